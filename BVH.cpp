@@ -514,9 +514,11 @@ void  BVH::OutputHierarchy(
 
 
 //
-//  BVH骨格・姿勢の描画関数
+//  BVH骨格・姿勢の描画関数（SH_GL_DISABLED を定義した場合は除く）
 //
 
+#ifndef  SH_GL_DISABLED
+
 #include <math.h>
 #define  FREEGLUT_STATIC
 #include <gl/glut.h>
@@ -685,5 +687,7 @@ void  BVH::RenderBone( float x0, float y0, float z0, float x1, float y1, float z
 }
 
 
+#endif // SH_GL_DISABLED
+
 
 // End of BVH.cpp
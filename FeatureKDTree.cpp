@@ -0,0 +1,224 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  特徴ベクトルの最近傍探索（kd木）
+**/
+
+
+// ライブラリ・クラス定義の読み込み
+#include "FeatureKDTree.h"
+
+// 標準ライブラリの読み込み
+#include <float.h>
+#include <algorithm>
+
+
+//
+//  ２つの特徴ベクトルの距離の２乗を計算
+//（途中で limit 以上になった場合は、その時点の値を返す）
+//
+static inline float  ComputeSquaredDistance( const float * a, const float * b, int dim, float limit )
+{
+	float  sum = 0.0f;
+	int  i = 0;
+	for ( ; i + 4 <= dim; i += 4 )
+	{
+		float  d0 = a[ i ] - b[ i ], d1 = a[ i + 1 ] - b[ i + 1 ], d2 = a[ i + 2 ] - b[ i + 2 ], d3 = a[ i + 3 ] - b[ i + 3 ];
+		sum += d0 * d0 + d1 * d1 + d2 * d2 + d3 * d3;
+		if ( sum >= limit )
+			return  sum;
+	}
+	for ( ; i < dim; i++ )
+	{
+		float  d = a[ i ] - b[ i ];
+		sum += d * d;
+	}
+	return  sum;
+}
+
+
+
+//
+//  コンストラクタ
+//
+FeatureKDTree::FeatureKDTree()
+{
+	dim = 0;
+	leaf_size = 16;
+}
+
+
+//
+//  全情報の削除
+//
+void  FeatureKDTree::Clear()
+{
+	dim = 0;
+	points.clear();
+	point_ids.clear();
+	nodes.clear();
+}
+
+
+//
+//  kd木の構築
+//
+void  FeatureKDTree::Build( const float * data, int num_points, int new_dim, int new_leaf_size )
+{
+	Clear();
+	if ( !data || ( num_points <= 0 ) || ( new_dim <= 0 ) )
+		return;
+
+	dim = new_dim;
+	leaf_size = max( new_leaf_size, 1 );
+
+	// 点の番号の配列を並べ替えながら、ノードを再帰的に構築
+	vector< int >  indices( num_points );
+	for ( int i = 0; i < num_points; i++ )
+		indices[ i ] = i;
+	nodes.reserve( 2 * ( num_points / leaf_size + 1 ) );
+	BuildNode( data, indices, 0, num_points );
+
+	// 探索時のメモリアクセスが連続になるように、特徴ベクトルを葉ノードの順番に並べ替えて格納
+	points.resize( (size_t) num_points * dim );
+	point_ids.swap( indices );
+	for ( int i = 0; i < num_points; i++ )
+		copy( data + (size_t) point_ids[ i ] * dim, data + (size_t)( point_ids[ i ] + 1 ) * dim, &points[ (size_t) i * dim ] );
+}
+
+
+//
+//  ノードの構築（再帰呼び出し）
+//
+int  FeatureKDTree::BuildNode( const float * data, vector< int > & indices, int begin, int end )
+{
+	int  node_no = (int) nodes.size();
+	nodes.push_back( Node() );
+	nodes[ node_no ].begin = begin;
+	nodes[ node_no ].end = end;
+	nodes[ node_no ].split_dim = -1;
+	nodes[ node_no ].split_value = 0.0f;
+	nodes[ node_no ].left = -1;
+	nodes[ node_no ].right = -1;
+
+	// 点の数が少なければ葉ノードとする
+	if ( end - begin <= leaf_size )
+		return  node_no;
+
+	// 値の範囲が最大の次元を分割する次元とする
+	int  split_dim = 0;
+	float  max_range = -1.0f;
+	for ( int d = 0; d < dim; d++ )
+	{
+		float  min_value = FLT_MAX, max_value = -FLT_MAX;
+		for ( int i = begin; i < end; i++ )
+		{
+			float  v = data[ (size_t) indices[ i ] * dim + d ];
+			min_value = min( min_value, v );
+			max_value = max( max_value, v );
+		}
+		if ( max_value - min_value > max_range )
+		{
+			max_range = max_value - min_value;
+			split_dim = d;
+		}
+	}
+
+	// 全ての点が同じ位置にあれば葉ノードとする
+	if ( max_range <= 0.0f )
+		return  node_no;
+
+	// 中央値で分割
+	int  mid = ( begin + end ) / 2;
+	nth_element( indices.begin() + begin, indices.begin() + mid, indices.begin() + end, [&]( int a, int b )
+	{
+		return  data[ (size_t) a * dim + split_dim ] < data[ (size_t) b * dim + split_dim ];
+	} );
+	float  split_value = data[ (size_t) indices[ mid ] * dim + split_dim ];
+
+	// 子ノードを構築（nodes の再確保に備えて、番号で参照する）
+	int  left = BuildNode( data, indices, begin, mid );
+	int  right = BuildNode( data, indices, mid, end );
+	nodes[ node_no ].split_dim = split_dim;
+	nodes[ node_no ].split_value = split_value;
+	nodes[ node_no ].left = left;
+	nodes[ node_no ].right = right;
+
+	return  node_no;
+}
+
+
+//
+//  最近傍の点を探索
+//
+int  FeatureKDTree::FindNearest( const float * query, float * distance_sq ) const
+{
+	int  best = -1;
+	float  best_distance = FLT_MAX;
+	if ( !nodes.empty() )
+		SearchNode( 0, query, best, best_distance );
+
+	if ( distance_sq )
+		*distance_sq = best_distance;
+	return  ( best >= 0 ) ? point_ids[ best ] : -1;
+}
+
+
+//
+//  ノードの探索（再帰呼び出し）
+// （クエリ側の子ノードを先に探索し、分割面までの距離が現在の最近傍の距離より近い場合のみ反対側を探索）
+//
+void  FeatureKDTree::SearchNode( int node_no, const float * query, int & best, float & best_distance ) const
+{
+	const Node &  node = nodes[ node_no ];
+
+	// 葉ノードであれば、全ての点との距離を計算
+	if ( node.split_dim < 0 )
+	{
+		for ( int i = node.begin; i < node.end; i++ )
+		{
+			float  d = ComputeSquaredDistance( query, &points[ (size_t) i * dim ], dim, best_distance );
+			if ( d < best_distance )
+			{
+				best_distance = d;
+				best = i;
+			}
+		}
+		return;
+	}
+
+	float  diff = query[ node.split_dim ] - node.split_value;
+	int  near_child = ( diff < 0.0f ) ? node.left : node.right;
+	int  far_child = ( diff < 0.0f ) ? node.right : node.left;
+
+	SearchNode( near_child, query, best, best_distance );
+	if ( diff * diff < best_distance )
+		SearchNode( far_child, query, best, best_distance );
+}
+
+
+//
+//  最近傍の点を全探索で探索（kd木の探索結果の検証用）
+//
+int  FeatureKDTree::FindNearestBruteForce( const float * query, float * distance_sq ) const
+{
+	int  best = -1;
+	float  best_distance = FLT_MAX;
+	for ( int i = 0; i < (int)point_ids.size(); i++ )
+	{
+		float  d = ComputeSquaredDistance( query, &points[ (size_t) i * dim ], dim, best_distance );
+		if ( d < best_distance )
+		{
+			best_distance = d;
+			best = i;
+		}
+	}
+
+	if ( distance_sq )
+		*distance_sq = best_distance;
+	return  ( best >= 0 ) ? point_ids[ best ] : -1;
+}
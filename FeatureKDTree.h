@@ -0,0 +1,93 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  特徴ベクトルの最近傍探索（kd木）
+**/
+
+#ifndef  _FEATURE_KD_TREE_H_
+#define  _FEATURE_KD_TREE_H_
+
+
+// 標準ライブラリの読み込み
+#include <stddef.h>
+
+// STL（Standard Template Library）を使用
+#include <vector>
+using namespace  std;
+
+
+//
+//  特徴ベクトルの最近傍探索のための kd木クラス
+// （各ノードで値の範囲が最大の次元を中央値で分割し、葉ノードには複数の点を格納する）
+//
+class  FeatureKDTree
+{
+  protected:
+	// kd木のノード
+	struct  Node
+	{
+		// ノードに含まれる点の範囲（並べ替え後の点の番号、begin 以上 end 未満）
+		int  begin;
+		int  end;
+
+		// 分割する次元と分割位置（葉ノードの場合は split_dim = -1）
+		int    split_dim;
+		float  split_value;
+
+		// 子ノードの番号（葉ノードの場合は -1）
+		int  left;
+		int  right;
+	};
+
+  protected:
+	// 特徴ベクトルの次元数
+	int  dim;
+
+	// 葉ノードに格納する最大の点の数
+	int  leaf_size;
+
+	// 特徴ベクトルの配列（kd木の葉ノードの順番に並べ替え） [点の番号 * dim + 次元]
+	vector< float >  points;
+
+	// 並べ替え後の各点の元の番号 [点の番号]
+	vector< int >  point_ids;
+
+	// ノードの配列（先頭がルートノード）
+	vector< Node >  nodes;
+
+  public:
+	// コンストラクタ
+	FeatureKDTree();
+
+  public:
+	// kd木の構築（特徴ベクトルの配列 data [点の番号 * dim + 次元] を指定）
+	void  Build( const float * data, int num_points, int dim, int leaf_size = 16 );
+
+	// 全情報の削除
+	void  Clear();
+
+	// 最近傍の点を探索（元の点の番号を返す、点がなければ -1、distance_sq には距離の２乗を出力）
+	int  FindNearest( const float * query, float * distance_sq = NULL ) const;
+
+	// 最近傍の点を全探索で探索（kd木の探索結果の検証用）
+	int  FindNearestBruteForce( const float * query, float * distance_sq = NULL ) const;
+
+  public:
+	// 情報取得
+	int  GetNumPoints() const { return  (int) point_ids.size(); }
+	int  GetDimension() const { return  dim; }
+
+  protected:
+	// ノードの構築（再帰呼び出し）
+	int  BuildNode( const float * data, vector< int > & indices, int begin, int end );
+
+	// ノードの探索（再帰呼び出し）
+	void  SearchNode( int node_no, const float * query, int & best, float & best_distance ) const;
+};
+
+
+#endif // _FEATURE_KD_TREE_H_
@@ -130,86 +130,3 @@ void  ForwardKinematicsApp::Animation( float delta )
 	// 順運動学計算
 	MyForwardKinematics( *curr_posture, segment_frames, joint_positions );
 }
-
-
-//
-//  順運動学計算
-//
-void  MyForwardKinematics( const Posture & posture, vector< Matrix4f > & seg_frame_array, vector< Point3f > & joi_pos_array )
-{
-	// 配列初期化
-	seg_frame_array.resize( posture.body->num_segments );
-	joi_pos_array.resize( posture.body->num_joints );
-
-	// ルート体節の位置・向きを設定
-	seg_frame_array[ 0 ].set( posture.root_ori, posture.root_pos, 1.0f );
-
-	// Forward Kinematics 計算のための反復計算（ルート体節から末端体節に向かって繰り返し計算）
-	MyForwardKinematicsIteration( posture.body->segments[ 0 ], NULL, posture, &seg_frame_array.front(), &joi_pos_array.front() );
-}
-
-
-//
-//  Forward Kinematics 計算のための反復計算（ルート体節から末端体節に向かって繰り返し再帰呼び出し）
-//
-void  MyForwardKinematicsIteration( 
-	const Segment *  segment, const Segment * prev_segment, const Posture & posture, 
-	Matrix4f * seg_frame_array, Point3f * joi_pos_array )
-{
-	// 骨格情報
-	const Skeleton *  body = posture.body;
-
-	// 次の関節・体節
-	Joint *  next_joint;
-	Segment *  next_segment;
-
-	// 次の関節・体節の変換行列
-	Matrix4f  frame;
-
-	// 計算用のベクトル・行列
-	Vector3f  pos;
-	Matrix4f  mat;
-	
-	// 現在の体節に接続している各関節に対して繰り返し
-	for ( int j = 0; j < segment->num_joints; j++ )
-	{
-		// 次の関節・次の体節を取得
-		next_joint = segment->joints[ j ];
-		if ( next_joint->segments[ 0 ] != segment )
-			next_segment = next_joint->segments[ 0 ];
-		else
-			next_segment = next_joint->segments[ 1 ];
-
-		// 前の体節側（ルート体節側）の関節はスキップ
-		if ( next_segment == prev_segment )
-			continue;
-
-		// 現在の体節の変換行列を取得
-		frame = seg_frame_array[ segment->index ];
-		
-		// ※ レポート課題
-
-		// 現在の体節の座標系から、接続関節への座標系への平行移動をかける
-//		???;
-
-		// 次の関節の位置を設定
-		if ( joi_pos_array )
-			joi_pos_array[ next_joint->index ] = pos;
-
-		// 関節の回転行列をかける
-//		???;
-
-		// 関節の座標系から、次の体節の座標系への平行移動をかける
-//		???;
-
-		// 次の体節の変換行列を設定
-		if ( seg_frame_array )
-			seg_frame_array[ next_segment->index ] = frame;
-
-		// 次の体節に対して繰り返し（再帰呼び出し）
-		MyForwardKinematicsIteration( next_segment, segment, posture, seg_frame_array, joi_pos_array );
-	}
-}
-
-
-
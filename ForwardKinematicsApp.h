@@ -15,6 +15,7 @@
 // ライブラリ・クラス定義の読み込み
 #include "SimpleHuman.h"
 #include "SimpleHumanGLUT.h"
+#include "MyForwardKinematics.h"
 #include "MotionPlaybackApp.h"
 
 
@@ -51,14 +52,4 @@ class  ForwardKinematicsApp : public MotionPlaybackApp
 };
 
 
-// 補助処理（グローバル関数）のプロトタイプ宣言
-
-// 順運動学計算（※レポート課題）
-void  MyForwardKinematics( const Posture & posture, vector< Matrix4f > & seg_frame_array, vector< Point3f > & joi_pos_array );
-
-// 順運動学計算のための反復計算（ルート体節から末端体節に向かって繰り返し再帰呼び出し）（※レポート課題）
-void  MyForwardKinematicsIteration( const Segment *  segment, const Segment * prev_segment, const Posture & posture, 
-	Matrix4f * seg_frame_array, Point3f * joi_pos_array = NULL );
-
-
 #endif // _FORWARD_KINEMATICS_APP_H_
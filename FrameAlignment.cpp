@@ -0,0 +1,260 @@
+#include "FrameAlignment.h"
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+
+// 経路を設定
+bool FrameAlignmentPath::Set(const std::vector<int>& frames1, const std::vector<int>& frames2) {
+    if (frames1.size() != frames2.size() || frames1.empty())
+        return false;
+    if (frames1[0] < 0 || frames2[0] < 0)
+        return false;
+    for (size_t k = 1; k < frames1.size(); ++k) {
+        int d1 = frames1[k] - frames1[k - 1];
+        int d2 = frames2[k] - frames2[k - 1];
+        if (d1 < 0 || d1 > 1 || d2 < 0 || d2 > 1 || (d1 == 0 && d2 == 0))
+            return false;
+    }
+    frames[0] = frames1;
+    frames[1] = frames2;
+    return true;
+}
+
+// DTW の経路の表から設定
+bool FrameAlignmentPath::SetFromPassTable(const std::vector<std::vector<int> >& pass, int num_steps) {
+    if (pass.size() < 2 || num_steps <= 0 || (int)pass[0].size() < num_steps || (int)pass[1].size() < num_steps)
+        return false;
+    std::vector<int> frames1(pass[0].begin(), pass[0].begin() + num_steps);
+    std::vector<int> frames2(pass[1].begin(), pass[1].begin() + num_steps);
+    return Set(frames1, frames2);
+}
+
+// 動作1のフレームに対応付けられた動作2のフレーム
+int FrameAlignmentPath::GetPairedFrame(int frame1) const {
+    if (Empty())
+        return frame1;
+    const std::vector<int>& f1 = frames[0];
+    const std::vector<int>& f2 = frames[1];
+    if (frame1 < f1.front())
+        return (std::max)(0, f2.front() - (f1.front() - frame1));
+    if (frame1 > f1.back())
+        return f2.back() + (frame1 - f1.back());
+    size_t step = std::lower_bound(f1.begin(), f1.end(), frame1) - f1.begin();
+    return f2[step];
+}
+
+// 動作1のフレームの範囲に対応する段の範囲
+void FrameAlignmentPath::GetStepRange(int frame1_begin, int frame1_end, int& step_begin, int& step_end) const {
+    const std::vector<int>& f1 = frames[0];
+    step_begin = (int)(std::lower_bound(f1.begin(), f1.end(), frame1_begin) - f1.begin());
+    step_end = (int)(std::upper_bound(f1.begin(), f1.end(), frame1_end) - f1.begin()) - 1;
+}
+
+// 段の範囲で動作のフレームが対応付けられた回数
+void FrameAlignmentPath::CountFrames(int motion_no, int step_begin, int step_end, int& frame_begin, std::vector<int>& counts) const {
+    counts.clear();
+    frame_begin = 0;
+    step_begin = (std::max)(step_begin, 0);
+    step_end = (std::min)(step_end, GetNumSteps() - 1);
+    if (step_begin > step_end)
+        return;
+
+    // 経路のフレーム番号は段ごとに増えるため、範囲内のフレームは連続する
+    const std::vector<int>& f = frames[motion_no ? 1 : 0];
+    frame_begin = f[step_begin];
+    counts.assign(f[step_end] - frame_begin + 1, 0);
+    for (int k = step_begin; k <= step_end; ++k)
+        ++counts[f[k] - frame_begin];
+}
+
+// フレームキャッシュからフレームごとの特徴量の要約を計算
+void ComputeFrameFeatureSummaries(const FrameVoxelCacheView& cache, std::vector<float>& out, int& dims) {
+    // 占有率の合計は姿勢によらずほぼ一定のため、動きを表す4つの特徴量のみを使う
+    const int kFirstFeature = 1;
+    const int kNumFeatures = 4;
+
+    int num_frames = cache.GetNumFrames();
+    int num_segments = cache.GetNumSegments();
+    dims = kNumFeatures * num_segments;
+    out.assign((size_t)num_frames * dims, 0.0f);
+
+    for (int f = 0; f < num_frames; ++f) {
+        float* summary = &out[(size_t)f * dims];
+        for (int s = 0; s < num_segments; ++s) {
+            for (int k = 0; k < kNumFeatures; ++k) {
+                double sum = 0.0;
+                cache.ForEachVoxel(f, s, kFirstFeature + k, [&](int, float v) {
+                    sum += v;
+                });
+                summary[s * kNumFeatures + k] = (float)sum;
+            }
+        }
+    }
+}
+
+// 2つの要約の列を標準化
+void NormalizeFrameFeatureSummaries(std::vector<float>& a, std::vector<float>& b, int dims) {
+    if (dims <= 0)
+        return;
+    size_t n = a.size() / dims;
+    size_t m = b.size() / dims;
+    if (n + m == 0)
+        return;
+
+    for (int d = 0; d < dims; ++d) {
+        double sum = 0.0, sum_sq = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += a[i * dims + d];
+            sum_sq += (double)a[i * dims + d] * a[i * dims + d];
+        }
+        for (size_t i = 0; i < m; ++i) {
+            sum += b[i * dims + d];
+            sum_sq += (double)b[i * dims + d] * b[i * dims + d];
+        }
+        double mean = sum / (n + m);
+        double var = sum_sq / (n + m) - mean * mean;
+        double inv_std = (var > 1e-12) ? 1.0 / sqrt(var) : 0.0;
+        for (size_t i = 0; i < n; ++i)
+            a[i * dims + d] = (float)((a[i * dims + d] - mean) * inv_std);
+        for (size_t i = 0; i < m; ++i)
+            b[i * dims + d] = (float)((b[i * dims + d] - mean) * inv_std);
+    }
+}
+
+// 2つのフレームの要約の距離（二乗誤差）
+static float fa_distance(const float* a, const float* b, int dims) {
+    float sum = 0.0f;
+    for (int d = 0; d < dims; ++d) {
+        float diff = a[d] - b[d];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+// 列を半分の長さに縮める（隣り合う2フレームの平均、奇数なら最後のフレームはそのまま）
+static void fa_halve_sequence(const float* x, int n, int dims, std::vector<float>& out) {
+    int half = (n + 1) / 2;
+    out.resize((size_t)half * dims);
+    for (int i = 0; i < half; ++i) {
+        const float* p = x + (size_t)(2 * i) * dims;
+        float* o = &out[(size_t)i * dims];
+        if (2 * i + 1 < n) {
+            const float* q = p + dims;
+            for (int d = 0; d < dims; ++d)
+                o[d] = 0.5f * (p[d] + q[d]);
+        } else {
+            for (int d = 0; d < dims; ++d)
+                o[d] = p[d];
+        }
+    }
+}
+
+// 行ごとの列の範囲 [lo[i], hi[i]] のみで DTW を計算し、経路を求める
+// 累積コストは窓の中のセルのみを行ごとに詰めて保持する
+static bool fa_dtw_in_window(const float* a, int n, const float* b, int m, int dims,
+                             const std::vector<int>& lo, const std::vector<int>& hi,
+                             std::vector<int>& path1, std::vector<int>& path2) {
+    std::vector<size_t> offsets(n + 1, 0);
+    for (int i = 0; i < n; ++i)
+        offsets[i + 1] = offsets[i] + (size_t)(hi[i] - lo[i] + 1);
+    std::vector<float> cost(offsets[n], FLT_MAX);
+
+    // 窓の中のセルの累積コスト（窓の外は FLT_MAX）
+    auto at = [&](int i, int j) -> float {
+        if (i < 0 || j < lo[i] || j > hi[i])
+            return FLT_MAX;
+        return cost[offsets[i] + (j - lo[i])];
+    };
+
+    for (int i = 0; i < n; ++i) {
+        const float* ai = a + (size_t)i * dims;
+        for (int j = lo[i]; j <= hi[i]; ++j) {
+            float best;
+            if (i == 0 && j == 0)
+                best = 0.0f;
+            else
+                best = (std::min)(at(i - 1, j - 1), (std::min)(at(i - 1, j), at(i, j - 1)));
+            if (best == FLT_MAX)
+                continue;
+            cost[offsets[i] + (j - lo[i])] = best + fa_distance(ai, b + (size_t)j * dims, dims);
+        }
+    }
+    if (at(n - 1, m - 1) == FLT_MAX)
+        return false;
+
+    // 終端から累積コストの小さい前のセルをたどる（同じなら斜めを優先）
+    path1.clear();
+    path2.clear();
+    int i = n - 1, j = m - 1;
+    path1.push_back(i);
+    path2.push_back(j);
+    while (i > 0 || j > 0) {
+        float diag = at(i - 1, j - 1);
+        float up = at(i - 1, j);
+        float left = at(i, j - 1);
+        if (diag <= up && diag <= left) {
+            --i;
+            --j;
+        } else if (up <= left) {
+            --i;
+        } else {
+            --j;
+        }
+        path1.push_back(i);
+        path2.push_back(j);
+    }
+    std::reverse(path1.begin(), path1.end());
+    std::reverse(path2.begin(), path2.end());
+    return true;
+}
+
+// FastDTW の再帰（短い列は窓を制限せずに計算）
+static bool fa_fast_dtw(const float* a, int n, const float* b, int m, int dims, int radius,
+                        std::vector<int>& path1, std::vector<int>& path2) {
+    std::vector<int> lo(n), hi(n);
+    if (n <= radius + 2 || m <= radius + 2) {
+        std::fill(lo.begin(), lo.end(), 0);
+        std::fill(hi.begin(), hi.end(), m - 1);
+        return fa_dtw_in_window(a, n, b, m, dims, lo, hi, path1, path2);
+    }
+
+    // 半分の長さの列の経路を求め、元の長さの列に投影して radius フレーム広げた範囲を窓とする
+    std::vector<float> half_a, half_b;
+    fa_halve_sequence(a, n, dims, half_a);
+    fa_halve_sequence(b, m, dims, half_b);
+    std::vector<int> coarse1, coarse2;
+    if (!fa_fast_dtw(half_a.data(), (n + 1) / 2, half_b.data(), (m + 1) / 2, dims, radius, coarse1, coarse2))
+        return false;
+    half_a.clear();
+    half_a.shrink_to_fit();
+    half_b.clear();
+    half_b.shrink_to_fit();
+
+    std::fill(lo.begin(), lo.end(), INT_MAX);
+    std::fill(hi.begin(), hi.end(), -1);
+    for (size_t k = 0; k < coarse1.size(); ++k) {
+        int i_begin = (std::max)(2 * coarse1[k] - radius, 0);
+        int i_end = (std::min)(2 * coarse1[k] + 1 + radius, n - 1);
+        int j_begin = (std::max)(2 * coarse2[k] - radius, 0);
+        int j_end = (std::min)(2 * coarse2[k] + 1 + radius, m - 1);
+        for (int i = i_begin; i <= i_end; ++i) {
+            lo[i] = (std::min)(lo[i], j_begin);
+            hi[i] = (std::max)(hi[i], j_end);
+        }
+    }
+    return fa_dtw_in_window(a, n, b, m, dims, lo, hi, path1, path2);
+}
+
+// 2つの列の DTW の経路を FastDTW で計算
+bool ComputeFastDTWAlignment(const float* a, int n, const float* b, int m, int dims, int radius, FrameAlignmentPath& out) {
+    if (!a || !b || n <= 0 || m <= 0 || dims <= 0)
+        return false;
+    if (radius < 1)
+        radius = 1;
+
+    std::vector<int> path1, path2;
+    if (!fa_fast_dtw(a, n, b, m, dims, radius, path1, path2))
+        return false;
+    return out.Set(path1, path2);
+}
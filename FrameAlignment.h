@@ -0,0 +1,49 @@
+#pragma once
+#include <vector>
+#include "FrameVoxelStore.h"
+
+// 2つの動作のフレームの対応付け（DTW の経路）
+// 経路の段ごとに動作1・動作2のフレーム番号の組を持ち、どちらのフレーム番号も段ごとに 0 または 1 ずつ増える
+// （テンポの異なる2つの動作を、同じ時刻ではなく対応する動きのフレームどうしで比較するために使う）
+class FrameAlignmentPath {
+public:
+    void Clear() { frames[0].clear(); frames[1].clear(); }
+    bool Empty() const { return frames[0].empty(); }
+    int GetNumSteps() const { return (int)frames[0].size(); }
+
+    // 段の動作（motion_no は 0 または 1）のフレーム番号
+    int GetFrame(int motion_no, int step) const { return frames[motion_no ? 1 : 0][step]; }
+
+    // 経路を設定（段ごとのフレーム番号の増分が 0 または 1 でなければ設定せず false を返す）
+    bool Set(const std::vector<int>& frames1, const std::vector<int>& frames2);
+
+    // DTW の経路の表（pass[0]・pass[1] に段ごとの動作1・動作2のフレーム番号、MotionPlaybackApp の DisPassAll と同じ形式）から設定
+    bool SetFromPassTable(const std::vector<std::vector<int> >& pass, int num_steps);
+
+    // 動作1のフレームに対応付けられた動作2のフレーム（複数あれば最初の段、経路の範囲外は端の段から同じ間隔で延長）
+    int GetPairedFrame(int frame1) const;
+
+    // 動作1のフレームの範囲 [frame1_begin, frame1_end] に対応する段の範囲（経路が空なら step_begin > step_end）
+    void GetStepRange(int frame1_begin, int frame1_end, int& step_begin, int& step_end) const;
+
+    // 段の範囲 [step_begin, step_end] で動作のフレームが対応付けられた回数（counts[k] がフレーム frame_begin + k の回数）
+    void CountFrames(int motion_no, int step_begin, int step_end, int& frame_begin, std::vector<int>& counts) const;
+
+    bool operator==(const FrameAlignmentPath& other) const { return frames[0] == other.frames[0] && frames[1] == other.frames[1]; }
+    bool operator!=(const FrameAlignmentPath& other) const { return !(*this == other); }
+
+private:
+    std::vector<int> frames[2];
+};
+
+// フレームキャッシュからフレームごとの特徴量の要約（部位ごとの速度・ジャーク・慣性モーメント・慣性主軸角速度の合計）を計算
+// out はフレーム数 × dims の配列（dims = 4 × 部位数）で、ルートの位置・向きによらない
+void ComputeFrameFeatureSummaries(const FrameVoxelCacheView& cache, std::vector<float>& out, int& dims);
+
+// 2つの要約の列を次元ごとに両方の列を合わせた平均・標準偏差で標準化（ばらつきのない次元は 0）
+void NormalizeFrameFeatureSummaries(std::vector<float>& a, std::vector<float>& b, int dims);
+
+// 2つの列（n × dims, m × dims）の DTW の経路を FastDTW で計算
+// 列を半分に縮めた経路を再帰的に求め、その周辺 radius フレームの範囲のみで DTW を計算するため、
+// 計算量・使用メモリは (n + m) × radius に比例し、n × m の行列は確保しない
+bool ComputeFastDTWAlignment(const float* a, int n, const float* b, int m, int dims, int radius, FrameAlignmentPath& out);
@@ -0,0 +1,236 @@
+#include "FrameRangeIndex.h"
+#include "ScratchArena.h"
+#include <algorithm>
+#include <cstring>
+
+// ボクセル番号・ブロック番号・値の記録（構築時の作業用）
+struct FrameRangeBuildRecord {
+    int index;
+    int block;
+    float value;
+
+    bool operator<(const FrameRangeBuildRecord& r) const {
+        return (index != r.index) ? (index < r.index) : (block < r.block);
+    }
+};
+
+// 1 以上の n に対して floor(log2(n)) を計算
+static int fri_floor_log2(int n) {
+    int k = 0;
+    while ((2 << k) <= n)
+        ++k;
+    return k;
+}
+
+FrameRangeIndex::FrameRangeIndex() : feature(0), num_frames(0), block_size(16) {}
+
+void FrameRangeIndex::Clear() {
+    segments.clear();
+    num_frames = 0;
+}
+
+size_t FrameRangeIndex::GetMemoryBytes() const {
+    size_t bytes = 0;
+    for (size_t s = 0; s < segments.size(); ++s) {
+        const SegmentIndex& seg = segments[s];
+        bytes += seg.voxels.capacity() * sizeof(int) + seg.offsets.capacity() * sizeof(int) + seg.blocks.capacity() * sizeof(int);
+        bytes += seg.prefix.capacity() * sizeof(double);
+        bytes += seg.table_offsets.capacity() * sizeof(int) + seg.table.capacity() * sizeof(float);
+    }
+    return bytes;
+}
+
+// フレームキャッシュの指定特徴量から索引を構築
+void FrameRangeIndex::Build(const FrameVoxelCacheView& cache, int feat, int block) {
+    Clear();
+    feature = feat;
+    block_size = (block > 0) ? block : 1;
+    if (cache.Empty())
+        return;
+
+    int frames = cache.GetNumFrames();
+    int num_segments = cache.GetNumSegments();
+    segments.resize(num_segments);
+
+    std::vector<FrameRangeBuildRecord> records;
+    for (int s = 0; s < num_segments; ++s) {
+        SegmentIndex& seg = segments[s];
+
+        // 部位の全フレームの値を記録し、ボクセル番号・ブロック番号順に整列
+        records.clear();
+        for (int f = 0; f < frames; ++f) {
+            int b = f / block_size;
+            cache.ForEachVoxel(f, s, feature, [&](int index, float v) {
+                FrameRangeBuildRecord r;
+                r.index = index;
+                r.block = b;
+                r.value = v;
+                records.push_back(r);
+            });
+        }
+        std::stable_sort(records.begin(), records.end());
+
+        // 同じボクセル・ブロックの記録をまとめる（占有率は合計、それ以外は最大値）
+        size_t n = 0;
+        for (size_t i = 0; i < records.size(); ++i) {
+            if (n > 0 && records[n - 1].index == records[i].index && records[n - 1].block == records[i].block) {
+                if (feature == 0)
+                    records[n - 1].value += records[i].value;
+                else if (records[i].value > records[n - 1].value)
+                    records[n - 1].value = records[i].value;
+            } else {
+                records[n++] = records[i];
+            }
+        }
+        records.resize(n);
+
+        // ボクセルごとのブロックの記録
+        seg.blocks.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            if (i == 0 || records[i].index != records[i - 1].index) {
+                seg.voxels.push_back(records[i].index);
+                seg.offsets.push_back((int)i);
+            }
+            seg.blocks[i] = records[i].block;
+        }
+        seg.offsets.push_back((int)n);
+
+        int num_voxels = (int)seg.voxels.size();
+        if (feature == 0) {
+            // ボクセルごとの累積和
+            seg.prefix.resize(n);
+            for (int v = 0; v < num_voxels; ++v) {
+                double sum = 0.0;
+                for (int i = seg.offsets[v]; i < seg.offsets[v + 1]; ++i) {
+                    sum += records[i].value;
+                    seg.prefix[i] = sum;
+                }
+            }
+        } else {
+            // ボクセルごとの疎テーブル
+            seg.table_offsets.resize(num_voxels + 1);
+            size_t table_size = 0;
+            for (int v = 0; v < num_voxels; ++v) {
+                seg.table_offsets[v] = (int)table_size;
+                int len = seg.offsets[v + 1] - seg.offsets[v];
+                for (int k = 0; (1 << k) <= len; ++k)
+                    table_size += len - (1 << k) + 1;
+            }
+            seg.table_offsets[num_voxels] = (int)table_size;
+            seg.table.resize(table_size);
+
+            for (int v = 0; v < num_voxels; ++v) {
+                int len = seg.offsets[v + 1] - seg.offsets[v];
+                float* level = &seg.table[seg.table_offsets[v]];
+                for (int i = 0; i < len; ++i)
+                    level[i] = records[seg.offsets[v] + i].value;
+                for (int k = 1; (1 << k) <= len; ++k) {
+                    const float* prev = level;
+                    int prev_len = len - (1 << (k - 1)) + 1;
+                    level += prev_len;
+                    int half = 1 << (k - 1);
+                    for (int i = 0; i + (1 << k) <= len; ++i)
+                        level[i] = (std::max)(prev[i], prev[i + half]);
+                }
+            }
+        }
+    }
+
+    num_frames = frames;
+}
+
+// ボクセル番号から部位の索引のボクセル位置を取得
+int FrameRangeIndex::FindVoxel(const SegmentIndex& seg, int index) {
+    std::vector<int>::const_iterator it = std::lower_bound(seg.voxels.begin(), seg.voxels.end(), index);
+    if (it == seg.voxels.end() || *it != index)
+        return -1;
+    return (int)(it - seg.voxels.begin());
+}
+
+// 部位の1フレーム分の値を作業領域に合成
+void FrameRangeIndex::AccumulateFrame(const FrameVoxelCacheView& cache, const SegmentIndex& seg, int frame, int segment, float* values) const {
+    cache.ForEachVoxel(frame, segment, feature, [&](int index, float v) {
+        int pos = FindVoxel(seg, index);
+        if (pos < 0)
+            return;
+        if (feature == 0)
+            values[pos] += v;
+        else if (v > values[pos])
+            values[pos] = v;
+    });
+}
+
+// 指定部位の区間の累積値を計算
+void FrameRangeIndex::QueryRange(const FrameVoxelCacheView& cache, int segment, int frame_begin, int frame_end,
+                                 std::vector<FrameRangeVoxelValue>& out) const {
+    out.clear();
+    if (segment < 0 || segment >= (int)segments.size())
+        return;
+    if (frame_begin < 0)
+        frame_begin = 0;
+    if (frame_end > num_frames - 1)
+        frame_end = num_frames - 1;
+    if (frame_begin > frame_end)
+        return;
+
+    const SegmentIndex& seg = segments[segment];
+    int num_voxels = (int)seg.voxels.size();
+    if (num_voxels == 0)
+        return;
+
+    // 区間に含まれるブロックの範囲 [b0, b1)（末尾のブロックは端数でも動作の末尾までなら含む）
+    int num_blocks = (num_frames + block_size - 1) / block_size;
+    int b0 = (frame_begin + block_size - 1) / block_size;
+    int b1 = (frame_end + 1 == num_frames) ? num_blocks : (frame_end + 1) / block_size;
+    if (b0 >= b1)
+        b0 = b1 = 0;
+
+    ScratchArena& arena = GetThreadScratchArena();
+    ScratchArenaScope scope(arena);
+    float* values = arena.AllocateArray<float>(num_voxels);
+    memset(values, 0, sizeof(float) * num_voxels);
+
+    // 区間に含まれるブロック
+    if (b0 < b1) {
+        for (int v = 0; v < num_voxels; ++v) {
+            const int* begin = &seg.blocks[0] + seg.offsets[v];
+            const int* end = &seg.blocks[0] + seg.offsets[v + 1];
+            const int* lo = std::lower_bound(begin, end, b0);
+            const int* hi = std::lower_bound(lo, end, b1);
+            if (lo == hi)
+                continue;
+            int i0 = (int)(lo - begin);
+            int i1 = (int)(hi - begin);
+            if (feature == 0) {
+                int base = seg.offsets[v];
+                double sum = seg.prefix[base + i1 - 1] - ((i0 > 0) ? seg.prefix[base + i0 - 1] : 0.0);
+                values[v] = (float)sum;
+            } else {
+                int len = (int)(end - begin);
+                int k = fri_floor_log2(i1 - i0);
+                const float* level = &seg.table[seg.table_offsets[v]];
+                for (int j = 0; j < k; ++j)
+                    level += len - (1 << j) + 1;
+                values[v] = (std::max)(level[i0], level[i1 - (1 << k)]);
+            }
+        }
+    }
+
+    // 端数フレーム
+    int head_end = (b0 < b1) ? b0 * block_size : frame_end + 1;
+    for (int f = frame_begin; f < head_end; ++f)
+        AccumulateFrame(cache, seg, f, segment, values);
+    if (b0 < b1) {
+        for (int f = b1 * block_size; f <= frame_end; ++f)
+            AccumulateFrame(cache, seg, f, segment, values);
+    }
+
+    for (int v = 0; v < num_voxels; ++v) {
+        if (values[v] <= 0.0f)
+            continue;
+        FrameRangeVoxelValue r;
+        r.index = seg.voxels[v];
+        r.value = values[v];
+        out.push_back(r);
+    }
+}
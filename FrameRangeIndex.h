@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include "FrameVoxelStore.h"
+
+// 区間の累積値（フレームキャッシュのボクセル番号と値）
+struct FrameRangeVoxelValue {
+    int index;
+    float value;
+};
+
+// フレームキャッシュの任意のフレーム区間の累積値（占有率は合計、速度・ジャーク・慣性モーメント・慣性主軸角速度は最大値）を求めるための索引
+// 1つの動作・1つの特徴量ごとに構築する
+// フレームを block_size フレームごとのブロックに分け、部位ごと・ボクセルごとに値を持つブロックのみを疎に保持する
+//   占有率 : ブロックの末尾までの累積和（prefix sum）
+//   その他 : ブロックの最大値の疎テーブル（sparse table、レベル k は連続する 2^k 個のブロックの最大値）
+// 区間 [f0, f1] に含まれるブロックは累積和の差・疎テーブルの2つの要素の最大値で求め、端の端数フレーム（合計でブロックの2倍未満）のみ直接読み出すため、
+// 区間の長さによらず部位のボクセル数に比例した時間で求められる
+// 値はフレームキャッシュのボクセル番号（各フレームの基準姿勢の座標系）のまま保持し、ルート姿勢に合わせた移動は呼び出し側で行う
+class FrameRangeIndex {
+public:
+    FrameRangeIndex();
+
+    // フレームキャッシュの指定特徴量から索引を構築（閾値以下の値はフレームキャッシュの構築時に除かれている）
+    void Build(const FrameVoxelCacheView& cache, int feature, int block_size = 16);
+    void Clear();
+
+    bool Empty() const { return num_frames == 0; }
+    int GetFeature() const { return feature; }
+    int GetNumFrames() const { return num_frames; }
+    int GetNumSegments() const { return (int)segments.size(); }
+    int GetBlockSize() const { return block_size; }
+    size_t GetMemoryBytes() const;
+
+    // 指定部位の区間 [frame_begin, frame_end] の累積値を、値が 0 より大きいボクセルのみ out に格納（ボクセル番号の昇順）
+    // cache には索引を構築したフレームキャッシュを指定する（端数フレームの読み出しに使用）
+    void QueryRange(const FrameVoxelCacheView& cache, int segment, int frame_begin, int frame_end,
+                    std::vector<FrameRangeVoxelValue>& out) const;
+
+private:
+    // 部位ごとの索引
+    // ボクセル v（voxels[v]）が値を持つブロックは blocks[offsets[v]] ～ blocks[offsets[v + 1] - 1]（昇順）
+    struct SegmentIndex {
+        std::vector<int> voxels;         // 部位が一度でも値を持ったボクセル番号（昇順）
+        std::vector<int> offsets;        // ボクセルごとのブロックの記録の開始位置（ボクセル数 + 1 個）
+        std::vector<int> blocks;         // 値を持つブロックの番号
+        std::vector<double> prefix;      // 占有率：ボクセルの先頭のブロックからそのブロックまでの合計（blocks と同じ並び）
+        std::vector<int> table_offsets;  // 最大値：ボクセルごとの疎テーブルの開始位置（ボクセル数 + 1 個）
+        std::vector<float> table;        // 最大値：ボクセルごとの疎テーブル（レベル 0 から順に、レベル k は記録数 - 2^k + 1 個）
+    };
+
+    // ボクセル番号から部位の索引のボクセル位置を取得（なければ -1）
+    static int FindVoxel(const SegmentIndex& seg, int index);
+
+    // 部位の1フレーム分の値を作業領域（ボクセル位置ごとの値）に合成
+    void AccumulateFrame(const FrameVoxelCacheView& cache, const SegmentIndex& seg, int frame, int segment, float* values) const;
+
+    int feature;
+    int num_frames;
+    int block_size;
+    std::vector<SegmentIndex> segments;
+};
@@ -0,0 +1,257 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  フレームの実行タイミングの管理（固定時間刻みのアニメーション更新、描画頻度の制限、待機）
+**/
+
+
+// ヘッダファイルのインクルード
+#include "FrameScheduler.h"
+
+// 標準ライブラリの読み込み
+#include <chrono>
+#include <thread>
+#include <cmath>
+
+
+// 長時間停止した後などに、一度に追いつこうとする経過時間の上限 [s]
+static const double  max_accumulated_time = 1.0;
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  フレームの実行タイミングの管理クラス
+//
+
+
+//
+//  コンストラクタ
+//
+FrameScheduler::FrameScheduler()
+{
+	fixed_step = 1.0f / 60.0f;
+	max_steps_per_update = 5;
+	max_frame_rate = 0.0f;
+	vsync = true;
+	idle_wait = 0.01f;
+
+	last_update_time = Now();
+	last_frame_time = 0.0;
+	accumulator = 0.0;
+	was_animating = false;
+	redraw_requests = 1;
+	render_start_time = 0.0;
+
+	stats.update_ms = 0.0f;
+	stats.render_ms = 0.0f;
+	stats.frame_interval_ms = 0.0f;
+	stats.update_steps = 0;
+	stats.budget_ms = GetFrameBudget() * 1000.0f;
+	stats.budget_usage = 0.0f;
+	stats.num_frames = 0;
+	stats.num_over_budget_frames = 0;
+	stats.dropped_time = 0.0;
+}
+
+
+//
+//  単調増加する時計の現在時刻 [s]（プログラム開始時からの経過時間）
+//
+double  FrameScheduler::Now()
+{
+	static const std::chrono::steady_clock::time_point  origin = std::chrono::steady_clock::now();
+	return  std::chrono::duration< double >( std::chrono::steady_clock::now() - origin ).count();
+}
+
+
+//
+//  アニメーション処理の固定の時間刻みを設定
+//
+void  FrameScheduler::SetFixedStep( float step )
+{
+	// 極端に小さい時間刻みは更新回数が増えすぎるため制限
+	if ( step < 0.001f )
+		step = 0.001f;
+	fixed_step = step;
+}
+
+
+//
+//  再描画を要求
+//
+void  FrameScheduler::RequestRedraw( int num_frames )
+{
+	if ( redraw_requests < num_frames )
+		redraw_requests = num_frames;
+}
+
+
+//
+//  次のフレームを開始するかどうかを判定
+//
+bool  FrameScheduler::IsFrameDue( bool animating ) const
+{
+	// アニメーション中でなく、再描画の要求もなければ描画しない
+	if ( !animating && ( redraw_requests <= 0 ) )
+		return  false;
+
+	// 描画頻度の上限を超える場合は描画しない
+	if ( ( max_frame_rate > 0.0f ) && ( Now() - last_frame_time < 1.0 / max_frame_rate ) )
+		return  false;
+
+	return  true;
+}
+
+
+//
+//  次のフレームの開始時刻まで待機
+//
+void  FrameScheduler::WaitForNextFrame( bool animating ) const
+{
+	double  wait = idle_wait;
+
+	// アニメーション中は、描画頻度の上限から決まる次のフレームの開始時刻まで待機
+	if ( ( animating || ( redraw_requests > 0 ) ) && ( max_frame_rate > 0.0f ) )
+	{
+		double  next_frame_time = last_frame_time + 1.0 / max_frame_rate;
+		double  remaining = next_frame_time - Now();
+		if ( remaining < wait )
+			wait = remaining;
+	}
+	if ( wait <= 0.0 )
+		return;
+
+	// スリープの精度は環境に依存するため、残り時間が短い場合は他のスレッドに処理を譲るのみとする
+	// （次の呼び出しで再度判定されるため、フレームの開始時刻が大きく遅れることはない）
+	const double  sleep_margin = 0.002;
+	if ( wait > sleep_margin )
+		std::this_thread::sleep_for( std::chrono::duration< double >( wait - sleep_margin * 0.5 ) );
+	else
+		std::this_thread::yield();
+}
+
+
+//
+//  更新処理の開始
+//
+int  FrameScheduler::BeginUpdate( bool animating )
+{
+	double  now = Now();
+
+	// アニメーション中でなければ経過時間を破棄（再開時に停止中の時間をまとめて進めないようにする）
+	if ( !animating )
+	{
+		last_update_time = now;
+		accumulator = 0.0;
+		was_animating = false;
+		stats.update_steps = 0;
+		return  0;
+	}
+
+	// アニメーションの開始直後は、経過時間の計測のみ開始
+	if ( !was_animating )
+	{
+		last_update_time = now;
+		accumulator = 0.0;
+		was_animating = true;
+	}
+
+	// 前回の更新からの経過時間を加算
+	accumulator += now - last_update_time;
+	last_update_time = now;
+	if ( accumulator > max_accumulated_time )
+	{
+		stats.dropped_time += accumulator - max_accumulated_time;
+		accumulator = max_accumulated_time;
+	}
+
+	// 固定時間刻みの更新回数を計算（上限を超える分の時間は切り捨てる）
+	int  steps = (int) floor( accumulator / fixed_step );
+	if ( steps > max_steps_per_update )
+	{
+		double  dropped = ( steps - max_steps_per_update ) * (double) fixed_step;
+		stats.dropped_time += dropped;
+		accumulator -= dropped;
+		steps = max_steps_per_update;
+	}
+	accumulator -= steps * (double) fixed_step;
+	if ( accumulator < 0.0 )
+		accumulator = 0.0;
+
+	stats.update_steps = steps;
+	return  steps;
+}
+
+
+//
+//  更新処理の終了
+//
+void  FrameScheduler::EndUpdate( double update_start_time )
+{
+	stats.update_ms = (float)( ( Now() - update_start_time ) * 1000.0 );
+}
+
+
+//
+//  補間の割合
+//
+float  FrameScheduler::GetInterpolationAlpha() const
+{
+	float  alpha = (float)( accumulator / fixed_step );
+	if ( alpha < 0.0f )
+		alpha = 0.0f;
+	if ( alpha > 1.0f )
+		alpha = 1.0f;
+	return  alpha;
+}
+
+
+//
+//  描画処理の開始
+//
+void  FrameScheduler::BeginRender()
+{
+	double  now = Now();
+	if ( last_frame_time > 0.0 )
+		stats.frame_interval_ms = (float)( ( now - last_frame_time ) * 1000.0 );
+	last_frame_time = now;
+	render_start_time = now;
+
+	if ( redraw_requests > 0 )
+		redraw_requests --;
+}
+
+
+//
+//  描画処理の終了
+//
+void  FrameScheduler::EndRender()
+{
+	stats.render_ms = (float)( ( Now() - render_start_time ) * 1000.0 );
+
+	// 予算の使用率を計算
+	stats.budget_ms = GetFrameBudget() * 1000.0f;
+	stats.budget_usage = ( stats.update_ms + stats.render_ms ) / stats.budget_ms;
+	stats.num_frames ++;
+	if ( stats.budget_usage > 1.0f )
+		stats.num_over_budget_frames ++;
+
+	// 更新処理の所要時間は次のフレームの更新で再設定する
+	stats.update_ms = 0.0f;
+}
+
+
+//
+//  １フレームの予算 [s] を取得
+//
+float  FrameScheduler::GetFrameBudget() const
+{
+	if ( max_frame_rate > 0.0f )
+		return  1.0f / max_frame_rate;
+	return  fixed_step;
+}
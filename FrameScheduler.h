@@ -0,0 +1,160 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  フレームの実行タイミングの管理（固定時間刻みのアニメーション更新、描画頻度の制限、待機）
+***
+***  単調増加する時計（std::chrono::steady_clock）で実時間の経過を計測し、
+***  経過時間を固定の時間刻みで分割してアニメーション処理を呼び出す（残りの時間は補間の割合として描画側に渡す）
+***  アニメーション中でなく、再描画の要求もないときは、描画を行わずに待機することで CPU の使用を抑える
+***  OpenGL / GLUT には依存しないため、描画処理とは独立に使用できる
+**/
+
+#ifndef  _FRAME_SCHEDULER_H_
+#define  _FRAME_SCHEDULER_H_
+
+
+//
+//  フレームの処理時間の統計
+//
+struct  FrameStats
+{
+	// 直近のフレームの更新処理（アニメーション処理）・描画処理の所要時間 [ms]
+	float  update_ms;
+	float  render_ms;
+
+	// 直近のフレームの間隔 [ms]
+	float  frame_interval_ms;
+
+	// 直近のフレームで実行した固定時間刻みの更新の回数
+	int  update_steps;
+
+	// １フレームの予算 [ms]（描画頻度の上限、上限がなければ固定時間刻みから決まる）
+	float  budget_ms;
+
+	// 直近のフレームの予算の使用率（更新処理＋描画処理の所要時間 ÷ 予算）
+	float  budget_usage;
+
+	// 描画したフレーム数・予算を超えたフレーム数・更新が追いつかずに切り捨てた時間の合計 [s]
+	long long  num_frames;
+	long long  num_over_budget_frames;
+	double  dropped_time;
+};
+
+
+//
+//  フレームの実行タイミングの管理クラス
+//
+class  FrameScheduler
+{
+  protected:
+	// 設定
+
+	// アニメーション処理の固定の時間刻み [s]
+	float  fixed_step;
+
+	// １回の更新で実行する固定時間刻みの最大回数（処理が追いつかない場合は残りの時間を切り捨てる）
+	int  max_steps_per_update;
+
+	// 描画頻度の上限 [fps]（0 なら制限なし）
+	float  max_frame_rate;
+
+	// 垂直同期を使用するかどうか（実際の設定は描画側で行う）
+	bool  vsync;
+
+	// アニメーション中でないときの待機時間の上限 [s]
+	float  idle_wait;
+
+  protected:
+	// 状態
+
+	// 前回の更新時刻・前回の描画開始時刻 [s]
+	double  last_update_time;
+	double  last_frame_time;
+
+	// 更新されていない経過時間 [s]
+	double  accumulator;
+
+	// 前回の更新時にアニメーション中だったかどうか
+	bool  was_animating;
+
+	// 残りの再描画の要求回数
+	int  redraw_requests;
+
+	// 描画処理の開始時刻 [s]
+	double  render_start_time;
+
+	// フレームの処理時間の統計
+	FrameStats  stats;
+
+  public:
+	// コンストラクタ
+	FrameScheduler();
+
+  public:
+	// 単調増加する時計の現在時刻 [s]（プログラム開始時からの経過時間）
+	static double  Now();
+
+  public:
+	// 設定
+
+	// アニメーション処理の固定の時間刻みを設定・取得
+	void  SetFixedStep( float step );
+	float  GetFixedStep() const { return  fixed_step; }
+
+	// １回の更新で実行する固定時間刻みの最大回数を設定・取得
+	void  SetMaxStepsPerUpdate( int max_steps ) { max_steps_per_update = ( max_steps < 1 ) ? 1 : max_steps; }
+	int  GetMaxStepsPerUpdate() const { return  max_steps_per_update; }
+
+	// 描画頻度の上限を設定・取得（0 なら制限なし）
+	void  SetMaxFrameRate( float fps ) { max_frame_rate = ( fps < 0.0f ) ? 0.0f : fps; }
+	float  GetMaxFrameRate() const { return  max_frame_rate; }
+
+	// 垂直同期の使用を設定・取得
+	void  SetVSync( bool enable ) { vsync = enable; }
+	bool  IsVSyncEnabled() const { return  vsync; }
+
+	// アニメーション中でないときの待機時間の上限を設定・取得
+	void  SetIdleWait( float wait ) { idle_wait = ( wait < 0.0f ) ? 0.0f : wait; }
+	float  GetIdleWait() const { return  idle_wait; }
+
+  public:
+	// フレームの処理
+
+	// 再描画を要求（入力処理などの後、ImGui の状態が反映されるまで数フレーム描画する）
+	void  RequestRedraw( int num_frames = 2 );
+
+	// 次のフレームを開始するかどうかを判定（アニメーション中か再描画の要求があり、描画頻度の上限を超えていなければ true）
+	bool  IsFrameDue( bool animating ) const;
+
+	// 次のフレームの開始時刻まで待機（アニメーション中でなければ、待機時間の上限まで待機）
+	void  WaitForNextFrame( bool animating ) const;
+
+	// 更新処理の開始（経過時間から実行する固定時間刻みの回数を計算して返す）
+	int  BeginUpdate( bool animating );
+
+	// 更新処理の終了（更新処理の所要時間を記録）
+	void  EndUpdate( double update_start_time );
+
+	// 補間の割合（最後の固定時間刻みの更新から、次の更新までの経過時間の割合 0～1）
+	float  GetInterpolationAlpha() const;
+
+	// 描画処理の開始・終了（描画処理の所要時間・予算の使用率を記録）
+	void  BeginRender();
+	void  EndRender();
+
+	// 再描画の要求が残っているかどうか
+	bool  HasRedrawRequest() const { return  redraw_requests > 0; }
+
+	// フレームの処理時間の統計を取得
+	const FrameStats &  GetStats() const { return  stats; }
+
+	// １フレームの予算 [s] を取得
+	float  GetFrameBudget() const;
+};
+
+
+#endif // _FRAME_SCHEDULER_H_
@@ -0,0 +1,427 @@
+#include "FrameVoxelStore.h"
+#include "Trace.h"
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char kFrameVoxelFileMagic[8] = {'S', 'H', 'F', 'V', 'O', 'X', '1', '\0'};
+static const unsigned int kFrameVoxelFileVersion = 3;
+
+// --- MemoryFrameVoxelStore ---
+
+bool MemoryFrameVoxelStore::Begin(int num_frames, int num_segments, int resolution, const std::vector<SegmentGridBounds>& segment_bounds,
+                                  float sparse_threshold) {
+    cache.Reset(num_frames, num_segments, resolution, sparse_threshold);
+    cache.segment_bounds = segment_bounds;
+    return true;
+}
+
+bool MemoryFrameVoxelStore::AppendFrame(const FrameSegmentVoxelGrid& frame) {
+    cache.AppendFrame(frame);
+    return true;
+}
+
+bool MemoryFrameVoxelStore::End() {
+    cache.ShrinkToFit();
+    return true;
+}
+
+void MemoryFrameVoxelStore::Abort() {
+    cache.Clear();
+}
+
+// --- MappedFile ---
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() : data(nullptr), size(0), file_handle(INVALID_HANDLE_VALUE), mapping_handle(nullptr) {}
+
+bool MappedFile::Open(const char* path) {
+    Close();
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart <= 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    file_handle = file;
+    mapping_handle = mapping;
+    data = static_cast<const unsigned char*>(view);
+    size = (size_t)file_size.QuadPart;
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data)
+        UnmapViewOfFile(data);
+    if (mapping_handle)
+        CloseHandle(mapping_handle);
+    if (file_handle != INVALID_HANDLE_VALUE)
+        CloseHandle(file_handle);
+    data = nullptr;
+    size = 0;
+    file_handle = INVALID_HANDLE_VALUE;
+    mapping_handle = nullptr;
+}
+
+#else
+
+MappedFile::MappedFile() : data(nullptr), size(0), fd(-1) {}
+
+bool MappedFile::Open(const char* path) {
+    Close();
+    int file = open(path, O_RDONLY);
+    if (file < 0)
+        return false;
+    struct stat st;
+    if (fstat(file, &st) != 0 || st.st_size <= 0) {
+        close(file);
+        return false;
+    }
+    void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, file, 0);
+    if (view == MAP_FAILED) {
+        close(file);
+        return false;
+    }
+    fd = file;
+    data = static_cast<const unsigned char*>(view);
+    size = (size_t)st.st_size;
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data)
+        munmap(const_cast<unsigned char*>(data), size);
+    if (fd >= 0)
+        close(fd);
+    data = nullptr;
+    size = 0;
+    fd = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+// --- MappedFrameVoxelStore ---
+
+MappedFrameVoxelStore::MappedFrameVoxelStore(const std::string& file_path)
+    : path(file_path), writer(nullptr), header(nullptr), frame_table(nullptr), segment_bounds(nullptr) {
+    memset(&write_header, 0, sizeof(write_header));
+    invalid_reference.root_pos.set(0.0f, 0.0f, 0.0f);
+    invalid_reference.root_ori.setIdentity();
+}
+
+MappedFrameVoxelStore::~MappedFrameVoxelStore() {
+    Abort();
+    Close();
+}
+
+// 一時ファイルで保存先のファイルを置き換え（置き換え前のファイルをマップしている他のプロセスには影響しない）
+static bool replace_file(const std::string& src, const std::string& dst) {
+#ifdef _WIN32
+    return MoveFileExA(src.c_str(), dst.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(src.c_str(), dst.c_str()) == 0;
+#endif
+}
+
+// 書き込み中のファイルの位置の取得・移動（2GB を超えるファイルでも 64bit の位置を扱う）
+static bool tell_file(FILE* file, unsigned long long& position) {
+#ifdef _WIN32
+    __int64 p = _ftelli64(file);
+#else
+    off_t p = ftello(file);
+#endif
+    if (p < 0)
+        return false;
+    position = (unsigned long long)p;
+    return true;
+}
+
+static bool seek_file(FILE* file, unsigned long long position) {
+#ifdef _WIN32
+    return _fseeki64(file, (__int64)position, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)position, SEEK_SET) == 0;
+#endif
+}
+
+// ヘッダー・部位ごとの局所グリッドの範囲・空のオフセット表を書き込み、フレームの書き込みを開始
+bool MappedFrameVoxelStore::Begin(int num_frames, int num_segments, int resolution, const std::vector<SegmentGridBounds>& segment_bounds,
+                                  float sparse_threshold) {
+    Abort();
+    Close();
+    writer = fopen(GetTemporaryPath().c_str(), "wb");
+    if (!writer)
+        return false;
+
+    memset(&write_header, 0, sizeof(write_header));
+    memcpy(write_header.magic, kFrameVoxelFileMagic, sizeof(write_header.magic));
+    write_header.version = kFrameVoxelFileVersion;
+    write_header.num_frames = num_frames;
+    write_header.num_segments = num_segments;
+    write_header.resolution = resolution;
+    write_header.frame_table_offset = sizeof(FrameVoxelFileHeader);
+    bool has_segment_bounds = (int)segment_bounds.size() == num_segments && num_segments > 0;
+    if (has_segment_bounds) {
+        write_header.segment_bounds_offset = sizeof(FrameVoxelFileHeader);
+        write_header.frame_table_offset += sizeof(SegmentGridBounds) * (size_t)num_segments;
+    }
+
+    write_offsets.assign(num_frames + 1, 0);
+    if (fwrite(&write_header, sizeof(write_header), 1, writer) != 1 ||
+        (has_segment_bounds && fwrite(segment_bounds.data(), sizeof(SegmentGridBounds), segment_bounds.size(), writer) != segment_bounds.size()) ||
+        fwrite(write_offsets.data(), sizeof(unsigned long long), write_offsets.size(), writer) != write_offsets.size()) {
+        Abort();
+        return false;
+    }
+    write_offsets.clear();
+    frame_buffer.Reset(1, num_segments, resolution, sparse_threshold);
+    return true;
+}
+
+// 1フレーム分を量子化して書き込み
+bool MappedFrameVoxelStore::AppendFrame(const FrameSegmentVoxelGrid& frame) {
+    if (!writer || (int)write_offsets.size() >= write_header.num_frames)
+        return false;
+
+    frame_buffer.Reset(1, write_header.num_segments, write_header.resolution, frame_buffer.sparse_threshold);
+    frame_buffer.AppendFrame(frame);
+    return WriteChunk(frame_buffer.references[0], frame_buffer.segments.data(),
+                      frame_buffer.bricks.data(), (unsigned int)frame_buffer.bricks.size(),
+                      frame_buffer.voxels.data(), (unsigned int)frame_buffer.voxels.size(), 0, 0);
+}
+
+// 1フレーム分の基準姿勢・部位のブリックの範囲（部位のオフセット表）・ブリック・疎ボクセル・特徴量ごとのマスクを書き込み
+// （マスクはフレーム内の番号で求め直す）
+bool MappedFrameVoxelStore::WriteChunk(const FrameReference& reference, const CompactSegmentRecord* records,
+                                       const SparseVoxelBrick* bricks, unsigned int num_bricks, const QuantizedSparseVoxel* voxels, unsigned int num_voxels,
+                                       unsigned int brick_base, unsigned int voxel_base) {
+    FrameVoxelChunkHeader chunk;
+    chunk.reference = reference;
+    chunk.num_bricks = num_bricks;
+    chunk.num_voxels = num_voxels;
+
+    int num_segments = write_header.num_segments;
+    write_records.assign(records, records + num_segments);
+    for (int s = 0; s < num_segments; ++s)
+        write_records[s].first_brick -= brick_base;
+    write_bricks.assign(bricks, bricks + num_bricks);
+    for (unsigned int b = 0; b < num_bricks; ++b)
+        write_bricks[b].first_voxel -= voxel_base;
+    for (int f = 0; f < 5; ++f)
+        write_masks[f].clear();
+    AppendQuantizedFeatureMasks(voxels, 0, num_voxels, write_masks);
+
+    unsigned long long position = 0;
+    if (!tell_file(writer, position))
+        return false;
+    write_offsets.push_back(position);
+    write_header.num_bricks += num_bricks;
+    write_header.num_voxels += num_voxels;
+    bool ok = fwrite(&chunk, sizeof(chunk), 1, writer) == 1;
+    ok = ok && fwrite(write_records.data(), sizeof(CompactSegmentRecord), write_records.size(), writer) == write_records.size();
+    if (num_bricks > 0) {
+        ok = ok && fwrite(write_bricks.data(), sizeof(SparseVoxelBrick), num_bricks, writer) == num_bricks;
+        ok = ok && fwrite(voxels, sizeof(QuantizedSparseVoxel), num_voxels, writer) == num_voxels;
+        for (int f = 0; f < 5; ++f)
+            ok = ok && fwrite(write_masks[f].data(), sizeof(unsigned int), write_masks[f].size(), writer) == write_masks[f].size();
+    }
+    return ok;
+}
+
+// オフセット表・全体のボクセル数を書き込んで一時ファイルを閉じ、保存先を置き換えてマップ
+bool MappedFrameVoxelStore::End() {
+    if (!writer)
+        return false;
+    if ((int)write_offsets.size() != write_header.num_frames) {
+        Abort();
+        return false;
+    }
+    unsigned long long end_position = 0;
+    bool ok = tell_file(writer, end_position);
+    write_offsets.push_back(end_position);
+
+    ok = ok && seek_file(writer, 0) &&
+         fwrite(&write_header, sizeof(write_header), 1, writer) == 1 &&
+         seek_file(writer, write_header.frame_table_offset) &&
+         fwrite(write_offsets.data(), sizeof(unsigned long long), write_offsets.size(), writer) == write_offsets.size();
+    ok = (fclose(writer) == 0) && ok;
+    writer = nullptr;
+    write_offsets.clear();
+    write_records.clear();
+    write_bricks.clear();
+    for (int f = 0; f < 5; ++f)
+        write_masks[f].clear();
+    frame_buffer.Clear();
+    std::string temporary_path = GetTemporaryPath();
+    if (!ok || !replace_file(temporary_path, path)) {
+        remove(temporary_path.c_str());
+        return false;
+    }
+    return Open();
+}
+
+// 書き込み途中の一時ファイルを削除
+void MappedFrameVoxelStore::Abort() {
+    if (!writer)
+        return;
+    fclose(writer);
+    writer = nullptr;
+    write_offsets.clear();
+    write_records.clear();
+    write_bricks.clear();
+    for (int f = 0; f < 5; ++f)
+        write_masks[f].clear();
+    frame_buffer.Clear();
+    remove(GetTemporaryPath().c_str());
+}
+
+// 量子化済みのフレームキャッシュを、フレームごとのブリック・疎ボクセルの範囲に分けて保存
+// （フレームキャッシュはフレーム順に追加されるため、各フレームのブリック・疎ボクセルは連続している）
+bool MappedFrameVoxelStore::WriteCache(const MotionFrameSegmentVoxelGridCache& cache) {
+    TRACE_SCOPE_CAT("MappedFrameVoxelStore::WriteCache", "io");
+
+    int num_frames = cache.GetNumFrames();
+    int num_segments = cache.GetNumSegments();
+    if (num_segments <= 0)
+        return false;
+    if (!Begin(num_frames, num_segments, cache.GetResolution(), cache.segment_bounds, cache.sparse_threshold))
+        return false;
+    frame_buffer.Clear();
+
+    for (int f = 0; f < num_frames; ++f) {
+        const CompactSegmentRecord* records = &cache.segments[(size_t)f * num_segments];
+        unsigned int brick_begin = records[0].first_brick;
+        unsigned int brick_end = (f + 1 < num_frames) ? cache.segments[(size_t)(f + 1) * num_segments].first_brick : (unsigned int)cache.bricks.size();
+        unsigned int voxel_begin = (brick_begin < cache.bricks.size()) ? cache.bricks[brick_begin].first_voxel : (unsigned int)cache.voxels.size();
+        unsigned int voxel_end = (brick_end < cache.bricks.size()) ? cache.bricks[brick_end].first_voxel : (unsigned int)cache.voxels.size();
+        unsigned int num_bricks = brick_end - brick_begin;
+        unsigned int num_voxels = voxel_end - voxel_begin;
+        const SparseVoxelBrick* bricks = (num_bricks > 0) ? &cache.bricks[brick_begin] : nullptr;
+        const QuantizedSparseVoxel* voxels = (num_voxels > 0) ? &cache.voxels[voxel_begin] : nullptr;
+        if (!WriteChunk(cache.references[f], records, bricks, num_bricks, voxels, num_voxels, brick_begin, voxel_begin)) {
+            Abort();
+            return false;
+        }
+    }
+    return End();
+}
+
+// 1フレーム分のファイル上の大きさ（先頭・部位ごとのブリックの範囲・ブリック・疎ボクセル・特徴量ごとのマスク）
+static unsigned long long get_chunk_size(const FrameVoxelChunkHeader& chunk, int num_segments) {
+    return sizeof(FrameVoxelChunkHeader) + sizeof(CompactSegmentRecord) * (unsigned long long)num_segments +
+           sizeof(SparseVoxelBrick) * (unsigned long long)chunk.num_bricks +
+           sizeof(QuantizedSparseVoxel) * (unsigned long long)chunk.num_voxels +
+           sizeof(unsigned int) * 5ull * GetFeatureMaskWords(chunk.num_voxels);
+}
+
+// 保存済みのファイルをマップ（ヘッダー・部位ごとの局所グリッドの範囲・オフセット表がファイルの範囲内に収まることのみを確認し、
+// 各フレームは初めて参照したときに ValidateFrame() で確認する）
+bool MappedFrameVoxelStore::Open() {
+    TRACE_SCOPE_CAT("MappedFrameVoxelStore::Open", "io");
+
+    Close();
+    if (!mapped.Open(path.c_str()))
+        return false;
+
+    const unsigned char* data = mapped.GetData();
+    size_t size = mapped.GetSize();
+    const FrameVoxelFileHeader* h = reinterpret_cast<const FrameVoxelFileHeader*>(data);
+    bool valid = size >= sizeof(FrameVoxelFileHeader) &&
+                 memcmp(h->magic, kFrameVoxelFileMagic, sizeof(h->magic)) == 0 &&
+                 h->version == kFrameVoxelFileVersion &&
+                 h->num_frames >= 0 && h->num_segments > 0 && h->resolution > 0 &&
+                 h->frame_table_offset + sizeof(unsigned long long) * ((size_t)h->num_frames + 1) <= size;
+    if (valid && h->segment_bounds_offset != 0)
+        valid = h->segment_bounds_offset + sizeof(SegmentGridBounds) * (size_t)h->num_segments <= h->frame_table_offset;
+    if (valid) {
+        const unsigned long long* table = reinterpret_cast<const unsigned long long*>(data + h->frame_table_offset);
+        valid = table[h->num_frames] == size;
+        if (valid) {
+            header = h;
+            frame_table = table;
+            segment_bounds = (h->segment_bounds_offset != 0) ? reinterpret_cast<const SegmentGridBounds*>(data + h->segment_bounds_offset) : nullptr;
+            frame_states.reset(new std::atomic<unsigned char>[(size_t)h->num_frames]);
+            for (int f = 0; f < h->num_frames; ++f)
+                frame_states[f].store(FRAME_UNCHECKED, std::memory_order_relaxed);
+        }
+    }
+    if (!valid)
+        mapped.Close();
+    return valid;
+}
+
+unsigned char MappedFrameVoxelStore::ValidateFrame(int frame) const {
+    const unsigned char* data = mapped.GetData();
+    unsigned long long begin = frame_table[frame];
+    unsigned long long end = frame_table[frame + 1];
+    unsigned long long table_end = header->frame_table_offset + sizeof(unsigned long long) * ((size_t)header->num_frames + 1);
+    bool valid = begin >= table_end && begin <= end && end <= mapped.GetSize() &&
+                 end - begin >= sizeof(FrameVoxelChunkHeader);
+    const FrameVoxelChunkHeader* chunk = reinterpret_cast<const FrameVoxelChunkHeader*>(data + begin);
+    valid = valid && get_chunk_size(*chunk, header->num_segments) == end - begin;
+
+    if (valid) {
+        // 部位のブリックの範囲がフレーム内のブリックに収まること
+        const CompactSegmentRecord* records = reinterpret_cast<const CompactSegmentRecord*>(chunk + 1);
+        const SparseVoxelBrick* bricks = reinterpret_cast<const SparseVoxelBrick*>(records + header->num_segments);
+        const QuantizedSparseVoxel* voxels = reinterpret_cast<const QuantizedSparseVoxel*>(bricks + chunk->num_bricks);
+        for (int s = 0; valid && s < header->num_segments; ++s)
+            valid = (unsigned long long)records[s].first_brick + records[s].num_bricks <= chunk->num_bricks;
+
+        // ブリックの疎ボクセルの範囲がフレーム内の疎ボクセルに収まり、各疎ボクセルの位置がグリッドの範囲内に収まること
+        // （読み出し側は疎ボクセルの位置をグリッドの線形インデックスとしてそのまま使う）
+        const int brick_bits = kSparseVoxelBrickBits;
+        const int mask = (1 << brick_bits) - 1;
+        const int resolution = header->resolution;
+        for (unsigned int b = 0; valid && b < chunk->num_bricks; ++b) {
+            const SparseVoxelBrick& brick = bricks[b];
+            valid = (unsigned long long)brick.first_voxel + brick.num_voxels <= chunk->num_voxels;
+            for (unsigned int k = 0; valid && k < brick.num_voxels; ++k) {
+                int local = voxels[brick.first_voxel + k].local;
+                valid = (brick.origin[0] << brick_bits) + (local & mask) < resolution &&
+                        (brick.origin[1] << brick_bits) + ((local >> brick_bits) & mask) < resolution &&
+                        (brick.origin[2] << brick_bits) + ((local >> (brick_bits * 2)) & mask) < resolution;
+            }
+        }
+    }
+
+    unsigned char state = valid ? FRAME_VALID : FRAME_INVALID;
+    frame_states[frame].store(state, std::memory_order_release);
+    return state;
+}
+
+void MappedFrameVoxelStore::Close() {
+    mapped.Close();
+    header = nullptr;
+    frame_table = nullptr;
+    segment_bounds = nullptr;
+    frame_states.reset();
+}
@@ -0,0 +1,220 @@
+#pragma once
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "VoxelData.h"
+
+// ボクセル化の結果の保存先（VoxelizationPipeline::BuildMotion の最後の段階）
+// Begin() → フレーム順に AppendFrame() → End() の順に呼ばれ、中断された場合は Abort() が呼ばれる
+// segment_bounds は部位ごとの局所グリッドの範囲（空ならワールド座標系の共通グリッド）
+// sparse_threshold 以下の特徴量の値は保存時に除き、読み出し時には閾値と比較しない
+class FrameVoxelStore {
+public:
+    virtual ~FrameVoxelStore() {}
+
+    virtual bool Begin(int num_frames, int num_segments, int resolution, const std::vector<SegmentGridBounds>& segment_bounds,
+                       float sparse_threshold) = 0;
+    virtual bool AppendFrame(const FrameSegmentVoxelGrid& frame) = 0;
+    virtual bool End() = 0;
+    virtual void Abort() = 0;
+};
+
+// メモリ上のフレームキャッシュに保存
+class MemoryFrameVoxelStore : public FrameVoxelStore {
+public:
+    explicit MemoryFrameVoxelStore(MotionFrameSegmentVoxelGridCache& c) : cache(c) {}
+
+    virtual bool Begin(int num_frames, int num_segments, int resolution, const std::vector<SegmentGridBounds>& segment_bounds,
+                       float sparse_threshold) override;
+    virtual bool AppendFrame(const FrameSegmentVoxelGrid& frame) override;
+    virtual bool End() override;
+    virtual void Abort() override;
+
+private:
+    MotionFrameSegmentVoxelGridCache& cache;
+};
+
+// 読み込み専用でメモリにマップしたファイル（同じファイルを開いた複数のプロセスで OS のページキャッシュを共有する）
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool Open(const char* path);
+    void Close();
+
+    bool IsOpen() const { return data != nullptr; }
+    const unsigned char* GetData() const { return data; }
+    size_t GetSize() const { return size; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const unsigned char* data;
+    size_t size;
+#ifdef _WIN32
+    void* file_handle;
+    void* mapping_handle;
+#else
+    int fd;
+#endif
+};
+
+// フレームキャッシュのファイルのヘッダー
+struct FrameVoxelFileHeader {
+    char magic[8];                        // "SHFVOX1"
+    unsigned int version;
+    int num_frames;
+    int num_segments;
+    int resolution;
+    unsigned long long frame_table_offset; // フレームのオフセット表（フレーム数 + 1 個、最後はファイルの末尾）の位置
+    unsigned long long num_bricks;         // 全フレームのブリック数・疎ボクセル数
+    unsigned long long num_voxels;
+    unsigned long long segment_bounds_offset; // 部位ごとの局所グリッドの範囲（部位数個の SegmentGridBounds）の位置（0 ならワールド座標系の共通グリッド）
+};
+
+// フレームキャッシュのファイルの1フレーム分の先頭（続けて部位ごとの CompactSegmentRecord・SparseVoxelBrick・QuantizedSparseVoxel、
+// 特徴量ごとの値が 0 でない疎ボクセルのマスク（5特徴量 × GetFeatureMaskWords(num_voxels) 語）を格納）
+// 部位のブリック番号・ブリックのボクセル番号・マスクのビットはフレーム内の番号
+struct FrameVoxelChunkHeader {
+    FrameReference reference;
+    unsigned int num_bricks;
+    unsigned int num_voxels;
+};
+
+// フレーム単位でファイルに保存し、メモリにマップして参照するフレームキャッシュ
+// 保存中は1フレームずつ量子化して一時ファイルに書き込み、End() でオフセット表を書き込んで置き換えた後にファイルをマップする
+// （置き換え前のファイルをマップしている他のプロセスは、閉じるまで置き換え前の内容を参照し続ける）
+// 保存済みのファイルは Open() でヘッダー・オフセット表のみを確認して開き（フレーム数によらず一定の時間）、各フレームはマップしたページから直接読み出す
+// 各フレームの位置・大きさと、部位のブリック・ブリックの疎ボクセルの範囲は、そのフレームを初めて参照したときに確認する
+// （確認できないフレームは疎ボクセルを持たないものとして扱い、壊れたファイルや古いファイルでも範囲外を読み出さない）
+class MappedFrameVoxelStore : public FrameVoxelStore {
+public:
+    explicit MappedFrameVoxelStore(const std::string& file_path);
+    virtual ~MappedFrameVoxelStore();
+
+    virtual bool Begin(int num_frames, int num_segments, int resolution, const std::vector<SegmentGridBounds>& segment_bounds,
+                       float sparse_threshold) override;
+    virtual bool AppendFrame(const FrameSegmentVoxelGrid& frame) override;
+    virtual bool End() override;
+    virtual void Abort() override;
+
+    // 量子化済みのフレームキャッシュをそのまま保存し、保存したファイルをマップ
+    bool WriteCache(const MotionFrameSegmentVoxelGridCache& cache);
+
+    // 保存済みのファイルを開く・閉じる
+    bool Open();
+    void Close();
+
+    bool IsOpen() const { return header != nullptr; }
+    const std::string& GetPath() const { return path; }
+    size_t GetFileSize() const { return mapped.GetSize(); }
+    int GetNumFrames() const { return header ? header->num_frames : 0; }
+    int GetNumSegments() const { return header ? header->num_segments : 0; }
+    int GetResolution() const { return header ? header->resolution : 0; }
+    size_t GetNumBricks() const { return header ? (size_t)header->num_bricks : 0; }
+    size_t GetNumVoxels() const { return header ? (size_t)header->num_voxels : 0; }
+    bool Empty() const { return GetNumFrames() == 0; }
+    bool IsFrameValid(int frame) const { return GetChunk(frame) != nullptr; }
+    const FrameReference& GetReference(int frame) const {
+        const FrameVoxelChunkHeader* chunk = GetChunk(frame);
+        return chunk ? chunk->reference : invalid_reference;
+    }
+    const SegmentGridBounds* GetSegmentBounds(int segment) const { return segment_bounds ? &segment_bounds[segment] : nullptr; }
+
+    // 指定フレーム・部位の指定特徴量が 0 でないボクセルについて func(線形インデックス, 値) を呼び出す
+    template <class Func>
+    void ForEachVoxel(int frame, int segment, int feature, Func func) const {
+        const FrameVoxelChunkHeader* chunk = GetChunk(frame);
+        if (!chunk)
+            return;
+        const CompactSegmentRecord* records = reinterpret_cast<const CompactSegmentRecord*>(chunk + 1);
+        const SparseVoxelBrick* bricks = reinterpret_cast<const SparseVoxelBrick*>(records + header->num_segments);
+        const QuantizedSparseVoxel* voxels = reinterpret_cast<const QuantizedSparseVoxel*>(bricks + chunk->num_bricks);
+        const unsigned int* masks = reinterpret_cast<const unsigned int*>(voxels + chunk->num_voxels);
+        ForEachQuantizedSegmentVoxel(records[segment], bricks, voxels, masks + GetFeatureMaskWords(chunk->num_voxels) * feature,
+                                     header->resolution, feature, func);
+    }
+
+private:
+    MappedFrameVoxelStore(const MappedFrameVoxelStore&);
+    MappedFrameVoxelStore& operator=(const MappedFrameVoxelStore&);
+
+    // フレームの確認の状態
+    enum FrameState { FRAME_UNCHECKED = 0, FRAME_VALID, FRAME_INVALID };
+
+    // 指定フレームの先頭（初めて参照したときに確認し、確認できないフレームは nullptr）
+    const FrameVoxelChunkHeader* GetChunk(int frame) const {
+        unsigned char state = frame_states[frame].load(std::memory_order_acquire);
+        if (state == FRAME_UNCHECKED)
+            state = ValidateFrame(frame);
+        return (state == FRAME_VALID) ? reinterpret_cast<const FrameVoxelChunkHeader*>(mapped.GetData() + frame_table[frame]) : nullptr;
+    }
+
+    // フレームの位置・大きさ・部位のブリックの範囲・ブリックの疎ボクセルの範囲・疎ボクセルの位置を確認し、結果を記録
+    // （複数のスレッドから同時に確認しても同じ結果を記録するだけなので、排他制御はしない）
+    unsigned char ValidateFrame(int frame) const;
+
+    // 1フレーム分を書き込み（ブリック番号・ボクセル番号は brick_base・voxel_base を引いてフレーム内の番号にする）
+    bool WriteChunk(const FrameReference& reference, const CompactSegmentRecord* records,
+                    const SparseVoxelBrick* bricks, unsigned int num_bricks, const QuantizedSparseVoxel* voxels, unsigned int num_voxels,
+                    unsigned int brick_base, unsigned int voxel_base);
+
+    // 書き込み中の一時ファイル
+    std::string GetTemporaryPath() const { return path + ".tmp"; }
+
+    std::string path;
+
+    // 保存中のファイル・フレームの位置・1フレーム分の量子化用の作業領域
+    FILE* writer;
+    FrameVoxelFileHeader write_header;
+    std::vector<unsigned long long> write_offsets;
+    std::vector<CompactSegmentRecord> write_records;
+    std::vector<SparseVoxelBrick> write_bricks;
+    std::vector<unsigned int> write_masks[5];
+    MotionFrameSegmentVoxelGridCache frame_buffer;
+
+    // マップしたファイル
+    MappedFile mapped;
+    const FrameVoxelFileHeader* header;
+    const unsigned long long* frame_table;
+    const SegmentGridBounds* segment_bounds;
+    mutable std::unique_ptr<std::atomic<unsigned char>[]> frame_states;
+    FrameReference invalid_reference; // 確認できないフレームの基準姿勢（原点・回転なし）
+};
+
+// フレームキャッシュの読み出し用の参照（メモリ上のキャッシュ・マップしたファイルのいずれかを参照し、解析側は区別せずに読み出す）
+class FrameVoxelCacheView {
+public:
+    FrameVoxelCacheView() : memory(nullptr), mapped(nullptr) {}
+    explicit FrameVoxelCacheView(const MotionFrameSegmentVoxelGridCache& c) : memory(&c), mapped(nullptr) {}
+    explicit FrameVoxelCacheView(const MappedFrameVoxelStore& c) : memory(nullptr), mapped(c.IsOpen() ? &c : nullptr) {}
+
+    bool IsMapped() const { return mapped != nullptr; }
+    int GetNumFrames() const { return mapped ? mapped->GetNumFrames() : memory ? memory->GetNumFrames() : 0; }
+    int GetNumSegments() const { return mapped ? mapped->GetNumSegments() : memory ? memory->GetNumSegments() : 0; }
+    int GetResolution() const { return mapped ? mapped->GetResolution() : memory ? memory->GetResolution() : 0; }
+    bool Empty() const { return GetNumFrames() == 0; }
+    const FrameReference& GetReference(int frame) const { return mapped ? mapped->GetReference(frame) : memory->GetReference(frame); }
+
+    // 部位の局所グリッドの範囲（ワールド座標系の共通グリッドなら nullptr）
+    const SegmentGridBounds* GetSegmentBounds(int segment) const {
+        return mapped ? mapped->GetSegmentBounds(segment) : memory ? memory->GetSegmentBounds(segment) : nullptr;
+    }
+
+    // 指定フレーム・部位の指定特徴量が 0 でないボクセルについて func(線形インデックス, 値) を呼び出す
+    template <class Func>
+    void ForEachVoxel(int frame, int segment, int feature, Func func) const {
+        if (mapped)
+            mapped->ForEachVoxel(frame, segment, feature, func);
+        else
+            memory->ForEachVoxel(frame, segment, feature, func);
+    }
+
+private:
+    const MotionFrameSegmentVoxelGridCache* memory;
+    const MappedFrameVoxelStore* mapped;
+};
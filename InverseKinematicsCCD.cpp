@@ -0,0 +1,456 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  逆運動学計算（CCD法）
+**/
+
+
+// ライブラリ・クラス定義の読み込み
+#include "SimpleHuman.h"
+#include "InverseKinematicsCCD.h"
+
+// 標準ライブラリの読み込み
+#include <math.h>
+#include <algorithm>
+#include <thread>
+
+
+
+//
+//  末端関節から支点関節へのパス（関節の配列と各関節における末端関節の方向）を探索
+// （支点関節の番号が -1 の場合は、ルート体節を支点とする）
+// （joint_path_signs は、各関節の子側に末端関節がある場合は 1、親側に末端関節がある場合は -1 を出力）
+//
+void  FindJointPath( const Skeleton * body, int base_joint_no, int ee_joint_no, vector< int > & joint_path, vector< int > & joint_path_signs )
+{
+	// 出力の配列をクリア
+	joint_path.clear();
+	joint_path_signs.clear();
+
+	// 探索時の現在の関節・体節
+	const Joint *  joint = NULL;
+	const Segment *  segment = NULL;
+
+	// 末端関節から探索を開始
+	joint = body->joints[ ee_joint_no ];
+
+	// 末端関節からルート体節に向かうパスを探索
+	while ( true )
+	{
+		// ルート側の隣の関節を辿り、ルートに到達したら終了
+		segment = joint->segments[ 0 ];
+		if ( segment->index == 0 )
+			break;
+		joint = segment->joints[ 0 ];
+
+		// 現在の関節をパスに追加
+		joint_path.push_back( joint->index );
+		
+		// 途中で支点関節に到達したら終了
+		if ( joint->index == base_joint_no )
+			break;
+	}
+
+	// 各関節における末端関節の方向を表す符号の配列を生成（全て子側に末端関節がある）
+	joint_path_signs.resize( joint_path.size(), 1 );
+
+
+	// 支点が常にルート体節、もしくは、末端関節とルート体節の間にあると仮定すれば、ここで終了しても構わない
+	// それ以外の場所に支点関節がある場合は、ルートから支点関節までのパスを求めて追加する処理が必要となる
+	return;
+
+/*
+	// ※レポート課題
+
+	// 支点がルート体節 or 支点関節がルート体節から末端関節のパス上にある場合は、終了
+	if ( ( base_joint_no == -1 ) || ( joint->index == base_joint_no ) )
+		return;
+
+	// 支点関節からルート体節へ向かうパス
+	vector< int >  joint_path2;
+
+	// 探索処理の終了判定用フラグ
+	bool  termination = false;
+
+	// 支点関節から探索を開始
+	joint = body->joints[ base_joint_no ];
+
+	// 支点関節からルート体節に向かうパスを探索
+	while ( true )
+	{
+		// 末端からルートまでのパスと合流したかどうかを判定し、合流したら終了
+		for ( ??? )
+		{
+			if ( ??? )
+			{
+				// 末端からルートまでのパスを、合流した体節の前の関節まで縮小
+				joint_path.resize( i + 1 );
+				termination = true;
+				break;
+			}
+		}
+		if ( termination )
+			break;
+
+		// 現在の関節をパスに追加
+		joint_path2.push_back( joint->index );
+
+		// ルート側の隣の関節を辿り、ルートに到達したら終了
+		segment = joint->segments[ 0 ];
+		if ( segment->index == 0 )
+			break;
+		joint = segment->joints[ 0 ];
+
+		// 末端関節に到達した場合（ルートと支点関節の間に末端関節がある場合）は、
+		// 末端関節からルートまでのパスはクリアして、支点関節から末端関節までのパスを使用
+		if ( joint->index == ee_joint_no )
+		{
+			joint_path.clear();
+			joint_path_signs.clear();
+			break;
+		}
+	}
+
+	// 末端からルートに向かうパスと、支点からルートに向かうパスを結合（後者は逆の順番で結合）
+	// 各関節における末端関節の方向を表す符号の配列を生成
+	joint_path_signs.resize( joint_path.size(), 1 );
+	for ( int i = 0; i < joint_path2.size(); i++ )
+	{
+		joint_path.push_back( joint_path2[ ??? ] );
+		joint_path_signs.push_back( -1 );
+	}
+*/
+
+}
+
+
+//
+//  Inverse Kinematics 計算（CCD法）
+//  入出力姿勢、支点関節番号（-1の場合はルートを支点とする）、末端関節番号、末端関節の目標位置を指定
+//
+void  ApplyInverseKinematicsCCD( Posture & posture, int base_joint_no, int ee_joint_no, Point3f ee_joint_position )
+{
+	// 引数チェック
+	if ( !posture.body || ( ee_joint_no == -1 ) || ( base_joint_no == ee_joint_no ) )
+		return;
+
+	// 末端関節から支点関節へのパス（関節の配列と各関節における末端関節の方向）を探索
+	vector< int >  joint_path, joint_path_signs;
+	FindJointPath( posture.body, base_joint_no, ee_joint_no, joint_path, joint_path_signs );
+
+	// 探索したパスを使って逆運動学計算
+	ApplyInverseKinematicsCCD( posture, joint_path, joint_path_signs, ee_joint_no, ee_joint_position );
+}
+
+
+//
+//  Inverse Kinematics 計算（CCD法）
+//  入出力姿勢、末端関節から支点関節へのパス（FindJointPath() の出力）、末端関節番号、末端関節の目標位置を指定
+//  繰り返し回数と、計算後の末端関節と目標位置の距離（残差）を出力（不要であれば NULL を指定）
+//
+void  ApplyInverseKinematicsCCD( Posture & posture, const vector< int > & joint_path, const vector< int > & joint_path_signs, 
+	int ee_joint_no, Point3f ee_joint_position, int * num_iterations, float * residual )
+{
+	// 最大繰り返し数の設定
+	const int  max_iteration = 10;
+
+	// 位置が収束したと判断するための閾値の設定
+	const float  distance_threshold = 0.01f;
+
+
+	// 順運動学計算結果の格納用変数
+	vector< Matrix4f >  segment_frames;
+	vector< Point3f >   joint_positions;
+
+	// 骨格情報
+	const Skeleton *  body = posture.body;
+
+	// 現在の関節
+	const Joint *  joint = NULL;
+
+	// ルートから見た現在の関節の方向（末端側の場合は 1、支点側の場合は -1）
+	float  direction;
+
+	// 末端関節の現在位置（ワールド座標系）
+	Point3f  ee_pos;
+
+	// 現在の関節の局所座標系（ワールド座標系における関節の位置＋親側の体節の向き）
+	Matrix4f  local_frame;
+
+	// ワールド座標系から現在の関節の局所座標系への変換行列
+	Matrix4f  trans_mat;
+
+	// 末端関節の現在位置（局所座標系）
+	Point3f  local_pos;
+
+	// 支点関節から末端関節へのベクトル（局所座標系）
+	Vector3f  ee_vec;
+
+	// 末端関節の現在位置から目標位置へのベクトル（局所座標系）
+	Vector3f  goal_vec;
+
+	// 関節の回転軸と回転角度
+	Vector3f  rot_axis;
+	float  rot_angle = 0.0f;
+
+	// 現在の関節の回転
+	Matrix3f  rot;
+
+	// 末端関節の目標位置と現在位置の距離
+	Vector3f  vec;
+	float  dist = -1.0f;
+
+
+	// 繰り返し回数
+	int  iteration = 0;
+
+
+	// 引数チェック
+	if ( !posture.body || ( ee_joint_no == -1 ) )
+		return;
+
+	// 現在の姿勢での各体節・関節の位置・向きを計算（順運動学計算）
+	ForwardKinematics( posture, segment_frames, joint_positions );
+
+	// CCD法の繰り返し計算（末端関節の位置が収束するか、一定回数繰り返したら終了する）
+	for ( int i = 0; i < max_iteration; i++ )
+	{
+		iteration = i + 1;
+
+		// 末端関節から支点関節に向かって順番に繰り返し
+		for ( int j = 0; j < (int)joint_path.size(); j++ )
+		{
+			// 現在の関節を取得
+			joint = body->joints[ joint_path[ j ] ];
+			direction = (float) joint_path_signs[ j ];
+
+			// 末端関節の現在位置を取得
+			ee_pos = joint_positions[ ee_joint_no ];
+
+			// 現在の関節のローカル座標系を取得（ワールド座標系における関節の位置＋親側の体節の向き）
+			Matrix3f  parent_ori;
+			segment_frames[ joint->segments[ 0 ]->index ].get( &parent_ori );
+			local_frame.set( parent_ori, Vector3f( joint_positions[ joint->index ] ), 1.0f );
+
+			// ワールド座標系から現在の関節のローカル座標系への変換行列を計算
+			trans_mat.invert( local_frame );
+
+			// 現在の関節から末端関節への方向ベクトル（現在の関節のローカル座標系）を計算
+			local_pos = ee_pos;
+			trans_mat.transform( &local_pos );
+			ee_vec.set( local_pos );
+
+			// 現在の関節から目標位置への方向ベクトル（現在の関節のローカル座標系）を計算
+			local_pos = ee_joint_position;
+			trans_mat.transform( &local_pos );
+			goal_vec.set( local_pos );
+
+			// 現在の関節の回転軸・回転角度（0～π）を計算（どちらかのベクトルの長さが 0 の場合は回転しない）
+			rot_angle = 0.0f;
+			if ( ( ee_vec.lengthSquared() > 0.0f ) && ( goal_vec.lengthSquared() > 0.0f ) )
+			{
+				ee_vec.normalize();
+				goal_vec.normalize();
+				rot_axis.cross( ee_vec, goal_vec );
+				if ( rot_axis.lengthSquared() > 0.0f )
+				{
+					rot_axis.normalize();
+					rot_angle = acos( max( -1.0f, min( 1.0f, ee_vec.dot( goal_vec ) ) ) );
+				}
+			}
+
+			// 回転角度が微少であれば、回転は適用せずにスキップする
+			if ( rot_angle < 0.001f )
+				continue;
+
+			// 回転を適用（親側の体節の座標系での回転を、現在の関節の回転の前にかける）
+			Matrix3f  delta;
+			delta.set( AxisAngle4f( rot_axis, rot_angle ) );
+			rot.mul( delta, posture.joint_rotations[ joint->index ] );
+
+			// 回転後の回転を設定
+			posture.joint_rotations[ joint->index ].set( rot );
+
+			// 末端関節と現在の関節の間にルート体節がある場合は、ルート体節に移動・回転を適用
+			if ( direction < 0.0f )
+			{
+			}
+
+			// 更新された姿勢にもとづいて、各体節・関節の位置・向きを再計算（順運動学計算）
+			ForwardKinematics( posture, segment_frames, joint_positions );
+		}
+
+		// 収束判定、末端関節の目標位置と現在位置の距離が閾値以下になったら終了
+		ee_pos = joint_positions[ ee_joint_no ];
+		vec.sub( ee_joint_position, ee_pos );
+		dist = vec.lengthSquared();
+		if ( dist < distance_threshold * distance_threshold )
+			break;
+	}
+
+	// 繰り返し回数と残差を出力
+	if ( num_iterations )
+		*num_iterations = iteration;
+	if ( residual )
+	{
+		ee_pos = joint_positions[ ee_joint_no ];
+		vec.sub( ee_joint_position, ee_pos );
+		*residual = vec.length();
+	}
+}
+
+
+//
+//  動作全体に対する逆運動学計算の拘束条件が、指定フレームで有効かどうかを判定
+//
+static bool  IsIKMotionConstraintEnabled( const IKMotionConstraint & constraint, int frame_no )
+{
+	if ( constraint.enabled.empty() )
+		return  true;
+	return  ( frame_no < (int)constraint.enabled.size() ) && constraint.enabled[ frame_no ];
+}
+
+
+//
+//  動作全体に対する Inverse Kinematics 計算（CCD法）の１フレーム分の処理
+//  前フレームの計算結果が与えられた場合は、前フレームでの関節回転の修正量を初期値として適用（ウォームスタート）
+//
+static void  ApplyInverseKinematicsCCDToFrame( Posture & posture, int frame_no, const Posture * prev_org, const Posture * prev_result, 
+	const vector< IKMotionConstraint > & constraints, const vector< vector< int > > & joint_paths, const vector< vector< int > > & joint_path_signs, 
+	vector< Matrix4f > & segment_frames, vector< Point3f > & joint_positions, float & residual, int & iterations )
+{
+	Matrix3f  delta;
+
+	// 前フレームの関節回転の修正量を現在のフレームに適用（修正量 = 前フレームの入力回転の逆 × 前フレームの出力回転）
+	//（複数の拘束条件のパスが共有する関節には１回だけ適用）
+	if ( prev_org && prev_result )
+	{
+		vector< bool >  applied( posture.body->num_joints, false );
+		for ( int c = 0; c < (int)constraints.size(); c++ )
+		{
+			if ( !IsIKMotionConstraintEnabled( constraints[ c ], frame_no ) )
+				continue;
+			for ( int j = 0; j < (int)joint_paths[ c ].size(); j++ )
+			{
+				int  joint_no = joint_paths[ c ][ j ];
+				if ( applied[ joint_no ] )
+					continue;
+				applied[ joint_no ] = true;
+				delta.transpose( prev_org->joint_rotations[ joint_no ] );
+				delta.mul( prev_result->joint_rotations[ joint_no ] );
+				posture.joint_rotations[ joint_no ].mul( delta );
+			}
+		}
+	}
+
+	// 各拘束条件を順番に適用
+	residual = 0.0f;
+	iterations = 0;
+	for ( int c = 0; c < (int)constraints.size(); c++ )
+	{
+		if ( !IsIKMotionConstraintEnabled( constraints[ c ], frame_no ) )
+			continue;
+		int  num_iterations = 0;
+		ApplyInverseKinematicsCCD( posture, joint_paths[ c ], joint_path_signs[ c ], constraints[ c ].ee_joint_no, constraints[ c ].targets[ frame_no ], &num_iterations, NULL );
+		iterations += num_iterations;
+	}
+
+	// 全ての拘束条件を適用した後の姿勢で、各末端関節と目標位置の距離の最大値を残差とする
+	//（複数の拘束条件が関節を共有する場合は、後の拘束条件の適用で前の拘束条件の残差が変わるため、最後にまとめて計算）
+	ForwardKinematics( posture, segment_frames, joint_positions );
+	for ( int c = 0; c < (int)constraints.size(); c++ )
+	{
+		if ( !IsIKMotionConstraintEnabled( constraints[ c ], frame_no ) )
+			continue;
+		Vector3f  vec;
+		vec.sub( constraints[ c ].targets[ frame_no ], joint_positions[ constraints[ c ].ee_joint_no ] );
+		float  dist = vec.length();
+		if ( dist > residual )
+			residual = dist;
+	}
+}
+
+
+//
+//  動作全体に対する Inverse Kinematics 計算（CCD法）
+//  各フレームの姿勢に、複数の末端関節の目標位置（拘束条件）を適用する
+//  全フレームを num_threads 個の連続区間に分割して並列に計算し、各区間内では前フレームの計算結果を初期値として使用する
+// （num_threads が 0 以下の場合は、ハードウェアの並列数を使用）
+//
+void  ApplyInverseKinematicsCCDToMotion( Motion & motion, const vector< IKMotionConstraint > & constraints, IKMotionResult * result, int num_threads )
+{
+	// 引数チェック
+	if ( !motion.body || !motion.frames || ( motion.num_frames <= 0 ) )
+		return;
+	for ( int c = 0; c < (int)constraints.size(); c++ )
+	{
+		if ( ( constraints[ c ].ee_joint_no < 0 ) || ( constraints[ c ].ee_joint_no >= motion.body->num_joints ) || 
+		     ( constraints[ c ].base_joint_no == constraints[ c ].ee_joint_no ) || 
+		     ( (int)constraints[ c ].targets.size() < motion.num_frames ) )
+			return;
+	}
+
+	// 各拘束条件の末端関節から支点関節へのパスを事前に探索（全フレームで共通）
+	vector< vector< int > >  joint_paths( constraints.size() );
+	vector< vector< int > >  joint_path_signs( constraints.size() );
+	for ( int c = 0; c < (int)constraints.size(); c++ )
+		FindJointPath( motion.body, constraints[ c ].base_joint_no, constraints[ c ].ee_joint_no, joint_paths[ c ], joint_path_signs[ c ] );
+
+	// 計算結果の格納用変数を初期化
+	vector< float >  residuals( motion.num_frames, 0.0f );
+	vector< int >  iterations( motion.num_frames, 0 );
+
+	// スレッド数を決定（１スレッドあたりのフレーム数が少なすぎる場合はスレッド数を減らす）
+	if ( num_threads <= 0 )
+		num_threads = (int) thread::hardware_concurrency();
+	if ( num_threads <= 0 )
+		num_threads = 1;
+	const int  min_frames_per_thread = 16;
+	num_threads = min( num_threads, max( 1, motion.num_frames / min_frames_per_thread ) );
+
+	// 連続するフレーム区間ごとの処理（区間内ではフレーム順に計算して、前フレームの結果を初期値とする）
+	auto  solve_range = [&]( int begin, int end )
+	{
+		vector< Matrix4f >  segment_frames;
+		vector< Point3f >  joint_positions;
+		Posture  prev_org( motion.body );
+		bool  has_prev = false;
+
+		for ( int f = begin; f < end; f++ )
+		{
+			// 次のフレームのウォームスタートのために、入力姿勢を記録しておく
+			Posture  org = motion.frames[ f ];
+
+			ApplyInverseKinematicsCCDToFrame( motion.frames[ f ], f, has_prev ? &prev_org : NULL, has_prev ? &motion.frames[ f - 1 ] : NULL, 
+				constraints, joint_paths, joint_path_signs, segment_frames, joint_positions, residuals[ f ], iterations[ f ] );
+
+			prev_org = org;
+			has_prev = true;
+		}
+	};
+
+	// フレーム区間ごとにスレッドを生成して計算（最初の区間は呼び出し元のスレッドで計算）
+	vector< thread >  workers;
+	int  frames_per_thread = ( motion.num_frames + num_threads - 1 ) / num_threads;
+	for ( int t = 1; t < num_threads; t++ )
+	{
+		int  begin = t * frames_per_thread;
+		int  end = min( begin + frames_per_thread, motion.num_frames );
+		if ( begin < end )
+			workers.push_back( thread( solve_range, begin, end ) );
+	}
+	solve_range( 0, min( frames_per_thread, motion.num_frames ) );
+	for ( int t = 0; t < (int)workers.size(); t++ )
+		workers[ t ].join();
+
+	// 計算結果を出力
+	if ( result )
+	{
+		result->residuals.swap( residuals );
+		result->iterations.swap( iterations );
+	}
+}
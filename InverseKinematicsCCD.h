@@ -0,0 +1,68 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  逆運動学計算（CCD法）
+***  （描画処理を含まないため、アプリケーション以外からも使用できる）
+**/
+
+#ifndef  _INVERSE_KINEMATICS_CCD_H_
+#define  _INVERSE_KINEMATICS_CCD_H_
+
+
+// ライブラリ・クラス定義の読み込み
+#include "SimpleHuman.h"
+#include "MyForwardKinematics.h"
+
+
+//
+//  動作全体に対する逆運動学計算の拘束条件（末端関節ごとに１つ）
+//
+struct  IKMotionConstraint
+{
+	// 支点・末端関節（支点関節が -1 の場合はルート体節を支点とする）
+	int  base_joint_no;
+	int  ee_joint_no;
+
+	// 末端関節の目標位置 [フレーム番号]
+	vector< Point3f >  targets;
+
+	// 拘束条件を適用するかどうか [フレーム番号]（空の場合は全フレームで適用）
+	vector< bool >  enabled;
+};
+
+
+//
+//  動作全体に対する逆運動学計算の結果
+//
+struct  IKMotionResult
+{
+	// 計算後の末端関節と目標位置の距離（全拘束条件の最大値） [フレーム番号]
+	vector< float >  residuals;
+
+	// CCD法の繰り返し回数（全拘束条件の合計） [フレーム番号]
+	vector< int >  iterations;
+};
+
+
+// 補助処理（グローバル関数）のプロトタイプ宣言
+
+// 末端関節から支点関節へのパス（関節の配列と各関節における末端関節の方向）を探索
+void  FindJointPath( const Skeleton * body, int base_joint_no, int ee_joint_no, vector< int > & joint_path, vector< int > & joint_path_signs );
+
+// Inverse Kinematics 計算（CCD法）
+void  ApplyInverseKinematicsCCD( Posture & posture, int base_joint_no, int ee_joint_no, Point3f ee_joint_position );
+
+// Inverse Kinematics 計算（CCD法）（探索済みのパスを指定、繰り返し回数と残差を出力）
+void  ApplyInverseKinematicsCCD( Posture & posture, const vector< int > & joint_path, const vector< int > & joint_path_signs, 
+	int ee_joint_no, Point3f ee_joint_position, int * num_iterations = NULL, float * residual = NULL );
+
+// 動作全体に対する Inverse Kinematics 計算（CCD法）（各フレームを並列に計算）
+// （支点関節がルート体節から末端関節へのパス上にない場合の FindJointPath() の探索と、ルート体節の移動・回転は未実装（レポート課題））
+void  ApplyInverseKinematicsCCDToMotion( Motion & motion, const vector< IKMotionConstraint > & constraints, IKMotionResult * result = NULL, int num_threads = 0 );
+
+
+#endif // _INVERSE_KINEMATICS_CCD_H_
@@ -14,12 +14,6 @@
 #include "InverseKinematicsCCDApp.h"
 #include "BVH.h"
 
-// プロトタイプ宣言
-
-// 順運動学計算（※レポート課題）
-void  MyForwardKinematics( const Posture & posture, vector< Matrix4f > & seg_frame_array, vector< Point3f > & joi_pos_array );
-
-
 
 //
 //  コンストラクタ
@@ -188,114 +182,6 @@ void  InverseKinematicsCCDApp::Keyboard( unsigned char key, int mx, int my )
 }
 
 
-//
-//  末端関節から支点関節へのパス（関節の配列と各関節における末端関節の方向）を探索
-// （支点関節の番号が -1 の場合は、ルート体節を支点とする）
-// （joint_path_signs は、各関節の子側に末端関節がある場合は 1、親側に末端関節がある場合は -1 を出力）
-//
-void  FindJointPath( const Skeleton * body, int base_joint_no, int ee_joint_no, vector< int > & joint_path, vector< int > & joint_path_signs )
-{
-	// 出力の配列をクリア
-	joint_path.clear();
-	joint_path_signs.clear();
-
-	// 探索時の現在の関節・体節
-	const Joint *  joint = NULL;
-	const Segment *  segment = NULL;
-
-	// 末端関節から探索を開始
-	joint = body->joints[ ee_joint_no ];
-
-	// 末端関節からルート体節に向かうパスを探索
-	while ( true )
-	{
-		// ルート側の隣の関節を辿り、ルートに到達したら終了
-		segment = joint->segments[ 0 ];
-		if ( segment->index == 0 )
-			break;
-		joint = segment->joints[ 0 ];
-
-		// 現在の関節をパスに追加
-		joint_path.push_back( joint->index );
-		
-		// 途中で支点関節に到達したら終了
-		if ( joint->index == base_joint_no )
-			break;
-	}
-
-	// 各関節における末端関節の方向を表す符号の配列を生成（全て子側に末端関節がある）
-	joint_path_signs.resize( joint_path.size(), 1 );
-
-
-	// 支点が常にルート体節、もしくは、末端関節とルート体節の間にあると仮定すれば、ここで終了しても構わない
-	// それ以外の場所に支点関節がある場合は、ルートから支点関節までのパスを求めて追加する処理が必要となる
-	return;
-
-/*
-	// ※レポート課題
-
-	// 支点がルート体節 or 支点関節がルート体節から末端関節のパス上にある場合は、終了
-	if ( ( base_joint_no == -1 ) || ( joint->index == base_joint_no ) )
-		return;
-
-	// 支点関節からルート体節へ向かうパス
-	vector< int >  joint_path2;
-
-	// 探索処理の終了判定用フラグ
-	bool  termination = false;
-
-	// 支点関節から探索を開始
-	joint = body->joints[ base_joint_no ];
-
-	// 支点関節からルート体節に向かうパスを探索
-	while ( true )
-	{
-		// 末端からルートまでのパスと合流したかどうかを判定し、合流したら終了
-		for ( ??? )
-		{
-			if ( ??? )
-			{
-				// 末端からルートまでのパスを、合流した体節の前の関節まで縮小
-				joint_path.resize( i + 1 );
-				termination = true;
-				break;
-			}
-		}
-		if ( termination )
-			break;
-
-		// 現在の関節をパスに追加
-		joint_path2.push_back( joint->index );
-
-		// ルート側の隣の関節を辿り、ルートに到達したら終了
-		segment = joint->segments[ 0 ];
-		if ( segment->index == 0 )
-			break;
-		joint = segment->joints[ 0 ];
-
-		// 末端関節に到達した場合（ルートと支点関節の間に末端関節がある場合）は、
-		// 末端関節からルートまでのパスはクリアして、支点関節から末端関節までのパスを使用
-		if ( joint->index == ee_joint_no )
-		{
-			joint_path.clear();
-			joint_path_signs.clear();
-			break;
-		}
-	}
-
-	// 末端からルートに向かうパスと、支点からルートに向かうパスを結合（後者は逆の順番で結合）
-	// 各関節における末端関節の方向を表す符号の配列を生成
-	joint_path_signs.resize( joint_path.size(), 1 );
-	for ( int i = 0; i < joint_path2.size(); i++ )
-	{
-		joint_path.push_back( joint_path2[ ??? ] );
-		joint_path_signs.push_back( -1 );
-	}
-*/
-
-}
-
-
 //
 //  Inverse Kinematics 計算（CCD法）
 //  入出力姿勢、支点関節番号（-1の場合はルートを支点とする）、末端関節番号、末端関節の目標位置を指定
@@ -306,138 +192,6 @@ void  InverseKinematicsCCDApp::ApplyInverseKinematics( Posture & posture, int ba
 }
 
 
-//
-//  Inverse Kinematics 計算（CCD法）
-//  入出力姿勢、支点関節番号（-1の場合はルートを支点とする）、末端関節番号、末端関節の目標位置を指定
-//
-void  ApplyInverseKinematicsCCD( Posture & posture, int base_joint_no, int ee_joint_no, Point3f ee_joint_position )
-{
-	// 最大繰り返し数の設定
-	const int  max_iteration = 10;
-
-	// 位置が収束したと判断するための閾値の設定
-	const float  distance_threshold = 0.01f;
-
-
-	// 順運動学計算結果の格納用変数
-	vector< Matrix4f >  segment_frames;
-	vector< Point3f >   joint_positions;
-
-	// 骨格情報
-	const Skeleton *  body = posture.body;
-
-	// 現在の関節
-	const Joint *  joint = NULL;
-
-	// 現在の関節の支点側の体節
-	const Segment *  segment = NULL;
-
-	// ルートから見た現在の関節の方向（末端側の場合は 1、支点側の場合は -1）
-	float  direction;
-
-	// 末端関節の現在位置（ワールド座標系）
-	Point3f  ee_pos;
-
-	// 現在の関節の局所座標系（ワールド座標系における関節の位置＋親側の体節の向き）
-	Matrix4f  local_frame;
-
-	// ワールド座標系から現在の関節の局所座標系への変換行列
-	Matrix4f  trans_mat;
-
-	// 末端関節の現在位置（局所座標系）
-	Point3f  local_pos;
-
-	// 支点関節から末端関節へのベクトル（局所座標系）
-	Vector3f  ee_vec;
-
-	// 末端関節の現在位置から目標位置へのベクトル（局所座標系）
-	Vector3f  goal_vec;
-
-	// 関節の回転軸と回転角度
-	Vector3f  rot_axis;
-	float  rot_angle = 0.0f;
-
-	// 現在の関節の回転
-	Matrix3f  rot;
-
-	// 末端関節の目標位置と現在位置の距離
-	Vector3f  vec;
-	float  dist = -1.0f;
-
-
-	// 引数チェック
-	if ( !posture.body || ( ee_joint_no == -1 ) || ( base_joint_no == ee_joint_no ) )
-		return;
-
-	// 末端関節から支点関節へのパス（関節の配列と各関節における末端関節の方向）を探索
-	vector< int >  joint_path, joint_path_signs;
-	FindJointPath( body, base_joint_no, ee_joint_no, joint_path, joint_path_signs );
-
-	// 現在の姿勢での各体節・関節の位置・向きを計算（順運動学計算）
-	ForwardKinematics( posture, segment_frames, joint_positions );
-
-	// CCD法の繰り返し計算（末端関節の位置が収束するか、一定回数繰り返したら終了する）
-	for ( int i = 0; i < max_iteration; i++ )
-	{
-		// 末端関節から支点関節に向かって順番に繰り返し
-		for ( int j = 0; j < joint_path.size(); j++ )
-		{
-			// 現在の関節と支点側の体節を取得
-			joint = body->joints[ joint_path[ j ] ];
-			direction = (float) joint_path_signs[ j ];
-			segment = ( direction > 0.0f ) ? joint->segments[ 0 ] : joint->segments[ 1 ];
-
-			// 末端関節の現在位置を取得
-			ee_pos = joint_positions[ ee_joint_no ];
-
-			// ※ レポート課題
-
-			// 現在の関節のローカル座標系を取得
-//			mat = ???;
-
-			// ワールド座標系から現在の関節のローカル座標系への変換行列を計算
-//			inv_mat = ???;
-
-			// 現在の関節から末端関節への方向ベクトル（現在の関節のローカル座標系）を計算
-//			ee_vec = ???;
-
-			// 現在の関節から目標位置への方向ベクトル（現在の関節のローカル座標系）を計算
-//			goal_vec = ???;
-
-			// 現在の関節の回転軸・回転角度（0～π）を計算
-//			rot_axis = ???;
-//			rot_angle = ???;
-
-			// 回転角度が微少であれば、回転は適用せずにスキップする
-			if ( rot_angle < 0.001f )
-				continue;
-
-			// 回転を適用（回転の方向を考慮しない）
-//			rot.set( AxisAngle4f( rot_axis, rot_angle ) );
-//			???;
-
-			// 回転後の回転を設定
-			posture.joint_rotations[ joint->index ].set( rot );
-
-			// 末端関節と現在の関節の間にルート体節がある場合は、ルート体節に移動・回転を適用
-			if ( direction < 0.0f )
-			{
-			}
-
-			// 更新された姿勢にもとづいて、各体節・関節の位置・向きを再計算（順運動学計算）
-			MyForwardKinematics( posture, segment_frames, joint_positions );
-		}
-
-		// 収束判定、末端関節の目標位置と現在位置の距離が閾値以下になったら終了
-		ee_pos = joint_positions[ ee_joint_no ];
-		vec.sub( ee_joint_position, ee_pos );
-		dist = vec.lengthSquared();
-		if ( dist < distance_threshold * distance_threshold )
-			break;
-	}
-}
-
-
 //
 //  以下、補助処理
 //
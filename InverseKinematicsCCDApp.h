@@ -15,6 +15,7 @@
 // ライブラリ・クラス定義の読み込み
 #include "SimpleHuman.h"
 #include "SimpleHumanGLUT.h"
+#include "InverseKinematicsCCD.h"
 
 
 //
@@ -97,16 +98,4 @@ class  InverseKinematicsCCDApp : public GLUTBaseApp
 };
 
 
-// 補助処理（グローバル関数）のプロトタイプ宣言
-
-// 末端関節から支点関節へのパス（関節の配列と各関節における末端関節の方向）を探索
-void  FindJointPath( const Skeleton * body, int base_joint_no, int ee_joint_no, vector< int > & joint_path, vector< int > & joint_path_signs );
-
-// Inverse Kinematics 計算（CCD法）
-void  ApplyInverseKinematicsCCD( Posture & posture, int base_joint_no, int ee_joint_no, Point3f ee_joint_position );
-
-// 順運動学計算（※レポート課題）
-void  MyForwardKinematics( const Posture & posture, vector< Matrix4f > & seg_frame_array, vector< Point3f > & joi_pos_array );
-
-
 #endif // _INVERSE_KINEMATICS_CCD_APP_H_
@@ -0,0 +1,149 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  ワーカースレッドによるジョブの非同期実行
+**/
+
+
+// ライブラリ・クラス定義の読み込み
+#include "JobSystem.h"
+
+// 処理時間の計測
+#include "Trace.h"
+
+// 標準ライブラリの読み込み
+#include <chrono>
+
+using namespace  std;
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  ワーカースレッドによるジョブの非同期実行クラス
+//
+
+
+//
+//  コンストラクタ
+//
+JobSystem::JobSystem( int num_threads )
+{
+	stopping = false;
+
+	// ワーカースレッド数を決定（描画スレッドの分を残す）
+	if ( num_threads <= 0 )
+	{
+		num_threads = (int) thread::hardware_concurrency() - 1;
+		if ( num_threads < 1 )
+			num_threads = 1;
+	}
+
+	// ワーカースレッドを開始
+	for ( int i = 0; i < num_threads; i++ )
+		workers.push_back( thread( &JobSystem::WorkerMain, this ) );
+}
+
+
+//
+//  デストラクタ
+//
+JobSystem::~JobSystem()
+{
+	// 実行待ちのジョブを中断し、ワーカースレッドに終了を通知
+	CancelAll();
+	{
+		lock_guard< mutex >  lock( queue_mutex );
+		stopping = true;
+	}
+	queue_cond.notify_all();
+
+	// 実行中のジョブの終了を待つ
+	for ( size_t i = 0; i < workers.size(); i++ )
+		workers[ i ].join();
+}
+
+
+//
+//  ジョブを登録
+//
+JobHandle  JobSystem::Submit( const function< void( Job & ) > & func )
+{
+	JobHandle  job = make_shared< Job >( func );
+	{
+		lock_guard< mutex >  lock( queue_mutex );
+		queue.push_back( job );
+	}
+	queue_cond.notify_one();
+	return  job;
+}
+
+
+//
+//  全てのジョブを中断
+//
+void  JobSystem::CancelAll()
+{
+	lock_guard< mutex >  lock( queue_mutex );
+
+	// 実行待ちのジョブは実行せずに削除
+	for ( size_t i = 0; i < queue.size(); i++ )
+	{
+		queue[ i ]->Cancel();
+		queue[ i ]->state.store( JOB_CANCELLED );
+	}
+	queue.clear();
+}
+
+
+//
+//  ジョブの終了を待つ
+//
+void  JobSystem::Wait( const JobHandle & job )
+{
+	// ジョブは長時間の処理を想定しているため、条件変数は使わずに一定間隔で確認する
+	while ( job && !job->IsDone() )
+		this_thread::sleep_for( chrono::milliseconds( 1 ) );
+}
+
+
+//
+//  ワーカースレッドの処理
+//
+void  JobSystem::WorkerMain()
+{
+	TraceSetThreadName( "JobWorker" );
+
+	while ( true )
+	{
+		// 実行待ちのジョブを取得（ジョブがなければ登録されるまで待機）
+		JobHandle  job;
+		{
+			unique_lock< mutex >  lock( queue_mutex );
+			queue_cond.wait( lock, [ this ] { return  stopping || !queue.empty(); } );
+			if ( stopping && queue.empty() )
+				return;
+			job = queue.front();
+			queue.pop_front();
+		}
+
+		// 実行前に中断された場合は実行しない
+		if ( job->IsCancelled() )
+		{
+			job->state.store( JOB_CANCELLED );
+			continue;
+		}
+
+		// ジョブを実行
+		job->state.store( JOB_RUNNING );
+		{
+			TRACE_SCOPE_CAT( "Job", "job" );
+			job->func( *job );
+		}
+		job->state.store( job->IsCancelled() ? JOB_CANCELLED : JOB_FINISHED );
+	}
+}
@@ -0,0 +1,133 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  ワーカースレッドによるジョブの非同期実行
+***
+***  Submit() で登録したジョブを、ワーカースレッドのいずれかが登録順に実行する
+***  ジョブの中断は協調的に行う（ジョブの処理側で定期的に IsCancelled() を確認して処理を打ち切る）
+***  ジョブの進捗・状態は、登録時に返される JobHandle から任意のスレッドで参照できる
+**/
+
+#ifndef  _JOB_SYSTEM_H_
+#define  _JOB_SYSTEM_H_
+
+
+// 標準ライブラリの読み込み
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+
+
+//
+//  ジョブの状態
+//
+enum  JobState
+{
+	JOB_PENDING,    // 実行待ち
+	JOB_RUNNING,    // 実行中
+	JOB_FINISHED,   // 実行完了
+	JOB_CANCELLED   // 中断（実行前に中断された場合も含む）
+};
+
+
+//
+//  ジョブ（ジョブの登録側と実行スレッドで共有）
+//
+class  Job
+{
+  protected:
+	// ジョブの処理
+	std::function< void( Job & ) >  func;
+
+	// ジョブの状態
+	std::atomic< int >  state;
+
+	// 中断の要求
+	std::atomic< bool >  cancel_requested;
+
+	// 進捗（0～1）
+	std::atomic< float >  progress;
+
+  public:
+	// コンストラクタ
+	Job( const std::function< void( Job & ) > & f ) : func( f ), state( JOB_PENDING ), cancel_requested( false ), progress( 0.0f ) {}
+
+  public:
+	// 中断を要求（実行中のジョブは、処理側が中断の要求を確認した時点で終了する）
+	void  Cancel() { cancel_requested.store( true ); }
+
+	// 中断が要求されているかどうか（ジョブの処理側で定期的に確認する）
+	bool  IsCancelled() const { return  cancel_requested.load( std::memory_order_relaxed ); }
+
+	// 進捗を設定・取得
+	void  SetProgress( float p ) { progress.store( p, std::memory_order_relaxed ); }
+	float  GetProgress() const { return  progress.load( std::memory_order_relaxed ); }
+
+	// 状態を取得
+	JobState  GetState() const { return  (JobState) state.load(); }
+
+	// 終了したかどうか（実行完了または中断）
+	bool  IsDone() const { int s = state.load(); return  ( s == JOB_FINISHED ) || ( s == JOB_CANCELLED ); }
+
+	friend class  JobSystem;
+};
+
+// ジョブの参照（ジョブは全ての参照がなくなった時点で削除される）
+typedef  std::shared_ptr< Job >  JobHandle;
+
+
+//
+//  ワーカースレッドによるジョブの非同期実行クラス
+//
+class  JobSystem
+{
+  protected:
+	// ワーカースレッド
+	std::vector< std::thread >  workers;
+
+	// 実行待ちのジョブ
+	std::deque< JobHandle >  queue;
+
+	// 実行待ちのジョブの排他制御・通知
+	std::mutex  queue_mutex;
+	std::condition_variable  queue_cond;
+
+	// 終了処理中かどうか
+	bool  stopping;
+
+  public:
+	// コンストラクタ（ワーカースレッド数に 0 以下を指定すると、ハードウェアのスレッド数－１ とする）
+	JobSystem( int num_threads = 0 );
+
+	// デストラクタ（実行待ちのジョブを中断し、実行中のジョブの終了を待つ）
+	~JobSystem();
+
+  public:
+	// ジョブを登録
+	JobHandle  Submit( const std::function< void( Job & ) > & func );
+
+	// 全てのジョブを中断
+	void  CancelAll();
+
+	// ジョブの終了を待つ
+	static void  Wait( const JobHandle & job );
+
+	// ワーカースレッド数を取得
+	int  GetNumThreads() const { return  (int) workers.size(); }
+
+  protected:
+	// ワーカースレッドの処理
+	void  WorkerMain();
+};
+
+
+#endif // _JOB_SYSTEM_H_
@@ -0,0 +1,225 @@
+﻿#include "LazyFrameCache.h"
+#include "Trace.h"
+
+// 1動作分のキャッシュの使用量の上限の初期値・先読みするフレーム数の初期値
+static const size_t kDefaultLazyCacheMemoryLimit = (size_t)128 * 1024 * 1024;
+static const int kDefaultPrefetchFrames = 60;
+
+LazyFrameCache::LazyFrameCache()
+    : memory_limit(kDefaultLazyCacheMemoryLimit), prefetch_frames(kDefaultPrefetchFrames),
+      source(nullptr), bound(false), memory_usage(0), num_hits(0), num_misses(0),
+      prefetch_requested(false), stopping(false), prefetch_center(0), prefetch_direction(1) {}
+
+LazyFrameCache::~LazyFrameCache() {
+    StopPrefetchThread();
+}
+
+// 使用量の上限を設定（超えている場合はこの場で破棄）
+void LazyFrameCache::SetMemoryLimit(size_t bytes) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    memory_limit = bytes;
+    while (memory_usage > memory_limit && !lru.empty()) {
+        Slot& slot = slots[lru.back()];
+        memory_usage -= slot.bytes;
+        slot.entry.reset();
+        slot.bytes = 0;
+        lru.pop_back();
+    }
+}
+
+// 動作を登録
+void LazyFrameCache::Bind(const Motion* m) {
+    if (IsBoundTo(m))
+        return;
+    Reset();
+    if (!m || !m->body || m->num_frames <= 0)
+        return;
+
+    TRACE_SCOPE_CAT("LazyFrameCache::Bind", "analysis");
+    snapshot = *m;
+    source = m;
+    slots.assign(m->num_frames, Slot());
+    bound = true;
+}
+
+// 登録済みの動作かどうか（フレーム数・フレーム間隔の変更も別の動作とみなす）
+bool LazyFrameCache::IsBoundTo(const Motion* m) const {
+    return bound && m == source && m->num_frames == snapshot.num_frames && m->interval == snapshot.interval;
+}
+
+// 先読みを停止し、全フレームと登録した動作を破棄
+void LazyFrameCache::Reset() {
+    StopPrefetchThread();
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    slots.clear();
+    lru.clear();
+    memory_usage = 0;
+    num_hits = 0;
+    num_misses = 0;
+    source = nullptr;
+    bound = false;
+}
+
+// 指定フレームを取得（キャッシュになければこの場で計算する）
+std::shared_ptr<const FrameSegmentVoxelGrid> LazyFrameCache::Acquire(int frame) {
+    if (!bound || frame < 0 || frame >= (int)slots.size())
+        return nullptr;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        std::shared_ptr<const FrameSegmentVoxelGrid> entry = FindLocked(frame, true);
+        if (entry) {
+            num_hits++;
+            return entry;
+        }
+        num_misses++;
+    }
+
+    TRACE_SCOPE_CAT("LazyFrameCache::Miss", "analysis");
+    std::shared_ptr<const FrameSegmentVoxelGrid> entry = BuildEntry(frame);
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    InsertLocked(frame, entry);
+    return entry;
+}
+
+// 先読みを要求（先読みスレッドは最初の要求時に開始）
+void LazyFrameCache::RequestPrefetch(int frame, int direction) {
+    if (!bound || prefetch_frames <= 0)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        prefetch_center = frame;
+        prefetch_direction = (direction < 0) ? -1 : 1;
+        prefetch_requested = true;
+    }
+    if (!prefetch_thread.joinable())
+        prefetch_thread = std::thread(&LazyFrameCache::PrefetchMain, this);
+    prefetch_cond.notify_one();
+}
+
+size_t LazyFrameCache::GetMemoryUsage() const {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return memory_usage;
+}
+
+int LazyFrameCache::GetNumCachedFrames() const {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return (int)lru.size();
+}
+
+// 先読みスレッドの処理
+void LazyFrameCache::PrefetchMain() {
+    TraceSetThreadName("FramePrefetch");
+
+    int num_frames = (int)slots.size();
+    while (true) {
+        int center, direction, window;
+        {
+            std::unique_lock<std::mutex> lock(cache_mutex);
+            prefetch_cond.wait(lock, [this] { return stopping || prefetch_requested; });
+            if (stopping)
+                return;
+            center = prefetch_center;
+            direction = prefetch_direction;
+            window = GetPrefetchWindowLocked();
+            prefetch_requested = false;
+        }
+
+        // 再生位置に近いフレームから順に計算（動作の終端では先頭に戻る）
+        for (int i = 1; i <= window; ++i) {
+            int frame = ((center + direction * i) % num_frames + num_frames) % num_frames;
+            {
+                std::lock_guard<std::mutex> lock(cache_mutex);
+                if (stopping || prefetch_requested)
+                    break;
+                if (slots[frame].entry)
+                    continue;
+            }
+
+            TRACE_SCOPE_CAT("LazyFrameCache::Prefetch", "analysis");
+            std::shared_ptr<const FrameSegmentVoxelGrid> entry = BuildEntry(frame);
+            std::lock_guard<std::mutex> lock(cache_mutex);
+            InsertLocked(frame, entry);
+        }
+    }
+}
+
+// 先読みスレッドを終了（計算中のフレームの完了を待つ）
+void LazyFrameCache::StopPrefetchThread() {
+    if (!prefetch_thread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        stopping = true;
+    }
+    prefetch_cond.notify_all();
+    prefetch_thread.join();
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    stopping = false;
+    prefetch_requested = false;
+}
+
+// 1フレーム分を計算（前フレームがキャッシュにあれば主軸方向速度の計算に使用）
+std::shared_ptr<const FrameSegmentVoxelGrid> LazyFrameCache::BuildEntry(int frame) {
+    std::shared_ptr<const FrameSegmentVoxelGrid> prev;
+    if (frame > 0) {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        prev = FindLocked(frame - 1, false);
+    }
+
+    std::shared_ptr<FrameSegmentVoxelGrid> entry = std::make_shared<FrameSegmentVoxelGrid>();
+    build_function(&snapshot, frame, prev.get(), *entry);
+    return entry;
+}
+
+// キャッシュに追加し、上限を超えた分を最後に使われたのが古い順に破棄（追加したフレームは破棄しない）
+void LazyFrameCache::InsertLocked(int frame, const std::shared_ptr<const FrameSegmentVoxelGrid>& entry) {
+    Slot& slot = slots[frame];
+    if (slot.entry) {
+        lru.splice(lru.begin(), lru, slot.lru_pos);
+        return;
+    }
+    slot.entry = entry;
+    slot.bytes = EstimateEntryBytes(*entry);
+    lru.push_front(frame);
+    slot.lru_pos = lru.begin();
+    memory_usage += slot.bytes;
+
+    while (memory_usage > memory_limit && lru.size() > 1) {
+        Slot& victim = slots[lru.back()];
+        memory_usage -= victim.bytes;
+        victim.entry.reset();
+        victim.bytes = 0;
+        lru.pop_back();
+    }
+}
+
+std::shared_ptr<const FrameSegmentVoxelGrid> LazyFrameCache::FindLocked(int frame, bool touch) {
+    Slot& slot = slots[frame];
+    if (slot.entry && touch)
+        lru.splice(lru.begin(), lru, slot.lru_pos);
+    return slot.entry;
+}
+
+// 先読みするフレーム数（先読みしたフレーム同士で破棄し合わないよう、上限に収まるフレーム数の半分までとする）
+int LazyFrameCache::GetPrefetchWindowLocked() const {
+    int window = prefetch_frames;
+    if (!lru.empty() && memory_usage > 0) {
+        size_t average_bytes = memory_usage / lru.size();
+        int capacity = (average_bytes > 0) ? (int)(memory_limit / average_bytes) : window;
+        if (window > capacity / 2)
+            window = capacity / 2;
+    }
+    if (window > (int)slots.size() - 1)
+        window = (int)slots.size() - 1;
+    return window;
+}
+
+// 1フレーム分の使用量（疎ボクセルの確保済み領域を含む）
+size_t LazyFrameCache::EstimateEntryBytes(const FrameSegmentVoxelGrid& entry) {
+    size_t bytes = sizeof(FrameSegmentVoxelGrid);
+    for (const SegmentVoxelGrid& grid : entry.segment_grids)
+        bytes += sizeof(SegmentVoxelGrid) + grid.voxels.capacity() * sizeof(SparseVoxel);
+    return bytes;
+}
@@ -0,0 +1,91 @@
+﻿#pragma once
+#include <list>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+#include "SimpleHuman.h"
+#include "VoxelData.h"
+
+// 瞬間表示用の遅延フレームキャッシュ（1動作分）
+// 要求されたフレームを初回のみボクセル化して保持し、使用量が上限を超えたら最後に使われたのが最も古いフレームから破棄する
+// 再生位置の先のフレームはワーカースレッドで先読みする
+// 計算は登録時の動作のコピーから行う（各フレームは基準姿勢付きの疎ボクセルのため、表示側の動作の移動・回転は合成時に反映される）
+class LazyFrameCache {
+public:
+    // 1フレーム分の疎ボクセルを計算する関数（prev は前フレームの計算結果、なければ nullptr）
+    typedef std::function<void(Motion* m, int frame, const FrameSegmentVoxelGrid* prev, FrameSegmentVoxelGrid& out)> BuildFunction;
+
+    LazyFrameCache();
+    ~LazyFrameCache();
+
+    // 設定
+    void SetBuildFunction(const BuildFunction& func) { build_function = func; }
+    void SetMemoryLimit(size_t bytes);
+    size_t GetMemoryLimit() const { return memory_limit; }
+    void SetPrefetchFrames(int frames) { prefetch_frames = (frames < 0) ? 0 : frames; }
+    int GetPrefetchFrames() const { return prefetch_frames; }
+
+    // 動作を登録（同じ動作が登録済みなら何もしない、異なる場合はキャッシュを破棄して動作をコピー）
+    void Bind(const Motion* m);
+    bool IsBoundTo(const Motion* m) const;
+
+    // 先読みを停止し、全フレームと登録した動作を破棄
+    void Reset();
+
+    // 指定フレームを取得（キャッシュになければこの場で計算する）
+    std::shared_ptr<const FrameSegmentVoxelGrid> Acquire(int frame);
+
+    // 指定フレームから再生方向（+1 / -1）の先のフレームの先読みを要求
+    void RequestPrefetch(int frame, int direction);
+
+    // 統計
+    size_t GetMemoryUsage() const;
+    int GetNumCachedFrames() const;
+    long long GetNumHits() const { return num_hits; }
+    long long GetNumMisses() const { return num_misses; }
+
+private:
+    // キャッシュの要素（lru 内の位置を保持）
+    struct Slot {
+        std::shared_ptr<const FrameSegmentVoxelGrid> entry;
+        std::list<int>::iterator lru_pos;
+        size_t bytes;
+        Slot() : bytes(0) {}
+    };
+
+    BuildFunction build_function;
+    size_t memory_limit;
+    int prefetch_frames;
+
+    // 登録した動作（source は同一性の判定のみに使用し、計算にはコピーを使用）
+    const Motion* source;
+    Motion snapshot;
+    bool bound;
+
+    // フレームごとの要素・使用順（先頭が最近使われたフレーム）・使用量
+    std::vector<Slot> slots;
+    std::list<int> lru;
+    size_t memory_usage;
+    long long num_hits;
+    long long num_misses;
+    mutable std::mutex cache_mutex;
+
+    // 先読みスレッドと要求
+    std::thread prefetch_thread;
+    std::condition_variable prefetch_cond;
+    bool prefetch_requested;
+    bool stopping;
+    int prefetch_center;
+    int prefetch_direction;
+
+    void PrefetchMain();
+    void StopPrefetchThread();
+    std::shared_ptr<const FrameSegmentVoxelGrid> BuildEntry(int frame);
+    void InsertLocked(int frame, const std::shared_ptr<const FrameSegmentVoxelGrid>& entry);
+    std::shared_ptr<const FrameSegmentVoxelGrid> FindLocked(int frame, bool touch);
+    int GetPrefetchWindowLocked() const;
+    static size_t EstimateEntryBytes(const FrameSegmentVoxelGrid& entry);
+};
@@ -1,6 +1,8 @@
 #include "MotionApp.h"
 #include "BVH.h"
 #include "imgui.h"
+#include "Trace.h"
+#include "TraceOverlay.h"
 #include <string>
 #include <algorithm>
 #include <cstdio>
@@ -11,6 +13,24 @@ using namespace std;
 
 static const float kPi = 3.14159265358979323846f;
 
+// ͑Ώ̗ۗ̈]ieɑ΂1mj
+static const float kWorldBoundsMargin = 1.0f;
+
+// ̓Wu̓ro߂Jt[Ԋu
+static const int kAnalysisPublishInterval = 100;
+
+// xt[LbV̎gpʂ̏̏liMBA삲Ɓj
+static const int kDefaultLazyCacheLimitMB = 128;
+
+// ^CC̃gbNi1E2Eݐς̑ΏێԔ͈́j
+static const int kTimelineTracks = 3;
+
+// pގ̃CfbNX̕ۑt@C
+static const char* kPoseIndexFileName = "pose_index.pidx";
+
+// Wc̓vf̊̃t@C
+static const char* kDefaultGroupModelFileName = "group_model.vgm";
+
 static int GetFrameIndexFromTime(const Motion* m, float time)
 {
     if (!m || m->num_frames <= 0 || m->interval <= 1e-8f)
@@ -33,7 +53,7 @@ static void SpecialKeyWrapper(int key, int x, int y)
 }
 
 // RXgN^FAvP[V̏Ԃݒ
-MotionApp::MotionApp() {
+MotionApp::MotionApp() : analysis_jobs(2) {
     g_app_instance = this;
     app_name = "Motion Analysis App";
     motion = NULL; 
@@ -70,11 +90,27 @@ MotionApp::MotionApp() {
     prev_rot1_y_deg = 0.0f;
     prev_rot2_y_deg = 0.0f;
     has_initial_root_cache = false;
+    similar_pose_epsilon = 0.05f;
+    show_trace_overlay = false;
+    analysis_pending = false;
+    lazy_cache_limit_mb = kDefaultLazyCacheLimitMB;
+    async_voxel_update = true;
+    snprintf(group_model_path, sizeof(group_model_path), "%s", kDefaultGroupModelFileName);
+    analyzer.SetLazyFrameCacheMemoryLimit((size_t)lazy_cache_limit_mb * 1024 * 1024);
+    timeline = NULL;
+    show_timeline = true;
+    timeline_seeking = false;
+    timeline_selecting = false;
+    timeline_select_start = 0.0f;
 }
 
 // fXgN^F[Vf[^ƃ|X`
 MotionApp::~MotionApp() 
 {
+    // ̓WuE{NZ̍XVEt[̐ǂ݂iijQƂĂ邽߁AɏI҂
+    WaitVoxelUpdate();
+    CancelAnalysisJob(true);
+    analyzer.ResetLazyFrameCaches();
     if ( motion ) {
         if (motion->body) delete motion->body;
         delete motion;
@@ -82,6 +118,7 @@ MotionApp::~MotionApp()
     if ( motion2 ) delete motion2; 
     if ( curr_posture ) delete curr_posture;
     if ( curr_posture2 ) delete curr_posture2;
+    if ( timeline ) delete timeline;
 }
 
 // AvP[V̏BVHt@C̓ǂݍ
@@ -89,10 +126,20 @@ void MotionApp::Initialize()
 {
     GLUTBaseApp::Initialize();
     glutSpecialFunc(SpecialKeyWrapper);
+    timeline = new Timeline();
+    pose_index.LoadFromFile(kPoseIndexFileName);
     OpenNewBVH(); 
     OpenNewBVH2();
 }
 
+// EBhETCYύXɃ^CC̕`̈ʂ̉ɐݒ
+void MotionApp::Reshape(int w, int h)
+{
+    GLUTBaseApp::Reshape(w, h);
+    if (timeline)
+        timeline->SetViewAreaBottom(0, 0, 0, kTimelineTracks, 16, 2);
+}
+
 // Aj[VJnAZbg
 void MotionApp::Start()
 {
@@ -100,10 +147,12 @@ void MotionApp::Start()
     on_animation = true;
     animation_time = 0.0f;
     Animation(0.0f);
+    InterpolateAnimation(0.0f, 0.0f);
 }
 
 // L[{[h͂iAj[VAXCXAʑIȂǁj
 void MotionApp::Keyboard(unsigned char key, int mx, int my) {
+    WaitVoxelUpdate();
     GLUTBaseApp::Keyboard(key, mx, my);
 
     // {
@@ -256,8 +305,33 @@ void MotionApp::Special(int key, int mx, int my)
 // }EXNbNiMY̎IƃhbOJn/Ij
 void MotionApp::MouseClick(int button, int state, int mx, int my)
 {
+    WaitVoxelUpdate();
     GLUTBaseApp::MouseClick(button, state, mx, my);
 
+    // ^CC̃NbNiShift ȂȂݐς̑ΏێԔ͈͂̑IAȊO͍Đ̕ύXj
+    if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN && show_timeline && timeline && motion && motion2 &&
+        timeline->GetTrackByPosition(mx, my) >= 0) {
+        float time = timeline->GetTimeByPosition(mx);
+        if (glutGetModifiers() & GLUT_ACTIVE_SHIFT) {
+            timeline_selecting = true;
+            timeline_select_start = time;
+            analyzer.SetAccumulationTimeRange(time, time);
+        } else {
+            timeline_seeking = true;
+            SeekAnimation(time);
+        }
+        return;
+    }
+    if (button == GLUT_LEFT_BUTTON && state == GLUT_UP && (timeline_seeking || timeline_selecting)) {
+        // 1t[ɖȂ͈͂̑I͉Ƃ݂Ȃ
+        if (timeline_selecting &&
+            fabsf(timeline->GetTimeByPosition(mx) - timeline_select_start) < motion->interval)
+            analyzer.ClearAccumulationTimeRange();
+        timeline_seeking = false;
+        timeline_selecting = false;
+        return;
+    }
+
     if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN && use_model_gizmo && motion && motion2) {
         Matrix3f gizmo_ori;
         gizmo_ori.setIdentity();
@@ -303,7 +377,20 @@ void MotionApp::MouseClick(int button, int state, int mx, int my)
 // }EXhbOiMYɂXCXʂ̈ړE]j
 void MotionApp::MouseDrag(int mx, int my)
 {
+    // ^CCł̃hbO̓J𑀍삵Ȃ
+    if (timeline_seeking || timeline_selecting) {
+        float time = timeline->GetTimeByPosition(mx);
+        if (timeline_selecting) {
+            WaitVoxelUpdate();
+            analyzer.SetAccumulationTimeRange(timeline_select_start, time);
+        } else {
+            SeekAnimation(time);
+        }
+        return;
+    }
+
     if (use_model_gizmo && model_gizmo_dragging && model_gizmo.GetSelectedAxis() != GIZMO_NONE) {
+        WaitVoxelUpdate();
         Point3f translation;
         Matrix4f local_rotation;
         model_gizmo.UpdateDrag(mx, my, win_width, win_height, translation, local_rotation);
@@ -327,6 +414,7 @@ void MotionApp::MouseMotion(int mx, int my)
 }
 
 // Aj[Vi߁Ã݂|X`XV
+// ĐŒ̎ԍ݂Ői߂ip͕`O InterpolateAnimation ŌvZj
 void MotionApp::Animation(float delta)
 {
     if (!on_animation || drag_mouse_l || !motion || !motion2)
@@ -337,8 +425,25 @@ void MotionApp::Animation(float delta)
         animation_time = 0.0f;
     if (animation_time < 0.0f) 
         animation_time = 0.0f;
-    motion->GetPosture(animation_time, *curr_posture);
-    motion2->GetPosture(animation_time, *curr_posture2);
+}
+
+// ̍XV܂ł̌oߎԂ̊ɉĕԂ̎pvZ
+void MotionApp::InterpolateAnimation(float alpha, float delta)
+{
+    if (!on_animation || drag_mouse_l || !motion || !motion2)
+        return;
+    float max_duration = max(motion->GetDuration(), motion2->GetDuration());
+    float display_time = min(animation_time + alpha * delta * animation_speed, max_duration);
+    motion->GetPosture(display_time, *curr_posture);
+    motion2->GetPosture(display_time, *curr_posture2);
+}
+
+// ĐE̓Wu̎ŝݖt[XVE`i~͓͂Ƃ̂ݍĕ`j
+bool MotionApp::IsAnimating()
+{
+    if (analysis_job)
+        return true;
+    return on_animation && !drag_mouse_l && motion && motion2;
 }
 
 // 3DfA{NZAMYA2DUIAeLXg`
@@ -346,26 +451,35 @@ void MotionApp::Display()
 {
     GLUTBaseApp::Display();
 
-    // 1. 3Df̕` - Motion1 (ԐF)
-    if (curr_posture) {
-        DrawPostureWithSegmentMode(*curr_posture, Color3f(1.0f, 0.0f, 0.0f));
-        glColor3f(0.0f, 0.0f, 0.0f);
-        DrawPostureShadow(*curr_posture, shadow_dir, shadow_color); 
-    }
-    
-    // 2. 3Df̕` - Motion2 (F)
-    if (curr_posture2) {
-        DrawPostureWithSegmentMode(*curr_posture2, Color3f(0.0f, 0.0f, 1.0f));
-        glColor3f(0.0f, 0.0f, 0.0f);
-        DrawPostureShadow(*curr_posture2, shadow_dir, shadow_color); 
+    {
+        TRACE_SCOPE_CAT("Display::Postures", "render");
+
+        // 1. 3Df̕` - Motion1 (ԐF)
+        if (curr_posture) {
+            DrawPostureWithSegmentMode(*curr_posture, Color3f(1.0f, 0.0f, 0.0f));
+            glColor3f(0.0f, 0.0f, 0.0f);
+            DrawPostureShadow(*curr_posture, shadow_dir, shadow_color); 
+        }
+        
+        // 2. 3Df̕` - Motion2 (F)
+        if (curr_posture2) {
+            DrawPostureWithSegmentMode(*curr_posture2, Color3f(0.0f, 0.0f, 1.0f));
+            glColor3f(0.0f, 0.0f, 0.0f);
+            DrawPostureShadow(*curr_posture2, shadow_dir, shadow_color); 
+        }
     }
 
+    // ̓Wu̓ro߁Eʂ̎荞
+    PollAnalysisJob();
+
     // 3. Analyzerɂ3D`
     if (analyzer.show_planes)
         analyzer.DrawSlicePlanes();
 
-    if (!model_gizmo_dragging)
+    if (!model_gizmo_dragging) {
+        TRACE_SCOPE_CAT("Display::UpdateVoxels", "analysis");
         UpdateVoxelDataWrapper();
+    }
     analyzer.DrawVoxels3D();
 
     // 4. MY̕`
@@ -393,9 +507,11 @@ void MotionApp::Display()
         glPopAttrib();
     }
 
-    // 5. 2D UI̕`iCT}bvj
+    // 5. 2D UI̕`iCT}bvE^CCj
     if (analyzer.show_maps)
         analyzer.DrawCTMaps(win_width, win_height);
+    if (show_timeline)
+        DrawAnalysisTimeline();
 
     // 6. eLXg̕\
     const char* feature_names[] = {"Occupancy", "Speed", "Jerk", "Inertia", "PrincipalAxis"};
@@ -439,6 +555,7 @@ void MotionApp::Display()
     }
 
     // === ImGui Control Panel ===
+    TRACE_SCOPE_CAT("Display::ControlPanel", "render");
     ImGui::Begin("Control Panel");
 
     // --- Animation ---
@@ -448,11 +565,73 @@ void MotionApp::Display()
     ImGui::SetNextItemWidth(120);
     ImGui::SliderFloat("Speed", &animation_speed, 0.0f, 3.0f);
 
+    // --- Analysis Job ---
+    if (analysis_job && analysis_job_handle) {
+        float progress = analysis_job_handle->GetProgress();
+        char overlay[128];
+        sprintf(overlay, "%s %.0f%%", analysis_job->GetStageName(), progress * 100.0f);
+        ImGui::ProgressBar(progress, ImVec2(-1.0f, 0.0f), overlay);
+    }
+
     // --- Display ---
     if (ImGui::CollapsingHeader("Display", ImGuiTreeNodeFlags_DefaultOpen)) {
         ImGui::Checkbox("Show Planes (B)", &analyzer.show_planes);
         ImGui::Checkbox("Show Maps (M)", &analyzer.show_maps);
         ImGui::Checkbox("Show Voxels (K)", &analyzer.show_voxels);
+        ImGui::Checkbox("Performance Overlay", &show_trace_overlay);
+        ImGui::Checkbox("Show Timeline", &show_timeline);
+
+        // t[̎s^C~OiE`px̏jƏ
+        FrameScheduler& scheduler = GetFrameScheduler();
+        bool vsync = scheduler.IsVSyncEnabled();
+        if (ImGui::Checkbox("VSync", &vsync))
+            scheduler.SetVSync(vsync);
+        ImGui::SameLine();
+        int max_fps = (int)scheduler.GetMaxFrameRate();
+        ImGui::SetNextItemWidth(120);
+        if (ImGui::SliderInt("FPS Cap", &max_fps, 0, 240, max_fps == 0 ? "Off" : "%d"))
+            scheduler.SetMaxFrameRate((float)max_fps);
+        const FrameStats& stats = scheduler.GetStats();
+        ImGui::Text("Update %.2f ms x%d  Render %.2f ms  Budget %.0f%%",
+                    stats.update_ms, stats.update_steps, stats.render_ms, stats.budget_usage * 100.0f);
+        ImGui::Text("Over budget: %lld / %lld frames", stats.num_over_budget_frames, stats.num_frames);
+
+        // ʂƂ̋ǏObhi؂ւƃt[LbVvZj
+        bool segment_local = analyzer.GetVoxelGridSpace() == VOXEL_GRID_SEGMENT_LOCAL;
+        if (ImGui::Checkbox("Segment-local Grids", &segment_local)) {
+            WaitVoxelUpdate();
+            analyzer.SetVoxelGridSpace(segment_local ? VOXEL_GRID_SEGMENT_LOCAL : VOXEL_GRID_WORLD);
+            StartAnalysisJob(false);
+        }
+
+        // t[LbV̍\z܂ł́A\t[݂̂vZEێxt[LbVgp
+        ImGui::SetNextItemWidth(120);
+        if (ImGui::SliderInt("Lazy Cache MB", &lazy_cache_limit_mb, 16, 1024)) {
+            WaitVoxelUpdate();
+            analyzer.SetLazyFrameCacheMemoryLimit((size_t)lazy_cache_limit_mb * 1024 * 1024);
+        }
+        ImGui::Checkbox("Async Voxel Update", &async_voxel_update);
+
+        // vZXV̒l͓ǂ܂AJς݂̌ʂ̓v\
+        std::shared_ptr<const SpatialDisplaySnapshot> snapshot = analyzer.AcquireDisplaySnapshot();
+        if (!analyzer.HasFrameCache()) {
+            ImGui::Text("Lazy cache: M1 %d frames %.1f MB, M2 %d frames %.1f MB",
+                        snapshot->lazy_cached_frames[0], snapshot->lazy_memory_bytes[0] / (1024.0f * 1024.0f),
+                        snapshot->lazy_cached_frames[1], snapshot->lazy_memory_bytes[1] / (1024.0f * 1024.0f));
+        } else {
+            // t[LbV̎gpiʎqǑ`ŕێꍇƂ̔rj
+            FrameCacheMemoryInfo info1 = analyzer.GetFrameCacheMemoryInfo(0);
+            FrameCacheMemoryInfo info2 = analyzer.GetFrameCacheMemoryInfo(1);
+            if (analyzer.HasMappedFrameCache())
+                ImGui::Text("Frame cache: mapped %.1f MB, %zu voxels",
+                            (info1.mapped_bytes + info2.mapped_bytes) / (1024.0f * 1024.0f),
+                            info1.num_voxels + info2.num_voxels);
+            else
+                ImGui::Text("Frame cache: %.1f MB (uncompressed %.1f MB), %zu voxels",
+                            (info1.total_bytes + info2.total_bytes) / (1024.0f * 1024.0f),
+                            (info1.uncompressed_bytes + info2.uncompressed_bytes) / (1024.0f * 1024.0f),
+                            info1.num_voxels + info2.num_voxels);
+        }
     }
 
     // --- Feature ---
@@ -461,6 +640,75 @@ void MotionApp::Display()
         ImGui::Combo("Feature (F)", &analyzer.feature_mode, feature_items, 5);
         const char* norm_items[] = {"CurrentFrame", "Accumulated"};
         ImGui::Combo("Norm (N)", &analyzer.norm_mode, norm_items, 2);
+
+        // ݐς̑ΏێԔ͈́i^CC Shift + hbOőIj
+        if (analyzer.HasAccumulationTimeRange() && motion) {
+            float t0 = analyzer.GetAccumulationRangeBegin();
+            float t1 = analyzer.GetAccumulationRangeEnd();
+            ImGui::Text("Range: %.2f - %.2f s (%d - %d)", t0, t1,
+                        GetFrameIndexFromTime(motion, t0), GetFrameIndexFromTime(motion, t1));
+            ImGui::SameLine();
+            if (ImGui::Button("Clear Range")) {
+                WaitVoxelUpdate();
+                analyzer.ClearAccumulationTimeRange();
+            }
+            ImGui::Text("Range index: %.1f MB", analyzer.AcquireDisplaySnapshot()->range_index_bytes / (1024.0f * 1024.0f));
+        } else {
+            ImGui::Text("Range: all frames (Shift+drag on timeline)");
+        }
+
+        // Wc̓vfivZ̕\QƂ郂f͕ύXAVfɒuj
+        ImGui::Separator();
+        ImGui::Checkbox("Z-score vs Group", &analyzer.show_group_zscore);
+        ImGui::InputText("Group File", group_model_path, sizeof(group_model_path));
+        if (ImGui::Button("Add M2 to Group") && motion2)
+            AddMotionToGroupModel(motion2, 1);
+        ImGui::SameLine();
+        if (ImGui::Button("Load Group")) {
+            std::shared_ptr<VoxelGroupModel> model = std::make_shared<VoxelGroupModel>();
+            if (model->LoadFromFile(group_model_path)) {
+                analyzer.group_model = model;
+                group_model_status = "Loaded";
+            } else {
+                group_model_status = "Load failed";
+            }
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Save Group") && analyzer.group_model)
+            group_model_status = analyzer.group_model->SaveToFile(group_model_path) ? "Saved" : "Save failed";
+        ImGui::SameLine();
+        if (ImGui::Button("Clear Group")) {
+            analyzer.group_model.reset();
+            group_model_status.clear();
+        }
+        if (analyzer.group_model) {
+            const VoxelGroupModel& group = *analyzer.group_model;
+            ImGui::Text("Group: %s, %d takes, %.1f MB %s", GetSpatialFeatureName(group.GetFeature()), group.GetNumTakes(),
+                        group.GetMemoryBytes() / (1024.0f * 1024.0f),
+                        group.IsCompatible(analyzer.grid_resolution, analyzer.world_bounds) ? "" : "(grid mismatch)");
+        }
+        if (!group_model_status.empty())
+            ImGui::Text("%s", group_model_status.c_str());
+
+        // t[̑Ήtit[LbV̓ʂ̗v񂩂 DTW ŌvZAł͂ȂΉt[ǂrj
+        ImGui::Separator();
+        if (ImGui::Button("DTW Align")) {
+            WaitVoxelUpdate();
+            alignment_status = analyzer.ComputeFrameCacheAlignment() ? "Aligned" : "Align failed (no frame cache)";
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Clear Align")) {
+            WaitVoxelUpdate();
+            analyzer.ClearFrameAlignment();
+            alignment_status.clear();
+        }
+        if (analyzer.HasFrameAlignment() && motion && motion2) {
+            int f1, f2;
+            analyzer.GetFramePairAtTime(motion, motion2, animation_time, f1, f2);
+            ImGui::Text("Alignment: %d steps, M1 frame %d - M2 frame %d", analyzer.GetFrameAlignment().GetNumSteps(), f1, f2);
+        } else if (!alignment_status.empty()) {
+            ImGui::Text("%s", alignment_status.c_str());
+        }
     }
 
     // --- Model Transform ---
@@ -487,6 +735,7 @@ void MotionApp::Display()
         apply_finalize = apply_finalize || ImGui::IsItemDeactivatedAfterEdit();
 
         if (ImGui::Button("Reset Transform")) {
+            WaitVoxelUpdate();
             RestoreInitialRootCache();
             apply_preview = false;
             apply_finalize = false;
@@ -615,7 +864,47 @@ void MotionApp::Display()
         }
     }
 
+    // --- Similar Poses ---
+    if (ImGui::CollapsingHeader("Similar Poses")) {
+        ImGui::Text("Index: %d takes, %d frames", pose_index.GetNumClips(), pose_index.GetNumNodes());
+        ImGui::SliderFloat("Epsilon [m]", &similar_pose_epsilon, 0.005f, 0.3f);
+        if (ImGui::Button("Search Current Frame (Motion1)"))
+            SearchSimilarPoses();
+        for (size_t i = 0; i < similar_poses.size(); ++i) {
+            const PoseIndexResult& r = similar_poses[i];
+            ImGui::Text("%s  frame %d  (%.3f s)  dist %.4f", pose_index.GetClip(r.clip).name.c_str(), r.frame,
+                r.frame * pose_index.GetClip(r.clip).interval, r.distance);
+        }
+    }
+
     ImGui::End();
+
+    // Ԃ̌v
+    DrawTraceOverlay(&show_trace_overlay);
+}
+
+// ǂݍ񂾓pގ̃CfbNXɒǉAVɒǉꂽꍇ̓t@Cɕۑ
+void MotionApp::AddMotionToPoseIndex(const Motion* m)
+{
+    if (!m)
+        return;
+    int num_clips = pose_index.GetNumClips();
+    if (pose_index.AddMotion(*m) < 0) {
+        cerr << "Pose index: skeleton of " << m->name << " does not match the indexed takes." << endl;
+        return;
+    }
+    if (pose_index.GetNumClips() != num_clips)
+        pose_index.SaveToFile(kPoseIndexFileName);
+}
+
+// Motion1̌݃t[̎pɋ߂t[ACfbNXɓo^ꂽS삩猟
+void MotionApp::SearchSimilarPoses()
+{
+    similar_poses.clear();
+    if (!motion)
+        return;
+    const int max_results = 50;
+    pose_index.SearchFrame(*motion, GetFrameIndexFromTime(motion, animation_time), max_results, similar_pose_epsilon, similar_poses);
 }
 
 // ŏBVHt@Cǂݍ݁AMotion1ƂĐݒ
@@ -623,6 +912,12 @@ void MotionApp::LoadBVH(const char* file_name) {
     Motion* new_motion = LoadAndCoustructBVHMotion(file_name);
     if (!new_motion) 
         return;
+    // [J[Xbh̃{NZ̍XVExt[LbVQƂĂ邽߁AɏI҂
+    WaitVoxelUpdate();
+    CancelAnalysisJob(true);
+    analyzer.ResetLazyFrameCaches();
+    analyzer.ClearFrameAlignment();
+    alignment_status.clear();
     if (motion) { 
         if (motion->body) 
             delete motion->body; 
@@ -633,6 +928,7 @@ void MotionApp::LoadBVH(const char* file_name) {
     motion = new_motion;
     curr_posture = new Posture(motion->body);
     has_initial_root_cache = false;
+    AddMotionToPoseIndex(motion);
 
     move1_x = 0.0f;
     move1_z = 0.0f;
@@ -652,6 +948,12 @@ void MotionApp::LoadBVH2(const char* file_name)
     Motion* m2 = LoadAndCoustructBVHMotion(file_name);
     if (!m2) 
         return;
+    // [J[Xbh̃{NZ̍XVExt[LbVQƂĂ邽߁AɏI҂
+    WaitVoxelUpdate();
+    CancelAnalysisJob(true);
+    analyzer.ResetLazyFrameCaches();
+    analyzer.ClearFrameAlignment();
+    alignment_status.clear();
     if (motion2) 
         delete motion2; 
     if (curr_posture2) 
@@ -659,6 +961,7 @@ void MotionApp::LoadBVH2(const char* file_name)
     motion2 = m2;
     curr_posture2 = new Posture(motion2->body); 
     has_initial_root_cache = false;
+    AddMotionToPoseIndex(motion2);
 
     move2_x = 0.0f;
     move2_z = 0.0f;
@@ -708,14 +1011,8 @@ void MotionApp::AlignInitialPositions() {
     if (!motion || !motion2 || motion->num_frames == 0 || motion2->num_frames == 0)
         return;
     
-    // XZʂ݂̂_ɑiYW͈ێj
-    Point3f offset1(motion->frames[0].root_pos.x, 0.0f, motion->frames[0].root_pos.z);
-    Point3f offset2(motion2->frames[0].root_pos.x, 0.0f, motion2->frames[0].root_pos.z);
-
-    for (int i = 0; i < motion->num_frames; i++)
-        motion->frames[i].root_pos -= offset1; 
-    for (int i = 0; i < motion2->num_frames; i++)
-        motion2->frames[i].root_pos -= offset2; 
+    AlignMotionInitialPosition(motion);
+    AlignMotionInitialPosition(motion2);
 
     printf("Initial positions aligned.\n");
 }
@@ -725,21 +1022,8 @@ void MotionApp::AlignInitialOrientations() {
     if (!motion || !motion2 || motion->num_frames == 0 || motion2->num_frames == 0)
         return;
     
-    Matrix3f ori1 = motion->frames[0].root_ori;
-    float angle1 = -atan2(ori1.m02, ori1.m22);
-    Matrix3f rot1; rot1.rotY(angle1);
-    for (int i = 0; i < motion->num_frames; i++) {
-        rot1.transform(&motion->frames[i].root_pos);
-        motion->frames[i].root_ori.mul(rot1, motion->frames[i].root_ori);
-    }
-    
-    Matrix3f ori2 = motion2->frames[0].root_ori;
-    float angle2 = -atan2(ori2.m02, ori2.m22);
-    Matrix3f rot2; rot2.rotY(angle2);
-    for (int i = 0; i < motion2->num_frames; i++) {
-        rot2.transform(&motion2->frames[i].root_pos);
-        motion2->frames[i].root_ori.mul(rot2, motion2->frames[i].root_ori);
-    }
+    AlignMotionInitialOrientation(motion);
+    AlignMotionInitialOrientation(motion2);
     
     printf("Initial orientations aligned to face +Z axis.\n");
 }
@@ -749,32 +1033,8 @@ void MotionApp::CalculateWorldBounds() {
     if (!motion || !motion2)
         return;
 
-    float min_x = 1e6f, min_y = 1e6f, min_z = 1e6f;
-    float max_x = -1e6f, max_y = -1e6f, max_z = -1e6f;
-
-    auto update_root_minmax = [&](const Motion* m) {
-        for (int f = 0; f < m->num_frames; ++f) {
-            const Point3f& p = m->frames[f].root_pos;
-            if (p.x < min_x) min_x = p.x;
-            if (p.x > max_x) max_x = p.x;
-            if (p.y < min_y) min_y = p.y;
-            if (p.y > max_y) max_y = p.y;
-            if (p.z < min_z) min_z = p.z;
-            if (p.z > max_z) max_z = p.z;
-        }
-    };
-
-    update_root_minmax(motion);
-    update_root_minmax(motion2);
-
-    const float margin_radius = 1.0f; // eɑ΂1m}[W
     float bounds[3][2];
-    bounds[0][0] = min_x - margin_radius;
-    bounds[0][1] = max_x + margin_radius;
-    bounds[1][0] = min_y - margin_radius;
-    bounds[1][1] = max_y + margin_radius;
-    bounds[2][0] = min_z - margin_radius;
-    bounds[2][1] = max_z + margin_radius;
+    ComputeMotionPairWorldBounds(motion, motion2, kWorldBoundsMargin, bounds);
 
     analyzer.SetWorldBounds(bounds);
     printf("World bounds set from all-frame root min/max + 1m margin.\n");
@@ -829,32 +1089,38 @@ void MotionApp::RestoreInitialRootCache() {
     motion->GetPosture(animation_time, *curr_posture);
     motion2->GetPosture(animation_time, *curr_posture2);
 
-    CalculateWorldBounds();
-    analyzer.BuildAllFeatureFrameCaches(motion, motion2);
+    StartAnalysisJob(false);
     // Display()Ŗt[XV邽߁Ał͓dXVȂ
 }
 
 void MotionApp::PrepareAllData() {
     if (!motion || !motion2)
         return;
+    TRACE_SCOPE_CAT("MotionApp::PrepareAllData", "analysis");
     AlignInitialPositions();
     AlignInitialOrientations();
     CalculateWorldBounds();
 
+    // ȑO̓̃t[LbVjiVLbV̓[J[Xbhō\zj
+    analyzer.BuildAllFeatureFrameCaches(nullptr, nullptr);
+
     bool cache_loaded = analyzer.LoadVoxelCache(motion->name.c_str(), motion2->name.c_str());
 
     if (!cache_loaded) {
-        std::cout << "Cache not found. Calculating accumulated voxels (integrated)..." << std::endl;
-        analyzer.AccumulateAllFrames(motion, motion2);
-        std::cout << "Saving voxel cache..." << std::endl;
-        analyzer.SaveVoxelCache(motion->name.c_str(), motion2->name.c_str());
+        std::cout << "Cache not found. Calculating accumulated voxels in background..." << std::endl;
+        analyzer.ClearAccumulatedData();
+        StartAnalysisJob(true, true);
+    } else if (analyzer.HasFrameCache()) {
+        // t[LbṼt@C}bvłꍇ͍č\zȂiet[͎QƎɓǂݏoj
+        std::cout << "Voxel cache and frame cache files loaded successfully." << std::endl;
+        CancelAnalysisJob(false);
+        analyzer.AdoptAnalysisMotions(motion, motion2);
+        analysis_pending = false;
     } else {
-        std::cout << "Voxel cache loaded successfully. Skipping calculation." << std::endl;
+        std::cout << "Voxel cache loaded successfully. Building feature frame caches in background..." << std::endl;
+        StartAnalysisJob(false, true);
     }
 
-    std::cout << "Building feature frame caches..." << std::endl;
-    analyzer.BuildAllFeatureFrameCaches(motion, motion2);
-
     CaptureInitialRootCache();
 
     // Display()Ŗt[XV邽߁Ał͓dXVȂ
@@ -863,6 +1129,7 @@ void MotionApp::PrepareAllData() {
 void MotionApp::ApplyXZMoveFromUI(bool finalize_update) {
     if (!motion || !motion2)
         return;
+    WaitVoxelUpdate();
 
     float d1x = move1_x - prev_move1_x;
     float d1z = move1_z - prev_move1_z;
@@ -914,6 +1181,10 @@ void MotionApp::ApplyXZMoveFromUI(bool finalize_update) {
     }
 
     if (has_delta) {
+        // vZ̉͌ʂ͌ÂȂ邽ߒfi̊ɍČvZj
+        CancelAnalysisJob(false);
+        analysis_pending = true;
+
         prev_move1_x = move1_x;
         prev_move1_z = move1_z;
         prev_move2_x = move2_x;
@@ -926,23 +1197,157 @@ void MotionApp::ApplyXZMoveFromUI(bool finalize_update) {
     motion2->GetPosture(animation_time, *curr_posture2);
 
     if (finalize_update) {
-        // ړE]̊̂ݏdČvZs
-        CalculateWorldBounds();
-        analyzer.BuildAllFeatureFrameCaches(motion, motion2);
+        // ړE]̊̂ݏdČvZ[J[Xbhōs
+        StartAnalysisJob(false);
     }
 
     UpdateVoxelDataWrapper();
 }
 
+// ĐύXApXV
+void MotionApp::SeekAnimation(float time)
+{
+    if (!motion || !motion2)
+        return;
+    float max_duration = max(motion->GetDuration(), motion2->GetDuration());
+    animation_time = max(0.0f, min(time, max_duration));
+    motion->GetPosture(animation_time, *curr_posture);
+    motion2->GetPosture(animation_time, *curr_posture2);
+}
+
+// ^CCi1E2̒Aݐς̑ΏێԔ͈́A݂̍Đj`
+void MotionApp::DrawAnalysisTimeline()
+{
+    if (!timeline || !motion || !motion2)
+        return;
+
+    float max_duration = max(motion->GetDuration(), motion2->GetDuration());
+    timeline->SetTimeRange(0.0f, max_duration);
+    timeline->DeleteAllElements();
+    timeline->DeleteAllLines();
+    timeline->AddElement(0.0f, motion->GetDuration(), Color4f(1.0f, 0.6f, 0.6f, 1.0f), "Motion1", 0);
+    timeline->AddElement(0.0f, motion2->GetDuration(), Color4f(0.6f, 0.6f, 1.0f, 1.0f), "Motion2", 1);
+    if (analyzer.HasAccumulationTimeRange())
+        timeline->AddElement(analyzer.GetAccumulationRangeBegin(), analyzer.GetAccumulationRangeEnd(),
+                             Color4f(0.5f, 0.9f, 0.5f, 1.0f), "Range", 2);
+    timeline->AddLine(animation_time, Color4f(0.0f, 0.0f, 0.0f, 1.0f));
+    timeline->DrawTimeline();
+}
+
 // ݂̃Aj[VŃ{NZf[^XV
 void MotionApp::UpdateVoxelDataWrapper() {
     if (!motion || !motion2)
         return;
-    analyzer.UpdateVoxels(motion, motion2, animation_time);
 
-    // accumulated\́A݂̓ʂt[LbVč
-    if (analyzer.norm_mode == 1)
-        analyzer.ComposeAccumulatedFeatureFromFrameCache(motion, motion2, analyzer.feature_mode);
+    // \̐ݒ͓o^ɕAvZɕ\ŕύXĂeȂ悤ɂ
+    SpatialDisplayRequest request = analyzer.MakeDisplayRequest(motion, motion2, animation_time);
+    request.playback_direction = (animation_speed < 0.0f) ? -1 : 1;
+    // accumulated\́A݂̓ʂt[LbVči̓Wů҂̊Ԃ͕ۗj
+    request.compose_accumulated = (analyzer.norm_mode == 1 && !analysis_pending);
+
+    if (!async_voxel_update) {
+        WaitVoxelUpdate();
+        analyzer.ComputeDisplayUpdate(request);
+        return;
+    }
+
+    // O̍XVIĂȂΓo^A`͌Jς݂̌ʂgi`悪vZ̊҂Ȃj
+    if (voxel_update_handle && !voxel_update_handle->IsDone())
+        return;
+    SpatialAnalyzer* target = &analyzer;
+    voxel_update_handle = analysis_jobs.Submit([target, request](Job&) { target->ComputeDisplayUpdate(request); });
+}
+
+// [J[XbhŎs̃{NZ̍XV̏I҂
+void MotionApp::WaitVoxelUpdate() {
+    if (!voxel_update_handle)
+        return;
+    JobSystem::Wait(voxel_update_handle);
+    voxel_update_handle.reset();
+}
+
+// ̗ݐσObhWc̓vf1sƂĒǉ
+void MotionApp::AddMotionToGroupModel(Motion* m, int motion_no) {
+    // [J[Xbh̃{NZ̍XVƃt[LbV𓯎ɓǂ܂Ȃ悤AI҂Ă獇
+    WaitVoxelUpdate();
+    int feature = analyzer.feature_mode;
+    VoxelGrid take;
+    if (!analyzer.ComposeMotionAccumulatedGrid(m, motion_no, feature, take)) {
+        group_model_status = "Add failed (no frame cache)";
+        return;
+    }
+
+    // ʁEObhfȂ畡ɒǉAقȂꍇ͐Vf쐬
+    std::shared_ptr<VoxelGroupModel> model;
+    const VoxelGroupModel* current = analyzer.group_model.get();
+    if (current && current->GetFeature() == feature && current->IsCompatible(analyzer.grid_resolution, analyzer.world_bounds)) {
+        model = std::make_shared<VoxelGroupModel>(*current);
+    } else {
+        model = std::make_shared<VoxelGroupModel>();
+        model->Reset(feature, analyzer.grid_resolution, analyzer.world_bounds);
+    }
+    model->AddTake(take);
+    analyzer.group_model = model;
+    group_model_status = "Added";
+}
+
+// ̓Wuo^is̃Wu͒fA݂̓̃Rs[vZj
+void MotionApp::StartAnalysisJob(bool accumulate_all, bool save_cache) {
+    if (!motion || !motion2)
+        return;
+    WaitVoxelUpdate();
+    CancelAnalysisJob(false);
+
+    SpatialAnalysisJobParams params;
+    params.grid_resolution = analyzer.grid_resolution;
+    ComputeMotionPairWorldBounds(motion, motion2, kWorldBoundsMargin, params.world_bounds);
+    params.accumulate_all = accumulate_all;
+    if (save_cache) {
+        params.cache_motion1_name = motion->name;
+        params.cache_motion2_name = motion2->name;
+    }
+    params.preview_feature = (accumulate_all || analyzer.norm_mode == 1) ? analyzer.feature_mode : -1;
+    params.publish_interval = kAnalysisPublishInterval;
+    params.grid_space = analyzer.GetVoxelGridSpace();
+
+    std::shared_ptr<SpatialAnalysisJob> job = std::make_shared<SpatialAnalysisJob>(motion, motion2, params);
+    analysis_job = job;
+    analysis_job_handle = analysis_jobs.Submit([job](Job& j) { job->Run(j); });
+    analysis_pending = true;
+}
+
+// s̉̓Wu𒆒fiwait  true ȂI҂j
+void MotionApp::CancelAnalysisJob(bool wait) {
+    if (analysis_job_handle) {
+        analysis_job_handle->Cancel();
+        if (wait)
+            JobSystem::Wait(analysis_job_handle);
+    }
+    analysis_job.reset();
+    analysis_job_handle.reset();
+}
+
+// ̓Wu̓ro߂\ɔfAĂΌʂ荞
+void MotionApp::PollAnalysisJob() {
+    if (!analysis_job || !analysis_job_handle)
+        return;
+
+    // ro߁Eʂ̎荞݂͉͌ʂ邽߁A{NZ̍XṼ͎t[ɉ
+    if (voxel_update_handle && !voxel_update_handle->IsDone())
+        return;
+    WaitVoxelUpdate();
+
+    analysis_job->TakePreview(analyzer);
+    if (!analysis_job_handle->IsDone())
+        return;
+
+    if (analysis_job->IsCompleted()) {
+        analyzer.AdoptAnalysisResults(*analysis_job, motion, motion2);
+        analysis_pending = false;
+    }
+    analysis_job.reset();
+    analysis_job_handle.reset();
+    RequestRedisplay();
 }
 
 // wWɃeLXg`
@@ -1134,6 +1539,10 @@ void MotionApp::ApplyModelGizmoDelta(const Point3f& translation, const Matrix4f&
     *rot_y_deg += angle * 180.0f / kPi;
     *prev_rot_y_deg = *rot_y_deg;
 
+    // vZ̉͌ʂ͌ÂȂ邽ߒfi}EXɍČvZj
+    CancelAnalysisJob(false);
+    analysis_pending = true;
+
     if (curr_posture && motion)
         motion->GetPosture(animation_time, *curr_posture);
     if (curr_posture2 && motion2)
@@ -1146,8 +1555,7 @@ void MotionApp::FinalizeModelTransform()
 {
     if (!motion || !motion2)
         return;
-    CalculateWorldBounds();
-    analyzer.BuildAllFeatureFrameCaches(motion, motion2);
+    StartAnalysisJob(false);
     UpdateVoxelDataWrapper();
 }
 
@@ -7,7 +7,12 @@
 #include "SimpleHumanGLUT.h"
 #include "SpatialAnalysis.h"
 #include "TransformGizmo.h"
+#include "PoseIndex.h"
+#include "JobSystem.h"
+#include "SpatialAnalysisJob.h"
+#include "Timeline.h"
 #include <vector>
+#include <memory>
 
 class  MotionApp : public GLUTBaseApp
 {
@@ -56,18 +61,52 @@ protected:
     std::vector<Matrix3f> initial_root_ori1;
     std::vector<Matrix3f> initial_root_ori2;
 
+    // pގiǂݍ񂾑S̑St[̃CfbNXƁA߂̌ʁj
+    PoseIndex pose_index;
+    std::vector<PoseIndexResult> similar_poses;
+    float similar_pose_epsilon;
+
+    // Ԃ̌vʁiԂƂ̃t[ԁj̕\
+    bool show_trace_overlay;
+
+    // ͏it[LbVEݐσ{NZ̍\zj̔񓯊s
+    JobSystem analysis_jobs;
+    std::shared_ptr<SpatialAnalysisJob> analysis_job; // s̉̓WuiȂ΋j
+    JobHandle analysis_job_handle;
+    bool analysis_pending; // \̉͌ʂ̈ړE]ɒǂĂȂiݐς̍čۗj
+    int lazy_cache_limit_mb; // t[LbV̍\z܂ł̏uԕ\Ɏgxt[LbV̏i삲Ɓj
+    bool async_voxel_update;  // \{NZ̍XV[J[XbhōsA`͌Jς݂̍ŐV̌ʂg
+    JobHandle voxel_update_handle; // s̃{NZ̍XViȂ΋j
+
+    // Wc̓vfiݐϕ\ō̑ M1 ̏Wcɑ΂ z l\j̃t@CƑ쌋ʂ̕\
+    char group_model_path[256];
+    std::string group_model_status;
+
+    // t[̑Ήt̑쌋ʂ̕\
+    std::string alignment_status;
+
+    // ^CCiNbNEhbOōĐύXAShift + hbOŗݐς̑ΏێԔ͈͂Ij
+    Timeline* timeline;
+    bool show_timeline;
+    bool timeline_seeking;     // ĐύX
+    bool timeline_selecting;   // ݐς̑ΏێԔ͈͂I
+    float timeline_select_start;
+
 public:
     MotionApp();
     virtual ~MotionApp();
     virtual void Initialize() override;
     virtual void Start() override;
     virtual void Display() override;
+    virtual void Reshape(int w, int h) override;
     virtual void Keyboard(unsigned char key, int mx, int my) override;
     void Special(int key, int mx, int my);
     virtual void MouseClick(int button, int state, int mx, int my) override;
     virtual void MouseDrag(int mx, int my) override;
     virtual void MouseMotion(int mx, int my) override;
     virtual void Animation(float delta) override;
+    virtual void InterpolateAnimation(float alpha, float delta) override;
+    virtual bool IsAnimating() override;
 
     // SpaceMouse͏iXCXʂɓKpj
     virtual void ProcessSpaceMouseInput() override;
@@ -83,6 +122,26 @@ protected:
     void RestoreInitialRootCache();
     void PrepareAllData();
     void ApplyXZMoveFromUI(bool finalize_update);
+
+    // ͏̔񓯊sio^EfE̊mFƌʂ̎荞݁j
+    // save_cache  true ȂLbṼt@Cɕۑiaccumulate_all  false Ȃt[LbV̂݁j
+    void StartAnalysisJob(bool accumulate_all, bool save_cache = false);
+    void CancelAnalysisJob(bool wait);
+    void PollAnalysisJob();
+
+    // [J[XbhŎs̃{NZ̍XV̏I҂iE͌ʂύX鑀̑OɌĂԁj
+    void WaitVoxelUpdate();
+
+    // ݂̌̓ʂ̑St[̗ݐσObhWc̓vf1sƂĒǉimotion_no  0 ܂ 1j
+    void AddMotionToGroupModel(Motion* m, int motion_no);
+
+    // ^CC̍XVE`ƁA}EXʒu̎ւ̍Đ̕ύX
+    void DrawAnalysisTimeline();
+    void SeekAnimation(float time);
+
+    // pގ
+    void AddMotionToPoseIndex(const Motion* m);
+    void SearchSimilarPoses();
     
     // bp[
     void UpdateVoxelDataWrapper();
@@ -0,0 +1,534 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  動作変形（動作ワーピング）
+**/
+
+
+// ライブラリ・クラス定義の読み込み
+#include "SimpleHuman.h"
+#include "InverseKinematicsCCD.h"
+#include "MotionDeformation.h"
+
+// 標準算術関数・定数の定義
+#define  _USE_MATH_DEFINES
+#include <math.h>
+
+// 標準ライブラリの読み込み
+#include <algorithm>
+#include <thread>
+
+
+
+//
+//  動作変形情報にもとづく動作変形処理
+//
+
+
+//
+//  動作変形（動作ワーピング）の情報の初期化
+//
+void  InitDeformationParameter( 
+	const Motion & motion, float key_time, float blend_in_duration, float blend_out_duration, 
+	MotionWarpingParam & param )
+{
+	param.key_time = key_time;
+	param.blend_in_duration = blend_in_duration;
+	param.blend_out_duration = blend_out_duration;
+	motion.GetPosture( param.key_time, param.org_pose );
+	param.key_pose = param.org_pose;
+}
+
+
+//
+//  動作変形（動作ワーピング）の情報の初期化
+//
+void  InitDeformationParameter( 
+	const Motion & motion, float key_time, float blend_in_duration, float blend_out_duration, 
+	int base_joint_no, int ee_joint_no, Point3f ee_joint_translation, 
+	MotionWarpingParam & param )
+{
+	InitDeformationParameter( motion, key_time, blend_in_duration, blend_out_duration, param );
+
+	// 順運動学計算
+	vector< Matrix4f >  seg_frame_array;
+	vector< Point3f >  joint_position_frame_array;
+	ForwardKinematics( param.key_pose, seg_frame_array, joint_position_frame_array );
+
+	// 指定関節の目標位置
+	Point3f  ee_pos;
+	ee_pos = joint_position_frame_array[ ee_joint_no ];
+	ee_pos.add( ee_joint_translation );
+
+	// キー姿勢の指定部位の位置を移動
+	ApplyInverseKinematicsCCD( param.key_pose, base_joint_no, ee_joint_no, ee_pos );
+}
+
+
+//
+//  動作変形（動作ワーピング）の適用後の動作を生成
+//
+Motion *  GenerateDeformedMotion( const MotionWarpingParam & deform, const Motion & motion )
+{
+	return  GenerateDeformedMotion( vector< MotionWarpingParam >( 1, deform ), motion );
+}
+
+
+//
+//  指定範囲のフレームを連続区間に分割して並列に処理（各区間の処理 func( begin, end ) をスレッドごとに呼び出し）
+// （num_threads が 0 以下の場合は、ハードウェアの並列数を使用）
+//
+template< class FUNC >
+static void  ParallelForFrames( int begin, int end, int num_threads, FUNC func )
+{
+	// １スレッドあたりの最小フレーム数
+	const int  min_frames_per_thread = 8;
+
+	if ( begin >= end )
+		return;
+
+	// スレッド数を決定
+	if ( num_threads <= 0 )
+		num_threads = (int) thread::hardware_concurrency();
+	if ( num_threads <= 0 )
+		num_threads = 1;
+	num_threads = min( num_threads, max( 1, ( end - begin ) / min_frames_per_thread ) );
+
+	// フレーム区間ごとにスレッドを生成して処理（最初の区間は呼び出し元のスレッドで処理）
+	vector< thread >  workers;
+	int  frames_per_thread = ( end - begin + num_threads - 1 ) / num_threads;
+	for ( int t = 1; t < num_threads; t++ )
+	{
+		int  b = begin + t * frames_per_thread;
+		int  e = min( b + frames_per_thread, end );
+		if ( b < e )
+			workers.push_back( thread( func, b, e ) );
+	}
+	func( begin, min( begin + frames_per_thread, end ) );
+	for ( int t = 0; t < (int)workers.size(); t++ )
+		workers[ t ].join();
+}
+
+
+//
+//  動作変形（動作ワーピング）の影響範囲のフレーム番号を取得（begin 以上 end 未満）
+//
+void  GetDeformationFrameRange( const MotionWarpingParam & deform, const Motion & motion, int & begin, int & end )
+{
+	begin = 0;
+	end = 0;
+	if ( ( motion.num_frames <= 0 ) || ( motion.interval <= 0.0f ) )
+		return;
+
+	// 変形範囲の開始・終了時刻を含むフレームを求める（境界の誤差を考慮して１フレームずつ広げる）
+	begin = (int) floor( ( deform.key_time - deform.blend_in_duration ) / motion.interval );
+	end = (int) ceil( ( deform.key_time + deform.blend_out_duration ) / motion.interval ) + 1;
+	begin = max( begin, 0 );
+	end = min( end, motion.num_frames );
+	if ( begin > end )
+		begin = end;
+}
+
+
+//
+//  動作変形（動作ワーピング）の適用後の動作を生成（複数の動作変形情報を重ねて適用）
+//  変形範囲内のフレームのみを並列に計算し、範囲外のフレームは入力動作の姿勢をコピーする
+//
+Motion *  GenerateDeformedMotion( const vector< MotionWarpingParam > & deforms, const Motion & motion )
+{
+	Motion *  deformed = NULL;
+
+	// 動作変形前の動作を生成
+	deformed = new Motion( motion );
+
+	// 各動作変形情報の影響範囲のフレームの姿勢を変形
+	//（複数の動作変形情報の範囲が重なる場合も、各フレームは全ての動作変形情報を重ねて１回だけ計算）
+	int  range_begin = motion.num_frames;
+	int  range_end = 0;
+	for ( int i = 0; i < (int)deforms.size(); i++ )
+	{
+		int  begin, end;
+		GetDeformationFrameRange( deforms[ i ], motion, begin, end );
+		if ( begin >= end )
+			continue;
+		range_begin = min( range_begin, begin );
+		range_end = max( range_end, end );
+	}
+	ParallelForFrames( range_begin, range_end, 0, [&]( int begin, int end )
+	{
+		Posture  temp_pose( motion.body );
+		for ( int i = begin; i < end; i++ )
+			ApplyMotionDeformation( motion.interval * i, deforms, motion.frames[ i ], deformed->frames[ i ], temp_pose );
+	} );
+
+	// 動作変形後の動作を返す
+	return  deformed;
+}
+
+
+//
+//  動作変形（動作ワーピング）の適用後の姿勢の計算
+// （変形適用の重み 0.0～1.0 を返す）
+//
+float  ApplyMotionDeformation( float time, const MotionWarpingParam & deform, const Posture & input_pose, Posture & output_pose )
+{
+	// 動作変形の範囲外であれば、入力姿勢を出力姿勢とする
+	if ( ( time < deform.key_time - deform.blend_in_duration ) || 
+	     ( time > deform.key_time + deform.blend_out_duration ) )
+	{
+		output_pose = input_pose;
+		return  0.0f;
+	}
+
+
+	// ※ レポート課題
+
+	// 姿勢変形（動作ワーピング）の重みを計算
+	float  ratio = 0.5f;
+//	ratio = ???;
+
+
+	// 姿勢変形（２つの姿勢の差分（dest - src）に重み ratio をかけたものを元の姿勢 org に加える ）
+	PostureWarping( input_pose, deform.org_pose, deform.key_pose, ratio, output_pose );
+
+	return  ratio;
+}
+
+
+//
+//  動作変形（動作ワーピング）の適用後の姿勢の計算（複数の動作変形情報を重ねて適用）
+// （変形適用の重みの最大値 0.0～1.0 を返す、temp_pose は計算用の作業領域）
+//
+float  ApplyMotionDeformation( float time, const vector< MotionWarpingParam > & deforms, const Posture & input_pose, Posture & output_pose, Posture & temp_pose )
+{
+	float  max_ratio = 0.0f;
+
+	// 入力姿勢から開始して、範囲内の動作変形を順番に適用
+	output_pose = input_pose;
+	for ( int i = 0; i < (int)deforms.size(); i++ )
+	{
+		const MotionWarpingParam &  deform = deforms[ i ];
+		if ( ( time < deform.key_time - deform.blend_in_duration ) || 
+		     ( time > deform.key_time + deform.blend_out_duration ) )
+			continue;
+
+		float  ratio = ApplyMotionDeformation( time, deform, output_pose, temp_pose );
+		output_pose = temp_pose;
+		if ( ratio > max_ratio )
+			max_ratio = ratio;
+	}
+	return  max_ratio;
+}
+
+
+//
+//  動作ワーピングの姿勢変形（２つの姿勢の差分（dest - src）に重み ratio をかけたものを元の姿勢 org に加える ）
+//
+void  PostureWarping( const Posture & org, const Posture & src, const Posture & dest, float ratio, Posture & p )
+{
+	// ３つの姿勢の骨格モデルが異なる場合は終了
+	if ( ( org.body != src.body ) || ( src.body != dest.body ) || ( dest.body != p.body ) )
+		return;
+
+	// 骨格モデルを取得
+	const Skeleton *  body = org.body;
+
+	// 計算用変数
+	Quat4f  q_identity( 0.0f, 0.0f, 0.0f, 1.0f );
+	Quat4f  q_org, q_src, q_dest, q_diff, q_warp, q;
+	Vector3f  v;
+
+	// 各関節の回転を計算（元の姿勢の回転に、変形前から変形後への回転の差分を重み ratio だけ加える）
+	for ( int i = 0; i < body->num_joints; i++ )
+	{
+		q_org.set( org.joint_rotations[ i ] );
+		q_src.set( src.joint_rotations[ i ] );
+		q_dest.set( dest.joint_rotations[ i ] );
+		q_src.inverse();
+		q_diff.mul( q_src, q_dest );
+		if ( q_diff.w < 0.0f )
+			q_diff.negate();
+		q_warp.interpolate( q_identity, q_diff, ratio );
+		q.mul( q_org, q_warp );
+		q.normalize();
+		p.joint_rotations[ i ].set( q );
+	}
+
+	// ルートの向きを計算（ワールド座標系での差分を加える）
+	q_org.set( org.root_ori );
+	q_src.set( src.root_ori );
+	q_dest.set( dest.root_ori );
+	q_src.inverse();
+	q_diff.mul( q_dest, q_src );
+	if ( q_diff.w < 0.0f )
+		q_diff.negate();
+	q_warp.interpolate( q_identity, q_diff, ratio );
+	q.mul( q_warp, q_org );
+	q.normalize();
+	p.root_ori.set( q );
+
+	// ルートの位置を計算
+	v.sub( dest.root_pos, src.root_pos );
+	v.scaleAdd( ratio, v, org.root_pos );
+	p.root_pos.set( v );
+}
+
+
+
+//
+//  動作変形（動作ワーピング）の計算クラス
+//
+
+
+//
+//  コンストラクタ
+//
+MotionDeformationEngine::MotionDeformationEngine()
+{
+	input_motion = NULL;
+	num_threads = 0;
+}
+
+
+//
+//  デストラクタ
+//
+MotionDeformationEngine::~MotionDeformationEngine()
+{
+	for ( int i = 0; i < (int)deformed_frames.size(); i++ )
+		if ( deformed_frames[ i ] )
+			delete  deformed_frames[ i ];
+}
+
+
+//
+//  入力動作の設定（全ての動作変形情報をクリア）
+//
+void  MotionDeformationEngine::Init( const Motion * motion )
+{
+	for ( int i = 0; i < (int)deformed_frames.size(); i++ )
+		if ( deformed_frames[ i ] )
+			delete  deformed_frames[ i ];
+
+	input_motion = motion;
+	deformations.clear();
+	deformed_frames.assign( motion ? motion->num_frames : 0, (Posture *) NULL );
+	dirty_ranges.clear();
+}
+
+
+//
+//  動作変形情報の追加
+//
+int  MotionDeformationEngine::AddDeformation( const MotionWarpingParam & deform )
+{
+	deformations.push_back( deform );
+	MarkDirty( deform );
+	return  (int) deformations.size() - 1;
+}
+
+
+//
+//  動作変形情報の更新（変更前と変更後の影響範囲のフレームを再計算対象とする）
+//
+void  MotionDeformationEngine::SetDeformation( int no, const MotionWarpingParam & deform )
+{
+	if ( ( no < 0 ) || ( no >= (int)deformations.size() ) )
+		return;
+	MarkDirty( deformations[ no ] );
+	deformations[ no ] = deform;
+	MarkDirty( deform );
+}
+
+
+//
+//  動作変形情報の削除
+//
+void  MotionDeformationEngine::RemoveDeformation( int no )
+{
+	if ( ( no < 0 ) || ( no >= (int)deformations.size() ) )
+		return;
+	MarkDirty( deformations[ no ] );
+	deformations.erase( deformations.begin() + no );
+}
+
+
+//
+//  全ての動作変形情報の削除
+//
+void  MotionDeformationEngine::ClearDeformations()
+{
+	for ( int i = 0; i < (int)deformations.size(); i++ )
+		MarkDirty( deformations[ i ] );
+	deformations.clear();
+}
+
+
+//
+//  動作変形情報の影響範囲のフレームを再計算対象に追加
+//
+void  MotionDeformationEngine::MarkDirty( const MotionWarpingParam & deform )
+{
+	if ( !input_motion )
+		return;
+
+	int  begin, end;
+	GetDeformationFrameRange( deform, *input_motion, begin, end );
+	if ( begin >= end )
+		return;
+
+	// 追加する範囲と重なる・隣接する範囲を統合して、開始フレームの昇順の位置に挿入
+	vector< pair< int, int > >::iterator  it = dirty_ranges.begin();
+	while ( ( it != dirty_ranges.end() ) && ( it->second < begin ) )
+		++it;
+	vector< pair< int, int > >::iterator  last = it;
+	while ( ( last != dirty_ranges.end() ) && ( last->first <= end ) )
+	{
+		begin = min( begin, last->first );
+		end = max( end, last->second );
+		++last;
+	}
+	it = dirty_ranges.erase( it, last );
+	dirty_ranges.insert( it, make_pair( begin, end ) );
+}
+
+
+//
+//  再計算が必要なフレームの姿勢を計算（範囲ごとに並列計算）
+//
+void  MotionDeformationEngine::Update()
+{
+	if ( !input_motion )
+		return;
+
+	for ( int r = 0; r < (int)dirty_ranges.size(); r++ )
+	{
+		ParallelForFrames( dirty_ranges[ r ].first, dirty_ranges[ r ].second, num_threads, [this]( int begin, int end )
+		{
+			Posture  temp_pose( input_motion->body );
+			EvaluateFrames( begin, end, temp_pose );
+		} );
+	}
+	dirty_ranges.clear();
+}
+
+
+//
+//  指定範囲のフレームの姿勢を計算
+//
+void  MotionDeformationEngine::EvaluateFrames( int begin, int end, Posture & temp_pose )
+{
+	for ( int i = begin; i < end; i++ )
+	{
+		float  time = input_motion->interval * i;
+
+		// このフレームを範囲に含む動作変形情報があるかを判定
+		bool  in_range = false;
+		for ( int j = 0; j < (int)deformations.size(); j++ )
+		{
+			if ( ( time >= deformations[ j ].key_time - deformations[ j ].blend_in_duration ) && 
+			     ( time <= deformations[ j ].key_time + deformations[ j ].blend_out_duration ) )
+			{
+				in_range = true;
+				break;
+			}
+		}
+
+		// 変形範囲外のフレームは、変形後の姿勢を削除して入力動作の姿勢を共有
+		if ( !in_range )
+		{
+			if ( deformed_frames[ i ] )
+			{
+				delete  deformed_frames[ i ];
+				deformed_frames[ i ] = NULL;
+			}
+			continue;
+		}
+
+		// 変形範囲内のフレームは、変形後の姿勢を計算
+		if ( !deformed_frames[ i ] )
+			deformed_frames[ i ] = new Posture( input_motion->body );
+		ApplyMotionDeformation( time, deformations, input_motion->frames[ i ], *deformed_frames[ i ], temp_pose );
+	}
+}
+
+
+//
+//  変形後の姿勢を取得
+//
+const Posture *  MotionDeformationEngine::GetFrame( int frame_no )
+{
+	if ( !input_motion || ( input_motion->num_frames <= 0 ) )
+		return  NULL;
+
+	Update();
+
+	if ( frame_no < 0 )
+		frame_no = 0;
+	if ( frame_no >= input_motion->num_frames )
+		frame_no = input_motion->num_frames - 1;
+
+	if ( deformed_frames[ frame_no ] )
+		return  deformed_frames[ frame_no ];
+	return  &input_motion->frames[ frame_no ];
+}
+
+
+//
+//  変形後の姿勢を取得（指定時刻の前後のフレームの変形後の姿勢を補間）
+//
+void  MotionDeformationEngine::GetPosture( float time, Posture & p )
+{
+	if ( !input_motion || ( input_motion->interval <= 0.0f ) || ( input_motion->num_frames <= 0 ) )
+		return;
+
+	// 前後のフレーム番号と補間の比率（範囲外の時刻は端のフレームの姿勢）
+	float  frame_time = time / input_motion->interval;
+	int  frame0 = (int) floor( frame_time );
+	float  ratio = frame_time - frame0;
+	if ( frame0 < 0 )
+	{
+		frame0 = 0;
+		ratio = 0.0f;
+	}
+	if ( frame0 >= input_motion->num_frames - 1 )
+	{
+		frame0 = input_motion->num_frames - 1;
+		ratio = 0.0f;
+	}
+
+	const Posture *  p0 = GetFrame( frame0 );
+	if ( !p0 )
+		return;
+	if ( ratio <= 0.0f )
+	{
+		p = *p0;
+		return;
+	}
+	const Posture *  p1 = GetFrame( frame0 + 1 );
+	PostureInterpolation( *p0, *p1, ratio, p );
+}
+
+
+//
+//  変形後の動作を生成
+//
+Motion *  MotionDeformationEngine::GenerateMotion()
+{
+	if ( !input_motion )
+		return  NULL;
+
+	Update();
+
+	// 変形後の姿勢が計算されているフレームのみ、入力動作の姿勢を置き換える
+	Motion *  deformed = new Motion( *input_motion );
+	deformed->name = input_motion->name;
+	for ( int i = 0; i < deformed->num_frames; i++ )
+		if ( deformed_frames[ i ] )
+			deformed->frames[ i ] = *deformed_frames[ i ];
+	return  deformed;
+}
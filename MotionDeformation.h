@@ -0,0 +1,143 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  動作変形（動作ワーピング）
+**/
+
+#ifndef  _MOTION_DEFORMATION_H_
+#define  _MOTION_DEFORMATION_H_
+
+
+// ライブラリ・クラス定義の読み込み
+#include "SimpleHuman.h"
+
+
+
+//
+//  動作変形（動作ワーピング）の情報（動作中の１つのキー時刻の姿勢を変形）
+//
+struct  MotionWarpingParam
+{
+	// 姿勢変形を適用するキー時刻
+	float        key_time;
+
+	// 変形前のキー時刻の姿勢
+	Posture      org_pose;
+
+	// 変形後のキー時刻の姿勢
+	Posture      key_pose;
+
+	// 姿勢変形の前後のブレンド時間
+	float        blend_in_duration;
+	float        blend_out_duration;
+};
+
+
+//
+//  動作変形（動作ワーピング）の計算クラス
+//  複数の動作変形情報を重ねて適用した動作を、変形範囲内のフレームのみ計算して保持する
+// （変形範囲外のフレームは入力動作の姿勢をそのまま共有し、変形情報の更新時は影響範囲のフレームのみ再計算する）
+//
+class  MotionDeformationEngine
+{
+  protected:
+	// 動作変形を適用する入力動作
+	const Motion *  input_motion;
+
+	// 動作変形情報の配列（配列の順番に重ねて適用）
+	vector< MotionWarpingParam >  deformations;
+
+	// 変形後の姿勢 [フレーム番号]（変形範囲外のフレームは NULL とし、入力動作の姿勢を共有）
+	vector< Posture * >  deformed_frames;
+
+	// 再計算が必要なフレームの範囲（begin 以上 end 未満）の配列（開始フレームの昇順、互いに重ならない）
+	// （離れた位置の動作変形情報を更新した場合に、間のフレームを再計算しないように範囲ごとに保持する）
+	vector< pair< int, int > >  dirty_ranges;
+
+	// 並列計算に使用するスレッド数（0 以下の場合はハードウェアの並列数）
+	int  num_threads;
+
+  public:
+	// コンストラクタ
+	MotionDeformationEngine();
+
+	// デストラクタ
+	~MotionDeformationEngine();
+
+  public:
+	// 入力動作の設定（全ての動作変形情報をクリア）
+	void  Init( const Motion * motion );
+
+	// 動作変形情報の追加・更新・削除（影響範囲のフレームを再計算対象とする）
+	int  AddDeformation( const MotionWarpingParam & deform );
+	void  SetDeformation( int no, const MotionWarpingParam & deform );
+	void  RemoveDeformation( int no );
+	void  ClearDeformations();
+
+	// 再計算が必要なフレームの姿勢を計算（範囲ごとに並列計算）
+	void  Update();
+
+	// 並列計算に使用するスレッド数の設定
+	void  SetNumThreads( int n ) { num_threads = n; }
+
+  public:
+	// 情報取得
+	const Motion *  GetInputMotion() const { return  input_motion; }
+	int  GetNumDeformations() const { return  (int) deformations.size(); }
+	const MotionWarpingParam &  GetDeformation( int no ) const { return  deformations[ no ]; }
+	bool  IsFrameDeformed( int frame_no ) const { return  ( frame_no >= 0 ) && ( frame_no < (int)deformed_frames.size() ) && deformed_frames[ frame_no ]; }
+
+	// 変形後の姿勢を取得（再計算が必要なフレームがあれば先に計算）
+	const Posture *  GetFrame( int frame_no );
+	void  GetPosture( float time, Posture & p );
+
+	// 変形後の動作を生成
+	Motion *  GenerateMotion();
+
+  protected:
+	// 動作変形情報の影響範囲のフレームを再計算対象に追加
+	void  MarkDirty( const MotionWarpingParam & deform );
+
+	// 指定範囲のフレームの姿勢を計算
+	void  EvaluateFrames( int begin, int end, Posture & temp_pose );
+};
+
+
+//
+//  動作変形情報にもとづく動作変形処理
+//
+
+// 動作変形（動作ワーピング）の情報の初期化
+void  InitDeformationParameter( const Motion & motion, float key_time, float blend_in_duration, float blend_out_duration, 
+	MotionWarpingParam & deform );
+
+// 動作変形（動作ワーピング）の情報の初期化
+void  InitDeformationParameter( const Motion & motion, float key_time, float blend_in_duration, float blend_out_duration, 
+	int base_joint_no, int ee_joint_no, Point3f ee_joint_translation, 
+	MotionWarpingParam & deform );
+
+// 動作変形（動作ワーピング）の適用後の動作を生成
+Motion *  GenerateDeformedMotion( const MotionWarpingParam & deform, const Motion & motion );
+
+// 動作変形（動作ワーピング）の適用後の動作を生成（複数の動作変形情報を重ねて適用）
+Motion *  GenerateDeformedMotion( const vector< MotionWarpingParam > & deforms, const Motion & motion );
+
+// 動作変形（動作ワーピング）の適用後の姿勢の計算
+float  ApplyMotionDeformation( float time, const MotionWarpingParam & deform, const Posture & input_pose, Posture & output_pose );
+
+// 動作変形（動作ワーピング）の適用後の姿勢の計算（複数の動作変形情報を重ねて適用）
+float  ApplyMotionDeformation( float time, const vector< MotionWarpingParam > & deforms, const Posture & input_pose, Posture & output_pose, Posture & temp_pose );
+
+// 動作変形（動作ワーピング）の影響範囲のフレーム番号を取得（begin 以上 end 未満）
+void  GetDeformationFrameRange( const MotionWarpingParam & deform, const Motion & motion, int & begin, int & end );
+
+// 動作ワーピングの姿勢変形（２つの姿勢の差分（dest - src）に重み ratio をかけたものを元の姿勢 org に加える ）
+void  PostureWarping( const Posture & org, const Posture & src, const Posture & dest, float ratio, Posture & p );
+
+
+
+#endif // _MOTION_DEFORMATION_H_
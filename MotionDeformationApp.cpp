@@ -21,6 +21,7 @@
 
 
 
+
 //
 //  コンストラクタ
 //
@@ -40,6 +41,7 @@ MotionDeformationApp::MotionDeformationApp() : InverseKinematicsCCDApp()
 	draw_original_posture = false;
 	draw_postures_side_by_side = false;
 	timeline = NULL;
+	deformation_engine = NULL;
 }
 
 
@@ -60,6 +62,8 @@ MotionDeformationApp::~MotionDeformationApp()
 		delete  deformed_posture;
 	if ( timeline )
 		delete  timeline;
+	if ( deformation_engine )
+		delete  deformation_engine;
 }
 
 
@@ -322,8 +326,11 @@ void  MotionDeformationApp::Animation( float delta )
 	// 動作データから現在時刻の姿勢を取得
 	motion->GetPosture( animation_time, *org_posture );
 
-	// 動作変形（動作ワーピング）の適用後の姿勢の計算
-	ApplyMotionDeformation( animation_time, deformation, *org_posture, *deformed_posture );
+	// 動作変形（動作ワーピング）の適用後の姿勢を取得（変形情報が更新されていれば、影響範囲のフレームのみ再計算）
+	if ( deformation_engine && ( deformation_engine->GetInputMotion() == motion ) )
+		deformation_engine->GetPosture( animation_time, *deformed_posture );
+	else
+		ApplyMotionDeformation( animation_time, deformation, *org_posture, *deformed_posture );
 }
 
 
@@ -375,6 +382,15 @@ void  MotionDeformationApp::InitMotion( int no )
 	else if ( no == 1 )
 	{
 	}
+
+	// 動作変形の計算に入力動作・動作変形情報を設定
+	if ( motion )
+	{
+		if ( !deformation_engine )
+			deformation_engine = new MotionDeformationEngine();
+		deformation_engine->Init( motion );
+		deformation_engine->AddDeformation( deformation );
+	}
 }
 
 
@@ -417,6 +433,10 @@ void  MotionDeformationApp::LoadBVH( const char * file_name )
 	if ( !new_motion )
 		return;
 
+	// 動作変形の計算が削除する動作を参照しないよう、入力動作の設定を解除
+	if ( deformation_engine )
+		deformation_engine->Init( NULL );
+
 	// 骨格・動作・姿勢の削除
 	if ( motion && motion->body )
 		delete  motion->body;
@@ -446,7 +466,13 @@ void  MotionDeformationApp::LoadBVH( const char * file_name )
 void  MotionDeformationApp::SaveDeformedMotionAsBVH( const char * file_name )
 {
 	// 動作変形適用後の動作を生成
-	Motion *  deformed_motion = GenerateDeformedMotion( deformation, *motion );
+	Motion *  deformed_motion = NULL;
+	if ( deformation_engine && ( deformation_engine->GetInputMotion() == motion ) )
+		deformed_motion = deformation_engine->GenerateMotion();
+	else
+		deformed_motion = GenerateDeformedMotion( deformation, *motion );
+	if ( !deformed_motion )
+		return;
 
 	// 動作変形適用後の動作を保存
 	// ※省略（各自作成）
@@ -457,126 +483,3 @@ void  MotionDeformationApp::SaveDeformedMotionAsBVH( const char * file_name )
 }
 
 
-
-//
-//  動作変形情報にもとづく動作変形処理
-//
-
-
-//
-//  動作変形（動作ワーピング）の情報の初期化
-//
-void  InitDeformationParameter( 
-	const Motion & motion, float key_time, float blend_in_duration, float blend_out_duration, 
-	MotionWarpingParam & param )
-{
-	param.key_time = key_time;
-	param.blend_in_duration = blend_in_duration;
-	param.blend_out_duration = blend_out_duration;
-	motion.GetPosture( param.key_time, param.org_pose );
-	param.key_pose = param.org_pose;
-}
-
-
-//
-//  動作変形（動作ワーピング）の情報の初期化
-//
-void  InitDeformationParameter( 
-	const Motion & motion, float key_time, float blend_in_duration, float blend_out_duration, 
-	int base_joint_no, int ee_joint_no, Point3f ee_joint_translation, 
-	MotionWarpingParam & param )
-{
-	InitDeformationParameter( motion, key_time, blend_in_duration, blend_out_duration, param );
-
-	// 順運動学計算
-	vector< Matrix4f >  seg_frame_array;
-	vector< Point3f >  joint_position_frame_array;
-	ForwardKinematics( param.key_pose, seg_frame_array, joint_position_frame_array );
-
-	// 指定関節の目標位置
-	Point3f  ee_pos;
-	ee_pos = joint_position_frame_array[ ee_joint_no ];
-	ee_pos.add( ee_joint_translation );
-
-	// キー姿勢の指定部位の位置を移動
-	ApplyInverseKinematicsCCD( param.key_pose, base_joint_no, ee_joint_no, ee_pos );
-}
-
-
-//
-//  動作変形（動作ワーピング）の適用後の動作を生成
-//
-Motion *  GenerateDeformedMotion( const MotionWarpingParam & deform, const Motion & motion )
-{
-	Motion *  deformed = NULL;
-
-	// 動作変形前の動作を生成
-	deformed = new Motion( motion );
-
-	// 各フレームの姿勢を変形
-	for ( int i = 0; i < motion.num_frames; i++ )
-		ApplyMotionDeformation( motion.interval * i, deform, motion.frames[ i ], deformed->frames[ i ] );
-
-	// 動作変形後の動作を返す
-	return  deformed;
-}
-
-
-//
-//  動作変形（動作ワーピング）の適用後の姿勢の計算
-// （変形適用の重み 0.0～1.0 を返す）
-//
-float  ApplyMotionDeformation( float time, const MotionWarpingParam & deform, const Posture & input_pose, Posture & output_pose )
-{
-	// 動作変形の範囲外であれば、入力姿勢を出力姿勢とする
-	if ( ( time < deform.key_time - deform.blend_in_duration ) || 
-	     ( time > deform.key_time + deform.blend_out_duration ) )
-	{
-		output_pose = input_pose;
-		return  0.0f;
-	}
-
-
-	// ※ レポート課題
-
-	// 姿勢変形（動作ワーピング）の重みを計算
-	float  ratio = 0.5f;
-//	ratio = ???;
-
-
-	// 姿勢変形（２つの姿勢の差分（dest - src）に重み ratio をかけたものを元の姿勢 org に加える ）
-	PostureWarping( input_pose, deform.org_pose, deform.key_pose, ratio, output_pose );
-
-	return  ratio;
-}
-
-
-//
-//  動作ワーピングの姿勢変形（２つの姿勢の差分（dest - src）に重み ratio をかけたものを元の姿勢 org に加える ）
-//
-void  PostureWarping( const Posture & org, const Posture & src, const Posture & dest, float ratio, Posture & p )
-{
-	// ３つの姿勢の骨格モデルが異なる場合は終了
-	if ( ( org.body != src.body ) || ( src.body != dest.body ) || ( dest.body != p.body ) )
-		return;
-
-	// 骨格モデルを取得
-	const Skeleton *  body = org.body;
-
-
-	// ※ レポート課題
-
-	// 各関節の回転を計算
-	for ( int i = 0; i < body->num_joints; i++ )
-	{
-//		p.joint_rotations[ i ] = ???;
-	}
-
-	// ルートの向きを計算
-//	p.root_ori = ???;
-
-	// ルートの位置を計算
-//	p.root_pos = ???;
-}
-
-
@@ -16,6 +16,7 @@
 #include "SimpleHuman.h"
 #include "SimpleHumanGLUT.h"
 #include "InverseKinematicsCCDApp.h"
+#include "MotionDeformation.h"
 
 
 // プロトタイプ宣言
@@ -23,26 +24,6 @@ class  Timeline;
 
 
 
-//
-//  動作変形（動作ワーピング）の情報（動作中の１つのキー時刻の姿勢を変形）
-//
-struct  MotionWarpingParam
-{
-	// 姿勢変形を適用するキー時刻
-	float        key_time;
-
-	// 変形前のキー時刻の姿勢
-	Posture      org_pose;
-
-	// 変形後のキー時刻の姿勢
-	Posture      key_pose;
-
-	// 姿勢変形の前後のブレンド時間
-	float        blend_in_duration;
-	float        blend_out_duration;
-};
-
-
 //
 //  動作変形アプリケーションクラス
 //
@@ -57,6 +38,9 @@ class  MotionDeformationApp : public InverseKinematicsCCDApp
 	// 動作変形情報
 	MotionWarpingParam deformation;
 
+	// 動作変形の計算（変形後の動作の保持）
+	MotionDeformationEngine *  deformation_engine;
+
   protected:
 	// 動作再生のための変数
 
@@ -141,28 +125,5 @@ class  MotionDeformationApp : public InverseKinematicsCCDApp
 };
 
 
-//
-//  動作変形情報にもとづく動作変形処理
-//
-
-// 動作変形（動作ワーピング）の情報の初期化
-void  InitDeformationParameter( const Motion & motion, float key_time, float blend_in_duration, float blend_out_duration, 
-	MotionWarpingParam & deform );
-
-// 動作変形（動作ワーピング）の情報の初期化
-void  InitDeformationParameter( const Motion & motion, float key_time, float blend_in_duration, float blend_out_duration, 
-	int base_joint_no, int ee_joint_no, Point3f ee_joint_translation, 
-	MotionWarpingParam & deform );
-
-// 動作変形（動作ワーピング）の適用後の動作を生成
-Motion *  GenerateDeformedMotion( const MotionWarpingParam & deform, const Motion & motion );
-
-// 動作変形（動作ワーピング）の適用後の姿勢の計算
-float  ApplyMotionDeformation( float time, const MotionWarpingParam & deform, const Posture & input_pose, Posture & output_pose );
-
-// 動作ワーピングの姿勢変形（２つの姿勢の差分（dest - src）に重み ratio をかけたものを元の姿勢 org に加える ）
-void  PostureWarping( const Posture & org, const Posture & src, const Posture & dest, float ratio, Posture & p );
-
-
 
 #endif // _MOTION_DEFORMATION_APP_H_
@@ -230,6 +230,10 @@ void  MotionDeformationEditApp::MouseClick( int button, int state, int mx, int m
 
 		// 動作変形の時間範囲をタイムラインに設定
 		timeline->SetElementTime( 1, deformation.key_time - deformation.blend_in_duration, deformation.key_time + deformation.blend_out_duration );
+
+		// 変更前後の時間範囲のフレームのみを再計算対象とする
+		if ( deformation_engine )
+			deformation_engine->SetDeformation( 0, deformation );
 	}
 }
 
@@ -246,6 +250,10 @@ void  MotionDeformationEditApp::MouseDrag( int mx, int my )
 
 		// 逆運動学計算により変形された姿勢を、動作変形のキー姿勢として設定
 		deformation.key_pose = *curr_posture;
+
+		// 動作変形の範囲内のフレームのみを再計算対象とする（再計算は次に変形後の姿勢を取得する時に行う）
+		if ( deformation_engine )
+			deformation_engine->SetDeformation( 0, deformation );
 	}
 	else
 		GLUTBaseApp::MouseDrag( mx, my );
@@ -411,6 +419,8 @@ void  MotionDeformationEditApp::StartKeyposeEditMode()
 void  MotionDeformationEditApp::ResetKeypose()
 {
 	motion->GetPosture( deformation.key_time, deformation.key_pose );
+	if ( deformation_engine )
+		deformation_engine->SetDeformation( 0, deformation );
 }
 
 
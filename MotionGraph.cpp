@@ -0,0 +1,539 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  モーショングラフ（動作データ間の遷移候補の事前計算）
+**/
+
+
+// ライブラリ・クラス定義の読み込み
+#include "SimpleHuman.h"
+#include "MotionGraph.h"
+
+// 標準算術関数・定数の定義
+#define  _USE_MATH_DEFINES
+#include <math.h>
+
+// 標準ライブラリの読み込み
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+// SIMD命令（SSE）の使用
+#if defined( _M_X64 ) || defined( __SSE2__ )
+#include <emmintrin.h>
+#define  MOTION_GRAPH_USE_SSE
+#endif
+
+
+// モーショングラフのファイルの識別子・バージョン
+static const char  motion_graph_file_magic[ 4 ] = { 'M', 'G', 'R', 'P' };
+static const int   motion_graph_file_version = 1;
+
+
+
+//
+//  モーショングラフの構築パラメタを初期化
+//
+void  InitMotionGraphParam( MotionGraphParam & param )
+{
+	param.window_half_frames = 5;
+	param.distance_threshold = 0.05f;
+	param.blend_duration = 0.3f;
+	param.min_self_frame_gap = 30;
+	param.tile_frames = 64;
+	param.num_threads = 0;
+}
+
+
+//
+//  姿勢比較のための特徴ベクトルを計算
+//  中心フレームの腰の水平位置・水平向きを基準とする座標系で、前後のフレームの全関節点の位置を並べる
+// （ComputeConnectionTransformation() と同様に、２つの姿勢の腰の水平位置・水平向きを合わせてから比較することに相当）
+//
+void  ComputeMotionGraphFeature( const Motion & motion, const vector< vector< Point3f > > & joint_positions, int frame_no, int window_half_frames, float * feature )
+{
+	const Posture &  center = motion.frames[ frame_no ];
+
+	// 中心フレームの腰の水平向きを打ち消す回転と、水平位置
+	Matrix3f  inv_ori;
+	ComputeOrientationMatrix( - ComputeOrientationAngle( center.root_ori ), inv_ori );
+	Vector3f  origin( center.root_pos.x, 0.0f, center.root_pos.z );
+
+	// 前後のフレームの全関節点の位置を、中心フレームの座標系に変換して出力
+	int  count = 0;
+	for ( int k = -window_half_frames; k <= window_half_frames; k++ )
+	{
+		int  f = min( max( frame_no + k, 0 ), motion.num_frames - 1 );
+		const vector< Point3f > &  positions = joint_positions[ f ];
+		for ( int j = 0; j < (int)positions.size(); j++ )
+		{
+			Vector3f  pos( positions[ j ] );
+			pos.sub( origin );
+			inv_ori.transform( &pos );
+			feature[ count++ ] = pos.x;
+			feature[ count++ ] = pos.y;
+			feature[ count++ ] = pos.z;
+		}
+	}
+}
+
+
+//
+//  ２つの特徴ベクトルの距離の２乗を計算（次元数は４の倍数）
+//
+static inline float  ComputeFeatureSquaredDistance( const float * a, const float * b, int dim )
+{
+#ifdef  MOTION_GRAPH_USE_SSE
+	__m128  sum = _mm_setzero_ps();
+	for ( int i = 0; i < dim; i += 4 )
+	{
+		__m128  d = _mm_sub_ps( _mm_loadu_ps( a + i ), _mm_loadu_ps( b + i ) );
+		sum = _mm_add_ps( sum, _mm_mul_ps( d, d ) );
+	}
+	float  s[ 4 ];
+	_mm_storeu_ps( s, sum );
+	return  ( s[ 0 ] + s[ 1 ] ) + ( s[ 2 ] + s[ 3 ] );
+#else
+	float  s[ 4 ] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for ( int i = 0; i < dim; i += 4 )
+	{
+		for ( int k = 0; k < 4; k++ )
+		{
+			float  d = a[ i + k ] - b[ i + k ];
+			s[ k ] += d * d;
+		}
+	}
+	return  ( s[ 0 ] + s[ 1 ] ) + ( s[ 2 ] + s[ 3 ] );
+#endif
+}
+
+
+
+//
+//  モーショングラフクラス
+//
+
+
+//
+//  コンストラクタ
+//
+MotionGraph::MotionGraph()
+{
+	InitMotionGraphParam( param );
+}
+
+
+//
+//  全情報の削除
+//
+void  MotionGraph::Clear()
+{
+	clip_names.clear();
+	clip_num_frames.clear();
+	clip_intervals.clear();
+	clip_offsets.clear();
+	transitions.clear();
+	transition_begin.clear();
+	next_transition.clear();
+}
+
+
+//
+//  モーショングラフの構築
+//  全フレームの組み合わせの距離行列を、対角以上（上三角）のタイル単位でスレッドに分配して計算して下三角に複写し、
+//  行方向のタイルごとに距離の極小点（周囲８近傍以下、かつ閾値以下）を遷移候補として抽出する
+// （距離は対称なため各組み合わせは１回だけ計算する、距離行列全体（全フレーム数の２乗）の記憶領域を使用する）
+//
+bool  MotionGraph::Build( const vector< const Motion * > & clips, const MotionGraphParam & new_param )
+{
+	Clear();
+	param = new_param;
+
+	// 入力チェック（全ての動作データは同じ骨格モデルを使用する）
+	if ( clips.size() == 0 )
+		return  false;
+	const Skeleton *  body = clips[ 0 ]->body;
+	for ( int c = 0; c < (int)clips.size(); c++ )
+		if ( !clips[ c ] || ( clips[ c ]->body != body ) || ( clips[ c ]->num_frames <= 0 ) )
+			return  false;
+
+	// 各動作の情報とフレームの通し番号を記録
+	int  num_clips = (int) clips.size();
+	clip_offsets.resize( num_clips + 1 );
+	clip_offsets[ 0 ] = 0;
+	for ( int c = 0; c < num_clips; c++ )
+	{
+		clip_names.push_back( clips[ c ]->name );
+		clip_num_frames.push_back( clips[ c ]->num_frames );
+		clip_intervals.push_back( clips[ c ]->interval );
+		clip_offsets[ c + 1 ] = clip_offsets[ c ] + clips[ c ]->num_frames;
+	}
+	int  total_frames = clip_offsets[ num_clips ];
+
+	// スレッド数を決定
+	int  num_threads = param.num_threads;
+	if ( num_threads <= 0 )
+		num_threads = (int) thread::hardware_concurrency();
+	if ( num_threads <= 0 )
+		num_threads = 1;
+	int  tile_frames = max( param.tile_frames, 1 );
+
+	// 特徴ベクトルの次元数（SIMD計算のために４の倍数に切り上げ、余りは 0 で埋める）
+	int  window_frames = param.window_half_frames * 2 + 1;
+	int  num_points = window_frames * body->num_joints;
+	int  dim = ( num_points * 3 + 3 ) & ~3;
+
+	// 全フレームの特徴ベクトルを計算（動作ごとに並列に順運動学計算）
+	vector< float >  features( (size_t) total_frames * dim, 0.0f );
+	vector< thread >  workers;
+	atomic< int >  next_clip( 0 );
+	auto  compute_features = [&]()
+	{
+		vector< Matrix4f >  segment_frames;
+		vector< vector< Point3f > >  joint_positions;
+		for ( int c = next_clip++; c < num_clips; c = next_clip++ )
+		{
+			const Motion &  motion = *clips[ c ];
+			joint_positions.resize( motion.num_frames );
+			for ( int f = 0; f < motion.num_frames; f++ )
+				ForwardKinematics( motion.frames[ f ], segment_frames, joint_positions[ f ] );
+			for ( int f = 0; f < motion.num_frames; f++ )
+				ComputeMotionGraphFeature( motion, joint_positions, f, param.window_half_frames, &features[ (size_t)( clip_offsets[ c ] + f ) * dim ] );
+		}
+	};
+	for ( int t = 1; t < min( num_threads, num_clips ); t++ )
+		workers.push_back( thread( compute_features ) );
+	compute_features();
+	for ( int t = 0; t < (int)workers.size(); t++ )
+		workers[ t ].join();
+	workers.clear();
+
+	// 各フレームの動作番号と、遷移に使用できるフレームか（遷移後のブレンドに必要な時間が動作の終了までに残っているか）を記録
+	vector< int >  frame_clips( total_frames );
+	vector< char >  frame_usable( total_frames );
+	for ( int c = 0; c < num_clips; c++ )
+	{
+		int  blend_frames = (int) ceil( param.blend_duration / clips[ c ]->interval );
+		for ( int f = 0; f < clips[ c ]->num_frames; f++ )
+		{
+			frame_clips[ clip_offsets[ c ] + f ] = c;
+			frame_usable[ clip_offsets[ c ] + f ] = ( f + blend_frames < clips[ c ]->num_frames );
+		}
+	}
+
+	// 距離の閾値（特徴ベクトルの距離の２乗に換算）
+	float  threshold = param.distance_threshold * param.distance_threshold * num_points;
+
+	// 距離行列の計算（上三角のタイルを各スレッドに動的に分配し、計算した距離を対角の反対側のタイルにも書き込む）
+	// 各タイルでは、行・列の特徴ベクトルをキャッシュ上で再利用する
+	int  num_row_tiles = ( total_frames + tile_frames - 1 ) / tile_frames;
+	vector< pair< int, int > >  tile_pairs;
+	for ( int ti = 0; ti < num_row_tiles; ti++ )
+		for ( int tj = ti; tj < num_row_tiles; tj++ )
+			tile_pairs.push_back( make_pair( ti, tj ) );
+	vector< float >  distances( (size_t) total_frames * total_frames );
+	atomic< int >  next_tile( 0 );
+	auto  compute_tiles = [&]()
+	{
+		for ( int tile = next_tile++; tile < (int)tile_pairs.size(); tile = next_tile++ )
+		{
+			int  row_begin = tile_pairs[ tile ].first * tile_frames;
+			int  row_end = min( row_begin + tile_frames, total_frames );
+			int  col_begin = tile_pairs[ tile ].second * tile_frames;
+			int  col_end = min( col_begin + tile_frames, total_frames );
+			for ( int i = row_begin; i < row_end; i++ )
+			{
+				const float *  a = &features[ (size_t) i * dim ];
+				float *  row = &distances[ (size_t) i * total_frames ];
+				for ( int j = max( col_begin, i ); j < col_end; j++ )
+				{
+					float  d = ComputeFeatureSquaredDistance( a, &features[ (size_t) j * dim ], dim );
+					row[ j ] = d;
+					distances[ (size_t) j * total_frames + i ] = d;
+				}
+			}
+		}
+	};
+	for ( int t = 1; t < num_threads; t++ )
+		workers.push_back( thread( compute_tiles ) );
+	compute_tiles();
+	for ( int t = 0; t < (int)workers.size(); t++ )
+		workers[ t ].join();
+	workers.clear();
+
+	// 距離の極小点の抽出（行方向のタイルを各スレッドに動的に分配）
+	next_tile = 0;
+	vector< vector< MotionGraphTransition > >  thread_transitions( num_threads );
+	auto  extract_tiles = [&]( int thread_no )
+	{
+		vector< MotionGraphTransition > &  found = thread_transitions[ thread_no ];
+		for ( int tile = next_tile++; tile < num_row_tiles; tile = next_tile++ )
+		{
+			int  row_begin = tile * tile_frames;
+			int  row_end = min( row_begin + tile_frames, total_frames );
+
+			// 距離の極小点を抽出（８近傍は同じ動作の組み合わせの範囲内のみを比較）
+			for ( int i = row_begin; i < row_end; i++ )
+			{
+				if ( !frame_usable[ i ] )
+					continue;
+				int  ci = frame_clips[ i ];
+				const float *  row = &distances[ (size_t) i * total_frames ];
+				for ( int j = 0; j < total_frames; j++ )
+				{
+					float  d = row[ j ];
+					if ( ( d > threshold ) || !frame_usable[ j ] )
+						continue;
+					int  cj = frame_clips[ j ];
+					if ( ( ci == cj ) && ( abs( i - j ) < param.min_self_frame_gap ) )
+						continue;
+
+					bool  is_minimum = true;
+					for ( int di = -1; ( di <= 1 ) && is_minimum; di++ )
+					{
+						int  ni = i + di;
+						if ( ( ni < 0 ) || ( ni >= total_frames ) || ( frame_clips[ ni ] != ci ) )
+							continue;
+						const float *  nrow = &distances[ (size_t) ni * total_frames ];
+						for ( int dj = -1; dj <= 1; dj++ )
+						{
+							int  nj = j + dj;
+							if ( ( ( di == 0 ) && ( dj == 0 ) ) || ( nj < 0 ) || ( nj >= total_frames ) || ( frame_clips[ nj ] != cj ) )
+								continue;
+							// 同じ距離の近傍が先に走査される位置にあれば、そちらを極小点とする（平坦な区間での重複を防ぐ）
+							if ( ( nrow[ nj ] < d ) || ( ( nrow[ nj ] == d ) && ( ( di < 0 ) || ( ( di == 0 ) && ( dj < 0 ) ) ) ) )
+							{
+								is_minimum = false;
+								break;
+							}
+						}
+					}
+					if ( !is_minimum )
+						continue;
+
+					MotionGraphTransition  trans;
+					trans.src_clip = ci;
+					trans.src_frame = i - clip_offsets[ ci ];
+					trans.dest_clip = cj;
+					trans.dest_frame = j - clip_offsets[ cj ];
+					trans.distance = sqrt( d / num_points );
+					found.push_back( trans );
+				}
+			}
+		}
+	};
+	for ( int t = 1; t < num_threads; t++ )
+		workers.push_back( thread( extract_tiles, t ) );
+	extract_tiles( 0 );
+	for ( int t = 0; t < (int)workers.size(); t++ )
+		workers[ t ].join();
+
+	// 遷移候補を統合して、遷移元の動作番号・フレーム番号、距離の順に整列
+	for ( int t = 0; t < num_threads; t++ )
+		transitions.insert( transitions.end(), thread_transitions[ t ].begin(), thread_transitions[ t ].end() );
+	sort( transitions.begin(), transitions.end(), []( const MotionGraphTransition & a, const MotionGraphTransition & b )
+	{
+		if ( a.src_clip != b.src_clip )
+			return  a.src_clip < b.src_clip;
+		if ( a.src_frame != b.src_frame )
+			return  a.src_frame < b.src_frame;
+		return  a.distance < b.distance;
+	} );
+
+	// 遷移候補の検索表の構築
+	BuildLookupTables();
+
+	return  true;
+}
+
+
+//
+//  遷移候補の検索表の構築
+//
+void  MotionGraph::BuildLookupTables()
+{
+	int  num_clips = (int) clip_names.size();
+	int  total_frames = clip_offsets.size() ? clip_offsets[ num_clips ] : 0;
+
+	// 各フレームを遷移元とする遷移候補の開始位置
+	transition_begin.assign( total_frames + 1, 0 );
+	for ( int i = 0; i < (int)transitions.size(); i++ )
+		transition_begin[ clip_offsets[ transitions[ i ].src_clip ] + transitions[ i ].src_frame + 1 ] ++;
+	for ( int i = 0; i < total_frames; i++ )
+		transition_begin[ i + 1 ] += transition_begin[ i ];
+
+	// 各フレーム以降で最初の、各動作への遷移候補（同じフレームに複数あれば距離が最小のもの）
+	// 各動作の末尾のフレームから先頭に向かって、直前の結果を引き継ぎながら計算
+	next_transition.assign( (size_t) total_frames * num_clips, -1 );
+	for ( int c = 0; c < num_clips; c++ )
+	{
+		for ( int f = clip_num_frames[ c ] - 1; f >= 0; f-- )
+		{
+			int  i = clip_offsets[ c ] + f;
+			int *  next = &next_transition[ (size_t) i * num_clips ];
+			if ( f + 1 < clip_num_frames[ c ] )
+				memcpy( next, next + num_clips, sizeof( int ) * num_clips );
+
+			// 同じフレームの遷移候補は距離の昇順に並んでいるため、逆順に上書きして最小のものを残す
+			for ( int t = transition_begin[ i + 1 ] - 1; t >= transition_begin[ i ]; t-- )
+				next[ transitions[ t ].dest_clip ] = t;
+		}
+	}
+}
+
+
+//
+//  指定フレームを遷移元とする遷移候補の範囲を取得（開始位置と個数を返す）
+//
+int  MotionGraph::GetTransitions( int src_clip, int src_frame, int * num_transitions ) const
+{
+	if ( num_transitions )
+		*num_transitions = 0;
+	if ( ( src_clip < 0 ) || ( src_clip >= (int)clip_names.size() ) || ( src_frame < 0 ) || ( src_frame >= clip_num_frames[ src_clip ] ) )
+		return  -1;
+
+	int  i = clip_offsets[ src_clip ] + src_frame;
+	if ( num_transitions )
+		*num_transitions = transition_begin[ i + 1 ] - transition_begin[ i ];
+	return  transition_begin[ i ];
+}
+
+
+//
+//  指定フレーム以降で最初の、指定動作への遷移候補の番号を取得（なければ -1）
+//
+int  MotionGraph::FindNextTransition( int src_clip, int src_frame, int dest_clip ) const
+{
+	int  num_clips = (int) clip_names.size();
+	if ( ( src_clip < 0 ) || ( src_clip >= num_clips ) || ( dest_clip < 0 ) || ( dest_clip >= num_clips ) )
+		return  -1;
+	if ( src_frame < 0 )
+		src_frame = 0;
+	if ( src_frame >= clip_num_frames[ src_clip ] )
+		return  -1;
+
+	return  next_transition[ (size_t)( clip_offsets[ src_clip ] + src_frame ) * num_clips + dest_clip ];
+}
+
+
+//
+//  ファイルへの保存
+//
+bool  MotionGraph::SaveToFile( const char * file_name ) const
+{
+	FILE *  fp = fopen( file_name, "wb" );
+	if ( !fp )
+		return  false;
+
+	// ヘッダ（識別子・バージョン・構築パラメタ）
+	fwrite( motion_graph_file_magic, 1, 4, fp );
+	fwrite( &motion_graph_file_version, sizeof( int ), 1, fp );
+	fwrite( &param, sizeof( MotionGraphParam ), 1, fp );
+
+	// 動作データの情報
+	int  num_clips = (int) clip_names.size();
+	fwrite( &num_clips, sizeof( int ), 1, fp );
+	for ( int c = 0; c < num_clips; c++ )
+	{
+		int  name_length = (int) clip_names[ c ].size();
+		fwrite( &name_length, sizeof( int ), 1, fp );
+		fwrite( clip_names[ c ].c_str(), 1, name_length, fp );
+		fwrite( &clip_num_frames[ c ], sizeof( int ), 1, fp );
+		fwrite( &clip_intervals[ c ], sizeof( float ), 1, fp );
+	}
+
+	// 遷移候補
+	int  num_transitions = (int) transitions.size();
+	fwrite( &num_transitions, sizeof( int ), 1, fp );
+	if ( num_transitions > 0 )
+		fwrite( &transitions[ 0 ], sizeof( MotionGraphTransition ), num_transitions, fp );
+
+	bool  success = !ferror( fp );
+	fclose( fp );
+	return  success;
+}
+
+
+//
+//  ファイルからの読み込み（動作データの名前・フレーム数・フレーム間隔が一致しない場合は失敗）
+//
+bool  MotionGraph::LoadFromFile( const char * file_name, const vector< const Motion * > & clips )
+{
+	Clear();
+
+	FILE *  fp = fopen( file_name, "rb" );
+	if ( !fp )
+		return  false;
+
+	// ファイルの内容を読み込み（途中で不正な値があれば失敗）
+	auto  read_graph = [&]() -> bool
+	{
+		char  magic[ 4 ];
+		int  version = 0;
+		int  num_clips = 0;
+		int  num_transitions = 0;
+
+		// ヘッダの確認
+		if ( ( fread( magic, 1, 4, fp ) != 4 ) || ( memcmp( magic, motion_graph_file_magic, 4 ) != 0 ) )
+			return  false;
+		if ( ( fread( &version, sizeof( int ), 1, fp ) != 1 ) || ( version != motion_graph_file_version ) )
+			return  false;
+		if ( fread( &param, sizeof( MotionGraphParam ), 1, fp ) != 1 )
+			return  false;
+
+		// 動作データの情報の照合
+		if ( ( fread( &num_clips, sizeof( int ), 1, fp ) != 1 ) || ( num_clips != (int)clips.size() ) )
+			return  false;
+		clip_offsets.push_back( 0 );
+		for ( int c = 0; c < num_clips; c++ )
+		{
+			int  name_length = 0;
+			int  num_frames = 0;
+			float  interval = 0.0f;
+			if ( ( fread( &name_length, sizeof( int ), 1, fp ) != 1 ) || ( name_length < 0 ) || ( name_length > 4096 ) )
+				return  false;
+			string  name( name_length, '\0' );
+			if ( ( name_length > 0 ) && ( fread( &name[ 0 ], 1, name_length, fp ) != (size_t)name_length ) )
+				return  false;
+			if ( ( fread( &num_frames, sizeof( int ), 1, fp ) != 1 ) || ( fread( &interval, sizeof( float ), 1, fp ) != 1 ) )
+				return  false;
+			if ( !clips[ c ] || ( name != clips[ c ]->name ) || ( num_frames != clips[ c ]->num_frames ) ||
+			     ( fabs( interval - clips[ c ]->interval ) > 1.0e-6f ) )
+				return  false;
+			clip_names.push_back( name );
+			clip_num_frames.push_back( num_frames );
+			clip_intervals.push_back( interval );
+			clip_offsets.push_back( clip_offsets.back() + num_frames );
+		}
+
+		// 遷移候補の読み込み
+		if ( ( fread( &num_transitions, sizeof( int ), 1, fp ) != 1 ) || ( num_transitions < 0 ) )
+			return  false;
+		transitions.resize( num_transitions );
+		if ( ( num_transitions > 0 ) && ( fread( &transitions[ 0 ], sizeof( MotionGraphTransition ), num_transitions, fp ) != (size_t)num_transitions ) )
+			return  false;
+		for ( int i = 0; i < num_transitions; i++ )
+		{
+			const MotionGraphTransition &  t = transitions[ i ];
+			if ( ( t.src_clip < 0 ) || ( t.src_clip >= num_clips ) || ( t.src_frame < 0 ) || ( t.src_frame >= clip_num_frames[ t.src_clip ] ) ||
+			     ( t.dest_clip < 0 ) || ( t.dest_clip >= num_clips ) || ( t.dest_frame < 0 ) || ( t.dest_frame >= clip_num_frames[ t.dest_clip ] ) )
+				return  false;
+		}
+		return  true;
+	};
+	bool  success = read_graph();
+	fclose( fp );
+
+	// 遷移候補の検索表の構築
+	if ( success )
+		BuildLookupTables();
+	else
+		Clear();
+	return  success;
+}
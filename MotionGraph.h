@@ -0,0 +1,133 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  モーショングラフ（動作データ間の遷移候補の事前計算）
+**/
+
+#ifndef  _MOTION_GRAPH_H_
+#define  _MOTION_GRAPH_H_
+
+
+// ライブラリ・クラス定義の読み込み
+#include "SimpleHuman.h"
+
+
+//
+//  モーショングラフの構築パラメタ
+//
+struct  MotionGraphParam
+{
+	// 姿勢比較に使用する前後のフレーム数（中心フレームの前後 window_half_frames フレームを比較）
+	int  window_half_frames;
+
+	// 遷移候補とする姿勢の距離の閾値（全関節点の平均二乗誤差の平方根、単位はメートル）
+	float  distance_threshold;
+
+	// 遷移時のブレンド時間（遷移元・遷移先のフレームから動作の終了までに必要な時間）
+	float  blend_duration;
+
+	// 同一動作内の遷移を候補とする最小のフレーム間隔
+	int  min_self_frame_gap;
+
+	// 距離行列の計算のタイルサイズ（フレーム数）
+	int  tile_frames;
+
+	// 並列計算に使用するスレッド数（0 以下の場合はハードウェアの並列数）
+	int  num_threads;
+};
+
+// モーショングラフの構築パラメタを初期化
+void  InitMotionGraphParam( MotionGraphParam & param );
+
+
+//
+//  モーショングラフの遷移（ある動作のフレームから、別の動作（同じ動作も含む）のフレームへの遷移）
+//
+struct  MotionGraphTransition
+{
+	// 遷移元の動作番号・フレーム番号
+	int  src_clip;
+	int  src_frame;
+
+	// 遷移先の動作番号・フレーム番号
+	int  dest_clip;
+	int  dest_frame;
+
+	// 遷移元・遷移先の姿勢の距離（全関節点の平均二乗誤差の平方根）
+	float  distance;
+};
+
+
+//
+//  モーショングラフクラス
+//  動作データ間の全フレームの組み合わせの姿勢の距離を計算し、距離の極小点を遷移候補として保持する
+//  再生時には、現在の動作・フレームから指定動作への次の遷移を定数時間で検索できる
+//
+class  MotionGraph
+{
+  protected:
+	// 構築に使用したパラメタ
+	MotionGraphParam  param;
+
+	// 各動作の名前・フレーム数・フレーム間隔（保存したファイルの読み込み時の照合用）
+	vector< string >  clip_names;
+	vector< int >  clip_num_frames;
+	vector< float >  clip_intervals;
+
+	// 各動作の先頭フレームの通し番号 [動作番号]（末尾に全フレーム数を追加）
+	vector< int >  clip_offsets;
+
+	// 遷移候補の配列（遷移元の動作番号・フレーム番号の順に整列）
+	vector< MotionGraphTransition >  transitions;
+
+	// 各フレームを遷移元とする遷移候補の配列の開始位置 [フレームの通し番号]（末尾に遷移候補の数を追加）
+	vector< int >  transition_begin;
+
+	// 各フレーム以降で最初の、各動作への遷移候補の番号 [フレームの通し番号 * 動作数 + 遷移先の動作番号]（なければ -1）
+	vector< int >  next_transition;
+
+  public:
+	// コンストラクタ
+	MotionGraph();
+
+  public:
+	// モーショングラフの構築
+	bool  Build( const vector< const Motion * > & clips, const MotionGraphParam & param );
+
+	// ファイルへの保存・読み込み（読み込み時は、動作データの名前・フレーム数・フレーム間隔が一致するかを確認）
+	bool  SaveToFile( const char * file_name ) const;
+	bool  LoadFromFile( const char * file_name, const vector< const Motion * > & clips );
+
+	// 全情報の削除
+	void  Clear();
+
+  public:
+	// 情報取得
+	const MotionGraphParam &  GetParam() const { return  param; }
+	int  GetNumClips() const { return  (int) clip_names.size(); }
+	int  GetNumTransitions() const { return  (int) transitions.size(); }
+	const MotionGraphTransition &  GetTransition( int no ) const { return  transitions[ no ]; }
+
+	// 指定フレームを遷移元とする遷移候補の範囲を取得（開始位置と個数を返す）
+	int  GetTransitions( int src_clip, int src_frame, int * num_transitions ) const;
+
+	// 指定フレーム以降で最初の、指定動作への遷移候補の番号を取得（なければ -1）
+	int  FindNextTransition( int src_clip, int src_frame, int dest_clip ) const;
+
+  protected:
+	// 遷移候補の検索表の構築
+	void  BuildLookupTables();
+};
+
+
+// 補助処理（グローバル関数）のプロトタイプ宣言
+
+// 姿勢比較のための特徴ベクトルを計算（中心フレームの腰の水平位置・水平向きを基準とする前後のフレームの全関節点の位置）
+void  ComputeMotionGraphFeature( const Motion & motion, const vector< vector< Point3f > > & joint_positions, int frame_no, int window_half_frames, float * feature );
+
+
+#endif // _MOTION_GRAPH_H_
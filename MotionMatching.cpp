@@ -0,0 +1,522 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  モーションマッチング（特徴ベクトルの最近傍探索による動作選択）
+**/
+
+
+// ライブラリ・クラス定義の読み込み
+#include "SimpleHuman.h"
+#include "MotionMatching.h"
+
+// 標準算術関数・定数の定義
+#define  _USE_MATH_DEFINES
+#include <math.h>
+
+// 標準ライブラリの読み込み
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+
+// 特徴ベクトルの各グループの開始次元
+static const int  feature_group_offsets[ MM_NUM_FEATURE_GROUPS + 1 ] = {
+	0,
+	MM_NUM_TRAJECTORY_SAMPLES * 2,
+	MM_NUM_TRAJECTORY_SAMPLES * 4,
+	MM_NUM_TRAJECTORY_SAMPLES * 4 + 6,
+	MM_NUM_TRAJECTORY_SAMPLES * 4 + 12,
+	MM_FEATURE_DIM };
+
+
+
+//
+//  モーションマッチングのパラメタを初期化
+//
+void  InitMotionMatchingParam( MotionMatchingParam & param )
+{
+	param.trajectory_times[ 0 ] = 0.33f;
+	param.trajectory_times[ 1 ] = 0.67f;
+	param.trajectory_times[ 2 ] = 1.0f;
+	param.group_weights[ MM_TRAJECTORY_POSITION ] = 1.0f;
+	param.group_weights[ MM_TRAJECTORY_DIRECTION ] = 1.5f;
+	param.group_weights[ MM_FOOT_POSITION ] = 0.75f;
+	param.group_weights[ MM_FOOT_VELOCITY ] = 1.0f;
+	param.group_weights[ MM_HIP_VELOCITY ] = 1.0f;
+	param.foot_segment_names[ 0 ] = "LeftAnkle";
+	param.foot_segment_names[ 1 ] = "RightAnkle";
+	param.search_interval_frames = 10;
+	param.blend_duration = 0.2f;
+	param.min_time_gap = 0.2f;
+	param.num_threads = 0;
+}
+
+
+//
+//  ワールド座標系の水平面上のベクトルを、指定の水平向き（ラジアン）を基準とするローカル座標系に変換
+//
+static void  ToLocalDirection( float dx, float dy, float dz, float angle, float * local )
+{
+	float  c = cos( angle ), s = sin( angle );
+	local[ 0 ] = c * dx - s * dz;
+	local[ 1 ] = dy;
+	local[ 2 ] = s * dx + c * dz;
+}
+
+
+
+//
+//  モーションマッチングの特徴データベースクラス
+//
+
+
+//
+//  コンストラクタ
+//
+MotionMatchingDatabase::MotionMatchingDatabase()
+{
+	InitMotionMatchingParam( param );
+	foot_segments[ 0 ] = -1;
+	foot_segments[ 1 ] = -1;
+	for ( int d = 0; d < MM_FEATURE_DIM; d++ )
+	{
+		feature_mean[ d ] = 0.0f;
+		feature_scale[ d ] = 1.0f;
+	}
+}
+
+
+//
+//  全情報の削除
+//
+void  MotionMatchingDatabase::Clear()
+{
+	clips.clear();
+	features.clear();
+	feature_clips.clear();
+	feature_frames.clear();
+	tree.Clear();
+}
+
+
+//
+//  未来の軌道に必要なフレーム数を取得
+//
+int  MotionMatchingDatabase::GetNumFutureFrames( const Motion & motion ) const
+{
+	return  (int) ceil( param.trajectory_times[ MM_NUM_TRAJECTORY_SAMPLES - 1 ] / motion.interval );
+}
+
+
+//
+//  データベースの構築
+//
+bool  MotionMatchingDatabase::Build( const vector< Motion * > & new_clips, const MotionMatchingParam & new_param )
+{
+	Clear();
+	if ( new_clips.size() == 0 )
+		return  false;
+
+	// 全ての動作が同じ骨格モデルを使用していることを確認
+	const Skeleton *  body = new_clips[ 0 ]->body;
+	for ( int c = 0; c < (int)new_clips.size(); c++ )
+		if ( !new_clips[ c ] || ( new_clips[ c ]->body != body ) || ( new_clips[ c ]->num_frames < 2 ) )
+			return  false;
+
+	param = new_param;
+	clips = new_clips;
+	foot_segments[ 0 ] = FindSegment( body, param.foot_segment_names[ 0 ] );
+	foot_segments[ 1 ] = FindSegment( body, param.foot_segment_names[ 1 ] );
+
+	// 未来の軌道が動作内に収まるフレームを特徴ベクトルの対象とする
+	for ( int c = 0; c < (int)clips.size(); c++ )
+	{
+		int  num_frames = clips[ c ]->num_frames - GetNumFutureFrames( *clips[ c ] );
+		for ( int f = 0; f < num_frames; f++ )
+		{
+			feature_clips.push_back( c );
+			feature_frames.push_back( f );
+		}
+	}
+	int  num_features = (int) feature_clips.size();
+	if ( num_features == 0 )
+	{
+		Clear();
+		return  false;
+	}
+
+	// スレッド数を決定
+	int  num_threads = param.num_threads;
+	if ( num_threads <= 0 )
+		num_threads = (int) thread::hardware_concurrency();
+	if ( num_threads <= 0 )
+		num_threads = 1;
+
+	// 全フレームの特徴ベクトルを計算（一定数のフレームごとに各スレッドに動的に分配）
+	const int  chunk_frames = 256;
+	features.resize( (size_t) num_features * MM_FEATURE_DIM );
+	atomic< int >  next_chunk( 0 );
+	auto  compute_features = [&]()
+	{
+		for ( int begin = chunk_frames * next_chunk++; begin < num_features; begin = chunk_frames * next_chunk++ )
+		{
+			int  end = min( begin + chunk_frames, num_features );
+			for ( int i = begin; i < end; i++ )
+				ComputeFeature( feature_clips[ i ], feature_frames[ i ], &features[ (size_t) i * MM_FEATURE_DIM ] );
+		}
+	};
+	vector< thread >  workers;
+	int  num_chunks = ( num_features + chunk_frames - 1 ) / chunk_frames;
+	for ( int t = 1; t < min( num_threads, num_chunks ); t++ )
+		workers.push_back( thread( compute_features ) );
+	compute_features();
+	for ( int t = 0; t < (int)workers.size(); t++ )
+		workers[ t ].join();
+
+	// 各次元の平均と標準偏差を計算
+	double  sum[ MM_FEATURE_DIM ] = { 0.0 }, sum_sq[ MM_FEATURE_DIM ] = { 0.0 };
+	for ( int i = 0; i < num_features; i++ )
+	{
+		const float *  feature = &features[ (size_t) i * MM_FEATURE_DIM ];
+		for ( int d = 0; d < MM_FEATURE_DIM; d++ )
+		{
+			sum[ d ] += feature[ d ];
+			sum_sq[ d ] += feature[ d ] * feature[ d ];
+		}
+	}
+
+	// 各グループの次元の標準偏差の平均でグループ全体を正規化し、グループの重みを掛ける
+	//（グループ内の次元間の相対的な大きさは維持する）
+	for ( int g = 0; g < MM_NUM_FEATURE_GROUPS; g++ )
+	{
+		double  group_std = 0.0;
+		for ( int d = feature_group_offsets[ g ]; d < feature_group_offsets[ g + 1 ]; d++ )
+		{
+			double  mean = sum[ d ] / num_features;
+			feature_mean[ d ] = (float) mean;
+			group_std += sqrt( max( sum_sq[ d ] / num_features - mean * mean, 0.0 ) );
+		}
+		group_std /= feature_group_offsets[ g + 1 ] - feature_group_offsets[ g ];
+
+		float  scale = ( group_std > 1.0e-6 ) ? (float)( param.group_weights[ g ] / group_std ) : 0.0f;
+		for ( int d = feature_group_offsets[ g ]; d < feature_group_offsets[ g + 1 ]; d++ )
+			feature_scale[ d ] = scale;
+	}
+
+	// 全ての特徴ベクトルを正規化
+	for ( int i = 0; i < num_features; i++ )
+	{
+		float *  feature = &features[ (size_t) i * MM_FEATURE_DIM ];
+		NormalizeFeature( feature, feature );
+	}
+
+	// kd木を構築
+	tree.Build( &features[ 0 ], num_features, MM_FEATURE_DIM );
+
+	return  true;
+}
+
+
+//
+//  指定動作・フレームの特徴ベクトルを計算（正規化前）
+//
+void  MotionMatchingDatabase::ComputeFeature( int clip_no, int frame_no, float * feature ) const
+{
+	const Motion &  motion = *clips[ clip_no ];
+	frame_no = max( 0, min( frame_no, motion.num_frames - 1 ) );
+
+	// 基準フレームの腰の水平位置・水平向き（ラジアン）
+	const Posture &  base = motion.frames[ frame_no ];
+	float  base_angle = ComputeOrientationAngle( base.root_ori ) * M_PI / 180.0f;
+
+	// 未来の腰の水平位置・水平向き
+	for ( int k = 0; k < MM_NUM_TRAJECTORY_SAMPLES; k++ )
+	{
+		int  future_no = min( frame_no + (int)( param.trajectory_times[ k ] / motion.interval + 0.5f ), motion.num_frames - 1 );
+		const Posture &  future = motion.frames[ future_no ];
+
+		float  local[ 3 ];
+		ToLocalDirection( future.root_pos.x - base.root_pos.x, 0.0f, future.root_pos.z - base.root_pos.z, base_angle, local );
+		feature[ feature_group_offsets[ MM_TRAJECTORY_POSITION ] + k * 2 + 0 ] = local[ 0 ];
+		feature[ feature_group_offsets[ MM_TRAJECTORY_POSITION ] + k * 2 + 1 ] = local[ 2 ];
+
+		float  angle = ComputeOrientationAngle( future.root_ori ) * M_PI / 180.0f - base_angle;
+		feature[ feature_group_offsets[ MM_TRAJECTORY_DIRECTION ] + k * 2 + 0 ] = sin( angle );
+		feature[ feature_group_offsets[ MM_TRAJECTORY_DIRECTION ] + k * 2 + 1 ] = cos( angle );
+	}
+
+	// 速度の計算に使用する前後のフレーム（先頭フレームの場合は次のフレームとの差分を使用）
+	int  prev_no = max( frame_no - 1, 0 );
+	int  next_no = prev_no + 1;
+	const Posture &  prev = motion.frames[ prev_no ];
+	const Posture &  next = motion.frames[ next_no ];
+
+	// 順運動学計算により、足の位置を計算
+	vector< Matrix4f >  seg_frames;
+	Point3f  foot_pos[ 2 ], prev_foot_pos[ 2 ], next_foot_pos[ 2 ];
+	for ( int j = 0; j < 2; j++ )
+		foot_pos[ j ] = prev_foot_pos[ j ] = next_foot_pos[ j ] = base.root_pos;
+	const Posture *  poses[ 3 ] = { &base, &prev, &next };
+	Point3f *  positions[ 3 ] = { foot_pos, prev_foot_pos, next_foot_pos };
+	for ( int p = 0; p < 3; p++ )
+	{
+		if ( ( p > 0 ) && ( poses[ p ] == &base ) )
+		{
+			positions[ p ][ 0 ] = foot_pos[ 0 ];
+			positions[ p ][ 1 ] = foot_pos[ 1 ];
+			continue;
+		}
+		ForwardKinematics( *poses[ p ], seg_frames );
+		for ( int j = 0; j < 2; j++ )
+			if ( foot_segments[ j ] >= 0 )
+				positions[ p ][ j ].set( seg_frames[ foot_segments[ j ] ].m03, seg_frames[ foot_segments[ j ] ].m13, seg_frames[ foot_segments[ j ] ].m23 );
+	}
+
+	// 左右の足の位置・速度
+	for ( int j = 0; j < 2; j++ )
+	{
+		ToLocalDirection( foot_pos[ j ].x - base.root_pos.x, foot_pos[ j ].y - base.root_pos.y, foot_pos[ j ].z - base.root_pos.z,
+			base_angle, &feature[ feature_group_offsets[ MM_FOOT_POSITION ] + j * 3 ] );
+		ToLocalDirection( ( next_foot_pos[ j ].x - prev_foot_pos[ j ].x ) / motion.interval,
+			( next_foot_pos[ j ].y - prev_foot_pos[ j ].y ) / motion.interval,
+			( next_foot_pos[ j ].z - prev_foot_pos[ j ].z ) / motion.interval,
+			base_angle, &feature[ feature_group_offsets[ MM_FOOT_VELOCITY ] + j * 3 ] );
+	}
+
+	// 腰の速度
+	ToLocalDirection( ( next.root_pos.x - prev.root_pos.x ) / motion.interval,
+		( next.root_pos.y - prev.root_pos.y ) / motion.interval,
+		( next.root_pos.z - prev.root_pos.z ) / motion.interval,
+		base_angle, &feature[ feature_group_offsets[ MM_HIP_VELOCITY ] ] );
+}
+
+
+//
+//  特徴ベクトルを正規化
+//
+void  MotionMatchingDatabase::NormalizeFeature( const float * feature, float * normalized ) const
+{
+	for ( int d = 0; d < MM_FEATURE_DIM; d++ )
+		normalized[ d ] = ( feature[ d ] - feature_mean[ d ] ) * feature_scale[ d ];
+}
+
+
+//
+//  正規化した特徴ベクトルに最も近いフレームを探索
+//
+int  MotionMatchingDatabase::FindNearest( const float * normalized, float * distance_sq ) const
+{
+	return  tree.FindNearest( normalized, distance_sq );
+}
+
+
+
+//
+//  モーションマッチングによる動作再生クラス
+//
+
+
+//
+//  コンストラクタ
+//
+MotionMatchingController::MotionMatchingController()
+{
+	database = NULL;
+	transition = NULL;
+	InitMotionInfo( &motion_infos[ 0 ] );
+	InitMotionInfo( &motion_infos[ 1 ] );
+	curr_info_no = 0;
+	curr_clip_no = -1;
+	next_clip_no = -1;
+	curr_motion_mat.setIdentity();
+	curr_start_time = 0.0f;
+	last_search_time = 0.0f;
+	search_count = 0;
+	transition_count = 0;
+	last_search_msec = 0.0f;
+}
+
+
+//
+//  デストラクタ
+//
+MotionMatchingController::~MotionMatchingController()
+{
+	if ( transition )
+		delete  transition;
+}
+
+
+//
+//  初期化（指定動作・フレームから再生を開始）
+//
+void  MotionMatchingController::Init( const MotionMatchingDatabase * new_database, int clip_no, int frame_no, float time )
+{
+	database = new_database;
+	if ( !database || ( clip_no < 0 ) || ( clip_no >= database->GetNumClips() ) )
+		return;
+
+	if ( !transition )
+		transition = new MotionTransition();
+
+	// 現在の動作の情報を設定（遷移が行われなければ、動作の終了時に同じフレームに戻る）
+	Motion *  motion = database->GetClip( clip_no );
+	curr_info_no = 0;
+	MotionInfo &  curr_info = motion_infos[ curr_info_no ];
+	InitMotionInfo( &curr_info, motion );
+	curr_info.begin_time = frame_no * motion->interval;
+	curr_info.blend_end_time = curr_info.begin_time;
+	curr_info.blend_begin_time = max( curr_info.end_time - database->GetParam().blend_duration, curr_info.begin_time );
+	curr_info.base_segment_no = 0;
+
+	curr_clip_no = clip_no;
+	next_clip_no = -1;
+	curr_motion_mat.setIdentity();
+	curr_start_time = time;
+	last_search_time = time;
+	search_count = 0;
+	transition_count = 0;
+
+	transition->Init( &curr_info, &curr_info, curr_motion_mat, curr_start_time );
+}
+
+
+//
+//  姿勢の更新
+//
+void  MotionMatchingController::Update( float time, const Vector3f & desired_velocity, float desired_ori, Posture & posture )
+{
+	if ( !database || !transition || ( curr_clip_no < 0 ) )
+		return;
+
+	const MotionMatchingParam &  param = database->GetParam();
+	const MotionInfo &  curr_info = motion_infos[ curr_info_no ];
+	const Motion *  curr_motion = curr_info.motion;
+
+	// 現在の動作のローカル時刻
+	float  local_time = time - curr_start_time;
+	float  motion_time = local_time + curr_info.begin_time;
+
+	// 遷移中でなければ、一定間隔で特徴ベクトルの探索を行う
+	// 現在の動作の終了が近づいている場合は、間隔に関わらず探索して遷移する
+	float  search_interval = param.search_interval_frames * curr_motion->interval;
+	bool  near_end = ( motion_time + param.blend_duration + search_interval >= curr_motion->GetDuration() );
+	if ( ( next_clip_no < 0 ) && ( near_end || ( time - last_search_time >= search_interval ) ) )
+	{
+		last_search_time = time;
+		search_count ++;
+
+		float  query[ MM_FEATURE_DIM ];
+		chrono::steady_clock::time_point  search_start = chrono::steady_clock::now();
+		ComputeQueryFeature( local_time, desired_velocity, desired_ori, query );
+		int  match = database->FindNearest( query );
+		last_search_msec = chrono::duration< float, milli >( chrono::steady_clock::now() - search_start ).count();
+
+		// 探索結果が現在再生中のフレームの近くであれば、遷移せずに再生を継続
+		if ( match >= 0 )
+		{
+			int  match_clip = database->GetFeatureClip( match );
+			int  match_frame = database->GetFeatureFrame( match );
+			bool  is_current = ( match_clip == curr_clip_no ) &&
+				( fabs( match_frame * curr_motion->interval - motion_time ) < param.min_time_gap );
+			if ( !is_current || near_end )
+				StartTransition( local_time, match_clip, match_frame );
+		}
+	}
+
+	// 動作接続・遷移クラスにより、ブレンドを考慮した姿勢を計算
+	MotionTransition::MotionTransitionState  state = transition->GetPosture( time, &posture );
+
+	// 遷移の完了処理
+	if ( ( state == MotionTransition::MT_NEXT_MOTION ) && ( next_clip_no >= 0 ) )
+	{
+		curr_motion_mat = transition->GetNextMotionMatrix();
+		curr_start_time = transition->GetNextBeginTime();
+		curr_info_no = 1 - curr_info_no;
+		curr_clip_no = next_clip_no;
+		next_clip_no = -1;
+	}
+}
+
+
+//
+//  目標の軌道と現在の姿勢から、正規化した探索用の特徴ベクトルを計算
+//
+void  MotionMatchingController::ComputeQueryFeature( float local_time, const Vector3f & desired_velocity, float desired_ori, float * query ) const
+{
+	const MotionMatchingParam &  param = database->GetParam();
+	const MotionInfo &  curr_info = motion_infos[ curr_info_no ];
+	const Motion *  curr_motion = curr_info.motion;
+
+	// 現在のフレームの特徴ベクトルを計算（足・腰の特徴は現在の動作のものをそのまま使用）
+	float  feature[ MM_FEATURE_DIM ];
+	int  frame_no = (int)( ( local_time + curr_info.begin_time ) / curr_motion->interval + 0.5f );
+	database->ComputeFeature( curr_clip_no, frame_no, feature );
+
+	// 現在のキャラクタの水平向き（ワールド座標系、ラジアン）
+	frame_no = max( 0, min( frame_no, curr_motion->num_frames - 1 ) );
+	Matrix3f  motion_ori, root_ori;
+	curr_motion_mat.get( &motion_ori );
+	root_ori.mul( motion_ori, curr_motion->frames[ frame_no ].root_ori );
+	float  curr_angle = ComputeOrientationAngle( root_ori ) * M_PI / 180.0f;
+
+	// 未来の軌道を、目標の移動速度・水平向きから予測したものに置き換え
+	float  local[ 3 ];
+	float  angle = desired_ori * M_PI / 180.0f - curr_angle;
+	for ( int k = 0; k < MM_NUM_TRAJECTORY_SAMPLES; k++ )
+	{
+		float  t = param.trajectory_times[ k ];
+		ToLocalDirection( desired_velocity.x * t, 0.0f, desired_velocity.z * t, curr_angle, local );
+		query[ k * 2 + 0 ] = local[ 0 ];
+		query[ k * 2 + 1 ] = local[ 2 ];
+	}
+	for ( int k = 0; k < MM_NUM_TRAJECTORY_SAMPLES; k++ )
+	{
+		feature[ feature_group_offsets[ MM_TRAJECTORY_POSITION ] + k * 2 + 0 ] = query[ k * 2 + 0 ];
+		feature[ feature_group_offsets[ MM_TRAJECTORY_POSITION ] + k * 2 + 1 ] = query[ k * 2 + 1 ];
+		feature[ feature_group_offsets[ MM_TRAJECTORY_DIRECTION ] + k * 2 + 0 ] = sin( angle );
+		feature[ feature_group_offsets[ MM_TRAJECTORY_DIRECTION ] + k * 2 + 1 ] = cos( angle );
+	}
+
+	// 正規化
+	database->NormalizeFeature( feature, query );
+}
+
+
+//
+//  指定動作・フレームへの遷移を開始
+//
+void  MotionMatchingController::StartTransition( float local_time, int clip_no, int frame_no )
+{
+	MotionInfo &  curr_info = motion_infos[ curr_info_no ];
+	MotionInfo &  next_info = motion_infos[ 1 - curr_info_no ];
+	Motion *  next_motion = database->GetClip( clip_no );
+
+	// ブレンド時間（現在の動作・次の動作の残り時間に収まるように調整）
+	float  motion_time = local_time + curr_info.begin_time;
+	float  next_time = frame_no * next_motion->interval;
+	float  blend = database->GetParam().blend_duration;
+	blend = min( blend, curr_info.motion->GetDuration() - motion_time );
+	blend = max( min( blend, next_motion->GetDuration() - next_time ), 0.0f );
+
+	// 現在の動作は現在時刻からブレンドを開始
+	curr_info.blend_begin_time = motion_time;
+	curr_info.end_time = motion_time + blend;
+
+	// 次の動作は探索したフレームから開始（遷移が行われなければ、動作の終了時に同じフレームに戻る）
+	InitMotionInfo( &next_info, next_motion );
+	next_info.begin_time = next_time;
+	next_info.blend_end_time = next_time + blend;
+	next_info.blend_begin_time = max( next_info.end_time - database->GetParam().blend_duration, next_info.blend_end_time );
+	next_info.base_segment_no = 0;
+
+	if ( !transition->Init( &curr_info, &next_info, curr_motion_mat, curr_start_time ) )
+		return;
+	next_clip_no = clip_no;
+	transition_count ++;
+}
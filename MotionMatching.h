@@ -0,0 +1,211 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  モーションマッチング（特徴ベクトルの最近傍探索による動作選択）
+**/
+
+#ifndef  _MOTION_MATCHING_H_
+#define  _MOTION_MATCHING_H_
+
+
+// ライブラリ・クラス定義の読み込み
+#include "SimpleHuman.h"
+#include "MotionTransition.h"
+#include "FeatureKDTree.h"
+
+
+//
+//  モーションマッチングの特徴ベクトルの構成
+//  全ての値は、そのフレームの腰の水平位置・水平向きを基準とするローカル座標系で表す
+//
+enum  MotionMatchingFeatureGroup
+{
+	MM_TRAJECTORY_POSITION,   // 未来の腰の水平位置（x, z）× 未来時刻の数
+	MM_TRAJECTORY_DIRECTION,  // 未来の腰の水平向き（x, z）× 未来時刻の数
+	MM_FOOT_POSITION,         // 左右の足の位置（x, y, z）× 2
+	MM_FOOT_VELOCITY,         // 左右の足の速度（x, y, z）× 2
+	MM_HIP_VELOCITY,          // 腰の速度（x, y, z）
+	MM_NUM_FEATURE_GROUPS
+};
+
+// 未来の軌道の時刻の数
+#define  MM_NUM_TRAJECTORY_SAMPLES  3
+
+// 特徴ベクトルの次元数
+#define  MM_FEATURE_DIM  ( MM_NUM_TRAJECTORY_SAMPLES * 4 + 6 + 6 + 3 )
+
+
+//
+//  モーションマッチングのパラメタ
+//
+struct  MotionMatchingParam
+{
+	// 未来の軌道の時刻（現在時刻からの経過時間）
+	float  trajectory_times[ MM_NUM_TRAJECTORY_SAMPLES ];
+
+	// 特徴ベクトルの各グループの重み
+	float  group_weights[ MM_NUM_FEATURE_GROUPS ];
+
+	// 左右の足の体節名
+	const char *  foot_segment_names[ 2 ];
+
+	// 探索を行う間隔（フレーム数）
+	int  search_interval_frames;
+
+	// 遷移時のブレンド時間
+	float  blend_duration;
+
+	// 探索結果が現在の動作のこの時間以内のフレームであれば、現在の動作の再生を継続する（遷移を行わない）
+	float  min_time_gap;
+
+	// 特徴ベクトルの計算に使用するスレッド数（0 以下の場合はハードウェアの並列数）
+	int  num_threads;
+};
+
+// モーションマッチングのパラメタを初期化
+void  InitMotionMatchingParam( MotionMatchingParam & param );
+
+
+//
+//  モーションマッチングの特徴データベースクラス
+//  全動作の全フレーム（未来の軌道が動作内に収まるフレーム）の特徴ベクトルを正規化して kd木に格納する
+//
+class  MotionMatchingDatabase
+{
+  protected:
+	// パラメタ
+	MotionMatchingParam  param;
+
+	// 動作データ
+	vector< Motion * >  clips;
+
+	// 左右の足の体節番号（全動作で骨格モデルが共通であることを前提とする、見つからなければ -1）
+	int  foot_segments[ 2 ];
+
+	// 各次元の正規化のための平均と倍率（正規化後の値 = ( 値 - 平均 ) * 倍率）
+	float  feature_mean[ MM_FEATURE_DIM ];
+	float  feature_scale[ MM_FEATURE_DIM ];
+
+	// 正規化後の特徴ベクトル [特徴番号 * MM_FEATURE_DIM + 次元]
+	vector< float >  features;
+
+	// 各特徴ベクトルの動作番号・フレーム番号 [特徴番号]
+	vector< int >  feature_clips;
+	vector< int >  feature_frames;
+
+	// 特徴ベクトルの最近傍探索のための kd木
+	FeatureKDTree  tree;
+
+  public:
+	// コンストラクタ
+	MotionMatchingDatabase();
+
+  public:
+	// データベースの構築
+	bool  Build( const vector< Motion * > & clips, const MotionMatchingParam & param );
+
+	// 全情報の削除
+	void  Clear();
+
+  public:
+	// 情報取得
+	const MotionMatchingParam &  GetParam() const { return  param; }
+	int  GetNumClips() const { return  (int) clips.size(); }
+	Motion *  GetClip( int no ) const { return  clips[ no ]; }
+	int  GetNumFeatures() const { return  (int) feature_clips.size(); }
+	int  GetFeatureClip( int no ) const { return  feature_clips[ no ]; }
+	int  GetFeatureFrame( int no ) const { return  feature_frames[ no ]; }
+	const float *  GetFeature( int no ) const { return  &features[ (size_t) no * MM_FEATURE_DIM ]; }
+
+	// 未来の軌道に必要なフレーム数を取得
+	int  GetNumFutureFrames( const Motion & motion ) const;
+
+	// 指定動作・フレームの特徴ベクトルを計算（正規化前）
+	void  ComputeFeature( int clip_no, int frame_no, float * feature ) const;
+
+	// 特徴ベクトルを正規化
+	void  NormalizeFeature( const float * feature, float * normalized ) const;
+
+	// 正規化した特徴ベクトルに最も近いフレームを探索（特徴番号を返す、なければ -1）
+	int  FindNearest( const float * normalized, float * distance_sq = NULL ) const;
+};
+
+
+//
+//  モーションマッチングによる動作再生クラス
+//  一定間隔で現在の姿勢と目標の軌道から特徴ベクトルを計算して最も近いフレームを探索し、
+//  動作接続・遷移クラスのブレンディングによって探索したフレームへ遷移する
+//
+class  MotionMatchingController
+{
+  protected:
+	// 特徴データベース
+	const MotionMatchingDatabase *  database;
+
+	// 動作接続・遷移
+	MotionTransition *  transition;
+
+	// 遷移区間を設定した動作情報（現在の動作と次の動作で交互に使用）
+	MotionInfo  motion_infos[ 2 ];
+
+	// 現在の動作が使用している motion_infos の番号
+	int  curr_info_no;
+
+	// 現在の動作の動作番号
+	int  curr_clip_no;
+
+	// 遷移中の次の動作の動作番号（遷移中でなければ -1）
+	int  next_clip_no;
+
+	// 現在の動作の位置・向きに対する変換行列
+	Matrix4f  curr_motion_mat;
+
+	// 現在の動作の再生開始時刻（グローバル時刻）
+	float  curr_start_time;
+
+	// 前回の探索時刻（グローバル時刻）
+	float  last_search_time;
+
+	// 探索回数・遷移回数（情報表示用）
+	int  search_count;
+	int  transition_count;
+
+	// 最後の探索に要した時間（ミリ秒、情報表示用）
+	float  last_search_msec;
+
+  public:
+	// コンストラクタ
+	MotionMatchingController();
+
+	// デストラクタ
+	~MotionMatchingController();
+
+  public:
+	// 初期化（指定動作・フレームから再生を開始）
+	void  Init( const MotionMatchingDatabase * database, int clip_no, int frame_no, float time );
+
+	// 姿勢の更新（目標の移動速度・水平向きはワールド座標系で指定）
+	void  Update( float time, const Vector3f & desired_velocity, float desired_ori, Posture & posture );
+
+  public:
+	// 情報取得
+	int  GetCurrentClip() const { return  curr_clip_no; }
+	int  GetNextClip() const { return  next_clip_no; }
+	int  GetSearchCount() const { return  search_count; }
+	int  GetTransitionCount() const { return  transition_count; }
+	float  GetLastSearchTime() const { return  last_search_msec; }
+
+  protected:
+	// 目標の軌道と現在の姿勢から、正規化した探索用の特徴ベクトルを計算
+	void  ComputeQueryFeature( float local_time, const Vector3f & desired_velocity, float desired_ori, float * query ) const;
+
+	// 指定動作・フレームへの遷移を開始
+	void  StartTransition( float local_time, int clip_no, int frame_no );
+};
+
+
+#endif // _MOTION_MATCHING_H_
@@ -1763,517 +1763,3 @@ void MotionPlaybackApp::ColorBarElementRepGray(Timeline* timeline, int segment_n
 		if(f == 0)
 			timeline->AddElement( 0.0f, name_space, Pattern_Color(pattern, segment_num),  motion.body->segments[segment_num]->name.c_str(), Track_num );
 }
-
-
-//
-//DTW初期化
-//
-void DTWinformation::DTWinformation_init( int frames1, int frames2, const Motion & motion1, const Motion & motion2 )
-{
-	//iが体節、jがフレーム1、kがフレーム2
-	int Num_segments = motion1.body->num_segments;
-	this->Seg_Color = new Color4f[Num_segments];
-	this->Pa_Color = new Color4f[9];
-
-	this->DistanceAll.resize(frames1 + 1, vector<float>(frames2 + 1, 0.0f));
-	this->DistancePart.resize(Num_segments,vector<vector<float>>(frames1 + 1, vector<float>(frames2 + 1, 0.0f)));
-	this->Dis_head.resize(frames1 + 1, vector<float>(frames2 + 1, 0.0f));
-	this->Dis_chest.resize(frames1 + 1, vector<float>(frames2 + 1, 0.0f));
-	this->Dis_head_chest.resize(frames1 + 1, vector<float>(frames2 + 1, 0.0f));
-	this->Dis_right_arm.resize(frames1 + 1, vector<float>(frames2 + 1, 0.0f));
-	this->Dis_left_arm.resize(frames1 + 1, vector<float>(frames2 + 1, 0.0f));
-	this->Dis_arm.resize(frames1 + 1, vector<float>(frames2 + 1, 0.0f));
-	this->Dis_right_leg.resize(frames1 + 1, vector<float>(frames2 + 1, 0.0f));
-	this->Dis_left_leg.resize(frames1 + 1, vector<float>(frames2 + 1, 0.0f));
-	this->Dis_leg.resize(frames1 + 1, vector<float>(frames2 + 1, 0.0f));
-	this->ErrorDisTotalAll = 0.0f;
-	this->ErrorDisTotalPart = new float [Num_segments];
-	this->DisOrder = new int[Num_segments];
-
-	this->AngleAll.resize(frames1 + 1, vector<float>(frames2 + 1, 0.0f));
-	this->AnglePart.resize(Num_segments,vector<vector<float>>(frames1 + 1, vector<float>(frames2 + 1, 0.0f)));
-	this->Ang_head.resize(frames1 + 1, vector<float>(frames2 + 1, 0.0f));
-	this->Ang_chest.resize(frames1 + 1, vector<float>(frames2 + 1, 0.0f));
-	this->Ang_head_chest.resize(frames1 + 1, vector<float>(frames2 + 1, 0.0f));
-	this->Ang_right_arm.resize(frames1 + 1, vector<float>(frames2 + 1, 0.0f));
-	this->Ang_left_arm.resize(frames1 + 1, vector<float>(frames2 + 1, 0.0f));
-	this->Ang_arm.resize(frames1 + 1, vector<float>(frames2 + 1, 0.0f));
-	this->Ang_right_leg.resize(frames1 + 1, vector<float>(frames2 + 1, 0.0f));
-	this->Ang_left_leg.resize(frames1 + 1, vector<float>(frames2 + 1, 0.0f));
-	this->Ang_leg.resize(frames1 + 1, vector<float>(frames2 + 1, 0.0f));
-	this->ErrorAngTotalAll = 0.0f;
-	this->ErrorAngTotalPart = new float[Num_segments];
-	this->AngOrder = new int[Num_segments];
-
-
-	vector< Matrix4f >  seg_frame_array1, seg_frame_array2;
-	vector< Point3f >  joi_pos_array1, joi_pos_array2;
-	Matrix4f  mat1, mat2;
-	vector< vector< Vector3f > > v1(frames1, vector< Vector3f >(Num_segments));
-	vector< vector< Vector3f > > v2(frames2, vector< Vector3f >(Num_segments));
-	vector< vector< Vector3f > > j1(frames1, vector< Vector3f >(Num_segments));
-	vector< vector< Vector3f > > j2(frames2, vector< Vector3f >(Num_segments));
-
-	for(int i = 0; i < Num_segments; i++)
-	{
-		this->DisOrder[i] = i;
-		this->ErrorDisTotalPart[i] = 0.0f;
-		this->AngOrder[i] = i;
-		this->ErrorAngTotalPart[i] = 0.0f;
-	}
-
-	//std::cout << motion1.frames[0].root_ori << std::endl;
-	//for (int i = 0; i < motion1.body->num_joints; i++)
-	//{
-	//	std::cout << i << std::endl;
-	//	std::cout << motion1.frames[0].joint_rotations[i] << std::endl;
-	//}
-
-	//順運動学計算
-	for(int j = 0; j < frames1; j++)
-	{
-		ForwardKinematics( motion1.frames[ j ], seg_frame_array1, joi_pos_array1 );
-		for(int k = 0; k < frames2; k++)
-		{
-			ForwardKinematics( motion2.frames[ k ], seg_frame_array2, joi_pos_array2 );
-			for(int i = 0; i < Num_segments; i++)
-			{
-				//手の部位は計算しない
-				while(i > 16 && i < 36)
-					i++;
-				if(i > 39)
-					break;
-
-				// 体節の中心の位置・向きを基準とする変換行列を適用
-				mat1.set( seg_frame_array1[ i ] );
-				mat1.get(&v1[j][i]);
-
-				mat2.set( seg_frame_array2[ i ] );
-				mat2.get(&v2[k][i]);
-
-				if(i == 0)
-				{
-					j1[j][i] = joi_pos_array1[6] - v1[j][i];
-					j2[k][i] = joi_pos_array2[6] - v2[k][i];
-				}
-				else if(i == 10)
-				{
-					j1[j][i] = joi_pos_array1[10] - joi_pos_array1[9];
-					j2[k][i] = joi_pos_array2[10] - joi_pos_array2[9];
-				}
-				else if(i == 3 || i == 6 || i == 12 || i == 16 || i == 39)
-				{
-					j1[j][i] = v1[j][i] - joi_pos_array1[i - 1];
-					j2[k][i] = v2[k][i] - joi_pos_array2[i - 1];
-				}
-				else
-				{
-					j1[j][i] = joi_pos_array1[i] - joi_pos_array1[i - 1];
-					j2[k][i] = joi_pos_array2[i] - joi_pos_array2[i - 1];
-				}
-			}
-		}
-	}
-
-	//for(int i = 0; i < Num_segments; i++ )
-	//{
-	//	std::cout << "segment:" << i << "->" << v1[frames1-1][i] << std::endl;
-	//	if (i < Num_segments - 1)
-	//		std::cout << "joint:" << i << "->" <<joi_pos_array1[i] << std::endl;
-	//}
-
-	//位置誤差の計算
-	for(int j = 0; j <= frames1; j++)
-	{
-		for(int k = 0; k <= frames2; k++)
-		{
-			for(int i = 0; i < Num_segments; i++)
-			{
-				//手の部位は計算しない
-				while (i > 16 && i < 36)
-					i++;
-				if (i > 39)
-					break;
-
-				if(j == frames1 || k == frames2)
-				{
-					this->DistanceAll[j][k] =100.0f;
-					this->DistancePart[i][j][k] = 100.0f;
-					this->Dis_head[j][k] = 100.0f;
-					this->Dis_chest[j][k] = 100.0f;
-					this->Dis_head_chest[j][k] = 100.0f;
-					this->Dis_right_arm[j][k] = 100.0f;
-					this->Dis_left_arm[j][k] = 100.0f;
-					this->Dis_leg[j][k] = 100.0f;
-					this->Dis_right_leg[j][k] = 100.0f;
-					this->Dis_left_leg[j][k] = 100.0f;
-					this->Dis_arm[j][k] = 100.0f;
-					break;
-				}
-				else
-				{
-					this->DistancePart[i][j][k] = 
-						sqrt(pow(v1[j][i].x - v2[k][i].x, 2.0) +
-						pow(v1[j][i].y - v2[k][i].y, 2.0) + 
-						pow(v1[j][i].z - v2[k][i].z, 2.0));
-
-					this->DistanceAll[j][k] += this->DistancePart[i][j][k];
-					if (i == 11 || i == 12)
-					{
-						this->Dis_head[j][k] += this->DistancePart[i][j][k];
-						this->Dis_head_chest[j][k] += this->DistancePart[i][j][k];
-					}
-					else if (i == 0 || (i >= 7 && i <= 10))
-					{
-						this->Dis_chest[j][k] += this->DistancePart[i][j][k];
-						this->Dis_head_chest[j][k] += this->DistancePart[i][j][k];
-					}
-					else if (i >= 13 && i <= 16)
-					{
-						this->Dis_right_arm[j][k] += this->DistancePart[i][j][k];
-						this->Dis_arm[j][k] += this->DistancePart[i][j][k];
-					}
-					else if (i >= 36 && i <= 39)
-					{
-						this->Dis_left_arm[j][k] += this->DistancePart[i][j][k];
-						this->Dis_arm[j][k] += this->DistancePart[i][j][k];
-					}
-					else if (i >= 1 && i <= 3)
-					{
-						this->Dis_right_leg[j][k] += this->DistancePart[i][j][k];
-						this->Dis_leg[j][k] += this->DistancePart[i][j][k];
-					}
-					else if (i >= 4 && i <= 6)
-					{
-						this->Dis_left_leg[j][k] += this->DistancePart[i][j][k];
-						this->Dis_leg[j][k] += this->DistancePart[i][j][k];
-					}
-				}
-			}
-		}
-	}
-
-	//角度誤差の計算
-	for(int j = 0; j <= frames1; j++)
-	{
-		for(int k = 0; k <= frames2; k++)
-		{
-			for(int i = 0; i < Num_segments; i++)
-			{
-				//手の部位は計算しない
-				while (i > 16 && i < 36)
-					i++;
-				if (i > 39)
-					break;
-
-				if(j == frames1 || k == frames2)
-				{
-					this->AngleAll[j][k] = 100.0f;
-					this->AnglePart[i][j][k] = 100.0f;
-					this->Ang_head[j][k] = 100.0f;
-					this->Ang_chest[j][k] = 100.0f;
-					this->Ang_head_chest[j][k] = 100.0f;
-					this->Ang_right_arm[j][k] = 100.0f;
-					this->Ang_left_arm[j][k] = 100.0f;
-					this->Ang_leg[j][k] = 100.0f;
-					this->Ang_right_leg[j][k] = 100.0f;
-					this->Ang_left_leg[j][k] = 100.0f;
-					this->Ang_arm[j][k] = 100.0f;
-					break;
-				}
-				else
-				{
-					this->AnglePart[i][j][k] = 
-						(j1[j][i].z * j2[k][i].z + j1[j][i].z * j2[k][i].z + j1[j][i].z * j2[k][i].z) /
-						(sqrt(pow(j1[j][i].x, 2.0) + pow(j1[j][i].y, 2.0) + pow(j1[j][i].z, 2.0)) *
-						sqrt(pow(j2[k][i].x, 2.0) + pow(j2[k][i].y, 2.0) + pow(j2[k][i].z, 2.0)));
-					//this->AnglePart[i][j][k] *= -0.5;
-					//this->AnglePart[i][j][k] += 0.5f;
-					this->AnglePart[i][j][k] += 1.0f;
-					this->AnglePart[i][j][k] = 2.0f - this->AnglePart[i][j][k];
-					this->AnglePart[i][j][k] /= 2.0f;
-
-					this->AngleAll[j][k] += this->AnglePart[i][j][k];
-					if (i == 11 || i == 12)
-					{
-						this->Ang_head[j][k] += this->AnglePart[i][j][k];
-						this->Ang_head_chest[j][k] += this->AnglePart[i][j][k];
-					}
-					else if (i == 0 || (i >= 7 && i <= 10))
-					{
-						this->Ang_chest[j][k] += this->AnglePart[i][j][k];
-						this->Ang_head_chest[j][k] += this->AnglePart[i][j][k];
-					}
-					else if (i >= 13 && i <= 16)
-					{
-						this->Ang_right_arm[j][k] += this->AnglePart[i][j][k];
-						this->Ang_arm[j][k] += this->AnglePart[i][j][k];
-					}
-					else if (i >= 36 && i <= 39)
-					{
-						this->Ang_left_arm[j][k] += this->AnglePart[i][j][k];
-						this->Ang_arm[j][k] += this->AnglePart[i][j][k];
-					}
-					else if (i >= 1 && i <= 3)
-					{
-						this->Ang_right_leg[j][k] += this->AnglePart[i][j][k];
-						this->Ang_leg[j][k] += this->AnglePart[i][j][k];
-					}
-					else if (i >= 4 && i <= 6)
-					{
-						this->Ang_left_leg[j][k] += this->AnglePart[i][j][k];
-						this->Ang_leg[j][k] += this->AnglePart[i][j][k];
-					}
-				}
-			}
-		}
-	}
-
-	//std::cout << "start"<< std::endl;
-	//for(int k = 0; k <= frames2; k++)
-	//{
-	//		for (int j = 0; j <= frames1; j++)
-	//			if(j != frames1)
-	//				std::cout << std::fixed << std::setprecision(4) << this->DistanceAll[j][k] << ",";
-	//			else
-	//				std::cout << std::fixed << std::setprecision(4) << this->DistanceAll[j][k] << std::endl;
-	//}
-
-	//位置誤差の全体に対するパスの作成
-	int f1 = frames1 - 1, f2 = frames2 - 1;
-	this->DisPassAll.resize(2, vector<int>());
-	float dis1, dis2, dis3;
-	
-	for(int j = 0; j < frames1; j++)
-		for (int k = 0; k < frames2; k++)
-			DistanceAll[j][k] += DisCostAcummurate(j, k);
-
-	while (f1 >= 0 && f2 >= 0)
-	{
-		if (f1 == 0 && f2 == 0)
-			break;
-		else if(f1 == 0 && f2 != 0)
-		{
-			this->DisPassAll[0].push_back(f1);
-			this->DisPassAll[1].push_back(--f2);
-		}
-		else if (f1 != 0 && f2 == 0)
-		{
-			this->DisPassAll[0].push_back(--f1);
-			this->DisPassAll[1].push_back(f2);
-		}
-		else
-		{
-			dis1 = this->DistanceAll[f1 - 1][f2 - 1];
-			dis2 = this->DistanceAll[f1 - 1][f2];
-			dis3 = this->DistanceAll[f1][f2 - 1];
-			if (dis1 > dis2 || dis1 > dis3)
-				if (dis2 > dis3)
-				{
-					this->DisPassAll[0].push_back(f1);
-					this->DisPassAll[1].push_back(--f2);
-				}
-				else
-				{
-					this->DisPassAll[0].push_back(--f1);
-					this->DisPassAll[1].push_back(f2);
-				}
-			else
-			{
-				this->DisPassAll[0].push_back(--f1);
-				this->DisPassAll[1].push_back(--f2);
-			}
-		}
-	}
-	std::reverse(this->DisPassAll[0].begin(), this->DisPassAll[0].end());
-	std::reverse(this->DisPassAll[1].begin(), this->DisPassAll[1].end());
-	this->DisFrame = DisPassAll[0].size();
-
-	//角度誤差の全体に対するパスの作成
-	f1 = frames1 - 1, f2 = frames2 - 1;
-	this->AngPassAll.resize(2, vector<int>());
-
-	for(int j = 0; j < frames1; j++)
-		for (int k = 0; k < frames2; k++)
-			AngleAll[j][k] += AngCostAcummurate(j, k);
-
-	float ang1, ang2, ang3;
-	while (f1 >= 0 && f2 >= 0)
-	{
-		if (f1 == 0 && f2 == 0)
-			break;
-		else if(f1 == 0 && f2 != 0)
-		{
-			this->AngPassAll[0].push_back(f1);
-			this->AngPassAll[1].push_back(--f2);
-		}
-		else if (f1 != 0 && f2 == 0)
-		{
-			this->AngPassAll[0].push_back(--f1);
-			this->AngPassAll[1].push_back(f2);
-		}
-		else
-		{
-			ang1 = this->AngleAll[f1 - 1][f2 - 1];
-			ang2 = this->AngleAll[f1 - 1][f2];
-			ang3 = this->AngleAll[f1][f2 - 1];
-			if (ang1 > ang2 || ang1 > ang3)
-				if (ang2 > ang3)
-				{
-					this->AngPassAll[0].push_back(f1);
-					this->AngPassAll[1].push_back(--f2);
-				}
-				else
-				{
-					this->AngPassAll[0].push_back(--f1);
-					this->AngPassAll[1].push_back(f2);
-				}
-			else
-			{
-				this->AngPassAll[0].push_back(--f1);
-				this->AngPassAll[1].push_back(--f2);
-			}
-		}
-	}
-	std::reverse(this->AngPassAll[0].begin(), this->AngPassAll[0].end());
-	std::reverse(this->AngPassAll[1].begin(), this->AngPassAll[1].end());
-	this->AngFrame = AngPassAll[0].size();
-
-	//位置誤差のパスの表示
-	std::cout << "DistancePass"<< std::endl;
-	for(int f = 0; f < this->DisFrame; f++)
-		std::cout <<  f << "[" << this->DisPassAll[0][f] << "," <<
-		this->DisPassAll[1][f] << "]" << std::endl;
-	std::cout << "motion1.num_frames:" << frames1 << std::endl <<
-		"motion2.num_frames:" << frames2 << std::endl;
-
-	//角度誤差のパスの表示
-	std::cout << "AnglePass" << std::endl;
-	for (int f = 0; f < this->AngFrame; f++)
-		std::cout << f << "[" << this->AngPassAll[0][f] << "," <<
-		this->AngPassAll[1][f] << "]" << std::endl;
-	std::cout << "motion1.num_frames:" << frames1 << std::endl <<
-		"motion2.num_frames:" << frames2 << std::endl;
-
-	//部位毎の位置誤差の合計値を取る
-	for(int i = 0; i < Num_segments; i++)
-	{
-		//手の部位は計算しない
-		while (i > 16 && i < 36)
-			i++;
-		if (i > 39)
-			break;
-
-		for(int f = 0; f < this->DisFrame; f++)
-			this->ErrorDisTotalPart[i] += this->DistancePart[i][DisPassAll[0][f]][DisPassAll[1][f]];
-	}
-
-	//部位毎の角度誤差の合計値を取る
-	for (int i = 0; i < Num_segments; i++)
-	{
-		//手の部位は計算しない
-		while (i > 16 && i < 36)
-			i++;
-		if (i > 39)
-			break;
-
-		for (int f = 0; f < this->AngFrame; f++)
-			this->ErrorAngTotalPart[i] += this->AnglePart[i][AngPassAll[0][f]][AngPassAll[1][f]];
-	}
-
-	//誤差の大きい順にDisorderを並べ替える
-	for(int i = 0; i < Num_segments - 1; i++)
-		for(int j = i; j < Num_segments; j++)
-			if(this->ErrorDisTotalPart[i] < this->ErrorDisTotalPart[j])
-				std::swap(this->DisOrder[i], this->DisOrder[j]);
-
-	//誤差の大きい順にAngorderを並べ替える
-	for (int i = 0; i < Num_segments - 1; i++)
-		for (int j = i; j < Num_segments; j++)
-			if (this->ErrorAngTotalPart[i] < this->ErrorAngTotalPart[j])
-				std::swap(this->AngOrder[i], this->AngOrder[j]);
-
-	//位置誤差の合計を加算
-	std::cout << "ErrorDisTotalPart:" << std::endl;
-	for(int i = 0; i < Num_segments; i++)
-	{
-		//手の部位は計算しない
-		while (i > 16 && i < 36)
-			i++;
-		if (i > 39)
-			break;
-
-		//全部位の誤差の合計を計算
-		this->ErrorDisTotalAll += this->ErrorDisTotalPart[i];
-
-		std::cout << " [ " << this->DisOrder[i] << " segment: " << 
-			this->ErrorDisTotalPart[this->DisOrder[i]] << " ] ";
-	}
-	std::cout << std::endl;
-
-	//角度誤差の合計を加算
-	std::cout << "ErrorAngTotalPart:" << std::endl;
-	for (int i = 0; i < Num_segments; i++)
-	{
-		//手の部位は計算しない
-		while (i > 16 && i < 36)
-			i++;
-		if (i > 39)
-			break;
-		//全部位の誤差の合計を計算
-		this->ErrorAngTotalAll += this->ErrorAngTotalPart[i];
-		std::cout << " [ " << this->AngOrder[i] << " segment: " <<
-			this->ErrorAngTotalPart[this->AngOrder[i]] << " ] ";
-	}
-	std::cout << std::endl;
-}
-
-float DTWinformation::DisCostAcummurate(int j, int k)
-{
-	if(j == 0 && k == 0)
-		return 0.0f;
-	else if(j == 0 && k != 0)
-		return DistanceAll[j][k - 1];
-	else if(j != 0 && k == 0)
-		return DistanceAll[j - 1][k];
-	else
-		return min(min(DistanceAll[j][k - 1], DistanceAll[j - 1][k]), DistanceAll[j - 1][k - 1]);
-}
-
-float DTWinformation::AngCostAcummurate(int j, int k)
-{
-	if(j == 0 && k == 0)
-		return 0.0f;
-	else if(j == 0 && k != 0)
-		return AngleAll[j][k - 1];
-	else if(j != 0 && k == 0)
-		return AngleAll[j - 1][k];
-	else
-		return min(min(AngleAll[j][k - 1], AngleAll[j - 1][k]), AngleAll[j - 1][k - 1]);
-}
-
-//mat1.get(&rot1);
-//e1[j][i].x = asin(rot1.m12);
-//if (cos(e1[j][i].x) != 0.0f)
-//{
-//	e1[j][i].z = atan2(rot1.m02, rot1.m22);
-//	e1[j][i].z = atan2(rot1.m10, rot1.m11);
-//}
-//else
-//{
-//	e1[j][i].z = atan2(-rot1.m20, rot1.m00);
-//	e1[j][i].z = 0.0f;
-//}
-
-//mat2.get(&rot2);
-//e2[k][i].x = asin(rot2.m12);
-//if (cos(e2[k][i].x) != 0.0f)
-//{
-//	e2[k][i].z = atan2(rot2.m02, rot2.m22);
-//	e2[k][i].z = atan2(rot2.m10, rot2.m11);
-//}
-//else
-//{
-//	e2[k][i].z = atan2(-rot2.m20, rot2.m00);
-//	e2[k][i].z = 0.0f;
-//}
\ No newline at end of file
@@ -15,107 +15,13 @@
 // ライブラリ・クラス定義の読み込み
 #include "SimpleHuman.h"
 #include "SimpleHumanGLUT.h"
+#include "MotionPlaybackDTW.h"
 #include "Timeline.h"
 
 
 // プロトタイプ宣言
-struct DTWinformation;
 struct DTWinformation2;
 
-//
-//MotionPlaybackAppクラスの前方宣言
-//
-
-struct DTWinformation
-{
-	public:
-
-		//位置誤差対応パス作成後のフレーム数
-		int DisFrame;
-
-		//角度誤差対応パス作成後のフレーム数
-		int AngFrame;
-
-		//全体の位置誤差対応パス
-		vector< vector< int > > DisPassAll;
-
-		//全体の角度誤差対応パス
-		vector< vector< int > > AngPassAll;
-
-		//パス対応された各フレームの位置誤差(部位毎)
-		vector< vector< vector<float > > > DistancePart;
-
-		//パス対応された各フレームの角度誤差(部位毎)
-		vector< vector< vector<float > > > AnglePart;
-
-		//パス対応された各フレームの位置誤差(全体)
-		vector< vector< float > > DistanceAll;
-
-		//パス対応された各フレームの角度誤差(全体)
-		vector< vector<float > > AngleAll;
-
-		//体節の順番を位置誤差の大きさ順に並べ替えた値
-		int * DisOrder;
-
-		//体節の順番を角度誤差の大きさ順に並べ替えた値
-		int * AngOrder;
-
-		//全体の位置誤差値の合計
-		float ErrorDisTotalAll;
-
-		//部位毎の位置誤差値の合計
-		float * ErrorDisTotalPart;
-
-		//全体の角度誤差値の合計
-		float ErrorAngTotalAll;
-
-		//部位毎の角度誤差値の合計
-		float * ErrorAngTotalPart;
-
-		//頭部の誤差
-		vector< vector< float > > Dis_head, Ang_head;
-
-		//胸部の誤差
-		vector< vector< float > > Dis_chest, Ang_chest;
-
-		//頭部と胸部の誤差
-		vector< vector< float > > Dis_head_chest, Ang_head_chest;
-
-		//右腕の誤差
-		vector< vector< float > > Dis_right_arm, Ang_right_arm;
-
-		//左腕の誤差
-		vector< vector< float > > Dis_left_arm, Ang_left_arm;
-
-		//腕全体の誤差
-		vector< vector< float > > Dis_arm, Ang_arm;
-
-		//右脚の誤差
-		vector< vector< float > > Dis_right_leg, Ang_right_leg;
-
-		//左脚の誤差
-		vector< vector< float > > Dis_left_leg, Ang_left_leg;
-
-		//脚全体の誤差
-		vector< vector< float > > Dis_leg, Ang_leg;
-
-		//体節ごとのリアルタイムでの誤差の色相(パターン5で使用)
-		Color4f * Seg_Color;
-
-		//パターンごとのリアルタイムでの誤差の色相(パターン1-4で使用)
-		//0-head,1-chest,2-head_chest,3-r_arm,4-l_arm,5-arm,6-r_leg,7-l_leg,8-leg
-		Color4f * Pa_Color;
-
-	public:
-		//DTW初期化
-		void DTWinformation_init( int frames1, int frames2, const Motion & motion1, const Motion & motion2 );	
-
-		//累積コストの計算
-		float DisCostAcummurate(int j, int k);
-
-		//累積コストの計算
-		float AngCostAcummurate(int j, int k);
-};
 
 //  動作再生アプリケーションクラス
 class  MotionPlaybackApp : public GLUTBaseApp
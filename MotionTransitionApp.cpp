@@ -13,6 +13,8 @@
 #include "SimpleHuman.h"
 #include "MotionTransition.h"
 #include "MotionTransitionApp.h"
+#include "MotionGraph.h"
+#include "MotionMatching.h"
 #include "BVH.h"
 #include "Timeline.h"
 
@@ -20,6 +22,12 @@
 #define  _USE_MATH_DEFINES
 #include <math.h>
 
+// 標準ライブラリの読み込み
+#include <algorithm>
+
+
+// モーショングラフの保存ファイル名
+static const char *  motion_graph_file_name = "sample_motions.mgr";
 
 
 //
@@ -108,6 +116,19 @@ MotionTransitionApp::MotionTransitionApp()
 	transition = NULL;
 	enable_transition = true;
 
+	motion_graph = NULL;
+	enable_motion_graph = false;
+	graph_motion_infos[ 0 ] = NULL;
+	graph_motion_infos[ 1 ] = NULL;
+	graph_curr_info_no = -1;
+	graph_next_info_no = -1;
+
+	mm_database = NULL;
+	mm_controller = NULL;
+	enable_motion_matching = false;
+	mm_desired_ori = 0.0f;
+	mm_desired_speed = 0.0f;
+
 	curr_posture = NULL;
 	on_animation = true;
 	animation_time = 0.0f;
@@ -133,6 +154,17 @@ MotionTransitionApp::~MotionTransitionApp()
 	if ( transition )
 		delete  transition;
 
+	if ( motion_graph )
+		delete  motion_graph;
+	for ( int i = 0; i < 2; i++ )
+		if ( graph_motion_infos[ i ] )
+			delete  graph_motion_infos[ i ];
+
+	if ( mm_controller )
+		delete  mm_controller;
+	if ( mm_database )
+		delete  mm_database;
+
 	if ( curr_posture->body )
 		delete  curr_posture->body;
 	if ( curr_posture )
@@ -166,6 +198,12 @@ void  MotionTransitionApp::Initialize()
 		InitPosture( *curr_posture, body );
 	}
 
+	// モーショングラフの初期化
+	InitMotionGraph();
+
+	// モーションマッチングの特徴データベースの初期化
+	InitMotionMatching();
+
 	// タイムライン描画機能の初期化
 	timeline = new Timeline();
 }
@@ -190,6 +228,10 @@ void  MotionTransitionApp::Start()
 	next_motion_no = -1;
 	waiting_motion_no = 0;
 
+	// モーショングラフによる遷移区間の変更を初期化
+	graph_curr_info_no = -1;
+	graph_next_info_no = -1;
+
 	// 動作接続・遷移機能の生成
 	if ( transition )
 		delete  transition;
@@ -211,6 +253,19 @@ void  MotionTransitionApp::Start()
 	curr_motion_mat.set( init_ori, init_pos, 1.0f );
 	curr_start_time = animation_time;
 
+	// モーションマッチングを使用する場合は、先頭の動作の先頭フレームから再生を開始
+	// 目標の水平向き・移動速度は、先頭の動作の開始時の水平向き・平均の移動速度とする
+	if ( enable_motion_matching && mm_controller && curr_motion_info )
+	{
+		const Motion &  motion = *curr_motion_info->motion;
+		const Posture &  first = motion.frames[ 0 ];
+		const Posture &  last = motion.frames[ motion.num_frames - 1 ];
+		Vector3f  move( last.root_pos.x - first.root_pos.x, 0.0f, last.root_pos.z - first.root_pos.z );
+		mm_desired_ori = ComputeOrientationAngle( first.root_ori );
+		mm_desired_speed = ( motion.GetDuration() > 0.0f ) ? move.length() / motion.GetDuration() : 0.0f;
+		mm_controller->Init( mm_database, curr_motion_no, 0, animation_time );
+	}
+
 	// アニメーション処理（開始時の姿勢の取得）
 	Animation( 0.0f );
 }
@@ -236,7 +291,7 @@ void  MotionTransitionApp::Display()
 		timeline->DrawTimeline();
 
 	// 現在のモード、現在・次の再生動作、アニメーション再生時間、動作接続・遷移の設定を表示
-	char  message[ 64 ];
+	char  message[ 128 ];
 	DrawTextInformation( 0, "Motion Transition" );
 	if ( curr_motion_no != -1 )
 	{
@@ -250,6 +305,19 @@ void  MotionTransitionApp::Display()
 	DrawTextInformation( 2, message );
 	if ( !enable_transition )
 		DrawTextInformation( 3, "Transition: Off" );
+	if ( enable_motion_graph && motion_graph )
+	{
+		sprintf( message, "Motion Graph: On (%d transitions)", motion_graph->GetNumTransitions() );
+		DrawTextInformation( 4, message );
+	}
+	if ( enable_motion_matching && mm_controller )
+	{
+		sprintf( message, "Motion Matching: On (%d searches, %d transitions, %.3f ms)", 
+			mm_controller->GetSearchCount(), mm_controller->GetTransitionCount(), mm_controller->GetLastSearchTime() );
+		DrawTextInformation( 5, message );
+		sprintf( message, "Direction: %.0f  Speed: %.2f", mm_desired_ori, mm_desired_speed );
+		DrawTextInformation( 6, message );
+	}
 }
 
 
@@ -318,6 +386,20 @@ void  MotionTransitionApp::Keyboard( unsigned char key, int mx, int my )
 		enable_transition = !enable_transition;
 		Start();
 	}
+
+	// g キーでモーショングラフの使用の有無を変更
+	if ( ( key == 'g' ) && motion_graph )
+	{
+		enable_motion_graph = !enable_motion_graph;
+		Start();
+	}
+
+	// f キーで動作リストからの動作選択の代わりにモーションマッチング（特徴ベクトルの探索）を使用するかどうかを変更
+	if ( ( key == 'f' ) && mm_controller )
+	{
+		enable_motion_matching = !enable_motion_matching;
+		Start();
+	}
 }
 
 
@@ -326,6 +408,20 @@ void  MotionTransitionApp::Keyboard( unsigned char key, int mx, int my )
 //
 void  MotionTransitionApp::KeyboardSpecial( unsigned char key, int mx, int my )
 {
+	// モーションマッチングを使用する場合は、カーソル左右キーで目標の水平向きを変更
+	if ( enable_motion_matching )
+	{
+		if ( key == GLUT_KEY_LEFT )
+			mm_desired_ori += 30.0f;
+		if ( key == GLUT_KEY_RIGHT )
+			mm_desired_ori -= 30.0f;
+		if ( mm_desired_ori > 180.0f )
+			mm_desired_ori -= 360.0f;
+		if ( mm_desired_ori < -180.0f )
+			mm_desired_ori += 360.0f;
+		return;
+	}
+
 	// カーソル上キーが押されたら、次の再生動作を変更
 	if ( key == GLUT_KEY_UP )
 	{
@@ -343,8 +439,11 @@ void  MotionTransitionApp::Animation( float delta )
 	if ( !on_animation )
 		return;
 
-	//  動作再生処理（動作接続・遷移を考慮）
-	AnimationWithMotionTransition( delta );
+	//  動作再生処理（モーションマッチング、もしくは、動作接続・遷移を考慮）
+	if ( enable_motion_matching && mm_controller )
+		AnimationWithMotionMatching( delta );
+	else
+		AnimationWithMotionTransition( delta );
 
 	// 注視点を更新
 	view_center.set( curr_posture->root_pos.x, 0.0f, curr_posture->root_pos.z );
@@ -376,14 +475,15 @@ void  MotionTransitionApp::SetNextMotion( int no )
 void  MotionTransitionApp::AnimationWithMotionTransition( float delta )
 {
 	// 現在の動作の情報を取得
+	//（モーショングラフにより遷移区間を変更した動作情報があれば、そちらを使用）
 	MotionInfo *  curr_motion_info = NULL;
 	if ( curr_motion_no!= -1 )
-		curr_motion_info = motion_list[ curr_motion_no ];
+		curr_motion_info = ( graph_curr_info_no != -1 ) ? graph_motion_infos[ graph_curr_info_no ] : motion_list[ curr_motion_no ];
 
 	// 次の動作の情報を取得
 	MotionInfo *  next_motion_info = NULL;
 	if ( next_motion_no != -1 )
-		next_motion_info = motion_list[ next_motion_no ];
+		next_motion_info = ( graph_next_info_no != -1 ) ? graph_motion_infos[ graph_next_info_no ] : motion_list[ next_motion_no ];
 
 	// 次の動作が未設定であれば、実行待ち動作を次の動作とする
 	else if ( waiting_motion_no != -1 )
@@ -394,6 +494,10 @@ void  MotionTransitionApp::AnimationWithMotionTransition( float delta )
 
 		// 実行待ちの動作を初期化
 		waiting_motion_no = -1;
+
+		// モーショングラフを使用する場合は、固定のキー時刻の代わりに遷移候補のフレームで遷移する
+		if ( enable_motion_graph && motion_graph && curr_motion_info )
+			SelectGraphTransition( curr_motion_info, next_motion_info );
 	}
 
 	// 動作接続・遷移の初期化
@@ -438,9 +542,11 @@ void  MotionTransitionApp::AnimationWithMotionTransition( float delta )
 
 		// 現在の動作を次の動作に切り替え
 		curr_motion_no = next_motion_no;
+		graph_curr_info_no = graph_next_info_no;
 
 		// 次の動作を初期化
 		next_motion_no = -1;
+		graph_next_info_no = -1;
 
 		// 実行待ち動作が未設定であれば、現在の動作を繰り返すように設定する
 		if ( waiting_motion_no == -1 )
@@ -452,6 +558,147 @@ void  MotionTransitionApp::AnimationWithMotionTransition( float delta )
 }
 
 
+//
+//  モーショングラフの初期化（保存済みのファイルがあれば読み込み、なければ構築して保存）
+//
+void  MotionTransitionApp::InitMotionGraph()
+{
+	if ( motion_list.size() == 0 )
+		return;
+
+	// 動作リストの順番をモーショングラフの動作番号とする
+	vector< const Motion * >  clips;
+	for ( int i = 0; i < (int)motion_list.size(); i++ )
+		clips.push_back( motion_list[ i ]->motion );
+
+	if ( !motion_graph )
+		motion_graph = new MotionGraph();
+
+	// 保存済みのモーショングラフが現在の動作リストと一致すれば使用
+	if ( motion_graph->LoadFromFile( motion_graph_file_name, clips ) )
+		return;
+
+	// モーショングラフを構築して保存
+	MotionGraphParam  param;
+	InitMotionGraphParam( param );
+	if ( motion_graph->Build( clips, param ) )
+		motion_graph->SaveToFile( motion_graph_file_name );
+}
+
+
+//
+//  モーションマッチングの特徴データベースの初期化
+//
+void  MotionTransitionApp::InitMotionMatching()
+{
+	if ( motion_list.size() == 0 )
+		return;
+
+	// 動作リストの順番を特徴データベースの動作番号とする
+	vector< Motion * >  clips;
+	for ( int i = 0; i < (int)motion_list.size(); i++ )
+		clips.push_back( motion_list[ i ]->motion );
+
+	if ( !mm_database )
+		mm_database = new MotionMatchingDatabase();
+
+	// 特徴データベースを構築（構築できなければモーションマッチングは使用しない）
+	MotionMatchingParam  param;
+	InitMotionMatchingParam( param );
+	if ( !mm_database->Build( clips, param ) )
+	{
+		delete  mm_database;
+		mm_database = NULL;
+		return;
+	}
+
+	if ( !mm_controller )
+		mm_controller = new MotionMatchingController();
+}
+
+
+//
+//  動作再生処理（モーションマッチング）
+//
+void  MotionTransitionApp::AnimationWithMotionMatching( float delta )
+{
+	// アニメーションの時間を進める
+	animation_time += delta * animation_speed;
+
+	// 目標の水平向き・移動速度から目標の速度（ワールド座標系）を計算
+	float  angle = mm_desired_ori * M_PI / 180.0f;
+	Vector3f  desired_velocity( sin( angle ) * mm_desired_speed, 0.0f, cos( angle ) * mm_desired_speed );
+
+	// 探索したフレームへの遷移を考慮して姿勢を計算
+	mm_controller->Update( animation_time, desired_velocity, mm_desired_ori, *curr_posture );
+
+	// 現在の動作・遷移中の次の動作を表示用の動作番号とし、描画色を設定
+	curr_motion_no = mm_controller->GetCurrentClip();
+	next_motion_no = mm_controller->GetNextClip();
+	if ( ( curr_motion_no >= 0 ) && ( curr_motion_no < (int)motion_list.size() ) )
+		figure_color = motion_list[ curr_motion_no ]->color;
+	transition_count = mm_controller->GetTransitionCount();
+
+	// タイムラインへの現在時刻・時間範囲の設定
+	UpdateTimeline( *timeline, animation_time );
+}
+
+
+//
+//  モーショングラフから現在の動作から次の動作への遷移候補を選択し、遷移区間を変更した動作情報を設定
+// （現在時刻以降で最初の遷移候補を選択し、なければ動作情報は変更しない）
+//
+bool  MotionTransitionApp::SelectGraphTransition( MotionInfo * & curr_motion_info, MotionInfo * & next_motion_info )
+{
+	if ( !motion_graph || !curr_motion_info || !next_motion_info || ( curr_motion_no == -1 ) || ( next_motion_no == -1 ) )
+		return  false;
+
+	const Motion *  curr_motion = curr_motion_info->motion;
+	const Motion *  next_motion = next_motion_info->motion;
+
+	// 現在の動作の再生中のフレーム番号（次のフレーム以降を遷移元とする）
+	float  curr_local_time = animation_time - curr_start_time + curr_motion_info->begin_time;
+	int  src_frame = (int) ceil( curr_local_time / curr_motion->interval ) + 1;
+
+	// 次の動作への遷移候補を検索
+	int  trans_no = motion_graph->FindNextTransition( curr_motion_no, src_frame, next_motion_no );
+	if ( trans_no == -1 )
+		return  false;
+	const MotionGraphTransition &  trans = motion_graph->GetTransition( trans_no );
+	float  blend_duration = motion_graph->GetParam().blend_duration;
+
+	// 現在の動作情報を複製（既に複製を使用中であれば、そのまま変更）し、遷移元のフレームでブレンドを開始するように変更
+	int  curr_info_no = ( graph_curr_info_no != -1 ) ? graph_curr_info_no : 0;
+	int  next_info_no = 1 - curr_info_no;
+	for ( int i = 0; i < 2; i++ )
+		if ( !graph_motion_infos[ i ] )
+			graph_motion_infos[ i ] = new MotionInfo();
+
+	MotionInfo &  curr_info = *graph_motion_infos[ curr_info_no ];
+	if ( graph_curr_info_no == -1 )
+		curr_info = *curr_motion_info;
+	curr_info.blend_begin_time = trans.src_frame * curr_motion->interval;
+	curr_info.end_time = min( curr_info.blend_begin_time + blend_duration, curr_motion->GetDuration() );
+	curr_info.blend_end_time = min( curr_info.blend_end_time, curr_info.blend_begin_time );
+
+	// 次の動作情報を複製し、遷移先のフレームから開始するように変更
+	MotionInfo &  next_info = *graph_motion_infos[ next_info_no ];
+	next_info = *motion_list[ next_motion_no ];
+	next_info.begin_time = trans.dest_frame * next_motion->interval;
+	next_info.blend_end_time = min( next_info.begin_time + blend_duration, next_motion->GetDuration() );
+	next_info.blend_begin_time = max( next_info.blend_begin_time, next_info.blend_end_time );
+	next_info.end_time = max( next_info.end_time, next_info.blend_begin_time );
+
+	// 変更した動作情報を使用
+	graph_curr_info_no = curr_info_no;
+	graph_next_info_no = next_info_no;
+	curr_motion_info = &curr_info;
+	next_motion_info = &next_info;
+
+	return  true;
+}
+
+
 //
 //  タイムラインへの現在動作・次の動作・遷移区間の設定
 //
@@ -20,6 +20,9 @@
 // プロトタイプ宣言
 struct  MotionInfo;
 class  MotionTransition;
+class  MotionGraph;
+class  MotionMatchingDatabase;
+class  MotionMatchingController;
 class  Timeline;
 
 
@@ -58,6 +61,38 @@ class  MotionTransitionApp : public GLUTBaseApp
 	// 動作遷移（前後の動作のブレンディング）を適用するかどうかの設定
 	bool  enable_transition;
 
+  protected:
+	// モーショングラフによる動作遷移のための変数
+
+	// モーショングラフ（動作データ間の遷移候補）
+	MotionGraph *  motion_graph;
+
+	// 固定のキー時刻の代わりに、モーショングラフの遷移候補を使用するかどうかの設定
+	bool  enable_motion_graph;
+
+	// モーショングラフの遷移候補に合わせて遷移区間を変更した動作情報（現在の動作と次の動作で交互に使用）
+	MotionInfo *  graph_motion_infos[ 2 ];
+
+	// 現在の動作・次の動作が使用している graph_motion_infos の番号（使用していなければ -1）
+	int  graph_curr_info_no;
+	int  graph_next_info_no;
+
+  protected:
+	// モーションマッチングによる動作再生のための変数
+
+	// モーションマッチングの特徴データベース（動作リストの全動作から構築）
+	MotionMatchingDatabase *  mm_database;
+
+	// モーションマッチングによる動作再生
+	MotionMatchingController *  mm_controller;
+
+	// 動作リストからの動作選択の代わりに、モーションマッチングによる動作再生を使用するかどうかの設定
+	bool  enable_motion_matching;
+
+	// モーションマッチングの目標の水平向き（度）と移動速度
+	float  mm_desired_ori;
+	float  mm_desired_speed;
+
   protected:
 	// 動作再生のための変数
 
@@ -129,6 +164,18 @@ class  MotionTransitionApp : public GLUTBaseApp
 	// 動作再生処理（動作接続・遷移を考慮）
 	void  AnimationWithMotionTransition( float delta );
 
+	// モーショングラフの初期化（保存済みのファイルがあれば読み込み、なければ構築して保存）
+	void  InitMotionGraph();
+
+	// モーショングラフから現在の動作から次の動作への遷移候補を選択し、遷移区間を変更した動作情報を設定
+	bool  SelectGraphTransition( MotionInfo * & curr_motion_info, MotionInfo * & next_motion_info );
+
+	// モーションマッチングの特徴データベースの初期化
+	void  InitMotionMatching();
+
+	// 動作再生処理（モーションマッチング）
+	void  AnimationWithMotionMatching( float delta );
+
 	// タイムラインへの前後の動作・遷移区間の設定
 	static void  InitTimeline( Timeline & timeline, const MotionTransition & trans, int count );
 
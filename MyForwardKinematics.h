@@ -0,0 +1,29 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  順運動学計算（※レポート課題）（OpenGL に依存しないため、アプリケーション以外からも使用できる）
+**/
+
+#ifndef  _MY_FORWARD_KINEMATICS_H_
+#define  _MY_FORWARD_KINEMATICS_H_
+
+
+// ライブラリ・クラス定義の読み込み
+#include "SimpleHuman.h"
+
+
+// 補助処理（グローバル関数）のプロトタイプ宣言
+
+// 順運動学計算（※レポート課題）
+void  MyForwardKinematics( const Posture & posture, vector< Matrix4f > & seg_frame_array, vector< Point3f > & joi_pos_array );
+
+// 順運動学計算のための反復計算（ルート体節から末端体節に向かって繰り返し再帰呼び出し）（※レポート課題）
+void  MyForwardKinematicsIteration( const Segment *  segment, const Segment * prev_segment, const Posture & posture, 
+	Matrix4f * seg_frame_array, Point3f * joi_pos_array = NULL );
+
+
+#endif // _MY_FORWARD_KINEMATICS_H_
@@ -0,0 +1,374 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "BenchmarkHarness.h"
+#include "HotPathBenchmarks.h"
+
+#include "../SimpleHuman.h"
+#include "../SpatialAnalysis.h"
+#include "../FrameVoxelStore.h"
+#include "../VoxelPyramid.h"
+#include "../VoxelGridOps.h"
+#include "../VoxelGroupModel.h"
+#include "../FrameAlignment.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace PerformanceTests1
+{
+	// 計測結果のログ・計測中の失敗をテストのログ・結果に出力
+	static void WriteBenchmarkTestLog(const char* message)
+	{
+		Logger::WriteMessage(message);
+	}
+
+	static void FailBenchmarkTest(const char* message)
+	{
+		std::wstring wide_message(message, message + strlen(message));
+		Assert::Fail(wide_message.c_str());
+	}
+
+	//
+	//  解析処理の主要な処理の実行時間の計測
+	//  各計測の結果はテストのログに出力し、全計測の終了後に benchmark_results.json にまとめて出力する
+	//  （計算結果の検証は AnalysisCorrectnessTests で行う）
+	//
+	TEST_CLASS(AnalysisBenchmarks)
+	{
+	public:
+
+		TEST_CLASS_INITIALIZE(SetupHarness)
+		{
+			SetBenchmarkLogger(WriteBenchmarkTestLog);
+			SetBenchmarkFailureHandler(FailBenchmarkTest);
+		}
+
+		TEST_CLASS_CLEANUP(WriteResults)
+		{
+			WriteBenchmarkJSON(kBenchResultFileName);
+		}
+
+		// BVHファイルの読み込み・動作データの構築・順運動学・姿勢補間
+		TEST_METHOD(MotionLoadAndKinematics)
+		{
+			BenchmarkMotionLoadAndKinematics();
+		}
+
+		// 逆運動学計算（CCD法）の1姿勢ごとの計算と、動作全体の計算（1スレッド・並列）
+		TEST_METHOD(InverseKinematicsCCD)
+		{
+			BenchmarkInverseKinematicsCCD();
+		}
+
+		// 1フレーム分の部位ごとの疎ボクセルの計算
+		TEST_METHOD(SegmentSparseVoxelization)
+		{
+			BenchmarkSegmentSparseVoxelization();
+		}
+
+		// 全フレームの疎ボクセルキャッシュの構築・累積ボクセルの合成・ボクセルキャッシュの保存と読み込み
+		TEST_METHOD(FrameCacheComposeAndFileIO)
+		{
+			BenchmarkFrameCacheComposeAndFileIO();
+		}
+
+		// ボクセル化の集約方法（dense / hash / sorted_run）と保存先（memory / mapped）の全ての組み合わせでの全フレームの疎ボクセルの計算
+		TEST_METHOD(VoxelizationPipelineBackends)
+		{
+			const int num_frames = kBenchFrameCounts[1];
+			const char* mapped_file_name = "bench_voxelization_pipeline.fvx";
+			SyntheticMotionFixture fixture(num_frames, kBenchJointsPerChain[0], -1.0f);
+			Assert::IsTrue(fixture.IsLoaded());
+			Motion* motion = fixture.motion1;
+			const int num_segments = fixture.GetNumSegments();
+
+			for (int resolution : kBenchResolutions)
+			{
+				SpatialAnalyzer analyzer;
+				fixture.SetupAnalyzer(analyzer, resolution);
+
+				for (int type = 0; type < VOXEL_ACCUMULATOR_COUNT; type++)
+				{
+					analyzer.SetVoxelAccumulator((VoxelAccumulatorType)type);
+					char name[128];
+
+					MotionFrameSegmentVoxelGridCache cache;
+					MemoryFrameVoxelStore memory_store(cache);
+					bool built = true;
+					snprintf(name, sizeof(name), "VoxelizationPipeline/%s/memory", GetVoxelAccumulatorName(type));
+					MeasureBenchmark(name, resolution, num_frames, num_segments, 1, [&]() {
+						built = analyzer.BuildMotionFrameStore(motion, memory_store);
+					});
+					Assert::IsTrue(built, L"failed to build frame cache");
+
+					MappedFrameVoxelStore mapped_store(mapped_file_name);
+					snprintf(name, sizeof(name), "VoxelizationPipeline/%s/mapped", GetVoxelAccumulatorName(type));
+					MeasureBenchmark(name, resolution, num_frames, num_segments, 1, [&]() {
+						built = analyzer.BuildMotionFrameStore(motion, mapped_store);
+					});
+					Assert::IsTrue(built && mapped_store.GetNumFrames() == num_frames, L"failed to build mapped frame cache");
+					mapped_store.Close();
+					std::remove(mapped_file_name);
+				}
+			}
+		}
+
+		// フレームキャッシュの特徴量ごとのマスクによる全特徴量・全フレームの読み出し
+		TEST_METHOD(FrameCacheFeatureMasks)
+		{
+			const int num_frames = kBenchFrameCounts[1];
+			const int resolution = 64;
+			SyntheticMotionFixture fixture(num_frames, kBenchJointsPerChain[0], -1.0f);
+			Assert::IsTrue(fixture.IsLoaded());
+			const int num_segments = fixture.GetNumSegments();
+
+			SpatialAnalyzer analyzer;
+			fixture.SetupAnalyzer(analyzer, resolution);
+			MotionFrameSegmentVoxelGridCache cache;
+			MemoryFrameVoxelStore memory_store(cache);
+			Assert::IsTrue(analyzer.BuildMotionFrameStore(fixture.motion1, memory_store), L"failed to build frame cache");
+			FrameVoxelCacheView memory_view(cache);
+
+			double total = 0.0;
+			MeasureBenchmark("FrameCacheForEachVoxel", resolution, num_frames, num_segments, 10, [&]() {
+				for (int feature = 0; feature < 5; feature++)
+					for (int f = 0; f < num_frames; f++)
+						for (int s = 0; s < num_segments; s++)
+							memory_view.ForEachVoxel(f, s, feature, [&](int, float v) { total += v; });
+			});
+			Assert::IsTrue(total > 0.0);
+		}
+
+		// 慣性主軸角速度の計算方法（ボーンの軸方向 / ボクセルの主成分分析）ごとの全フレームの疎ボクセルの計算
+		TEST_METHOD(PrincipalAxisModes)
+		{
+			const int num_frames = 60;
+			const int resolution = 128;
+			SyntheticMotionFixture fixture(num_frames, 2, -1.0f);
+			Assert::IsTrue(fixture.IsLoaded());
+
+			for (int mode = 0; mode < PRINCIPAL_AXIS_COUNT; mode++)
+			{
+				SpatialAnalyzer analyzer;
+				fixture.SetupAnalyzer(analyzer, resolution);
+				analyzer.SetPrincipalAxisMode((PrincipalAxisMode)mode);
+
+				MotionFrameSegmentVoxelGridCache cache;
+				MemoryFrameVoxelStore store(cache);
+				bool built = true;
+				char name[128];
+				snprintf(name, sizeof(name), "PrincipalAxis/%s", GetPrincipalAxisModeName(mode));
+				MeasureBenchmark(name, resolution, num_frames, fixture.GetNumSegments(), 1, [&]() {
+					built = analyzer.BuildMotionFrameStore(fixture.motion1, store);
+				});
+				Assert::IsTrue(built, L"failed to build frame cache");
+			}
+		}
+
+		// 時間範囲を指定した累積（区間累積の索引による合成）
+		TEST_METHOD(AccumulationTimeRange)
+		{
+			const int num_frames = 120;
+			const int resolution = 64;
+			const int windows[][2] = { { 0, num_frames - 1 }, { 0, 0 }, { 5, 40 }, { 17, 95 }, { 64, num_frames - 1 } };
+			SyntheticMotionFixture fixture(num_frames, 4);
+			Assert::IsTrue(fixture.IsLoaded());
+			Motion* motion1 = fixture.motion1;
+			Motion* motion2 = fixture.motion2;
+
+			SpatialAnalyzer analyzer;
+			fixture.SetupAnalyzer(analyzer, resolution);
+			analyzer.BuildAllFeatureFrameCaches(motion1, motion2);
+			Assert::IsTrue(analyzer.HasFrameCache());
+
+			for (const int* window : windows)
+			{
+				// 範囲の両端はフレームの中央の時刻で指定
+				analyzer.SetAccumulationTimeRange((window[0] + 0.5f) * motion1->interval, (window[1] + 0.5f) * motion1->interval);
+				char name[128];
+				snprintf(name, sizeof(name), "ComposeAccumulatedRange/%d-%d", window[0], window[1]);
+				MeasureBenchmark(name, resolution, window[1] - window[0] + 1, fixture.GetNumSegments(), 1, [&]() {
+					for (int feature = 0; feature < SA_FEATURE_COUNT; feature++)
+						analyzer.ComposeAccumulatedFeatureFromFrameCache(motion1, motion2, feature);
+				});
+			}
+			analyzer.ClearAccumulationTimeRange();
+		}
+
+		// 部位ごとの局所グリッド・ワールド座標系の共通グリッドによるフレームキャッシュの構築
+		TEST_METHOD(SegmentLocalGrids)
+		{
+			const int num_frames = 120;
+			const int resolution = 64;
+			SyntheticMotionFixture fixture(num_frames, 4);
+			Assert::IsTrue(fixture.IsLoaded());
+
+			for (int i = 0; i < 2; i++)
+			{
+				SpatialAnalyzer analyzer;
+				fixture.SetupAnalyzer(analyzer, resolution);
+				analyzer.SetVoxelGridSpace(i == 0 ? VOXEL_GRID_WORLD : VOXEL_GRID_SEGMENT_LOCAL);
+				MeasureBenchmark(i == 0 ? "BuildFrameCache/world" : "BuildFrameCache/segment_local", resolution, num_frames, fixture.GetNumSegments(), 1, [&]() {
+					analyzer.BuildAllFeatureFrameCaches(fixture.motion1, fixture.motion2);
+				});
+				Assert::IsTrue(analyzer.HasFrameCache());
+			}
+		}
+
+		// 累積差分グリッドの多重解像度ピラミッドの構築（解像度は2のべき乗でない場合）
+		TEST_METHOD(VoxelPyramidLevels)
+		{
+			const int num_frames = 60;
+			const int resolution = 100;
+			SyntheticMotionFixture fixture(num_frames, 4);
+			Assert::IsTrue(fixture.IsLoaded());
+
+			SpatialAnalyzer analyzer;
+			fixture.SetupAnalyzer(analyzer, resolution);
+			analyzer.BuildAllFeatureFrameCaches(fixture.motion1, fixture.motion2);
+
+			for (int feature = 0; feature < SA_FEATURE_COUNT; feature++)
+			{
+				const VoxelGrid& base = analyzer.GetAccumulatedDiffGrid(feature);
+				VoxelGridPyramid pyramid;
+				pyramid.SetReduce(GetVoxelPyramidReduce(feature));
+				MeasureBenchmark("VoxelPyramid::Build", resolution, num_frames, fixture.GetNumSegments(), 1, [&]() {
+					pyramid.Invalidate();
+					pyramid.Build(base);
+				});
+			}
+		}
+
+		// 表示用の結果の計算・公開（全フレームを順に更新）
+		TEST_METHOD(DisplaySnapshotPublishing)
+		{
+			const int num_frames = 60;
+			const int resolution = 64;
+			SyntheticMotionFixture fixture(num_frames, 4);
+			Assert::IsTrue(fixture.IsLoaded());
+			Motion* motion1 = fixture.motion1;
+			Motion* motion2 = fixture.motion2;
+
+			SpatialAnalyzer analyzer;
+			fixture.SetupAnalyzer(analyzer, resolution);
+			analyzer.BuildAllFeatureFrameCaches(motion1, motion2);
+			analyzer.feature_mode = 1;
+			analyzer.norm_mode = 0;
+
+			MeasureBenchmark("SpatialAnalyzer::ComputeDisplayUpdate", resolution, num_frames, fixture.GetNumSegments(), 1, [&]() {
+				for (int frame = 0; frame < num_frames; frame++)
+					analyzer.ComputeDisplayUpdate(analyzer.MakeDisplayRequest(motion1, motion2, frame * motion1->interval));
+			});
+		}
+
+		// 瞬間ボクセルの計算（書き込んだブリックのみの消去・差分計算）
+		TEST_METHOD(InstantDirtyBricks)
+		{
+			const int num_frames = 60;
+			const int resolution = 100;
+			SyntheticMotionFixture fixture(num_frames, 4);
+			Assert::IsTrue(fixture.IsLoaded());
+			Motion* motion1 = fixture.motion1;
+			Motion* motion2 = fixture.motion2;
+
+			SpatialAnalyzer analyzer;
+			fixture.SetupAnalyzer(analyzer, resolution);
+			analyzer.BuildAllFeatureFrameCaches(motion1, motion2);
+
+			for (int feature = 0; feature < SA_FEATURE_COUNT; feature++)
+			{
+				MeasureBenchmark("ComputeInstantFeature(dirty bricks)", resolution, num_frames, fixture.GetNumSegments(), 1, [&]() {
+					for (int frame = 0; frame < num_frames; frame++)
+						analyzer.ComputeInstantFeature(motion1, motion2, frame * motion1->interval, feature);
+				});
+			}
+		}
+
+		// ボクセルグリッドの差の絶対値・最大値の計算（利用できる各実装）
+		TEST_METHOD(VoxelGridOpsBackends)
+		{
+			const int resolution = 100;
+			const size_t n = (size_t)resolution * resolution * resolution + 5;
+			std::vector<float> a, b, diff(n);
+			MakeSyntheticVoxelGridPair(n, a, b);
+
+			const VoxelGridOpsBackend default_backend = GetVoxelGridOpsBackend();
+			for (int backend = 0; backend < VOXEL_GRID_OPS_COUNT; backend++)
+			{
+				if (!SetVoxelGridOpsBackend(backend))
+					continue;
+				char name[64];
+				snprintf(name, sizeof(name), "VoxelGridAbsDiffMax/%s", GetVoxelGridOpsBackendName(backend));
+				MeasureBenchmark(name, resolution, 1, 1, 10, [&]() {
+					VoxelGridAbsDiffMax(a.data(), b.data(), diff.data(), n);
+				});
+			}
+			SetVoxelGridOpsBackend(default_backend);
+		}
+
+		// 集団の統計モデルへの試行の追加と、新しい試行の z 値の計算
+		TEST_METHOD(GroupModelWelford)
+		{
+			const int resolution = 64;
+			const int num_takes = 8;
+			const float bounds[3][2] = { { -1.0f, 1.0f }, { 0.0f, 2.0f }, { -1.0f, 1.0f } };
+			std::vector<VoxelGrid> takes;
+			MakeSyntheticGroupTakes(resolution, num_takes + 1, takes);
+
+			VoxelGroupModel model;
+			model.Reset(0, resolution, bounds);
+			MeasureBenchmark("GroupModelAddTake", resolution, num_takes, 1, 1, [&]() {
+				for (int t = 0; t < num_takes; t++)
+					model.AddTake(takes[t]);
+			});
+			Assert::AreEqual(num_takes, model.GetNumTakes());
+
+			VoxelGrid zscore;
+			MeasureBenchmark("GroupModelZScore", resolution, 1, 1, 5, [&]() {
+				model.ComputeZScoreGrid(takes[num_takes], zscore, 0.05f, false);
+			});
+		}
+
+		// フレームの対応付け（FastDTW）と、対応付けたフレームどうしの累積ボクセルの合成
+		TEST_METHOD(FrameAlignmentDTW)
+		{
+			const int n = 300, m = 420, dims = 8;
+			std::vector<float> a, b;
+			MakeSyntheticWarpedSequences(n, m, dims, a, b);
+			NormalizeFrameFeatureSummaries(a, b, dims);
+			FrameAlignmentPath fast;
+			bool aligned = true;
+			MeasureBenchmark("FastDTWAlignment", 0, n + m, dims, 5, [&]() {
+				aligned = ComputeFastDTWAlignment(a.data(), n, b.data(), m, dims, 10, fast);
+			});
+			Assert::IsTrue(aligned);
+
+			const int num_frames = 120;
+			const int resolution = 64;
+			SyntheticMotionFixture fixture(num_frames, 4);
+			Assert::IsTrue(fixture.IsLoaded());
+			Motion* motion1 = fixture.motion1;
+			Motion* motion2 = fixture.motion2;
+
+			SpatialAnalyzer analyzer;
+			fixture.SetupAnalyzer(analyzer, resolution);
+			analyzer.BuildAllFeatureFrameCaches(motion1, motion2);
+			Assert::IsTrue(analyzer.ComputeFrameCacheAlignment());
+			MeasureBenchmark("ComposeAlignedAccumulated", resolution, num_frames, fixture.GetNumSegments(), 1, [&]() {
+				for (int feature = 0; feature < SA_FEATURE_COUNT; feature++)
+					analyzer.ComposeAccumulatedFeatureFromFrameCache(motion1, motion2, feature);
+			});
+			analyzer.ClearFrameAlignment();
+		}
+
+		// DTWによる2つの動作の位置・角度誤差の計算
+		TEST_METHOD(DTWInitialization)
+		{
+			BenchmarkDTWInitialization();
+		}
+	};
+}
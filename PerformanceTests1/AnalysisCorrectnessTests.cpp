@@ -0,0 +1,786 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "BenchmarkHarness.h"
+
+#include "../SimpleHuman.h"
+#include "../SpatialAnalysis.h"
+#include "../FrameVoxelStore.h"
+#include "../VoxelPyramid.h"
+#include "../VoxelGridOps.h"
+#include "../VoxelGroupModel.h"
+#include "../FrameAlignment.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace PerformanceTests1
+{
+	// フレームキャッシュの指定範囲の累積（フレームごとの合成）・選択部位の合成を参照できる解析クラス（時間範囲を指定した累積・瞬間ボクセルの検証用）
+	class RangeTestAnalyzer : public SpatialAnalyzer
+	{
+	public:
+		using SpatialAnalysisCore::AccumulateFrameCacheRange;
+		using SpatialAnalysisCore::ComposeSelectedSegmentsInstant;
+	};
+
+	// 2つのグリッドの差の最大値（基準のグリッドの最大値に対する比、最大値が 1 未満の場合は差の最大値）
+	static float MaxRelativeError(const VoxelGrid& grid, const VoxelGrid& reference)
+	{
+		float max_value = 0.0f, error = 0.0f;
+		for (size_t k = 0; k < reference.data.size(); k++)
+		{
+			max_value = std::max(max_value, fabsf(reference.data[k]));
+			error = std::max(error, fabsf(grid.data[k] - reference.data[k]));
+		}
+		return error / std::max(max_value, 1.0f);
+	}
+
+	//
+	//  解析処理の計算結果の検証
+	//  高速化した各処理が、基準となる計算（全走査・フレームごとの合成・SIMD 命令を使わない実装など）と同じ結果を返すことを確認する
+	//  （実行時間の計測は AnalysisBenchmarks で行う）
+	//
+	TEST_CLASS(AnalysisCorrectnessTests)
+	{
+	public:
+
+		// ボクセル化の集約方法（dense / hash / sorted_run）によらず、全フレームの疎ボクセル数が一致することを確認する
+		TEST_METHOD(VoxelizationPipelineBackends)
+		{
+			SyntheticMotionFixture fixture(kBenchFrameCounts[1], kBenchJointsPerChain[0], -1.0f);
+			Assert::IsTrue(fixture.IsLoaded());
+
+			for (int resolution : kBenchResolutions)
+			{
+				SpatialAnalyzer analyzer;
+				fixture.SetupAnalyzer(analyzer, resolution);
+
+				size_t reference_voxels = 0;
+				for (int type = 0; type < VOXEL_ACCUMULATOR_COUNT; type++)
+				{
+					analyzer.SetVoxelAccumulator((VoxelAccumulatorType)type);
+					MotionFrameSegmentVoxelGridCache cache;
+					MemoryFrameVoxelStore store(cache);
+					Assert::IsTrue(analyzer.BuildMotionFrameStore(fixture.motion1, store), L"failed to build frame cache");
+
+					size_t num_voxels = cache.GetMemoryInfo().num_voxels;
+					if (type == VOXEL_ACCUMULATOR_DENSE)
+						reference_voxels = num_voxels;
+					Assert::AreEqual(reference_voxels, num_voxels, L"accumulators produced different voxels");
+				}
+			}
+		}
+
+		// マップしたフレームキャッシュのファイルの検証
+		// ヘッダー・オフセット表が壊れたファイルは開かず、内容が壊れたフレームは参照時に確認して疎ボクセルを持たないものとして扱う
+		// （フレームの大きさ・部位のブリックの範囲・ブリックの疎ボクセルの範囲・疎ボクセルの位置のいずれが壊れていても範囲外を読み出さない）
+		TEST_METHOD(MappedFrameStoreValidation)
+		{
+			SyntheticMotionFixture fixture(kBenchFrameCounts[0], kBenchJointsPerChain[0], -1.0f);
+			Assert::IsTrue(fixture.IsLoaded());
+			SpatialAnalyzer analyzer;
+			fixture.SetupAnalyzer(analyzer, kBenchResolutions[0]);
+			const char* file_name = "test_mapped_store_validation.fvx";
+
+			MappedFrameVoxelStore store(file_name);
+			Assert::IsTrue(analyzer.BuildMotionFrameStore(fixture.motion1, store), L"failed to build mapped frame cache");
+			Assert::IsTrue(store.Open(), L"failed to reopen mapped frame cache");
+			const int num_frames = store.GetNumFrames();
+			const int num_segments = store.GetNumSegments();
+			for (int f = 0; f < num_frames; f++)
+				Assert::IsTrue(store.IsFrameValid(f), L"frame of a valid file rejected");
+			std::vector<char> original(store.GetFileSize());
+			store.Close();
+			FILE* file = fopen(file_name, "rb");
+			Assert::IsTrue(file != NULL);
+			bool read = fread(original.data(), 1, original.size(), file) == original.size();
+			fclose(file);
+			Assert::IsTrue(read, L"failed to read mapped frame cache");
+
+			const FrameVoxelFileHeader* header = reinterpret_cast<const FrameVoxelFileHeader*>(original.data());
+			std::vector<unsigned long long> table(num_frames + 1);
+			memcpy(table.data(), original.data() + header->frame_table_offset, table.size() * sizeof(unsigned long long));
+			auto chunk_at = [&](std::vector<char>& bytes, int frame) { return reinterpret_cast<FrameVoxelChunkHeader*>(bytes.data() + table[frame]); };
+			auto records_at = [&](std::vector<char>& bytes, int frame) { return reinterpret_cast<CompactSegmentRecord*>(chunk_at(bytes, frame) + 1); };
+			auto bricks_at = [&](std::vector<char>& bytes, int frame) { return reinterpret_cast<SparseVoxelBrick*>(records_at(bytes, frame) + num_segments); };
+
+			// 書き換えたファイルを開き、書き換えたフレームのみが確認で除かれることを確認
+			auto check_corrupted_frame = [&](const std::vector<char>& bytes, int frame, const wchar_t* message) {
+				FILE* out = fopen(file_name, "wb");
+				Assert::IsTrue(out != NULL);
+				bool written = fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size();
+				fclose(out);
+				Assert::IsTrue(written, L"failed to modify mapped frame cache");
+				Assert::IsTrue(store.Open(), L"failed to open a frame cache whose header is valid");
+				Assert::IsFalse(store.IsFrameValid(frame), message);
+				int num_visited = 0;
+				for (int s = 0; s < num_segments; s++)
+					for (int feature = 0; feature < 5; feature++)
+						store.ForEachVoxel(frame, s, feature, [&](int, float) { num_visited++; });
+				Assert::AreEqual(0, num_visited, L"read voxels of a corrupted frame");
+				Assert::IsTrue(store.IsFrameValid((frame + 1) % num_frames), L"corruption of one frame rejected another frame");
+				store.Close();
+			};
+
+			// ブリックを持つ部位・疎ボクセルを持つブリックのあるフレーム
+			int frame = -1, segment = -1;
+			for (int f = 0; f < num_frames && segment < 0; f++)
+			{
+				for (int s = 0; s < num_segments && segment < 0; s++)
+				{
+					const CompactSegmentRecord& record = records_at(original, f)[s];
+					if (record.num_bricks > 0 && bricks_at(original, f)[record.first_brick].num_voxels > 0)
+					{
+						frame = f;
+						segment = s;
+					}
+				}
+			}
+			Assert::IsTrue(segment >= 0, L"no frame has voxels");
+
+			// フレームの大きさ（疎ボクセル数）
+			std::vector<char> bytes = original;
+			chunk_at(bytes, frame)->num_voxels += 1000;
+			check_corrupted_frame(bytes, frame, L"accepted a frame whose chunk size does not match the offset table");
+
+			// 部位のブリックの範囲
+			bytes = original;
+			records_at(bytes, frame)[segment].first_brick = chunk_at(bytes, frame)->num_bricks;
+			check_corrupted_frame(bytes, frame, L"accepted a segment whose bricks are out of the frame");
+
+			// ブリックの疎ボクセルの範囲
+			bytes = original;
+			const unsigned int brick = records_at(bytes, frame)[segment].first_brick;
+			bricks_at(bytes, frame)[brick].first_voxel = chunk_at(bytes, frame)->num_voxels;
+			check_corrupted_frame(bytes, frame, L"accepted a brick whose voxels are out of the frame");
+
+			// 疎ボクセルの位置（ブリックの位置がグリッドの外）
+			bytes = original;
+			bricks_at(bytes, frame)[brick].origin[2] = (unsigned short)header->resolution;
+			check_corrupted_frame(bytes, frame, L"accepted a voxel outside the grid");
+
+			// オフセット表の最後がファイルの末尾と一致しないファイルは開かない
+			bytes = original;
+			bytes.resize(bytes.size() - 1);
+			FILE* out = fopen(file_name, "wb");
+			Assert::IsTrue(out != NULL);
+			fwrite(bytes.data(), 1, bytes.size(), out);
+			fclose(out);
+			Assert::IsFalse(store.Open(), L"opened a frame cache whose offset table does not match the file size");
+			std::remove(file_name);
+		}
+
+		// フレームキャッシュの特徴量ごとのマスクによる読み出し（構築時に閾値以下の値を除き、マスクのビットが立った疎ボクセルのみを読み出す）
+		// メモリ上のキャッシュ・マップしたファイルのいずれも、全疎ボクセルを走査して閾値より大きい値を選んだ結果と一致することを確認する
+		TEST_METHOD(FrameCacheFeatureMasks)
+		{
+			const int num_frames = kBenchFrameCounts[1];
+			const int resolution = 64;
+			const char* mapped_file_name = "test_feature_masks.fvx";
+			SyntheticMotionFixture fixture(num_frames, kBenchJointsPerChain[0], -1.0f);
+			Assert::IsTrue(fixture.IsLoaded());
+			const int num_segments = fixture.GetNumSegments();
+
+			SpatialAnalyzer analyzer;
+			fixture.SetupAnalyzer(analyzer, resolution);
+			MotionFrameSegmentVoxelGridCache cache;
+			MemoryFrameVoxelStore memory_store(cache);
+			MappedFrameVoxelStore mapped_store(mapped_file_name);
+			Assert::IsTrue(analyzer.BuildMotionFrameStore(fixture.motion1, memory_store), L"failed to build frame cache");
+			Assert::IsTrue(analyzer.BuildMotionFrameStore(fixture.motion1, mapped_store), L"failed to build mapped frame cache");
+			FrameVoxelCacheView memory_view(cache);
+			FrameVoxelCacheView mapped_view(mapped_store);
+
+			typedef std::pair<int, float> IndexValue;
+			std::vector<IndexValue> expected, memory_values, mapped_values;
+			const int mask = MotionFrameSegmentVoxelGridCache::kBrickSize - 1;
+			const int brick_bits = MotionFrameSegmentVoxelGridCache::kBrickBits;
+			for (int f = 0; f < num_frames; f++)
+			{
+				for (int s = 0; s < num_segments; s++)
+				{
+					const CompactSegmentRecord& record = cache.segments[(size_t)f * num_segments + s];
+					for (int feature = 0; feature < 5; feature++)
+					{
+						// 全疎ボクセルを走査して値を選ぶ
+						expected.clear();
+						for (unsigned int b = 0; b < record.num_bricks; b++)
+						{
+							const SparseVoxelBrick& brick = cache.bricks[record.first_brick + b];
+							int base = (brick.origin[0] + brick.origin[1] * resolution + brick.origin[2] * resolution * resolution) << brick_bits;
+							for (unsigned int k = 0; k < brick.num_voxels; k++)
+							{
+								const QuantizedSparseVoxel& v = cache.voxels[brick.first_voxel + k];
+								float value = v.values[feature] * record.scale[feature];
+								if (value <= cache.sparse_threshold)
+									continue;
+								int local = v.local;
+								int index = base + (local & mask) + ((local >> brick_bits) & mask) * resolution + (local >> (brick_bits * 2)) * resolution * resolution;
+								expected.push_back(IndexValue(index, value));
+							}
+						}
+
+						memory_values.clear();
+						mapped_values.clear();
+						memory_view.ForEachVoxel(f, s, feature, [&](int index, float v) { memory_values.push_back(IndexValue(index, v)); });
+						mapped_view.ForEachVoxel(f, s, feature, [&](int index, float v) { mapped_values.push_back(IndexValue(index, v)); });
+						Assert::IsTrue(memory_values == expected, L"memory cache differs from full scan");
+						Assert::IsTrue(mapped_values == expected, L"mapped cache differs from full scan");
+					}
+				}
+			}
+
+			mapped_store.Close();
+			std::remove(mapped_file_name);
+		}
+
+		// 慣性主軸角速度の計算方法（ボーンの軸方向 / ボクセルの主成分分析）
+		// 部位ごとの全フレームの平均値がボクセルの主成分分析（検証用）と許容誤差内で一致することを確認する
+		// （主成分分析はボクセルの量子化の影響を受けるため、部位がボクセルに対して十分に大きい解像度 128 で比較する）
+		TEST_METHOD(PrincipalAxisModes)
+		{
+			const int num_frames = 60;
+			const int resolution = 128;
+			const float min_mean_speed = 0.1f;     // 比較する部位の平均角速度の下限 [rad/s]
+			const float relative_tolerance = 0.1f; // 平均角速度の許容誤差（主成分分析の値に対する比）
+
+			SyntheticMotionFixture fixture(num_frames, 2, -1.0f);
+			Assert::IsTrue(fixture.IsLoaded());
+			const int num_segments = fixture.GetNumSegments();
+
+			std::vector<double> mean_speeds[PRINCIPAL_AXIS_COUNT];
+			for (int mode = 0; mode < PRINCIPAL_AXIS_COUNT; mode++)
+			{
+				SpatialAnalyzer analyzer;
+				fixture.SetupAnalyzer(analyzer, resolution);
+				analyzer.SetPrincipalAxisMode((PrincipalAxisMode)mode);
+				MotionFrameSegmentVoxelGridCache cache;
+				MemoryFrameVoxelStore store(cache);
+				Assert::IsTrue(analyzer.BuildMotionFrameStore(fixture.motion1, store), L"failed to build frame cache");
+
+				// 部位の全ボクセルは同じ値を持つため、部位ごとの最大値をそのフレームの角速度とする
+				mean_speeds[mode].assign(num_segments, 0.0);
+				for (int f = 1; f < num_frames; f++)
+				{
+					for (int s = 0; s < num_segments; s++)
+					{
+						float speed = 0.0f;
+						cache.ForEachVoxel(f, s, 4, [&](int, float v) { speed = std::max(speed, v); });
+						mean_speeds[mode][s] += speed / (num_frames - 1);
+					}
+				}
+			}
+
+			for (int s = 0; s < num_segments; s++)
+			{
+				double reference = mean_speeds[PRINCIPAL_AXIS_VOXEL_PCA][s];
+				if (reference < min_mean_speed)
+					continue;
+				double error = fabs(mean_speeds[PRINCIPAL_AXIS_BONE][s] - reference) / reference;
+				char message[256];
+				snprintf(message, sizeof(message), "PrincipalAxis segment %d: bone=%.4f voxel_pca=%.4f error=%.1f%%\n",
+					s, mean_speeds[PRINCIPAL_AXIS_BONE][s], reference, error * 100.0);
+				Logger::WriteMessage(message);
+				Assert::IsTrue(error <= relative_tolerance, L"bone principal axis speed differs from voxel PCA");
+			}
+		}
+
+		// 慣性主軸角速度の計算方法の変更によるフレームキャッシュの破棄（集約方法の変更では計算結果が変わらないため破棄しない）
+		TEST_METHOD(PrincipalAxisModeDiscardsFrameCaches)
+		{
+			SyntheticMotionFixture fixture(kBenchFrameCounts[0], kBenchJointsPerChain[0]);
+			Assert::IsTrue(fixture.IsLoaded());
+			SpatialAnalyzer analyzer;
+			fixture.SetupAnalyzer(analyzer, kBenchResolutions[0]);
+			analyzer.BuildAllFeatureFrameCaches(fixture.motion1, fixture.motion2);
+			Assert::IsTrue(analyzer.GetFrameCacheMemoryInfo(0).num_frames == kBenchFrameCounts[0]);
+
+			analyzer.SetVoxelAccumulator(VOXEL_ACCUMULATOR_HASH);
+			Assert::IsTrue(analyzer.GetFrameCacheMemoryInfo(0).num_frames == kBenchFrameCounts[0], L"changing the accumulator discarded the frame cache");
+
+			analyzer.SetPrincipalAxisMode(PRINCIPAL_AXIS_VOXEL_PCA);
+			Assert::IsTrue(analyzer.GetFrameCacheMemoryInfo(0).num_frames == 0, L"frame cache built with the previous principal axis mode was kept");
+		}
+
+		// 時間を指定した範囲の累積（区間累積の索引による合成）が、フレームごとに合成した結果と一致することを確認する
+		TEST_METHOD(AccumulationTimeRange)
+		{
+			const int num_frames = 120;
+			const int resolution = 64;
+			const float relative_tolerance = 1.0e-4f; // 累積ボクセルの許容誤差（フレームごとに合成した結果の最大値に対する比）
+			const int windows[][2] = { { 0, num_frames - 1 }, { 0, 0 }, { 5, 40 }, { 17, 95 }, { 64, num_frames - 1 } };
+
+			SyntheticMotionFixture fixture(num_frames, 4);
+			Assert::IsTrue(fixture.IsLoaded());
+			Motion* motion1 = fixture.motion1;
+			Motion* motion2 = fixture.motion2;
+
+			RangeTestAnalyzer analyzer;
+			fixture.SetupAnalyzer(analyzer, resolution);
+			analyzer.BuildAllFeatureFrameCaches(motion1, motion2);
+			Assert::IsTrue(analyzer.HasFrameCache());
+
+			for (const int* window : windows)
+			{
+				// 範囲の両端はフレームの中央の時刻で指定
+				analyzer.SetAccumulationTimeRange((window[0] + 0.5f) * motion1->interval, (window[1] + 0.5f) * motion1->interval);
+				for (int feature = 0; feature < SA_FEATURE_COUNT; feature++)
+				{
+					analyzer.ComposeAccumulatedFeatureFromFrameCache(motion1, motion2, feature);
+					for (int i = 0; i < 2; i++)
+					{
+						VoxelGrid reference;
+						reference.Resize(resolution);
+						analyzer.AccumulateFrameCacheRange(i == 0 ? motion1 : motion2, i, feature, window[0], window[1], reference);
+						Assert::IsTrue(MaxRelativeError(analyzer.GetAccumulatedGrid(i, feature), reference) <= relative_tolerance, L"ranged accumulation differs from per-frame composition");
+					}
+				}
+			}
+			analyzer.ClearAccumulationTimeRange();
+		}
+
+		// 部位ごとの局所グリッドによるフレームキャッシュの構築・合成
+		// 全範囲の累積占有率の合計がワールド座標系の共通グリッドと近く、範囲を指定した累積がフレームごとに合成した結果と一致することを確認する
+		TEST_METHOD(SegmentLocalGrids)
+		{
+			const int num_frames = 120;
+			const int resolution = 64;
+			const float relative_tolerance = 1.0e-4f; // 範囲を指定した累積ボクセルの許容誤差
+			const double occupancy_tolerance = 0.05;  // 局所グリッドと共通グリッドの累積占有率の合計の許容誤差（比）
+
+			SyntheticMotionFixture fixture(num_frames, 4);
+			Assert::IsTrue(fixture.IsLoaded());
+			Motion* motion1 = fixture.motion1;
+			Motion* motion2 = fixture.motion2;
+
+			RangeTestAnalyzer world_analyzer, local_analyzer;
+			RangeTestAnalyzer* analyzers[2] = { &world_analyzer, &local_analyzer };
+			double sums[2] = { 0.0, 0.0 };
+			for (int i = 0; i < 2; i++)
+			{
+				fixture.SetupAnalyzer(*analyzers[i], resolution);
+				analyzers[i]->SetVoxelGridSpace(i == 0 ? VOXEL_GRID_WORLD : VOXEL_GRID_SEGMENT_LOCAL);
+				analyzers[i]->BuildAllFeatureFrameCaches(motion1, motion2);
+				Assert::IsTrue(analyzers[i]->HasFrameCache());
+				analyzers[i]->ComposeAccumulatedFeatureFromFrameCache(motion1, motion2, 0);
+
+				const VoxelGrid& grid = analyzers[i]->GetAccumulatedGrid(0, 0);
+				for (size_t k = 0; k < grid.data.size(); k++)
+					sums[i] += grid.data[k];
+			}
+			Assert::IsTrue((int)local_analyzer.GetSegmentGridBounds().size() == fixture.GetNumSegments());
+
+			char message[256];
+			snprintf(message, sizeof(message), "SegmentLocalGrids occupancy sum: world=%.1f segment_local=%.1f\n", sums[0], sums[1]);
+			Logger::WriteMessage(message);
+			Assert::IsTrue(fabs(sums[1] - sums[0]) <= occupancy_tolerance * sums[0], L"segment-local occupancy differs from world grid");
+
+			// 範囲を指定した累積（基準姿勢が一定でないため、フレームごとの合成に切り替わる）
+			const int window[2] = { 12, 71 };
+			local_analyzer.SetAccumulationTimeRange((window[0] + 0.5f) * motion1->interval, (window[1] + 0.5f) * motion1->interval);
+			for (int feature = 0; feature < SA_FEATURE_COUNT; feature++)
+			{
+				local_analyzer.ComposeAccumulatedFeatureFromFrameCache(motion1, motion2, feature);
+				VoxelGrid reference;
+				reference.Resize(resolution);
+				local_analyzer.AccumulateFrameCacheRange(motion1, 0, feature, window[0], window[1], reference);
+				Assert::IsTrue(MaxRelativeError(local_analyzer.GetAccumulatedGrid(0, feature), reference) <= relative_tolerance, L"segment-local ranged accumulation differs from per-frame composition");
+			}
+			local_analyzer.ClearAccumulationTimeRange();
+		}
+
+		// 累積差分グリッドの多重解像度ピラミッド
+		// 各段の値が段 0 のボクセルを直接集約した値と一致し、上位の段から絞り込んだ格子が全探索の結果と一致することを確認する
+		// 解像度は2のべき乗でない場合（端の格子の子が8個未満）も確認する
+		TEST_METHOD(VoxelPyramidLevels)
+		{
+			const int resolution = 100;
+			const float relative_tolerance = 1.0e-4f; // 合計の許容誤差（段 0 のボクセルを直接集約した値に対する比）
+
+			SyntheticMotionFixture fixture(60, 4);
+			Assert::IsTrue(fixture.IsLoaded());
+			SpatialAnalyzer analyzer;
+			fixture.SetupAnalyzer(analyzer, resolution);
+			analyzer.BuildAllFeatureFrameCaches(fixture.motion1, fixture.motion2);
+
+			for (int feature = 0; feature < SA_FEATURE_COUNT; feature++)
+			{
+				const VoxelGrid& base = analyzer.GetAccumulatedDiffGrid(feature);
+				VoxelGridPyramid pyramid;
+				pyramid.SetReduce(GetVoxelPyramidReduce(feature));
+				pyramid.Build(base);
+				Assert::IsTrue(pyramid.GetLevelResolution(pyramid.GetTopLevel()) == 1);
+
+				for (int level = 1; level <= pyramid.GetTopLevel(); level++)
+				{
+					const int level_res = pyramid.GetLevelResolution(level);
+					const int span = 1 << level;
+					for (int z = 0; z < level_res; z++)
+						for (int y = 0; y < level_res; y++)
+							for (int x = 0; x < level_res; x++)
+							{
+								double expected = (feature == 0) ? 0.0 : -1.0e30;
+								for (int bz = z * span; bz < std::min((z + 1) * span, resolution); bz++)
+									for (int by = y * span; by < std::min((y + 1) * span, resolution); by++)
+										for (int bx = x * span; bx < std::min((x + 1) * span, resolution); bx++)
+											expected = (feature == 0) ? expected + base.Get(bx, by, bz) : std::max(expected, (double)base.Get(bx, by, bz));
+								float value = pyramid.GetLevelValue(base, level, x, y, z);
+								Assert::IsTrue(fabs(value - expected) <= relative_tolerance * std::max(fabs(expected), 1.0), L"pyramid level differs from direct reduction");
+							}
+				}
+
+				// 最大値の半分以上の格子の絞り込み
+				const float threshold = 0.5f * analyzer.GetAccumulatedMaxValue(feature);
+				for (int level : { 0, 2 })
+				{
+					std::vector<int> cells;
+					pyramid.CollectCellsAbove(base, level, threshold, cells);
+					std::sort(cells.begin(), cells.end());
+
+					std::vector<int> expected;
+					const int level_res = pyramid.GetLevelResolution(level);
+					for (int z = 0; z < level_res; z++)
+						for (int y = 0; y < level_res; y++)
+							for (int x = 0; x < level_res; x++)
+								if (pyramid.GetLevelValue(base, level, x, y, z) >= threshold)
+									expected.push_back((z * level_res + y) * level_res + x);
+					Assert::IsTrue(cells == expected, L"pyramid refinement differs from exhaustive search");
+				}
+			}
+		}
+
+		// 表示用の結果の公開（計算側のスレッドで更新しながら描画側のスレッドで読み出し、途中まで書き込まれた結果を参照しないことを確認）
+		TEST_METHOD(DisplaySnapshotPublishing)
+		{
+			const int num_frames = 60;
+			const int resolution = 64;
+			const int feature = 1;
+
+			SyntheticMotionFixture fixture(num_frames, 4);
+			Assert::IsTrue(fixture.IsLoaded());
+			Motion* motion1 = fixture.motion1;
+
+			SpatialAnalyzer analyzer;
+			fixture.SetupAnalyzer(analyzer, resolution);
+			analyzer.BuildAllFeatureFrameCaches(motion1, fixture.motion2);
+			analyzer.feature_mode = feature;
+			analyzer.norm_mode = 0;
+
+			// 計算側のスレッドで全フレームを順に更新
+			const SpatialDisplayRequest base_request = analyzer.MakeDisplayRequest(motion1, fixture.motion2, 0.0f);
+			std::atomic<bool> done(false);
+			std::thread worker([&]() {
+				for (int frame = 0; frame < num_frames; frame++)
+				{
+					SpatialDisplayRequest request = base_request;
+					request.time = frame * motion1->interval;
+					analyzer.ComputeDisplayUpdate(request);
+				}
+				done = true;
+			});
+
+			// 描画側では、取得した結果の差分と最大値が両動作のグリッドと一致し、番号が戻らないことを確認
+			unsigned int last_serial = 0;
+			int num_checked = 0;
+			bool consistent = true;
+			while (!done || num_checked == 0)
+			{
+				std::shared_ptr<const SpatialDisplaySnapshot> snapshot = analyzer.AcquireDisplaySnapshot();
+				if (snapshot->serial == last_serial)
+					continue;
+				consistent = consistent && snapshot->serial > last_serial && snapshot->feature_mode == feature;
+				last_serial = snapshot->serial;
+
+				const VoxelGrid* grids = snapshot->grids;
+				consistent = consistent && grids[0].resolution == resolution && grids[2].data.size() == grids[0].data.size();
+				float max_diff = 0.0f;
+				for (size_t i = 0; consistent && i < grids[2].data.size(); i++)
+				{
+					float d = fabsf(grids[0].data[i] - grids[1].data[i]);
+					consistent = (grids[2].data[i] == d);
+					max_diff = std::max(max_diff, d);
+				}
+				consistent = consistent && (snapshot->max_value == max_diff || (max_diff < 1.0e-5f && snapshot->max_value == 1.0f));
+				num_checked++;
+			}
+			worker.join();
+			Assert::IsTrue(consistent, L"display snapshot is torn or out of order");
+
+			// 計算の完了後は最後に公開した結果を取得
+			Assert::IsTrue(analyzer.AcquireDisplaySnapshot()->serial >= last_serial);
+			char message[256];
+			snprintf(message, sizeof(message), "DisplaySnapshotPublishing checked %d of %u snapshots\n", num_checked, last_serial);
+			Logger::WriteMessage(message);
+		}
+
+		// 瞬間ボクセルの書き込んだブリックのみの消去・差分計算（毎フレーム全体を消去・計算し直した結果と一致することを確認）
+		TEST_METHOD(InstantDirtyBricks)
+		{
+			const int num_frames = 60;
+			const int resolution = 100;
+
+			SyntheticMotionFixture fixture(num_frames, 4);
+			Assert::IsTrue(fixture.IsLoaded());
+			Motion* motion1 = fixture.motion1;
+			Motion* motion2 = fixture.motion2;
+
+			RangeTestAnalyzer tracked;
+			fixture.SetupAnalyzer(tracked, resolution);
+			tracked.BuildAllFeatureFrameCaches(motion1, motion2);
+			const std::vector<bool> all_segments(fixture.GetNumSegments(), true);
+
+			for (int feature = 0; feature < SA_FEATURE_COUNT; feature++)
+			{
+				// 前のフレームの書き込みが残らないよう飛び飛びのフレームを順に計算し、全部位を選択して全体を消去・計算した結果と比較
+				for (int frame = 0; frame < num_frames; frame += 7)
+				{
+					float time = frame * motion1->interval;
+					tracked.ComputeInstantFeature(motion1, motion2, time, feature);
+
+					VoxelGrid expected1, expected2, expected_diff;
+					float expected_max = 0.0f;
+					Assert::IsTrue(tracked.ComposeSelectedSegmentsInstant(motion1, motion2, feature, time, all_segments, -1,
+					                                                      expected1, expected2, expected_diff, expected_max));
+					Assert::IsTrue(tracked.GetInstantGrid(0, feature).data == expected1.data, L"instant grid differs after dirty-brick clear");
+					Assert::IsTrue(tracked.GetInstantGrid(1, feature).data == expected2.data, L"instant grid differs after dirty-brick clear");
+					Assert::IsTrue(tracked.GetInstantDiffGrid(feature).data == expected_diff.data, L"diff grid differs from full computation");
+					Assert::AreEqual(expected_max, tracked.GetInstantMaxValue(feature));
+				}
+			}
+		}
+
+		// ボクセルグリッドの演算（SIMD 命令による各実装が SIMD 命令を使わない実装と同じ結果を返すことを確認）
+		TEST_METHOD(VoxelGridOpsBackends)
+		{
+			const int resolution = 100;
+			const size_t n = (size_t)resolution * resolution * resolution + 5; // 端数の処理も確認するため 8 の倍数にしない
+			const float threshold = 0.25f;
+			std::vector<float> a, b;
+			MakeSyntheticVoxelGridPair(n, a, b);
+
+			const VoxelGridOpsBackend default_backend = GetVoxelGridOpsBackend();
+			std::vector<float> expected_diff(n), expected_scaled(a);
+			std::vector<int> expected_indices(n);
+			std::vector<float> expected_values(n);
+			SetVoxelGridOpsBackend(VOXEL_GRID_OPS_SCALAR);
+			VoxelGridAbsDiff(a.data(), b.data(), expected_diff.data(), n);
+			const float expected_max = VoxelGridMax(b.data(), n);
+			const float expected_max_diff = VoxelGridMaxAbsDiff(a.data(), b.data(), n);
+			VoxelGridScale(expected_scaled.data(), n, 1.0f / 3.0f);
+			const size_t expected_count = VoxelGridCompactAbove(a.data(), n, threshold, expected_indices.data(), expected_values.data());
+			const double expected_sum = VoxelGridSum(a.data(), n);
+
+			for (int backend = 0; backend < VOXEL_GRID_OPS_COUNT; backend++)
+			{
+				if (!SetVoxelGridOpsBackend(backend))
+					continue;
+				std::vector<float> diff(n), fused(n), scaled(a);
+				std::vector<int> indices(n);
+				std::vector<float> values(n);
+				float fused_max = VoxelGridAbsDiffMax(a.data(), b.data(), fused.data(), n);
+				VoxelGridAbsDiff(a.data(), b.data(), diff.data(), n);
+				VoxelGridScale(scaled.data(), n, 1.0f / 3.0f);
+				size_t count = VoxelGridCompactAbove(a.data(), n, threshold, indices.data(), values.data());
+
+				Assert::IsTrue(memcmp(diff.data(), expected_diff.data(), n * sizeof(float)) == 0, L"abs-diff differs from scalar");
+				Assert::IsTrue(memcmp(fused.data(), expected_diff.data(), n * sizeof(float)) == 0, L"fused abs-diff differs from scalar");
+				Assert::IsTrue(memcmp(scaled.data(), expected_scaled.data(), n * sizeof(float)) == 0, L"scale differs from scalar");
+				Assert::AreEqual(expected_max_diff, fused_max);
+				Assert::AreEqual(expected_max_diff, VoxelGridMaxAbsDiff(a.data(), b.data(), n));
+				Assert::AreEqual(expected_max, VoxelGridMax(b.data(), n));
+				Assert::AreEqual(expected_count, count);
+				Assert::IsTrue(std::equal(indices.begin(), indices.begin() + count, expected_indices.begin()), L"compaction indices differ from scalar");
+				Assert::IsTrue(std::equal(values.begin(), values.begin() + count, expected_values.begin()), L"compaction values differ from scalar");
+				Assert::AreEqual(expected_count, VoxelGridCompactAbove(a.data(), n, threshold, nullptr, nullptr));
+				Assert::IsTrue(VoxelGridSum(a.data(), n) == expected_sum, L"sum differs from scalar");
+			}
+			SetVoxelGridOpsBackend(default_backend);
+		}
+
+		// 集団の統計モデル（疎な追加・統合・ファイル入出力の平均・分散が2パスで求めた値と一致し、z 値が定義どおりであることを確認）
+		TEST_METHOD(GroupModelWelford)
+		{
+			const int resolution = 64;
+			const int num_takes = 8;
+			const size_t n = (size_t)resolution * resolution * resolution;
+			const float bounds[3][2] = { { -1.0f, 1.0f }, { 0.0f, 2.0f }, { -1.0f, 1.0f } };
+
+			// 統計モデルに追加する試行と、z 値を求める新しい試行
+			std::vector<VoxelGrid> takes;
+			MakeSyntheticGroupTakes(resolution, num_takes + 1, takes);
+
+			// 2パスで求めた平均・不偏分散
+			std::vector<double> expected_mean(n, 0.0), expected_var(n, 0.0);
+			for (size_t i = 0; i < n; i++)
+			{
+				for (int t = 0; t < num_takes; t++)
+					expected_mean[i] += takes[t].data[i];
+				expected_mean[i] /= num_takes;
+				for (int t = 0; t < num_takes; t++)
+					expected_var[i] += (takes[t].data[i] - expected_mean[i]) * (takes[t].data[i] - expected_mean[i]);
+				expected_var[i] /= num_takes - 1;
+			}
+
+			VoxelGroupModel sequential, first_half, second_half;
+			sequential.Reset(0, resolution, bounds);
+			first_half.Reset(0, resolution, bounds);
+			second_half.Reset(0, resolution, bounds);
+			for (int t = 0; t < num_takes; t++)
+			{
+				sequential.AddTake(takes[t]);
+				(t < num_takes / 2 ? first_half : second_half).AddTake(takes[t]);
+			}
+			Assert::IsTrue(first_half.Merge(second_half));
+			Assert::AreEqual(num_takes, sequential.GetNumTakes());
+			Assert::AreEqual(num_takes, first_half.GetNumTakes());
+
+			const char* file_name = "group_model_test.vgm";
+			Assert::IsTrue(sequential.SaveToFile(file_name));
+			VoxelGroupModel loaded;
+			Assert::IsTrue(loaded.LoadFromFile(file_name));
+			std::remove(file_name);
+			Assert::IsTrue(loaded.IsCompatible(resolution, bounds));
+
+			const VoxelGroupModel* models[] = { &sequential, &first_half, &loaded };
+			for (const VoxelGroupModel* model : models)
+			{
+				for (size_t i = 0; i < n; i++)
+				{
+					Assert::AreEqual(expected_mean[i], (double)model->GetMean(i), 1e-4 * (1.0 + expected_mean[i]), L"mean differs from two-pass");
+					Assert::AreEqual(expected_var[i], (double)model->GetVariance(i), 1e-3 * (1.0 + expected_var[i]), L"variance differs from two-pass");
+				}
+			}
+			for (size_t i = 0; i < n; i++)
+			{
+				Assert::AreEqual(sequential.GetMean(i), loaded.GetMean(i));
+				Assert::AreEqual(sequential.GetVariance(i), loaded.GetVariance(i));
+			}
+
+			// 新しい試行の z 値（標準偏差の下限を含む）
+			VoxelGrid zscore;
+			float max_z = sequential.ComputeZScoreGrid(takes[num_takes], zscore, 0.05f, false);
+			double max_stddev = 0.0;
+			for (size_t i = 0; i < n; i++)
+				max_stddev = std::max(max_stddev, std::sqrt(expected_var[i]));
+			float expected_max_z = 0.0f;
+			for (size_t i = 0; i < n; i++)
+			{
+				double stddev = std::max(std::sqrt(expected_var[i]), max_stddev * 0.05);
+				double z = (takes[num_takes].data[i] - expected_mean[i]) / stddev;
+				Assert::AreEqual(z, (double)zscore.data[i], 1e-3 * (1.0 + std::fabs(z)), L"z-score differs from definition");
+				expected_max_z = std::max(expected_max_z, (float)std::fabs(z));
+			}
+			Assert::AreEqual(expected_max_z, max_z, 1e-3f * (1.0f + expected_max_z));
+		}
+
+		// フレームの対応付け（FastDTW）と、対応付けたフレームどうしの瞬間・累積ボクセルの合成
+		// 時間を伸縮した列の対応付けが窓を制限しない DTW とほぼ同じ経路長・コストになり、
+		// 対応付けの設定中の瞬間・累積ボクセルが、対応するフレームを指定して合成した結果と一致することを確認する
+		TEST_METHOD(FrameAlignmentDTW)
+		{
+			const int n = 300, m = 420, dims = 8;
+			std::vector<float> a, b;
+			MakeSyntheticWarpedSequences(n, m, dims, a, b);
+			NormalizeFrameFeatureSummaries(a, b, dims);
+
+			auto path_cost = [&](const FrameAlignmentPath& path) {
+				double cost = 0.0;
+				for (int k = 0; k < path.GetNumSteps(); k++)
+				{
+					const float* p = &a[(size_t)path.GetFrame(0, k) * dims];
+					const float* q = &b[(size_t)path.GetFrame(1, k) * dims];
+					for (int d = 0; d < dims; d++)
+						cost += (p[d] - q[d]) * (p[d] - q[d]);
+				}
+				return cost;
+			};
+
+			FrameAlignmentPath fast, full;
+			Assert::IsTrue(ComputeFastDTWAlignment(a.data(), n, b.data(), m, dims, 10, fast));
+			Assert::IsTrue(ComputeFastDTWAlignment(a.data(), n, b.data(), m, dims, m, full));
+			for (const FrameAlignmentPath* path : { &fast, &full })
+			{
+				Assert::AreEqual(0, path->GetFrame(0, 0));
+				Assert::AreEqual(0, path->GetFrame(1, 0));
+				Assert::AreEqual(n - 1, path->GetFrame(0, path->GetNumSteps() - 1));
+				Assert::AreEqual(m - 1, path->GetFrame(1, path->GetNumSteps() - 1));
+			}
+			double fast_cost = path_cost(fast), full_cost = path_cost(full);
+			Assert::IsTrue(fast_cost <= full_cost * 1.05 + 1.0e-3, L"FastDTW cost is far from the full DTW cost");
+			for (int i = 0; i < n; i++)
+				Assert::IsTrue(fabsf(SyntheticTimeWarp(fast.GetPairedFrame(i), n, m) - i) <= 3.0f, L"alignment does not recover the time warp");
+
+			// 動作2のフレームが動作1の半分の速さで進む経路（DisPassAll と同じ形式の表から設定）
+			const int num_frames = 120;
+			const int resolution = 64;
+			const float relative_tolerance = 1.0e-4f;
+			std::vector<std::vector<int> > pass(2, std::vector<int>(num_frames + 10, 0));
+			for (int k = 0; k < num_frames; k++)
+			{
+				pass[0][k] = k;
+				pass[1][k] = k / 2;
+			}
+			FrameAlignmentPath half_speed;
+			Assert::IsTrue(half_speed.SetFromPassTable(pass, num_frames));
+			Assert::IsFalse(FrameAlignmentPath().SetFromPassTable(pass, num_frames + 10), L"non-monotone pass table accepted");
+
+			SyntheticMotionFixture fixture(num_frames, 4);
+			Assert::IsTrue(fixture.IsLoaded());
+			Motion* motion1 = fixture.motion1;
+			Motion* motion2 = fixture.motion2;
+
+			RangeTestAnalyzer analyzer;
+			fixture.SetupAnalyzer(analyzer, resolution);
+			analyzer.BuildAllFeatureFrameCaches(motion1, motion2);
+			Assert::IsTrue(analyzer.HasFrameCache());
+			Assert::IsTrue(analyzer.ComputeFrameCacheAlignment());
+			Assert::IsTrue(analyzer.HasFrameAlignment());
+
+			// 瞬間ボクセル：動作1のフレーム f と動作2のフレーム f / 2 を比較
+			const int instant_frames[] = { 0, 31, 77, num_frames - 1 };
+			for (int f : instant_frames)
+			{
+				for (int feature = 0; feature < SA_FEATURE_COUNT; feature++)
+				{
+					analyzer.SetFrameAlignment(half_speed);
+					analyzer.ComputeInstantFeature(motion1, motion2, (f + 0.5f) * motion1->interval, feature);
+					VoxelGrid aligned1 = analyzer.GetInstantGrid(0, feature);
+					VoxelGrid aligned2 = analyzer.GetInstantGrid(1, feature);
+
+					analyzer.ClearFrameAlignment();
+					analyzer.ComputeInstantFeature(motion1, motion2, (f + 0.5f) * motion1->interval, feature);
+					Assert::IsTrue(MaxRelativeError(aligned1, analyzer.GetInstantGrid(0, feature)) <= relative_tolerance, L"aligned instant motion1 differs");
+					analyzer.ComputeInstantFeature(motion1, motion2, (f / 2 + 0.5f) * motion2->interval, feature);
+					Assert::IsTrue(MaxRelativeError(aligned2, analyzer.GetInstantGrid(1, feature)) <= relative_tolerance, L"aligned instant motion2 differs");
+				}
+			}
+
+			// 累積ボクセル：動作2の前半のフレームはそれぞれ2回累積（占有率は2倍、他の特徴量は最大値のため同じ）
+			analyzer.SetFrameAlignment(half_speed);
+			for (int feature = 0; feature < SA_FEATURE_COUNT; feature++)
+			{
+				analyzer.ComposeAccumulatedFeatureFromFrameCache(motion1, motion2, feature);
+				VoxelGrid reference1, reference2;
+				reference1.Resize(resolution);
+				reference2.Resize(resolution);
+				analyzer.AccumulateFrameCacheRange(motion1, 0, feature, 0, num_frames - 1, reference1);
+				analyzer.AccumulateFrameCacheRange(motion2, 1, feature, 0, (num_frames - 1) / 2, reference2);
+				if (feature == 0)
+				{
+					for (float& v : reference2.data)
+						v *= 2.0f;
+				}
+				Assert::IsTrue(MaxRelativeError(analyzer.GetAccumulatedGrid(0, feature), reference1) <= relative_tolerance, L"aligned accumulation of motion1 differs");
+				Assert::IsTrue(MaxRelativeError(analyzer.GetAccumulatedGrid(1, feature), reference2) <= relative_tolerance, L"aligned accumulation of motion2 differs");
+			}
+			analyzer.ClearFrameAlignment();
+		}
+	};
+}
@@ -0,0 +1,305 @@
+#include "pch.h"
+#include "BenchmarkHarness.h"
+
+#include "../BVH.h"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+namespace PerformanceTests1
+{
+	static std::vector<AnalysisBenchmarkRecord> s_benchmark_records;
+	static BenchmarkMessageFunc s_benchmark_logger = NULL;
+	static BenchmarkMessageFunc s_benchmark_failure_handler = NULL;
+	static int s_benchmark_failure_count = 0;
+	static bool s_benchmark_quick_mode = false;
+
+	void SetBenchmarkLogger(BenchmarkMessageFunc logger)
+	{
+		s_benchmark_logger = logger;
+	}
+
+	void SetBenchmarkFailureHandler(BenchmarkMessageFunc handler)
+	{
+		s_benchmark_failure_handler = handler;
+	}
+
+	void WriteBenchmarkLog(const char* message)
+	{
+		if (s_benchmark_logger)
+			s_benchmark_logger(message);
+		else
+			fputs(message, stdout);
+	}
+
+	void ExpectBenchmark(bool condition, const char* message)
+	{
+		if (condition)
+			return;
+		s_benchmark_failure_count++;
+		if (s_benchmark_failure_handler)
+			s_benchmark_failure_handler(message);
+		else
+			fprintf(stderr, "FAILED: %s\n", message);
+	}
+
+	int GetBenchmarkFailureCount()
+	{
+		return s_benchmark_failure_count;
+	}
+
+	void SetBenchmarkQuickMode(bool quick)
+	{
+		s_benchmark_quick_mode = quick;
+	}
+
+	const BenchmarkSweep& GetBenchmarkSweep()
+	{
+		// 簡易計測では最小の解像度・フレーム数と、全ての処理（DTW は41体節以上）を計測できる関節数のみを使用
+		static const BenchmarkSweep full = {
+			std::vector<int>(std::begin(kBenchResolutions), std::end(kBenchResolutions)),
+			std::vector<int>(std::begin(kBenchFrameCounts), std::end(kBenchFrameCounts)),
+			std::vector<int>(std::begin(kBenchJointsPerChain), std::end(kBenchJointsPerChain)) };
+		static const BenchmarkSweep quick = {
+			std::vector<int>(1, kBenchResolutions[0]),
+			std::vector<int>(1, kBenchFrameCounts[0]),
+			std::vector<int>(1, kBenchJointsPerChain[1]) };
+		return s_benchmark_quick_mode ? quick : full;
+	}
+
+	std::vector<AnalysisBenchmarkRecord>& GetBenchmarkRecords()
+	{
+		return s_benchmark_records;
+	}
+
+	void AddBenchmarkRecord(const AnalysisBenchmarkRecord& record)
+	{
+		s_benchmark_records.push_back(record);
+
+		char message[256];
+		snprintf(message, sizeof(message), "%s res=%d frames=%d segments=%d: mean=%.3fms min=%.3fms (x%d) scratch: allocs=%lld peak=%zuKB\n",
+			record.name.c_str(), record.resolution, record.frames, record.segments, record.mean_ms, record.min_ms, record.iterations,
+			record.scratch_system_allocations, record.scratch_peak_bytes / 1024);
+		WriteBenchmarkLog(message);
+	}
+
+	bool WriteBenchmarkJSON(const char* file_name)
+	{
+		std::ofstream file(file_name);
+		if (!file)
+			return false;
+
+		file << "{\n  \"benchmarks\": [\n";
+		for (size_t i = 0; i < s_benchmark_records.size(); i++)
+		{
+			const AnalysisBenchmarkRecord& r = s_benchmark_records[i];
+			char line[512];
+			snprintf(line, sizeof(line),
+				"    { \"name\": \"%s\", \"resolution\": %d, \"frames\": %d, \"segments\": %d, \"iterations\": %d, \"mean_ms\": %.4f, \"min_ms\": %.4f, "
+				"\"scratch_system_allocations\": %lld, \"scratch_peak_bytes\": %zu }%s\n",
+				r.name.c_str(), r.resolution, r.frames, r.segments, r.iterations, r.mean_ms, r.min_ms,
+				r.scratch_system_allocations, r.scratch_peak_bytes,
+				(i + 1 < s_benchmark_records.size()) ? "," : "");
+			file << line;
+		}
+		file << "  ]\n}\n";
+		return (bool)file;
+	}
+
+	std::string WriteSyntheticBVH(int num_frames, int joints_per_chain, float phase)
+	{
+		char file_name[128];
+		snprintf(file_name, sizeof(file_name), "bench_motion_%d_%d_%d.bvh", num_frames, joints_per_chain, (int)(phase * 100.0f));
+
+		// 各連なりの付け根の位置・伸びる方向・長さ [cm]
+		const float chain_roots[kBenchNumChains][3] = { { 0, 5, 0 }, { -15, 45, 0 }, { 15, 45, 0 }, { -10, 0, 0 }, { 10, 0, 0 } };
+		const float chain_dirs[kBenchNumChains][3] = { { 0, 1, 0 }, { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, -1, 0 } };
+		const float chain_lengths[kBenchNumChains] = { 50.0f, 55.0f, 55.0f, 85.0f, 85.0f };
+
+		std::ofstream file(file_name);
+		file << "HIERARCHY\nROOT Hips\n{\n\tOFFSET 0 90 0\n\tCHANNELS 6 Xposition Yposition Zposition Zrotation Xrotation Yrotation\n";
+		for (int c = 0; c < kBenchNumChains; c++)
+		{
+			float step = chain_lengths[c] / joints_per_chain;
+			for (int k = 0; k < joints_per_chain; k++)
+			{
+				std::string indent(k + 1, '\t');
+				float offset[3];
+				for (int d = 0; d < 3; d++)
+					offset[d] = (k == 0) ? chain_roots[c][d] : chain_dirs[c][d] * step;
+				file << indent << "JOINT Chain" << c << "_" << k << "\n" << indent << "{\n";
+				file << indent << "\tOFFSET " << offset[0] << " " << offset[1] << " " << offset[2] << "\n";
+				file << indent << "\tCHANNELS 3 Zrotation Xrotation Yrotation\n";
+			}
+			std::string indent(joints_per_chain + 1, '\t');
+			file << indent << "End Site\n" << indent << "{\n" << indent << "\tOFFSET "
+				<< chain_dirs[c][0] * step << " " << chain_dirs[c][1] * step << " " << chain_dirs[c][2] * step << "\n" << indent << "}\n";
+			for (int k = joints_per_chain - 1; k >= 0; k--)
+				file << std::string(k + 1, '\t') << "}\n";
+		}
+		file << "}\n";
+
+		const float interval = 1.0f / 30.0f;
+		file << "MOTION\nFrames: " << num_frames << "\nFrame Time: " << interval << "\n";
+		for (int f = 0; f < num_frames; f++)
+		{
+			float t = f * interval + phase;
+			file << 0.0f << " " << 90.0f + 2.0f * sinf(6.0f * t) << " " << 100.0f * f * interval << " "
+				<< 0.0f << " " << 0.0f << " " << 20.0f * sinf(0.5f * t);
+			for (int c = 0; c < kBenchNumChains; c++)
+				for (int k = 0; k < joints_per_chain; k++)
+					file << " " << 15.0f * sinf(2.0f * t + c + 0.5f * k)
+						<< " " << 25.0f * sinf(3.0f * t + 0.7f * c + k)
+						<< " " << 5.0f * sinf(t + k);
+			file << "\n";
+		}
+		return file_name;
+	}
+
+	Motion* LoadSyntheticMotion(int num_frames, int joints_per_chain, float phase, const Skeleton* body)
+	{
+		std::string file_name = WriteSyntheticBVH(num_frames, joints_per_chain, phase);
+		BVH bvh(file_name.c_str());
+		Motion* motion = bvh.IsLoadSuccess() ? CoustructBVHMotion(&bvh, body) : NULL;
+		std::remove(file_name.c_str());
+		return motion;
+	}
+
+	void DeleteSyntheticMotion(Motion* motion)
+	{
+		if (motion)
+			delete motion;
+	}
+
+	void SetBenchmarkWorldBounds(SpatialAnalysisCore& analyzer, const Motion* m1, const Motion* m2)
+	{
+		float bounds[3][2] = { { 1.0e6f, -1.0e6f }, { 1.0e6f, -1.0e6f }, { 1.0e6f, -1.0e6f } };
+		std::vector<Matrix4f> seg_frames;
+		const Motion* motions[2] = { m1, m2 };
+		for (const Motion* m : motions)
+		{
+			for (int f = 0; f < m->num_frames; f++)
+			{
+				ForwardKinematics(m->frames[f], seg_frames);
+				for (const Matrix4f& frame : seg_frames)
+				{
+					const float pos[3] = { frame.m03, frame.m13, frame.m23 };
+					for (int d = 0; d < 3; d++)
+					{
+						bounds[d][0] = std::min(bounds[d][0], pos[d] - 0.3f);
+						bounds[d][1] = std::max(bounds[d][1], pos[d] + 0.3f);
+					}
+				}
+			}
+		}
+		analyzer.SetWorldBounds(bounds);
+	}
+
+	void RemoveVoxelCacheFiles(const SpatialAnalysisCore& analyzer, const char* name1, const char* name2)
+	{
+		static const char* prefixes[SA_FEATURE_COUNT] = { "acc", "spd_acc", "jrk_acc", "ine_acc", "pax_acc" };
+		std::string base = analyzer.GenerateCacheFilename(name1, name2);
+		for (int f = 0; f < SA_FEATURE_COUNT; f++)
+		{
+			std::remove((base + "_" + prefixes[f] + "1.bin").c_str());
+			std::remove((base + "_" + prefixes[f] + "2.bin").c_str());
+			std::remove((base + "_" + prefixes[f] + "_diff.bin").c_str());
+		}
+		std::remove((base + "_meta.txt").c_str());
+		std::remove(SpatialAnalysisCore::GenerateFrameCacheFilename(base, 0).c_str());
+		std::remove(SpatialAnalysisCore::GenerateFrameCacheFilename(base, 1).c_str());
+	}
+
+	void MakeSyntheticVoxelGridPair(size_t n, std::vector<float>& a, std::vector<float>& b)
+	{
+		a.assign(n, 0.0f);
+		b.assign(n, 0.0f);
+		unsigned int seed = 12345;
+		for (size_t i = 0; i < n; i++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			if ((seed >> 24) < 16)
+			{
+				a[i] = (float)((seed >> 8) & 0xffff) / 65536.0f;
+				b[i] = (seed & 1) ? a[i] * 0.5f : -0.0f;
+			}
+			else if ((seed >> 24) < 20)
+				b[i] = -(float)((seed >> 4) & 0xfff) / 4096.0f;
+		}
+	}
+
+	void MakeSyntheticGroupTakes(int resolution, int num_takes, std::vector<VoxelGrid>& takes)
+	{
+		const size_t n = (size_t)resolution * resolution * resolution;
+		takes.assign(num_takes, VoxelGrid());
+		unsigned int seed = 2468;
+		for (int t = 0; t < num_takes; t++)
+		{
+			takes[t].Resize(resolution);
+			for (size_t i = 0; i < n; i++)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				if ((i % 7) < 2 && (seed >> 24) < 160)
+					takes[t].data[i] = 1.0f + (float)((seed >> 8) & 0xffff) / 16384.0f;
+			}
+		}
+	}
+
+	// 列 a の時刻 t の d 次元目の値
+	static float SyntheticSequenceValue(float t, int d)
+	{
+		return sinf(0.05f * (d + 1) * t + d) + 0.5f * cosf(0.031f * t * (d % 3 + 1));
+	}
+
+	float SyntheticTimeWarp(int j, int n, int m)
+	{
+		const float kPi = 3.14159265f;
+		return j * (float)(n - 1) / (m - 1) + 8.0f * sinf(kPi * j / (m - 1));
+	}
+
+	void MakeSyntheticWarpedSequences(int n, int m, int dims, std::vector<float>& a, std::vector<float>& b)
+	{
+		a.resize((size_t)n * dims);
+		b.resize((size_t)m * dims);
+		for (int i = 0; i < n; i++)
+			for (int d = 0; d < dims; d++)
+				a[(size_t)i * dims + d] = SyntheticSequenceValue((float)i, d);
+		for (int j = 0; j < m; j++)
+			for (int d = 0; d < dims; d++)
+				b[(size_t)j * dims + d] = SyntheticSequenceValue(SyntheticTimeWarp(j, n, m), d);
+	}
+
+	SyntheticMotionFixture::SyntheticMotionFixture(int num_frames, int joints_per_chain, float phase2)
+		: motion1(NULL), motion2(NULL), paired(phase2 >= 0.0f)
+	{
+		motion1 = LoadSyntheticMotion(num_frames, joints_per_chain, 0.0f);
+		if (motion1 && paired)
+			motion2 = LoadSyntheticMotion(num_frames, joints_per_chain, phase2, motion1->body);
+	}
+
+	SyntheticMotionFixture::~SyntheticMotionFixture()
+	{
+		const Skeleton* body = motion1 ? motion1->body : NULL;
+		DeleteSyntheticMotion(motion1);
+		DeleteSyntheticMotion(motion2);
+		delete body;
+	}
+
+	bool SyntheticMotionFixture::IsLoaded() const
+	{
+		return motion1 && (motion2 || !paired);
+	}
+
+	int SyntheticMotionFixture::GetNumSegments() const
+	{
+		return motion1 ? motion1->body->num_segments : 0;
+	}
+
+	void SyntheticMotionFixture::SetupAnalyzer(SpatialAnalysisCore& analyzer, int resolution) const
+	{
+		analyzer.ResizeGrids(resolution);
+		SetBenchmarkWorldBounds(analyzer, motion1, GetSecondMotion());
+	}
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+// 解析処理の計測の共通処理（計測結果の記録・出力、合成動作データの生成）
+// MSTest（AnalysisBenchmarks.cpp）と、CMake でビルドする計測プログラム（BenchmarkMain.cpp）の両方から使用する
+// （OpenGL に依存しない処理のみを使用するため、SH_GL_DISABLED を定義してビルドしたライブラリとリンクできる）
+
+#include "../SimpleHuman.h"
+#include "../SpatialAnalysisCore.h"
+#include "../ScratchArena.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace PerformanceTests1
+{
+	// 計測条件（ボクセル解像度・フレーム数・体節ごとの関節数）
+	static const int kBenchResolutions[] = { 32, 64, 128 };
+	static const int kBenchFrameCounts[] = { 30, 120 };
+	static const int kBenchJointsPerChain[] = { 4, 8 };
+
+	// 合成骨格の関節の連なり（背骨・左右の腕・左右の脚）の数
+	static const int kBenchNumChains = 5;
+
+	// 計測結果の出力ファイル
+	static const char* const kBenchResultFileName = "benchmark_results.json";
+
+	// 計測条件の組み合わせ（簡易計測では各条件を最小の1つずつに絞る）
+	struct BenchmarkSweep
+	{
+		std::vector<int> resolutions;
+		std::vector<int> frame_counts;
+		std::vector<int> joints_per_chain;
+	};
+
+	// 1項目の計測結果（解像度を持たない処理は resolution = 0）
+	struct AnalysisBenchmarkRecord
+	{
+		std::string name;
+		int resolution;
+		int frames;
+		int segments;
+		int iterations;
+		double mean_ms;
+		double min_ms;
+		long long scratch_system_allocations; // 計測中の作業領域（現在のスレッドのアリーナ）のブロックの確保回数
+		size_t scratch_peak_bytes;            // 計測中の作業領域の使用量の最大値
+	};
+
+	// 計測結果のログの出力先・計測中の失敗の通知先（未設定なら標準出力に出力し、失敗の回数を数える）
+	typedef void (*BenchmarkMessageFunc)(const char* message);
+	void SetBenchmarkLogger(BenchmarkMessageFunc logger);
+	void SetBenchmarkFailureHandler(BenchmarkMessageFunc handler);
+	void WriteBenchmarkLog(const char* message);
+
+	// 計測の前提条件の確認（満たさない場合は失敗を通知）
+	void ExpectBenchmark(bool condition, const char* message);
+	int GetBenchmarkFailureCount();
+
+	// 簡易計測の設定と、現在の計測条件の組み合わせの取得
+	void SetBenchmarkQuickMode(bool quick);
+	const BenchmarkSweep& GetBenchmarkSweep();
+
+	// 記録済みの計測結果
+	std::vector<AnalysisBenchmarkRecord>& GetBenchmarkRecords();
+
+	// 計測結果を記録してログに出力
+	void AddBenchmarkRecord(const AnalysisBenchmarkRecord& record);
+
+	// 処理を指定回数実行して平均・最小の実行時間を記録
+	template <class Func>
+	void MeasureBenchmark(const char* name, int resolution, int frames, int segments, int iterations, Func func)
+	{
+		ScratchArena& arena = GetThreadScratchArena();
+		arena.ResetStatistics();
+
+		double total = 0.0, best = 1.0e30;
+		for (int i = 0; i < iterations; i++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			func();
+			double msec = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			total += msec;
+			best = std::min(best, msec);
+		}
+
+		AnalysisBenchmarkRecord record;
+		record.name = name;
+		record.resolution = resolution;
+		record.frames = frames;
+		record.segments = segments;
+		record.iterations = iterations;
+		record.mean_ms = total / iterations;
+		record.min_ms = best;
+		record.scratch_system_allocations = arena.GetStatistics().num_system_allocations;
+		record.scratch_peak_bytes = arena.GetStatistics().peak_bytes;
+		AddBenchmarkRecord(record);
+	}
+
+	// 計測結果を JSON 形式で出力
+	bool WriteBenchmarkJSON(const char* file_name);
+
+	// 合成動作データのBVHファイルを出力
+	// 腰から背骨・左右の腕・左右の脚の関節の連なりを伸ばし、各関節を位相の異なる正弦波で回転させる
+	std::string WriteSyntheticBVH(int num_frames, int joints_per_chain, float phase);
+
+	// 合成動作データの読み込み
+	Motion* LoadSyntheticMotion(int num_frames, int joints_per_chain, float phase, const Skeleton* body = NULL);
+
+	// 動作データの削除（骨格モデルは呼び出し側で削除）
+	void DeleteSyntheticMotion(Motion* motion);
+
+	// 2つの動作の全フレームを含む範囲をボクセル化の対象領域として設定
+	void SetBenchmarkWorldBounds(SpatialAnalysisCore& analyzer, const Motion* m1, const Motion* m2);
+
+	// ボクセルキャッシュのファイルを削除（ファイル名は SpatialAnalysisCore::SaveVoxelCache と同じ規則）
+	void RemoveVoxelCacheFiles(const SpatialAnalysisCore& analyzer, const char* name1, const char* name2);
+
+	// 大部分が 0 の疎な2つのボクセルグリッドの値の配列（負の値・-0 を含む、ボクセルグリッドの演算用）
+	void MakeSyntheticVoxelGridPair(size_t n, std::vector<float>& a, std::vector<float>& b);
+
+	// 試行ごとに一部のボクセルのみ値を持つ疎なボクセルグリッド（試行によって値を持つボクセルが異なる、集団の統計モデル用）
+	void MakeSyntheticGroupTakes(int resolution, int num_takes, std::vector<VoxelGrid>& takes);
+
+	// 長さ n, m の dims 次元の特徴量の列（列 b は列 a の時刻 SyntheticTimeWarp(j) の値、フレームの対応付け用）
+	void MakeSyntheticWarpedSequences(int n, int m, int dims, std::vector<float>& a, std::vector<float>& b);
+	float SyntheticTimeWarp(int j, int n, int m);
+
+	//
+	//  計測用の合成動作データ（同じ骨格の2つの動作、もしくは1つの動作）
+	//  動作と骨格モデルはデストラクタで削除する
+	//
+	struct SyntheticMotionFixture
+	{
+		Motion* motion1;
+		Motion* motion2; // 1つの動作のみの場合は NULL
+
+		// 2つ目の動作は phase2 だけ位相をずらして生成（phase2 が負の場合は1つの動作のみ）
+		SyntheticMotionFixture(int num_frames, int joints_per_chain, float phase2 = 0.4f);
+		~SyntheticMotionFixture();
+
+		bool IsLoaded() const;
+		int GetNumSegments() const;
+
+		// 解析の2つ目の動作（1つの動作のみの場合は1つ目と同じ動作）
+		Motion* GetSecondMotion() const { return motion2 ? motion2 : motion1; }
+
+		// 解析クラスのボクセル解像度と、全フレームを含む対象領域を設定
+		void SetupAnalyzer(SpatialAnalysisCore& analyzer, int resolution) const;
+
+	private:
+		bool paired; // 2つの動作を生成するかどうか
+
+		SyntheticMotionFixture(const SyntheticMotionFixture&);
+		SyntheticMotionFixture& operator=(const SyntheticMotionFixture&);
+	};
+}
@@ -0,0 +1,45 @@
+#include "pch.h"
+#include "BenchmarkHarness.h"
+#include "HotPathBenchmarks.h"
+
+#include <cstdio>
+#include <cstring>
+
+// 解析処理の主要な処理の計測プログラム（CMake でビルドし、MSTest を使わない環境で実行する）
+// 使い方: AnalysisBenchmarksMain [--quick] [出力ファイル名]
+//        AnalysisBenchmarksMain --write-bvh
+//   --quick を指定すると、最小の計測条件のみを計測する（ctest から実行する場合）
+//   --write-bvh を指定すると、計測せずに位相の異なる合成動作の BVH ファイルの組を出力する（SpatialAnalysisCLI の ctest 用）
+//   計測結果は標準出力と、出力ファイル（既定は benchmark_results.json）に出力する
+// --write-bvh で出力する合成動作のフレーム数・連なりごとの関節数（出力ファイル名は CMakeLists.txt の ctest と合わせる）
+static const int kSmokeBVHFrames = 60;
+static const int kSmokeBVHJointsPerChain = 3;
+
+int main(int argc, char** argv)
+{
+	using namespace PerformanceTests1;
+
+	const char* result_file_name = kBenchResultFileName;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--quick") == 0)
+			SetBenchmarkQuickMode(true);
+		else if (strcmp(argv[i], "--write-bvh") == 0)
+		{
+			for (float phase : { 0.0f, 0.5f })
+				printf("%s\n", WriteSyntheticBVH(kSmokeBVHFrames, kSmokeBVHJointsPerChain, phase).c_str());
+			return 0;
+		}
+		else
+			result_file_name = argv[i];
+	}
+
+	RunHotPathBenchmarks();
+
+	if (!WriteBenchmarkJSON(result_file_name))
+	{
+		fprintf(stderr, "failed to write %s\n", result_file_name);
+		return 1;
+	}
+	return (GetBenchmarkFailureCount() == 0) ? 0 : 1;
+}
@@ -0,0 +1,264 @@
+#include "pch.h"
+#include "HotPathBenchmarks.h"
+#include "BenchmarkHarness.h"
+
+#include "../SimpleHuman.h"
+#include "../BVH.h"
+#include "../SpatialAnalysisCore.h"
+#include "../InverseKinematicsCCD.h"
+#include "../MotionPlaybackDTW.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace PerformanceTests1
+{
+	// DTWの結果として確保される配列の削除
+	static void DeleteDTWArrays(DTWinformation& dtw)
+	{
+		delete[] dtw.Seg_Color;
+		delete[] dtw.Pa_Color;
+		delete[] dtw.ErrorDisTotalPart;
+		delete[] dtw.DisOrder;
+		delete[] dtw.ErrorAngTotalPart;
+		delete[] dtw.AngOrder;
+	}
+
+	// 合成骨格の関節の連なりの付け根・先端の関節番号（関節名は WriteSyntheticBVH の出力と同じ）
+	static void FindChainJoints(const Skeleton* body, int chain, int joints_per_chain, int& base_joint_no, int& ee_joint_no)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "Chain%d_0", chain);
+		base_joint_no = FindJoint(body, name);
+		snprintf(name, sizeof(name), "Chain%d_%d", chain, joints_per_chain - 1);
+		ee_joint_no = FindJoint(body, name);
+	}
+
+	void BenchmarkMotionLoadAndKinematics()
+	{
+		const BenchmarkSweep& sweep = GetBenchmarkSweep();
+		for (int num_frames : sweep.frame_counts)
+		{
+			for (int joints_per_chain : sweep.joints_per_chain)
+			{
+				std::string file_name = WriteSyntheticBVH(num_frames, joints_per_chain, 0.0f);
+				BVH bvh(file_name.c_str());
+				Motion* motion = bvh.IsLoadSuccess() ? CoustructBVHMotion(&bvh) : NULL;
+				ExpectBenchmark(motion != NULL, "failed to load synthetic BVH");
+				if (!motion)
+				{
+					std::remove(file_name.c_str());
+					continue;
+				}
+				const int num_segments = motion->body->num_segments;
+
+				MeasureBenchmark("BVH::Load", 0, num_frames, num_segments, 5, [&]() {
+					BVH loaded;
+					loaded.Load(file_name.c_str());
+				});
+				MeasureBenchmark("CoustructBVHMotion", 0, num_frames, num_segments, 5, [&]() {
+					DeleteSyntheticMotion(CoustructBVHMotion(&bvh, motion->body));
+				});
+
+				std::vector<Matrix4f> seg_frames;
+				std::vector<Point3f> joint_positions;
+				MeasureBenchmark("ForwardKinematics", 0, num_frames, num_segments, 10, [&]() {
+					for (int f = 0; f < motion->num_frames; f++)
+						ForwardKinematics(motion->frames[f], seg_frames, joint_positions);
+				});
+
+				Posture posture(motion->body);
+				MeasureBenchmark("PostureInterpolation", 0, num_frames, num_segments, 10, [&]() {
+					for (int f = 0; f + 1 < motion->num_frames; f++)
+						PostureInterpolation(motion->frames[f], motion->frames[f + 1], 0.5f, posture);
+				});
+
+				const Skeleton* body = motion->body;
+				DeleteSyntheticMotion(motion);
+				delete body;
+				std::remove(file_name.c_str());
+			}
+		}
+	}
+
+	// 左右の腕の先端の関節を、腕の付け根との距離が2割縮む位置に移動する拘束条件で計測
+	void BenchmarkInverseKinematicsCCD()
+	{
+		const BenchmarkSweep& sweep = GetBenchmarkSweep();
+		for (int num_frames : sweep.frame_counts)
+		{
+			for (int joints_per_chain : sweep.joints_per_chain)
+			{
+				SyntheticMotionFixture fixture(num_frames, joints_per_chain, -1.0f);
+				ExpectBenchmark(fixture.IsLoaded(), "failed to load synthetic motion");
+				if (!fixture.IsLoaded())
+					continue;
+				const Motion* motion = fixture.motion1;
+				const Skeleton* body = motion->body;
+				const int num_segments = fixture.GetNumSegments();
+
+				// 左右の腕（関節の連なり 1, 2）の拘束条件
+				std::vector<IKMotionConstraint> constraints(2);
+				std::vector<Matrix4f> seg_frames;
+				std::vector<Point3f> joint_positions;
+				for (int c = 0; c < 2; c++)
+				{
+					IKMotionConstraint& constraint = constraints[c];
+					FindChainJoints(body, 1 + c, joints_per_chain, constraint.base_joint_no, constraint.ee_joint_no);
+					constraint.targets.resize(motion->num_frames);
+				}
+				ExpectBenchmark(constraints[0].ee_joint_no >= 0 && constraints[1].ee_joint_no >= 0, "failed to find chain joints");
+				if (constraints[0].ee_joint_no < 0 || constraints[1].ee_joint_no < 0)
+					continue;
+				for (int f = 0; f < motion->num_frames; f++)
+				{
+					ForwardKinematics(motion->frames[f], seg_frames, joint_positions);
+					for (IKMotionConstraint& constraint : constraints)
+					{
+						Point3f target;
+						target.interpolate(joint_positions[constraint.base_joint_no], joint_positions[constraint.ee_joint_no], 0.8f);
+						constraint.targets[f] = target;
+					}
+				}
+
+				// 1姿勢ごとの計算（関節のパスの探索を含む）
+				Posture posture(body);
+				MeasureBenchmark("ApplyInverseKinematicsCCD", 0, num_frames, num_segments, 2, [&]() {
+					for (int f = 0; f < motion->num_frames; f++)
+					{
+						posture = motion->frames[f];
+						ApplyInverseKinematicsCCD(posture, constraints[0].base_joint_no, constraints[0].ee_joint_no, constraints[0].targets[f]);
+					}
+				});
+
+				// 動作全体の計算（1スレッド・ハードウェアの並列数）
+				Motion work(*motion);
+				IKMotionResult result;
+				MeasureBenchmark("ApplyInverseKinematicsCCDToMotion/1thread", 0, num_frames, num_segments, 2, [&]() {
+					for (int f = 0; f < motion->num_frames; f++)
+						work.frames[f] = motion->frames[f];
+					ApplyInverseKinematicsCCDToMotion(work, constraints, &result, 1);
+				});
+				MeasureBenchmark("ApplyInverseKinematicsCCDToMotion/parallel", 0, num_frames, num_segments, 2, [&]() {
+					for (int f = 0; f < motion->num_frames; f++)
+						work.frames[f] = motion->frames[f];
+					ApplyInverseKinematicsCCDToMotion(work, constraints, &result, 0);
+				});
+				ExpectBenchmark((int)result.residuals.size() == motion->num_frames, "IK result does not cover all frames");
+			}
+		}
+	}
+
+	void BenchmarkSegmentSparseVoxelization()
+	{
+		const BenchmarkSweep& sweep = GetBenchmarkSweep();
+		const int num_frames = sweep.frame_counts[0];
+		for (int joints_per_chain : sweep.joints_per_chain)
+		{
+			SyntheticMotionFixture fixture(num_frames, joints_per_chain, -1.0f);
+			ExpectBenchmark(fixture.IsLoaded(), "failed to load synthetic motion");
+			if (!fixture.IsLoaded())
+				continue;
+			Motion* motion = fixture.motion1;
+
+			for (int resolution : sweep.resolutions)
+			{
+				SpatialAnalysisCore analyzer;
+				fixture.SetupAnalyzer(analyzer, resolution);
+
+				std::vector<std::vector<SparseVoxel>> sparse_values;
+				int frame = 0;
+				MeasureBenchmark("BuildSegmentSparseBaseValues", resolution, 1, fixture.GetNumSegments(), 10, [&]() {
+					analyzer.BuildSegmentSparseBaseValues(motion, frame * motion->interval, sparse_values);
+					frame = (frame + 3) % motion->num_frames;
+				});
+			}
+		}
+	}
+
+	void BenchmarkFrameCacheComposeAndFileIO()
+	{
+		const BenchmarkSweep& sweep = GetBenchmarkSweep();
+		for (int num_frames : sweep.frame_counts)
+		{
+			for (int joints_per_chain : sweep.joints_per_chain)
+			{
+				SyntheticMotionFixture fixture(num_frames, joints_per_chain);
+				ExpectBenchmark(fixture.IsLoaded(), "failed to load synthetic motion");
+				if (!fixture.IsLoaded())
+					continue;
+				Motion* motion1 = fixture.motion1;
+				Motion* motion2 = fixture.motion2;
+				const int num_segments = fixture.GetNumSegments();
+
+				for (int resolution : sweep.resolutions)
+				{
+					SpatialAnalysisCore analyzer;
+					fixture.SetupAnalyzer(analyzer, resolution);
+
+					MeasureBenchmark("BuildAllFeatureFrameCaches", resolution, num_frames, num_segments, 1, [&]() {
+						analyzer.BuildAllFeatureFrameCaches(motion1, motion2);
+					});
+
+					// 対象領域の再設定により合成済みの結果を無効化して、全特徴量の合成を計測
+					MeasureBenchmark("ComposeAccumulatedFeatureFromFrameCache", resolution, num_frames, num_segments, 2, [&]() {
+						analyzer.SetWorldBounds(analyzer.world_bounds);
+						for (int feature = 0; feature < SA_FEATURE_COUNT; feature++)
+							analyzer.ComposeAccumulatedFeatureFromFrameCache(motion1, motion2, feature);
+					});
+
+					const char* name1 = "bench_motion1";
+					const char* name2 = "bench_motion2";
+					bool saved = true, loaded = true;
+					MeasureBenchmark("SaveVoxelCache", resolution, num_frames, num_segments, 1, [&]() {
+						saved = analyzer.SaveVoxelCache(name1, name2);
+					});
+					MeasureBenchmark("LoadVoxelCache", resolution, num_frames, num_segments, 1, [&]() {
+						loaded = analyzer.LoadVoxelCache(name1, name2);
+					});
+					// 読み込み時にマップしたフレームキャッシュのファイルを閉じてから削除
+					analyzer.BuildAllFeatureFrameCaches(nullptr, nullptr);
+					RemoveVoxelCacheFiles(analyzer, name1, name2);
+					ExpectBenchmark(saved && loaded, "failed to save or load voxel cache");
+				}
+			}
+		}
+	}
+
+	// DTWinformation_init は体節番号39までを固定の部位に割り当てるため、41体節以上の骨格でのみ計測する
+	void BenchmarkDTWInitialization()
+	{
+		const BenchmarkSweep& sweep = GetBenchmarkSweep();
+		for (int num_frames : sweep.frame_counts)
+		{
+			for (int joints_per_chain : sweep.joints_per_chain)
+			{
+				if (1 + kBenchNumChains * joints_per_chain < 41)
+					continue;
+
+				SyntheticMotionFixture fixture(num_frames, joints_per_chain);
+				ExpectBenchmark(fixture.IsLoaded(), "failed to load synthetic motion");
+				if (!fixture.IsLoaded())
+					continue;
+				Motion* motion1 = fixture.motion1;
+				Motion* motion2 = fixture.motion2;
+
+				MeasureBenchmark("DTWinformation_init", 0, num_frames, fixture.GetNumSegments(), 2, [&]() {
+					DTWinformation dtw;
+					dtw.DTWinformation_init(motion1->num_frames, motion2->num_frames, *motion1, *motion2);
+					DeleteDTWArrays(dtw);
+				});
+			}
+		}
+	}
+
+	void RunHotPathBenchmarks()
+	{
+		BenchmarkMotionLoadAndKinematics();
+		BenchmarkInverseKinematicsCCD();
+		BenchmarkSegmentSparseVoxelization();
+		BenchmarkFrameCacheComposeAndFileIO();
+		BenchmarkDTWInitialization();
+	}
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+// 解析処理の主要な処理の実行時間の計測（計測条件は GetBenchmarkSweep() に従う）
+// 各処理は OpenGL に依存しないため、MSTest（AnalysisBenchmarks.cpp）と CMake でビルドする計測プログラム（BenchmarkMain.cpp）の両方から実行する
+
+namespace PerformanceTests1
+{
+	// BVHファイルの読み込み・動作データの構築・順運動学・姿勢補間
+	void BenchmarkMotionLoadAndKinematics();
+
+	// 逆運動学計算（CCD法）の1姿勢ごとの計算と、動作全体の計算（1スレッド・並列）
+	void BenchmarkInverseKinematicsCCD();
+
+	// 1フレーム分の部位ごとの疎ボクセルの計算
+	void BenchmarkSegmentSparseVoxelization();
+
+	// 全フレームの疎ボクセルキャッシュの構築・累積ボクセルの合成・ボクセルキャッシュの保存と読み込み
+	void BenchmarkFrameCacheComposeAndFileIO();
+
+	// DTWによる2つの動作の位置・角度誤差の計算
+	void BenchmarkDTWInitialization();
+
+	// 上記の全ての計測
+	void RunHotPathBenchmarks();
+}
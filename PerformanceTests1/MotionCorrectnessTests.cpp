@@ -0,0 +1,568 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "BenchmarkHarness.h"
+
+#include "../SimpleHuman.h"
+#include "../PoseIndex.h"
+#include "../MotionDeformation.h"
+#include "../MotionGraph.h"
+#include "../InverseKinematicsCCD.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace PerformanceTests1
+{
+	// 合成動作データの関節数・フレーム数（動作の処理の検証用）
+	static const int kMotionTestJointsPerChain = 3;
+	static const int kMotionTestFrames = 120;
+
+	// 同じ骨格の位相の異なる合成動作（動作と骨格モデルはデストラクタで削除する）
+	struct SyntheticMotionSet
+	{
+		std::vector<Motion*> motions;
+
+		SyntheticMotionSet(const float* phases, int num_motions, int num_frames = kMotionTestFrames)
+		{
+			const Skeleton* body = NULL;
+			for (int i = 0; i < num_motions; i++)
+			{
+				Motion* motion = LoadSyntheticMotion(num_frames, kMotionTestJointsPerChain, phases[i], body);
+				motions.push_back(motion);
+				if (motion && !body)
+					body = motion->body;
+			}
+		}
+		~SyntheticMotionSet()
+		{
+			const Skeleton* body = (!motions.empty() && motions[0]) ? motions[0]->body : NULL;
+			for (Motion* motion : motions)
+				DeleteSyntheticMotion(motion);
+			delete body;
+		}
+		bool IsLoaded() const
+		{
+			return std::find(motions.begin(), motions.end(), (Motion*)NULL) == motions.end();
+		}
+	};
+
+	// 近似探索の結果のうち、厳密な探索の上位 k 個の距離以内に入るものの割合（同じ距離のフレームはどれを返しても正解とする）
+	static float RecallAtK(const std::vector<PoseIndexResult>& approx, const std::vector<PoseIndexResult>& exact)
+	{
+		if (exact.empty())
+			return 1.0f;
+		float threshold = exact.back().distance * (1.0f + 1.0e-5f) + 1.0e-7f;
+		int hits = 0;
+		for (const PoseIndexResult& r : approx)
+			if (r.distance <= threshold)
+				hits++;
+		return (float)std::min(hits, (int)exact.size()) / exact.size();
+	}
+
+	// 2つの姿勢が一致するか（各関節の回転・ルートの向き・位置の各要素の差が eps 以下）
+	static bool SamePosture(const Posture& a, const Posture& b, float eps)
+	{
+		if ((a.body != b.body) || !a.root_ori.epsilonEquals(b.root_ori, eps) ||
+			(fabsf(a.root_pos.x - b.root_pos.x) > eps) || (fabsf(a.root_pos.y - b.root_pos.y) > eps) || (fabsf(a.root_pos.z - b.root_pos.z) > eps))
+			return false;
+		for (int i = 0; i < a.body->num_joints; i++)
+			if (!a.joint_rotations[i].epsilonEquals(b.joint_rotations[i], eps))
+				return false;
+		return true;
+	}
+
+	// キー時刻の姿勢の一部の関節を回転し、ルートを移動した動作変形情報
+	static void MakeTestDeformation(const Motion& motion, float key_time, float blend, float angle, MotionWarpingParam& deform)
+	{
+		InitDeformationParameter(motion, key_time, blend, blend, deform);
+		Matrix3f rot;
+		rot.rotX(angle);
+		for (int i = 0; i < motion.body->num_joints; i += 2)
+			deform.key_pose.joint_rotations[i].mul(rot);
+		deform.key_pose.root_pos.y += angle * 0.1f;
+	}
+
+	// モーショングラフの遷移候補の比較順（遷移元・遷移先の動作番号・フレーム番号の順）
+	static bool LessTransition(const MotionGraphTransition& a, const MotionGraphTransition& b)
+	{
+		if (a.src_clip != b.src_clip)
+			return a.src_clip < b.src_clip;
+		if (a.src_frame != b.src_frame)
+			return a.src_frame < b.src_frame;
+		if (a.dest_clip != b.dest_clip)
+			return a.dest_clip < b.dest_clip;
+		return a.dest_frame < b.dest_frame;
+	}
+
+	// モーショングラフの遷移候補を、タイル分割・SIMD 命令を使わずに全フレームの組み合わせの距離から求める（MotionGraph::Build の基準）
+	// 距離は SIMD 命令の4要素ごとの部分和と同じ順序で加算し、倍精度で加算した距離との差も確認する
+	static void BuildReferenceTransitions(const vector<const Motion*>& clips, const MotionGraphParam& param, vector<MotionGraphTransition>& transitions)
+	{
+		const Skeleton* body = clips[0]->body;
+		int num_points = (param.window_half_frames * 2 + 1) * body->num_joints;
+		int dim = (num_points * 3 + 3) & ~3;
+
+		vector<int> frame_clips, frame_numbers;
+		vector<char> frame_usable;
+		vector<float> features;
+		for (int c = 0; c < (int)clips.size(); c++)
+		{
+			const Motion& motion = *clips[c];
+			vector<Matrix4f> segment_frames;
+			vector<vector<Point3f>> joint_positions(motion.num_frames);
+			for (int f = 0; f < motion.num_frames; f++)
+				ForwardKinematics(motion.frames[f], segment_frames, joint_positions[f]);
+			int blend_frames = (int)ceil(param.blend_duration / motion.interval);
+			for (int f = 0; f < motion.num_frames; f++)
+			{
+				features.resize(features.size() + dim, 0.0f);
+				ComputeMotionGraphFeature(motion, joint_positions, f, param.window_half_frames, &features[features.size() - dim]);
+				frame_clips.push_back(c);
+				frame_numbers.push_back(f);
+				frame_usable.push_back(f + blend_frames < motion.num_frames);
+			}
+		}
+
+		int total_frames = (int)frame_clips.size();
+		vector<float> distances((size_t)total_frames * total_frames);
+		for (int i = 0; i < total_frames; i++)
+		{
+			for (int j = 0; j < total_frames; j++)
+			{
+				const float* a = &features[(size_t)i * dim];
+				const float* b = &features[(size_t)j * dim];
+				float lanes[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+				double exact = 0.0;
+				for (int k = 0; k < dim; k++)
+				{
+					float d = a[k] - b[k];
+					lanes[k % 4] += d * d;
+					exact += (double)d * d;
+				}
+				float d = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+				Assert::IsTrue(fabs(d - exact) <= 1.0e-4 * exact + 1.0e-9);
+				distances[(size_t)i * total_frames + j] = d;
+			}
+		}
+
+		float threshold = param.distance_threshold * param.distance_threshold * num_points;
+		transitions.clear();
+		for (int i = 0; i < total_frames; i++)
+		{
+			for (int j = 0; j < total_frames; j++)
+			{
+				float d = distances[(size_t)i * total_frames + j];
+				int ci = frame_clips[i], cj = frame_clips[j];
+				if ((d > threshold) || !frame_usable[i] || !frame_usable[j] || ((ci == cj) && (abs(i - j) < param.min_self_frame_gap)))
+					continue;
+
+				// 同じ動作の組み合わせの8近傍の距離以下（同じ距離の場合は先に走査される近傍を優先）
+				bool is_minimum = true;
+				for (int di = -1; di <= 1; di++)
+				{
+					for (int dj = -1; dj <= 1; dj++)
+					{
+						int ni = i + di, nj = j + dj;
+						if (((di == 0) && (dj == 0)) || (ni < 0) || (ni >= total_frames) || (nj < 0) || (nj >= total_frames) ||
+							(frame_clips[ni] != ci) || (frame_clips[nj] != cj))
+							continue;
+						float nd = distances[(size_t)ni * total_frames + nj];
+						if ((nd < d) || ((nd == d) && ((di < 0) || ((di == 0) && (dj < 0)))))
+							is_minimum = false;
+					}
+				}
+				if (!is_minimum)
+					continue;
+
+				MotionGraphTransition trans;
+				trans.src_clip = ci;
+				trans.src_frame = frame_numbers[i];
+				trans.dest_clip = cj;
+				trans.dest_frame = frame_numbers[j];
+				trans.distance = sqrtf(d / num_points);
+				transitions.push_back(trans);
+			}
+		}
+	}
+
+	//
+	//  動作の処理の計算結果の検証
+	//  近似・並列化・逐次更新した各処理が、基準となる計算（全探索・逐次の計算など）と同じ結果を返すことを確認する
+	//
+	TEST_CLASS(MotionCorrectnessTests)
+	{
+	public:
+
+		// 姿勢インデックスの近似探索が全探索（SearchExact）と一致すること
+		// 動作の逐次追加・同じ動作の重複追加・ファイルへの保存と読み込みの後も同じ結果を返し、不正なファイルを読み込まないことを確認する
+		TEST_METHOD(PoseIndexMatchesExactSearch)
+		{
+			const float phases[] = { 0.0f, 0.3f, 0.6f, 0.9f, 0.15f };
+			const int num_indexed = 4; // 最後の動作は登録せずに検索の姿勢にのみ使用
+			SyntheticMotionSet set(phases, 5);
+			Assert::IsTrue(set.IsLoaded());
+
+			PoseIndexParam param;
+			InitPoseIndexParam(param);
+			PoseIndex index;
+			index.Init(param);
+
+			const int k = 10;
+			std::vector<float> descriptor;
+			std::vector<PoseIndexResult> approx, exact;
+			auto check_recall = [&](const PoseIndex& target, float min_recall)
+			{
+				descriptor.resize(target.GetDimension());
+				float recall = 0.0f;
+				int num_queries = 0;
+				for (int m = 0; m < (int)set.motions.size(); m++)
+				{
+					for (int f = 0; f < kMotionTestFrames; f += 7)
+					{
+						Assert::IsTrue(target.ComputeDescriptor(*set.motions[m], f, descriptor.data()));
+						Assert::IsTrue(target.Search(descriptor.data(), k, 1.0e6f, approx));
+						Assert::IsTrue(target.SearchExact(descriptor.data(), k, 1.0e6f, exact));
+						Assert::AreEqual((size_t)k, exact.size());
+						for (size_t i = 1; i < approx.size(); i++)
+							Assert::IsTrue(approx[i - 1].distance <= approx[i].distance);
+						recall += RecallAtK(approx, exact);
+						num_queries++;
+					}
+				}
+				recall /= num_queries;
+				char message[128];
+				snprintf(message, sizeof(message), "pose index: %d nodes, recall@%d %.3f\n", target.GetNumNodes(), k, recall);
+				Logger::WriteMessage(message);
+				Assert::IsTrue(recall >= min_recall, L"recall of the approximate search is too low");
+			};
+
+			// 動作を1つずつ追加し、追加のたびに近似探索の精度を確認
+			for (int m = 0; m < num_indexed; m++)
+			{
+				Assert::AreEqual(m, index.AddMotion(*set.motions[m]));
+				Assert::AreEqual((m + 1) * kMotionTestFrames, index.GetNumNodes());
+				check_recall(index, 0.95f);
+			}
+
+			// 同じ動作を再度追加しても、ノードは増えずに登録済みの動作番号を返す
+			Assert::AreEqual(1, index.AddMotion(*set.motions[1]));
+			Assert::AreEqual(num_indexed, index.GetNumClips());
+			Assert::AreEqual(num_indexed * kMotionTestFrames, index.GetNumNodes());
+			Assert::AreEqual(1, index.FindClip(set.motions[1]->name, kMotionTestFrames));
+
+			// 検索結果の動作番号・フレーム番号が、検索した姿勢の動作・フレームを指すこと
+			descriptor.resize(index.GetDimension());
+			Assert::IsTrue(index.ComputeDescriptor(*set.motions[2], 33, descriptor.data()));
+			Assert::IsTrue(index.SearchExact(descriptor.data(), 1, 1.0e6f, exact));
+			Assert::AreEqual(2, exact[0].clip);
+			Assert::AreEqual(33, exact[0].frame);
+			Assert::IsTrue(exact[0].distance < 1.0e-5f);
+
+			// 保存・読み込みした姿勢インデックスが、同じ検索結果を返すこと
+			const char* file_name = "test_pose_index.pidx";
+			Assert::IsTrue(index.SaveToFile(file_name));
+			PoseIndex loaded;
+			Assert::IsTrue(loaded.LoadFromFile(file_name));
+			Assert::AreEqual(index.GetNumClips(), loaded.GetNumClips());
+			Assert::AreEqual(index.GetNumNodes(), loaded.GetNumNodes());
+			std::vector<PoseIndexResult> loaded_results;
+			for (int f = 0; f < kMotionTestFrames; f += 11)
+			{
+				Assert::IsTrue(index.ComputeDescriptor(*set.motions[num_indexed], f, descriptor.data()));
+				index.Search(descriptor.data(), k, 1.0e6f, approx);
+				loaded.Search(descriptor.data(), k, 1.0e6f, loaded_results);
+				Assert::AreEqual(approx.size(), loaded_results.size());
+				for (size_t i = 0; i < approx.size(); i++)
+				{
+					Assert::AreEqual(approx[i].clip, loaded_results[i].clip);
+					Assert::AreEqual(approx[i].frame, loaded_results[i].frame);
+					Assert::AreEqual(approx[i].distance, loaded_results[i].distance);
+				}
+			}
+
+			// 読み込んだ姿勢インデックスへの追加（重複は登録済みの番号を返し、新しい動作は末尾に追加される）
+			Assert::AreEqual(0, loaded.AddMotion(*set.motions[0]));
+			Assert::AreEqual(num_indexed, loaded.AddMotion(*set.motions[num_indexed]));
+			Assert::AreEqual((num_indexed + 1) * kMotionTestFrames, loaded.GetNumNodes());
+			check_recall(loaded, 0.95f);
+
+			// ファイルの内容を読み込み、動作の情報・ノードの動作番号の位置を求める
+			std::vector<unsigned char> bytes;
+			FILE* fp = fopen(file_name, "rb");
+			Assert::IsTrue(fp != NULL);
+			for (int c = fgetc(fp); c != EOF; c = fgetc(fp))
+				bytes.push_back((unsigned char)c);
+			fclose(fp);
+			size_t clips_offset = 4 + sizeof(int) + sizeof(PoseIndexParam) + sizeof(int) * 6;
+			size_t last_first_node_offset = clips_offset;
+			for (int i = 0; i < index.GetNumClips(); i++)
+			{
+				last_first_node_offset = clips_offset + sizeof(int) + index.GetClip(i).name.size() + sizeof(int) + sizeof(float);
+				clips_offset = last_first_node_offset + sizeof(int);
+			}
+			size_t node_clips_offset = clips_offset + sizeof(float) * (size_t)index.GetNumNodes() * index.GetDimension();
+
+			// 一部を書き換えたファイルを読み込めないこと（読み込みに失敗した場合は元の内容を保持する）
+			auto write_corrupted = [&](size_t offset, int value) -> bool
+			{
+				std::vector<unsigned char> corrupted = bytes;
+				memcpy(&corrupted[offset], &value, sizeof(int));
+				FILE* out = fopen(file_name, "wb");
+				fwrite(corrupted.data(), 1, corrupted.size(), out);
+				fclose(out);
+				PoseIndex target;
+				target.Init(param);
+				target.AddMotion(*set.motions[0]);
+				bool success = target.LoadFromFile(file_name);
+				if (!success)
+					Assert::AreEqual(kMotionTestFrames, target.GetNumNodes());
+				return success;
+			};
+			Assert::IsTrue(write_corrupted(node_clips_offset, 0));
+			Assert::IsFalse(write_corrupted(node_clips_offset, num_indexed));
+			Assert::IsFalse(write_corrupted(node_clips_offset, -1));
+			Assert::IsFalse(write_corrupted(node_clips_offset + sizeof(int) * kMotionTestFrames, 0));
+			Assert::IsFalse(write_corrupted(last_first_node_offset, (num_indexed - 1) * kMotionTestFrames + 1));
+			Assert::IsFalse(write_corrupted(last_first_node_offset, -1));
+			std::remove(file_name);
+		}
+
+		// 動作変形の計算クラスの結果が、動作変形情報を重ねて逐次に適用した姿勢（ApplyMotionDeformation）と一致すること
+		// 範囲の重なる変形・離れた位置の変形の追加・更新・削除の後の各フレームと、フレーム間の時刻の補間した姿勢を確認する
+		TEST_METHOD(MotionDeformationEngineMatchesSerial)
+		{
+			const int num_frames = 300;
+			const float phases[] = { 0.0f };
+			SyntheticMotionSet set(phases, 1, num_frames);
+			Assert::IsTrue(set.IsLoaded());
+			const Motion& motion = *set.motions[0];
+
+			MotionDeformationEngine engine;
+			engine.SetNumThreads(4);
+			engine.Init(&motion);
+
+			// 動作変形情報を重ねて逐次に適用した姿勢と比較（変形範囲外のフレームは入力動作の姿勢を共有していること）
+			Posture reference(motion.body), reference1(motion.body), interpolated(motion.body), temp_pose(motion.body), engine_pose(motion.body);
+			auto check_frames = [&]()
+			{
+				vector<MotionWarpingParam> deforms;
+				for (int j = 0; j < engine.GetNumDeformations(); j++)
+					deforms.push_back(engine.GetDeformation(j));
+				int num_deformed = 0;
+				for (int i = 0; i < num_frames; i++)
+				{
+					float ratio = ApplyMotionDeformation(motion.interval * i, deforms, motion.frames[i], reference, temp_pose);
+					const Posture* frame = engine.GetFrame(i);
+					Assert::IsTrue(SamePosture(*frame, reference, 0.0f));
+					Assert::AreEqual(ratio > 0.0f, engine.IsFrameDeformed(i));
+					if (!engine.IsFrameDeformed(i))
+						Assert::IsTrue(frame == &motion.frames[i]);
+					else if (!SamePosture(*frame, motion.frames[i], 1.0e-4f))
+						num_deformed++;
+				}
+				Assert::IsTrue(deforms.empty() || (num_deformed > 0));
+
+				// フレーム間の時刻の姿勢は、前後のフレームの変形後の姿勢を補間したもの
+				for (float time = 0.0f; time < motion.interval * num_frames; time += motion.interval * 2.37f)
+				{
+					int f0 = std::min((int)floorf(time / motion.interval), num_frames - 1);
+					int f1 = std::min(f0 + 1, num_frames - 1);
+					float ratio = time / motion.interval - f0;
+					ApplyMotionDeformation(motion.interval * f0, deforms, motion.frames[f0], reference, temp_pose);
+					ApplyMotionDeformation(motion.interval * f1, deforms, motion.frames[f1], reference1, temp_pose);
+					if ((ratio > 0.0f) && (f1 > f0))
+						PostureInterpolation(reference, reference1, ratio, interpolated);
+					else
+						interpolated = reference;
+					engine.GetPosture(time, engine_pose);
+					Assert::IsTrue(SamePosture(engine_pose, interpolated, 0.0f));
+				}
+
+				// 変形後の動作の生成も、全フレームを変形した動作と一致する
+				Motion* generated = engine.GenerateMotion();
+				Motion* expected = GenerateDeformedMotion(deforms, motion);
+				for (int i = 0; i < num_frames; i++)
+					Assert::IsTrue(SamePosture(generated->frames[i], expected->frames[i], 0.0f));
+				delete generated;
+				delete expected;
+			};
+
+			// 範囲の重なる2つの変形と、離れた位置の変形を追加
+			MotionWarpingParam deform;
+			MakeTestDeformation(motion, 2.0f, 0.5f, 0.4f, deform);
+			engine.AddDeformation(deform);
+			MakeTestDeformation(motion, 2.3f, 0.5f, -0.3f, deform);
+			engine.AddDeformation(deform);
+			MakeTestDeformation(motion, 8.0f, 0.4f, 0.5f, deform);
+			engine.AddDeformation(deform);
+			check_frames();
+
+			// 離れた位置の変形を移動（移動前の範囲は入力動作の姿勢に戻る）
+			MakeTestDeformation(motion, 5.0f, 0.6f, 0.5f, deform);
+			engine.SetDeformation(2, deform);
+			check_frames();
+
+			// 重なる変形の一方と、離れた位置の変形の両方を更新してから計算
+			MakeTestDeformation(motion, 2.1f, 0.3f, 0.2f, deform);
+			engine.SetDeformation(0, deform);
+			MakeTestDeformation(motion, 9.5f, 0.5f, -0.6f, deform);
+			engine.SetDeformation(2, deform);
+			check_frames();
+
+			// 変形の削除・全削除
+			engine.RemoveDeformation(1);
+			check_frames();
+			engine.ClearDeformations();
+			check_frames();
+		}
+
+		// モーショングラフの構築（上三角のタイルの距離行列・SIMD 命令・並列計算）の遷移候補が、全組み合わせの距離から求めたものと一致すること
+		// タイルのサイズ・スレッド数によらず同じ結果となり、保存したファイルはフレーム間隔の異なる動作に対しては読み込めないことを確認する
+		TEST_METHOD(MotionGraphMatchesNaiveReference)
+		{
+			const float phases[] = { 0.0f, 0.35f, 0.8f };
+			SyntheticMotionSet set(phases, 3, 150);
+			Assert::IsTrue(set.IsLoaded());
+			vector<const Motion*> clips(set.motions.begin(), set.motions.end());
+
+			MotionGraphParam param;
+			InitMotionGraphParam(param);
+			vector<MotionGraphTransition> expected;
+			BuildReferenceTransitions(clips, param, expected);
+			std::sort(expected.begin(), expected.end(), LessTransition);
+			Assert::IsTrue(expected.size() > 0);
+
+			// 行・列の端数のタイルを含むタイルのサイズと、スレッド数の組み合わせ
+			const int tile_sizes[] = { 7, 64, 1000 };
+			const int thread_counts[] = { 1, 4 };
+			MotionGraph graph;
+			for (int tile_frames : tile_sizes)
+			{
+				for (int num_threads : thread_counts)
+				{
+					param.tile_frames = tile_frames;
+					param.num_threads = num_threads;
+					Assert::IsTrue(graph.Build(clips, param));
+
+					vector<MotionGraphTransition> found;
+					for (int t = 0; t < graph.GetNumTransitions(); t++)
+						found.push_back(graph.GetTransition(t));
+					std::sort(found.begin(), found.end(), LessTransition);
+					Assert::AreEqual(expected.size(), found.size());
+					for (size_t t = 0; t < found.size(); t++)
+					{
+						Assert::IsFalse(LessTransition(found[t], expected[t]) || LessTransition(expected[t], found[t]));
+						Assert::AreEqual(expected[t].distance, found[t].distance);
+					}
+				}
+			}
+			char message[128];
+			snprintf(message, sizeof(message), "motion graph: %d transitions\n", graph.GetNumTransitions());
+			Logger::WriteMessage(message);
+
+			// 保存したファイルの読み込み（同じ動作に対しては同じ遷移候補、フレーム間隔の異なる動作に対しては失敗）
+			const char* file_name = "test_motion_graph.mgrp";
+			Assert::IsTrue(graph.SaveToFile(file_name));
+			MotionGraph loaded;
+			Assert::IsTrue(loaded.LoadFromFile(file_name, clips));
+			Assert::AreEqual(graph.GetNumTransitions(), loaded.GetNumTransitions());
+			for (int c = 0; c < (int)clips.size(); c++)
+				for (int f = 0; f < clips[c]->num_frames; f += 5)
+					Assert::AreEqual(graph.FindNextTransition(c, f, (c + 1) % 3), loaded.FindNextTransition(c, f, (c + 1) % 3));
+			float interval = set.motions[1]->interval;
+			set.motions[1]->interval = interval * 0.5f;
+			Assert::IsFalse(loaded.LoadFromFile(file_name, clips));
+			Assert::AreEqual(0, loaded.GetNumTransitions());
+			set.motions[1]->interval = interval;
+			std::remove(file_name);
+		}
+
+		TEST_METHOD(InverseKinematicsMotionMatchesSingleThread)
+		{
+			const float phases[] = { 0.0f };
+			SyntheticMotionSet set(phases, 1);
+			Assert::IsTrue(set.IsLoaded());
+			const Motion& motion = *set.motions[0];
+			const Skeleton* body = motion.body;
+
+			// 腕の先端の関節を、付け根の関節の周りに回転して付け根に近づけた位置に移動する拘束条件（全フレームで到達可能）
+			// 一部のフレームでは拘束条件を適用しない
+			IKMotionConstraint constraint;
+			constraint.base_joint_no = FindJoint(body, "Chain1_0");
+			constraint.ee_joint_no = FindJoint(body, "Chain1_2");
+			Assert::IsTrue(constraint.base_joint_no >= 0 && constraint.ee_joint_no >= 0);
+			constraint.targets.resize(motion.num_frames);
+			constraint.enabled.resize(motion.num_frames);
+			vector<float> initial_distances(motion.num_frames);
+			vector<Matrix4f> seg_frames;
+			vector<Point3f> joint_positions;
+			Matrix3f rot;
+			rot.rotZ(0.35f);
+			for (int f = 0; f < motion.num_frames; f++)
+			{
+				ForwardKinematics(motion.frames[f], seg_frames, joint_positions);
+				const Point3f& base = joint_positions[constraint.base_joint_no];
+				Vector3f vec;
+				vec.sub(joint_positions[constraint.ee_joint_no], base);
+				rot.transform(&vec);
+				vec.scale(0.9f);
+				constraint.targets[f].add(base, vec);
+				constraint.enabled[f] = (f % 10) != 3;
+				initial_distances[f] = constraint.targets[f].distance(joint_positions[constraint.ee_joint_no]);
+			}
+			vector<IKMotionConstraint> constraints(1, constraint);
+
+			// １スレッド・複数スレッド（区間ごとにウォームスタート）で計算
+			Motion single(motion), parallel(motion);
+			IKMotionResult single_result, parallel_result;
+			ApplyInverseKinematicsCCDToMotion(single, constraints, &single_result, 1);
+			ApplyInverseKinematicsCCDToMotion(parallel, constraints, &parallel_result, 4);
+			Assert::AreEqual(motion.num_frames, (int)single_result.residuals.size());
+			Assert::AreEqual(motion.num_frames, (int)single_result.iterations.size());
+			Assert::AreEqual(motion.num_frames, (int)parallel_result.residuals.size());
+			Assert::AreEqual(motion.num_frames, (int)parallel_result.iterations.size());
+
+			// 適用したフレームでは残差が初期の距離より小さく収束閾値以下、適用しないフレームでは姿勢が変わらない
+			// 残差は出力姿勢の末端関節と目標位置の距離に一致し、両者の末端関節の位置は収束閾値の範囲で一致する
+			const float distance_threshold = 0.01f;
+			float max_residual = 0.0f;
+			int total_iterations = 0;
+			for (int f = 0; f < motion.num_frames; f++)
+			{
+				if (!constraint.enabled[f])
+				{
+					Assert::AreEqual(0, single_result.iterations[f]);
+					Assert::AreEqual(0, parallel_result.iterations[f]);
+					Assert::IsTrue(SamePosture(motion.frames[f], single.frames[f], 0.0f));
+					Assert::IsTrue(SamePosture(motion.frames[f], parallel.frames[f], 0.0f));
+					continue;
+				}
+				Assert::IsTrue(single_result.iterations[f] >= 1);
+				Assert::IsTrue(parallel_result.iterations[f] >= 1);
+				Assert::IsTrue(single_result.residuals[f] < initial_distances[f]);
+				Assert::IsTrue(parallel_result.residuals[f] < initial_distances[f]);
+				Assert::IsTrue(single_result.residuals[f] <= distance_threshold);
+				Assert::IsTrue(parallel_result.residuals[f] <= distance_threshold);
+
+				ForwardKinematics(single.frames[f], seg_frames, joint_positions);
+				Point3f single_ee = joint_positions[constraint.ee_joint_no];
+				Assert::AreEqual(constraint.targets[f].distance(single_ee), single_result.residuals[f], 1.0e-5f);
+				ForwardKinematics(parallel.frames[f], seg_frames, joint_positions);
+				Point3f parallel_ee = joint_positions[constraint.ee_joint_no];
+				Assert::AreEqual(constraint.targets[f].distance(parallel_ee), parallel_result.residuals[f], 1.0e-5f);
+				Assert::IsTrue(single_ee.distance(parallel_ee) <= distance_threshold * 2.0f);
+
+				max_residual = std::max(max_residual, std::max(single_result.residuals[f], parallel_result.residuals[f]));
+				total_iterations += single_result.iterations[f];
+			}
+			char message[128];
+			snprintf(message, sizeof(message), "inverse kinematics: max residual %.5f, %d iterations\n", max_residual, total_iterations);
+			Logger::WriteMessage(message);
+		}
+	};
+}
@@ -0,0 +1,132 @@
+﻿#include "pch.h"
+#include "CppUnitTest.h"
+
+#include "../FeatureKDTree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace PerformanceTests1
+{
+	// モーションマッチングの特徴ベクトルと同じ次元数
+	static const int kFeatureDim = 27;
+
+	// 動作データの特徴ベクトルを模した合成データを生成
+	// 実際の特徴ベクトルは少数の自由度で滑らかに変化するため、低次元の潜在変数のランダムウォークを線形写像して雑音を加える
+	static std::vector<float> MakeSyntheticFeatures(int num_frames, unsigned int seed)
+	{
+		const int latent_dim = 6;
+		const int clip_frames = 600;
+		std::mt19937 rng(seed);
+		std::normal_distribution<float> normal(0.0f, 1.0f);
+
+		std::vector<float> basis(latent_dim * kFeatureDim);
+		for (float& b : basis)
+			b = normal(rng);
+
+		std::vector<float> data((size_t)num_frames * kFeatureDim);
+		float latent[latent_dim] = {};
+		for (int i = 0; i < num_frames; i++)
+		{
+			// 動作の区切りごとに潜在変数を初期化し、フレーム間では小さく変化させる
+			for (int k = 0; k < latent_dim; k++)
+				latent[k] = (i % clip_frames == 0) ? normal(rng) : latent[k] * 0.995f + normal(rng) * 0.05f;
+
+			float* feature = &data[(size_t)i * kFeatureDim];
+			for (int d = 0; d < kFeatureDim; d++)
+			{
+				float v = normal(rng) * 0.01f;
+				for (int k = 0; k < latent_dim; k++)
+					v += basis[k * kFeatureDim + d] * latent[k];
+				feature[d] = v;
+			}
+		}
+		return data;
+	}
+
+	TEST_CLASS(MotionMatchingBenchmark)
+	{
+	public:
+
+		// kd木の探索結果が全探索と一致することを確認
+		TEST_METHOD(KDTreeMatchesBruteForce)
+		{
+			const int num_frames = 20000;
+			std::vector<float> data = MakeSyntheticFeatures(num_frames, 1);
+			FeatureKDTree tree;
+			tree.Build(data.data(), num_frames, kFeatureDim);
+
+			std::mt19937 rng(2);
+			std::normal_distribution<float> normal(0.0f, 0.2f);
+			std::uniform_int_distribution<int> pick(0, num_frames - 1);
+			for (int q = 0; q < 500; q++)
+			{
+				float query[kFeatureDim];
+				const float* base = &data[(size_t)pick(rng) * kFeatureDim];
+				for (int d = 0; d < kFeatureDim; d++)
+					query[d] = base[d] + normal(rng);
+
+				float tree_distance = 0.0f, brute_distance = 0.0f;
+				tree.FindNearest(query, &tree_distance);
+				tree.FindNearestBruteForce(query, &brute_distance);
+				Assert::AreEqual(brute_distance, tree_distance);
+			}
+		}
+
+		// データベースのサイズ（最大100万フレーム）に対する探索時間の計測
+		// （実行環境に依存するため結果はログに出力するのみとし、探索結果の正しさは KDTreeMatchesBruteForce で確認する）
+		TEST_METHOD(QueryLatencyByDatabaseSize)
+		{
+			const int sizes[] = { 1000, 10000, 100000, 1000000 };
+			const int num_queries = 2000;
+
+			for (int num_frames : sizes)
+			{
+				std::vector<float> data = MakeSyntheticFeatures(num_frames, 3);
+
+				auto build_start = std::chrono::steady_clock::now();
+				FeatureKDTree tree;
+				tree.Build(data.data(), num_frames, kFeatureDim);
+				double build_msec = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - build_start).count();
+
+				// 再生中の探索を模して、データベース中のフレームに雑音を加えたものを探索
+				std::mt19937 rng(4);
+				std::normal_distribution<float> normal(0.0f, 0.2f);
+				std::uniform_int_distribution<int> pick(0, num_frames - 1);
+				std::vector<float> queries((size_t)num_queries * kFeatureDim);
+				for (int q = 0; q < num_queries; q++)
+				{
+					const float* base = &data[(size_t)pick(rng) * kFeatureDim];
+					for (int d = 0; d < kFeatureDim; d++)
+						queries[(size_t)q * kFeatureDim + d] = base[d] + normal(rng);
+				}
+
+				std::vector<double> latencies(num_queries);
+				long long checksum = 0;
+				for (int q = 0; q < num_queries; q++)
+				{
+					auto start = std::chrono::steady_clock::now();
+					checksum += tree.FindNearest(&queries[(size_t)q * kFeatureDim]);
+					latencies[q] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+				}
+				std::sort(latencies.begin(), latencies.end());
+				double mean = 0.0;
+				for (double l : latencies)
+					mean += l;
+				mean /= num_queries;
+
+				char message[256];
+				snprintf(message, sizeof(message),
+					"frames=%d build=%.1fms query mean=%.2fus p50=%.2fus p99=%.2fus (checksum %lld)\n",
+					num_frames, build_msec, mean, latencies[num_queries / 2], latencies[num_queries * 99 / 100], checksum);
+				Logger::WriteMessage(message);
+			}
+		}
+	};
+}
@@ -0,0 +1,621 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  姿勢の類似検索のためのインデックス（階層的近傍グラフによる近似最近傍探索）
+**/
+
+
+// ライブラリ・クラス定義の読み込み
+#include "SimpleHuman.h"
+#include "PoseIndex.h"
+
+// 標準算術関数・定数の定義
+#define  _USE_MATH_DEFINES
+#include <math.h>
+
+// 標準ライブラリの読み込み
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <algorithm>
+#include <queue>
+#include <unordered_set>
+
+
+// 姿勢インデックスのファイルの識別子・バージョン
+static const char  pose_index_file_magic[ 4 ] = { 'P', 'I', 'D', 'X' };
+static const int   pose_index_file_version = 1;
+
+
+
+//
+//  姿勢インデックスのパラメタを初期化
+//
+void  InitPoseIndexParam( PoseIndexParam & param )
+{
+	param.use_velocity = true;
+	param.velocity_weight = 0.1f;
+	param.max_links = 16;
+	param.ef_construction = 100;
+	param.ef_search = 64;
+	param.random_seed = 12345;
+}
+
+
+//
+//  指定フレームの各関節点の位置を、腰の水平位置・水平向きを基準とするローカル座標系で計算
+//
+static void  ComputeLocalJointPositions( const Posture & posture, vector< Matrix4f > & seg_frames, vector< Point3f > & joint_positions, float * local )
+{
+	ForwardKinematics( posture, seg_frames, joint_positions );
+
+	float  angle = ComputeOrientationAngle( posture.root_ori ) * M_PI / 180.0f;
+	float  c = cos( angle ), s = sin( angle );
+	for ( int j = 0; j < (int)joint_positions.size(); j++ )
+	{
+		float  dx = joint_positions[ j ].x - posture.root_pos.x;
+		float  dz = joint_positions[ j ].z - posture.root_pos.z;
+		local[ j * 3 + 0 ] = c * dx - s * dz;
+		local[ j * 3 + 1 ] = joint_positions[ j ].y - posture.root_pos.y;
+		local[ j * 3 + 2 ] = s * dx + c * dz;
+	}
+}
+
+
+
+//
+//  姿勢インデックスクラス
+//
+
+
+//
+//  コンストラクタ
+//
+PoseIndex::PoseIndex()
+{
+	PoseIndexParam  default_param;
+	InitPoseIndexParam( default_param );
+	Init( default_param );
+}
+
+
+//
+//  初期化（全情報を削除してパラメタを設定）
+//
+void  PoseIndex::Init( const PoseIndexParam & new_param )
+{
+	param = new_param;
+	param.max_links = max( param.max_links, 2 );
+	num_joints = 0;
+	dim = 0;
+	clips.clear();
+	descriptors.clear();
+	node_clips.clear();
+	node_levels.clear();
+	node_links.clear();
+	entry_node = -1;
+	max_level = -1;
+	random.seed( param.random_seed );
+}
+
+
+//
+//  指定動作・フレームの姿勢記述子を計算
+//
+bool  PoseIndex::ComputeDescriptor( const Motion & motion, int frame_no, float * descriptor ) const
+{
+	if ( ( dim == 0 ) || ( motion.body->num_joints != num_joints ) || ( frame_no < 0 ) || ( frame_no >= motion.num_frames ) )
+		return  false;
+
+	vector< Matrix4f >  seg_frames;
+	vector< Point3f >  joint_positions;
+	ComputeLocalJointPositions( motion.frames[ frame_no ], seg_frames, joint_positions, descriptor );
+
+	// 各関節点の速度（前のフレームとのローカル位置の差分、先頭フレームでは次のフレームとの差分）
+	if ( param.use_velocity )
+	{
+		float *  velocity = descriptor + num_joints * 3;
+		if ( motion.num_frames < 2 )
+		{
+			for ( int i = 0; i < num_joints * 3; i++ )
+				velocity[ i ] = 0.0f;
+			return  true;
+		}
+
+		int  prev_no = ( frame_no > 0 ) ? frame_no - 1 : 0;
+		int  next_no = prev_no + 1;
+		vector< float >  prev_local( num_joints * 3 ), next_local( num_joints * 3 );
+		ComputeLocalJointPositions( motion.frames[ prev_no ], seg_frames, joint_positions, &prev_local[ 0 ] );
+		if ( next_no == frame_no )
+			copy( descriptor, descriptor + num_joints * 3, next_local.begin() );
+		else
+			ComputeLocalJointPositions( motion.frames[ next_no ], seg_frames, joint_positions, &next_local[ 0 ] );
+
+		float  scale = param.velocity_weight / motion.interval;
+		for ( int i = 0; i < num_joints * 3; i++ )
+			velocity[ i ] = ( next_local[ i ] - prev_local[ i ] ) * scale;
+	}
+	return  true;
+}
+
+
+//
+//  登録済みの動作を検索
+//
+int  PoseIndex::FindClip( const string & name, int num_frames ) const
+{
+	for ( int i = 0; i < (int)clips.size(); i++ )
+		if ( ( clips[ i ].name == name ) && ( clips[ i ].num_frames == num_frames ) )
+			return  i;
+	return  -1;
+}
+
+
+//
+//  動作の追加
+//
+int  PoseIndex::AddMotion( const Motion & motion )
+{
+	if ( !motion.body || ( motion.num_frames <= 0 ) )
+		return  -1;
+
+	// 登録済みの動作であれば、その番号を返す
+	int  clip_no = FindClip( motion.name, motion.num_frames );
+	if ( clip_no >= 0 )
+		return  clip_no;
+
+	// 最初の動作の骨格モデルで姿勢記述子の次元数を決定（関節数の異なる動作は追加できない）
+	if ( dim == 0 )
+	{
+		num_joints = motion.body->num_joints;
+		dim = num_joints * 3 * ( param.use_velocity ? 2 : 1 );
+	}
+	if ( ( motion.body->num_joints != num_joints ) || ( dim == 0 ) )
+		return  -1;
+
+	// 動作の情報を登録
+	PoseIndexClip  clip;
+	clip.name = motion.name;
+	clip.num_frames = motion.num_frames;
+	clip.interval = motion.interval;
+	clip.first_node = (int) node_clips.size();
+	clip_no = (int) clips.size();
+	clips.push_back( clip );
+
+	// 全フレームの姿勢記述子を計算
+	descriptors.resize( (size_t)( clip.first_node + motion.num_frames ) * dim );
+	for ( int f = 0; f < motion.num_frames; f++ )
+		ComputeDescriptor( motion, f, &descriptors[ (size_t)( clip.first_node + f ) * dim ] );
+
+	// 全フレームを近傍グラフに追加
+	for ( int f = 0; f < motion.num_frames; f++ )
+	{
+		node_clips.push_back( clip_no );
+		InsertNode( clip.first_node + f );
+	}
+
+	return  clip_no;
+}
+
+
+//
+//  姿勢記述子とノードの距離の２乗
+//
+float  PoseIndex::ComputeDistance( const float * descriptor, int node_no ) const
+{
+	const float *  node = &descriptors[ (size_t) node_no * dim ];
+	float  sum = 0.0f;
+	for ( int i = 0; i < dim; i++ )
+	{
+		float  d = descriptor[ i ] - node[ i ];
+		sum += d * d;
+	}
+	return  sum;
+}
+
+
+//
+//  ノードの追加
+//
+void  PoseIndex::InsertNode( int node_no )
+{
+	const float *  descriptor = &descriptors[ (size_t) node_no * dim ];
+
+	// ノードの階層を指数分布にもとづいて決定
+	uniform_real_distribution< double >  uniform( 0.0, 1.0 );
+	double  level_scale = 1.0 / log( (double) param.max_links );
+	int  level = (int)( -log( max( uniform( random ), 1.0e-12 ) ) * level_scale );
+	node_levels.push_back( level );
+	node_links.push_back( vector< vector< int > >( level + 1 ) );
+
+	// 最初のノードは探索の開始ノードとする
+	if ( entry_node < 0 )
+	{
+		entry_node = node_no;
+		max_level = level;
+		return;
+	}
+
+	// 上位の階層では、貪欲法により最も近いノードまで移動
+	int  entry = entry_node;
+	for ( int l = max_level; l > level; l-- )
+		entry = SearchNearestInLevel( descriptor, entry, l );
+
+	// 追加したノードの階層以下では、近傍のノードを探索して相互にリンク
+	vector< pair< float, int > >  found;
+	vector< int >  neighbors;
+	for ( int l = min( level, max_level ); l >= 0; l-- )
+	{
+		SearchLevel( descriptor, entry, param.ef_construction, l, found );
+		SelectNeighbors( found, param.max_links, neighbors );
+		node_links[ node_no ][ l ] = neighbors;
+
+		int  max_num = ( l == 0 ) ? param.max_links * 2 : param.max_links;
+		for ( int i = 0; i < (int)neighbors.size(); i++ )
+		{
+			vector< int > &  links = node_links[ neighbors[ i ] ][ l ];
+			links.push_back( node_no );
+			if ( (int)links.size() <= max_num )
+				continue;
+
+			// リンク数が上限を超えたら、隣接ノードの近傍を選択し直す
+			const float *  neighbor = &descriptors[ (size_t) neighbors[ i ] * dim ];
+			vector< pair< float, int > >  candidates( links.size() );
+			for ( int j = 0; j < (int)links.size(); j++ )
+				candidates[ j ] = make_pair( ComputeDistance( neighbor, links[ j ] ), links[ j ] );
+			sort( candidates.begin(), candidates.end() );
+			SelectNeighbors( candidates, max_num, links );
+		}
+		entry = found[ 0 ].second;
+	}
+
+	// 最上位の階層を更新
+	if ( level > max_level )
+	{
+		entry_node = node_no;
+		max_level = level;
+	}
+}
+
+
+//
+//  指定階層で、開始ノードから最も近いノードを貪欲法により探索
+//
+int  PoseIndex::SearchNearestInLevel( const float * descriptor, int entry, int level ) const
+{
+	int  curr = entry;
+	float  curr_distance = ComputeDistance( descriptor, curr );
+	bool  changed = true;
+	while ( changed )
+	{
+		changed = false;
+		const vector< int > &  links = node_links[ curr ][ level ];
+		for ( int i = 0; i < (int)links.size(); i++ )
+		{
+			float  d = ComputeDistance( descriptor, links[ i ] );
+			if ( d < curr_distance )
+			{
+				curr_distance = d;
+				curr = links[ i ];
+				changed = true;
+			}
+		}
+	}
+	return  curr;
+}
+
+
+//
+//  指定階層で、開始ノードから近い順に最大 ef 個のノードを探索
+//
+void  PoseIndex::SearchLevel( const float * descriptor, int entry, int ef, int level, vector< pair< float, int > > & found ) const
+{
+	// 探索候補（距離の昇順に取り出す）と、探索結果（距離の降順に取り出す）
+	priority_queue< pair< float, int >, vector< pair< float, int > >, greater< pair< float, int > > >  candidates;
+	priority_queue< pair< float, int > >  nearest;
+	unordered_set< int >  visited;
+
+	float  d = ComputeDistance( descriptor, entry );
+	candidates.push( make_pair( d, entry ) );
+	nearest.push( make_pair( d, entry ) );
+	visited.insert( entry );
+
+	while ( !candidates.empty() )
+	{
+		pair< float, int >  curr = candidates.top();
+		if ( curr.first > nearest.top().first )
+			break;
+		candidates.pop();
+
+		const vector< int > &  links = node_links[ curr.second ][ level ];
+		for ( int i = 0; i < (int)links.size(); i++ )
+		{
+			if ( !visited.insert( links[ i ] ).second )
+				continue;
+			d = ComputeDistance( descriptor, links[ i ] );
+			if ( ( (int)nearest.size() < ef ) || ( d < nearest.top().first ) )
+			{
+				candidates.push( make_pair( d, links[ i ] ) );
+				nearest.push( make_pair( d, links[ i ] ) );
+				if ( (int)nearest.size() > ef )
+					nearest.pop();
+			}
+		}
+	}
+
+	found.resize( nearest.size() );
+	for ( int i = (int) found.size() - 1; i >= 0; i-- )
+	{
+		found[ i ] = nearest.top();
+		nearest.pop();
+	}
+}
+
+
+//
+//  候補から、近傍グラフの隣接ノードを選択
+// （既に選択したノードよりも候補に近いノードを優先し、不足する場合は残りの候補を距離の順に追加）
+//
+void  PoseIndex::SelectNeighbors( const vector< pair< float, int > > & candidates, int max_num, vector< int > & neighbors ) const
+{
+	vector< int >  selected, skipped;
+	for ( int i = 0; ( i < (int)candidates.size() ) && ( (int)selected.size() < max_num ); i++ )
+	{
+		const float *  candidate = &descriptors[ (size_t) candidates[ i ].second * dim ];
+		bool  is_diverse = true;
+		for ( int j = 0; j < (int)selected.size(); j++ )
+		{
+			if ( ComputeDistance( candidate, selected[ j ] ) < candidates[ i ].first )
+			{
+				is_diverse = false;
+				break;
+			}
+		}
+		if ( is_diverse )
+			selected.push_back( candidates[ i ].second );
+		else
+			skipped.push_back( candidates[ i ].second );
+	}
+	for ( int i = 0; ( i < (int)skipped.size() ) && ( (int)selected.size() < max_num ); i++ )
+		selected.push_back( skipped[ i ] );
+
+	neighbors.swap( selected );
+}
+
+
+//
+//  検索結果の変換
+//
+void  PoseIndex::MakeResults( const vector< pair< float, int > > & found, int max_results, float max_distance, vector< PoseIndexResult > & results ) const
+{
+	results.clear();
+	for ( int i = 0; ( i < (int)found.size() ) && ( (int)results.size() < max_results ); i++ )
+	{
+		PoseIndexResult  result;
+		result.distance = sqrt( found[ i ].first / num_joints );
+		if ( result.distance > max_distance )
+			break;
+		result.clip = node_clips[ found[ i ].second ];
+		result.frame = found[ i ].second - clips[ result.clip ].first_node;
+		results.push_back( result );
+	}
+}
+
+
+//
+//  姿勢記述子に近いフレームを検索
+//
+bool  PoseIndex::Search( const float * descriptor, int max_results, float max_distance, vector< PoseIndexResult > & results ) const
+{
+	results.clear();
+	if ( ( entry_node < 0 ) || ( max_results <= 0 ) )
+		return  false;
+
+	int  entry = entry_node;
+	for ( int l = max_level; l > 0; l-- )
+		entry = SearchNearestInLevel( descriptor, entry, l );
+
+	vector< pair< float, int > >  found;
+	SearchLevel( descriptor, entry, max( param.ef_search, max_results ), 0, found );
+	MakeResults( found, max_results, max_distance, results );
+	return  true;
+}
+
+
+//
+//  指定動作・フレームの姿勢に近いフレームを検索
+//
+bool  PoseIndex::SearchFrame( const Motion & motion, int frame_no, int max_results, float max_distance, vector< PoseIndexResult > & results ) const
+{
+	results.clear();
+	vector< float >  descriptor( max( dim, 1 ) );
+	if ( !ComputeDescriptor( motion, frame_no, &descriptor[ 0 ] ) )
+		return  false;
+	return  Search( &descriptor[ 0 ], max_results, max_distance, results );
+}
+
+
+//
+//  全ノードとの比較による厳密な検索
+//
+bool  PoseIndex::SearchExact( const float * descriptor, int max_results, float max_distance, vector< PoseIndexResult > & results ) const
+{
+	results.clear();
+	if ( ( entry_node < 0 ) || ( max_results <= 0 ) )
+		return  false;
+
+	vector< pair< float, int > >  found( node_clips.size() );
+	for ( int i = 0; i < (int)found.size(); i++ )
+		found[ i ] = make_pair( ComputeDistance( descriptor, i ), i );
+	int  num = min( max_results, (int) found.size() );
+	partial_sort( found.begin(), found.begin() + num, found.end() );
+	found.resize( num );
+	MakeResults( found, max_results, max_distance, results );
+	return  true;
+}
+
+
+//
+//  ファイルへの保存
+//
+bool  PoseIndex::SaveToFile( const char * file_name ) const
+{
+	FILE *  fp = fopen( file_name, "wb" );
+	if ( !fp )
+		return  false;
+
+	// ヘッダ・パラメタ
+	int  num_clips = (int) clips.size();
+	int  num_nodes = (int) node_clips.size();
+	fwrite( pose_index_file_magic, 1, 4, fp );
+	fwrite( &pose_index_file_version, sizeof( int ), 1, fp );
+	fwrite( &param, sizeof( PoseIndexParam ), 1, fp );
+	fwrite( &num_joints, sizeof( int ), 1, fp );
+	fwrite( &dim, sizeof( int ), 1, fp );
+	fwrite( &num_clips, sizeof( int ), 1, fp );
+	fwrite( &num_nodes, sizeof( int ), 1, fp );
+	fwrite( &entry_node, sizeof( int ), 1, fp );
+	fwrite( &max_level, sizeof( int ), 1, fp );
+
+	// 動作の情報
+	for ( int i = 0; i < num_clips; i++ )
+	{
+		int  name_length = (int) clips[ i ].name.size();
+		fwrite( &name_length, sizeof( int ), 1, fp );
+		fwrite( clips[ i ].name.c_str(), 1, name_length, fp );
+		fwrite( &clips[ i ].num_frames, sizeof( int ), 1, fp );
+		fwrite( &clips[ i ].interval, sizeof( float ), 1, fp );
+		fwrite( &clips[ i ].first_node, sizeof( int ), 1, fp );
+	}
+
+	// 姿勢記述子・近傍グラフ
+	if ( num_nodes > 0 )
+	{
+		fwrite( &descriptors[ 0 ], sizeof( float ), (size_t) num_nodes * dim, fp );
+		fwrite( &node_clips[ 0 ], sizeof( int ), num_nodes, fp );
+		fwrite( &node_levels[ 0 ], sizeof( int ), num_nodes, fp );
+	}
+	for ( int i = 0; i < num_nodes; i++ )
+	{
+		for ( int l = 0; l <= node_levels[ i ]; l++ )
+		{
+			int  num_links = (int) node_links[ i ][ l ].size();
+			fwrite( &num_links, sizeof( int ), 1, fp );
+			if ( num_links > 0 )
+				fwrite( &node_links[ i ][ l ][ 0 ], sizeof( int ), num_links, fp );
+		}
+	}
+
+	bool  success = !ferror( fp );
+	fclose( fp );
+	return  success;
+}
+
+
+//
+//  ファイルからの読み込み
+//
+bool  PoseIndex::LoadFromFile( const char * file_name )
+{
+	FILE *  fp = fopen( file_name, "rb" );
+	if ( !fp )
+		return  false;
+
+	// ファイルの内容を読み込み（途中で失敗したら false を返す）
+	PoseIndex  loaded;
+	auto  read_index = [&]() -> bool
+	{
+		char  magic[ 4 ];
+		int  version = 0, num_clips = 0, num_nodes = 0;
+		if ( ( fread( magic, 1, 4, fp ) != 4 ) || ( memcmp( magic, pose_index_file_magic, 4 ) != 0 ) )
+			return  false;
+		if ( ( fread( &version, sizeof( int ), 1, fp ) != 1 ) || ( version != pose_index_file_version ) )
+			return  false;
+		if ( ( fread( &loaded.param, sizeof( PoseIndexParam ), 1, fp ) != 1 ) ||
+			( fread( &loaded.num_joints, sizeof( int ), 1, fp ) != 1 ) ||
+			( fread( &loaded.dim, sizeof( int ), 1, fp ) != 1 ) ||
+			( fread( &num_clips, sizeof( int ), 1, fp ) != 1 ) ||
+			( fread( &num_nodes, sizeof( int ), 1, fp ) != 1 ) ||
+			( fread( &loaded.entry_node, sizeof( int ), 1, fp ) != 1 ) ||
+			( fread( &loaded.max_level, sizeof( int ), 1, fp ) != 1 ) )
+			return  false;
+		if ( ( num_clips < 0 ) || ( num_nodes < 0 ) || ( loaded.dim < 0 ) || ( loaded.entry_node >= num_nodes ) )
+			return  false;
+
+		loaded.clips.resize( num_clips );
+		for ( int i = 0; i < num_clips; i++ )
+		{
+			int  name_length = 0;
+			if ( ( fread( &name_length, sizeof( int ), 1, fp ) != 1 ) || ( name_length < 0 ) )
+				return  false;
+			loaded.clips[ i ].name.resize( name_length );
+			if ( ( name_length > 0 ) && ( fread( &loaded.clips[ i ].name[ 0 ], 1, name_length, fp ) != (size_t)name_length ) )
+				return  false;
+			if ( ( fread( &loaded.clips[ i ].num_frames, sizeof( int ), 1, fp ) != 1 ) ||
+				( fread( &loaded.clips[ i ].interval, sizeof( float ), 1, fp ) != 1 ) ||
+				( fread( &loaded.clips[ i ].first_node, sizeof( int ), 1, fp ) != 1 ) )
+				return  false;
+
+			// 動作のフレームのノードの範囲が全ノードに収まること
+			const PoseIndexClip &  clip = loaded.clips[ i ];
+			if ( ( clip.num_frames <= 0 ) || ( clip.first_node < 0 ) || ( (long long) clip.first_node + clip.num_frames > num_nodes ) )
+				return  false;
+		}
+
+		loaded.descriptors.resize( (size_t) num_nodes * loaded.dim );
+		loaded.node_clips.resize( num_nodes );
+		loaded.node_levels.resize( num_nodes );
+		if ( num_nodes > 0 )
+		{
+			if ( ( fread( &loaded.descriptors[ 0 ], sizeof( float ), loaded.descriptors.size(), fp ) != loaded.descriptors.size() ) ||
+				( fread( &loaded.node_clips[ 0 ], sizeof( int ), num_nodes, fp ) != (size_t)num_nodes ) ||
+				( fread( &loaded.node_levels[ 0 ], sizeof( int ), num_nodes, fp ) != (size_t)num_nodes ) )
+				return  false;
+		}
+
+		// 各ノードの動作番号が登録された動作を指し、そのノードが動作のフレームの範囲に含まれること
+		for ( int i = 0; i < num_nodes; i++ )
+		{
+			int  clip_no = loaded.node_clips[ i ];
+			if ( ( clip_no < 0 ) || ( clip_no >= num_clips ) ||
+				( i < loaded.clips[ clip_no ].first_node ) || ( i >= loaded.clips[ clip_no ].first_node + loaded.clips[ clip_no ].num_frames ) )
+				return  false;
+		}
+		if ( ( num_nodes > 0 ) && ( loaded.entry_node < 0 ) )
+			return  false;
+		loaded.node_links.resize( num_nodes );
+		for ( int i = 0; i < num_nodes; i++ )
+		{
+			if ( ( loaded.node_levels[ i ] < 0 ) || ( loaded.node_levels[ i ] > loaded.max_level ) )
+				return  false;
+			loaded.node_links[ i ].resize( loaded.node_levels[ i ] + 1 );
+			for ( int l = 0; l <= loaded.node_levels[ i ]; l++ )
+			{
+				int  num_links = 0;
+				if ( ( fread( &num_links, sizeof( int ), 1, fp ) != 1 ) || ( num_links < 0 ) )
+					return  false;
+				vector< int > &  links = loaded.node_links[ i ][ l ];
+				links.resize( num_links );
+				if ( ( num_links > 0 ) && ( fread( &links[ 0 ], sizeof( int ), num_links, fp ) != (size_t)num_links ) )
+					return  false;
+				for ( int j = 0; j < num_links; j++ )
+					if ( ( links[ j ] < 0 ) || ( links[ j ] >= num_nodes ) )
+						return  false;
+			}
+		}
+		return  true;
+	};
+	bool  success = read_index();
+	fclose( fp );
+	if ( !success )
+		return  false;
+
+	// 読み込んだ内容で置き換え（以降の追加で構築時と同じ階層の列が繰り返されないように、乱数の種にノード数を加える）
+	*this = loaded;
+	random.seed( param.random_seed + (unsigned int) node_clips.size() );
+	return  true;
+}
@@ -0,0 +1,174 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  姿勢の類似検索のためのインデックス（階層的近傍グラフによる近似最近傍探索）
+**/
+
+#ifndef  _POSE_INDEX_H_
+#define  _POSE_INDEX_H_
+
+
+// ライブラリ・クラス定義の読み込み
+#include "SimpleHuman.h"
+
+// 標準ライブラリの読み込み
+#include <random>
+
+
+//
+//  姿勢インデックスのパラメタ
+//
+struct  PoseIndexParam
+{
+	// 姿勢記述子に各関節点の速度を含めるかどうか
+	bool  use_velocity;
+
+	// 速度の重み（速度 [m/s] に掛ける値）
+	float  velocity_weight;
+
+	// 近傍グラフの各ノードの最大リンク数（最下層はこの２倍）
+	int  max_links;
+
+	// 追加時・探索時の候補リストのサイズ
+	int  ef_construction;
+	int  ef_search;
+
+	// 各ノードの階層を決定する乱数の種
+	unsigned int  random_seed;
+};
+
+// 姿勢インデックスのパラメタを初期化
+void  InitPoseIndexParam( PoseIndexParam & param );
+
+
+//
+//  姿勢インデックスの検索結果
+//
+struct  PoseIndexResult
+{
+	// 動作番号・フレーム番号
+	int  clip;
+	int  frame;
+
+	// 姿勢記述子の距離（関節点あたりの二乗平均平方根、単位はメートル）
+	float  distance;
+};
+
+
+//
+//  姿勢インデックスに登録された動作の情報
+//
+struct  PoseIndexClip
+{
+	// 動作名・フレーム数・フレーム間隔
+	string  name;
+	int  num_frames;
+	float  interval;
+
+	// 先頭フレームのノード番号
+	int  first_node;
+};
+
+
+//
+//  姿勢インデックスクラス
+//  全動作の全フレームの姿勢記述子（腰の水平位置・水平向きを基準とする各関節点の位置と、必要に応じて速度）を、
+//  階層的近傍グラフ（HNSW）に登録し、指定姿勢に近いフレームを近似最近傍探索により検索する
+//  動作の追加は逐次的に行うことができ、構築済みのインデックスはファイルに保存・読み込みできる
+//
+class  PoseIndex
+{
+  protected:
+	// パラメタ
+	PoseIndexParam  param;
+
+	// 関節数・姿勢記述子の次元数（最初に追加した動作の骨格モデルで決定）
+	int  num_joints;
+	int  dim;
+
+	// 登録された動作の情報
+	vector< PoseIndexClip >  clips;
+
+	// 姿勢記述子 [ノード番号 * dim + 次元]
+	vector< float >  descriptors;
+
+	// 各ノードの動作番号 [ノード番号]
+	vector< int >  node_clips;
+
+	// 各ノードの階層 [ノード番号]
+	vector< int >  node_levels;
+
+	// 各ノードの各階層の隣接ノード [ノード番号][階層][隣接番号]
+	vector< vector< vector< int > > >  node_links;
+
+	// 探索の開始ノードと最上位の階層
+	int  entry_node;
+	int  max_level;
+
+	// 階層を決定する乱数生成器
+	mt19937  random;
+
+  public:
+	// コンストラクタ
+	PoseIndex();
+
+  public:
+	// 初期化（全情報を削除してパラメタを設定）
+	void  Init( const PoseIndexParam & param );
+
+	// 動作の追加（動作番号を返す、同じ名前・フレーム数の動作が登録済みであればその番号を返す、失敗したら -1）
+	int  AddMotion( const Motion & motion );
+
+	// 登録済みの動作を検索（なければ -1）
+	int  FindClip( const string & name, int num_frames ) const;
+
+	// 姿勢記述子に近いフレームを検索（距離が max_distance 以下のものを最大 max_results 個、距離の昇順に出力）
+	bool  Search( const float * descriptor, int max_results, float max_distance, vector< PoseIndexResult > & results ) const;
+
+	// 指定動作・フレームの姿勢に近いフレームを検索
+	bool  SearchFrame( const Motion & motion, int frame_no, int max_results, float max_distance, vector< PoseIndexResult > & results ) const;
+
+	// 全ノードとの比較による厳密な検索（近似探索の検証用）
+	bool  SearchExact( const float * descriptor, int max_results, float max_distance, vector< PoseIndexResult > & results ) const;
+
+	// ファイルへの保存・読み込み
+	bool  SaveToFile( const char * file_name ) const;
+	bool  LoadFromFile( const char * file_name );
+
+  public:
+	// 情報取得
+	const PoseIndexParam &  GetParam() const { return  param; }
+	int  GetNumClips() const { return  (int) clips.size(); }
+	const PoseIndexClip &  GetClip( int no ) const { return  clips[ no ]; }
+	int  GetNumNodes() const { return  (int) node_clips.size(); }
+	int  GetDimension() const { return  dim; }
+
+	// 指定動作・フレームの姿勢記述子を計算（descriptor には GetDimension() 個の値を出力）
+	bool  ComputeDescriptor( const Motion & motion, int frame_no, float * descriptor ) const;
+
+  protected:
+	// ノードの追加
+	void  InsertNode( int node_no );
+
+	// 姿勢記述子とノードの距離の２乗
+	float  ComputeDistance( const float * descriptor, int node_no ) const;
+
+	// 指定階層で、開始ノードから最も近いノードを貪欲法により探索
+	int  SearchNearestInLevel( const float * descriptor, int entry, int level ) const;
+
+	// 指定階層で、開始ノードから近い順に最大 ef 個のノードを探索（found には距離の２乗とノード番号を昇順に出力）
+	void  SearchLevel( const float * descriptor, int entry, int ef, int level, vector< pair< float, int > > & found ) const;
+
+	// 候補（距離の昇順）から、近傍グラフの隣接ノードを最大 max_num 個選択
+	void  SelectNeighbors( const vector< pair< float, int > > & candidates, int max_num, vector< int > & neighbors ) const;
+
+	// 検索結果の変換（距離の２乗から関節点あたりの距離に変換し、範囲外のものを除く）
+	void  MakeResults( const vector< pair< float, int > > & found, int max_results, float max_distance, vector< PoseIndexResult > & results ) const;
+};
+
+
+#endif // _POSE_INDEX_H_
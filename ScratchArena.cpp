@@ -0,0 +1,192 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  フレーム単位の作業領域（モノトニックアリーナ・オブジェクトプール）
+**/
+
+
+// ライブラリ・クラス定義の読み込み
+#include "ScratchArena.h"
+
+// 標準ライブラリの読み込み
+#include <cstdlib>
+#include <new>
+
+using namespace  std;
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  モノトニックアリーナ
+//
+
+
+//
+//  コンストラクタ
+//
+ScratchArena::ScratchArena( size_t initial_block_size )
+{
+	current = 0;
+	block_size = initial_block_size;
+	stats.num_system_allocations = 0;
+	stats.reserved_bytes = 0;
+	ResetStatistics();
+}
+
+
+//
+//  デストラクタ
+//
+ScratchArena::~ScratchArena()
+{
+	for ( size_t i = 0; i < blocks.size(); i++ )
+		free( blocks[ i ].data );
+}
+
+
+//
+//  領域を割り当て
+//
+void *  ScratchArena::Allocate( size_t size, size_t align )
+{
+	if ( size == 0 )
+		size = 1;
+
+	// 現在のブロックに収まらなければ、後ろの未使用のブロックか新しいブロックに移る
+	while ( true )
+	{
+		if ( current < (int) blocks.size() )
+		{
+			Block &  b = blocks[ current ];
+			size_t  offset = ( b.used + align - 1 ) & ~( align - 1 );
+			if ( offset + size <= b.size )
+			{
+				stats.used_bytes += offset + size - b.used;
+				if ( stats.used_bytes > stats.peak_bytes )
+					stats.peak_bytes = stats.used_bytes;
+				stats.num_allocations++;
+				b.used = offset + size;
+				return  b.data + offset;
+			}
+			if ( current + 1 < (int) blocks.size() )
+			{
+				current++;
+				continue;
+			}
+		}
+		AddBlock( size + align );
+		current = (int) blocks.size() - 1;
+	}
+}
+
+
+//
+//  現在の使用位置を取得
+//
+ScratchArena::Marker  ScratchArena::GetMarker() const
+{
+	Marker  marker;
+	marker.block = current;
+	marker.offset = ( current < (int) blocks.size() ) ? blocks[ current ].used : 0;
+	return  marker;
+}
+
+
+//
+//  指定位置まで巻き戻し
+//
+void  ScratchArena::Rewind( const Marker & marker )
+{
+	for ( int i = (int) blocks.size() - 1; i > marker.block; i-- )
+	{
+		stats.used_bytes -= blocks[ i ].used;
+		blocks[ i ].used = 0;
+	}
+	if ( marker.block < (int) blocks.size() )
+	{
+		stats.used_bytes -= blocks[ marker.block ].used - marker.offset;
+		blocks[ marker.block ].used = marker.offset;
+	}
+	current = marker.block;
+	stats.num_rewinds++;
+
+	// 先頭まで巻き戻した時、複数のブロックがあれば合計サイズの１つのブロックにまとめる
+	// （以降は１つのブロックに収まるため、ブロックの追加が発生しなくなる）
+	if ( ( marker.block == 0 ) && ( marker.offset == 0 ) && ( blocks.size() > 1 ) )
+	{
+		size_t  total = stats.reserved_bytes;
+		for ( size_t i = 0; i < blocks.size(); i++ )
+			free( blocks[ i ].data );
+		blocks.clear();
+		stats.reserved_bytes = 0;
+		AddBlock( total );
+		current = 0;
+	}
+}
+
+
+//
+//  全体を巻き戻し
+//
+void  ScratchArena::Reset()
+{
+	Marker  marker;
+	marker.block = 0;
+	marker.offset = 0;
+	Rewind( marker );
+}
+
+
+//
+//  統計情報を初期化
+//
+void  ScratchArena::ResetStatistics()
+{
+	stats.num_system_allocations = 0;
+	stats.used_bytes = 0;
+	for ( size_t i = 0; i < blocks.size(); i++ )
+		stats.used_bytes += blocks[ i ].used;
+	stats.peak_bytes = stats.used_bytes;
+	stats.num_allocations = 0;
+	stats.num_rewinds = 0;
+}
+
+
+//
+//  ブロックを追加
+//
+void  ScratchArena::AddBlock( size_t min_size )
+{
+	// 追加するごとにブロックのサイズを倍にする
+	size_t  size = block_size;
+	if ( !blocks.empty() )
+		size = blocks.back().size * 2;
+	if ( size < min_size )
+		size = min_size;
+
+	Block  b;
+	b.data = (char *) malloc( size );
+	if ( !b.data )
+		throw  bad_alloc();
+	b.size = size;
+	b.used = 0;
+	blocks.push_back( b );
+
+	stats.num_system_allocations++;
+	stats.reserved_bytes += size;
+}
+
+
+//
+//  現在のスレッドのアリーナを取得
+//
+ScratchArena &  GetThreadScratchArena()
+{
+	static thread_local ScratchArena  arena;
+	return  arena;
+}
@@ -0,0 +1,231 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  フレーム単位の作業領域（モノトニックアリーナ・オブジェクトプール）
+***
+***  ScratchArena は確保済みのブロックの先頭から順に領域を割り当て、個別の解放は行わない
+***  ScratchArenaScope で囲んだ範囲で割り当てた領域は、スコープの終了時にまとめて巻き戻される
+***  （フレームごとにスコープを置くことで、２フレーム目以降はシステムのメモリ確保・解放が発生しなくなる）
+***  アリーナはスレッドごとに１つ GetThreadScratchArena() で取得し、他のスレッドとは共有しない
+***  アリーナにはデストラクタの呼び出しが不要な型（数値・座標・行列など）のみを格納すること
+**/
+
+#ifndef  _SCRATCH_ARENA_H_
+#define  _SCRATCH_ARENA_H_
+
+
+// 標準ライブラリの読み込み
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <type_traits>
+
+
+//
+//  アリーナの統計情報
+//
+struct  ScratchArenaStatistics
+{
+	// システムからのブロックの確保回数・確保済みの容量（バイト数）
+	long long  num_system_allocations;
+	size_t  reserved_bytes;
+
+	// 使用中のバイト数・使用量の最大値
+	size_t  used_bytes;
+	size_t  peak_bytes;
+
+	// 領域の割り当て回数・巻き戻しの回数
+	long long  num_allocations;
+	long long  num_rewinds;
+};
+
+
+//
+//  モノトニックアリーナ（フレーム単位の作業領域）
+//
+class  ScratchArena
+{
+  public:
+	// 巻き戻し位置
+	struct  Marker
+	{
+		int  block;
+		size_t  offset;
+	};
+
+  protected:
+	// ブロック
+	struct  Block
+	{
+		char *  data;
+		size_t  size;
+		size_t  used;
+	};
+
+	// 確保済みのブロック（current より後のブロックは未使用）
+	std::vector< Block >  blocks;
+	int  current;
+
+	// 新しく確保するブロックの最小サイズ
+	size_t  block_size;
+
+	// 統計情報
+	ScratchArenaStatistics  stats;
+
+  public:
+	// コンストラクタ・デストラクタ
+	ScratchArena( size_t initial_block_size = 256 * 1024 );
+	~ScratchArena();
+
+  private:
+	// コピーは禁止
+	ScratchArena( const ScratchArena & );
+	ScratchArena &  operator=( const ScratchArena & );
+
+  public:
+	// 領域を割り当て（解放は Rewind() でまとめて行う）
+	void *  Allocate( size_t size, size_t align = alignof( std::max_align_t ) );
+
+	// 配列を割り当て（初期化は行わない）
+	template< class T >
+	T *  AllocateArray( size_t count )
+	{
+		static_assert( std::is_trivially_destructible< T >::value, "ScratchArena stores trivially destructible types only" );
+		return  (T *) Allocate( sizeof( T ) * count, alignof( T ) );
+	}
+
+	// 現在の使用位置を取得
+	Marker  GetMarker() const;
+
+	// 指定位置まで巻き戻し（先頭まで巻き戻した時、複数のブロックがあれば１つのブロックにまとめる）
+	void  Rewind( const Marker & marker );
+
+	// 全体を巻き戻し
+	void  Reset();
+
+	// 統計情報を取得・初期化（初期化後も確保済みの容量は維持する）
+	const ScratchArenaStatistics &  GetStatistics() const { return  stats; }
+	void  ResetStatistics();
+
+  protected:
+	// ブロックを追加
+	void  AddBlock( size_t min_size );
+};
+
+
+// 現在のスレッドのアリーナを取得
+ScratchArena &  GetThreadScratchArena();
+
+
+//
+//  アリーナの使用範囲（スコープの終了時に開始時の位置まで巻き戻す）
+//
+class  ScratchArenaScope
+{
+  protected:
+	ScratchArena &  arena;
+	ScratchArena::Marker  marker;
+
+  public:
+	ScratchArenaScope( ScratchArena & a ) : arena( a ), marker( a.GetMarker() ) {}
+	~ScratchArenaScope() { arena.Rewind( marker ); }
+
+  private:
+	ScratchArenaScope( const ScratchArenaScope & );
+	ScratchArenaScope &  operator=( const ScratchArenaScope & );
+};
+
+
+//
+//  アリーナから割り当てる標準ライブラリのアロケータ（解放は何もしない）
+//  コンテナはアリーナの巻き戻し前に破棄すること
+//
+template< class T >
+class  ScratchAllocator
+{
+  public:
+	typedef  T  value_type;
+
+	ScratchArena *  arena;
+
+  public:
+	ScratchAllocator( ScratchArena & a ) : arena( &a ) {}
+	template< class U >
+	ScratchAllocator( const ScratchAllocator< U > & a ) : arena( a.arena ) {}
+
+	T *  allocate( size_t n ) { return  arena->AllocateArray< T >( n ); }
+	void  deallocate( T *, size_t ) {}
+
+	template< class U >
+	bool  operator==( const ScratchAllocator< U > & a ) const { return  arena == a.arena; }
+	template< class U >
+	bool  operator!=( const ScratchAllocator< U > & a ) const { return  arena != a.arena; }
+};
+
+// アリーナから割り当てる可変長配列
+template< class T >
+using  ScratchVector = std::vector< T, ScratchAllocator< T > >;
+
+
+//
+//  オブジェクトプール（返却されたオブジェクトを破棄せずに再利用する）
+//  プールはスレッドごとに用意し、他のスレッドとは共有しない
+//
+template< class T >
+class  ObjectPool
+{
+  protected:
+	// 全てのオブジェクト・未使用のオブジェクト
+	std::vector< std::unique_ptr< T > >  objects;
+	std::vector< T * >  free_objects;
+
+  public:
+	// オブジェクトを取得（未使用のものがなければ生成する）
+	T *  Acquire()
+	{
+		if ( free_objects.empty() )
+		{
+			objects.push_back( std::unique_ptr< T >( new T() ) );
+			return  objects.back().get();
+		}
+		T *  obj = free_objects.back();
+		free_objects.pop_back();
+		return  obj;
+	}
+
+	// オブジェクトを返却（内容は次の取得時まで保持される）
+	void  Release( T * obj ) { free_objects.push_back( obj ); }
+
+	// 生成したオブジェクト数
+	int  GetNumObjects() const { return  (int) objects.size(); }
+};
+
+
+//
+//  オブジェクトプールから取得したオブジェクト（スコープの終了時に返却）
+//
+template< class T >
+class  PooledObject
+{
+  protected:
+	ObjectPool< T > &  pool;
+	T *  obj;
+
+  public:
+	PooledObject( ObjectPool< T > & p ) : pool( p ), obj( p.Acquire() ) {}
+	~PooledObject() { pool.Release( obj ); }
+
+	T &  operator*() const { return  *obj; }
+	T *  operator->() const { return  obj; }
+
+  private:
+	PooledObject( const PooledObject & );
+	PooledObject &  operator=( const PooledObject & );
+};
+
+
+#endif // _SCRATCH_ARENA_H_
@@ -8,15 +8,23 @@
 
 // ヘッダファイルのインクルード
 #include "SimpleHuman.h"
-#include "bvh.h"
+#include "BVH.h"
 
-// OpenGL + GLUT を使用
+// OpenGL + GLUT を使用（SH_GL_DISABLED を定義してコンパイルすると描画関数を除き、OpenGL なしで使用できる）
+#ifndef  SH_GL_DISABLED
 #include <gl/glut.h>
+#endif
+
+// 処理時間の計測
+#include "Trace.h"
 
 // 標準算術関数・定数の定義
 #define  _USE_MATH_DEFINES
 #include <math.h>
 
+// 文字列の比較（FindSegment・FindJoint）
+#include <string.h>
+
 // ADDED: std::transform用
 #include <algorithm>
 
@@ -598,15 +606,25 @@ Motion *  CoustructBVHMotion( class BVH * bvh, const Skeleton * bvh_body )
 //
 Motion *  LoadAndCoustructBVHMotion( const char * bvh_file_name, const Skeleton * bvh_body )
 {
+	TRACE_SCOPE_CAT( "LoadAndCoustructBVHMotion", "io" );
+
 	// BVH動作データを読み込み
-	BVH  bvh( bvh_file_name );
+	BVH  bvh;
+	{
+		TRACE_SCOPE_CAT( "BVH::Load", "io" );
+		bvh.Load( bvh_file_name );
+	}
 
 	// 読み込みに失敗したら終了
 	if ( !bvh.IsLoadSuccess() )
 		return  NULL;
 
 	// BVH動作から骨格モデルと動作データを生成
-	Motion *  motion = CoustructBVHMotion( &bvh, bvh_body );
+	Motion *  motion = NULL;
+	{
+		TRACE_SCOPE_CAT( "CoustructBVHMotion", "io" );
+		motion = CoustructBVHMotion( &bvh, bvh_body );
+	}
 
 	// 生成した動作データを返す
 	return  motion;
@@ -879,6 +897,8 @@ void  ForwardKinematicsIteration(
 //
 void  ForwardKinematics( const Posture & posture, vector< Matrix4f > & seg_frame_array, vector< Point3f > & joi_pos_array )
 {
+	TRACE_SCOPE_CAT( "ForwardKinematics", "kinematics" );
+
 	// 配列初期化
 	seg_frame_array.resize( posture.body->num_segments );
 	joi_pos_array.resize( posture.body->num_joints );
@@ -895,6 +915,8 @@ void  ForwardKinematics( const Posture & posture, vector< Matrix4f > & seg_frame
 //
 void  ForwardKinematics( const Posture & posture, vector< Matrix4f > & seg_frame_array )
 {
+	TRACE_SCOPE_CAT( "ForwardKinematics", "kinematics" );
+
 	// 配列初期化
 	seg_frame_array.resize( posture.body->num_segments );
 
@@ -993,6 +1015,8 @@ void  TransformPosture( const Matrix4f & trans, Posture & posture )
 	trans.transform( &posture.root_pos );
 }
 
+#ifndef  SH_GL_DISABLED
+
 //
 //  骨格モデルの１本のリンクを楕円体で描画
 //
@@ -1340,3 +1364,4 @@ void DrawPostureMultiSelect(const Posture& posture, const std::vector<bool>& sel
 }
 
 
+#endif // SH_GL_DISABLED
@@ -13,6 +13,14 @@
 #include "SimpleHumanGLUT.h"
 #include <cmath>
 
+// ̐ݒiWindows ȊOł GLX ̊g@\gpj
+#if !defined( _WIN32 ) && !defined( __APPLE__ )
+#include <GL/glx.h>
+#endif
+
+// Ԃ̌v
+#include "Trace.h"
+
 // ImGui
 #include "imgui.h"
 #include "imgui_impl_glut.h"
@@ -43,6 +51,9 @@ const char *    software_description = "Human Animation Sample\nCopyright (c) 20
 // sAvP[V̐ؑ֊֐ivg^Cv錾j
 void  ChangeApp( int app_no );
 
+// t[̎s^C~O̊Ǘ
+FrameScheduler    frame_scheduler;
+
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -258,6 +269,25 @@ void  GLUTBaseApp::Animation( float delta )
 }
 
 
+//
+//  Aj[V̌ʂ̕
+//
+void  GLUTBaseApp::InterpolateAnimation( float /*alpha*/, float /*delta*/ )
+{
+	// ftHgł͉ȂiŌ̍XVʂ̂܂ܕ`悷j
+}
+
+
+//
+//  Aj[Vǂ
+//
+bool  GLUTBaseApp::IsAnimating()
+{
+	// ftHgł͏ɃAj[VƂit[XVE`悷j
+	return  true;
+}
+
+
 //
 //  SpaceMouse͏ihNXŃI[o[Ch\j
 //
@@ -388,12 +418,67 @@ void  UpdateSpaceMouseTransform()
 		app->ProcessSpaceMouseInput();
 		// SpaceMouse̕ϊZbgiݐςhj
 		CSpaceMouseGLUT::GetInstance().Reset();
+		// ͂ʂɔf
+		RequestRedisplay();
 	}
 }
 #endif
 
 
 
+///////////////////////////////////////////////////////////////////////////////
+//
+//  t[̎s^C~O̊Ǘ
+//
+
+
+//
+//  t[̎s^C~O̊Ǘ擾
+//
+FrameScheduler &  GetFrameScheduler()
+{
+	return  frame_scheduler;
+}
+
+
+//
+//  ĕ`v
+//
+void  RequestRedisplay()
+{
+	frame_scheduler.RequestRedraw();
+	glutPostRedisplay();
+}
+
+
+//
+//  ̐ݒiobt@̌ԊuݒA݂̕`ReLXgɓKpj
+//
+static bool  SetSwapInterval( int interval )
+{
+#if defined( _WIN32 )
+	typedef BOOL ( WINAPI * SwapIntervalEXTProc )( int );
+	SwapIntervalEXTProc  swap_interval_ext = (SwapIntervalEXTProc) wglGetProcAddress( "wglSwapIntervalEXT" );
+	if ( swap_interval_ext )
+		return  swap_interval_ext( interval ) != FALSE;
+	return  false;
+#elif !defined( __APPLE__ )
+	typedef int ( * SwapIntervalMESAProc )( unsigned int );
+	typedef int ( * SwapIntervalSGIProc )( int );
+	SwapIntervalMESAProc  swap_interval_mesa = (SwapIntervalMESAProc) glXGetProcAddressARB( (const GLubyte *) "glXSwapIntervalMESA" );
+	if ( swap_interval_mesa )
+		return  swap_interval_mesa( interval ) == 0;
+	SwapIntervalSGIProc  swap_interval_sgi = (SwapIntervalSGIProc) glXGetProcAddressARB( (const GLubyte *) "glXSwapIntervalSGI" );
+	if ( swap_interval_sgi && ( interval > 0 ) )
+		return  swap_interval_sgi( interval ) == 0;
+	return  false;
+#else
+	return  false;
+#endif
+}
+
+
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 //  GLUTt[[NiCxgAECj
@@ -417,21 +502,51 @@ void  SpecialKeyboardUpCallback( int key, int mx, int my )
 //
 void  DisplayCallback( void )
 {
-	// ImGui new frame
-	ImGui_ImplOpenGL2_NewFrame();
-	ImGui_ImplGLUT_NewFrame();
-	ImGui::NewFrame();
+	// ̐ݒ肪ύXꂽ`ReLXgɓKp
+	static int  applied_vsync = -1;
+	int  vsync = frame_scheduler.IsVSyncEnabled() ? 1 : 0;
+	if ( vsync != applied_vsync )
+	{
+		SetSwapInterval( vsync );
+		applied_vsync = vsync;
+	}
 
-	// AvP[V̕`揈
-	if ( app )
-		app->Display();
+	// t[Pʂ̏Ԃ̌vJn
+	frame_scheduler.BeginRender();
+	TraceBeginFrame();
+	{
+		TRACE_SCOPE_CAT( "Frame", "render" );
+
+		// ImGui new frame
+		ImGui_ImplOpenGL2_NewFrame();
+		ImGui_ImplGLUT_NewFrame();
+		ImGui::NewFrame();
+
+		// AvP[V̕`揈
+		if ( app )
+		{
+			TRACE_SCOPE_CAT( "App::Display", "render" );
+			app->Display();
+		}
+
+		// ImGui rendering
+		{
+			TRACE_SCOPE_CAT( "ImGui::Render", "render" );
+			ImGui::Render();
+			ImGui_ImplOpenGL2_RenderDrawData(ImGui::GetDrawData());
+		}
 
-	// ImGui rendering
-	ImGui::Render();
-	ImGui_ImplOpenGL2_RenderDrawData(ImGui::GetDrawData());
+		// obNobt@ɕ`悵ʂtgobt@ɕ\
+		{
+			TRACE_SCOPE_CAT( "SwapBuffers", "render" );
+			glutSwapBuffers();
+		}
+	}
+	TraceEndFrame();
+	frame_scheduler.EndRender();
 
-	// obNobt@ɕ`悵ʂtgobt@ɕ\
-	glutSwapBuffers();
+	// Pt[̗\Z̎gpL^
+	TRACE_COUNTER( "Frame::BudgetUsage", frame_scheduler.GetStats().budget_usage * 100.0f );
 }
 
 
@@ -454,6 +569,9 @@ void  ReshapeCallback( int w, int h )
 	// AvP[ṼEBhETCYύX
 	if ( app )
 		app->Reshape( w, h );
+
+	// ĕ`
+	RequestRedisplay();
 }
 
 
@@ -468,7 +586,7 @@ void  MouseClickCallback( int button, int state, int mx, int my )
 	// ImGui}EXgp̏ꍇAAvP[V̏XLbv
 	if (ImGui::GetIO().WantCaptureMouse)
 	{
-		glutPostRedisplay();
+		RequestRedisplay();
 		return;
 	}
 
@@ -477,7 +595,7 @@ void  MouseClickCallback( int button, int state, int mx, int my )
 		app->MouseClick( button, state, mx, my );
 
 	// ĕ`
-	glutPostRedisplay();
+	RequestRedisplay();
 }
 
 
@@ -492,7 +610,7 @@ void  MouseDragCallback( int mx, int my )
 	// ImGui}EXgp̏ꍇAAvP[V̏XLbv
 	if (ImGui::GetIO().WantCaptureMouse)
 	{
-		glutPostRedisplay();
+		RequestRedisplay();
 		return;
 	}
 
@@ -501,7 +619,7 @@ void  MouseDragCallback( int mx, int my )
 		app->MouseDrag( mx, my );
 
 	// ĕ`
-	glutPostRedisplay();
+	RequestRedisplay();
 }
 
 
@@ -518,7 +636,7 @@ void  MouseMotionCallback( int mx, int my )
 		app->MouseMotion( mx, my );
 
 	// ĕ`
-	glutPostRedisplay();
+	RequestRedisplay();
 }
 
 
@@ -533,7 +651,7 @@ void  KeyboardCallback( unsigned char key, int mx, int my )
 	// ImGuiL[{[hgp̏ꍇAAvP[V̏XLbv
 	if (ImGui::GetIO().WantCaptureKeyboard)
 	{
-		glutPostRedisplay();
+		RequestRedisplay();
 		return;
 	}
 
@@ -573,7 +691,7 @@ void  KeyboardCallback( unsigned char key, int mx, int my )
 		app->Keyboard( key, mx, my );
 
 	// ĕ`
-	glutPostRedisplay();
+	RequestRedisplay();
 }
 
 
@@ -590,7 +708,7 @@ void  SpecialKeyboardCallback( int key, int mx, int my )
 		app->KeyboardSpecial( key, mx, my );
 
 	// ĕ`
-	glutPostRedisplay();
+	RequestRedisplay();
 }
 
 
@@ -607,26 +725,38 @@ void  IdleCallback( void )
 	// Aj[V
 	if ( app )
 	{
-		// Aj[V̎ԕωijvZ
-#ifdef  WIN32
-		// VXeԂ擾AO񂩂̌oߎԂɉă
-		static DWORD  last_time = 0;
-		DWORD  curr_time = timeGetTime();
-		float  delta = ( curr_time - last_time ) * 0.001f;
-		if ( delta > 0.03f )
-			delta = 0.03f;
-		last_time = curr_time;
-#else
-		// Œ̃gp
-		float  delta = 0.03f;
-#endif
+		bool  animating = app->IsAnimating();
 
-		// AvP[ṼAj[V
-		if ( app )
-			app->Animation( delta );
+		// Aj[Vĕ`̗vA`px̏𒴂Ȃ΁Ãt[
+		if ( frame_scheduler.IsFrameDue( animating ) )
+		{
+			// Ԃ̌o߂ɉāAŒ̎ԍ݂ŃAvP[ṼAj[VĂяo
+			double  update_start_time = FrameScheduler::Now();
+			int  steps = frame_scheduler.BeginUpdate( animating );
+			if ( animating )
+			{
+				TRACE_SCOPE_CAT( "App::Animation", "update" );
+				float  delta = frame_scheduler.GetFixedStep();
+				for ( int i = 0; i < steps; i++ )
+					app->Animation( delta );
 
-		// ĕ`̎woǐōĕ`̃R[obN֐Ă΂j
-		glutPostRedisplay();
+				// ̍XV܂ł̌oߎԂ̊ɉāA`悷Ԃ
+				app->InterpolateAnimation( frame_scheduler.GetInterpolationAlpha(), delta );
+			}
+			frame_scheduler.EndUpdate( update_start_time );
+			TRACE_COUNTER( "Frame::UpdateSteps", steps );
+
+			// ĕ`̎woǐōĕ`̃R[obN֐Ă΂j
+			glutPostRedisplay();
+		}
+
+		// `̕KvȂ΁Ãt[̊Jn܂őҋ@i~ CPU gȂ悤ɂj
+		else
+		{
+			if ( !animating )
+				frame_scheduler.BeginUpdate( false );
+			frame_scheduler.WaitForNextFrame( animating );
+		}
 	}
 
 #ifdef _WIN32
@@ -677,6 +807,9 @@ void  ChangeApp( int app_no )
 	app->Start();
 	if ( curr_app )
 		app->Reshape( win_width, win_height );
+
+	// ĕ`
+	RequestRedisplay();
 }
 
 
@@ -810,6 +943,9 @@ int  SimpleHumanGLUTMain( const vector< class GLUTBaseApp * > & app_lists, int a
 	// _O
 	initEnvironment();
 
+	// Ԃ̌vʂɕ\Xbhݒ
+	TraceSetThreadName( "main" );
+
 	// ImGui
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
@@ -14,7 +14,9 @@
 
 
 // Windows関数定義の読み込み
+#ifdef _WIN32
 #include <windows.h>
+#endif
 
 // GLUT を使用
 #include <GL/glut.h>
@@ -34,6 +36,9 @@
 #include <string>
 using namespace std;
 
+// フレームの実行タイミングの管理
+#include "FrameScheduler.h"
+
 
 
 // SpaceMouseサポートを有効化
@@ -164,9 +169,15 @@ class  GLUTBaseApp
 	// キーボードの特殊キー押下
 	virtual void  KeyboardSpecial( unsigned char key, int mx, int my );
 	
-	// アニメーション処理
+	// アニメーション処理（実時間の経過に応じて、固定の時間刻み delta で呼ばれる）
 	virtual void  Animation( float delta );
 
+	// アニメーション処理の結果の補間（アニメーション処理の後、描画の前に呼ばれる、alpha は次の更新までの経過時間の割合 0～1）
+	virtual void  InterpolateAnimation( float alpha, float delta );
+
+	// アニメーション中かどうか（false の間は、入力や再描画の要求がなければ描画を行わずに待機する）
+	virtual bool  IsAnimating();
+
 	// SpaceMouse入力処理（派生クラスでオーバーライド可能）
 	virtual void  ProcessSpaceMouseInput();
 
@@ -200,5 +211,17 @@ int  SimpleHumanGLUTMain( const vector< class GLUTBaseApp * > & app_lists, int a
 int  SimpleHumanGLUTMain( class GLUTBaseApp * app, int argc, char ** argv, const char * win_title = NULL, int win_width = 0, int win_height = 0 );
 
 
+//
+//  フレームの実行タイミングの管理を取得（固定時間刻み・描画頻度の上限・垂直同期の設定、処理時間の統計の取得に使用）
+//
+FrameScheduler &  GetFrameScheduler();
+
+
+//
+//  再描画を要求（アニメーション中でないときに、入力以外の理由で画面を更新する場合に使用）
+//
+void  RequestRedisplay();
+
+
 
 #endif // SIMPLE_HUMAN_GLUT
@@ -0,0 +1,94 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  計算結果の公開（ロックフリーのトリプルバッファ）
+***
+***  書き込み側のスレッドが BeginWrite() で取得した領域に計算結果を書き込み、Publish() で公開する
+***  読み出し側のスレッドは Acquire() で最新の公開済みの結果を参照カウント付きで取得する
+***  ３つの領域を書き込み側・読み出し側・公開中に割り当て、公開中の領域の番号を atomic な入れ替えのみで受け渡すため、
+***  いずれの側もロックや相手の処理の完了を待たない（読み出し側は公開の途中の結果を参照することはない）
+***  書き込み側・読み出し側はそれぞれ１つのスレッドのみとする
+***  公開した結果は読み出し側が参照を保持している間は変更されず、参照がなくなった領域は書き込み側で再利用する
+**/
+
+#ifndef  _SNAPSHOT_EXCHANGE_H_
+#define  _SNAPSHOT_EXCHANGE_H_
+
+
+// 標準ライブラリの読み込み
+#include <atomic>
+#include <memory>
+
+
+//
+//  計算結果の公開（T は既定のコンストラクタを持つ型）
+//
+template< class T >
+class  SnapshotExchange
+{
+  protected:
+	// 公開中の領域の番号に付ける、未読み出しの印
+	enum { FRESH_BIT = 4, INDEX_MASK = 3 };
+
+	// 領域（slots[write_index] は書き込み側、slots[read_index] は読み出し側のみが参照する）
+	std::shared_ptr< T >  slots[ 3 ];
+
+	// 公開中の領域の番号（未読み出しなら FRESH_BIT を付ける）
+	std::atomic< int >  published;
+
+	// 書き込み側・読み出し側の領域の番号
+	int  write_index;
+	int  read_index;
+
+  public:
+	// コンストラクタ
+	SnapshotExchange() : published( 1 ), write_index( 0 ), read_index( 2 )
+	{
+		for ( int i = 0; i < 3; i++ )
+			slots[ i ] = std::make_shared< T >();
+	}
+
+  private:
+	// コピーは禁止
+	SnapshotExchange( const SnapshotExchange & );
+	SnapshotExchange &  operator=( const SnapshotExchange & );
+
+  public:
+	// 書き込み側の領域を取得（書き込み側のスレッドから呼び出す）
+	// 以前に公開した結果を読み出し側が参照していなければその領域を再利用し、参照していれば新しい領域を割り当てる
+	// （再利用した領域には以前の内容が残っているため、書き込み側で全ての値を設定し直す）
+	T &  BeginWrite()
+	{
+		std::shared_ptr< T > &  slot = slots[ write_index ];
+		if ( slot.use_count() == 1 )
+			std::atomic_thread_fence( std::memory_order_acquire ); // 読み出し側が参照を解放するまでの読み出しの後に書き込む
+		else
+			slot = std::make_shared< T >();
+		return  *slot;
+	}
+
+	// 書き込んだ結果を公開（書き込み側のスレッドから呼び出す）
+	void  Publish()
+	{
+		int  prev = published.exchange( write_index | FRESH_BIT, std::memory_order_acq_rel );
+		write_index = prev & INDEX_MASK;
+	}
+
+	// 最新の公開済みの結果を取得（読み出し側のスレッドから呼び出す、新しい結果が公開されていなければ前回と同じ結果を返す）
+	std::shared_ptr< const T >  Acquire()
+	{
+		if ( published.load( std::memory_order_relaxed ) & FRESH_BIT )
+		{
+			int  prev = published.exchange( read_index, std::memory_order_acq_rel );
+			read_index = prev & INDEX_MASK;
+		}
+		return  slots[ read_index ];
+	}
+};
+
+
+#endif // _SNAPSHOT_EXCHANGE_H_
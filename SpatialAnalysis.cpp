@@ -1,98 +1,37 @@
 ﻿#include "SpatialAnalysis.h"
 #include "SimpleHumanGLUT.h" // OpenGL用
+#include "Trace.h"
 #include <cmath>
 #include <algorithm>
 #include <cstdio>
 #include <iostream>
-#include <fstream>  // ファイルI/O用
 
 using namespace std;
 
 // --- 内部ヘルパー関数 ---
 
-// 指定された軸の値を取得（0:x, 1:y, 2:z）
-static float sa_get_axis_value(const Point3f& p, int axis_index) {
-    if (axis_index == 0) return p.x; 
-    if (axis_index == 1) return p.y;
-    return p.z; 
-}
-
 static bool sa_should_use_segment_mode(bool show_segment_mode, int selected_count, int selected_segment_index) {
     return show_segment_mode && (selected_count > 0 || selected_segment_index >= 0);
 }
 
+static int sa_count_selected_segments(const std::vector<bool>& selected_segments) {
+    int count = 0;
+    for (size_t i = 0; i < selected_segments.size(); ++i)
+        if (selected_segments[i])
+            count++;
+    return count;
+}
+
 static int sa_normalize_feature_index(int feature_index) {
     if (feature_index < 0 || feature_index >= SA_FEATURE_COUNT)
         return 0;
     return feature_index;
 }
 
-static float sa_fill_diff_grid_and_compute_max(const VoxelGrid& a, const VoxelGrid& b, VoxelGrid& out_diff, float floor_value = 1.0f, float eps = 1e-5f) {
-    int size = (std::min)((int)a.data.size(), (int)b.data.size());
-    size = (std::min)(size, (int)out_diff.data.size());
-
-    float out_max = 0.0f;
-    for (int i = 0; i < size; ++i) {
-        float d = fabsf(a.data[i] - b.data[i]);
-        out_diff.data[i] = d;
-        if (d > out_max)
-            out_max = d;
-    }
-
-    for (int i = size; i < (int)out_diff.data.size(); ++i)
-        out_diff.data[i] = 0.0f;
-
-    if (out_max < eps)
-        out_max = floor_value;
-    return out_max;
-}
-
-static const char* sa_get_feature_file_prefix(int feature_index) {
-    static const char* prefixes[SA_FEATURE_COUNT] = {"acc", "spd_acc", "jrk_acc", "ine_acc", "pax_acc"};
-    if (feature_index < 0 || feature_index >= SA_FEATURE_COUNT)
-        return "acc";
-    return prefixes[feature_index];
-}
-
-static bool sa_save_accumulated_feature_grids(const std::string& base,
-                                              VoxelGrid grids1[SA_FEATURE_COUNT],
-                                              VoxelGrid grids2[SA_FEATURE_COUNT],
-                                              VoxelGrid grids_diff[SA_FEATURE_COUNT]) {
-    for (int f = 0; f < SA_FEATURE_COUNT; ++f) {
-        std::string prefix = sa_get_feature_file_prefix(f);
-        if (!grids1[f].SaveToFile((base + "_" + prefix + "1.bin").c_str())) return false;
-        if (!grids2[f].SaveToFile((base + "_" + prefix + "2.bin").c_str())) return false;
-        if (!grids_diff[f].SaveToFile((base + "_" + prefix + "_diff.bin").c_str())) return false;
-    }
-    return true;
-}
-
-static bool sa_load_accumulated_feature_grids(const std::string& base,
-                                              VoxelGrid grids1[SA_FEATURE_COUNT],
-                                              VoxelGrid grids2[SA_FEATURE_COUNT],
-                                              VoxelGrid grids_diff[SA_FEATURE_COUNT]) {
-    for (int f = 0; f < SA_FEATURE_COUNT; ++f) {
-        std::string prefix = sa_get_feature_file_prefix(f);
-        if (!grids1[f].LoadFromFile((base + "_" + prefix + "1.bin").c_str())) return false;
-        if (!grids2[f].LoadFromFile((base + "_" + prefix + "2.bin").c_str())) return false;
-        if (!grids_diff[f].LoadFromFile((base + "_" + prefix + "_diff.bin").c_str())) return false;
-    }
-    return true;
-}
-
 static float sa_sample_voxel_value_from_grid(const VoxelGrid& grid, int gx, int gy, int gz) {
     return grid.Get(gx, gy, gz);
 }
 
-static std::function<float(int, int, int)> sa_make_voxel_index_sampler(const VoxelGrid* grid) {
-    if (!grid)
-        return [](int, int, int) -> float { return 0.0f; };
-
-    return [grid](int x, int y, int z) -> float {
-        return sa_sample_voxel_value_from_grid(*grid, x, y, z);
-    };
-}
-
 static float sa_sample_voxel_at_world_pos_with_bounds(
     const VoxelGrid& grid,
     const float world_bounds[3][2],
@@ -131,6 +70,52 @@ static std::function<float(const Point3f&)> sa_make_voxel_world_sampler(
     };
 }
 
+// ピラミッドの指定段から、ワールド座標を含む格子の値（表示用に換算）を読むサンプラ
+static std::function<float(const Point3f&)> sa_make_pyramid_world_sampler(
+    const VoxelGrid* grid,
+    const VoxelGridPyramid* pyramid,
+    int level,
+    const float world_bounds[3][2],
+    int grid_resolution) {
+    if (!grid || !pyramid || level <= 0)
+        return sa_make_voxel_world_sampler(grid, world_bounds, grid_resolution);
+
+    float scale = pyramid->GetLevelScale(level);
+    return [grid, pyramid, level, scale, world_bounds, grid_resolution](const Point3f& world_pos) -> float {
+        float fx = (world_pos.x - world_bounds[0][0]) / (world_bounds[0][1] - world_bounds[0][0]);
+        float fy = (world_pos.y - world_bounds[1][0]) / (world_bounds[1][1] - world_bounds[1][0]);
+        float fz = (world_pos.z - world_bounds[2][0]) / (world_bounds[2][1] - world_bounds[2][0]);
+        if (!(fx >= 0.0f && fx <= 1.0f && fy >= 0.0f && fy <= 1.0f && fz >= 0.0f && fz <= 1.0f))
+            return 0.0f;
+
+        int gx = (std::min)(grid_resolution - 1, (int)(fx * grid_resolution));
+        int gy = (std::min)(grid_resolution - 1, (int)(fy * grid_resolution));
+        int gz = (std::min)(grid_resolution - 1, (int)(fz * grid_resolution));
+        return pyramid->GetValueAtBaseVoxel(*grid, level, gx, gy, gz) * scale;
+    };
+}
+
+// 1つの格子の大きさ sample_size が段 0 のボクセルの大きさ voxel_size の何倍かに応じて段を選ぶ（max_level 以下）
+static int sa_select_pyramid_level(float sample_size, float voxel_size, int max_level) {
+    int level = 0;
+    if (voxel_size <= 0.0f)
+        return level;
+    while (level < max_level && voxel_size * (float)(2 << level) <= sample_size)
+        ++level;
+    return level;
+}
+
+// 断面図の1辺の描画セル数
+static const int kSliceMapDrawResolution = 64;
+
+// 3D表示で1つのボクセルを描画する最小の画面上の大きさ（ピクセル）と、1辺あたりの最大の描画数
+static const float kVoxel3DMinPixels = 3.0f;
+static const int kVoxel3DMaxDrawResolution = 64;
+
+// 集団に対する z 値の表示の最大値（この値以上は同じ色）と、z 値の計算に使う標準偏差の下限（全ボクセルの標準偏差の最大値に対する割合）
+static const float kGroupZScoreDisplayMax = 3.0f;
+static const float kGroupZScoreStdDevFloor = 0.05f;
+
 // 値（0～1）をHSV色空間でヒートマップカラー（青→赤）に変換
 static Color3f sa_get_heatmap_color(float value) {
     Color3f color;
@@ -156,679 +141,8 @@ static Color3f sa_get_heatmap_color(float value) {
     return color; 
 }
 
-static Point3f sa_voxel_center_from_linear_index(int linear_index, int resolution, const float world_bounds[3][2]) {
-    int xy = resolution * resolution;
-    int z = linear_index / xy;
-    int rem = linear_index - z * xy;
-    int y = rem / resolution;
-    int x = rem - y * resolution;
-
-    float range_x = world_bounds[0][1] - world_bounds[0][0];
-    float range_y = world_bounds[1][1] - world_bounds[1][0];
-    float range_z = world_bounds[2][1] - world_bounds[2][0];
-
-    float wx = world_bounds[0][0] + (x + 0.5f) * (range_x / resolution);
-    float wy = world_bounds[1][0] + (y + 0.5f) * (range_y / resolution);
-    float wz = world_bounds[2][0] + (z + 0.5f) * (range_z / resolution);
-    return Point3f(wx, wy, wz);
-}
-
-static bool sa_world_to_voxel_index(const Point3f& p, int resolution, const float world_bounds[3][2], int& x, int& y, int& z);
-static void sa_accumulate_feature_value_to_grids(int feature, VoxelGrid* seg_grid_ptr, VoxelGrid& acc_grid, int x, int y, int z, float v);
-static Point3f sa_transform_world_by_root_delta(const Point3f& world_pos, const Point3f& from_root_pos,
-    const Matrix3f& from_root_ori, const Point3f& to_root_pos, const Matrix3f& to_root_ori);
-static int sa_min_segment_count(size_t a, size_t b);
-static int sa_get_frame_index_from_time(const Motion* m, float time);
-static float sa_compute_principal_axis_angular_speed_sparse_values(
-    const std::vector<SparseVoxel>& curr_sparse_values,
-    const std::vector<SparseVoxel>& prev_sparse_values,
-    int resolution,
-    float dt,
-    const float world_bounds[3][2],
-    float weight_threshold = 1e-6f);
-static void sa_apply_principal_axis_speed_to_sparse_segment(
-    std::vector<SparseVoxel>& curr,
-    const std::vector<SparseVoxel>& prev,
-    int resolution,
-    float dt,
-    const float world_bounds[3][2],
-    float weight_threshold);
-
-static void sa_parse_cache_meta_tail(
-    const std::vector<double>& meta_tail_values,
-    int& legacy_segment_dense_flag,
-    size_t& bounds_offset) {
-    legacy_segment_dense_flag = -1;
-    bounds_offset = 0;
-    if (meta_tail_values.size() >= 7) {
-        double flag = meta_tail_values[0];
-        if (flag == 0.0 || flag == 1.0) {
-            legacy_segment_dense_flag = (int)flag;
-            bounds_offset = 1;
-        }
-    }
-}
-
-static bool sa_save_cache_meta_file(
-    const std::string& meta_file,
-    int grid_resolution,
-    const float max_accumulated_val[SA_FEATURE_COUNT],
-    const float world_bounds[3][2]) {
-    ofstream meta_ofs(meta_file);
-    if (!meta_ofs)
-        return false;
-
-    meta_ofs << grid_resolution << std::endl;
-    meta_ofs << max_accumulated_val[0] << std::endl;
-    meta_ofs << max_accumulated_val[1] << std::endl;
-    meta_ofs << max_accumulated_val[2] << std::endl;
-    meta_ofs << max_accumulated_val[3] << std::endl;
-    meta_ofs << 0 << std::endl;
-    for (int i = 0; i < 3; ++i)
-        meta_ofs << world_bounds[i][0] << " " << world_bounds[i][1] << std::endl;
-
-    return true;
-}
-
-static bool sa_load_cache_meta_file(
-    const std::string& meta_file,
-    int& out_res,
-    float out_max_accumulated_val[SA_FEATURE_COUNT],
-    float out_world_bounds[3][2],
-    int& out_legacy_segment_dense_flag,
-    std::string& out_error) {
-    ifstream meta_ifs(meta_file);
-    if (!meta_ifs) {
-        out_error = "Cache file not found: " + meta_file;
-        return false;
-    }
-
-    if (!(meta_ifs >> out_res >> out_max_accumulated_val[0] >> out_max_accumulated_val[1] >> out_max_accumulated_val[2] >> out_max_accumulated_val[3])) {
-        out_error = "Invalid cache metadata format: " + meta_file;
-        return false;
-    }
-    if (out_res <= 0) {
-        out_error = "Invalid cache resolution in metadata: " + meta_file;
-        return false;
-    }
-
-    std::vector<double> meta_tail_values;
-    double tail_value = 0.0;
-    while (meta_ifs >> tail_value)
-        meta_tail_values.push_back(tail_value);
-    if (!meta_ifs.eof()) {
-        out_error = "Invalid cache metadata format: " + meta_file;
-        return false;
-    }
-
-    size_t bounds_offset;
-    sa_parse_cache_meta_tail(meta_tail_values, out_legacy_segment_dense_flag, bounds_offset);
-    if (meta_tail_values.size() < bounds_offset + 6) {
-        out_error = "Invalid cache metadata format: " + meta_file;
-        return false;
-    }
-
-    out_max_accumulated_val[4] = 1.0f;
-    for (int i = 0; i < 3; ++i) {
-        out_world_bounds[i][0] = (float)meta_tail_values[bounds_offset + i * 2 + 0];
-        out_world_bounds[i][1] = (float)meta_tail_values[bounds_offset + i * 2 + 1];
-    }
-
-    return true;
-}
-
-static float sa_compute_grid_max_with_floor(const VoxelGrid& grid, float floor_value = 1.0f, float eps = 1e-5f) {
-    float max_value = 0.0f;
-    for (size_t i = 0; i < grid.data.size(); ++i)
-        if (grid.data[i] > max_value)
-            max_value = grid.data[i];
-    if (max_value < eps)
-        max_value = floor_value;
-    return max_value;
-}
-
-static float sa_compute_max_abs_diff_between_grids(const VoxelGrid& a, const VoxelGrid& b, float floor_value = 1.0f, float eps = 1e-5f) {
-    int size = (std::min)((int)a.data.size(), (int)b.data.size());
-    float max_diff = 0.0f;
-    for (int i = 0; i < size; ++i) {
-        float d = fabsf(a.data[i] - b.data[i]);
-        if (d > max_diff)
-            max_diff = d;
-    }
-    if (max_diff < eps)
-        max_diff = floor_value;
-    return max_diff;
-}
-
-static void sa_recompute_feature_max_values_from_diff_grids(const VoxelGrid diff_grids[SA_FEATURE_COUNT], float out_max_values[SA_FEATURE_COUNT]) {
-    for (int f = 0; f < SA_FEATURE_COUNT; ++f)
-        out_max_values[f] = sa_compute_grid_max_with_floor(diff_grids[f]);
-}
-
-static void sa_scatter_segment_sparse_feature_to_grids(
-    const SegmentVoxelGrid& segment_sparse,
-    int feature,
-    int resolution,
-    const float world_bounds[3][2],
-    const Point3f& curr_root_pos,
-    const Matrix3f& curr_root_ori,
-    float sparse_threshold,
-    VoxelGrid* seg_grid_ptr,
-    VoxelGrid& out_acc) {
-    const std::vector<SparseVoxel>& sparse_list = segment_sparse.voxels;
-    for (size_t k = 0; k < sparse_list.size(); ++k) {
-        const SparseVoxel& sv = sparse_list[k];
-        float v = sv.values[feature];
-        if (v <= sparse_threshold)
-            continue;
-
-        Point3f cached_world = sa_voxel_center_from_linear_index(sv.index, resolution, world_bounds);
-        Point3f transformed_world = cached_world;
-        if (segment_sparse.has_reference) {
-            transformed_world = sa_transform_world_by_root_delta(
-                cached_world,
-                segment_sparse.reference_root_pos,
-                segment_sparse.reference_root_ori,
-                curr_root_pos,
-                curr_root_ori);
-        }
-
-        int x, y, z;
-        if (!sa_world_to_voxel_index(transformed_world, resolution, world_bounds, x, y, z))
-            continue;
-
-        sa_accumulate_feature_value_to_grids(feature, seg_grid_ptr, out_acc, x, y, z, v);
-    }
-}
-
-static void sa_compose_sparse_feature_frames_to_grids(
-    const Motion* m,
-    const MotionFrameSegmentVoxelGridCache& cache,
-    int feature,
-    int resolution,
-    const float world_bounds[3][2],
-    float sparse_threshold,
-    int frame_begin,
-    int frame_end,
-    std::vector<VoxelGrid>* out_seg_grids,
-    VoxelGrid& out_acc) {
-    if (!m)
-        return;
-
-    if (frame_begin < 0)
-        frame_begin = 0;
-    int max_frame = (std::min)((int)cache.frames.size(), m->num_frames) - 1;
-    if (max_frame < 0)
-        return;
-    if (frame_end > max_frame)
-        frame_end = max_frame;
-    if (frame_begin > frame_end)
-        return;
-
-    for (int f = frame_begin; f <= frame_end; ++f) {
-        const FrameSegmentVoxelGrid& frame_sparse = cache.frames[f];
-        const Point3f& curr_root_pos = m->frames[f].root_pos;
-        const Matrix3f& curr_root_ori = m->frames[f].root_ori;
-
-        int seg_count = cache.num_segments;
-        if (out_seg_grids)
-            seg_count = (std::min)(seg_count, (int)out_seg_grids->size());
-
-        for (int s = 0; s < seg_count; ++s) {
-            const SegmentVoxelGrid& segment_sparse = frame_sparse.segment_grids[s];
-            VoxelGrid* seg_grid_ptr = out_seg_grids ? &(*out_seg_grids)[s] : nullptr;
-            sa_scatter_segment_sparse_feature_to_grids(
-                segment_sparse,
-                feature,
-                resolution,
-                world_bounds,
-                curr_root_pos,
-                curr_root_ori,
-                sparse_threshold,
-                seg_grid_ptr,
-                out_acc);
-        }
-    }
-}
-
-static void sa_collect_active_segments(const std::vector<bool>& selected_segments, int selected_segment_index, std::vector<int>& active_segments) {
-    active_segments.clear();
-    for (size_t s = 0; s < selected_segments.size(); ++s) {
-        if (selected_segments[s])
-            active_segments.push_back((int)s);
-    }
-
-    if (selected_segment_index >= 0 &&
-        selected_segment_index < (int)selected_segments.size() &&
-        !selected_segments[selected_segment_index]) {
-        active_segments.push_back(selected_segment_index);
-    }
-}
-
-static bool sa_compose_selected_segments_instant_from_frame_cache(
-    const Motion* m1,
-    const Motion* m2,
-    const MotionFrameSegmentVoxelGridCache& cache1,
-    const MotionFrameSegmentVoxelGridCache& cache2,
-    int feature,
-    int resolution,
-    const float world_bounds[3][2],
-    float sparse_threshold,
-    float current_time,
-    const std::vector<bool>& selected_segments,
-    int selected_segment_index,
-    VoxelGrid& out1,
-    VoxelGrid& out2,
-    VoxelGrid& out_diff,
-    float& out_max) {
-    if (!m1 || !m2)
-        return false;
-    if (feature < 0 || feature >= SA_FEATURE_COUNT)
-        return false;
-    if (cache1.frames.empty() || cache2.frames.empty())
-        return false;
-
-    std::vector<int> active_segments;
-    sa_collect_active_segments(selected_segments, selected_segment_index, active_segments);
-
-    int size = resolution * resolution * resolution;
-    if ((int)out1.data.size() != size) out1.Resize(resolution); else out1.Clear();
-    if ((int)out2.data.size() != size) out2.Resize(resolution); else out2.Clear();
-    if ((int)out_diff.data.size() != size) out_diff.Resize(resolution); else out_diff.Clear();
-
-    if (active_segments.empty()) {
-        out_max = 1.0f;
-        return true;
-    }
-
-    int f1 = sa_get_frame_index_from_time(m1, current_time);
-    int f2 = sa_get_frame_index_from_time(m2, current_time);
-    if (f1 < 0 || f1 >= (int)cache1.frames.size() || f2 < 0 || f2 >= (int)cache2.frames.size())
-        return false;
-
-    const FrameSegmentVoxelGrid& frame_sparse1 = cache1.frames[f1];
-    const FrameSegmentVoxelGrid& frame_sparse2 = cache2.frames[f2];
-    const Point3f& curr_root_pos1 = m1->frames[f1].root_pos;
-    const Matrix3f& curr_root_ori1 = m1->frames[f1].root_ori;
-    const Point3f& curr_root_pos2 = m2->frames[f2].root_pos;
-    const Matrix3f& curr_root_ori2 = m2->frames[f2].root_ori;
-
-    for (size_t k = 0; k < active_segments.size(); ++k) {
-        int s = active_segments[k];
-        if (s >= 0 && s < (int)frame_sparse1.segment_grids.size()) {
-            sa_scatter_segment_sparse_feature_to_grids(
-                frame_sparse1.segment_grids[s],
-                feature,
-                resolution,
-                world_bounds,
-                curr_root_pos1,
-                curr_root_ori1,
-                sparse_threshold,
-                nullptr,
-                out1);
-        }
-        if (s >= 0 && s < (int)frame_sparse2.segment_grids.size()) {
-            sa_scatter_segment_sparse_feature_to_grids(
-                frame_sparse2.segment_grids[s],
-                feature,
-                resolution,
-                world_bounds,
-                curr_root_pos2,
-                curr_root_ori2,
-                sparse_threshold,
-                nullptr,
-                out2);
-        }
-    }
-
-    out_max = sa_fill_diff_grid_and_compute_max(out1, out2, out_diff);
-
-    return true;
-}
-
-static void sa_compose_selected_segments_feature_frames_to_grid(
-    const Motion* m,
-    const MotionFrameSegmentVoxelGridCache& cache,
-    int feature,
-    int resolution,
-    const float world_bounds[3][2],
-    float sparse_threshold,
-    int frame_begin,
-    int frame_end,
-    const std::vector<int>& active_segments,
-    VoxelGrid& out_grid) {
-    if (!m || feature < 0 || feature >= SA_FEATURE_COUNT)
-        return;
-
-    if (frame_begin < 0)
-        frame_begin = 0;
-    int max_frame = (std::min)((int)cache.frames.size(), m->num_frames) - 1;
-    if (max_frame < 0)
-        return;
-    if (frame_end > max_frame)
-        frame_end = max_frame;
-    if (frame_begin > frame_end)
-        return;
-
-    for (int f = frame_begin; f <= frame_end; ++f) {
-        const FrameSegmentVoxelGrid& frame_sparse = cache.frames[f];
-        const Point3f& curr_root_pos = m->frames[f].root_pos;
-        const Matrix3f& curr_root_ori = m->frames[f].root_ori;
-
-        for (size_t k = 0; k < active_segments.size(); ++k) {
-            int s = active_segments[k];
-            if (s < 0 || s >= (int)frame_sparse.segment_grids.size())
-                continue;
-
-            sa_scatter_segment_sparse_feature_to_grids(
-                frame_sparse.segment_grids[s],
-                feature,
-                resolution,
-                world_bounds,
-                curr_root_pos,
-                curr_root_ori,
-                sparse_threshold,
-                nullptr,
-                out_grid);
-        }
-    }
-}
-
-static bool sa_compose_selected_segments_accumulated_from_frame_cache(
-    const Motion* m1,
-    const Motion* m2,
-    const MotionFrameSegmentVoxelGridCache& cache1,
-    const MotionFrameSegmentVoxelGridCache& cache2,
-    int feature,
-    int resolution,
-    const float world_bounds[3][2],
-    float sparse_threshold,
-    const std::vector<bool>& selected_segments,
-    int selected_segment_index,
-    VoxelGrid& out1,
-    VoxelGrid& out2,
-    VoxelGrid& out_diff,
-    float& out_max) {
-    if (!m1 || !m2)
-        return false;
-    if (feature < 0 || feature >= SA_FEATURE_COUNT)
-        return false;
-    if (cache1.frames.empty() || cache2.frames.empty())
-        return false;
-
-    std::vector<int> active_segments;
-    sa_collect_active_segments(selected_segments, selected_segment_index, active_segments);
-
-    int size = resolution * resolution * resolution;
-    if ((int)out1.data.size() != size) out1.Resize(resolution); else out1.Clear();
-    if ((int)out2.data.size() != size) out2.Resize(resolution); else out2.Clear();
-    if ((int)out_diff.data.size() != size) out_diff.Resize(resolution); else out_diff.Clear();
-
-    if (active_segments.empty()) {
-        out_max = 1.0f;
-        return true;
-    }
-
-    sa_compose_selected_segments_feature_frames_to_grid(
-        m1,
-        cache1,
-        feature,
-        resolution,
-        world_bounds,
-        sparse_threshold,
-        0,
-        m1->num_frames - 1,
-        active_segments,
-        out1);
-
-    sa_compose_selected_segments_feature_frames_to_grid(
-        m2,
-        cache2,
-        feature,
-        resolution,
-        world_bounds,
-        sparse_threshold,
-        0,
-        m2->num_frames - 1,
-        active_segments,
-        out2);
-
-    out_max = sa_fill_diff_grid_and_compute_max(out1, out2, out_diff);
-
-    return true;
-}
-
-static bool sa_compute_principal_axis_from_sparse_presence_values(
-    const std::vector<SparseVoxel>& sparse_values,
-    int resolution,
-    const float world_bounds[3][2],
-    Vector3f& axis_out,
-    float weight_threshold) {
-    if (resolution <= 0 || sparse_values.empty())
-        return false;
-
-    double sum_w = 0.0;
-    double cx = 0.0, cy = 0.0, cz = 0.0;
-    for (size_t k = 0; k < sparse_values.size(); ++k) {
-        float w = sparse_values[k].values[0];
-        if (w <= weight_threshold)
-            continue;
-        Point3f c = sa_voxel_center_from_linear_index(sparse_values[k].index, resolution, world_bounds);
-        cx += (double)w * c.x;
-        cy += (double)w * c.y;
-        cz += (double)w * c.z;
-        sum_w += w;
-    }
-
-    if (sum_w <= 1e-8)
-        return false;
-
-    cx /= sum_w;
-    cy /= sum_w;
-    cz /= sum_w;
-
-    double c00 = 0.0, c01 = 0.0, c02 = 0.0;
-    double c11 = 0.0, c12 = 0.0, c22 = 0.0;
-    for (size_t k = 0; k < sparse_values.size(); ++k) {
-        float w = sparse_values[k].values[0];
-        if (w <= weight_threshold)
-            continue;
-        Point3f c = sa_voxel_center_from_linear_index(sparse_values[k].index, resolution, world_bounds);
-        double dx = c.x - cx;
-        double dy = c.y - cy;
-        double dz = c.z - cz;
-        c00 += (double)w * dx * dx;
-        c01 += (double)w * dx * dy;
-        c02 += (double)w * dx * dz;
-        c11 += (double)w * dy * dy;
-        c12 += (double)w * dy * dz;
-        c22 += (double)w * dz * dz;
-    }
-
-    c00 /= sum_w; c01 /= sum_w; c02 /= sum_w;
-    c11 /= sum_w; c12 /= sum_w; c22 /= sum_w;
-
-    Vector3f v(1.0f, 0.0f, 0.0f);
-    for (int it = 0; it < 16; ++it) {
-        Vector3f nv;
-        nv.x = (float)(c00 * v.x + c01 * v.y + c02 * v.z);
-        nv.y = (float)(c01 * v.x + c11 * v.y + c12 * v.z);
-        nv.z = (float)(c02 * v.x + c12 * v.y + c22 * v.z);
-        float len = nv.length();
-        if (len <= 1e-8f)
-            return false;
-        nv.x /= len; nv.y /= len; nv.z /= len;
-        v = nv;
-    }
-
-    axis_out = v;
-    return true;
-}
-
-static float sa_compute_unsigned_angle_between_unit_vectors(const Vector3f& a, const Vector3f& b) {
-    float dot = fabsf(a.x * b.x + a.y * b.y + a.z * b.z);
-    dot = (std::max)(0.0f, (std::min)(1.0f, dot));
-    return acosf(dot);
-}
-
-static int sa_min_segment_count(size_t a, size_t b) {
-    return (std::min)((int)a, (int)b);
-}
-
-static void sa_apply_uniform_principal_axis_speed(std::vector<SparseVoxel>& curr, float omega_axis) {
-    for (size_t k = 0; k < curr.size(); ++k) {
-        if (omega_axis > curr[k].values[4])
-            curr[k].values[4] = omega_axis;
-    }
-}
-
-static float sa_compute_principal_axis_angular_speed_sparse_values(
-    const std::vector<SparseVoxel>& curr_sparse_values,
-    const std::vector<SparseVoxel>& prev_sparse_values,
-    int resolution,
-    float dt,
-    const float world_bounds[3][2],
-    float weight_threshold) {
-    if (resolution <= 0 || dt <= 1e-8f || curr_sparse_values.empty() || prev_sparse_values.empty())
-        return 0.0f;
-
-    float effective_weight_threshold = (std::max)(0.0f, weight_threshold);
-
-    Vector3f e_curr, e_prev;
-    if (!sa_compute_principal_axis_from_sparse_presence_values(curr_sparse_values, resolution, world_bounds, e_curr, effective_weight_threshold))
-        return 0.0f;
-    if (!sa_compute_principal_axis_from_sparse_presence_values(prev_sparse_values, resolution, world_bounds, e_prev, effective_weight_threshold))
-        return 0.0f;
-
-    float dtheta = sa_compute_unsigned_angle_between_unit_vectors(e_curr, e_prev);
-    return dtheta / dt;
-}
-
-static void sa_apply_principal_axis_speed_to_sparse_segment(
-    std::vector<SparseVoxel>& curr,
-    const std::vector<SparseVoxel>& prev,
-    int resolution,
-    float dt,
-    const float world_bounds[3][2],
-    float weight_threshold) {
-    if (resolution <= 0 || curr.empty() || prev.empty())
-        return;
-
-    float omega_axis = sa_compute_principal_axis_angular_speed_sparse_values(
-        curr,
-        prev,
-        resolution,
-        dt,
-        world_bounds,
-        weight_threshold);
-
-    if (omega_axis <= 0.0f)
-        return;
-
-    sa_apply_uniform_principal_axis_speed(curr, omega_axis);
-}
-
-static void sa_apply_principal_axis_speed_to_sparse_segments(
-    std::vector<std::vector<SparseVoxel>>& curr_sparse_values,
-    const std::vector<std::vector<SparseVoxel>>& prev_sparse_values,
-    int resolution,
-    float dt,
-    const float world_bounds[3][2],
-    float weight_threshold) {
-    int seg_count = sa_min_segment_count(curr_sparse_values.size(), prev_sparse_values.size());
-    for (int s = 0; s < seg_count; ++s) {
-        sa_apply_principal_axis_speed_to_sparse_segment(
-            curr_sparse_values[s],
-            prev_sparse_values[s],
-            resolution,
-            dt,
-            world_bounds,
-            weight_threshold);
-    }
-}
-
-static int sa_get_frame_index_from_time(const Motion* m, float time) {
-    if (!m || m->num_frames <= 0 || m->interval <= 1e-8f)
-        return 0;
-    int idx = (int)(time / m->interval);
-    if (idx < 0)
-        idx = 0;
-    if (idx >= m->num_frames)
-        idx = m->num_frames - 1;
-    return idx;
-}
-
-static bool sa_nearly_equal_float(float a, float b, float eps = 1e-5f) {
-    return fabsf(a - b) <= eps;
-}
-
-static bool sa_nearly_equal_point3(const Point3f& a, const Point3f& b, float eps = 1e-5f) {
-    return sa_nearly_equal_float(a.x, b.x, eps) &&
-           sa_nearly_equal_float(a.y, b.y, eps) &&
-           sa_nearly_equal_float(a.z, b.z, eps);
-}
-
-static bool sa_nearly_equal_matrix3(const Matrix3f& a, const Matrix3f& b, float eps = 1e-5f) {
-    return sa_nearly_equal_float(a.m00, b.m00, eps) && sa_nearly_equal_float(a.m01, b.m01, eps) && sa_nearly_equal_float(a.m02, b.m02, eps) &&
-           sa_nearly_equal_float(a.m10, b.m10, eps) && sa_nearly_equal_float(a.m11, b.m11, eps) && sa_nearly_equal_float(a.m12, b.m12, eps) &&
-           sa_nearly_equal_float(a.m20, b.m20, eps) && sa_nearly_equal_float(a.m21, b.m21, eps) && sa_nearly_equal_float(a.m22, b.m22, eps);
-}
-
-static bool sa_world_to_voxel_index(const Point3f& p, int resolution, const float world_bounds[3][2], int& x, int& y, int& z) {
-    float range_x = world_bounds[0][1] - world_bounds[0][0];
-    float range_y = world_bounds[1][1] - world_bounds[1][0];
-    float range_z = world_bounds[2][1] - world_bounds[2][0];
-    if (range_x <= 1e-8f || range_y <= 1e-8f || range_z <= 1e-8f)
-        return false;
-
-    x = (int)(((p.x - world_bounds[0][0]) / range_x) * resolution);
-    y = (int)(((p.y - world_bounds[1][0]) / range_y) * resolution);
-    z = (int)(((p.z - world_bounds[2][0]) / range_z) * resolution);
-
-    return x >= 0 && x < resolution && y >= 0 && y < resolution && z >= 0 && z < resolution;
-}
-
-static void sa_accumulate_feature_value_to_grids(int feature, VoxelGrid* seg_grid_ptr, VoxelGrid& acc_grid, int x, int y, int z, float v) {
-    if (feature == 0) {
-        if (seg_grid_ptr)
-            seg_grid_ptr->At(x, y, z) += v;
-        acc_grid.At(x, y, z) += v;
-    } else {
-        if (seg_grid_ptr) {
-            float& seg_v = seg_grid_ptr->At(x, y, z);
-            if (v > seg_v) seg_v = v;
-        }
-        float& acc_v = acc_grid.At(x, y, z);
-        if (v > acc_v) acc_v = v;
-    }
-}
-
-static Point3f sa_transform_world_by_root_delta(const Point3f& world_pos, const Point3f& from_root_pos,
-    const Matrix3f& from_root_ori, const Point3f& to_root_pos, const Matrix3f& to_root_ori) {
-    float dx = world_pos.x - from_root_pos.x;
-    float dy = world_pos.y - from_root_pos.y;
-    float dz = world_pos.z - from_root_pos.z;
-
-    // local = from_root_ori^T * (world - from_root_pos)
-    float lx = from_root_ori.m00 * dx + from_root_ori.m10 * dy + from_root_ori.m20 * dz;
-    float ly = from_root_ori.m01 * dx + from_root_ori.m11 * dy + from_root_ori.m21 * dz;
-    float lz = from_root_ori.m02 * dx + from_root_ori.m12 * dy + from_root_ori.m22 * dz;
-
-    // world' = to_root_ori * local + to_root_pos
-    float wx = to_root_ori.m00 * lx + to_root_ori.m01 * ly + to_root_ori.m02 * lz + to_root_pos.x;
-    float wy = to_root_ori.m10 * lx + to_root_ori.m11 * ly + to_root_ori.m12 * lz + to_root_pos.y;
-    float wz = to_root_ori.m20 * lx + to_root_ori.m21 * ly + to_root_ori.m22 * lz + to_root_pos.z;
-
-    return Point3f(wx, wy, wz);
-}
-
-// --- SpatialAnalyzer Implementation ---
-
-// コンストラクタ：初期値を設定し、グリッドを初期化
+// コンストラクタ：表示関連の初期値を設定（計算部は SpatialAnalysisCore で初期化）
 SpatialAnalyzer::SpatialAnalyzer() {
-    grid_resolution = 64; 
-    ResizeGrids(grid_resolution);
-    
     zoom = 1.0f;
     pan_center.set(0.0f, 0.0f);
     is_manual_view = false;
@@ -837,11 +151,6 @@ SpatialAnalyzer::SpatialAnalyzer() {
     show_voxels = false;
     feature_mode = 0;
     norm_mode = 0;
-    for (int i = 0; i < SA_FEATURE_COUNT; ++i) {
-        max_val[i] = 1.0f;
-        max_accumulated_val[i] = 1.0f;
-        accumulated_pose_cache[i].valid = false;
-    }
     
     // 部位別表示モード
     selected_segment_index = -1;
@@ -853,6 +162,9 @@ SpatialAnalyzer::SpatialAnalyzer() {
     cached_feature_mode = -1;
     cached_norm_mode = -1;
     cached_selected_segment_index = -2;
+
+    // 集団の統計モデル
+    show_group_zscore = false;
     
     // スライス平面の変換行列を単位行列で初期化
     slice_plane_transform.setIdentity();
@@ -866,8 +178,6 @@ SpatialAnalyzer::SpatialAnalyzer() {
     has_world_bounds_initialized = false;
     slice_display_base_range = 1.0f;
 
-    has_frame_cache = false;
-    sparse_threshold = 1e-4f;
     last_instant_motion1 = nullptr;
     last_instant_motion2 = nullptr;
     last_instant_time = 0.0f;
@@ -875,29 +185,30 @@ SpatialAnalyzer::SpatialAnalyzer() {
     last_accum_motion1 = nullptr;
     last_accum_motion2 = nullptr;
     has_latest_accum_context = false;
-    prev_presence_cache_entries[0] = PrevPresenceCacheEntry();
-    prev_presence_cache_entries[1] = PrevPresenceCacheEntry();
+    display_revision = 1;
+    published_serial = 0;
+    published_source = nullptr;
+    published_revision = 0;
+    published_feature_mode = -1;
+    published_norm_mode = -1;
+    render_snapshot = display_snapshots.Acquire();
 }
 
 // デストラクタ
 SpatialAnalyzer::~SpatialAnalyzer() {}
 
-// 全ボクセルグリッドを指定解像度でリサイズ
-void SpatialAnalyzer::ResizeGrids(int res) {
-    grid_resolution = res;
+// 計算結果の更新時に部位選択キャッシュを無効化
+void SpatialAnalyzer::OnAnalysisDataChanged() {
+    segment_cache_dirty = true;
+    ++display_revision;
+}
 
-    for (int i = 0; i < SA_FEATURE_COUNT; ++i) {
-        voxels1[i].Resize(res); voxels2[i].Resize(res); voxels_diff[i].Resize(res);
-        voxels1_accumulated[i].Resize(res); voxels2_accumulated[i].Resize(res); voxels_accumulated_diff[i].Resize(res);
-        accumulated_pose_cache[i].valid = false;
-    }
+// 全ボクセルグリッドを指定解像度でリサイズし、表示側の参照も破棄
+void SpatialAnalyzer::ResizeGrids(int res) {
+    SpatialAnalysisCore::ResizeGrids(res);
 
-    prev_presence_cache_entries[0].valid = false;
-    prev_presence_cache_entries[1].valid = false;
-    frame_cache1.Clear();
-    frame_cache2.Clear();
-    has_frame_cache = false;
     segment_cache_dirty = true;
+    ++display_revision;
     last_instant_motion1 = nullptr;
     last_instant_motion2 = nullptr;
     last_instant_time = 0.0f;
@@ -911,10 +222,7 @@ void SpatialAnalyzer::ResizeGrids(int res) {
 void SpatialAnalyzer::SetWorldBounds(float bounds[3][2]) {
     bool first_initialize = !has_world_bounds_initialized;
 
-    for (int i = 0; i < 3; ++i) {
-        world_bounds[i][0] = bounds[i][0];
-        world_bounds[i][1] = bounds[i][1];
-    }
+    SpatialAnalysisCore::SetWorldBounds(bounds);
 
     float world_range[3];
     for (int i = 0; i < 3; ++i)
@@ -940,136 +248,149 @@ void SpatialAnalyzer::SetWorldBounds(float bounds[3][2]) {
     }
 
     has_world_bounds_initialized = true;
-
-    for (int i = 0; i < SA_FEATURE_COUNT; ++i)
-        accumulated_pose_cache[i].valid = false;
-}
-
-// 指定時刻のモーションを占有率・速度・ジャーク・慣性モーメントのボクセルグリッドに変換
-void SpatialAnalyzer::VoxelizeMotion(Motion* m, float time, VoxelGrid& occ, VoxelGrid& spd, VoxelGrid& jrk, VoxelGrid& ine, VoxelGrid& pax) {
-    if (!m)
-        return;
-
-    int size = grid_resolution * grid_resolution * grid_resolution;
-    if ((int)occ.data.size() != size) occ.Resize(grid_resolution);
-    if ((int)spd.data.size() != size) spd.Resize(grid_resolution);
-    if ((int)jrk.data.size() != size) jrk.Resize(grid_resolution);
-    if ((int)ine.data.size() != size) ine.Resize(grid_resolution);
-    if ((int)pax.data.size() != size) pax.Resize(grid_resolution);
-
-    std::fill(occ.data.begin(), occ.data.end(), 0.0f);
-    std::fill(spd.data.begin(), spd.data.end(), 0.0f);
-    std::fill(jrk.data.begin(), jrk.data.end(), 0.0f);
-    std::fill(ine.data.begin(), ine.data.end(), 0.0f);
-    std::fill(pax.data.begin(), pax.data.end(), 0.0f);
-
-    std::vector<std::vector<SparseVoxel>> curr_sparse_presence;
-    BuildSegmentSparseVoxels(m, time, curr_sparse_presence);
-
-    for (size_t s = 0; s < curr_sparse_presence.size(); ++s) {
-        const std::vector<SparseVoxel>& sparse = curr_sparse_presence[s];
-        for (size_t k = 0; k < sparse.size(); ++k) {
-            int i = sparse[k].index;
-            occ.data[i] += sparse[k].values[0];
-            if (sparse[k].values[1] > spd.data[i]) spd.data[i] = sparse[k].values[1];
-            if (sparse[k].values[2] > jrk.data[i]) jrk.data[i] = sparse[k].values[2];
-            if (sparse[k].values[3] > ine.data[i]) ine.data[i] = sparse[k].values[3];
-            if (sparse[k].values[4] > pax.data[i]) pax.data[i] = sparse[k].values[4];
-        }
-    }
 }
 
 // 現在時刻の両モーションのボクセルを更新し、差分を計算
 void SpatialAnalyzer::UpdateVoxels(Motion* m1, Motion* m2, float current_time) {
+    ComputeDisplayUpdate(MakeDisplayRequest(m1, m2, current_time));
+}
+
+// 現在の表示の設定から表示の更新の設定を作成
+SpatialDisplayRequest SpatialAnalyzer::MakeDisplayRequest(Motion* m1, Motion* m2, float current_time) const {
+    SpatialDisplayRequest request;
+    request.motion1 = m1;
+    request.motion2 = m2;
+    request.time = current_time;
+    request.feature_mode = feature_mode;
+    request.norm_mode = norm_mode;
+    request.show_segment_mode = show_segment_mode;
+    request.selected_segment_index = selected_segment_index;
+    request.selected_segments = selected_segments;
+    request.playback_direction = playback_direction;
+    if (show_group_zscore)
+        request.group_model = group_model;
+    return request;
+}
+
+// 表示の更新の設定に従って両モーションのボクセルを更新し、差分を計算して公開
+void SpatialAnalyzer::ComputeDisplayUpdate(const SpatialDisplayRequest& request) {
+    TRACE_SCOPE_CAT("Analyzer::UpdateVoxels", "analysis");
+
+    Motion* m1 = request.motion1;
+    Motion* m2 = request.motion2;
     last_instant_motion1 = m1;
     last_instant_motion2 = m2;
-    last_instant_time = current_time;
+    last_instant_time = request.time;
     has_latest_instant_context = (m1 != nullptr && m2 != nullptr);
+    SetPlaybackDirection(request.playback_direction);
 
-    int selected_count = GetSelectedSegmentCount();
-    bool use_segment_mode = sa_should_use_segment_mode(show_segment_mode, selected_count, selected_segment_index);
-    int feature = sa_normalize_feature_index(feature_mode);
+    int selected_count = sa_count_selected_segments(request.selected_segments);
+    bool use_segment_mode = sa_should_use_segment_mode(request.show_segment_mode, selected_count, request.selected_segment_index);
+    int feature = sa_normalize_feature_index(request.feature_mode);
 
-    voxels1[feature].Clear();
-    voxels2[feature].Clear();
-    voxels_diff[feature].Clear();
-    max_val[feature] = 0.0f;
+    // 瞬間表示の全体のグリッドは毎回入れ替えて公開するため、表示の更新の番号は公開し直す必要のあるグリッドの更新時のみ増やす
+    ComputeInstantFeature(m1, m2, request.time, feature);
 
-    if (!ComposeInstantFeatureFromFrameCache(m1, m2, feature, current_time)) {
-        VoxelizeMotion(m1, current_time, voxels1[0], voxels1[1], voxels1[2], voxels1[3], voxels1[4]);
-        VoxelizeMotion(m2, current_time, voxels2[0], voxels2[1], voxels2[2], voxels2[3], voxels2[4]);
+    if (use_segment_mode && request.norm_mode == 0) {
+        ++display_revision;
+        segment_cache_dirty = false;
+        if (ComposeSelectedSegmentsInstant(m1, m2, feature, request.time,
+                                           request.selected_segments, request.selected_segment_index,
+                                           cached_segment_grid1, cached_segment_grid2,
+                                           cached_segment_diff, cached_segment_max_val)) {
+            cached_feature_mode = request.feature_mode;
+            cached_norm_mode = request.norm_mode;
+            cached_selected_segment_index = request.selected_segment_index;
+            cached_selected_segments = request.selected_segments;
+        } else {
+            segment_cache_dirty = true;
+        }
     }
 
-    if (use_segment_mode && norm_mode == 0) {
-        if (sa_compose_selected_segments_instant_from_frame_cache(
-            m1,
-            m2,
-            frame_cache1,
-            frame_cache2,
-            feature,
-            grid_resolution,
-            world_bounds,
-            sparse_threshold,
-            current_time,
-            selected_segments,
-            selected_segment_index,
-            cached_segment_grid1,
-            cached_segment_grid2,
-            cached_segment_diff,
-            cached_segment_max_val)) {
-            segment_cache_dirty = false;
-            cached_feature_mode = feature_mode;
-            cached_norm_mode = norm_mode;
-            cached_selected_segment_index = selected_segment_index;
-            cached_selected_segments = selected_segments;
+    // 累積表示時は、現在の特徴量をフレームキャッシュから再合成
+    if (request.compose_accumulated && request.norm_mode == 1 && m1 && m2) {
+        ComposeAccumulatedFeatureFromFrameCache(m1, m2, feature);
+        ++display_revision;
+    }
+
+    PublishDisplaySnapshot(request);
+}
+
+// 表示するグリッドを公開用のバッファに書き込んで公開
+void SpatialAnalyzer::PublishDisplaySnapshot(const SpatialDisplayRequest& request) {
+    TRACE_SCOPE_CAT("Analyzer::PublishDisplaySnapshot", "analysis");
+
+    VoxelGrid* grids[3] = { nullptr, nullptr, nullptr };
+    float max_value = 1.0f;
+    ResolveDisplayGridPointers(request, grids[0], grids[1], grids[2], max_value);
+
+    // 瞬間表示の全体のグリッドは毎回計算し直すため、公開用のバッファと入れ替えて公開（次回の計算では入れ替えたバッファに書き込む）
+    // 累積グリッド・部位選択キャッシュは計算結果を保持し続けるため、更新された場合のみ複製して公開
+    int feature = sa_normalize_feature_index(request.feature_mode);
+    bool instant = (grids[0] == &voxels1[feature]);
+
+    // 集団の統計モデルは累積表示の全体のグリッドのみと比較（特徴量・グリッドが異なるモデルは使わない）
+    const VoxelGroupModel* group = request.group_model.get();
+    if (group && (request.norm_mode != 1 || grids[0] != &voxels1_accumulated[feature] ||
+                  group->GetFeature() != feature || group->GetNumTakes() < 2 ||
+                  !group->IsCompatible(grids[0]->resolution, world_bounds)))
+        group = nullptr;
+
+    if (!instant && published_source == grids[0] && published_revision == display_revision &&
+        published_feature_mode == request.feature_mode && published_norm_mode == request.norm_mode &&
+        published_group_model.get() == group)
+        return;
+
+    SpatialDisplaySnapshot& snapshot = display_snapshots.BeginWrite();
+    for (int i = 0; i < 3; ++i) {
+        if (instant) {
+            std::swap(snapshot.grids[i], *grids[i]);
+            if (grids[i]->resolution != grid_resolution)
+                grids[i]->Resize(grid_resolution);
         } else {
-            segment_cache_dirty = true;
+            snapshot.grids[i] = *grids[i];
         }
     }
+    snapshot.max_value = max_value;
+    snapshot.diff_max_value = max_value;
+    snapshot.diff_is_zscore = false;
+    if (group) {
+        group->ComputeZScoreGrid(snapshot.grids[0], snapshot.grids[2], kGroupZScoreStdDevFloor, true);
+        snapshot.diff_max_value = kGroupZScoreDisplayMax;
+        snapshot.diff_is_zscore = true;
+    }
+    snapshot.feature_mode = request.feature_mode;
+    snapshot.norm_mode = request.norm_mode;
+    for (int i = 0; i < 3; ++i) {
+        snapshot.world_bounds[i][0] = world_bounds[i][0];
+        snapshot.world_bounds[i][1] = world_bounds[i][1];
+    }
+    for (int i = 0; i < 2; ++i) {
+        const LazyFrameCache& lazy = GetLazyFrameCache(i);
+        snapshot.lazy_cached_frames[i] = lazy.GetNumCachedFrames();
+        snapshot.lazy_memory_bytes[i] = lazy.GetMemoryUsage();
+    }
+    snapshot.range_index_bytes = GetFrameRangeIndexMemoryBytes(0) + GetFrameRangeIndexMemoryBytes(1);
+    snapshot.serial = ++published_serial;
+    display_snapshots.Publish();
 
-    // 差分計算と最大値更新（現在のfeature_modeのみ）
-    max_val[feature] = sa_fill_diff_grid_and_compute_max(voxels1[feature], voxels2[feature], voxels_diff[feature]);
+    published_source = instant ? nullptr : grids[0];
+    published_revision = display_revision;
+    published_feature_mode = request.feature_mode;
+    published_norm_mode = request.norm_mode;
+    published_group_model = group ? request.group_model : nullptr;
 }
 
-bool SpatialAnalyzer::ComposeInstantFeatureFromFrameCache(Motion* m1, Motion* m2, int feature, float current_time) {
-    if (!m1 || !m2 || !has_frame_cache)
-        return false;
-    if (frame_cache1.frames.empty() || frame_cache2.frames.empty())
-        return false;
-
-    int num_segments = m1->body ? m1->body->num_segments : 0;
-    if (num_segments <= 0)
-        return false;
-
-    int f1 = sa_get_frame_index_from_time(m1, current_time);
-    int f2 = sa_get_frame_index_from_time(m2, current_time);
-    if (f1 >= (int)frame_cache1.frames.size() || f2 >= (int)frame_cache2.frames.size())
-        return false;
-
-    VoxelGrid* out1 = nullptr;
-    VoxelGrid* out2 = nullptr;
-
-    if (feature < 0 || feature >= SA_FEATURE_COUNT)
-        return false;
-
-    out1 = &voxels1[feature];
-    out2 = &voxels2[feature];
-
-    int size = grid_resolution * grid_resolution * grid_resolution;
-    if ((int)out1->data.size() != size) out1->Resize(grid_resolution);
-    if ((int)out2->data.size() != size) out2->Resize(grid_resolution);
-
-    sa_compose_sparse_feature_frames_to_grids(
-        m1, frame_cache1, feature, grid_resolution, world_bounds, sparse_threshold,
-        f1, f1, nullptr, *out1);
-    sa_compose_sparse_feature_frames_to_grids(
-        m2, frame_cache2, feature, grid_resolution, world_bounds, sparse_threshold,
-        f2, f2, nullptr, *out2);
-    return true;
+// 最新の表示用の結果を取得
+std::shared_ptr<const SpatialDisplaySnapshot> SpatialAnalyzer::AcquireDisplaySnapshot() {
+    render_snapshot = display_snapshots.Acquire();
+    return render_snapshot;
 }
 
 // スライス平面を描画
 void SpatialAnalyzer::DrawSlicePlanes() {
+    TRACE_SCOPE_CAT("Analyzer::DrawSlicePlanes", "render");
+
     DrawRotatedSlicePlane();
 }
 
@@ -1093,27 +414,28 @@ void SpatialAnalyzer::Zoom(float factor) {
     is_manual_view = true; 
 }
 
-void SpatialAnalyzer::ResolveDisplayGridPointersForCurrentMode(VoxelGrid*& grid1,
-                                                              VoxelGrid*& grid2,
-                                                              VoxelGrid*& grid_diff,
-                                                              float& max_value) {
+void SpatialAnalyzer::ResolveDisplayGridPointers(const SpatialDisplayRequest& request,
+                                                 VoxelGrid*& grid1,
+                                                 VoxelGrid*& grid2,
+                                                 VoxelGrid*& grid_diff,
+                                                 float& max_value) {
     grid1 = nullptr;
     grid2 = nullptr;
     grid_diff = nullptr;
     max_value = 1.0f;
 
-    int selected_count = GetSelectedSegmentCount();
-    bool use_segment_mode = sa_should_use_segment_mode(show_segment_mode, selected_count, selected_segment_index);
+    int selected_count = sa_count_selected_segments(request.selected_segments);
+    bool use_segment_mode = sa_should_use_segment_mode(request.show_segment_mode, selected_count, request.selected_segment_index);
 
-    int feature = sa_normalize_feature_index(feature_mode);
+    int feature = sa_normalize_feature_index(request.feature_mode);
 
     if (use_segment_mode) {
-        UpdateSegmentCache();
+        UpdateSegmentCache(request);
         grid1 = &cached_segment_grid1;
         grid2 = &cached_segment_grid2;
         grid_diff = &cached_segment_diff;
         max_value = cached_segment_max_val;
-    } else if (norm_mode == 0) {
+    } else if (request.norm_mode == 0) {
         grid1 = &voxels1[feature];
         grid2 = &voxels2[feature];
         grid_diff = &voxels_diff[feature];
@@ -1126,40 +448,61 @@ void SpatialAnalyzer::ResolveDisplayGridPointersForCurrentMode(VoxelGrid*& grid1
     }
 }
 
-void SpatialAnalyzer::ResolveDiffGridPointerForCurrentMode(VoxelGrid*& grid_diff,
-                                                           float& max_value) {
-    VoxelGrid* grid1 = nullptr;
-    VoxelGrid* grid2 = nullptr;
-    ResolveDisplayGridPointersForCurrentMode(grid1, grid2, grid_diff, max_value);
-}
-
-void SpatialAnalyzer::ResolveDisplaySamplersForCurrentMode(std::function<float(const Point3f&)>& sampler1,
-                                                           std::function<float(const Point3f&)>& sampler2,
-                                                           std::function<float(const Point3f&)>& sampler_diff,
-                                                           float& max_value) {
-    VoxelGrid* grid1 = nullptr;
-    VoxelGrid* grid2 = nullptr;
-    VoxelGrid* grid_diff = nullptr;
-    ResolveDisplayGridPointersForCurrentMode(grid1, grid2, grid_diff, max_value);
-
-    const float (*wb)[2] = world_bounds;
-    int res = grid_resolution;
-
-    sampler1 = sa_make_voxel_world_sampler(grid1, wb, res);
-    sampler2 = sa_make_voxel_world_sampler(grid2, wb, res);
-    sampler_diff = sa_make_voxel_world_sampler(grid_diff, wb, res);
+void SpatialAnalyzer::ResolveDisplaySamplers(const SpatialDisplaySnapshot& snapshot,
+                                             std::function<float(const Point3f&)>& sampler1,
+                                             std::function<float(const Point3f&)>& sampler2,
+                                             std::function<float(const Point3f&)>& sampler_diff,
+                                             int level) {
+    const float (*wb)[2] = snapshot.world_bounds;
+    int res = snapshot.grids[0].resolution;
+
+    const VoxelGridPyramid* pyramid1 = (level > 0) ? GetDisplayPyramid(0, snapshot) : nullptr;
+    const VoxelGridPyramid* pyramid2 = (level > 0) ? GetDisplayPyramid(1, snapshot) : nullptr;
+    const VoxelGridPyramid* pyramid_diff = (level > 0) ? GetDisplayPyramid(2, snapshot) : nullptr;
+
+    sampler1 = sa_make_pyramid_world_sampler(&snapshot.grids[0], pyramid1, level, wb, res);
+    sampler2 = sa_make_pyramid_world_sampler(&snapshot.grids[1], pyramid2, level, wb, res);
+    sampler_diff = sa_make_pyramid_world_sampler(&snapshot.grids[2], pyramid_diff, level, wb, res);
+}
+
+// スナップショットのグリッドのピラミッドを取得（スナップショットが変わった場合は再構築）
+const VoxelGridPyramid* SpatialAnalyzer::GetDisplayPyramid(int slot, const SpatialDisplaySnapshot& snapshot) {
+    if (slot < 0 || slot >= 3)
+        return nullptr;
+    const VoxelGrid* grid = &snapshot.grids[slot];
+    if (grid->resolution <= 0)
+        return nullptr;
+
+    DisplayPyramid& display = display_pyramids[slot];
+    if (display.source != grid || display.serial != snapshot.serial) {
+        display.pyramid.Invalidate();
+        display.source = grid;
+        display.serial = snapshot.serial;
+    }
+    // z 値は占有率でも合計せず最大値で集約
+    if (slot == 2 && snapshot.diff_is_zscore)
+        display.pyramid.SetReduce(VOXEL_PYRAMID_MAX);
+    else
+        display.pyramid.SetReduce(GetVoxelPyramidReduce(sa_normalize_feature_index(snapshot.feature_mode)));
+    display.pyramid.Build(*grid);
+    return &display.pyramid;
 }
 
-void SpatialAnalyzer::ResolveDiffVoxelSamplerForCurrentMode(std::function<float(int, int, int)>& sampler,
-                                                            float& max_value) {
-    VoxelGrid* grid_diff = nullptr;
-    ResolveDiffGridPointerForCurrentMode(grid_diff, max_value);
-
-    sampler = sa_make_voxel_index_sampler(grid_diff);
+// 断面図の表示範囲の半分の大きさ
+float SpatialAnalyzer::GetSliceDisplayHalfSize() const {
+    float world_range[3];
+    for (int i = 0; i < 3; ++i)
+        world_range[i] = world_bounds[i][1] - world_bounds[i][0];
+    float max_range = slice_display_base_range;
+    if (max_range <= 1e-6f)
+        max_range = max(world_range[0], max(world_range[1], world_range[2]));
+    return max_range * 0.6f * zoom;
 }
 
 // 2Dヒートマップ（CT風断面図）を画面に描画
 void SpatialAnalyzer::DrawCTMaps(int win_width, int win_height) {
+    TRACE_SCOPE_CAT("Analyzer::DrawCTMaps", "render");
+
     if (!show_maps)
         return;
     
@@ -1180,16 +523,31 @@ void SpatialAnalyzer::DrawCTMaps(int win_width, int win_height) {
     int start_y = win_height - margin - (num_rows * map_h + (num_rows - 1) * gap);
     int y_pos = start_y;
     
+    // 計算側が公開した最新の結果（描画中は同じ結果を参照し続ける）
+    std::shared_ptr<const SpatialDisplaySnapshot> snapshot = AcquireDisplaySnapshot();
+    int snapshot_res = snapshot->grids[0].resolution;
+
+    // ズーム倍率に応じたピラミッドの段（断面図の1セルに含まれるボクセルを集約した段）
+    float voxel_size = 0.0f;
+    for (int i = 0; i < 3; ++i)
+        voxel_size = max(voxel_size, (snapshot->world_bounds[i][1] - snapshot->world_bounds[i][0]) / max(snapshot_res, 1));
+    float sample_size = 2.0f * GetSliceDisplayHalfSize() / kSliceMapDrawResolution;
+    int max_level = 0;
+    for (int r = snapshot_res; r > 1; r = (r + 1) / 2)
+        ++max_level;
+    int level = sa_select_pyramid_level(sample_size, voxel_size, max_level);
+
     // 描画するサンプラと最大値を決定
     std::function<float(const Point3f&)> sampler_m1;
     std::function<float(const Point3f&)> sampler_m2;
     std::function<float(const Point3f&)> sampler_diff;
-    float max_value = 1.0f;
-    ResolveDisplaySamplersForCurrentMode(sampler_m1, sampler_m2, sampler_diff, max_value);
+    float max_value = snapshot->max_value;
+    ResolveDisplaySamplers(*snapshot, sampler_m1, sampler_m2, sampler_diff, level);
 
     DrawRotatedSliceMapWithSampler(start_x, y_pos, map_w, map_h, max_value, "Rotated M1", sampler_m1);
     DrawRotatedSliceMapWithSampler(start_x + map_w + gap, y_pos, map_w, map_h, max_value, "Rotated M2", sampler_m2);
-    DrawRotatedSliceMapWithSampler(start_x + 2*(map_w + gap), y_pos, map_w, map_h, max_value, "Rotated Diff", sampler_diff);
+    DrawRotatedSliceMapWithSampler(start_x + 2*(map_w + gap), y_pos, map_w, map_h, snapshot->diff_max_value,
+                                   snapshot->diff_is_zscore ? "Rotated Z-score" : "Rotated Diff", sampler_diff);
     
     glPopAttrib();
     glMatrixMode(GL_PROJECTION); glPopMatrix();
@@ -1198,6 +556,8 @@ void SpatialAnalyzer::DrawCTMaps(int win_width, int win_height) {
 
 // 3D空間にボクセルを半透明キューブとして描画
 void SpatialAnalyzer::DrawVoxels3D() {
+    TRACE_SCOPE_CAT("Analyzer::DrawVoxels3D", "render");
+
     if (!show_voxels)
         return;
 
@@ -1205,475 +565,118 @@ void SpatialAnalyzer::DrawVoxels3D() {
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glEnable(GL_DEPTH_TEST);
 
+    // 計算側が公開した最新の結果（描画中は同じ結果を参照し続ける）
+    std::shared_ptr<const SpatialDisplaySnapshot> snapshot = AcquireDisplaySnapshot();
+    const float (*wb)[2] = snapshot->world_bounds;
+    const VoxelGrid* grid_diff = &snapshot->grids[2];
+    int res = grid_diff->resolution;
+
     float world_range[3];
     for (int i = 0; i < 3; ++i) 
-        world_range[i] = world_bounds[i][1] - world_bounds[i][0];
+        world_range[i] = wb[i][1] - wb[i][0];
     
-    float cell_size_x = world_range[0] / grid_resolution;
-    float cell_size_y = world_range[1] / grid_resolution;
-    float cell_size_z = world_range[2] / grid_resolution;
+    float cell_size_x = world_range[0] / max(res, 1);
+    float cell_size_y = world_range[1] / max(res, 1);
+    float cell_size_z = world_range[2] / max(res, 1);
     
-    int step = grid_resolution / 32;
-    if (step < 1) step = 1;
-    
-    // 描画するサンプラと最大値を決定
-    std::function<float(int, int, int)> diff_grid_sampler;
-    float draw_max_val = 1.0f;
-    ResolveDiffVoxelSamplerForCurrentMode(diff_grid_sampler, draw_max_val);
+    // 描画するグリッドと最大値を決定
+    float draw_max_val = snapshot->diff_max_value;
     if (draw_max_val < 1e-5f)
         draw_max_val = 1.0f;
-    
-    // ボクセルを描画
-    for (int z = 0; z < grid_resolution; z += step) {
-        for (int y = 0; y < grid_resolution; y += step) {
-            for (int x = 0; x < grid_resolution; x += step) {
-                float val = diff_grid_sampler(x, y, z);
-                if (val < 0.01f) 
-                    continue;
-                
-                float wx = world_bounds[0][0] + (x + 0.5f) * cell_size_x;
-                float wy = world_bounds[1][0] + (y + 0.5f) * cell_size_y;
-                float wz = world_bounds[2][0] + (z + 0.5f) * cell_size_z;
-                
-                float norm_val = min(val / draw_max_val, 1.0f);
-                Color3f color = sa_get_heatmap_color(norm_val);
-                
-                glColor4f(color.x, color.y, color.z, 0.3f + 0.5f * norm_val);
-                
-                glPushMatrix();
-                glTranslatef(wx, wy, wz);
-                glutSolidCube(cell_size_x * 0.8f * step);
-                glPopMatrix();
-            }
-        }
+    const VoxelGridPyramid* pyramid = GetDisplayPyramid(2, *snapshot);
+    if (!pyramid) {
+        glDisable(GL_BLEND);
+        return;
+    }
+
+    // カメラからワールド範囲の中心までの距離から、1つのボクセルの画面上の大きさを求め、段を選ぶ
+    GLfloat modelview[16], projection[16];
+    GLint viewport[4];
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+    glGetFloatv(GL_PROJECTION_MATRIX, projection);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    float cx = (wb[0][0] + wb[0][1]) * 0.5f;
+    float cy = (wb[1][0] + wb[1][1]) * 0.5f;
+    float cz = (wb[2][0] + wb[2][1]) * 0.5f;
+    float eye_depth = -(modelview[2] * cx + modelview[6] * cy + modelview[10] * cz + modelview[14]);
+    float pixels_per_unit = projection[5] * viewport[3] * 0.5f / max(eye_depth, 1e-3f);
+    float min_size = kVoxel3DMinPixels / max(pixels_per_unit, 1e-6f);
+
+    int level = sa_select_pyramid_level(min_size, cell_size_x, pyramid->GetTopLevel());
+    while (level < pyramid->GetTopLevel() && pyramid->GetLevelResolution(level) > kVoxel3DMaxDrawResolution)
+        ++level;
+    int level_res = pyramid->GetLevelResolution(level);
+    int span = 1 << level;
+    float scale = pyramid->GetLevelScale(level);
+
+    // 表示する値以上の格子のみを上位の段から絞り込んで描画
+    std::vector<int> cells;
+    pyramid->CollectCellsAbove(*grid_diff, level, 0.01f / scale, cells);
+    for (size_t i = 0; i < cells.size(); ++i) {
+        int x = cells[i] % level_res;
+        int y = (cells[i] / level_res) % level_res;
+        int z = cells[i] / (level_res * level_res);
+        float val = pyramid->GetLevelValue(*grid_diff, level, x, y, z) * scale;
+
+        // 格子に含まれる段 0 のボクセルの範囲の中心（端の格子はグリッドの範囲までに切り詰める）
+        float bx = (x * span + min((x + 1) * span, res)) * 0.5f;
+        float by = (y * span + min((y + 1) * span, res)) * 0.5f;
+        float bz = (z * span + min((z + 1) * span, res)) * 0.5f;
+        float wx = wb[0][0] + bx * cell_size_x;
+        float wy = wb[1][0] + by * cell_size_y;
+        float wz = wb[2][0] + bz * cell_size_z;
+
+        float norm_val = min(val / draw_max_val, 1.0f);
+        Color3f color = sa_get_heatmap_color(norm_val);
+
+        glColor4f(color.x, color.y, color.z, 0.3f + 0.5f * norm_val);
+
+        glPushMatrix();
+        glTranslatef(wx, wy, wz);
+        glutSolidCube(cell_size_x * 0.8f * span);
+        glPopMatrix();
     }
     
     glDisable(GL_BLEND);
 }
 
-// モーション全体を通して累積ボクセルを計算（占有率・速度・ジャーク + 部位ごと）
+// モーション全体を通して累積ボクセルを計算し、部位選択状態を初期化
 void SpatialAnalyzer::AccumulateAllFrames(Motion* m1, Motion* m2)
 {
     last_accum_motion1 = m1;
     last_accum_motion2 = m2;
     has_latest_accum_context = (m1 != nullptr && m2 != nullptr);
 
-    if (!m1 || !m2)
-        return;
-
-    ClearAccumulatedData();
-
-    BuildAllFeatureFrameCaches(m1, m2);
-    if (!has_frame_cache) {
-        std::cout << "Frame sparse cache is unavailable. Accumulation skipped." << std::endl;
-        return;
-    }
-
-    int num_segments = (m1->body) ? m1->body->num_segments : 0;
-    if (num_segments > 0)
-        InitializeSegmentSelection(num_segments);
+    SpatialAnalysisCore::AccumulateAllFrames(m1, m2);
 
-    for (int feat = 0; feat < SA_FEATURE_COUNT; ++feat)
-        ComposeAccumulatedFeatureFromFrameCache(m1, m2, feat);
+    int num_segments = (m1 && m1->body) ? m1->body->num_segments : 0;
+    if (has_frame_cache && num_segments > 0)
+        selected_segments.assign(num_segments, false);
 
     segment_cache_dirty = true;
-
-    std::cout << "Integrated accumulation complete (from frame sparse cache)." << std::endl;
-    std::cout << "  Max presence diff: " << max_accumulated_val[0] << std::endl;
-    std::cout << "  Max speed: " << max_accumulated_val[1] << std::endl;
-    std::cout << "  Max jerk: " << max_accumulated_val[2] << std::endl;
-    std::cout << "  Max inertia: " << max_accumulated_val[3] << std::endl;
-    std::cout << "  Max principal-axis speed: " << max_accumulated_val[4] << std::endl;
 }
 
-// 累積ボクセルグリッドをクリアし、最大値をリセット
-void SpatialAnalyzer::ClearAccumulatedData()
+// ワーカースレッドで計算した結果を取り込み、表示側の参照を更新
+void SpatialAnalyzer::AdoptAnalysisResults(SpatialAnalysisCore& results, Motion* m1, Motion* m2)
 {
-    for (int i = 0; i < SA_FEATURE_COUNT; ++i) {
-        voxels1_accumulated[i].Clear();
-        voxels2_accumulated[i].Clear();
-        voxels_accumulated_diff[i].Clear();
-        max_accumulated_val[i] = 0.0f;
-    }
-}
-
-void SpatialAnalyzer::BuildSingleMotionFeatureFrameCache(Motion* m, MotionFrameSegmentVoxelGridCache& cache) {
-    cache.Clear();
-    if (!m || !m->body || m->num_frames <= 0)
-        return;
-
-    int num_segments = m->body->num_segments;
-    cache.Resize(m->num_frames, num_segments, grid_resolution);
-
-    for (int f = 0; f < m->num_frames; ++f) {
-        float time = f * m->interval;
-
-        std::vector<std::vector<SparseVoxel>> curr_sparse_values;
-        BuildSegmentSparseBaseValues(m, time, curr_sparse_values);
-
-        FrameSegmentVoxelGrid& frame_sparse = cache.frames[f];
-        frame_sparse.Clear();
-        for (int s = 0; s < num_segments; ++s) {
-            frame_sparse.segment_grids[s].SetReference(m->frames[f].root_pos, m->frames[f].root_ori);
-            frame_sparse.segment_grids[s].voxels.swap(curr_sparse_values[s]);
-        }
-
-        if (f > 0) {
-            const float weight_threshold = sparse_threshold;
-            int seg_count = sa_min_segment_count(frame_sparse.segment_grids.size(), cache.frames[f - 1].segment_grids.size());
-            for (int s = 0; s < seg_count; ++s) {
-                sa_apply_principal_axis_speed_to_sparse_segment(
-                    frame_sparse.segment_grids[s].voxels,
-                    cache.frames[f - 1].segment_grids[s].voxels,
-                    grid_resolution,
-                    m->interval,
-                    world_bounds,
-                    weight_threshold);
-            }
-        }
-
-    }
-}
-
-void SpatialAnalyzer::BuildAllFeatureFrameCaches(Motion* m1, Motion* m2) {
-    has_frame_cache = false;
-    segment_cache_dirty = true;
-    frame_cache1.Clear();
-    frame_cache2.Clear();
-    for (int f = 0; f < SA_FEATURE_COUNT; ++f)
-        accumulated_pose_cache[f].valid = false;
-
-    if (!m1 || !m2)
-        return;
-
-    BuildSingleMotionFeatureFrameCache(m1, frame_cache1);
-    BuildSingleMotionFeatureFrameCache(m2, frame_cache2);
-    has_frame_cache = !frame_cache1.frames.empty() && !frame_cache2.frames.empty();
-}
-
-void SpatialAnalyzer::ComposeAccumulatedFeatureFromFrameCache(Motion* m1, Motion* m2, int feature) {
-    MotionFrameSegmentVoxelGridCache* c1 = nullptr;
-    MotionFrameSegmentVoxelGridCache* c2 = nullptr;
-    bool has_cache = false;
-    AccumulatedPoseCache* pose_cache = nullptr;
-    VoxelGrid* acc1 = nullptr;
-    VoxelGrid* acc2 = nullptr;
-    VoxelGrid* diff = nullptr;
-    float* max_val = nullptr;
-    std::vector<float>* seg_max = nullptr;
-
-    c1 = &frame_cache1;
-    c2 = &frame_cache2;
-    has_cache = has_frame_cache;
-
-    if (feature < 0 || feature >= SA_FEATURE_COUNT)
-        return;
-
-    pose_cache = &accumulated_pose_cache[feature];
-    acc1 = &voxels1_accumulated[feature];
-    acc2 = &voxels2_accumulated[feature];
-    diff = &voxels_accumulated_diff[feature];
-    max_val = &max_accumulated_val[feature];
-    seg_max = &segment_max[feature];
-
-    if (!m1 || !m2 || !has_cache || m1->num_frames <= 0 || m2->num_frames <= 0)
-        return;
-
-    const Point3f& curr_m1_root_pos = m1->frames[0].root_pos;
-    const Matrix3f& curr_m1_root_ori = m1->frames[0].root_ori;
-    const Point3f& curr_m2_root_pos = m2->frames[0].root_pos;
-    const Matrix3f& curr_m2_root_ori = m2->frames[0].root_ori;
-
-    if (pose_cache->valid &&
-        sa_nearly_equal_point3(pose_cache->motion1_root_pos, curr_m1_root_pos) &&
-        sa_nearly_equal_matrix3(pose_cache->motion1_root_ori, curr_m1_root_ori) &&
-        sa_nearly_equal_point3(pose_cache->motion2_root_pos, curr_m2_root_pos) &&
-        sa_nearly_equal_matrix3(pose_cache->motion2_root_ori, curr_m2_root_ori)) {
-        return;
-    }
-
-    int num_segments = m1->body->num_segments;
-
-    acc1->Resize(grid_resolution); acc2->Resize(grid_resolution); diff->Resize(grid_resolution);
-    acc1->Clear(); acc2->Clear(); diff->Clear();
-
-    sa_compose_sparse_feature_frames_to_grids(
-        m1, *c1, feature, grid_resolution, world_bounds, sparse_threshold,
-        0, m1->num_frames - 1, nullptr, *acc1);
-    sa_compose_sparse_feature_frames_to_grids(
-        m2, *c2, feature, grid_resolution, world_bounds, sparse_threshold,
-        0, m2->num_frames - 1, nullptr, *acc2);
-
-    *max_val = sa_fill_diff_grid_and_compute_max(*acc1, *acc2, *diff);
-
-    if (seg_max->size() != (size_t)num_segments)
-        InitializeSegmentSelection(num_segments);
-
-    std::vector<int> active_single_segment(1, 0);
-    VoxelGrid seg1_grid;
-    VoxelGrid seg2_grid;
-    seg1_grid.Resize(grid_resolution);
-    seg2_grid.Resize(grid_resolution);
-
-    for (int s = 0; s < num_segments; ++s) {
-        active_single_segment[0] = s;
-        seg1_grid.Clear();
-        seg2_grid.Clear();
-
-        sa_compose_selected_segments_feature_frames_to_grid(
-            m1,
-            *c1,
-            feature,
-            grid_resolution,
-            world_bounds,
-            sparse_threshold,
-            0,
-            m1->num_frames - 1,
-            active_single_segment,
-            seg1_grid);
-
-        sa_compose_selected_segments_feature_frames_to_grid(
-            m2,
-            *c2,
-            feature,
-            grid_resolution,
-            world_bounds,
-            sparse_threshold,
-            0,
-            m2->num_frames - 1,
-            active_single_segment,
-            seg2_grid);
-
-        (*seg_max)[s] = sa_compute_max_abs_diff_between_grids(seg1_grid, seg2_grid);
-    }
-
-    segment_cache_dirty = true;
-    pose_cache->motion1_root_pos = curr_m1_root_pos;
-    pose_cache->motion1_root_ori = curr_m1_root_ori;
-    pose_cache->motion2_root_pos = curr_m2_root_pos;
-    pose_cache->motion2_root_ori = curr_m2_root_ori;
-    pose_cache->valid = true;
-}
-
-void SpatialAnalyzer::BuildSegmentSparseBaseValues(Motion* m, float time, std::vector<std::vector<SparseVoxel>>& seg_sparse_values) {
-    if (!m || !m->body)
-        return;
-
-    int num_segments = m->body->num_segments;
-    int size = grid_resolution * grid_resolution * grid_resolution;
-    seg_sparse_values.assign(num_segments, std::vector<SparseVoxel>());
-    std::vector<std::vector<int>> index_to_pos(num_segments, std::vector<int>(size, -1));
-
-    FrameData frame_data;
-    ComputeFrameData(m, time, frame_data);
-
-    vector<BoneData> bones;
-    ExtractBoneData(m, frame_data, bones);
-
-    float bone_radius = 0.08f;
-    float world_range[3];
-    for (int i = 0; i < 3; ++i)
-        world_range[i] = world_bounds[i][1] - world_bounds[i][0];
-
-    for (const BoneData& bone : bones) {
-        if (!bone.valid)
-            continue;
-        if (bone.segment_index < 0 || bone.segment_index >= num_segments)
-            continue;
-        WriteToVoxelGrid(bone,
-            bone_radius,
-            world_range,
-            &seg_sparse_values[bone.segment_index],
-            &index_to_pos[bone.segment_index]);
-    }
-
-    for (int s = 0; s < num_segments; ++s) {
-        std::vector<SparseVoxel>& sparse = seg_sparse_values[s];
-        size_t write_pos = 0;
-        for (size_t k = 0; k < sparse.size(); ++k) {
-            sparse[k].values[4] = 0.0f;
-            float v0 = sparse[k].values[0];
-            float v1 = sparse[k].values[1];
-            float v2 = sparse[k].values[2];
-            float v3 = sparse[k].values[3];
-            if (v0 > sparse_threshold || v1 > sparse_threshold || v2 > sparse_threshold || v3 > sparse_threshold)
-                sparse[write_pos++] = sparse[k];
-        }
-        sparse.resize(write_pos);
-    }
+    // 表示側のスライス平面の初期化などのため、先にワールド境界を設定
+    SetWorldBounds(results.world_bounds);
+    SwapAnalysisResults(results);
+    AdoptAnalysisMotions(m1, m2);
 }
 
-void SpatialAnalyzer::VoxelizeMotionBySegmentGrids(Motion* m, float time,
-                                                   std::vector<VoxelGrid>& seg_presence_grids,
-                                                   std::vector<VoxelGrid>& seg_speed_grids,
-                                                   std::vector<VoxelGrid>& seg_jerk_grids,
-                                                   std::vector<VoxelGrid>& seg_inertia_grids,
-                                                   std::vector<VoxelGrid>& seg_principal_axis_grids) {
-    if (!m) 
-        return;
-
-    int num_segments = m->body->num_segments;
-    auto prepare = [&](std::vector<VoxelGrid>& grids) {
-        if ((int)grids.size() != num_segments)
-            grids.resize(num_segments);
-        for (int s = 0; s < num_segments; ++s) {
-            if (grids[s].resolution != grid_resolution || (int)grids[s].data.size() != grid_resolution * grid_resolution * grid_resolution)
-                grids[s].Resize(grid_resolution);
-            else
-                grids[s].Clear();
-        }
-    };
-
-    prepare(seg_presence_grids);
-    prepare(seg_speed_grids);
-    prepare(seg_jerk_grids);
-    prepare(seg_inertia_grids);
-    prepare(seg_principal_axis_grids);
-
-    std::vector<std::vector<SparseVoxel>> curr_sparse_presence;
-    BuildSegmentSparseVoxels(m, time, curr_sparse_presence);
-
-    for (int s = 0; s < num_segments; ++s) {
-        VoxelGrid& seg_pres_grid = seg_presence_grids[s];
-        VoxelGrid& seg_spd_grid = seg_speed_grids[s];
-        VoxelGrid& seg_jrk_grid = seg_jerk_grids[s];
-        VoxelGrid& seg_pax_grid = seg_principal_axis_grids[s];
-        VoxelGrid& seg_ine_grid = seg_inertia_grids[s];
-        const std::vector<SparseVoxel>& sparse = curr_sparse_presence[s];
-        for (size_t k = 0; k < sparse.size(); ++k) {
-            int i = sparse[k].index;
-            seg_pres_grid.data[i] = sparse[k].values[0];
-            seg_spd_grid.data[i] = sparse[k].values[1];
-            seg_jrk_grid.data[i] = sparse[k].values[2];
-            seg_ine_grid.data[i] = sparse[k].values[3];
-            if (sparse[k].values[4] > seg_pax_grid.data[i])
-                seg_pax_grid.data[i] = sparse[k].values[4];
-        }
-    }
-}
-
-void SpatialAnalyzer::BuildSegmentSparseVoxels(Motion* m, float time, std::vector<std::vector<SparseVoxel>>& seg_sparse_values) {
-    seg_sparse_values.clear();
-    if (!m || !m->body)
-        return;
-
-    int num_segments = m->body->num_segments;
-    BuildSegmentSparseBaseValues(m, time, seg_sparse_values);
-
-    float prev_time = time - m->interval;
-    if (prev_time < 0.0f)
-        prev_time = 0.0f;
-
-    const std::vector<std::vector<SparseVoxel>>* prev_sparse_ptr = nullptr;
-    std::vector<std::vector<SparseVoxel>> prev_sparse_presence;
-
-    PrevPresenceCacheEntry* entry_for_motion = nullptr;
-    PrevPresenceCacheEntry* first_free_entry = nullptr;
-    for (int ci = 0; ci < 2; ++ci) {
-        PrevPresenceCacheEntry& e = prev_presence_cache_entries[ci];
-        if (e.valid && e.motion == m) {
-            entry_for_motion = &e;
-            break;
-        }
-        if (!e.valid && !first_free_entry)
-            first_free_entry = &e;
-    }
-
-    bool can_reuse_prev = false;
-    if (entry_for_motion && entry_for_motion->valid) {
-        float dt_err = fabsf((time - entry_for_motion->time) - m->interval);
-        can_reuse_prev = dt_err <= 1e-4f &&
-                         (int)entry_for_motion->seg_presence_sparse.size() == num_segments;
-    }
-
-    if (can_reuse_prev) {
-        prev_sparse_ptr = &entry_for_motion->seg_presence_sparse;
-    } else {
-        BuildSegmentSparseBaseValues(m, prev_time, prev_sparse_presence);
-        prev_sparse_ptr = &prev_sparse_presence;
-    }
-
-    const float weight_threshold = sparse_threshold;
-    sa_apply_principal_axis_speed_to_sparse_segments(
-        seg_sparse_values,
-        *prev_sparse_ptr,
-        grid_resolution,
-        m->interval,
-        world_bounds,
-        weight_threshold);
-
-    if (!entry_for_motion)
-        entry_for_motion = first_free_entry;
-    if (!entry_for_motion)
-        entry_for_motion = &prev_presence_cache_entries[0];
-
-    entry_for_motion->seg_presence_sparse = seg_sparse_values;
-    entry_for_motion->motion = m;
-    entry_for_motion->time = time;
-    entry_for_motion->valid = true;
-}
-
-// モーション名からキャッシュファイルのベース名を生成
-std::string SpatialAnalyzer::GenerateCacheFilename(const char* motion1_name, const char* motion2_name) const {
-    std::string filename = "voxel_cache_";
-    filename += motion1_name;
-    filename += "_";
-    filename += motion2_name;
-    filename += ".vxl";
-    return filename;
-}
-
-// 累積ボクセルデータをファイルに保存してキャッシュ
-bool SpatialAnalyzer::SaveVoxelCache(const char* motion1_name, const char* motion2_name) {
-    std::string base = GenerateCacheFilename(motion1_name, motion2_name);
-    
-    std::cout << "Saving voxel cache to " << base << "..." << std::endl;
+// 現在の解析結果に対応する動作を設定し、部位選択状態を初期化
+void SpatialAnalyzer::AdoptAnalysisMotions(Motion* m1, Motion* m2)
+{
+    last_accum_motion1 = m1;
+    last_accum_motion2 = m2;
+    has_latest_accum_context = (m1 != nullptr && m2 != nullptr);
 
-    if (!sa_save_accumulated_feature_grids(base, voxels1_accumulated, voxels2_accumulated, voxels_accumulated_diff)) {
-        std::cout << "Failed to save accumulated voxel cache files for base: " << base << std::endl;
-        return false;
-    }
-    
-    const std::string meta_file = base + "_meta.txt";
-    if (!sa_save_cache_meta_file(meta_file, grid_resolution, max_accumulated_val, world_bounds)) {
-        std::cout << "Failed to save cache metadata: " << meta_file << std::endl;
-        return false;
-    }
-    
-    std::cout << "Voxel cache saved successfully!" << std::endl;
-    return true;
-}
+    int num_segments = (m1 && m1->body) ? m1->body->num_segments : 0;
+    if (has_frame_cache && num_segments > 0 && (int)selected_segments.size() != num_segments)
+        selected_segments.assign(num_segments, false);
 
-// ファイルからボクセルキャッシュを読み込み
-bool SpatialAnalyzer::LoadVoxelCache(const char* motion1_name, const char* motion2_name) {
-    std::string base = GenerateCacheFilename(motion1_name, motion2_name);
-    const std::string meta_file = base + "_meta.txt";
-    
-    std::cout << "Loading voxel cache from " << base << "..." << std::endl;
-    
-    int res;
-    int legacy_segment_dense_flag;
-    std::string meta_error;
-    if (!sa_load_cache_meta_file(meta_file, res, max_accumulated_val, world_bounds, legacy_segment_dense_flag, meta_error)) {
-        std::cout << meta_error << std::endl;
-        return false;
-    }
-    
-    ResizeGrids(res);
     segment_cache_dirty = true;
-    
-    if (!sa_load_accumulated_feature_grids(base, voxels1_accumulated, voxels2_accumulated, voxels_accumulated_diff)) {
-        std::cout << "Failed to load accumulated voxel cache files for base: " << base << std::endl;
-        return false;
-    }
-
-    if (legacy_segment_dense_flag == 1)
-        std::cout << "Legacy metadata flag detected and ignored (sparse-only runtime path)." << std::endl;
-
-    sa_recompute_feature_max_values_from_diff_grids(voxels_accumulated_diff, max_accumulated_val);
-    
-    std::cout << "Voxel cache loaded successfully!" << std::endl;
-    return true;
 }
 
 // スライス平面を角度指定で回転（キーボード入力用）
@@ -1741,13 +744,7 @@ void SpatialAnalyzer::DrawRotatedSlicePlane() {
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glDisable(GL_CULL_FACE);  // 両面描画を有効化
     
-    float world_range[3];
-    for (int i = 0; i < 3; ++i)
-        world_range[i] = world_bounds[i][1] - world_bounds[i][0];
-    float max_range = slice_display_base_range;
-    if (max_range <= 1e-6f)
-        max_range = max(world_range[0], max(world_range[1], world_range[2]));
-    float half_size = max_range * 0.6f * zoom;
+    float half_size = GetSliceDisplayHalfSize();
 
     Point3f center = GetSlicePlaneCenter();
     Vector3f slice_u = GetSlicePlaneU();
@@ -1820,13 +817,7 @@ void SpatialAnalyzer::DrawRotatedSliceMapWithSampler(int x_pos, int y_pos, int w
     glVertex2i(x_pos + w, y_pos);
     glEnd();
     
-    float world_range[3];
-    for (int i = 0; i < 3; ++i)
-        world_range[i] = world_bounds[i][1] - world_bounds[i][0];
-    float max_range = slice_display_base_range;
-    if (max_range <= 1e-6f)
-        max_range = max(world_range[0], max(world_range[1], world_range[2]));
-    float half_size = max_range * 0.6f * zoom;
+    float half_size = GetSliceDisplayHalfSize();
 
     Point3f center = GetSlicePlaneCenter();
     Vector3f slice_u = GetSlicePlaneU();
@@ -1836,7 +827,7 @@ void SpatialAnalyzer::DrawRotatedSliceMapWithSampler(int x_pos, int y_pos, int w
     center.y += slice_u.y * pan_center.x + slice_v.y * pan_center.y;
     center.z += slice_u.z * pan_center.x + slice_v.z * pan_center.y;
     
-    int draw_res = 64;
+    int draw_res = kSliceMapDrawResolution;
     float cell_w = (float)w / draw_res;
     float cell_h = (float)h / draw_res;
     
@@ -1986,228 +977,12 @@ void SpatialAnalyzer::UpdateEulerAnglesFromTransform() {
     slice_rotation[2] = atan2f(u.y, v.y) * 180.0f / 3.14159265f;
 }
 
-// === 共通ボクセル化ヘルパー関数 ===
-
-// 指定時刻と前3フレーム分の姿勢データを計算（速度・ジャーク計算用）
-void SpatialAnalyzer::ComputeFrameData(Motion* m, float time, FrameData& frame_data) {
-    if (!m) 
-        return;
-    
-    Posture curr_pose(m->body);
-    Posture prev_pose(m->body);
-    Posture prev2_pose(m->body);
-    Posture prev3_pose(m->body);
-    
-    frame_data.dt = m->interval;
-    float prev_time = time - frame_data.dt;
-    float prev2_time = time - 2.0f * frame_data.dt;
-    float prev3_time = time - 3.0f * frame_data.dt;
-    if (prev_time < 0) prev_time = 0;
-    if (prev2_time < 0) prev2_time = 0;
-    if (prev3_time < 0) prev3_time = 0;
-
-    m->GetPosture(time, curr_pose);
-    m->GetPosture(prev_time, prev_pose);
-    m->GetPosture(prev2_time, prev2_pose);
-    m->GetPosture(prev3_time, prev3_pose);
-
-    curr_pose.ForwardKinematics(frame_data.curr_frames, frame_data.curr_joint_pos);
-    prev_pose.ForwardKinematics(frame_data.prev_frames, frame_data.prev_joint_pos);
-    prev2_pose.ForwardKinematics(frame_data.prev2_frames, frame_data.prev2_joint_pos);
-    prev3_pose.ForwardKinematics(frame_data.prev3_frames, frame_data.prev3_joint_pos);
-
-    frame_data.curr_root_pos.set(curr_pose.root_pos);
-    frame_data.prev_root_pos.set(prev_pose.root_pos);
-}
-
-// フレームデータから全ボーンの位置・速度・ジャークを抽出
-void SpatialAnalyzer::ExtractBoneData(Motion* m, const FrameData& frame_data, vector<BoneData>& bones) {
-    bones.clear();
-    bones.reserve(m->body->num_segments);
-    
-    for (int s = 0; s < m->body->num_segments; ++s) {
-        const Segment* seg = m->body->segments[s];
-        BoneData bone;
-        bone.segment_index = s;
-        bone.valid = false;
-        
-        // 指をスキップ
-        if (IsFingerSegment(seg)) {
-            bones.push_back(bone);
-            continue;
-        }
-
-        if (seg->num_joints == 1) {
-            bone.p1 = Point3f(frame_data.curr_frames[s].m03, frame_data.curr_frames[s].m13, frame_data.curr_frames[s].m23);
-            bone.p1_prev = Point3f(frame_data.prev_frames[s].m03, frame_data.prev_frames[s].m13, frame_data.prev_frames[s].m23);
-            bone.p1_prev2 = Point3f(frame_data.prev2_frames[s].m03, frame_data.prev2_frames[s].m13, frame_data.prev2_frames[s].m23);
-            bone.p1_prev3 = Point3f(frame_data.prev3_frames[s].m03, frame_data.prev3_frames[s].m13, frame_data.prev3_frames[s].m23);
-            
-            if (seg->has_site) {
-                // site_positionをワールド座標に変換
-                Matrix3f R_curr(frame_data.curr_frames[s].m00, frame_data.curr_frames[s].m01, frame_data.curr_frames[s].m02, 
-                                frame_data.curr_frames[s].m10, frame_data.curr_frames[s].m11, frame_data.curr_frames[s].m12, 
-                                frame_data.curr_frames[s].m20, frame_data.curr_frames[s].m21, frame_data.curr_frames[s].m22);
-                Point3f offset = seg->site_position;
-                R_curr.transform(&offset);
-                bone.p2 = bone.p1 + offset;
-
-                Matrix3f R_prev(frame_data.prev_frames[s].m00, frame_data.prev_frames[s].m01, frame_data.prev_frames[s].m02, 
-                                frame_data.prev_frames[s].m10, frame_data.prev_frames[s].m11, frame_data.prev_frames[s].m12, 
-                                frame_data.prev_frames[s].m20, frame_data.prev_frames[s].m21, frame_data.prev_frames[s].m22);
-                Point3f offset_prev = seg->site_position;
-                R_prev.transform(&offset_prev);
-                bone.p2_prev = bone.p1_prev + offset_prev;
-
-                Matrix3f R_prev2(frame_data.prev2_frames[s].m00, frame_data.prev2_frames[s].m01, frame_data.prev2_frames[s].m02, 
-                                 frame_data.prev2_frames[s].m10, frame_data.prev2_frames[s].m11, frame_data.prev2_frames[s].m12, 
-                                 frame_data.prev2_frames[s].m20, frame_data.prev2_frames[s].m21, frame_data.prev2_frames[s].m22);
-                Point3f offset_prev2 = seg->site_position;
-                R_prev2.transform(&offset_prev2);
-                bone.p2_prev2 = bone.p1_prev2 + offset_prev2;
-
-                Matrix3f R_prev3(frame_data.prev3_frames[s].m00, frame_data.prev3_frames[s].m01, frame_data.prev3_frames[s].m02, 
-                                 frame_data.prev3_frames[s].m10, frame_data.prev3_frames[s].m11, frame_data.prev3_frames[s].m12,
-                                 frame_data.prev3_frames[s].m20, frame_data.prev3_frames[s].m21, frame_data.prev3_frames[s].m22);
-                Point3f offset_prev3 = seg->site_position;
-                R_prev3.transform(&offset_prev3);
-                bone.p2_prev3 = bone.p1_prev3 + offset_prev3;
-
-                bone.valid = true;
-            }
-        } else if (seg->num_joints >= 2) {
-            Joint* root_joint = seg->joints[0];
-            Joint* end_joint = seg->joints[1];
-            
-            bone.p1 = frame_data.curr_joint_pos[root_joint->index];
-            bone.p2 = frame_data.curr_joint_pos[end_joint->index];
-            bone.p1_prev = frame_data.prev_joint_pos[root_joint->index];
-            bone.p2_prev = frame_data.prev_joint_pos[end_joint->index];
-            bone.p1_prev2 = frame_data.prev2_joint_pos[root_joint->index];
-            bone.p2_prev2 = frame_data.prev2_joint_pos[end_joint->index];
-            bone.p1_prev3 = frame_data.prev3_joint_pos[root_joint->index];
-            bone.p2_prev3 = frame_data.prev3_joint_pos[end_joint->index];
-
-            bone.valid = true;
-        }
-        
-        // 速度とジャークと慣性モーメントを計算
-        if (bone.valid) {
-            Vector3f spd1_curr = bone.p1 - bone.p1_prev;
-            Vector3f spd2_curr = bone.p2 - bone.p2_prev;
-            bone.speed1 = spd1_curr.length() / frame_data.dt;
-            bone.speed2 = spd2_curr.length() / frame_data.dt;
-
-            Vector3f spd1_prev = bone.p1_prev - bone.p1_prev2;
-            Vector3f spd2_prev = bone.p2_prev - bone.p2_prev2;
-            Vector3f spd1_prev2 = bone.p1_prev2 - bone.p1_prev3;
-            Vector3f spd2_prev2 = bone.p2_prev2 - bone.p2_prev3;
-
-            Vector3f accel1_curr = spd1_curr - spd1_prev;
-            Vector3f accel2_curr = spd2_curr - spd2_prev;
-            Vector3f accel1_prev = spd1_prev - spd1_prev2;
-            Vector3f accel2_prev = spd2_prev - spd2_prev2;
-
-            Vector3f jerk1_curr = accel1_curr - accel1_prev;
-            Vector3f jerk2_curr = accel2_curr - accel2_prev;
-            bone.jerk1 = jerk1_curr.length() / frame_data.dt;
-            bone.jerk2 = jerk2_curr.length() / frame_data.dt;
-
-            // 慣性モーメント: ルートからの距離の2乗
-            Vector3f d1 = bone.p1 - frame_data.curr_root_pos;
-            Vector3f d2 = bone.p2 - frame_data.curr_root_pos;
-            bone.inertia1 = d1.x*d1.x + d1.y*d1.y + d1.z*d1.z;
-            bone.inertia2 = d2.x*d2.x + d2.y*d2.y + d2.z*d2.z;
-        }
-        
-        bones.push_back(bone);
-    }
-}
-
-// ボーンの軸平行境界ボックス（AABB）をボクセル座標で計算
-void SpatialAnalyzer::ComputeAABB(const Point3f& p1, const Point3f& p2, float radius,
-                                   int idx_min[3], int idx_max[3], const float world_range[3]) {
-    float b_min[3], b_max[3];
-    for (int i = 0; i < 3; ++i) {
-        b_min[i] = min(sa_get_axis_value(p1, i), sa_get_axis_value(p2, i)) - radius;
-        b_max[i] = max(sa_get_axis_value(p1, i), sa_get_axis_value(p2, i)) + radius;
-        
-        idx_min[i] = max(0, (int)(((b_min[i] - world_bounds[i][0]) / world_range[i]) * grid_resolution));
-        idx_max[i] = min(grid_resolution - 1, (int)(((b_max[i] - world_bounds[i][0]) / world_range[i]) * grid_resolution));
-    }
-}
-
-// ボーンの影響をガウス分布で重み付けしてボクセルグリッドに書き込み
-void SpatialAnalyzer::WriteToVoxelGrid(const BoneData& bone, float bone_radius, const float world_range[3],
-                                        std::vector<SparseVoxel>* occ_sparse_values, std::vector<int>* occ_index_to_pos) {
-    if (!bone.valid) 
-        return;
-    
-    int idx_min[3], idx_max[3];
-    ComputeAABB(bone.p1, bone.p2, bone_radius, idx_min, idx_max, world_range);
-    
-    Point3f bone_vec = bone.p2 - bone.p1;
-    float bone_len_sq = bone_vec.x*bone_vec.x + bone_vec.y*bone_vec.y + bone_vec.z*bone_vec.z;
-    if (bone_len_sq < 1e-6f) 
-        return;
-    
-    float sigma_sq = 2.0f * (bone_radius/2.0f) * (bone_radius/2.0f);
-    float radius_sq = bone_radius * bone_radius;
-
-    for (int z = idx_min[2]; z <= idx_max[2]; ++z) {
-        for (int y = idx_min[1]; y <= idx_max[1]; ++y) {
-            for (int x = idx_min[0]; x <= idx_max[0]; ++x) {
-                float wc[3];
-                wc[0] = world_bounds[0][0] + (x + 0.5f) * (world_range[0] / grid_resolution);
-                wc[1] = world_bounds[1][0] + (y + 0.5f) * (world_range[1] / grid_resolution);
-                wc[2] = world_bounds[2][0] + (z + 0.5f) * (world_range[2] / grid_resolution);
-
-                Point3f voxel_center(wc[0], wc[1], wc[2]);
-                Point3f v_to_p1 = voxel_center - bone.p1;
-                float t = (v_to_p1.x*bone_vec.x + v_to_p1.y*bone_vec.y + v_to_p1.z*bone_vec.z) / bone_len_sq;
-                float k_clamped = max(0.0f, min(1.0f, t));
-                Point3f closest = bone.p1 + bone_vec * k_clamped;
-                
-                float dist_sq = pow(voxel_center.x - closest.x, 2.0) + pow(voxel_center.y - closest.y, 2.0) + pow(voxel_center.z - closest.z, 2.0);
-
-                if (dist_sq < radius_sq) {                
-                    int idx = x + y * grid_resolution + z * grid_resolution * grid_resolution;
-                    float s_interp = (1.0f - k_clamped) * bone.speed1 + k_clamped * bone.speed2;
-                    float j_interp = (1.0f - k_clamped) * bone.jerk1 + k_clamped * bone.jerk2;
-                    float i_interp = (1.0f - k_clamped) * bone.inertia1 + k_clamped * bone.inertia2;
-
-                    if (occ_sparse_values && occ_index_to_pos) {
-                        if (idx >= 0 && idx < (int)occ_index_to_pos->size()) {
-                            float presence = exp(-dist_sq / sigma_sq);
-                            int pos = (*occ_index_to_pos)[idx];
-                            if (pos < 0) {
-                                (*occ_index_to_pos)[idx] = (int)occ_sparse_values->size();
-                                occ_sparse_values->push_back(SparseVoxel(idx, presence, s_interp, j_interp, i_interp, 0.0f));
-                            } else {
-                                (*occ_sparse_values)[pos].values[0] += presence;
-                                if (s_interp > (*occ_sparse_values)[pos].values[1])
-                                    (*occ_sparse_values)[pos].values[1] = s_interp;
-                                if (j_interp > (*occ_sparse_values)[pos].values[2])
-                                    (*occ_sparse_values)[pos].values[2] = j_interp;
-                                if (i_interp > (*occ_sparse_values)[pos].values[3])
-                                    (*occ_sparse_values)[pos].values[3] = i_interp;
-                            }
-                        }
-                    }
-
-                }
-            }
-        }
-    }
-}
-
 // === 部位選択操作（複数選択対応） ===
 
 // 部位選択状態を初期化し、最大値配列を確保
 void SpatialAnalyzer::InitializeSegmentSelection(int num_segments) {
     selected_segments.assign(num_segments, false);
-    for (int f = 0; f < SA_FEATURE_COUNT; ++f)
-        segment_max[f].assign(num_segments, 1.0f);
+    InitializeSegmentMaxValues(num_segments);
 }
 
 // 指定部位の選択状態をトグル
@@ -2268,25 +1043,30 @@ void SpatialAnalyzer::InvalidateSegmentCache() {
 }
 
 // 選択部位のボクセルデータをキャッシュに集約（差分描画用）
-void SpatialAnalyzer::UpdateSegmentCache() {
+void SpatialAnalyzer::UpdateSegmentCache(const SpatialDisplayRequest& request) {
+    TRACE_SCOPE_CAT("Analyzer::UpdateSegmentCache", "analysis");
+
     // キャッシュ有効性チェック
     bool selection_changed = false;
-    if (cached_selected_segments.size() != selected_segments.size()) {
+    if (cached_selected_segments.size() != request.selected_segments.size()) {
         selection_changed = true;
     } else {
-        for (size_t i = 0; i < selected_segments.size(); ++i) {
-            if (cached_selected_segments[i] != selected_segments[i]) {
+        for (size_t i = 0; i < request.selected_segments.size(); ++i) {
+            if (cached_selected_segments[i] != request.selected_segments[i]) {
                 selection_changed = true;
                 break;
             }
         }
     }
-    
-    if (!segment_cache_dirty && !selection_changed &&
-        cached_feature_mode == feature_mode &&
-        cached_norm_mode == norm_mode &&
-        cached_selected_segment_index == selected_segment_index)
+
+    // 無効化の通知は集約の前に取り出す（集約中に表示側で無効化された場合は次回に再集約）
+    bool dirty = segment_cache_dirty.exchange(false);
+    if (!dirty && !selection_changed &&
+        cached_feature_mode == request.feature_mode &&
+        cached_norm_mode == request.norm_mode &&
+        cached_selected_segment_index == request.selected_segment_index)
         return;
+    ++display_revision;
     
     // キャッシュグリッドをリサイズ・クリア
     cached_segment_grid1.Resize(grid_resolution);
@@ -2296,65 +1076,29 @@ void SpatialAnalyzer::UpdateSegmentCache() {
     cached_segment_grid2.Clear();
     cached_segment_diff.Clear();
     
-    int feature = sa_normalize_feature_index(feature_mode);
+    int feature = sa_normalize_feature_index(request.feature_mode);
+    cached_feature_mode = request.feature_mode;
+    cached_norm_mode = request.norm_mode;
+    cached_selected_segment_index = request.selected_segment_index;
+    cached_selected_segments = request.selected_segments;
 
-    if (norm_mode == 0 &&
+    if (request.norm_mode == 0 &&
         has_frame_cache &&
         has_latest_instant_context &&
-        sa_compose_selected_segments_instant_from_frame_cache(
-            last_instant_motion1,
-            last_instant_motion2,
-            frame_cache1,
-            frame_cache2,
-            feature,
-            grid_resolution,
-            world_bounds,
-            sparse_threshold,
-            last_instant_time,
-            selected_segments,
-            selected_segment_index,
-            cached_segment_grid1,
-            cached_segment_grid2,
-            cached_segment_diff,
-            cached_segment_max_val)) {
-        segment_cache_dirty = false;
-        cached_feature_mode = feature_mode;
-        cached_norm_mode = norm_mode;
-        cached_selected_segment_index = selected_segment_index;
-        cached_selected_segments = selected_segments;
+        ComposeSelectedSegmentsInstant(last_instant_motion1, last_instant_motion2, feature, last_instant_time,
+                                       request.selected_segments, request.selected_segment_index,
+                                       cached_segment_grid1, cached_segment_grid2,
+                                       cached_segment_diff, cached_segment_max_val))
         return;
-    }
 
-    if (norm_mode == 1 &&
+    if (request.norm_mode == 1 &&
         has_frame_cache &&
         has_latest_accum_context &&
-        sa_compose_selected_segments_accumulated_from_frame_cache(
-            last_accum_motion1,
-            last_accum_motion2,
-            frame_cache1,
-            frame_cache2,
-            feature,
-            grid_resolution,
-            world_bounds,
-            sparse_threshold,
-            selected_segments,
-            selected_segment_index,
-            cached_segment_grid1,
-            cached_segment_grid2,
-            cached_segment_diff,
-            cached_segment_max_val)) {
-        segment_cache_dirty = false;
-        cached_feature_mode = feature_mode;
-        cached_norm_mode = norm_mode;
-        cached_selected_segment_index = selected_segment_index;
-        cached_selected_segments = selected_segments;
+        ComposeSelectedSegmentsAccumulated(last_accum_motion1, last_accum_motion2, feature,
+                                           request.selected_segments, request.selected_segment_index,
+                                           cached_segment_grid1, cached_segment_grid2,
+                                           cached_segment_diff, cached_segment_max_val))
         return;
-    }
 
     cached_segment_max_val = 1.0f;
-    segment_cache_dirty = false;
-    cached_feature_mode = feature_mode;
-    cached_norm_mode = norm_mode;
-    cached_selected_segment_index = selected_segment_index;
-    cached_selected_segments = selected_segments;
-}
\ No newline at end of file
+}
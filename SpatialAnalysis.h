@@ -3,12 +3,15 @@
 #include <cmath>
 #include <string>
 #include <functional>
+#include <memory>
+#include <atomic>
 #include <Point3.h>
 #include "SimpleHuman.h"
 #include "SimpleHumanGLUT.h"
-#include "VoxelData.h"
-
-static const int SA_FEATURE_COUNT = 5;
+#include "SpatialAnalysisCore.h"
+#include "VoxelPyramid.h"
+#include "VoxelGroupModel.h"
+#include "SnapshotExchange.h"
 
 // 2D point structure for spatial analysis
 struct SpatialPoint2f {
@@ -18,86 +21,53 @@ struct SpatialPoint2f {
     void set(float _x, float _y) { x = _x; y = _y; }
 };
 
-// {[i[\́i{NZ̋ʉpj
-struct BoneData {
-    Point3f p1, p2;           // ݃t[̗[_
-    Point3f p1_prev, p2_prev; // Ot[̗[_
-    Point3f p1_prev2, p2_prev2; // 2t[O̗[_ixvZpj
-	Point3f p1_prev3, p2_prev3; // 3t[O̗[_iW[NvZpj
-	float speed1, speed2;     // [̑x
-	float jerk1, jerk2;       // [̃W[N
-	float inertia1, inertia2; // [̊[gi[g̋2j
-	int segment_index;        // ZOgCfbNX
-	bool valid;               // Lȃ{[ǂ
-
-	BoneData() : speed1(0), speed2(0), jerk1(0), jerk2(0), inertia1(0), inertia2(0), segment_index(-1), valid(false) {}
-};
-
-// t[f[^i[\́iFKvZʂ̋ʉpj
-struct FrameData {  
-    std::vector<Matrix4f> curr_frames;     // ݃t[̕ϊs
-    std::vector<Matrix4f> prev_frames;     // Ot[̕ϊs
-    std::vector<Matrix4f> prev2_frames;    // 2t[O̕ϊsixvZpj
-	std::vector<Matrix4f> prev3_frames;    // 3t[O̕ϊsiW[NvZpj
-    Point3f curr_root_pos;  // ݃t[̃[gʒu
-    std::vector<Point3f> curr_joint_pos;   // ݃t[̊֐߈ʒu
-    std::vector<Point3f> prev_joint_pos;   // Ot[̊֐߈ʒu
-    std::vector<Point3f> prev2_joint_pos;  // 2t[O̊֐߈ʒuixvZpj
-	std::vector<Point3f> prev3_joint_pos;  // 3t[O̊֐߈ʒuiW[NvZpj
-    float dt;                              // t[Ԋu
-    Point3f prev_root_pos;                 // Ot[̃[gʒu
-    
-	FrameData() : dt(0) {}
+// \̍XV̐ݒiXV̊Jnɕ\̏ԂRs[AvZɕ\ŕύXĂe󂯂Ȃj
+struct SpatialDisplayRequest {
+    Motion* motion1;
+    Motion* motion2;
+    float time;
+    int feature_mode;
+    int norm_mode;
+    bool show_segment_mode;
+    int selected_segment_index;
+    std::vector<bool> selected_segments;
+    bool compose_accumulated; // ݐϕ\Ɍ݂̓ʂt[LbVč邩
+    int playback_direction;   // xt[LbV̐ǂ݂̕i+1 / -1j
+    std::shared_ptr<const VoxelGroupModel> group_model; // ̑ M1  z l\Wc̓vfiȂ nullptrj
+
+    SpatialDisplayRequest() : motion1(nullptr), motion2(nullptr), time(0.0f), feature_mode(0), norm_mode(0),
+                              show_segment_mode(false), selected_segment_index(-1), compose_accumulated(false), playback_direction(1) {}
 };
 
-class SpatialAnalyzer {
-public:
-
-	int grid_resolution; // {NZObh𑜓x
-
-    float world_bounds[3][2];//[hWn̕\E{NZΏۗ̈\3̍ŏl/ől
-
-private:
-    
-	// uԕ\p̃{NZf[^iKvɉĒǉj
-	VoxelGrid voxels1[SA_FEATURE_COUNT], voxels2[SA_FEATURE_COUNT], voxels_diff[SA_FEATURE_COUNT]; // 0:L, 1:x, 2:W[N, 3:[g, 4:厲px
-
-	// ݐσ{NZf[^iKvɉĒǉj
-	VoxelGrid voxels1_accumulated[SA_FEATURE_COUNT], voxels2_accumulated[SA_FEATURE_COUNT], voxels_accumulated_diff[SA_FEATURE_COUNT]; // 0:L, 1:x, 2:W[N, 3:[g, 4:厲px
-    
-    // t[Pʂ̑a{NZLbV
-    MotionFrameSegmentVoxelGridCache frame_cache1;
-    MotionFrameSegmentVoxelGridCache frame_cache2;
-    bool has_frame_cache;
-    float sparse_threshold;
-
-    // čς݃LbV̎pXibvVbg
-    struct AccumulatedPoseCache {
-        bool valid;
-        Point3f motion1_root_pos;
-        Matrix3f motion1_root_ori;
-        Point3f motion2_root_pos;
-        Matrix3f motion2_root_ori;
-
-        AccumulatedPoseCache() : valid(false) {
-            motion1_root_pos.set(0, 0, 0);
-            motion2_root_pos.set(0, 0, 0);
-            motion1_root_ori.setIdentity();
-            motion2_root_ori.setIdentity();
+// \p̌vZʁiJ͕ύXꂸA`摤͎QƂێĂԂ̂܂ܓǂݏoj
+struct SpatialDisplaySnapshot {
+    VoxelGrid grids[3];          // 0: M1, 1: M2, 2: i݂̓ʁE\[hEʑIɉObhj
+    float max_value;             // ̍őliF̐Kpj
+    float diff_max_value;        // grids[2] ̐F̐Kp̍őliȂ max_value Ɠj
+    bool diff_is_zscore;         // grids[2] ̑ M1 ̏Wcɑ΂ z l̐Βl
+    int feature_mode;
+    int norm_mode;
+    float world_bounds[3][2];    // Obh͈̔
+    int lazy_cached_frames[2];   // xt[LbṼt[Egpʁipl̕\pj
+    size_t lazy_memory_bytes[2];
+    size_t range_index_bytes;    // ԗݐς̍̎gp
+    unsigned int serial;         // J̔ԍi0 Ȃ疢vZj
+
+    SpatialDisplaySnapshot() : max_value(1.0f), diff_max_value(1.0f), diff_is_zscore(false), feature_mode(0), norm_mode(0), range_index_bytes(0), serial(0) {
+        for (int i = 0; i < 3; ++i)
+            world_bounds[i][0] = world_bounds[i][1] = 0.0f;
+        for (int i = 0; i < 2; ++i) {
+            lazy_cached_frames[i] = 0;
+            lazy_memory_bytes[i] = 0;
         }
-    };
-    
-	AccumulatedPoseCache accumulated_pose_cache[SA_FEATURE_COUNT]; // 0:L, 1:x, 2:W[N, 3:[g, 4:厲px
-
-	// uԕ\p̍őliKvɉĒǉj
-	float max_val[SA_FEATURE_COUNT]; // 0:L, 1:x, 2:W[N, 3:[g, 4:厲px
-
-	// ݐϗp̍őliKvɉĒǉj
-	float max_accumulated_val[SA_FEATURE_COUNT]; // 0:L, 1:x, 2:W[N, 3:[g, 4:厲px
-
-	// ʂƂ̐KpőliKvɉĒǉj
-	std::vector<float> segment_max[SA_FEATURE_COUNT]; // 0:L, 1:x, 2:W[N, 3:[g, 4:厲px
+    }
+};
 
+// ԉ͂̕\iXCXʁEfʐ}E3D{NZ`ƕʑIj
+// vZiComputeDisplayUpdatej͕\p̌ʂXibvVbgƂČJA`͍ŐṼXibvVbĝ݂ǂݏo߁A
+// vZ[J[XbhōsĂ`̓bN炸ɌvZƕsčs
+// ivZɕύXĂ͂ȂȂ͉̂͌ʁEEʑILbVŁA\̐ݒ SpatialDisplayRequest ɃRs[ĂvZj
+class SpatialAnalyzer : public SpatialAnalysisCore {
 public:
 
     // --- r[/XCXݒ ---
@@ -139,32 +109,56 @@ public:
     VoxelGrid cached_segment_grid2;   // I𕔈ʂW񂵂ObhiM2j
     VoxelGrid cached_segment_diff;    // I𕔈ʂ̍Obh
     float cached_segment_max_val;     // I𕔈ʂ̍ő卷l
-    bool segment_cache_dirty;         // LbVǂ
+    std::atomic<bool> segment_cache_dirty; // LbVǂi\̑ŖAvZōXVj
     int cached_feature_mode;          // LbV쐬feature_mode
     int cached_norm_mode;             // LbV쐬norm_mode
     int cached_selected_segment_index;// LbV쐬selected_segment_index
     std::vector<bool> cached_selected_segments; // LbV쐬̑I
 
+    // Wc̓vfi̎s̗ݐσObh̃{NZƂ̕ρEUj
+    // show_group_zscore  true ȂAݐϕ\ES̕\œʂƃObhfƓƂȂ M1  z l̐Βl\
+    // vZ̃f͕ύXAύXꍇ͐Vfɒu
+    std::shared_ptr<const VoxelGroupModel> group_model;
+    bool show_group_zscore;
+
+    // \p̑d𑜓xs~bhi`摤݂̂gpA0: M1, 1: M2, 2: j
+    // 3D\̓J̋Afʐ}̓Y[{ɉĒiIсAԈɏW񂵂l`悷
+    struct DisplayPyramid {
+        const VoxelGrid* source;   // \z̃XibvVbg̃Obh
+        unsigned int serial;       // \z̃XibvVbg̔ԍ
+        VoxelGridPyramid pyramid;
+        DisplayPyramid() : source(nullptr), serial(0) {}
+    };
+    DisplayPyramid display_pyramids[3];
+    unsigned int display_revision;    // vZŕ\Obh̍XVƂɑ₷iύX̂ȂݐσObh͍ČJȂj
+
 public:
     SpatialAnalyzer();
-    ~SpatialAnalyzer();
+    virtual ~SpatialAnalyzer();
 
-    void ResizeGrids(int res);
-    void SetWorldBounds(float bounds[3][2]);
+    virtual void ResizeGrids(int res) override;
+    virtual void SetWorldBounds(float bounds[3][2]) override;
     
-    // {NZvZ
+    // {NZvZi݂̓ʁEʑIɉčXVA\p̌ʂJj
     void UpdateVoxels(Motion* m1, Motion* m2, float current_time);
 
+    // ݂̕\̐ݒ肩\̍XV̐ݒ쐬i\̃XbhŌĂяoj
+    SpatialDisplayRequest MakeDisplayRequest(Motion* m1, Motion* m2, float current_time) const;
+
+    // \̍XV̐ݒɏ]ă{NZvZA\p̌ʂJi[J[XbhĂяoj
+    void ComputeDisplayUpdate(const SpatialDisplayRequest& request);
+
+    // ŐV̕\p̌ʂ擾i`摤̃XbhŌĂяoA܂JĂȂ serial  0 ̋̌ʁj
+    std::shared_ptr<const SpatialDisplaySnapshot> AcquireDisplaySnapshot();
+
     // ݐσ{NZvZiŚ{ʂƂ𓯎ɌvZj
-    void AccumulateAllFrames(Motion* m1, Motion* m2);
-    void ClearAccumulatedData();
-    void BuildAllFeatureFrameCaches(Motion* m1, Motion* m2);
-    void ComposeAccumulatedFeatureFromFrameCache(Motion* m1, Motion* m2, int feature);
+    virtual void AccumulateAllFrames(Motion* m1, Motion* m2) override;
 
-    // {NZLbVit@CۑEǂݍ݁j
-    bool SaveVoxelCache(const char* motion1_name, const char* motion2_name);
-    bool LoadVoxelCache(const char* motion1_name, const char* motion2_name);
-    std::string GenerateCacheFilename(const char* motion1_name, const char* motion2_name) const;
+    // [J[XbhŌvZʂ荞݁A\̎QƂXVim1, m2 ͕\̓j
+    void AdoptAnalysisResults(SpatialAnalysisCore& results, Motion* m1, Motion* m2);
+
+    // ݂̉͌ʁiǂݍ񂾃LbV܂ށjɑΉ铮ݒ肵AʑIԂ
+    void AdoptAnalysisMotions(Motion* m1, Motion* m2);
 
     // `֘A
     void DrawSlicePlanes();
@@ -201,7 +195,7 @@ public:
     int GetSelectedSegmentCount() const;                // I𕔈ʐ擾
     float GetSegmentMaxValue(int segment_index) const;  // ʂƂ̍ől擾
     void InvalidateSegmentCache();                      // LbV𖳌
-    void UpdateSegmentCache();                          // LbVXV
+    void UpdateSegmentCache(const SpatialDisplayRequest& request); // LbVXV
 
 private:
     const Motion* last_instant_motion1;
@@ -212,53 +206,43 @@ private:
     const Motion* last_accum_motion2;
     bool has_latest_accum_context;
 
-    struct PrevPresenceCacheEntry {
-        const Motion* motion;
-        float time;
-        std::vector<std::vector<SparseVoxel>> seg_presence_sparse;
-        bool valid;
-
-        PrevPresenceCacheEntry() : motion(nullptr), time(0.0f), valid(false) {}
-    };
-
-    PrevPresenceCacheEntry prev_presence_cache_entries[2];
+    // \p̌ʂ̌JivZ݁A`摤ǂݏoj
+    SnapshotExchange<SpatialDisplaySnapshot> display_snapshots;
+    std::shared_ptr<const SpatialDisplaySnapshot> render_snapshot; // `摤Qƒ̌
+    unsigned int published_serial;
+    const VoxelGrid* published_source;  // OJObhEvZʂ̍XViݐσObh̍ČJ̔pj
+    unsigned int published_revision;
+    int published_feature_mode;
+    int published_norm_mode;
+    std::shared_ptr<const VoxelGroupModel> published_group_model;
 
     // ]XCXp̃wp[
     void DrawRotatedSlicePlane();
     void DrawRotatedSliceMapWithSampler(int x, int y, int w, int h, float max_val, const char* title,
                                         const std::function<float(const Point3f&)>& sampler);
-    void ResolveDisplayGridPointersForCurrentMode(VoxelGrid*& grid1,
-                                                  VoxelGrid*& grid2,
-                                                  VoxelGrid*& grid_diff,
-                                                  float& max_value);
-    void ResolveDiffGridPointerForCurrentMode(VoxelGrid*& grid_diff,
-                                              float& max_value);
-    void ResolveDisplaySamplersForCurrentMode(std::function<float(const Point3f&)>& sampler1,
-                                              std::function<float(const Point3f&)>& sampler2,
-                                              std::function<float(const Point3f&)>& sampler_diff,
-                                              float& max_value);
-    void ResolveDiffVoxelSamplerForCurrentMode(std::function<float(int, int, int)>& sampler,
-                                               float& max_value);
+    void ResolveDisplayGridPointers(const SpatialDisplayRequest& request,
+                                    VoxelGrid*& grid1,
+                                    VoxelGrid*& grid2,
+                                    VoxelGrid*& grid_diff,
+                                    float& max_value);
+    void ResolveDisplaySamplers(const SpatialDisplaySnapshot& snapshot,
+                                std::function<float(const Point3f&)>& sampler1,
+                                std::function<float(const Point3f&)>& sampler2,
+                                std::function<float(const Point3f&)>& sampler_diff,
+                                int level = 0);
+
+    // \ObhvZ̃obt@ɏŌJiύX̂ȂݐσObh͌JȂj
+    void PublishDisplaySnapshot(const SpatialDisplayRequest& request);
+
+    // XibvVbg̃Obh̃s~bh擾iXibvVbgςꍇ͍č\zj
+    const VoxelGridPyramid* GetDisplayPyramid(int slot, const SpatialDisplaySnapshot& snapshot);
+
+    // fʐ}̕\͈͂̔̑傫iY[{𔽉fj
+    float GetSliceDisplayHalfSize() const;
     
     // IC[pϊs񂩂tZi\pj
     void UpdateEulerAnglesFromTransform();
-    
-    // ʃ{NZwp[֐
-    void ComputeFrameData(Motion* m, float time, FrameData& frame_data);
-    void ExtractBoneData(Motion* m, const FrameData& frame_data, std::vector<BoneData>& bones);
-    void ComputeAABB(const Point3f& p1, const Point3f& p2, float radius, 
-                     int idx_min[3], int idx_max[3], const float world_range[3]);
-    void WriteToVoxelGrid(const BoneData& bone, float bone_radius, const float world_range[3],
-                          std::vector<SparseVoxel>* occ_sparse_values, std::vector<int>* occ_index_to_pos);
-    void VoxelizeMotion(Motion* m, float time, VoxelGrid& occ, VoxelGrid& spd, VoxelGrid& jrk, VoxelGrid& ine, VoxelGrid& pax);
-    void VoxelizeMotionBySegmentGrids(Motion* m, float time,
-                                      std::vector<VoxelGrid>& seg_presence_grids,
-                                      std::vector<VoxelGrid>& seg_speed_grids,
-                                      std::vector<VoxelGrid>& seg_jerk_grids,
-                                      std::vector<VoxelGrid>& seg_inertia_grids,
-                                      std::vector<VoxelGrid>& seg_principal_axis_grids);
-    void BuildSegmentSparseBaseValues(Motion* m, float time, std::vector<std::vector<SparseVoxel>>& seg_sparse_values);
-    void BuildSegmentSparseVoxels(Motion* m, float time, std::vector<std::vector<SparseVoxel>>& seg_sparse_values);
-    void BuildSingleMotionFeatureFrameCache(Motion* m, MotionFrameSegmentVoxelGridCache& cache);
-    bool ComposeInstantFeatureFromFrameCache(Motion* m1, Motion* m2, int feature, float current_time);
+
+protected:
+    virtual void OnAnalysisDataChanged() override;
 };
\ No newline at end of file
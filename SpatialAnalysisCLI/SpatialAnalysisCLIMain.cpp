@@ -0,0 +1,577 @@
+﻿#include "SimpleHuman.h"
+#include "SpatialAnalysisCore.h"
+#include "VoxelGridOps.h"
+#include "VoxelGroupModel.h"
+#include <cstdio>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+
+// 空間解析のバッチ処理用コマンドラインツール
+// ウィンドウや OpenGL コンテキストを作成せずに、2つの BVH 動作の累積ボクセル・差分・集計値を出力する
+//
+// 使い方:
+//   SpatialAnalysisCLI motion1.bvh motion2.bvh [--resolution N] [--bounds xmin xmax ymin ymax zmin zmax]
+//                      [--margin m] [--features occupancy,speed,...] [--output base] [--no-align]
+//                      [--accumulator dense|hash|sorted_run] [--principal-axis bone|voxel_pca]
+//                      [--grid-space world|segment_local] [--local-voxel-size m] [--group base]
+//                      [--dtw] [--dtw-radius R]
+//   SpatialAnalysisCLI --build-group take1.bvh take2.bvh ... [options]
+//     複数の試行の累積グリッドから特徴量ごとの集団の統計モデル（平均・分散）を作成し、base_<特徴量>.vgm に保存
+
+// コマンドライン引数
+struct CLIOptions {
+    std::string motion1_file;
+    std::string motion2_file;
+    std::string output_base;
+    int resolution;
+    bool has_bounds;
+    float bounds[3][2];
+    float margin;
+    bool align;
+    bool features[SA_FEATURE_COUNT];
+    VoxelAccumulatorType accumulator;
+    PrincipalAxisMode principal_axis;
+    VoxelGridSpace grid_space;
+    float local_voxel_size;
+    bool build_group;                    // 集団の統計モデルを作成（位置引数は全て試行の動作）
+    std::vector<std::string> take_files;
+    std::string group_base;              // 動作1の z 値を求める集団の統計モデル（空なら求めない）
+    bool dtw;                            // フレームキャッシュから DTW でフレームを対応付けてから累積
+    int dtw_radius;
+
+    CLIOptions() : output_base("spatial_analysis"), resolution(64), has_bounds(false), margin(1.0f), align(true), accumulator(VOXEL_ACCUMULATOR_DENSE),
+                   principal_axis(PRINCIPAL_AXIS_BONE), grid_space(VOXEL_GRID_WORLD), local_voxel_size(0.02f), build_group(false),
+                   dtw(false), dtw_radius(10) {
+        for (int i = 0; i < 3; ++i) {
+            bounds[i][0] = -1.0f;
+            bounds[i][1] = 1.0f;
+        }
+        for (int f = 0; f < SA_FEATURE_COUNT; ++f)
+            features[f] = true;
+    }
+};
+
+static void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " motion1.bvh motion2.bvh [options]" << std::endl;
+    std::cout << "       " << program << " --build-group take1.bvh take2.bvh ... [options]" << std::endl;
+    std::cout << "  --resolution N                       voxel grid resolution (default 64)" << std::endl;
+    std::cout << "  --bounds xmin xmax ymin ymax zmin zmax  analysis region in meters (default: root range + margin)" << std::endl;
+    std::cout << "  --margin m                           margin added to the root range (default 1.0)" << std::endl;
+    std::cout << "  --features f1,f2,...                 occupancy, speed, jerk, inertia, principal_axis or all" << std::endl;
+    std::cout << "  --output base                        output file base name (default spatial_analysis)" << std::endl;
+    std::cout << "  --no-align                           keep the initial positions/orientations of the motions" << std::endl;
+    std::cout << "  --accumulator a                      voxel accumulator: dense, hash or sorted_run (default dense)" << std::endl;
+    std::cout << "  --principal-axis m                   principal axis: bone or voxel_pca (validation, default bone)" << std::endl;
+    std::cout << "  --grid-space g                       frame cache grid: world or segment_local (per-segment root-relative grids, default world)" << std::endl;
+    std::cout << "  --local-voxel-size m                 minimum voxel size of the segment-local grids in meters (default 0.02)" << std::endl;
+    std::cout << "  --build-group                        build per-feature group models (mean/variance) from the takes into base_<feature>.vgm" << std::endl;
+    std::cout << "  --group base                         report z-scores of motion1 against the group models base_<feature>.vgm" << std::endl;
+    std::cout << "  --dtw                                accumulate frames paired by DTW alignment instead of by time" << std::endl;
+    std::cout << "  --dtw-radius R                       FastDTW search radius in frames (default 10)" << std::endl;
+}
+
+// 特徴量のリスト（カンマ区切り）を解析
+static bool ParseFeatureList(const char* list, bool features[SA_FEATURE_COUNT]) {
+    for (int f = 0; f < SA_FEATURE_COUNT; ++f)
+        features[f] = false;
+
+    std::string text(list);
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t end = text.find(',', start);
+        if (end == std::string::npos)
+            end = text.size();
+        std::string name = text.substr(start, end - start);
+        start = end + 1;
+        if (name.empty())
+            continue;
+
+        if (name == "all") {
+            for (int f = 0; f < SA_FEATURE_COUNT; ++f)
+                features[f] = true;
+            continue;
+        }
+
+        int found = -1;
+        for (int f = 0; f < SA_FEATURE_COUNT; ++f) {
+            if (name == GetSpatialFeatureName(f)) {
+                found = f;
+                break;
+            }
+        }
+        if (found < 0) {
+            std::cerr << "Unknown feature: " << name << std::endl;
+            return false;
+        }
+        features[found] = true;
+    }
+
+    for (int f = 0; f < SA_FEATURE_COUNT; ++f)
+        if (features[f])
+            return true;
+    std::cerr << "No feature selected." << std::endl;
+    return false;
+}
+
+// ボクセル化の集約方法の名前を解析
+static bool ParseAccumulator(const char* name, VoxelAccumulatorType& accumulator) {
+    for (int a = 0; a < VOXEL_ACCUMULATOR_COUNT; ++a) {
+        if (strcmp(name, GetVoxelAccumulatorName(a)) == 0) {
+            accumulator = (VoxelAccumulatorType)a;
+            return true;
+        }
+    }
+    std::cerr << "Unknown accumulator: " << name << std::endl;
+    return false;
+}
+
+// 慣性主軸角速度の計算方法の名前を解析
+static bool ParsePrincipalAxisMode(const char* name, PrincipalAxisMode& mode) {
+    for (int a = 0; a < PRINCIPAL_AXIS_COUNT; ++a) {
+        if (strcmp(name, GetPrincipalAxisModeName(a)) == 0) {
+            mode = (PrincipalAxisMode)a;
+            return true;
+        }
+    }
+    std::cerr << "Unknown principal axis mode: " << name << std::endl;
+    return false;
+}
+
+// ボクセル化の座標系の名前を解析
+static bool ParseGridSpace(const char* name, VoxelGridSpace& space) {
+    for (int a = 0; a < VOXEL_GRID_SPACE_COUNT; ++a) {
+        if (strcmp(name, GetVoxelGridSpaceName(a)) == 0) {
+            space = (VoxelGridSpace)a;
+            return true;
+        }
+    }
+    std::cerr << "Unknown grid space: " << name << std::endl;
+    return false;
+}
+
+// コマンドライン引数を解析
+static bool ParseArguments(int argc, char** argv, CLIOptions& options) {
+    std::vector<std::string> positional;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--resolution") == 0 && i + 1 < argc) {
+            options.resolution = atoi(argv[++i]);
+        } else if (strcmp(arg, "--bounds") == 0 && i + 6 < argc) {
+            for (int a = 0; a < 3; ++a) {
+                options.bounds[a][0] = (float)atof(argv[++i]);
+                options.bounds[a][1] = (float)atof(argv[++i]);
+            }
+            options.has_bounds = true;
+        } else if (strcmp(arg, "--margin") == 0 && i + 1 < argc) {
+            options.margin = (float)atof(argv[++i]);
+        } else if (strcmp(arg, "--features") == 0 && i + 1 < argc) {
+            if (!ParseFeatureList(argv[++i], options.features))
+                return false;
+        } else if (strcmp(arg, "--output") == 0 && i + 1 < argc) {
+            options.output_base = argv[++i];
+        } else if (strcmp(arg, "--no-align") == 0) {
+            options.align = false;
+        } else if (strcmp(arg, "--accumulator") == 0 && i + 1 < argc) {
+            if (!ParseAccumulator(argv[++i], options.accumulator))
+                return false;
+        } else if (strcmp(arg, "--principal-axis") == 0 && i + 1 < argc) {
+            if (!ParsePrincipalAxisMode(argv[++i], options.principal_axis))
+                return false;
+        } else if (strcmp(arg, "--grid-space") == 0 && i + 1 < argc) {
+            if (!ParseGridSpace(argv[++i], options.grid_space))
+                return false;
+        } else if (strcmp(arg, "--local-voxel-size") == 0 && i + 1 < argc) {
+            options.local_voxel_size = (float)atof(argv[++i]);
+        } else if (strcmp(arg, "--build-group") == 0) {
+            options.build_group = true;
+        } else if (strcmp(arg, "--group") == 0 && i + 1 < argc) {
+            options.group_base = argv[++i];
+        } else if (strcmp(arg, "--dtw") == 0) {
+            options.dtw = true;
+        } else if (strcmp(arg, "--dtw-radius") == 0 && i + 1 < argc) {
+            options.dtw_radius = atoi(argv[++i]);
+        } else if (arg[0] == '-' && arg[1] == '-') {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            return false;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+
+    if (options.build_group) {
+        if (positional.size() < 2) {
+            std::cerr << "At least two BVH files are required to build a group model." << std::endl;
+            return false;
+        }
+        options.take_files = positional;
+    } else {
+        if (positional.size() != 2) {
+            std::cerr << "Two BVH files are required." << std::endl;
+            return false;
+        }
+        options.motion1_file = positional[0];
+        options.motion2_file = positional[1];
+    }
+
+    if (options.resolution < 2 || options.resolution > 512) {
+        std::cerr << "Resolution must be in [2, 512]: " << options.resolution << std::endl;
+        return false;
+    }
+    if (options.dtw_radius < 1) {
+        std::cerr << "DTW radius must be positive: " << options.dtw_radius << std::endl;
+        return false;
+    }
+    if (options.local_voxel_size <= 0.0f) {
+        std::cerr << "Local voxel size must be positive: " << options.local_voxel_size << std::endl;
+        return false;
+    }
+    if (options.has_bounds) {
+        for (int a = 0; a < 3; ++a) {
+            if (!(options.bounds[a][1] > options.bounds[a][0])) {
+                std::cerr << "Invalid bounds on axis " << a << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// JSON 文字列用のエスケープ
+static std::string EscapeJSON(const std::string& text) {
+    std::string out;
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            out += ' ';
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+// 特徴量ごとの集計値
+struct FeatureSummary {
+    float max_diff;
+    double sum_abs_diff;
+    double mean_abs_diff;
+    int occupied1;
+    int occupied2;
+    int nonzero_diff;
+};
+
+// 累積グリッドから集計値を計算
+static FeatureSummary SummarizeFeature(const SpatialAnalysisCore& analyzer, int feature) {
+    const float eps = 1e-6f;
+    const VoxelGrid& g1 = analyzer.GetAccumulatedGrid(0, feature);
+    const VoxelGrid& g2 = analyzer.GetAccumulatedGrid(1, feature);
+    const VoxelGrid& diff = analyzer.GetAccumulatedDiffGrid(feature);
+
+    FeatureSummary s;
+    s.max_diff = analyzer.GetAccumulatedMaxValue(feature);
+    s.occupied1 = (int)VoxelGridCompactAbove(g1.data.data(), g1.data.size(), eps, nullptr, nullptr);
+    s.occupied2 = (int)VoxelGridCompactAbove(g2.data.data(), g2.data.size(), eps, nullptr, nullptr);
+
+    // 差分グリッドは差の絶対値のため、そのまま合計する
+    s.sum_abs_diff = VoxelGridSum(diff.data.data(), diff.data.size());
+    s.nonzero_diff = (int)VoxelGridCompactAbove(diff.data.data(), diff.data.size(), eps, nullptr, nullptr);
+    s.mean_abs_diff = (s.nonzero_diff > 0) ? s.sum_abs_diff / s.nonzero_diff : 0.0;
+    return s;
+}
+
+// 集計値を JSON ファイルに出力
+static bool WriteSummary(const std::string& file_name, const CLIOptions& options, const SpatialAnalysisCore& analyzer,
+                         const Motion* m1, const Motion* m2) {
+    std::ofstream ofs(file_name.c_str());
+    if (!ofs)
+        return false;
+
+    ofs << "{\n";
+    ofs << "  \"motion1\": {\"file\": \"" << EscapeJSON(options.motion1_file) << "\", \"frames\": " << m1->num_frames
+        << ", \"interval\": " << m1->interval << "},\n";
+    ofs << "  \"motion2\": {\"file\": \"" << EscapeJSON(options.motion2_file) << "\", \"frames\": " << m2->num_frames
+        << ", \"interval\": " << m2->interval << "},\n";
+    ofs << "  \"resolution\": " << analyzer.grid_resolution << ",\n";
+    ofs << "  \"bounds\": [";
+    for (int a = 0; a < 3; ++a)
+        ofs << (a ? ", " : "") << "[" << analyzer.world_bounds[a][0] << ", " << analyzer.world_bounds[a][1] << "]";
+    ofs << "],\n";
+    ofs << "  \"grid_space\": \"" << GetVoxelGridSpaceName(analyzer.GetVoxelGridSpace()) << "\",\n";
+    ofs << "  \"dtw_alignment_steps\": " << analyzer.GetFrameAlignment().GetNumSteps() << ",\n";
+    ofs << "  \"features\": {\n";
+
+    bool first_feature = true;
+    for (int f = 0; f < SA_FEATURE_COUNT; ++f) {
+        if (!options.features[f])
+            continue;
+        FeatureSummary s = SummarizeFeature(analyzer, f);
+        const std::vector<float>& seg_max = analyzer.GetSegmentMaxValues(f);
+
+        if (!first_feature)
+            ofs << ",\n";
+        first_feature = false;
+
+        ofs << "    \"" << GetSpatialFeatureName(f) << "\": {\n";
+        ofs << "      \"max_diff\": " << s.max_diff << ",\n";
+        ofs << "      \"sum_abs_diff\": " << s.sum_abs_diff << ",\n";
+        ofs << "      \"mean_abs_diff\": " << s.mean_abs_diff << ",\n";
+        ofs << "      \"occupied_voxels1\": " << s.occupied1 << ",\n";
+        ofs << "      \"occupied_voxels2\": " << s.occupied2 << ",\n";
+        ofs << "      \"nonzero_diff_voxels\": " << s.nonzero_diff << ",\n";
+        ofs << "      \"segment_max\": [";
+        for (size_t i = 0; i < seg_max.size(); ++i) {
+            const char* seg_name = (m1->body && (int)i < m1->body->num_segments) ? m1->body->segments[i]->name.c_str() : "";
+            ofs << (i ? ", " : "") << "{\"segment\": \"" << EscapeJSON(seg_name) << "\", \"max\": " << seg_max[i] << "}";
+        }
+        ofs << "]\n";
+        ofs << "    }";
+    }
+    ofs << "\n  }\n";
+    ofs << "}\n";
+    return true;
+}
+
+// 集団の統計モデルのファイル名（base_<特徴量>.vgm）
+static std::string GetGroupModelFileName(const std::string& base, int feature) {
+    return base + "_" + GetSpatialFeatureName(feature) + ".vgm";
+}
+
+// 解析の設定（解像度・対象領域・ボクセル化の方法）
+static void ConfigureAnalyzer(SpatialAnalysisCore& analyzer, const CLIOptions& options, float bounds[3][2]) {
+    analyzer.ResizeGrids(options.resolution);
+    analyzer.SetWorldBounds(bounds);
+    analyzer.SetVoxelAccumulator(options.accumulator);
+    analyzer.SetPrincipalAxisMode(options.principal_axis);
+    analyzer.SetVoxelGridSpace(options.grid_space);
+    analyzer.SetSegmentGridVoxelSize(options.local_voxel_size);
+}
+
+// 試行の動作を読み込み、初期位置・向きを調整（body が nullptr なら骨格も読み込む）
+static Motion* LoadTakeMotion(const std::string& file_name, const CLIOptions& options, const Skeleton* body) {
+    Motion* motion = LoadAndCoustructBVHMotion(file_name.c_str(), body);
+    if (!motion || motion->num_frames <= 0) {
+        std::cerr << "Failed to load motion: " << file_name << std::endl;
+        if (motion && !body)
+            delete motion->body;
+        delete motion;
+        return nullptr;
+    }
+    if (options.align) {
+        AlignMotionInitialPosition(motion);
+        AlignMotionInitialOrientation(motion);
+    }
+    return motion;
+}
+
+// 複数の試行から特徴量ごとの集団の統計モデルを作成して保存
+// 試行は1つずつ読み込んで累積グリッドを追加してから破棄するため、使用メモリは試行数によらない
+// （対象領域を指定しない場合は、全試行の腰の位置の範囲を求めるために先に1回ずつ読み込む）
+static int BuildGroupModels(const CLIOptions& options) {
+    Motion* first = LoadTakeMotion(options.take_files[0], options, nullptr);
+    if (!first)
+        return 1;
+    const Skeleton* body = first->body;
+
+    float bounds[3][2];
+    if (options.has_bounds) {
+        for (int a = 0; a < 3; ++a) {
+            bounds[a][0] = options.bounds[a][0];
+            bounds[a][1] = options.bounds[a][1];
+        }
+    } else {
+        ComputeMotionPairWorldBounds(first, first, options.margin, bounds);
+        for (size_t t = 1; t < options.take_files.size(); ++t) {
+            Motion* take = LoadTakeMotion(options.take_files[t], options, body);
+            if (!take)
+                continue;
+            float take_bounds[3][2];
+            ComputeMotionPairWorldBounds(take, take, options.margin, take_bounds);
+            for (int a = 0; a < 3; ++a) {
+                bounds[a][0] = (std::min)(bounds[a][0], take_bounds[a][0]);
+                bounds[a][1] = (std::max)(bounds[a][1], take_bounds[a][1]);
+            }
+            delete take;
+        }
+    }
+
+    SpatialAnalysisCore analyzer;
+    ConfigureAnalyzer(analyzer, options, bounds);
+    VoxelGroupModel models[SA_FEATURE_COUNT];
+    for (int f = 0; f < SA_FEATURE_COUNT; ++f) {
+        if (options.features[f])
+            models[f].Reset(f, options.resolution, bounds);
+    }
+
+    VoxelGrid grids[SA_FEATURE_COUNT];
+    for (size_t t = 0; t < options.take_files.size(); ++t) {
+        Motion* take = (t == 0) ? first : LoadTakeMotion(options.take_files[t], options, body);
+        if (!take)
+            continue;
+        if (analyzer.ComposeTakeAccumulatedGrids(take, grids)) {
+            for (int f = 0; f < SA_FEATURE_COUNT; ++f) {
+                if (options.features[f])
+                    models[f].AddTake(grids[f]);
+            }
+            std::cout << "Take " << (t + 1) << ": " << options.take_files[t] << " (" << take->num_frames << " frames)" << std::endl;
+        } else {
+            std::cerr << "Failed to voxelize take: " << options.take_files[t] << std::endl;
+        }
+        if (take != first)
+            delete take;
+    }
+
+    int exit_code = 0;
+    for (int f = 0; f < SA_FEATURE_COUNT; ++f) {
+        if (!options.features[f])
+            continue;
+        std::string file_name = GetGroupModelFileName(options.output_base, f);
+        if (models[f].GetNumTakes() < 2 || !models[f].SaveToFile(file_name.c_str())) {
+            std::cerr << "Failed to save group model: " << file_name << std::endl;
+            exit_code = 1;
+            continue;
+        }
+        std::cout << "  " << GetSpatialFeatureName(f) << ": " << models[f].GetNumTakes() << " takes, "
+                  << models[f].GetMemoryBytes() / (1024.0 * 1024.0) << " MB -> " << file_name << std::endl;
+    }
+
+    delete first;
+    delete body;
+    return exit_code;
+}
+
+// 動作1の累積グリッドの集団に対する z 値の集計を表示（モデルの特徴量・グリッドが解析と同じもののみ）
+static void ReportGroupZScores(const SpatialAnalysisCore& analyzer, const CLIOptions& options) {
+    VoxelGrid zscore;
+    for (int f = 0; f < SA_FEATURE_COUNT; ++f) {
+        if (!options.features[f])
+            continue;
+        std::string file_name = GetGroupModelFileName(options.group_base, f);
+        VoxelGroupModel model;
+        if (!model.LoadFromFile(file_name.c_str())) {
+            std::cerr << "Failed to load group model: " << file_name << std::endl;
+            continue;
+        }
+        if (model.GetFeature() != f || !model.IsCompatible(analyzer.grid_resolution, analyzer.world_bounds)) {
+            std::cerr << "Group model grid does not match the analysis (use the same --resolution and --bounds): " << file_name << std::endl;
+            continue;
+        }
+        float max_z = model.ComputeZScoreGrid(analyzer.GetAccumulatedGrid(0, f), zscore, 0.05f, true);
+        size_t num_outliers = 0;
+        for (size_t i = 0; i < zscore.data.size(); ++i) {
+            if (zscore.data[i] > 3.0f)
+                ++num_outliers;
+        }
+        std::cout << "  " << GetSpatialFeatureName(f) << ": max |z| " << max_z << ", " << num_outliers
+                  << " voxels with |z| > 3 (" << model.GetNumTakes() << " takes)" << std::endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    CLIOptions options;
+    if (!ParseArguments(argc, argv, options)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    if (options.build_group)
+        return BuildGroupModels(options);
+
+    // 動作の読み込み（2つ目の動作は1つ目の骨格を共有）
+    Motion* motion1 = LoadAndCoustructBVHMotion(options.motion1_file.c_str());
+    if (!motion1 || motion1->num_frames <= 0) {
+        std::cerr << "Failed to load motion: " << options.motion1_file << std::endl;
+        return 1;
+    }
+    Motion* motion2 = LoadAndCoustructBVHMotion(options.motion2_file.c_str(), motion1->body);
+    if (!motion2 || motion2->num_frames <= 0) {
+        std::cerr << "Failed to load motion: " << options.motion2_file << std::endl;
+        delete motion1->body;
+        delete motion1;
+        return 1;
+    }
+
+    // 初期位置・向きの調整
+    if (options.align) {
+        AlignMotionInitialPosition(motion1);
+        AlignMotionInitialPosition(motion2);
+        AlignMotionInitialOrientation(motion1);
+        AlignMotionInitialOrientation(motion2);
+    }
+
+    // 解析対象領域・解像度の設定
+    float bounds[3][2];
+    if (options.has_bounds) {
+        for (int a = 0; a < 3; ++a) {
+            bounds[a][0] = options.bounds[a][0];
+            bounds[a][1] = options.bounds[a][1];
+        }
+    } else {
+        ComputeMotionPairWorldBounds(motion1, motion2, options.margin, bounds);
+    }
+
+    SpatialAnalysisCore analyzer;
+    ConfigureAnalyzer(analyzer, options, bounds);
+
+    // フレームキャッシュの構築と、選択された特徴量の累積
+    analyzer.ClearAccumulatedData();
+    analyzer.BuildAllFeatureFrameCaches(motion1, motion2);
+    if (!analyzer.HasFrameCache()) {
+        std::cerr << "Failed to build frame caches." << std::endl;
+        delete motion2;
+        delete motion1->body;
+        delete motion1;
+        return 1;
+    }
+    for (int m = 0; m < 2; ++m) {
+        FrameCacheMemoryInfo info = analyzer.GetFrameCacheMemoryInfo(m);
+        std::cout << "Frame cache (motion" << (m + 1) << "): " << info.num_frames << " frames, " << info.num_voxels << " voxels, "
+                  << info.total_bytes / (1024.0 * 1024.0) << " MB (uncompressed " << info.uncompressed_bytes / (1024.0 * 1024.0) << " MB)" << std::endl;
+    }
+    analyzer.InitializeSegmentMaxValues(motion1->body->num_segments);
+
+    // フレームキャッシュの特徴量の要約から両動作のフレームを対応付け
+    if (options.dtw) {
+        if (analyzer.ComputeFrameCacheAlignment(options.dtw_radius))
+            std::cout << "DTW alignment: " << analyzer.GetFrameAlignment().GetNumSteps() << " steps" << std::endl;
+        else
+            std::cerr << "Failed to compute DTW alignment; frames are paired by time." << std::endl;
+    }
+
+    for (int f = 0; f < SA_FEATURE_COUNT; ++f) {
+        if (!options.features[f])
+            continue;
+        analyzer.ComposeAccumulatedFeatureFromFrameCache(motion1, motion2, f);
+        std::cout << "  " << GetSpatialFeatureName(f) << ": max diff " << analyzer.GetAccumulatedMaxValue(f) << std::endl;
+    }
+    if (!options.group_base.empty()) {
+        std::cout << "Group z-scores of motion1:" << std::endl;
+        ReportGroupZScores(analyzer, options);
+    }
+
+    // 結果の出力
+    int exit_code = 0;
+    if (!analyzer.SaveAccumulatedData(options.output_base)) {
+        std::cerr << "Failed to save accumulated data: " << options.output_base << std::endl;
+        exit_code = 1;
+    }
+    std::string summary_file = options.output_base + "_summary.json";
+    if (!WriteSummary(summary_file, options, analyzer, motion1, motion2)) {
+        std::cerr << "Failed to write summary: " << summary_file << std::endl;
+        exit_code = 1;
+    } else {
+        std::cout << "Summary written to " << summary_file << std::endl;
+    }
+
+    delete motion2;
+    delete motion1->body;
+    delete motion1;
+    return exit_code;
+}
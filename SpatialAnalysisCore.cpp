@@ -0,0 +1,2445 @@
+﻿#include "SpatialAnalysisCore.h"
+#include "Trace.h"
+#include "ScratchArena.h"
+#include "FrameVoxelStore.h"
+#include "VoxelGridOps.h"
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <fstream>  // ファイルI/O用
+
+using namespace std;
+
+// --- 内部ヘルパー関数 ---
+
+// 差分グリッドを計算し、差分の最大値を返す
+// 3つのグリッドとも書き込んだブリックを記録している場合は、両グリッドの書き込んだブリックの和集合のみを計算する
+// （それ以外のボクセルは両グリッドとも 0 のため差分も 0 となり、1フレーム分の体が占める領域のみの計算で済む）
+static float sa_fill_diff_grid_and_compute_max(const VoxelGrid& a, const VoxelGrid& b, VoxelGrid& out_diff, float floor_value = 1.0f, float eps = 1e-5f) {
+    if (a.HasDirtyBricks() && b.HasDirtyBricks() && out_diff.HasDirtyBricks() &&
+        a.resolution == out_diff.resolution && b.resolution == out_diff.resolution) {
+        out_diff.Clear();
+        int res = out_diff.resolution;
+        float out_max = 0.0f;
+        int begin[3], end[3];
+        const std::vector<int>* lists[2] = { &a.GetDirtyBricks(), &b.GetDirtyBricks() };
+        for (int l = 0; l < 2; ++l) {
+            for (size_t i = 0; i < lists[l]->size(); ++i) {
+                int brick = (*lists[l])[i];
+                if (!out_diff.MarkDirtyBrick(brick))
+                    continue;
+                out_diff.GetBrickRange(brick, begin, end);
+                for (int z = begin[2]; z < end[2]; ++z)
+                    for (int y = begin[1]; y < end[1]; ++y) {
+                        size_t row = ((size_t)z * res + y) * res + begin[0];
+                        float d = VoxelGridAbsDiffMax(&a.data[row], &b.data[row], &out_diff.data[row], end[0] - begin[0]);
+                        if (d > out_max)
+                            out_max = d;
+                    }
+            }
+        }
+        if (out_max < eps)
+            out_max = floor_value;
+        return out_max;
+    }
+
+    out_diff.MarkAllDirty();
+    int size = (std::min)((int)a.data.size(), (int)b.data.size());
+    size = (std::min)(size, (int)out_diff.data.size());
+
+    float out_max = VoxelGridAbsDiffMax(a.data.data(), b.data.data(), out_diff.data.data(), size);
+
+    for (int i = size; i < (int)out_diff.data.size(); ++i)
+        out_diff.data[i] = 0.0f;
+
+    if (out_max < eps)
+        out_max = floor_value;
+    return out_max;
+}
+
+static const char* sa_get_feature_file_prefix(int feature_index) {
+    static const char* prefixes[SA_FEATURE_COUNT] = {"acc", "spd_acc", "jrk_acc", "ine_acc", "pax_acc"};
+    if (feature_index < 0 || feature_index >= SA_FEATURE_COUNT)
+        return "acc";
+    return prefixes[feature_index];
+}
+
+static bool sa_save_accumulated_feature_grids(const std::string& base,
+                                              const VoxelGrid grids1[SA_FEATURE_COUNT],
+                                              const VoxelGrid grids2[SA_FEATURE_COUNT],
+                                              const VoxelGrid grids_diff[SA_FEATURE_COUNT]) {
+    for (int f = 0; f < SA_FEATURE_COUNT; ++f) {
+        std::string prefix = sa_get_feature_file_prefix(f);
+        if (!grids1[f].SaveToFile((base + "_" + prefix + "1.bin").c_str())) return false;
+        if (!grids2[f].SaveToFile((base + "_" + prefix + "2.bin").c_str())) return false;
+        if (!grids_diff[f].SaveToFile((base + "_" + prefix + "_diff.bin").c_str())) return false;
+    }
+    return true;
+}
+
+static bool sa_load_accumulated_feature_grids(const std::string& base,
+                                              VoxelGrid grids1[SA_FEATURE_COUNT],
+                                              VoxelGrid grids2[SA_FEATURE_COUNT],
+                                              VoxelGrid grids_diff[SA_FEATURE_COUNT]) {
+    for (int f = 0; f < SA_FEATURE_COUNT; ++f) {
+        std::string prefix = sa_get_feature_file_prefix(f);
+        if (!grids1[f].LoadFromFile((base + "_" + prefix + "1.bin").c_str())) return false;
+        if (!grids2[f].LoadFromFile((base + "_" + prefix + "2.bin").c_str())) return false;
+        if (!grids_diff[f].LoadFromFile((base + "_" + prefix + "_diff.bin").c_str())) return false;
+    }
+    return true;
+}
+
+static Point3f sa_voxel_center_from_linear_index(int linear_index, int resolution, const float world_bounds[3][2]) {
+    int xy = resolution * resolution;
+    int z = linear_index / xy;
+    int rem = linear_index - z * xy;
+    int y = rem / resolution;
+    int x = rem - y * resolution;
+
+    float range_x = world_bounds[0][1] - world_bounds[0][0];
+    float range_y = world_bounds[1][1] - world_bounds[1][0];
+    float range_z = world_bounds[2][1] - world_bounds[2][0];
+
+    float wx = world_bounds[0][0] + (x + 0.5f) * (range_x / resolution);
+    float wy = world_bounds[1][0] + (y + 0.5f) * (range_y / resolution);
+    float wz = world_bounds[2][0] + (z + 0.5f) * (range_z / resolution);
+    return Point3f(wx, wy, wz);
+}
+
+static bool sa_world_to_voxel_index(const Point3f& p, int resolution, const float world_bounds[3][2], int& x, int& y, int& z);
+static void sa_accumulate_feature_value_to_grids(int feature, VoxelGrid* seg_grid_ptr, VoxelGrid& acc_grid, int x, int y, int z, float v);
+static Point3f sa_transform_world_by_root_delta(const Point3f& world_pos, const Point3f& from_root_pos,
+    const Matrix3f& from_root_ori, const Point3f& to_root_pos, const Matrix3f& to_root_ori);
+static int sa_min_segment_count(size_t a, size_t b);
+static int sa_get_frame_index_from_time(const Motion* m, float time);
+static bool sa_has_uniform_root_delta(const Motion* m, const FrameVoxelCacheView& cache, int frame_begin, int frame_end);
+static void sa_compose_segment_feature_range_to_grids(
+    const Motion* m, const FrameVoxelCacheView& cache, const FrameRangeIndex* range_index, bool uniform_delta,
+    int segment, int feature, int resolution, const float world_bounds[3][2],
+    int frame_begin, int frame_end, VoxelGrid* seg_grid_ptr, VoxelGrid& out_acc);
+static float sa_compute_principal_axis_angular_speed_sparse_values(
+    const std::vector<SparseVoxel>& curr_sparse_values,
+    const std::vector<SparseVoxel>& prev_sparse_values,
+    int resolution,
+    float dt,
+    const float world_bounds[3][2],
+    float weight_threshold = 1e-6f);
+static void sa_apply_principal_axis_speed_to_sparse_segment(
+    std::vector<SparseVoxel>& curr,
+    const std::vector<SparseVoxel>& prev,
+    int resolution,
+    float dt,
+    const float world_bounds[3][2],
+    float weight_threshold);
+
+static void sa_parse_cache_meta_tail(
+    const std::vector<double>& meta_tail_values,
+    int& legacy_segment_dense_flag,
+    size_t& bounds_offset) {
+    legacy_segment_dense_flag = -1;
+    bounds_offset = 0;
+    if (meta_tail_values.size() >= 7) {
+        double flag = meta_tail_values[0];
+        if (flag == 0.0 || flag == 1.0) {
+            legacy_segment_dense_flag = (int)flag;
+            bounds_offset = 1;
+        }
+    }
+}
+
+static bool sa_save_cache_meta_file(
+    const std::string& meta_file,
+    int grid_resolution,
+    const float max_accumulated_val[SA_FEATURE_COUNT],
+    const float world_bounds[3][2]) {
+    ofstream meta_ofs(meta_file);
+    if (!meta_ofs)
+        return false;
+
+    meta_ofs << grid_resolution << std::endl;
+    meta_ofs << max_accumulated_val[0] << std::endl;
+    meta_ofs << max_accumulated_val[1] << std::endl;
+    meta_ofs << max_accumulated_val[2] << std::endl;
+    meta_ofs << max_accumulated_val[3] << std::endl;
+    meta_ofs << 0 << std::endl;
+    for (int i = 0; i < 3; ++i)
+        meta_ofs << world_bounds[i][0] << " " << world_bounds[i][1] << std::endl;
+
+    return true;
+}
+
+static bool sa_load_cache_meta_file(
+    const std::string& meta_file,
+    int& out_res,
+    float out_max_accumulated_val[SA_FEATURE_COUNT],
+    float out_world_bounds[3][2],
+    int& out_legacy_segment_dense_flag,
+    std::string& out_error) {
+    ifstream meta_ifs(meta_file);
+    if (!meta_ifs) {
+        out_error = "Cache file not found: " + meta_file;
+        return false;
+    }
+
+    if (!(meta_ifs >> out_res >> out_max_accumulated_val[0] >> out_max_accumulated_val[1] >> out_max_accumulated_val[2] >> out_max_accumulated_val[3])) {
+        out_error = "Invalid cache metadata format: " + meta_file;
+        return false;
+    }
+    if (out_res <= 0) {
+        out_error = "Invalid cache resolution in metadata: " + meta_file;
+        return false;
+    }
+
+    std::vector<double> meta_tail_values;
+    double tail_value = 0.0;
+    while (meta_ifs >> tail_value)
+        meta_tail_values.push_back(tail_value);
+    if (!meta_ifs.eof()) {
+        out_error = "Invalid cache metadata format: " + meta_file;
+        return false;
+    }
+
+    size_t bounds_offset;
+    sa_parse_cache_meta_tail(meta_tail_values, out_legacy_segment_dense_flag, bounds_offset);
+    if (meta_tail_values.size() < bounds_offset + 6) {
+        out_error = "Invalid cache metadata format: " + meta_file;
+        return false;
+    }
+
+    out_max_accumulated_val[4] = 1.0f;
+    for (int i = 0; i < 3; ++i) {
+        out_world_bounds[i][0] = (float)meta_tail_values[bounds_offset + i * 2 + 0];
+        out_world_bounds[i][1] = (float)meta_tail_values[bounds_offset + i * 2 + 1];
+    }
+
+    return true;
+}
+
+static float sa_compute_grid_max_with_floor(const VoxelGrid& grid, float floor_value = 1.0f, float eps = 1e-5f) {
+    float max_value = VoxelGridMax(grid.data.data(), grid.data.size());
+    if (max_value < eps)
+        max_value = floor_value;
+    return max_value;
+}
+
+static float sa_compute_max_abs_diff_between_grids(const VoxelGrid& a, const VoxelGrid& b, float floor_value = 1.0f, float eps = 1e-5f) {
+    size_t size = (std::min)(a.data.size(), b.data.size());
+    float max_diff = VoxelGridMaxAbsDiff(a.data.data(), b.data.data(), size);
+    if (max_diff < eps)
+        max_diff = floor_value;
+    return max_diff;
+}
+
+static void sa_recompute_feature_max_values_from_diff_grids(const VoxelGrid diff_grids[SA_FEATURE_COUNT], float out_max_values[SA_FEATURE_COUNT]) {
+    for (int f = 0; f < SA_FEATURE_COUNT; ++f)
+        out_max_values[f] = sa_compute_grid_max_with_floor(diff_grids[f]);
+}
+
+// 疎ボクセルのボクセル番号の座標系（local_bounds が nullptr ならワールド座標系の共通グリッド）
+// 部位の局所グリッドでは、占有率を局所グリッドとワールドグリッドのボクセルの体積比（value_scale）で換算して加算する
+struct SaSparseGridSpace {
+    const SegmentGridBounds* local_bounds;
+    float value_scale;
+};
+
+static SaSparseGridSpace sa_make_sparse_grid_space(const SegmentGridBounds* local_bounds, int feature, const float world_bounds[3][2]) {
+    SaSparseGridSpace space;
+    space.local_bounds = local_bounds;
+    space.value_scale = 1.0f;
+    if (local_bounds && feature == 0) {
+        float local_volume = 1.0f, world_volume = 1.0f;
+        for (int i = 0; i < 3; ++i) {
+            local_volume *= local_bounds->bounds[i][1] - local_bounds->bounds[i][0];
+            world_volume *= world_bounds[i][1] - world_bounds[i][0];
+        }
+        if (world_volume > 1e-12f)
+            space.value_scale = local_volume / world_volume;
+    }
+    return space;
+}
+
+// ルート相対の座標をワールド座標に変換（root_ori * local + root_pos）
+static inline Point3f sa_root_local_to_world(const Point3f& local, const Point3f& root_pos, const Matrix3f& root_ori) {
+    return Point3f(root_ori.m00 * local.x + root_ori.m01 * local.y + root_ori.m02 * local.z + root_pos.x,
+                   root_ori.m10 * local.x + root_ori.m11 * local.y + root_ori.m12 * local.z + root_pos.y,
+                   root_ori.m20 * local.x + root_ori.m21 * local.y + root_ori.m22 * local.z + root_pos.z);
+}
+
+// 疎ボクセル1つを基準姿勢から現在のルート姿勢に合わせて移動し、グリッドに加算（ref_root_pos が nullptr なら移動しない）
+// 部位の局所グリッドのボクセルはルート相対の座標のため、基準姿勢によらず現在のルート姿勢で直接ワールド座標に変換する
+static inline void sa_scatter_sparse_value_to_grids(
+    int index,
+    float v,
+    int feature,
+    int resolution,
+    const float world_bounds[3][2],
+    const SaSparseGridSpace& space,
+    const Point3f* ref_root_pos,
+    const Matrix3f* ref_root_ori,
+    const Point3f& curr_root_pos,
+    const Matrix3f& curr_root_ori,
+    VoxelGrid* seg_grid_ptr,
+    VoxelGrid& out_acc) {
+    Point3f transformed_world;
+    if (space.local_bounds) {
+        Point3f local = sa_voxel_center_from_linear_index(index, resolution, space.local_bounds->bounds);
+        transformed_world = sa_root_local_to_world(local, curr_root_pos, curr_root_ori);
+        v *= space.value_scale;
+    } else {
+        Point3f cached_world = sa_voxel_center_from_linear_index(index, resolution, world_bounds);
+        transformed_world = cached_world;
+        if (ref_root_pos) {
+            transformed_world = sa_transform_world_by_root_delta(
+                cached_world,
+                *ref_root_pos,
+                *ref_root_ori,
+                curr_root_pos,
+                curr_root_ori);
+        }
+    }
+
+    int x, y, z;
+    if (!sa_world_to_voxel_index(transformed_world, resolution, world_bounds, x, y, z))
+        return;
+
+    sa_accumulate_feature_value_to_grids(feature, seg_grid_ptr, out_acc, x, y, z, v);
+}
+
+static void sa_scatter_segment_sparse_feature_to_grids(
+    const SegmentVoxelGrid& segment_sparse,
+    int feature,
+    int resolution,
+    const float world_bounds[3][2],
+    const SegmentGridBounds* local_bounds,
+    const Point3f& curr_root_pos,
+    const Matrix3f& curr_root_ori,
+    float sparse_threshold,
+    VoxelGrid* seg_grid_ptr,
+    VoxelGrid& out_acc) {
+    const Point3f* ref_root_pos = segment_sparse.has_reference ? &segment_sparse.reference_root_pos : nullptr;
+    const Matrix3f* ref_root_ori = segment_sparse.has_reference ? &segment_sparse.reference_root_ori : nullptr;
+    const std::vector<SparseVoxel>& sparse_list = segment_sparse.voxels;
+    SaSparseGridSpace space = sa_make_sparse_grid_space(local_bounds, feature, world_bounds);
+    for (size_t k = 0; k < sparse_list.size(); ++k) {
+        const SparseVoxel& sv = sparse_list[k];
+        float v = sv.values[feature];
+        if (v <= sparse_threshold)
+            continue;
+        sa_scatter_sparse_value_to_grids(sv.index, v, feature, resolution, world_bounds, space,
+                                         ref_root_pos, ref_root_ori, curr_root_pos, curr_root_ori, seg_grid_ptr, out_acc);
+    }
+}
+
+// フレームキャッシュの1フレーム・1部位分の疎ボクセルを、現在のルート姿勢に合わせてグリッドに加算
+// （閾値以下の値はフレームキャッシュの構築時に除かれ、特徴量の値を持つ疎ボクセルのみが読み出される）
+// weight は値に掛ける重み（フレームの対応付けで同じフレームを複数回累積する場合の回数）
+static void sa_scatter_cached_segment_feature_to_grids(
+    const FrameVoxelCacheView& cache,
+    int frame,
+    int segment,
+    int feature,
+    int resolution,
+    const float world_bounds[3][2],
+    const Point3f& curr_root_pos,
+    const Matrix3f& curr_root_ori,
+    VoxelGrid* seg_grid_ptr,
+    VoxelGrid& out_acc,
+    float weight = 1.0f) {
+    const FrameReference& ref = cache.GetReference(frame);
+    SaSparseGridSpace space = sa_make_sparse_grid_space(cache.GetSegmentBounds(segment), feature, world_bounds);
+    cache.ForEachVoxel(frame, segment, feature, [&](int index, float v) {
+        sa_scatter_sparse_value_to_grids(index, v * weight, feature, resolution, world_bounds, space,
+                                         &ref.root_pos, &ref.root_ori, curr_root_pos, curr_root_ori, seg_grid_ptr, out_acc);
+    });
+}
+
+// 1フレーム分の部位ごとの疎ボクセルを、現在のルート姿勢に合わせてグリッドに加算
+// segment_bounds は疎ボクセルを計算したときの部位ごとの局所グリッドの範囲（部位数未満ならワールド座標系の共通グリッド）
+static void sa_compose_sparse_feature_frame_to_grids(
+    const FrameSegmentVoxelGrid& frame_sparse,
+    int num_segments,
+    int feature,
+    int resolution,
+    const float world_bounds[3][2],
+    const std::vector<SegmentGridBounds>& segment_bounds,
+    float sparse_threshold,
+    const Point3f& curr_root_pos,
+    const Matrix3f& curr_root_ori,
+    std::vector<VoxelGrid>* out_seg_grids,
+    VoxelGrid& out_acc) {
+    int seg_count = (std::min)(num_segments, (int)frame_sparse.segment_grids.size());
+    if (out_seg_grids)
+        seg_count = (std::min)(seg_count, (int)out_seg_grids->size());
+
+    for (int s = 0; s < seg_count; ++s) {
+        const SegmentVoxelGrid& segment_sparse = frame_sparse.segment_grids[s];
+        VoxelGrid* seg_grid_ptr = out_seg_grids ? &(*out_seg_grids)[s] : nullptr;
+        sa_scatter_segment_sparse_feature_to_grids(
+            segment_sparse,
+            feature,
+            resolution,
+            world_bounds,
+            ((int)segment_bounds.size() >= num_segments) ? &segment_bounds[s] : nullptr,
+            curr_root_pos,
+            curr_root_ori,
+            sparse_threshold,
+            seg_grid_ptr,
+            out_acc);
+    }
+}
+
+static void sa_compose_sparse_feature_frames_to_grids(
+    const Motion* m,
+    const FrameVoxelCacheView& cache,
+    int feature,
+    int resolution,
+    const float world_bounds[3][2],
+    int frame_begin,
+    int frame_end,
+    std::vector<VoxelGrid>* out_seg_grids,
+    VoxelGrid& out_acc) {
+    if (!m)
+        return;
+
+    if (frame_begin < 0)
+        frame_begin = 0;
+    int max_frame = (std::min)(cache.GetNumFrames(), m->num_frames) - 1;
+    if (max_frame < 0)
+        return;
+    if (frame_end > max_frame)
+        frame_end = max_frame;
+    if (frame_begin > frame_end)
+        return;
+
+    int seg_count = cache.GetNumSegments();
+    if (out_seg_grids)
+        seg_count = (std::min)(seg_count, (int)out_seg_grids->size());
+
+    for (int f = frame_begin; f <= frame_end; ++f) {
+        const Point3f& curr_root_pos = m->frames[f].root_pos;
+        const Matrix3f& curr_root_ori = m->frames[f].root_ori;
+        for (int s = 0; s < seg_count; ++s) {
+            VoxelGrid* seg_grid_ptr = out_seg_grids ? &(*out_seg_grids)[s] : nullptr;
+            sa_scatter_cached_segment_feature_to_grids(
+                cache,
+                f,
+                s,
+                feature,
+                resolution,
+                world_bounds,
+                curr_root_pos,
+                curr_root_ori,
+                seg_grid_ptr,
+                out_acc);
+        }
+    }
+}
+
+// フレームの対応付けの経路に沿って、部位のフレームごとの特徴量をグリッドに合成
+// counts[k] はフレーム frame_begin + k が経路の段に対応付けられた回数で、占有率は回数で重み付けする
+// （他の特徴量は最大値で集約するため、同じフレームを複数回累積しても結果は変わらない）
+static void sa_compose_aligned_segment_feature_frames_to_grids(
+    const Motion* m,
+    const FrameVoxelCacheView& cache,
+    int segment,
+    int feature,
+    int resolution,
+    const float world_bounds[3][2],
+    int frame_begin,
+    const std::vector<int>& counts,
+    VoxelGrid* seg_grid_ptr,
+    VoxelGrid& out_acc) {
+    if (!m || segment < 0 || segment >= cache.GetNumSegments())
+        return;
+    int max_frame = (std::min)(cache.GetNumFrames(), m->num_frames) - 1;
+    for (size_t k = 0; k < counts.size(); ++k) {
+        int f = frame_begin + (int)k;
+        if (counts[k] <= 0 || f < 0 || f > max_frame)
+            continue;
+        float weight = (feature == 0) ? (float)counts[k] : 1.0f;
+        sa_scatter_cached_segment_feature_to_grids(
+            cache, f, segment, feature, resolution, world_bounds,
+            m->frames[f].root_pos, m->frames[f].root_ori, seg_grid_ptr, out_acc, weight);
+    }
+}
+
+static void sa_collect_active_segments(const std::vector<bool>& selected_segments, int selected_segment_index, std::vector<int>& active_segments) {
+    active_segments.clear();
+    for (size_t s = 0; s < selected_segments.size(); ++s) {
+        if (selected_segments[s])
+            active_segments.push_back((int)s);
+    }
+
+    if (selected_segment_index >= 0 &&
+        selected_segment_index < (int)selected_segments.size() &&
+        !selected_segments[selected_segment_index]) {
+        active_segments.push_back(selected_segment_index);
+    }
+}
+
+static bool sa_compose_selected_segments_instant_from_frame_cache(
+    const Motion* m1,
+    const Motion* m2,
+    const FrameVoxelCacheView& cache1,
+    const FrameVoxelCacheView& cache2,
+    int feature,
+    int resolution,
+    const float world_bounds[3][2],
+    int f1,
+    int f2,
+    const std::vector<bool>& selected_segments,
+    int selected_segment_index,
+    VoxelGrid& out1,
+    VoxelGrid& out2,
+    VoxelGrid& out_diff,
+    float& out_max) {
+    if (!m1 || !m2)
+        return false;
+    if (feature < 0 || feature >= SA_FEATURE_COUNT)
+        return false;
+    if (cache1.Empty() || cache2.Empty())
+        return false;
+
+    std::vector<int> active_segments;
+    sa_collect_active_segments(selected_segments, selected_segment_index, active_segments);
+
+    int size = resolution * resolution * resolution;
+    if ((int)out1.data.size() != size) out1.Resize(resolution); else out1.Clear();
+    if ((int)out2.data.size() != size) out2.Resize(resolution); else out2.Clear();
+    if ((int)out_diff.data.size() != size) out_diff.Resize(resolution); else out_diff.Clear();
+
+    if (active_segments.empty()) {
+        out_max = 1.0f;
+        return true;
+    }
+
+    if (f1 < 0 || f1 >= cache1.GetNumFrames() || f2 < 0 || f2 >= cache2.GetNumFrames())
+        return false;
+
+    const Point3f& curr_root_pos1 = m1->frames[f1].root_pos;
+    const Matrix3f& curr_root_ori1 = m1->frames[f1].root_ori;
+    const Point3f& curr_root_pos2 = m2->frames[f2].root_pos;
+    const Matrix3f& curr_root_ori2 = m2->frames[f2].root_ori;
+
+    for (size_t k = 0; k < active_segments.size(); ++k) {
+        int s = active_segments[k];
+        if (s >= 0 && s < cache1.GetNumSegments()) {
+            sa_scatter_cached_segment_feature_to_grids(
+                cache1,
+                f1,
+                s,
+                feature,
+                resolution,
+                world_bounds,
+                curr_root_pos1,
+                curr_root_ori1,
+                nullptr,
+                out1);
+        }
+        if (s >= 0 && s < cache2.GetNumSegments()) {
+            sa_scatter_cached_segment_feature_to_grids(
+                cache2,
+                f2,
+                s,
+                feature,
+                resolution,
+                world_bounds,
+                curr_root_pos2,
+                curr_root_ori2,
+                nullptr,
+                out2);
+        }
+    }
+
+    out_max = sa_fill_diff_grid_and_compute_max(out1, out2, out_diff);
+
+    return true;
+}
+
+static void sa_compose_selected_segments_feature_frames_to_grid(
+    const Motion* m,
+    const FrameVoxelCacheView& cache,
+    int feature,
+    int resolution,
+    const float world_bounds[3][2],
+    int frame_begin,
+    int frame_end,
+    const std::vector<int>& active_segments,
+    VoxelGrid& out_grid) {
+    if (!m || feature < 0 || feature >= SA_FEATURE_COUNT)
+        return;
+
+    if (frame_begin < 0)
+        frame_begin = 0;
+    int max_frame = (std::min)(cache.GetNumFrames(), m->num_frames) - 1;
+    if (max_frame < 0)
+        return;
+    if (frame_end > max_frame)
+        frame_end = max_frame;
+    if (frame_begin > frame_end)
+        return;
+
+    for (int f = frame_begin; f <= frame_end; ++f) {
+        const Point3f& curr_root_pos = m->frames[f].root_pos;
+        const Matrix3f& curr_root_ori = m->frames[f].root_ori;
+
+        for (size_t k = 0; k < active_segments.size(); ++k) {
+            int s = active_segments[k];
+            if (s < 0 || s >= cache.GetNumSegments())
+                continue;
+
+            sa_scatter_cached_segment_feature_to_grids(
+                cache,
+                f,
+                s,
+                feature,
+                resolution,
+                world_bounds,
+                curr_root_pos,
+                curr_root_ori,
+                nullptr,
+                out_grid);
+        }
+    }
+}
+
+// frame_range1・frame_range2 は累積するフレームの範囲、range_index1・range_index2 は区間累積の索引（なければ nullptr）
+static bool sa_compose_selected_segments_accumulated_from_frame_cache(
+    const Motion* m1,
+    const Motion* m2,
+    const FrameVoxelCacheView& cache1,
+    const FrameVoxelCacheView& cache2,
+    int feature,
+    int resolution,
+    const float world_bounds[3][2],
+    const int frame_range1[2],
+    const int frame_range2[2],
+    const FrameRangeIndex* range_index1,
+    const FrameRangeIndex* range_index2,
+    const FrameAlignmentPath* alignment,
+    const std::vector<bool>& selected_segments,
+    int selected_segment_index,
+    VoxelGrid& out1,
+    VoxelGrid& out2,
+    VoxelGrid& out_diff,
+    float& out_max) {
+    if (!m1 || !m2)
+        return false;
+    if (feature < 0 || feature >= SA_FEATURE_COUNT)
+        return false;
+    if (cache1.Empty() || cache2.Empty())
+        return false;
+
+    std::vector<int> active_segments;
+    sa_collect_active_segments(selected_segments, selected_segment_index, active_segments);
+
+    int size = resolution * resolution * resolution;
+    if ((int)out1.data.size() != size) out1.Resize(resolution); else out1.Clear();
+    if ((int)out2.data.size() != size) out2.Resize(resolution); else out2.Clear();
+    if ((int)out_diff.data.size() != size) out_diff.Resize(resolution); else out_diff.Clear();
+
+    if (active_segments.empty()) {
+        out_max = 1.0f;
+        return true;
+    }
+
+    if (alignment) {
+        // 動作1の累積範囲に対応する経路の段で、両動作のフレームを対応付けられた回数だけ累積
+        int step_begin, step_end, begin1, begin2;
+        std::vector<int> counts1, counts2;
+        alignment->GetStepRange(frame_range1[0], frame_range1[1], step_begin, step_end);
+        alignment->CountFrames(0, step_begin, step_end, begin1, counts1);
+        alignment->CountFrames(1, step_begin, step_end, begin2, counts2);
+        for (size_t k = 0; k < active_segments.size(); ++k) {
+            int s = active_segments[k];
+            sa_compose_aligned_segment_feature_frames_to_grids(
+                m1, cache1, s, feature, resolution, world_bounds, begin1, counts1, nullptr, out1);
+            sa_compose_aligned_segment_feature_frames_to_grids(
+                m2, cache2, s, feature, resolution, world_bounds, begin2, counts2, nullptr, out2);
+        }
+    } else if (!range_index1 && !range_index2) {
+        sa_compose_selected_segments_feature_frames_to_grid(
+            m1,
+            cache1,
+            feature,
+            resolution,
+            world_bounds,
+            frame_range1[0],
+            frame_range1[1],
+            active_segments,
+            out1);
+
+        sa_compose_selected_segments_feature_frames_to_grid(
+            m2,
+            cache2,
+            feature,
+            resolution,
+            world_bounds,
+            frame_range2[0],
+            frame_range2[1],
+            active_segments,
+            out2);
+    } else {
+        bool uniform1 = sa_has_uniform_root_delta(m1, cache1, frame_range1[0], frame_range1[1]);
+        bool uniform2 = sa_has_uniform_root_delta(m2, cache2, frame_range2[0], frame_range2[1]);
+        for (size_t k = 0; k < active_segments.size(); ++k) {
+            int s = active_segments[k];
+            if (s >= 0 && s < cache1.GetNumSegments()) {
+                sa_compose_segment_feature_range_to_grids(
+                    m1, cache1, range_index1, uniform1, s, feature, resolution, world_bounds,
+                    frame_range1[0], frame_range1[1], nullptr, out1);
+            }
+            if (s >= 0 && s < cache2.GetNumSegments()) {
+                sa_compose_segment_feature_range_to_grids(
+                    m2, cache2, range_index2, uniform2, s, feature, resolution, world_bounds,
+                    frame_range2[0], frame_range2[1], nullptr, out2);
+            }
+        }
+    }
+
+    out_max = sa_fill_diff_grid_and_compute_max(out1, out2, out_diff);
+
+    return true;
+}
+
+// 3x3 対称行列の最大固有値に対応する単位固有ベクトルを閉形式で計算（反復なし）
+// 固有値は三角関数による解法、固有ベクトルは (A - λI) の行ベクトルの外積のうち最長のものとする
+// 最大固有値が重根（軸が一意に定まらない）の場合は false を返す
+static bool sa_compute_symmetric3x3_major_eigenvector(double a00, double a01, double a02,
+                                                      double a11, double a12, double a22, Vector3f& axis_out) {
+    double p1 = a01 * a01 + a02 * a02 + a12 * a12;
+    double q = (a00 + a11 + a22) / 3.0;
+    double b00 = a00 - q, b11 = a11 - q, b22 = a22 - q;
+    double p2 = b00 * b00 + b11 * b11 + b22 * b22 + 2.0 * p1;
+    if (p2 <= 1e-30)
+        return false;
+    double p = sqrt(p2 / 6.0);
+
+    // B = (A - qI) / p の行列式の半分から最大固有値を計算
+    double det = b00 * (b11 * b22 - a12 * a12) - a01 * (a01 * b22 - a12 * a02) + a02 * (a01 * a12 - b11 * a02);
+    double r = det / (2.0 * p * p * p);
+    r = (std::max)(-1.0, (std::min)(1.0, r));
+    double lambda = q + 2.0 * p * cos(acos(r) / 3.0);
+
+    double r0[3] = {a00 - lambda, a01, a02};
+    double r1[3] = {a01, a11 - lambda, a12};
+    double r2[3] = {a02, a12, a22 - lambda};
+    const double* rows[3][2] = {{r0, r1}, {r0, r2}, {r1, r2}};
+    double best[3] = {0.0, 0.0, 0.0};
+    double best_len_sq = 0.0;
+    for (int i = 0; i < 3; ++i) {
+        const double* u = rows[i][0];
+        const double* v = rows[i][1];
+        double c[3] = {u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0]};
+        double len_sq = c[0] * c[0] + c[1] * c[1] + c[2] * c[2];
+        if (len_sq > best_len_sq) {
+            best_len_sq = len_sq;
+            best[0] = c[0]; best[1] = c[1]; best[2] = c[2];
+        }
+    }
+
+    // 外積が全て短い場合は (A - λI) の階数が 1 以下（最大固有値が重根）
+    if (best_len_sq <= 1e-12 * p2 * p2)
+        return false;
+    double len = sqrt(best_len_sq);
+    axis_out.x = (float)(best[0] / len);
+    axis_out.y = (float)(best[1] / len);
+    axis_out.z = (float)(best[2] / len);
+    return true;
+}
+
+// 占有率で重み付けしたボクセル中心の主軸（検証用の PRINCIPAL_AXIS_VOXEL_PCA で使用）
+// 1回の走査で重心・共分散のモーメントを集計し（桁落ちを避けるため最初のボクセルを原点とする）、固有ベクトルは閉形式で計算
+static bool sa_compute_principal_axis_from_sparse_presence_values(
+    const std::vector<SparseVoxel>& sparse_values,
+    int resolution,
+    const float world_bounds[3][2],
+    Vector3f& axis_out,
+    float weight_threshold) {
+    if (resolution <= 0 || sparse_values.empty())
+        return false;
+
+    double cell[3];
+    for (int i = 0; i < 3; ++i)
+        cell[i] = (double)((world_bounds[i][1] - world_bounds[i][0]) / resolution);
+
+    bool has_origin = false;
+    int origin[3] = {0, 0, 0};
+    double sum_w = 0.0;
+    double m1[3] = {0.0, 0.0, 0.0};
+    double m00 = 0.0, m01 = 0.0, m02 = 0.0, m11 = 0.0, m12 = 0.0, m22 = 0.0;
+    for (size_t k = 0; k < sparse_values.size(); ++k) {
+        float w = sparse_values[k].values[0];
+        if (w <= weight_threshold)
+            continue;
+        int index = sparse_values[k].index;
+        int xy = resolution * resolution;
+        int v[3];
+        v[2] = index / xy;
+        v[1] = (index - v[2] * xy) / resolution;
+        v[0] = index - v[2] * xy - v[1] * resolution;
+        if (!has_origin) {
+            origin[0] = v[0]; origin[1] = v[1]; origin[2] = v[2];
+            has_origin = true;
+        }
+        double dx = (v[0] - origin[0]) * cell[0];
+        double dy = (v[1] - origin[1]) * cell[1];
+        double dz = (v[2] - origin[2]) * cell[2];
+        sum_w += w;
+        m1[0] += w * dx; m1[1] += w * dy; m1[2] += w * dz;
+        m00 += w * dx * dx; m01 += w * dx * dy; m02 += w * dx * dz;
+        m11 += w * dy * dy; m12 += w * dy * dz; m22 += w * dz * dz;
+    }
+
+    if (sum_w <= 1e-8)
+        return false;
+
+    double cx = m1[0] / sum_w, cy = m1[1] / sum_w, cz = m1[2] / sum_w;
+    return sa_compute_symmetric3x3_major_eigenvector(
+        m00 / sum_w - cx * cx, m01 / sum_w - cx * cy, m02 / sum_w - cx * cz,
+        m11 / sum_w - cy * cy, m12 / sum_w - cy * cz, m22 / sum_w - cz * cz,
+        axis_out);
+}
+
+static float sa_compute_unsigned_angle_between_unit_vectors(const Vector3f& a, const Vector3f& b) {
+    float dot = fabsf(a.x * b.x + a.y * b.y + a.z * b.z);
+    dot = (std::max)(0.0f, (std::min)(1.0f, dot));
+    return acosf(dot);
+}
+
+static int sa_min_segment_count(size_t a, size_t b) {
+    return (std::min)((int)a, (int)b);
+}
+
+static void sa_apply_uniform_principal_axis_speed(std::vector<SparseVoxel>& curr, float omega_axis) {
+    for (size_t k = 0; k < curr.size(); ++k) {
+        if (omega_axis > curr[k].values[4])
+            curr[k].values[4] = omega_axis;
+    }
+}
+
+static float sa_compute_principal_axis_angular_speed_sparse_values(
+    const std::vector<SparseVoxel>& curr_sparse_values,
+    const std::vector<SparseVoxel>& prev_sparse_values,
+    int resolution,
+    float dt,
+    const float world_bounds[3][2],
+    float weight_threshold) {
+    if (resolution <= 0 || dt <= 1e-8f || curr_sparse_values.empty() || prev_sparse_values.empty())
+        return 0.0f;
+
+    float effective_weight_threshold = (std::max)(0.0f, weight_threshold);
+
+    Vector3f e_curr, e_prev;
+    if (!sa_compute_principal_axis_from_sparse_presence_values(curr_sparse_values, resolution, world_bounds, e_curr, effective_weight_threshold))
+        return 0.0f;
+    if (!sa_compute_principal_axis_from_sparse_presence_values(prev_sparse_values, resolution, world_bounds, e_prev, effective_weight_threshold))
+        return 0.0f;
+
+    float dtheta = sa_compute_unsigned_angle_between_unit_vectors(e_curr, e_prev);
+    return dtheta / dt;
+}
+
+static void sa_apply_principal_axis_speed_to_sparse_segment(
+    std::vector<SparseVoxel>& curr,
+    const std::vector<SparseVoxel>& prev,
+    int resolution,
+    float dt,
+    const float world_bounds[3][2],
+    float weight_threshold) {
+    if (resolution <= 0 || curr.empty() || prev.empty())
+        return;
+
+    float omega_axis = sa_compute_principal_axis_angular_speed_sparse_values(
+        curr,
+        prev,
+        resolution,
+        dt,
+        world_bounds,
+        weight_threshold);
+
+    if (omega_axis <= 0.0f)
+        return;
+
+    sa_apply_uniform_principal_axis_speed(curr, omega_axis);
+}
+
+static void sa_apply_principal_axis_speed_to_sparse_segments(
+    std::vector<std::vector<SparseVoxel>>& curr_sparse_values,
+    const std::vector<std::vector<SparseVoxel>>& prev_sparse_values,
+    int resolution,
+    float dt,
+    const float world_bounds[3][2],
+    float weight_threshold) {
+    int seg_count = sa_min_segment_count(curr_sparse_values.size(), prev_sparse_values.size());
+    for (int s = 0; s < seg_count; ++s) {
+        sa_apply_principal_axis_speed_to_sparse_segment(
+            curr_sparse_values[s],
+            prev_sparse_values[s],
+            resolution,
+            dt,
+            world_bounds,
+            weight_threshold);
+    }
+}
+
+static int sa_get_frame_index_from_time(const Motion* m, float time) {
+    if (!m || m->num_frames <= 0 || m->interval <= 1e-8f)
+        return 0;
+    int idx = (int)(time / m->interval);
+    if (idx < 0)
+        idx = 0;
+    if (idx >= m->num_frames)
+        idx = m->num_frames - 1;
+    return idx;
+}
+
+static bool sa_nearly_equal_float(float a, float b, float eps = 1e-5f) {
+    return fabsf(a - b) <= eps;
+}
+
+static bool sa_nearly_equal_point3(const Point3f& a, const Point3f& b, float eps = 1e-5f) {
+    return sa_nearly_equal_float(a.x, b.x, eps) &&
+           sa_nearly_equal_float(a.y, b.y, eps) &&
+           sa_nearly_equal_float(a.z, b.z, eps);
+}
+
+static bool sa_nearly_equal_matrix3(const Matrix3f& a, const Matrix3f& b, float eps = 1e-5f) {
+    return sa_nearly_equal_float(a.m00, b.m00, eps) && sa_nearly_equal_float(a.m01, b.m01, eps) && sa_nearly_equal_float(a.m02, b.m02, eps) &&
+           sa_nearly_equal_float(a.m10, b.m10, eps) && sa_nearly_equal_float(a.m11, b.m11, eps) && sa_nearly_equal_float(a.m12, b.m12, eps) &&
+           sa_nearly_equal_float(a.m20, b.m20, eps) && sa_nearly_equal_float(a.m21, b.m21, eps) && sa_nearly_equal_float(a.m22, b.m22, eps);
+}
+
+static bool sa_world_to_voxel_index(const Point3f& p, int resolution, const float world_bounds[3][2], int& x, int& y, int& z) {
+    float range_x = world_bounds[0][1] - world_bounds[0][0];
+    float range_y = world_bounds[1][1] - world_bounds[1][0];
+    float range_z = world_bounds[2][1] - world_bounds[2][0];
+    if (range_x <= 1e-8f || range_y <= 1e-8f || range_z <= 1e-8f)
+        return false;
+
+    x = (int)(((p.x - world_bounds[0][0]) / range_x) * resolution);
+    y = (int)(((p.y - world_bounds[1][0]) / range_y) * resolution);
+    z = (int)(((p.z - world_bounds[2][0]) / range_z) * resolution);
+
+    return x >= 0 && x < resolution && y >= 0 && y < resolution && z >= 0 && z < resolution;
+}
+
+static void sa_accumulate_feature_value_to_grids(int feature, VoxelGrid* seg_grid_ptr, VoxelGrid& acc_grid, int x, int y, int z, float v) {
+    acc_grid.MarkDirty(x, y, z);
+    if (feature == 0) {
+        if (seg_grid_ptr)
+            seg_grid_ptr->At(x, y, z) += v;
+        acc_grid.At(x, y, z) += v;
+    } else {
+        if (seg_grid_ptr) {
+            float& seg_v = seg_grid_ptr->At(x, y, z);
+            if (v > seg_v) seg_v = v;
+        }
+        float& acc_v = acc_grid.At(x, y, z);
+        if (v > acc_v) acc_v = v;
+    }
+}
+
+static Point3f sa_transform_world_by_root_delta(const Point3f& world_pos, const Point3f& from_root_pos,
+    const Matrix3f& from_root_ori, const Point3f& to_root_pos, const Matrix3f& to_root_ori) {
+    float dx = world_pos.x - from_root_pos.x;
+    float dy = world_pos.y - from_root_pos.y;
+    float dz = world_pos.z - from_root_pos.z;
+
+    // local = from_root_ori^T * (world - from_root_pos)
+    float lx = from_root_ori.m00 * dx + from_root_ori.m10 * dy + from_root_ori.m20 * dz;
+    float ly = from_root_ori.m01 * dx + from_root_ori.m11 * dy + from_root_ori.m21 * dz;
+    float lz = from_root_ori.m02 * dx + from_root_ori.m12 * dy + from_root_ori.m22 * dz;
+
+    // world' = to_root_ori * local + to_root_pos
+    float wx = to_root_ori.m00 * lx + to_root_ori.m01 * ly + to_root_ori.m02 * lz + to_root_pos.x;
+    float wy = to_root_ori.m10 * lx + to_root_ori.m11 * ly + to_root_ori.m12 * lz + to_root_pos.y;
+    float wz = to_root_ori.m20 * lx + to_root_ori.m21 * ly + to_root_ori.m22 * lz + to_root_pos.z;
+
+    return Point3f(wx, wy, wz);
+}
+
+// 基準姿勢から現在のルート姿勢への移動（回転 to_ori * from_ori^T と、平行移動 to_pos - 回転 * from_pos）を計算
+static void sa_compute_root_delta(const Point3f& from_pos, const Matrix3f& from_ori, const Point3f& to_pos, const Matrix3f& to_ori,
+                                  Matrix3f& rot, Point3f& trans) {
+    rot.m00 = to_ori.m00 * from_ori.m00 + to_ori.m01 * from_ori.m01 + to_ori.m02 * from_ori.m02;
+    rot.m01 = to_ori.m00 * from_ori.m10 + to_ori.m01 * from_ori.m11 + to_ori.m02 * from_ori.m12;
+    rot.m02 = to_ori.m00 * from_ori.m20 + to_ori.m01 * from_ori.m21 + to_ori.m02 * from_ori.m22;
+    rot.m10 = to_ori.m10 * from_ori.m00 + to_ori.m11 * from_ori.m01 + to_ori.m12 * from_ori.m02;
+    rot.m11 = to_ori.m10 * from_ori.m10 + to_ori.m11 * from_ori.m11 + to_ori.m12 * from_ori.m12;
+    rot.m12 = to_ori.m10 * from_ori.m20 + to_ori.m11 * from_ori.m21 + to_ori.m12 * from_ori.m22;
+    rot.m20 = to_ori.m20 * from_ori.m00 + to_ori.m21 * from_ori.m01 + to_ori.m22 * from_ori.m02;
+    rot.m21 = to_ori.m20 * from_ori.m10 + to_ori.m21 * from_ori.m11 + to_ori.m22 * from_ori.m12;
+    rot.m22 = to_ori.m20 * from_ori.m20 + to_ori.m21 * from_ori.m21 + to_ori.m22 * from_ori.m22;
+    trans.x = to_pos.x - (rot.m00 * from_pos.x + rot.m01 * from_pos.y + rot.m02 * from_pos.z);
+    trans.y = to_pos.y - (rot.m10 * from_pos.x + rot.m11 * from_pos.y + rot.m12 * from_pos.z);
+    trans.z = to_pos.z - (rot.m20 * from_pos.x + rot.m21 * from_pos.y + rot.m22 * from_pos.z);
+}
+
+// 指定範囲の全フレームで、フレームキャッシュの基準姿勢から現在のルート姿勢への移動が等しいかを判定
+// （未編集の動作・動作全体を剛体変換した動作では等しく、区間の累積値を先頭フレームの移動でまとめて移動できる）
+static bool sa_has_uniform_root_delta(const Motion* m, const FrameVoxelCacheView& cache, int frame_begin, int frame_end) {
+    if (!m)
+        return false;
+    if (frame_begin < 0)
+        frame_begin = 0;
+    int max_frame = (std::min)(cache.GetNumFrames(), m->num_frames) - 1;
+    if (frame_end > max_frame)
+        frame_end = max_frame;
+    if (frame_begin > frame_end)
+        return true;
+
+    // 部位の局所グリッドのボクセル番号はフレームごとのルート姿勢の座標系のため、基準姿勢も等しい場合のみ区間の累積値をまとめて移動できる
+    bool segment_local = cache.GetNumSegments() > 0 && cache.GetSegmentBounds(0) != nullptr;
+
+    Matrix3f rot0, rot;
+    Point3f trans0, trans;
+    const FrameReference& ref0 = cache.GetReference(frame_begin);
+    sa_compute_root_delta(ref0.root_pos, ref0.root_ori, m->frames[frame_begin].root_pos, m->frames[frame_begin].root_ori, rot0, trans0);
+    for (int f = frame_begin + 1; f <= frame_end; ++f) {
+        const FrameReference& ref = cache.GetReference(f);
+        if (segment_local && (!sa_nearly_equal_matrix3(ref.root_ori, ref0.root_ori, 1e-4f) || !sa_nearly_equal_point3(ref.root_pos, ref0.root_pos, 1e-4f)))
+            return false;
+        sa_compute_root_delta(ref.root_pos, ref.root_ori, m->frames[f].root_pos, m->frames[f].root_ori, rot, trans);
+        if (!sa_nearly_equal_matrix3(rot, rot0, 1e-4f) || !sa_nearly_equal_point3(trans, trans0, 1e-4f))
+            return false;
+    }
+    return true;
+}
+
+// 指定部位の指定範囲のフレームの特徴量をグリッドに合成
+// 区間累積の索引があり、範囲内の全フレームでルート姿勢の移動が等しければ区間の累積値を求めてから移動し、それ以外はフレームごとに合成する
+static void sa_compose_segment_feature_range_to_grids(
+    const Motion* m, const FrameVoxelCacheView& cache, const FrameRangeIndex* range_index, bool uniform_delta,
+    int segment, int feature, int resolution, const float world_bounds[3][2],
+    int frame_begin, int frame_end, VoxelGrid* seg_grid_ptr, VoxelGrid& out_acc) {
+    if (!m)
+        return;
+    if (frame_begin < 0)
+        frame_begin = 0;
+    int max_frame = (std::min)(cache.GetNumFrames(), m->num_frames) - 1;
+    if (frame_end > max_frame)
+        frame_end = max_frame;
+    if (frame_begin > frame_end)
+        return;
+
+    if (range_index && uniform_delta) {
+        std::vector<FrameRangeVoxelValue> values;
+        range_index->QueryRange(cache, segment, frame_begin, frame_end, values);
+        const FrameReference& ref = cache.GetReference(frame_begin);
+        const Point3f& curr_root_pos = m->frames[frame_begin].root_pos;
+        const Matrix3f& curr_root_ori = m->frames[frame_begin].root_ori;
+        SaSparseGridSpace space = sa_make_sparse_grid_space(cache.GetSegmentBounds(segment), feature, world_bounds);
+        for (size_t i = 0; i < values.size(); ++i) {
+            sa_scatter_sparse_value_to_grids(values[i].index, values[i].value, feature, resolution, world_bounds, space,
+                                             &ref.root_pos, &ref.root_ori, curr_root_pos, curr_root_ori, seg_grid_ptr, out_acc);
+        }
+        return;
+    }
+
+    for (int f = frame_begin; f <= frame_end; ++f) {
+        sa_scatter_cached_segment_feature_to_grids(
+            cache, f, segment, feature, resolution, world_bounds,
+            m->frames[f].root_pos, m->frames[f].root_ori, seg_grid_ptr, out_acc);
+    }
+}
+
+// フレームキャッシュの要素の作成用の作業領域（前フレームの部位ごとの疎ボクセルの配列を再利用）
+struct SaFrameCacheEntryScratch {
+    std::vector<std::vector<SparseVoxel>> prev_sparse_values;
+};
+
+// スレッドごとの作業領域のプール（フレームキャッシュの構築・先読みの各スレッドが個別に使用）
+static ObjectPool<SaFrameCacheEntryScratch>& sa_get_frame_cache_entry_scratch_pool() {
+    static thread_local ObjectPool<SaFrameCacheEntryScratch> pool;
+    return pool;
+}
+
+// --- SpatialAnalysisCore Implementation ---
+
+// 特徴量の名前を取得
+const char* GetSpatialFeatureName(int feature) {
+    static const char* names[SA_FEATURE_COUNT] = {"occupancy", "speed", "jerk", "inertia", "principal_axis"};
+    if (feature < 0 || feature >= SA_FEATURE_COUNT)
+        return "unknown";
+    return names[feature];
+}
+
+// ボクセル化の座標系の名前を取得
+const char* GetVoxelGridSpaceName(int space) {
+    static const char* names[VOXEL_GRID_SPACE_COUNT] = {"world", "segment_local"};
+    if (space < 0 || space >= VOXEL_GRID_SPACE_COUNT)
+        return "unknown";
+    return names[space];
+}
+
+// 動作の初期位置をXZ平面の原点に揃える（Y座標はそのまま維持）
+void AlignMotionInitialPosition(Motion* m) {
+    if (!m || m->num_frames == 0)
+        return;
+
+    Point3f offset(m->frames[0].root_pos.x, 0.0f, m->frames[0].root_pos.z);
+    for (int i = 0; i < m->num_frames; i++)
+        m->frames[i].root_pos -= offset;
+}
+
+// 動作の初期向きを+Z軸方向に揃える
+void AlignMotionInitialOrientation(Motion* m) {
+    if (!m || m->num_frames == 0)
+        return;
+
+    Matrix3f ori = m->frames[0].root_ori;
+    float angle = -atan2(ori.m02, ori.m22);
+    Matrix3f rot; rot.rotY(angle);
+    for (int i = 0; i < m->num_frames; i++) {
+        rot.transform(&m->frames[i].root_pos);
+        m->frames[i].root_ori.mul(rot, m->frames[i].root_ori);
+    }
+}
+
+// 2つの動作の全フレームの腰の位置の範囲に余白を加えて、解析対象領域を計算
+void ComputeMotionPairWorldBounds(const Motion* m1, const Motion* m2, float margin, float bounds[3][2]) {
+    float min_x = 1e6f, min_y = 1e6f, min_z = 1e6f;
+    float max_x = -1e6f, max_y = -1e6f, max_z = -1e6f;
+
+    auto update_root_minmax = [&](const Motion* m) {
+        if (!m)
+            return;
+        for (int f = 0; f < m->num_frames; ++f) {
+            const Point3f& p = m->frames[f].root_pos;
+            if (p.x < min_x) min_x = p.x;
+            if (p.x > max_x) max_x = p.x;
+            if (p.y < min_y) min_y = p.y;
+            if (p.y > max_y) max_y = p.y;
+            if (p.z < min_z) min_z = p.z;
+            if (p.z > max_z) max_z = p.z;
+        }
+    };
+
+    update_root_minmax(m1);
+    update_root_minmax(m2);
+
+    bounds[0][0] = min_x - margin;
+    bounds[0][1] = max_x + margin;
+    bounds[1][0] = min_y - margin;
+    bounds[1][1] = max_y + margin;
+    bounds[2][0] = min_z - margin;
+    bounds[2][1] = max_z + margin;
+}
+
+// コンストラクタ：初期値を設定し、グリッドを初期化
+SpatialAnalysisCore::SpatialAnalysisCore() {
+    for (int i = 0; i < 3; ++i) {
+        world_bounds[i][0] = -1.0f;
+        world_bounds[i][1] = 1.0f;
+    }
+
+    grid_resolution = 64;
+    ResizeGrids(grid_resolution);
+
+    for (int i = 0; i < SA_FEATURE_COUNT; ++i) {
+        max_val[i] = 1.0f;
+        max_accumulated_val[i] = 1.0f;
+        accumulated_pose_cache[i].valid = false;
+    }
+
+    has_frame_cache = false;
+    sparse_threshold = 1e-4f;
+    voxel_accumulator = VOXEL_ACCUMULATOR_DENSE;
+    principal_axis_mode = PRINCIPAL_AXIS_BONE;
+    voxel_grid_space = VOXEL_GRID_WORLD;
+    segment_grid_voxel_size = 0.02f;
+    has_accumulation_range = false;
+    accumulation_range[0] = 0.0f;
+    accumulation_range[1] = 0.0f;
+    frame_alignment_revision = 0;
+    prev_presence_cache_entries[0] = PrevPresenceCacheEntry();
+    prev_presence_cache_entries[1] = PrevPresenceCacheEntry();
+
+    use_lazy_frame_cache = true;
+    playback_direction = 1;
+    for (int i = 0; i < 2; ++i) {
+        lazy_frame_caches[i].SetBuildFunction(
+            [this](Motion* m, int frame, const FrameSegmentVoxelGrid* prev, FrameSegmentVoxelGrid& out) {
+                BuildFrameCacheEntry(m, frame, prev, out);
+            });
+    }
+}
+
+// デストラクタ（先読みスレッドが参照するメンバが破棄される前に停止）
+SpatialAnalysisCore::~SpatialAnalysisCore() {
+    ResetLazyFrameCaches();
+}
+
+// 全ボクセルグリッドを指定解像度でリサイズ
+void SpatialAnalysisCore::ResizeGrids(int res) {
+    ResetLazyFrameCaches();
+    grid_resolution = res;
+
+    for (int i = 0; i < SA_FEATURE_COUNT; ++i) {
+        voxels1[i].Resize(res); voxels2[i].Resize(res); voxels_diff[i].Resize(res);
+        voxels1_accumulated[i].Resize(res); voxels2_accumulated[i].Resize(res); voxels_accumulated_diff[i].Resize(res);
+        accumulated_pose_cache[i].valid = false;
+    }
+
+    prev_presence_cache_entries[0].valid = false;
+    prev_presence_cache_entries[1].valid = false;
+    frame_cache1.Clear();
+    frame_cache2.Clear();
+    CloseFrameCacheFiles();
+    ClearFrameRangeIndices();
+    segment_grid_bounds.clear();
+    has_frame_cache = false;
+}
+
+// ワールド座標の境界を設定し、合成済みの累積結果・部位ごとの局所グリッドの範囲を無効化
+void SpatialAnalysisCore::SetWorldBounds(float bounds[3][2]) {
+    ResetLazyFrameCaches();
+    for (int i = 0; i < 3; ++i) {
+        world_bounds[i][0] = bounds[i][0];
+        world_bounds[i][1] = bounds[i][1];
+    }
+    segment_grid_bounds.clear();
+
+    for (int i = 0; i < SA_FEATURE_COUNT; ++i)
+        accumulated_pose_cache[i].valid = false;
+}
+
+// ボクセル化の集約方法を設定（計算結果は変わらないが、先読みスレッドが参照しているため遅延フレームキャッシュを止めて破棄）
+void SpatialAnalysisCore::SetVoxelAccumulator(VoxelAccumulatorType type) {
+    if (type == voxel_accumulator)
+        return;
+    ResetLazyFrameCaches();
+    voxel_accumulator = type;
+}
+
+// 慣性主軸角速度の計算方法を設定（変更した場合はフレームキャッシュ・合成済みの累積結果を破棄）
+void SpatialAnalysisCore::SetPrincipalAxisMode(PrincipalAxisMode mode) {
+    if (mode == principal_axis_mode)
+        return;
+    ResetLazyFrameCaches();
+    principal_axis_mode = mode;
+    DiscardFrameCaches();
+}
+
+// フレームキャッシュのボクセル化の座標系を設定（変更した場合はフレームキャッシュ・合成済みの累積結果を破棄）
+void SpatialAnalysisCore::SetVoxelGridSpace(VoxelGridSpace space) {
+    if (space == voxel_grid_space)
+        return;
+    voxel_grid_space = space;
+    DiscardFrameCaches();
+}
+
+// 部位ごとの局所グリッドのボクセルの1辺の下限を設定（局所グリッドの場合はフレームキャッシュ・合成済みの累積結果を破棄）
+void SpatialAnalysisCore::SetSegmentGridVoxelSize(float size) {
+    if (size <= 0.0f || size == segment_grid_voxel_size)
+        return;
+    segment_grid_voxel_size = size;
+    if (voxel_grid_space == VOXEL_GRID_SEGMENT_LOCAL)
+        DiscardFrameCaches();
+}
+
+// ボクセル化の設定の変更により、フレームキャッシュ・部位ごとの局所グリッドの範囲・合成済みの累積結果を破棄
+void SpatialAnalysisCore::DiscardFrameCaches() {
+    ResetLazyFrameCaches();
+    segment_grid_bounds.clear();
+
+    for (int i = 0; i < SA_FEATURE_COUNT; ++i)
+        accumulated_pose_cache[i].valid = false;
+    prev_presence_cache_entries[0].valid = false;
+    prev_presence_cache_entries[1].valid = false;
+    frame_cache1.Clear();
+    frame_cache2.Clear();
+    CloseFrameCacheFiles();
+    ClearFrameRangeIndices();
+    has_frame_cache = false;
+    OnAnalysisDataChanged();
+}
+
+// 部位ごとの局所グリッドの範囲を計算（余白はボーンの影響半径）
+void SpatialAnalysisCore::PrepareSegmentGridBounds(Motion* m1, Motion* m2) {
+    if (voxel_grid_space != VOXEL_GRID_SEGMENT_LOCAL || !segment_grid_bounds.empty())
+        return;
+    TRACE_SCOPE_CAT("Analysis::PrepareSegmentGridBounds", "analysis");
+
+    // 計算前の範囲で先読みした遅延フレームキャッシュは使えないため破棄
+    ResetLazyFrameCaches();
+    ComputeSegmentGridBounds(m1, m2, VoxelizationSettings().bone_radius, segment_grid_voxel_size * grid_resolution, segment_grid_bounds);
+}
+
+// 指定時刻のモーションを占有率・速度・ジャーク・慣性モーメントのボクセルグリッドに変換
+void SpatialAnalysisCore::VoxelizeMotion(Motion* m, float time, VoxelGrid& occ, VoxelGrid& spd, VoxelGrid& jrk, VoxelGrid& ine, VoxelGrid& pax) {
+    TRACE_SCOPE_CAT("Analysis::VoxelizeMotion", "analysis");
+
+    if (!m)
+        return;
+
+    int size = grid_resolution * grid_resolution * grid_resolution;
+    if ((int)occ.data.size() != size) occ.Resize(grid_resolution);
+    if ((int)spd.data.size() != size) spd.Resize(grid_resolution);
+    if ((int)jrk.data.size() != size) jrk.Resize(grid_resolution);
+    if ((int)ine.data.size() != size) ine.Resize(grid_resolution);
+    if ((int)pax.data.size() != size) pax.Resize(grid_resolution);
+
+    std::fill(occ.data.begin(), occ.data.end(), 0.0f);
+    std::fill(spd.data.begin(), spd.data.end(), 0.0f);
+    std::fill(jrk.data.begin(), jrk.data.end(), 0.0f);
+    std::fill(ine.data.begin(), ine.data.end(), 0.0f);
+    std::fill(pax.data.begin(), pax.data.end(), 0.0f);
+    occ.MarkAllDirty();
+    spd.MarkAllDirty();
+    jrk.MarkAllDirty();
+    ine.MarkAllDirty();
+    pax.MarkAllDirty();
+
+    std::vector<std::vector<SparseVoxel>> curr_sparse_presence;
+    BuildSegmentSparseVoxels(m, time, curr_sparse_presence);
+
+    for (size_t s = 0; s < curr_sparse_presence.size(); ++s) {
+        const std::vector<SparseVoxel>& sparse = curr_sparse_presence[s];
+        for (size_t k = 0; k < sparse.size(); ++k) {
+            int i = sparse[k].index;
+            occ.data[i] += sparse[k].values[0];
+            if (sparse[k].values[1] > spd.data[i]) spd.data[i] = sparse[k].values[1];
+            if (sparse[k].values[2] > jrk.data[i]) jrk.data[i] = sparse[k].values[2];
+            if (sparse[k].values[3] > ine.data[i]) ine.data[i] = sparse[k].values[3];
+            if (sparse[k].values[4] > pax.data[i]) pax.data[i] = sparse[k].values[4];
+        }
+    }
+}
+
+bool SpatialAnalysisCore::ComposeInstantFeatureFromFrameCache(Motion* m1, Motion* m2, int feature, float current_time) {
+    TRACE_SCOPE_CAT("Analysis::ComposeInstantFeature", "analysis");
+
+    if (!m1 || !m2 || !has_frame_cache)
+        return false;
+    FrameVoxelCacheView cache1 = GetFrameCacheView(0);
+    FrameVoxelCacheView cache2 = GetFrameCacheView(1);
+    if (cache1.Empty() || cache2.Empty())
+        return false;
+
+    int num_segments = m1->body ? m1->body->num_segments : 0;
+    if (num_segments <= 0)
+        return false;
+
+    int f1, f2;
+    GetFramePairAtTime(m1, m2, current_time, f1, f2);
+    if (f1 >= cache1.GetNumFrames() || f2 >= cache2.GetNumFrames())
+        return false;
+
+    VoxelGrid* out1 = nullptr;
+    VoxelGrid* out2 = nullptr;
+
+    if (feature < 0 || feature >= SA_FEATURE_COUNT)
+        return false;
+
+    out1 = &voxels1[feature];
+    out2 = &voxels2[feature];
+
+    int size = grid_resolution * grid_resolution * grid_resolution;
+    if ((int)out1->data.size() != size) out1->Resize(grid_resolution);
+    if ((int)out2->data.size() != size) out2->Resize(grid_resolution);
+
+    sa_compose_sparse_feature_frames_to_grids(
+        m1, cache1, feature, grid_resolution, world_bounds,
+        f1, f1, nullptr, *out1);
+    sa_compose_sparse_feature_frames_to_grids(
+        m2, cache2, feature, grid_resolution, world_bounds,
+        f2, f2, nullptr, *out2);
+    return true;
+}
+
+// 遅延フレームキャッシュから指定時刻のフレームを取得して瞬間ボクセルを合成し、再生方向の先のフレームを先読み
+bool SpatialAnalysisCore::ComposeInstantFeatureFromLazyCache(Motion* m1, Motion* m2, int feature, float current_time) {
+    TRACE_SCOPE_CAT("Analysis::ComposeInstantFeatureLazy", "analysis");
+
+    if (!use_lazy_frame_cache || !m1 || !m2 || !m1->body || !m2->body)
+        return false;
+    if (feature < 0 || feature >= SA_FEATURE_COUNT)
+        return false;
+    PrepareSegmentGridBounds(m1, m2);
+
+    Motion* motions[2] = { m1, m2 };
+    VoxelGrid* outs[2] = { &voxels1[feature], &voxels2[feature] };
+    int size = grid_resolution * grid_resolution * grid_resolution;
+    int frames[2];
+    GetFramePairAtTime(m1, m2, current_time, frames[0], frames[1]);
+
+    for (int i = 0; i < 2; ++i) {
+        LazyFrameCache& cache = lazy_frame_caches[i];
+        cache.Bind(motions[i]);
+
+        int f = frames[i];
+        std::shared_ptr<const FrameSegmentVoxelGrid> entry = cache.Acquire(f);
+        if (!entry)
+            return false;
+
+        if ((int)outs[i]->data.size() != size) outs[i]->Resize(grid_resolution);
+        sa_compose_sparse_feature_frame_to_grids(
+            *entry, entry->num_segments, feature, grid_resolution, world_bounds, segment_grid_bounds, sparse_threshold,
+            motions[i]->frames[f].root_pos, motions[i]->frames[f].root_ori, nullptr, *outs[i]);
+
+        cache.RequestPrefetch(f, playback_direction);
+    }
+    return true;
+}
+
+// 遅延フレームキャッシュの設定
+void SpatialAnalysisCore::SetLazyFrameCacheEnabled(bool enable) {
+    use_lazy_frame_cache = enable;
+    if (!enable)
+        ResetLazyFrameCaches();
+}
+
+void SpatialAnalysisCore::SetLazyFrameCacheMemoryLimit(size_t bytes) {
+    lazy_frame_caches[0].SetMemoryLimit(bytes);
+    lazy_frame_caches[1].SetMemoryLimit(bytes);
+}
+
+void SpatialAnalysisCore::SetLazyFramePrefetch(int frames) {
+    lazy_frame_caches[0].SetPrefetchFrames(frames);
+    lazy_frame_caches[1].SetPrefetchFrames(frames);
+}
+
+void SpatialAnalysisCore::ResetLazyFrameCaches() {
+    lazy_frame_caches[0].Reset();
+    lazy_frame_caches[1].Reset();
+}
+
+const LazyFrameCache& SpatialAnalysisCore::GetLazyFrameCache(int motion_no) const {
+    return lazy_frame_caches[(motion_no == 0) ? 0 : 1];
+}
+
+// フレームキャッシュの使用メモリの内訳
+FrameCacheMemoryInfo SpatialAnalysisCore::GetFrameCacheMemoryInfo(int motion_no) const {
+    int i = (motion_no == 0) ? 0 : 1;
+    FrameCacheMemoryInfo info = ((i == 0) ? frame_cache1 : frame_cache2).GetMemoryInfo();
+    const MappedFrameVoxelStore* mapped = mapped_frame_caches[i].get();
+    if (mapped && mapped->IsOpen()) {
+        info.num_frames = mapped->GetNumFrames();
+        info.num_voxels = mapped->GetNumVoxels();
+        info.num_bricks = mapped->GetNumBricks();
+        info.mapped_bytes = mapped->GetFileSize();
+    }
+    return info;
+}
+
+// フレームキャッシュの読み出し用の参照（ファイルをマップしている場合はマップしたページから読み出す）
+FrameVoxelCacheView SpatialAnalysisCore::GetFrameCacheView(int motion_no) const {
+    int i = (motion_no == 0) ? 0 : 1;
+    const MappedFrameVoxelStore* mapped = mapped_frame_caches[i].get();
+    if (mapped && mapped->IsOpen())
+        return FrameVoxelCacheView(*mapped);
+    return FrameVoxelCacheView((i == 0) ? frame_cache1 : frame_cache2);
+}
+
+// 指定時刻の両モーションのボクセルを計算し、差分と最大値を更新
+void SpatialAnalysisCore::ComputeInstantFeature(Motion* m1, Motion* m2, float current_time, int feature) {
+    TRACE_SCOPE_CAT("Analysis::ComputeInstantFeature", "analysis");
+
+    if (feature < 0 || feature >= SA_FEATURE_COUNT)
+        feature = 0;
+
+    // 前回のフレームで書き込んだブリックのみを消去し、今回書き込んだブリックのみの差分を計算
+    voxels1[feature].EnableDirtyTracking();
+    voxels2[feature].EnableDirtyTracking();
+    voxels_diff[feature].EnableDirtyTracking();
+    voxels1[feature].Clear();
+    voxels2[feature].Clear();
+    voxels_diff[feature].Clear();
+    max_val[feature] = 0.0f;
+
+    if (!ComposeInstantFeatureFromFrameCache(m1, m2, feature, current_time) &&
+        !ComposeInstantFeatureFromLazyCache(m1, m2, feature, current_time)) {
+        int f1, f2;
+        GetFramePairAtTime(m1, m2, current_time, f1, f2);
+        float time2 = (HasFrameAlignment() && m2) ? f2 * m2->interval : current_time;
+        VoxelizeMotion(m1, current_time, voxels1[0], voxels1[1], voxels1[2], voxels1[3], voxels1[4]);
+        VoxelizeMotion(m2, time2, voxels2[0], voxels2[1], voxels2[2], voxels2[3], voxels2[4]);
+    }
+
+    // 差分計算と最大値更新（指定特徴量のみ）
+    max_val[feature] = sa_fill_diff_grid_and_compute_max(voxels1[feature], voxels2[feature], voxels_diff[feature]);
+}
+
+// モーション全体を通して累積ボクセルを計算（占有率・速度・ジャーク + 部位ごと）
+void SpatialAnalysisCore::AccumulateAllFrames(Motion* m1, Motion* m2)
+{
+    TRACE_SCOPE_CAT("Analysis::AccumulateAllFrames", "analysis");
+
+    if (!m1 || !m2)
+        return;
+
+    ClearAccumulatedData();
+
+    BuildAllFeatureFrameCaches(m1, m2);
+    if (!has_frame_cache) {
+        std::cout << "Frame sparse cache is unavailable. Accumulation skipped." << std::endl;
+        return;
+    }
+
+    int num_segments = (m1->body) ? m1->body->num_segments : 0;
+    if (num_segments > 0)
+        InitializeSegmentMaxValues(num_segments);
+
+    for (int feat = 0; feat < SA_FEATURE_COUNT; ++feat) {
+        if (!OnAnalysisProgress(SA_STAGE_ACCUMULATE, feat, SA_FEATURE_COUNT)) {
+            std::cout << "Accumulation cancelled." << std::endl;
+            return;
+        }
+        ComposeAccumulatedFeatureFromFrameCache(m1, m2, feat);
+    }
+    OnAnalysisProgress(SA_STAGE_ACCUMULATE, SA_FEATURE_COUNT, SA_FEATURE_COUNT);
+
+    OnAnalysisDataChanged();
+
+    std::cout << "Integrated accumulation complete (from frame sparse cache)." << std::endl;
+    std::cout << "  Max presence diff: " << max_accumulated_val[0] << std::endl;
+    std::cout << "  Max speed: " << max_accumulated_val[1] << std::endl;
+    std::cout << "  Max jerk: " << max_accumulated_val[2] << std::endl;
+    std::cout << "  Max inertia: " << max_accumulated_val[3] << std::endl;
+    std::cout << "  Max principal-axis speed: " << max_accumulated_val[4] << std::endl;
+}
+
+// 累積ボクセルグリッドをクリアし、最大値をリセット
+void SpatialAnalysisCore::ClearAccumulatedData()
+{
+    for (int i = 0; i < SA_FEATURE_COUNT; ++i) {
+        voxels1_accumulated[i].Clear();
+        voxels2_accumulated[i].Clear();
+        voxels_accumulated_diff[i].Clear();
+        max_accumulated_val[i] = 0.0f;
+    }
+}
+
+// 1フレーム分の部位ごとの疎ボクセル（全特徴量）を計算し、基準姿勢とともにフレームキャッシュの要素に格納
+void SpatialAnalysisCore::BuildFrameCacheEntry(Motion* m, int frame, const FrameSegmentVoxelGrid* prev_entry, FrameSegmentVoxelGrid& out) {
+    VoxelizationPipeline pipeline(GetVoxelizationSettings());
+    pipeline.BuildFrameEntry(m, frame, out);
+    ApplyFrameCachePrincipalAxisSpeed(m, frame, prev_entry, out);
+}
+
+// 検証用のボクセルの主成分分析では、慣性主軸角速度に前フレームの占有率を使用（prev_entry がなければ前フレームをこの場で計算）
+// ボーンの軸方向を使用する場合はボクセル化の処理の流れで設定済み
+void SpatialAnalysisCore::ApplyFrameCachePrincipalAxisSpeed(Motion* m, int frame, const FrameSegmentVoxelGrid* prev_entry, FrameSegmentVoxelGrid& out) {
+    if (frame <= 0 || principal_axis_mode != PRINCIPAL_AXIS_VOXEL_PCA)
+        return;
+
+    PooledObject<SaFrameCacheEntryScratch> scratch(sa_get_frame_cache_entry_scratch_pool());
+    std::vector<std::vector<SparseVoxel>>& prev_sparse_values = scratch->prev_sparse_values;
+    const float weight_threshold = sparse_threshold;
+
+    // 部位の局所グリッドはフレームごとのルート姿勢の座標系のため、主成分分析は両フレームともワールド座標系の共通グリッドで行う
+    if ((int)segment_grid_bounds.size() >= (int)out.segment_grids.size()) {
+        std::vector<std::vector<SparseVoxel>> curr_sparse_values;
+        BuildSegmentSparseBaseValues(m, frame * m->interval, curr_sparse_values);
+        BuildSegmentSparseBaseValues(m, (frame - 1) * m->interval, prev_sparse_values);
+        int count = sa_min_segment_count(out.segment_grids.size(), sa_min_segment_count(curr_sparse_values.size(), prev_sparse_values.size()));
+        for (int s = 0; s < count; ++s) {
+            float omega_axis = sa_compute_principal_axis_angular_speed_sparse_values(
+                curr_sparse_values[s], prev_sparse_values[s], grid_resolution, m->interval, world_bounds, weight_threshold);
+            if (omega_axis > 0.0f)
+                sa_apply_uniform_principal_axis_speed(out.segment_grids[s].voxels, omega_axis);
+        }
+        return;
+    }
+
+    if (!prev_entry)
+        BuildSegmentSparseBaseValues(m, (frame - 1) * m->interval, prev_sparse_values);
+
+    int prev_count = prev_entry ? (int)prev_entry->segment_grids.size() : (int)prev_sparse_values.size();
+    int seg_count = sa_min_segment_count(out.segment_grids.size(), prev_count);
+    for (int s = 0; s < seg_count; ++s) {
+        sa_apply_principal_axis_speed_to_sparse_segment(
+            out.segment_grids[s].voxels,
+            prev_entry ? prev_entry->segment_grids[s].voxels : prev_sparse_values[s],
+            grid_resolution,
+            m->interval,
+            world_bounds,
+            weight_threshold);
+    }
+}
+
+VoxelizationSettings SpatialAnalysisCore::GetVoxelizationSettings() const {
+    VoxelizationSettings settings;
+    settings.resolution = grid_resolution;
+    for (int i = 0; i < 3; ++i) {
+        settings.world_bounds[i][0] = world_bounds[i][0];
+        settings.world_bounds[i][1] = world_bounds[i][1];
+    }
+    settings.sparse_threshold = sparse_threshold;
+    settings.accumulator = voxel_accumulator;
+    settings.principal_axis = principal_axis_mode;
+    settings.segment_bounds = segment_grid_bounds;
+    return settings;
+}
+
+// 姿勢の取得～集約はボクセル化の処理の流れで行い、保存前に前フレームの要素から慣性主軸角速度を設定
+bool SpatialAnalysisCore::BuildMotionFrameStore(Motion* m, FrameVoxelStore& store, int stage) {
+    VoxelizationPipeline pipeline(GetVoxelizationSettings());
+    VoxelizationPipeline::FrameFilter principal_axis =
+        [this](Motion* motion, int frame, const FrameSegmentVoxelGrid* prev, FrameSegmentVoxelGrid& curr) {
+            ApplyFrameCachePrincipalAxisSpeed(motion, frame, prev, curr);
+        };
+    VoxelizationPipeline::ProgressFunction progress;
+    if (stage >= 0) {
+        progress = [this, stage](int done, int total) {
+            return OnAnalysisProgress(stage, done, total);
+        };
+    }
+    return pipeline.BuildMotion(m, store, principal_axis, progress);
+}
+
+void SpatialAnalysisCore::BuildSingleMotionFeatureFrameCache(Motion* m, MotionFrameSegmentVoxelGridCache& cache) {
+    TRACE_SCOPE_CAT("Analysis::BuildMotionFrameCache", "analysis");
+
+    cache.Clear();
+    if (!m || !m->body || m->num_frames <= 0)
+        return;
+
+    // 中断された場合は構築途中のキャッシュが破棄される
+    MemoryFrameVoxelStore store(cache);
+    int stage = (&cache == &frame_cache1) ? SA_STAGE_FRAME_CACHE1 : SA_STAGE_FRAME_CACHE2;
+    if (!BuildMotionFrameStore(m, store, stage))
+        return;
+
+#ifndef SH_TRACE_DISABLED
+    if (TraceIsEnabled()) {
+        FrameCacheMemoryInfo info = cache.GetMemoryInfo();
+        TRACE_COUNTER("Frame cache sparse voxels", info.num_voxels);
+        TRACE_COUNTER("Frame cache MB", info.total_bytes / (1024.0 * 1024.0));
+    }
+#endif
+}
+
+void SpatialAnalysisCore::BuildAllFeatureFrameCaches(Motion* m1, Motion* m2) {
+    TRACE_SCOPE_CAT("Analysis::BuildAllFrameCaches", "analysis");
+
+    has_frame_cache = false;
+    OnAnalysisDataChanged();
+    ResetLazyFrameCaches();
+    frame_cache1.Clear();
+    frame_cache2.Clear();
+    CloseFrameCacheFiles();
+    ClearFrameRangeIndices();
+    for (int f = 0; f < SA_FEATURE_COUNT; ++f)
+        accumulated_pose_cache[f].valid = false;
+
+    if (!m1 || !m2)
+        return;
+
+    // 部位ごとの局所グリッドの範囲は解析する動作の組ごとに計算し直す
+    segment_grid_bounds.clear();
+    PrepareSegmentGridBounds(m1, m2);
+
+    BuildSingleMotionFeatureFrameCache(m1, frame_cache1);
+    if (frame_cache1.Empty())
+        return;
+    BuildSingleMotionFeatureFrameCache(m2, frame_cache2);
+    has_frame_cache = !frame_cache1.Empty() && !frame_cache2.Empty();
+}
+
+void SpatialAnalysisCore::ComposeAccumulatedFeatureFromFrameCache(Motion* m1, Motion* m2, int feature) {
+    TRACE_SCOPE_CAT("Analysis::ComposeAccumulatedFeature", "analysis");
+
+    bool has_cache = false;
+    AccumulatedPoseCache* pose_cache = nullptr;
+    VoxelGrid* acc1 = nullptr;
+    VoxelGrid* acc2 = nullptr;
+    VoxelGrid* diff = nullptr;
+    float* max_val = nullptr;
+    std::vector<float>* seg_max = nullptr;
+
+    FrameVoxelCacheView c1 = GetFrameCacheView(0);
+    FrameVoxelCacheView c2 = GetFrameCacheView(1);
+    has_cache = has_frame_cache;
+
+    if (feature < 0 || feature >= SA_FEATURE_COUNT)
+        return;
+
+    pose_cache = &accumulated_pose_cache[feature];
+    acc1 = &voxels1_accumulated[feature];
+    acc2 = &voxels2_accumulated[feature];
+    diff = &voxels_accumulated_diff[feature];
+    max_val = &max_accumulated_val[feature];
+    seg_max = &segment_max[feature];
+
+    if (!m1 || !m2 || !has_cache || m1->num_frames <= 0 || m2->num_frames <= 0)
+        return;
+
+    const Point3f& curr_m1_root_pos = m1->frames[0].root_pos;
+    const Matrix3f& curr_m1_root_ori = m1->frames[0].root_ori;
+    const Point3f& curr_m2_root_pos = m2->frames[0].root_pos;
+    const Matrix3f& curr_m2_root_ori = m2->frames[0].root_ori;
+
+    int range1[2], range2[2];
+    GetAccumulationFrameRange(m1, range1[0], range1[1]);
+    GetAccumulationFrameRange(m2, range2[0], range2[1]);
+
+    if (pose_cache->valid &&
+        pose_cache->frame_range1[0] == range1[0] && pose_cache->frame_range1[1] == range1[1] &&
+        pose_cache->frame_range2[0] == range2[0] && pose_cache->frame_range2[1] == range2[1] &&
+        pose_cache->alignment_revision == frame_alignment_revision &&
+        sa_nearly_equal_point3(pose_cache->motion1_root_pos, curr_m1_root_pos) &&
+        sa_nearly_equal_matrix3(pose_cache->motion1_root_ori, curr_m1_root_ori) &&
+        sa_nearly_equal_point3(pose_cache->motion2_root_pos, curr_m2_root_pos) &&
+        sa_nearly_equal_matrix3(pose_cache->motion2_root_ori, curr_m2_root_ori)) {
+        return;
+    }
+
+    int num_segments = m1->body->num_segments;
+
+    acc1->Resize(grid_resolution); acc2->Resize(grid_resolution); diff->Resize(grid_resolution);
+    acc1->Clear(); acc2->Clear(); diff->Clear();
+
+    if (HasFrameAlignment()) {
+        // 動作1の累積範囲に対応する経路の段ごとに両動作のフレームを累積し、部位ごとのグリッドと全体の累積グリッドを同時に計算
+        int step_begin, step_end, begin1, begin2;
+        std::vector<int> counts1, counts2;
+        frame_alignment.GetStepRange(range1[0], range1[1], step_begin, step_end);
+        frame_alignment.CountFrames(0, step_begin, step_end, begin1, counts1);
+        frame_alignment.CountFrames(1, step_begin, step_end, begin2, counts2);
+
+        if (seg_max->size() != (size_t)num_segments)
+            InitializeSegmentMaxValues(num_segments);
+
+        VoxelGrid seg1_grid;
+        VoxelGrid seg2_grid;
+        seg1_grid.Resize(grid_resolution);
+        seg2_grid.Resize(grid_resolution);
+        for (int s = 0; s < num_segments; ++s) {
+            seg1_grid.Clear();
+            seg2_grid.Clear();
+            sa_compose_aligned_segment_feature_frames_to_grids(
+                m1, c1, s, feature, grid_resolution, world_bounds, begin1, counts1, &seg1_grid, *acc1);
+            sa_compose_aligned_segment_feature_frames_to_grids(
+                m2, c2, s, feature, grid_resolution, world_bounds, begin2, counts2, &seg2_grid, *acc2);
+            (*seg_max)[s] = sa_compute_max_abs_diff_between_grids(seg1_grid, seg2_grid);
+        }
+        *max_val = sa_fill_diff_grid_and_compute_max(*acc1, *acc2, *diff);
+    } else if (has_accumulation_range) {
+        // 区間累積の索引から部位ごとに合成し、部位ごとのグリッドと全体の累積グリッドを同時に計算
+        EnsureFrameRangeIndex(0, feature);
+        EnsureFrameRangeIndex(1, feature);
+        bool uniform1 = sa_has_uniform_root_delta(m1, c1, range1[0], range1[1]);
+        bool uniform2 = sa_has_uniform_root_delta(m2, c2, range2[0], range2[1]);
+
+        if (seg_max->size() != (size_t)num_segments)
+            InitializeSegmentMaxValues(num_segments);
+
+        VoxelGrid seg1_grid;
+        VoxelGrid seg2_grid;
+        seg1_grid.Resize(grid_resolution);
+        seg2_grid.Resize(grid_resolution);
+        for (int s = 0; s < num_segments; ++s) {
+            seg1_grid.Clear();
+            seg2_grid.Clear();
+            if (s < c1.GetNumSegments()) {
+                sa_compose_segment_feature_range_to_grids(
+                    m1, c1, &frame_range_indices[0][feature], uniform1, s, feature, grid_resolution, world_bounds,
+                    range1[0], range1[1], &seg1_grid, *acc1);
+            }
+            if (s < c2.GetNumSegments()) {
+                sa_compose_segment_feature_range_to_grids(
+                    m2, c2, &frame_range_indices[1][feature], uniform2, s, feature, grid_resolution, world_bounds,
+                    range2[0], range2[1], &seg2_grid, *acc2);
+            }
+            (*seg_max)[s] = sa_compute_max_abs_diff_between_grids(seg1_grid, seg2_grid);
+        }
+        *max_val = sa_fill_diff_grid_and_compute_max(*acc1, *acc2, *diff);
+    } else {
+        sa_compose_sparse_feature_frames_to_grids(
+            m1, c1, feature, grid_resolution, world_bounds,
+            0, m1->num_frames - 1, nullptr, *acc1);
+        sa_compose_sparse_feature_frames_to_grids(
+            m2, c2, feature, grid_resolution, world_bounds,
+            0, m2->num_frames - 1, nullptr, *acc2);
+
+        *max_val = sa_fill_diff_grid_and_compute_max(*acc1, *acc2, *diff);
+
+        if (seg_max->size() != (size_t)num_segments)
+            InitializeSegmentMaxValues(num_segments);
+
+        std::vector<int> active_single_segment(1, 0);
+        VoxelGrid seg1_grid;
+        VoxelGrid seg2_grid;
+        seg1_grid.Resize(grid_resolution);
+        seg2_grid.Resize(grid_resolution);
+
+        for (int s = 0; s < num_segments; ++s) {
+            active_single_segment[0] = s;
+            seg1_grid.Clear();
+            seg2_grid.Clear();
+
+            sa_compose_selected_segments_feature_frames_to_grid(
+                m1,
+                c1,
+                feature,
+                grid_resolution,
+                world_bounds,
+                0,
+                m1->num_frames - 1,
+                active_single_segment,
+                seg1_grid);
+
+            sa_compose_selected_segments_feature_frames_to_grid(
+                m2,
+                c2,
+                feature,
+                grid_resolution,
+                world_bounds,
+                0,
+                m2->num_frames - 1,
+                active_single_segment,
+                seg2_grid);
+
+            (*seg_max)[s] = sa_compute_max_abs_diff_between_grids(seg1_grid, seg2_grid);
+        }
+    }
+
+    OnAnalysisDataChanged();
+    pose_cache->motion1_root_pos = curr_m1_root_pos;
+    pose_cache->motion1_root_ori = curr_m1_root_ori;
+    pose_cache->motion2_root_pos = curr_m2_root_pos;
+    pose_cache->motion2_root_ori = curr_m2_root_ori;
+    pose_cache->frame_range1[0] = range1[0];
+    pose_cache->frame_range1[1] = range1[1];
+    pose_cache->frame_range2[0] = range2[0];
+    pose_cache->frame_range2[1] = range2[1];
+    pose_cache->alignment_revision = frame_alignment_revision;
+    pose_cache->valid = true;
+}
+
+// 密なグリッドへの直接の書き込み・主成分分析に使うため、局所グリッドの設定によらずワールド座標系の共通グリッドにボクセル化
+void SpatialAnalysisCore::BuildSegmentSparseBaseValues(Motion* m, float time, std::vector<std::vector<SparseVoxel>>& seg_sparse_values) {
+    VoxelizationSettings settings = GetVoxelizationSettings();
+    settings.segment_bounds.clear();
+    VoxelizationPipeline pipeline(settings);
+    pipeline.BuildFrame(m, time, seg_sparse_values);
+}
+
+void SpatialAnalysisCore::VoxelizeMotionBySegmentGrids(Motion* m, float time,
+                                                   std::vector<VoxelGrid>& seg_presence_grids,
+                                                   std::vector<VoxelGrid>& seg_speed_grids,
+                                                   std::vector<VoxelGrid>& seg_jerk_grids,
+                                                   std::vector<VoxelGrid>& seg_inertia_grids,
+                                                   std::vector<VoxelGrid>& seg_principal_axis_grids) {
+    if (!m) 
+        return;
+
+    int num_segments = m->body->num_segments;
+    auto prepare = [&](std::vector<VoxelGrid>& grids) {
+        if ((int)grids.size() != num_segments)
+            grids.resize(num_segments);
+        for (int s = 0; s < num_segments; ++s) {
+            if (grids[s].resolution != grid_resolution || (int)grids[s].data.size() != grid_resolution * grid_resolution * grid_resolution)
+                grids[s].Resize(grid_resolution);
+            else
+                grids[s].Clear();
+        }
+    };
+
+    prepare(seg_presence_grids);
+    prepare(seg_speed_grids);
+    prepare(seg_jerk_grids);
+    prepare(seg_inertia_grids);
+    prepare(seg_principal_axis_grids);
+
+    std::vector<std::vector<SparseVoxel>> curr_sparse_presence;
+    BuildSegmentSparseVoxels(m, time, curr_sparse_presence);
+
+    for (int s = 0; s < num_segments; ++s) {
+        VoxelGrid& seg_pres_grid = seg_presence_grids[s];
+        VoxelGrid& seg_spd_grid = seg_speed_grids[s];
+        VoxelGrid& seg_jrk_grid = seg_jerk_grids[s];
+        VoxelGrid& seg_pax_grid = seg_principal_axis_grids[s];
+        VoxelGrid& seg_ine_grid = seg_inertia_grids[s];
+        const std::vector<SparseVoxel>& sparse = curr_sparse_presence[s];
+        for (size_t k = 0; k < sparse.size(); ++k) {
+            int i = sparse[k].index;
+            seg_pres_grid.data[i] = sparse[k].values[0];
+            seg_spd_grid.data[i] = sparse[k].values[1];
+            seg_jrk_grid.data[i] = sparse[k].values[2];
+            seg_ine_grid.data[i] = sparse[k].values[3];
+            if (sparse[k].values[4] > seg_pax_grid.data[i])
+                seg_pax_grid.data[i] = sparse[k].values[4];
+        }
+    }
+}
+
+void SpatialAnalysisCore::BuildSegmentSparseVoxels(Motion* m, float time, std::vector<std::vector<SparseVoxel>>& seg_sparse_values) {
+    seg_sparse_values.clear();
+    if (!m || !m->body)
+        return;
+
+    int num_segments = m->body->num_segments;
+    BuildSegmentSparseBaseValues(m, time, seg_sparse_values);
+
+    // ボーンの軸方向を使用する場合は慣性主軸角速度を設定済みのため、前フレームのボクセル化は不要
+    if (principal_axis_mode != PRINCIPAL_AXIS_VOXEL_PCA)
+        return;
+
+    float prev_time = time - m->interval;
+    if (prev_time < 0.0f)
+        prev_time = 0.0f;
+
+    const std::vector<std::vector<SparseVoxel>>* prev_sparse_ptr = nullptr;
+    std::vector<std::vector<SparseVoxel>> prev_sparse_presence;
+
+    PrevPresenceCacheEntry* entry_for_motion = nullptr;
+    PrevPresenceCacheEntry* first_free_entry = nullptr;
+    for (int ci = 0; ci < 2; ++ci) {
+        PrevPresenceCacheEntry& e = prev_presence_cache_entries[ci];
+        if (e.valid && e.motion == m) {
+            entry_for_motion = &e;
+            break;
+        }
+        if (!e.valid && !first_free_entry)
+            first_free_entry = &e;
+    }
+
+    bool can_reuse_prev = false;
+    if (entry_for_motion && entry_for_motion->valid) {
+        float dt_err = fabsf((time - entry_for_motion->time) - m->interval);
+        can_reuse_prev = dt_err <= 1e-4f &&
+                         (int)entry_for_motion->seg_presence_sparse.size() == num_segments;
+    }
+
+    if (can_reuse_prev) {
+        prev_sparse_ptr = &entry_for_motion->seg_presence_sparse;
+    } else {
+        BuildSegmentSparseBaseValues(m, prev_time, prev_sparse_presence);
+        prev_sparse_ptr = &prev_sparse_presence;
+    }
+
+    const float weight_threshold = sparse_threshold;
+    sa_apply_principal_axis_speed_to_sparse_segments(
+        seg_sparse_values,
+        *prev_sparse_ptr,
+        grid_resolution,
+        m->interval,
+        world_bounds,
+        weight_threshold);
+
+    if (!entry_for_motion)
+        entry_for_motion = first_free_entry;
+    if (!entry_for_motion)
+        entry_for_motion = &prev_presence_cache_entries[0];
+
+    entry_for_motion->seg_presence_sparse = seg_sparse_values;
+    entry_for_motion->motion = m;
+    entry_for_motion->time = time;
+    entry_for_motion->valid = true;
+}
+
+// モーション名からキャッシュファイルのベース名を生成
+std::string SpatialAnalysisCore::GenerateCacheFilename(const char* motion1_name, const char* motion2_name) const {
+    std::string filename = "voxel_cache_";
+    filename += motion1_name;
+    filename += "_";
+    filename += motion2_name;
+    filename += ".vxl";
+    return filename;
+}
+
+// 累積ボクセルデータと最大値・対象領域のメタデータを保存
+bool SpatialAnalysisCore::SaveAccumulatedData(const std::string& base) const {
+    TRACE_SCOPE_CAT("Analysis::SaveAccumulatedData", "analysis");
+
+    if (!sa_save_accumulated_feature_grids(base, voxels1_accumulated, voxels2_accumulated, voxels_accumulated_diff)) {
+        std::cout << "Failed to save accumulated voxel cache files for base: " << base << std::endl;
+        return false;
+    }
+    
+    const std::string meta_file = base + "_meta.txt";
+    if (!sa_save_cache_meta_file(meta_file, grid_resolution, max_accumulated_val, world_bounds)) {
+        std::cout << "Failed to save cache metadata: " << meta_file << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// 累積ボクセルデータとメタデータを読み込み（解像度・対象領域も復元）
+bool SpatialAnalysisCore::LoadAccumulatedData(const std::string& base) {
+    TRACE_SCOPE_CAT("Analysis::LoadAccumulatedData", "analysis");
+
+    const std::string meta_file = base + "_meta.txt";
+    
+    int res;
+    int legacy_segment_dense_flag;
+    std::string meta_error;
+    if (!sa_load_cache_meta_file(meta_file, res, max_accumulated_val, world_bounds, legacy_segment_dense_flag, meta_error)) {
+        std::cout << meta_error << std::endl;
+        return false;
+    }
+    
+    ResizeGrids(res);
+    OnAnalysisDataChanged();
+    
+    if (!sa_load_accumulated_feature_grids(base, voxels1_accumulated, voxels2_accumulated, voxels_accumulated_diff)) {
+        std::cout << "Failed to load accumulated voxel cache files for base: " << base << std::endl;
+        return false;
+    }
+
+    if (legacy_segment_dense_flag == 1)
+        std::cout << "Legacy metadata flag detected and ignored (sparse-only runtime path)." << std::endl;
+
+    sa_recompute_feature_max_values_from_diff_grids(voxels_accumulated_diff, max_accumulated_val);
+    return true;
+}
+
+// 累積ボクセルデータをファイルに保存してキャッシュ
+bool SpatialAnalysisCore::SaveVoxelCache(const char* motion1_name, const char* motion2_name) {
+    std::string base = GenerateCacheFilename(motion1_name, motion2_name);
+    
+    std::cout << "Saving voxel cache to " << base << "..." << std::endl;
+
+    if (!SaveAccumulatedData(base))
+        return false;
+
+    // フレームキャッシュは保存できなくても累積ボクセルのキャッシュは有効（読み込み時に再構築される）
+    if (has_frame_cache && !SaveFrameCacheFiles(base))
+        std::cout << "Failed to save frame cache files for base: " << base << std::endl;
+    
+    std::cout << "Voxel cache saved successfully!" << std::endl;
+    return true;
+}
+
+// ファイルからボクセルキャッシュを読み込み
+bool SpatialAnalysisCore::LoadVoxelCache(const char* motion1_name, const char* motion2_name) {
+    std::string base = GenerateCacheFilename(motion1_name, motion2_name);
+    
+    std::cout << "Loading voxel cache from " << base << "..." << std::endl;
+    
+    if (!LoadAccumulatedData(base))
+        return false;
+
+    // フレームキャッシュのファイルがあればマップ（フレームの内容は参照時に読み出される）
+    if (OpenFrameCacheFiles(base))
+        std::cout << "Frame cache files mapped." << std::endl;
+    
+    std::cout << "Voxel cache loaded successfully!" << std::endl;
+    return true;
+}
+
+// フレームキャッシュのみ保存（累積ボクセルのキャッシュは読み込めたがフレームキャッシュのファイルがない場合）
+bool SpatialAnalysisCore::SaveFrameCache(const char* motion1_name, const char* motion2_name) const {
+    if (!has_frame_cache)
+        return false;
+    std::string base = GenerateCacheFilename(motion1_name, motion2_name);
+    if (!SaveFrameCacheFiles(base)) {
+        std::cout << "Failed to save frame cache files for base: " << base << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// フレームキャッシュのファイル名（ボクセルキャッシュのベース名に動作ごとの接尾辞を付ける）
+std::string SpatialAnalysisCore::GenerateFrameCacheFilename(const std::string& base, int motion_no) {
+    return base + ((motion_no == 0) ? "_frames1.fvx" : "_frames2.fvx");
+}
+
+// フレームキャッシュをフレーム単位のファイルに保存（マップしたファイルから読み出している場合は保存済み）
+bool SpatialAnalysisCore::SaveFrameCacheFiles(const std::string& base) const {
+    TRACE_SCOPE_CAT("Analysis::SaveFrameCacheFiles", "analysis");
+
+    for (int i = 0; i < 2; ++i) {
+        std::string path = GenerateFrameCacheFilename(base, i);
+        const MappedFrameVoxelStore* mapped = mapped_frame_caches[i].get();
+        if (mapped && mapped->IsOpen() && mapped->GetPath() == path)
+            continue;
+
+        const MotionFrameSegmentVoxelGridCache& cache = (i == 0) ? frame_cache1 : frame_cache2;
+        if (cache.Empty())
+            return false;
+        MappedFrameVoxelStore store(path);
+        if (!store.WriteCache(cache))
+            return false;
+    }
+    return true;
+}
+
+// フレームキャッシュのファイルをマップし、メモリ上のフレームキャッシュの代わりに使用
+// ヘッダー・オフセット表のみ確認するため、フレーム数によらず一定時間で開ける
+bool SpatialAnalysisCore::OpenFrameCacheFiles(const std::string& base) {
+    TRACE_SCOPE_CAT("Analysis::OpenFrameCacheFiles", "analysis");
+
+    CloseFrameCacheFiles();
+    std::unique_ptr<MappedFrameVoxelStore> stores[2];
+    for (int i = 0; i < 2; ++i) {
+        stores[i].reset(new MappedFrameVoxelStore(GenerateFrameCacheFilename(base, i)));
+        if (!stores[i]->Open() || stores[i]->GetResolution() != grid_resolution || stores[i]->Empty())
+            return false;
+        // 現在と異なる座標系でボクセル化したファイルは使わない
+        bool segment_local = stores[i]->GetSegmentBounds(0) != nullptr;
+        if (segment_local != (voxel_grid_space == VOXEL_GRID_SEGMENT_LOCAL))
+            return false;
+    }
+    if (stores[0]->GetNumSegments() != stores[1]->GetNumSegments())
+        return false;
+
+    ResetLazyFrameCaches();
+    frame_cache1.Clear();
+    frame_cache2.Clear();
+    mapped_frame_caches[0].swap(stores[0]);
+    mapped_frame_caches[1].swap(stores[1]);
+    ClearFrameRangeIndices();
+    prev_presence_cache_entries[0].valid = false;
+    prev_presence_cache_entries[1].valid = false;
+    segment_grid_bounds.clear();
+    if (voxel_grid_space == VOXEL_GRID_SEGMENT_LOCAL) {
+        const MappedFrameVoxelStore& store = *mapped_frame_caches[0];
+        for (int s = 0; s < store.GetNumSegments(); ++s)
+            segment_grid_bounds.push_back(*store.GetSegmentBounds(s));
+    }
+    has_frame_cache = true;
+    OnAnalysisDataChanged();
+    return true;
+}
+
+// マップしたフレームキャッシュのファイルを閉じる
+void SpatialAnalysisCore::CloseFrameCacheFiles() {
+    mapped_frame_caches[0].reset();
+    mapped_frame_caches[1].reset();
+}
+
+// 累積の対象時間範囲を設定（次の合成時に範囲内のフレームで再合成される）
+void SpatialAnalysisCore::SetAccumulationTimeRange(float t0, float t1) {
+    if (t0 > t1)
+        std::swap(t0, t1);
+    has_accumulation_range = true;
+    accumulation_range[0] = t0;
+    accumulation_range[1] = t1;
+}
+
+// 累積の対象時間範囲を解除（全フレームを累積し、区間累積の索引を破棄）
+void SpatialAnalysisCore::ClearAccumulationTimeRange() {
+    has_accumulation_range = false;
+    ClearFrameRangeIndices();
+}
+
+// 累積するフレームの範囲を取得
+void SpatialAnalysisCore::GetAccumulationFrameRange(const Motion* m, int& frame_begin, int& frame_end) const {
+    frame_begin = 0;
+    frame_end = m ? m->num_frames - 1 : -1;
+    if (!m || !has_accumulation_range)
+        return;
+    frame_begin = sa_get_frame_index_from_time(m, accumulation_range[0]);
+    frame_end = sa_get_frame_index_from_time(m, accumulation_range[1]);
+}
+
+// フレームの対応付けを設定（以降の瞬間・累積の比較は対応付けられたフレームどうしで行う）
+void SpatialAnalysisCore::SetFrameAlignment(const FrameAlignmentPath& alignment) {
+    frame_alignment = alignment;
+    ++frame_alignment_revision;
+    OnAnalysisDataChanged();
+}
+
+// フレームの対応付けを解除（同じ時刻のフレームどうしの比較に戻す）
+void SpatialAnalysisCore::ClearFrameAlignment() {
+    if (frame_alignment.Empty())
+        return;
+    frame_alignment.Clear();
+    ++frame_alignment_revision;
+    OnAnalysisDataChanged();
+}
+
+// フレームキャッシュの特徴量の要約から FastDTW でフレームの対応付けを計算して設定
+bool SpatialAnalysisCore::ComputeFrameCacheAlignment(int radius) {
+    if (!has_frame_cache)
+        return false;
+    TRACE_SCOPE_CAT("Analysis::ComputeFrameCacheAlignment", "analysis");
+
+    std::vector<float> summaries1, summaries2;
+    int dims1 = 0, dims2 = 0;
+    ComputeFrameFeatureSummaries(GetFrameCacheView(0), summaries1, dims1);
+    ComputeFrameFeatureSummaries(GetFrameCacheView(1), summaries2, dims2);
+    if (dims1 != dims2 || dims1 <= 0)
+        return false;
+    NormalizeFrameFeatureSummaries(summaries1, summaries2, dims1);
+
+    FrameAlignmentPath alignment;
+    if (!ComputeFastDTWAlignment(summaries1.data(), (int)(summaries1.size() / dims1),
+                                 summaries2.data(), (int)(summaries2.size() / dims2),
+                                 dims1, radius, alignment))
+        return false;
+    SetFrameAlignment(alignment);
+    return true;
+}
+
+// 時刻に比較する2つの動作のフレーム（対応付けがあれば動作1のフレームに対応付けられた動作2のフレーム）
+void SpatialAnalysisCore::GetFramePairAtTime(const Motion* m1, const Motion* m2, float time, int& frame1, int& frame2) const {
+    frame1 = sa_get_frame_index_from_time(m1, time);
+    if (HasFrameAlignment() && m2 && m2->num_frames > 0)
+        frame2 = (std::max)(0, (std::min)(frame_alignment.GetPairedFrame(frame1), m2->num_frames - 1));
+    else
+        frame2 = sa_get_frame_index_from_time(m2, time);
+}
+
+// 区間累積の索引を構築（フレームキャッシュの全フレームを1回読み出す）
+void SpatialAnalysisCore::EnsureFrameRangeIndex(int motion_no, int feature) {
+    if (feature < 0 || feature >= SA_FEATURE_COUNT)
+        return;
+    int i = (motion_no == 0) ? 0 : 1;
+    if (!frame_range_indices[i][feature].Empty())
+        return;
+
+    TRACE_SCOPE_CAT("Analysis::BuildFrameRangeIndex", "analysis");
+    frame_range_indices[i][feature].Build(GetFrameCacheView(i), feature);
+}
+
+// 区間累積の索引を破棄（フレームキャッシュが変わった時）
+void SpatialAnalysisCore::ClearFrameRangeIndices() {
+    for (int i = 0; i < 2; ++i) {
+        for (int f = 0; f < SA_FEATURE_COUNT; ++f)
+            frame_range_indices[i][f].Clear();
+    }
+}
+
+// 区間累積の索引の使用量
+size_t SpatialAnalysisCore::GetFrameRangeIndexMemoryBytes(int motion_no) const {
+    int i = (motion_no == 0) ? 0 : 1;
+    size_t bytes = 0;
+    for (int f = 0; f < SA_FEATURE_COUNT; ++f)
+        bytes += frame_range_indices[i][f].GetMemoryBytes();
+    return bytes;
+}
+
+// 部位ごとの最大値配列を初期化
+void SpatialAnalysisCore::InitializeSegmentMaxValues(int num_segments) {
+    for (int f = 0; f < SA_FEATURE_COUNT; ++f)
+        segment_max[f].assign(num_segments, 1.0f);
+}
+
+// 瞬間ボクセルグリッドを取得
+const VoxelGrid& SpatialAnalysisCore::GetInstantGrid(int motion_no, int feature) const {
+    if (feature < 0 || feature >= SA_FEATURE_COUNT)
+        feature = 0;
+    return (motion_no == 0) ? voxels1[feature] : voxels2[feature];
+}
+
+// 瞬間ボクセルの差分グリッドを取得
+const VoxelGrid& SpatialAnalysisCore::GetInstantDiffGrid(int feature) const {
+    if (feature < 0 || feature >= SA_FEATURE_COUNT)
+        feature = 0;
+    return voxels_diff[feature];
+}
+
+// 瞬間ボクセルの差分の最大値を取得
+float SpatialAnalysisCore::GetInstantMaxValue(int feature) const {
+    if (feature < 0 || feature >= SA_FEATURE_COUNT)
+        return 1.0f;
+    return max_val[feature];
+}
+
+// 累積ボクセルグリッドを取得
+const VoxelGrid& SpatialAnalysisCore::GetAccumulatedGrid(int motion_no, int feature) const {
+    if (feature < 0 || feature >= SA_FEATURE_COUNT)
+        feature = 0;
+    return (motion_no == 0) ? voxels1_accumulated[feature] : voxels2_accumulated[feature];
+}
+
+// 累積ボクセルの差分グリッドを取得
+const VoxelGrid& SpatialAnalysisCore::GetAccumulatedDiffGrid(int feature) const {
+    if (feature < 0 || feature >= SA_FEATURE_COUNT)
+        feature = 0;
+    return voxels_accumulated_diff[feature];
+}
+
+// 累積ボクセルの差分の最大値を取得
+float SpatialAnalysisCore::GetAccumulatedMaxValue(int feature) const {
+    if (feature < 0 || feature >= SA_FEATURE_COUNT)
+        return 1.0f;
+    return max_accumulated_val[feature];
+}
+
+// 部位ごとの累積差分の最大値を取得
+const std::vector<float>& SpatialAnalysisCore::GetSegmentMaxValues(int feature) const {
+    if (feature < 0 || feature >= SA_FEATURE_COUNT)
+        feature = 0;
+    return segment_max[feature];
+}
+
+// 別のインスタンスの計算結果を取り込む
+void SpatialAnalysisCore::SwapAnalysisResults(SpatialAnalysisCore& other) {
+    // 遅延フレームキャッシュは取り込む前のワールド境界で計算されているため破棄
+    ResetLazyFrameCaches();
+    if (other.grid_resolution != grid_resolution)
+        ResizeGrids(other.grid_resolution);
+
+    for (int i = 0; i < 3; ++i) {
+        world_bounds[i][0] = other.world_bounds[i][0];
+        world_bounds[i][1] = other.world_bounds[i][1];
+    }
+
+    frame_cache1.Swap(other.frame_cache1);
+    frame_cache2.Swap(other.frame_cache2);
+    mapped_frame_caches[0].swap(other.mapped_frame_caches[0]);
+    mapped_frame_caches[1].swap(other.mapped_frame_caches[1]);
+    std::swap(has_frame_cache, other.has_frame_cache);
+    ClearFrameRangeIndices();
+    sparse_threshold = other.sparse_threshold;
+    voxel_accumulator = other.voxel_accumulator;
+    principal_axis_mode = other.principal_axis_mode;
+    voxel_grid_space = other.voxel_grid_space;
+    segment_grid_voxel_size = other.segment_grid_voxel_size;
+    segment_grid_bounds.swap(other.segment_grid_bounds);
+
+    // 合成済みの特徴量のみ累積結果を入れ替え
+    for (int f = 0; f < SA_FEATURE_COUNT; ++f) {
+        if (!other.accumulated_pose_cache[f].valid) {
+            accumulated_pose_cache[f].valid = false;
+            continue;
+        }
+        std::swap(voxels1_accumulated[f], other.voxels1_accumulated[f]);
+        std::swap(voxels2_accumulated[f], other.voxels2_accumulated[f]);
+        std::swap(voxels_accumulated_diff[f], other.voxels_accumulated_diff[f]);
+        std::swap(max_accumulated_val[f], other.max_accumulated_val[f]);
+        segment_max[f].swap(other.segment_max[f]);
+        accumulated_pose_cache[f] = other.accumulated_pose_cache[f];
+        // 累積時と同じフレームの対応付けであれば、この解析の対応付けの版で有効とする
+        if (frame_alignment == other.frame_alignment)
+            accumulated_pose_cache[f].alignment_revision = frame_alignment_revision;
+        else
+            accumulated_pose_cache[f].valid = false;
+    }
+
+    prev_presence_cache_entries[0].valid = false;
+    prev_presence_cache_entries[1].valid = false;
+    OnAnalysisDataChanged();
+}
+
+// 計算途中の累積ボクセルを表示用に設定
+void SpatialAnalysisCore::SetAccumulatedPreview(int feature, VoxelGrid& grid1, VoxelGrid& grid2, VoxelGrid& diff, float max_value) {
+    if (feature < 0 || feature >= SA_FEATURE_COUNT)
+        return;
+
+    std::swap(voxels1_accumulated[feature], grid1);
+    std::swap(voxels2_accumulated[feature], grid2);
+    std::swap(voxels_accumulated_diff[feature], diff);
+    max_accumulated_val[feature] = max_value;
+    accumulated_pose_cache[feature].valid = false;
+    OnAnalysisDataChanged();
+}
+
+// フレームキャッシュの指定範囲のフレームの特徴量を累積グリッドに加算
+void SpatialAnalysisCore::AccumulateFrameCacheRange(const Motion* m, int motion_no, int feature, int frame_begin, int frame_end, VoxelGrid& out) const {
+    if (feature < 0 || feature >= SA_FEATURE_COUNT)
+        return;
+    if (out.resolution != grid_resolution)
+        out.Resize(grid_resolution);
+
+    FrameVoxelCacheView cache = GetFrameCacheView(motion_no);
+    sa_compose_sparse_feature_frames_to_grids(
+        m, cache, feature, grid_resolution, world_bounds,
+        frame_begin, frame_end, nullptr, out);
+}
+
+// 解析中の動作のフレームキャッシュから全フレームの累積グリッドを合成
+bool SpatialAnalysisCore::ComposeMotionAccumulatedGrid(const Motion* m, int motion_no, int feature, VoxelGrid& out) const {
+    if (!m || !has_frame_cache || feature < 0 || feature >= SA_FEATURE_COUNT || m->num_frames <= 0)
+        return false;
+    if (out.resolution != grid_resolution)
+        out.Resize(grid_resolution);
+    out.Clear();
+    AccumulateFrameCacheRange(m, motion_no, feature, 0, m->num_frames - 1, out);
+    return true;
+}
+
+// 任意の動作の全特徴量の累積グリッドを一時的なフレームキャッシュから合成
+bool SpatialAnalysisCore::ComposeTakeAccumulatedGrids(Motion* m, VoxelGrid out[SA_FEATURE_COUNT]) {
+    TRACE_SCOPE_CAT("Analysis::ComposeTakeAccumulatedGrids", "analysis");
+
+    if (!m || !m->body || m->num_frames <= 0)
+        return false;
+    MotionFrameSegmentVoxelGridCache cache;
+    MemoryFrameVoxelStore store(cache);
+    if (!BuildMotionFrameStore(m, store) || cache.Empty())
+        return false;
+
+    FrameVoxelCacheView view(cache);
+    for (int f = 0; f < SA_FEATURE_COUNT; ++f) {
+        if (out[f].resolution != grid_resolution)
+            out[f].Resize(grid_resolution);
+        out[f].Clear();
+        sa_compose_sparse_feature_frames_to_grids(
+            m, view, f, grid_resolution, world_bounds,
+            0, m->num_frames - 1, nullptr, out[f]);
+    }
+    return true;
+}
+
+// 2つのグリッドの差分グリッドを計算し、差分の最大値を返す
+float SpatialAnalysisCore::ComputeDiffGrid(const VoxelGrid& a, const VoxelGrid& b, VoxelGrid& out_diff) {
+    if (out_diff.resolution != a.resolution)
+        out_diff.Resize(a.resolution);
+    return sa_fill_diff_grid_and_compute_max(a, b, out_diff);
+}
+
+// 選択部位のみを集約した瞬間ボクセルを計算
+bool SpatialAnalysisCore::ComposeSelectedSegmentsInstant(const Motion* m1, const Motion* m2, int feature, float current_time,
+                                                         const std::vector<bool>& selected_segments, int selected_segment_index,
+                                                         VoxelGrid& out1, VoxelGrid& out2, VoxelGrid& out_diff, float& out_max) const {
+    TRACE_SCOPE_CAT("Analysis::ComposeSelectedSegmentsInstant", "analysis");
+
+    int f1, f2;
+    GetFramePairAtTime(m1, m2, current_time, f1, f2);
+    return sa_compose_selected_segments_instant_from_frame_cache(
+        m1,
+        m2,
+        GetFrameCacheView(0),
+        GetFrameCacheView(1),
+        feature,
+        grid_resolution,
+        world_bounds,
+        f1,
+        f2,
+        selected_segments,
+        selected_segment_index,
+        out1,
+        out2,
+        out_diff,
+        out_max);
+}
+
+// 選択部位のみを集約した累積ボクセルを計算
+bool SpatialAnalysisCore::ComposeSelectedSegmentsAccumulated(const Motion* m1, const Motion* m2, int feature,
+                                                             const std::vector<bool>& selected_segments, int selected_segment_index,
+                                                             VoxelGrid& out1, VoxelGrid& out2, VoxelGrid& out_diff, float& out_max) const {
+    TRACE_SCOPE_CAT("Analysis::ComposeSelectedSegmentsAccumulated", "analysis");
+
+    // 累積の対象時間範囲があれば、構築済みの区間累積の索引を使用
+    int range1[2], range2[2];
+    GetAccumulationFrameRange(m1, range1[0], range1[1]);
+    GetAccumulationFrameRange(m2, range2[0], range2[1]);
+    const FrameRangeIndex* range_index1 = nullptr;
+    const FrameRangeIndex* range_index2 = nullptr;
+    if (has_accumulation_range && feature >= 0 && feature < SA_FEATURE_COUNT) {
+        if (!frame_range_indices[0][feature].Empty())
+            range_index1 = &frame_range_indices[0][feature];
+        if (!frame_range_indices[1][feature].Empty())
+            range_index2 = &frame_range_indices[1][feature];
+    }
+
+    return sa_compose_selected_segments_accumulated_from_frame_cache(
+        m1,
+        m2,
+        GetFrameCacheView(0),
+        GetFrameCacheView(1),
+        feature,
+        grid_resolution,
+        world_bounds,
+        range1,
+        range2,
+        range_index1,
+        range_index2,
+        HasFrameAlignment() ? &frame_alignment : nullptr,
+        selected_segments,
+        selected_segment_index,
+        out1,
+        out2,
+        out_diff,
+        out_max);
+}
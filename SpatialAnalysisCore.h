@@ -0,0 +1,316 @@
+﻿#pragma once
+#include <vector>
+#include <cmath>
+#include <string>
+#include <memory>
+#include <Point3.h>
+#include "SimpleHuman.h"
+#include "VoxelData.h"
+#include "VoxelizationPipeline.h"
+#include "FrameVoxelStore.h"
+#include "LazyFrameCache.h"
+#include "FrameRangeIndex.h"
+#include "FrameAlignment.h"
+
+// 空間解析の計算部（ボクセル化・フレームキャッシュ・累積・差分・最大値）
+// OpenGL / GLUT に依存しないため、ウィンドウを持たないコマンドラインツールからも使用できる
+
+static const int SA_FEATURE_COUNT = 5;
+
+// 解析処理の段階（進捗の通知用）
+enum SpatialAnalysisStage {
+    SA_STAGE_FRAME_CACHE1 = 0, // 動作1のフレームキャッシュの構築
+    SA_STAGE_FRAME_CACHE2 = 1, // 動作2のフレームキャッシュの構築
+    SA_STAGE_ACCUMULATE = 2    // 累積ボクセルの合成
+};
+
+// 特徴量の名前を取得（0:occupancy, 1:speed, 2:jerk, 3:inertia, 4:principal_axis）
+const char* GetSpatialFeatureName(int feature);
+
+// フレームキャッシュのボクセル化の座標系
+enum VoxelGridSpace {
+    VOXEL_GRID_WORLD = 0,         // 全部位をワールド座標系の共通グリッド（world_bounds）にボクセル化
+    VOXEL_GRID_SEGMENT_LOCAL = 1, // 部位ごとに動く範囲のみを覆うルート相対の局所グリッドにボクセル化し、合成時にワールドグリッドに配置
+    VOXEL_GRID_SPACE_COUNT = 2
+};
+
+// ボクセル化の座標系の名前を取得（world, segment_local）
+const char* GetVoxelGridSpaceName(int space);
+
+// 動作の初期位置をXZ平面の原点に揃える（Y座標はそのまま維持）
+void AlignMotionInitialPosition(Motion* m);
+
+// 動作の初期向きを+Z軸方向に揃える
+void AlignMotionInitialOrientation(Motion* m);
+
+// 2つの動作の全フレームの腰の位置の範囲に余白を加えて、解析対象領域を計算
+void ComputeMotionPairWorldBounds(const Motion* m1, const Motion* m2, float margin, float bounds[3][2]);
+
+class SpatialAnalysisCore {
+public:
+
+	int grid_resolution; // ボクセルグリッド解像度
+
+    float world_bounds[3][2];//ワールド座標系の表示・ボクセル化対象領域を表す3軸分の最小値/最大値
+
+protected:
+
+	// 瞬間表示用のボクセルデータ（必要に応じて追加）
+	VoxelGrid voxels1[SA_FEATURE_COUNT], voxels2[SA_FEATURE_COUNT], voxels_diff[SA_FEATURE_COUNT]; // 0:占有率, 1:速度, 2:ジャーク, 3:慣性モーメント, 4:慣性主軸角速度
+
+	// 累積ボクセルデータ（必要に応じて追加）
+	VoxelGrid voxels1_accumulated[SA_FEATURE_COUNT], voxels2_accumulated[SA_FEATURE_COUNT], voxels_accumulated_diff[SA_FEATURE_COUNT]; // 0:占有率, 1:速度, 2:ジャーク, 3:慣性モーメント, 4:慣性主軸角速度
+
+    // フレーム単位の疎ボクセルキャッシュ
+    MotionFrameSegmentVoxelGridCache frame_cache1;
+    MotionFrameSegmentVoxelGridCache frame_cache2;
+    std::unique_ptr<MappedFrameVoxelStore> mapped_frame_caches[2]; // ボクセルキャッシュのファイルから読み込んだ（マップした）フレームキャッシュ
+    bool has_frame_cache;
+    float sparse_threshold;
+    VoxelAccumulatorType voxel_accumulator; // ボクセル化の集約方法
+    PrincipalAxisMode principal_axis_mode;  // 慣性主軸角速度の計算方法
+    VoxelGridSpace voxel_grid_space;        // フレームキャッシュのボクセル化の座標系
+    std::vector<SegmentGridBounds> segment_grid_bounds; // 部位ごとの局所グリッドの範囲（VOXEL_GRID_SEGMENT_LOCAL のみ、解析する動作の組から計算）
+    float segment_grid_voxel_size;          // 部位ごとの局所グリッドのボクセルの1辺の下限
+
+    // 全フレームのキャッシュがない間の瞬間表示に使う遅延フレームキャッシュ（動作ごと）
+    LazyFrameCache lazy_frame_caches[2];
+    bool use_lazy_frame_cache;
+    int playback_direction; // 先読みする方向（+1 / -1）
+
+    // 累積の対象時間範囲（未設定なら全フレーム）
+    bool has_accumulation_range;
+    float accumulation_range[2]; // 開始・終了時刻
+
+    // 2つの動作のフレームの対応付け（空なら同じ時刻のフレームを比較）と、変更ごとに増やす番号（累積の再合成の判定用）
+    FrameAlignmentPath frame_alignment;
+    unsigned int frame_alignment_revision;
+
+    // 区間累積の索引（動作・特徴量ごと、累積の対象時間範囲を設定した特徴量のみ構築）
+    FrameRangeIndex frame_range_indices[2][SA_FEATURE_COUNT];
+
+    // 再合成済みキャッシュの姿勢スナップショット
+    struct AccumulatedPoseCache {
+        bool valid;
+        Point3f motion1_root_pos;
+        Matrix3f motion1_root_ori;
+        Point3f motion2_root_pos;
+        Matrix3f motion2_root_ori;
+        int frame_range1[2]; // 累積したフレームの範囲
+        int frame_range2[2];
+        unsigned int alignment_revision; // 累積したときのフレームの対応付けの番号
+
+        AccumulatedPoseCache() : valid(false), alignment_revision(0) {
+            frame_range1[0] = frame_range1[1] = 0;
+            frame_range2[0] = frame_range2[1] = 0;
+            motion1_root_pos.set(0, 0, 0);
+            motion2_root_pos.set(0, 0, 0);
+            motion1_root_ori.setIdentity();
+            motion2_root_ori.setIdentity();
+        }
+    };
+
+	AccumulatedPoseCache accumulated_pose_cache[SA_FEATURE_COUNT]; // 0:占有率, 1:速度, 2:ジャーク, 3:慣性モーメント, 4:慣性主軸角速度
+
+	// 瞬間表示用の最大値（必要に応じて追加）
+	float max_val[SA_FEATURE_COUNT]; // 0:占有率, 1:速度, 2:ジャーク, 3:慣性モーメント, 4:慣性主軸角速度
+
+	// 累積用の最大値（必要に応じて追加）
+	float max_accumulated_val[SA_FEATURE_COUNT]; // 0:占有率, 1:速度, 2:ジャーク, 3:慣性モーメント, 4:慣性主軸角速度
+
+	// 部位ごとの正規化用最大値（必要に応じて追加）
+	std::vector<float> segment_max[SA_FEATURE_COUNT]; // 0:占有率, 1:速度, 2:ジャーク, 3:慣性モーメント, 4:慣性主軸角速度
+
+public:
+    SpatialAnalysisCore();
+    virtual ~SpatialAnalysisCore();
+
+    virtual void ResizeGrids(int res);
+    virtual void SetWorldBounds(float bounds[3][2]);
+
+    // 指定時刻の両モーションの指定特徴量のボクセルを計算し、差分と最大値を更新
+    void ComputeInstantFeature(Motion* m1, Motion* m2, float current_time, int feature);
+
+    // 総合累積ボクセル計算（全体＋部位ごとを同時に計算）
+    virtual void AccumulateAllFrames(Motion* m1, Motion* m2);
+    void ClearAccumulatedData();
+    void BuildAllFeatureFrameCaches(Motion* m1, Motion* m2);
+    void ComposeAccumulatedFeatureFromFrameCache(Motion* m1, Motion* m2, int feature);
+
+    // 1フレーム分の部位ごとの疎ボクセル（占有率・速度・ジャーク・慣性モーメント）を計算
+    void BuildSegmentSparseBaseValues(Motion* m, float time, std::vector<std::vector<SparseVoxel>>& seg_sparse_values);
+
+    // ボクセル化の集約方法（計算結果はいずれも同じ、フレームキャッシュの構築速度・メモリ使用量のみ異なる）
+    // （変更すると先読み中の遅延フレームキャッシュを破棄する）
+    void SetVoxelAccumulator(VoxelAccumulatorType type);
+    VoxelAccumulatorType GetVoxelAccumulator() const { return voxel_accumulator; }
+
+    // 累積の対象時間範囲（[t0, t1] 秒、各動作のフレーム番号に変換して累積する）
+    // 設定中は区間累積の索引（累積和・疎テーブル）を特徴量ごとに必要になった時点で構築し、範囲の長さによらずボクセル数に比例した時間で合成する
+    void SetAccumulationTimeRange(float t0, float t1);
+    void ClearAccumulationTimeRange();
+    bool HasAccumulationTimeRange() const { return has_accumulation_range; }
+    float GetAccumulationRangeBegin() const { return accumulation_range[0]; }
+    float GetAccumulationRangeEnd() const { return accumulation_range[1]; }
+
+    // 2つの動作のフレームの対応付け（DTW の経路）
+    // 設定中は、瞬間表示は動作1の現在時刻のフレームとそれに対応付けられた動作2のフレームを比較し、
+    // 累積表示は動作1の累積範囲に対応する経路の段ごとに両動作のフレームを累積する（占有率は対応付けられた回数で重み付け）
+    void SetFrameAlignment(const FrameAlignmentPath& path);
+    void ClearFrameAlignment();
+    bool HasFrameAlignment() const { return !frame_alignment.Empty(); }
+    const FrameAlignmentPath& GetFrameAlignment() const { return frame_alignment; }
+
+    // フレームキャッシュのフレームごとの特徴量の要約から FastDTW で対応付けを計算して設定（フレームキャッシュがなければ false）
+    bool ComputeFrameCacheAlignment(int radius = 10);
+
+    // 時刻に対応する両動作のフレーム番号（対応付けの設定中は、動作2のフレームは動作1のフレームに対応付けられたフレーム）
+    void GetFramePairAtTime(const Motion* m1, const Motion* m2, float time, int& frame1, int& frame2) const;
+
+    // 区間累積の索引の使用量（動作ごと、構築済みの全特徴量の合計）
+    size_t GetFrameRangeIndexMemoryBytes(int motion_no) const;
+
+    // 慣性主軸角速度の計算方法（ボーンの軸方向が既定、ボクセルの主成分分析は検証用、変更するとフレームキャッシュを破棄する）
+    void SetPrincipalAxisMode(PrincipalAxisMode mode);
+    PrincipalAxisMode GetPrincipalAxisMode() const { return principal_axis_mode; }
+
+    // フレームキャッシュのボクセル化の座標系（変更するとフレームキャッシュを破棄する）
+    // 部位ごとの局所グリッドでは、同じ解像度でも部位の動く範囲を分割した細かいボクセルで保持し、合成時のワールドグリッドの解像度によらない精度で特徴量を計算する
+    // 占有率はワールドグリッドとのボクセルの体積比で換算して合成するため、いずれの座標系でも同程度の値になる
+    void SetVoxelGridSpace(VoxelGridSpace space);
+    VoxelGridSpace GetVoxelGridSpace() const { return voxel_grid_space; }
+
+    // 部位ごとの局所グリッドのボクセルの1辺の下限（メートル、既定 0.02）
+    // 動く範囲の狭い部位もこの大きさより細かく分割しないため、疎ボクセルの数・フレームキャッシュの使用量を抑えられる
+    void SetSegmentGridVoxelSize(float size);
+    float GetSegmentGridVoxelSize() const { return segment_grid_voxel_size; }
+
+    // 部位ごとの局所グリッドの範囲を2つの動作から計算（VOXEL_GRID_SEGMENT_LOCAL のみ、計算済みなら何もしない）
+    // フレームキャッシュの構築時に呼ばれ、ワールド境界を設定すると（動作の変更時）再計算が必要な状態になる
+    void PrepareSegmentGridBounds(Motion* m1, Motion* m2);
+    const std::vector<SegmentGridBounds>& GetSegmentGridBounds() const { return segment_grid_bounds; }
+
+    // 現在の解像度・ワールド境界・閾値・集約方法・慣性主軸角速度の計算方法・部位ごとの局所グリッドの範囲によるボクセル化の設定
+    VoxelizationSettings GetVoxelizationSettings() const;
+
+    // 動作の全フレームの疎ボクセル（慣性主軸角速度を含む全特徴量）を計算して保存先に追加
+    // stage に解析処理の段階を指定すると進捗を通知し、中断された場合は保存先を破棄して false を返す
+    bool BuildMotionFrameStore(Motion* m, FrameVoxelStore& store, int stage = -1);
+
+    // 全フレームの累積グリッド（集団の統計モデルの1試行分の入力）
+    // 解析中の動作（motion_no は 0 または 1）のフレームキャッシュから、指定特徴量の累積グリッドを合成
+    bool ComposeMotionAccumulatedGrid(const Motion* m, int motion_no, int feature, VoxelGrid& out) const;
+    // 任意の動作の疎ボクセルを一時的なフレームキャッシュに計算して全特徴量の累積グリッドを合成（解析中の動作の計算結果は変更しない）
+    bool ComposeTakeAccumulatedGrids(Motion* m, VoxelGrid out[SA_FEATURE_COUNT]);
+
+    // 累積ボクセルデータの保存・読み込み（base に特徴量ごとの接尾辞を付けたファイルを使用）
+    bool SaveAccumulatedData(const std::string& base) const;
+    bool LoadAccumulatedData(const std::string& base);
+
+    // ボクセルキャッシュ（ファイル保存・読み込み）
+    // 累積ボクセルとともにフレームキャッシュもフレーム単位のファイルに保存し、読み込み時はファイルをマップするのみで開く
+    bool SaveVoxelCache(const char* motion1_name, const char* motion2_name);
+    bool LoadVoxelCache(const char* motion1_name, const char* motion2_name);
+    bool SaveFrameCache(const char* motion1_name, const char* motion2_name) const;
+    std::string GenerateCacheFilename(const char* motion1_name, const char* motion2_name) const;
+    static std::string GenerateFrameCacheFilename(const std::string& base, int motion_no);
+
+    // 部位ごとの最大値配列の初期化
+    void InitializeSegmentMaxValues(int num_segments);
+
+    // 計算結果の取得（motion_no は 0 または 1）
+    bool HasFrameCache() const { return has_frame_cache; }
+    bool HasMappedFrameCache() const { return mapped_frame_caches[0] && mapped_frame_caches[1]; }
+    FrameVoxelCacheView GetFrameCacheView(int motion_no) const;
+    FrameCacheMemoryInfo GetFrameCacheMemoryInfo(int motion_no) const;
+    const VoxelGrid& GetInstantGrid(int motion_no, int feature) const;
+    const VoxelGrid& GetInstantDiffGrid(int feature) const;
+    float GetInstantMaxValue(int feature) const;
+    const VoxelGrid& GetAccumulatedGrid(int motion_no, int feature) const;
+    const VoxelGrid& GetAccumulatedDiffGrid(int feature) const;
+    float GetAccumulatedMaxValue(int feature) const;
+    const std::vector<float>& GetSegmentMaxValues(int feature) const;
+
+    // 遅延フレームキャッシュの設定（使用量の上限は動作ごと、先読みは再生方向の先のフレーム数）
+    void SetLazyFrameCacheEnabled(bool enable);
+    void SetLazyFrameCacheMemoryLimit(size_t bytes);
+    void SetLazyFramePrefetch(int frames);
+    void SetPlaybackDirection(int direction) { playback_direction = (direction < 0) ? -1 : 1; }
+    const LazyFrameCache& GetLazyFrameCache(int motion_no) const;
+
+    // 遅延フレームキャッシュを破棄（先読みの完了を待つため、動作を削除・変更する前に呼び出す）
+    void ResetLazyFrameCaches();
+
+    // 別のインスタンス（ワーカースレッドでの計算用）の計算結果を取り込む
+    // フレームキャッシュ・ワールド境界と、合成済みの特徴量の累積ボクセル・最大値を入れ替え、未合成の特徴量は再合成が必要な状態にする
+    void SwapAnalysisResults(SpatialAnalysisCore& other);
+
+    // 計算途中の累積ボクセルを表示用に設定（引数のグリッドと入れ替え、完了後の再合成が必要な状態にする）
+    void SetAccumulatedPreview(int feature, VoxelGrid& grid1, VoxelGrid& grid2, VoxelGrid& diff, float max_value);
+
+protected:
+    // 計算結果が更新されたときに呼ばれる（表示側のキャッシュの無効化用）
+    virtual void OnAnalysisDataChanged() {}
+
+    // 解析処理の進捗の通知（フレームキャッシュの1フレーム・累積の1特徴量ごとに呼ばれ、false を返すと処理を中断する）
+    virtual bool OnAnalysisProgress(int /*stage*/, int /*done*/, int /*total*/) { return true; }
+
+    // フレームキャッシュの指定範囲のフレームの特徴量を累積グリッドに加算（motion_no は 0 または 1）
+    void AccumulateFrameCacheRange(const Motion* m, int motion_no, int feature, int frame_begin, int frame_end, VoxelGrid& out) const;
+
+    // 1フレーム分の部位ごとの疎ボクセルを計算してフレームキャッシュの要素を作成（prev_entry は前フレームの要素、なければ nullptr）
+    void BuildFrameCacheEntry(Motion* m, int frame, const FrameSegmentVoxelGrid* prev_entry, FrameSegmentVoxelGrid& out);
+
+    // フレームキャッシュの要素に前フレームの占有率から慣性主軸角速度を設定（prev_entry がなければ前フレームをこの場で計算）
+    void ApplyFrameCachePrincipalAxisSpeed(Motion* m, int frame, const FrameSegmentVoxelGrid* prev_entry, FrameSegmentVoxelGrid& out);
+
+    // 2つのグリッドの差分グリッドを計算し、差分の最大値を返す
+    static float ComputeDiffGrid(const VoxelGrid& a, const VoxelGrid& b, VoxelGrid& out_diff);
+
+    // 選択部位のみを集約した瞬間・累積ボクセルの計算
+    bool ComposeSelectedSegmentsInstant(const Motion* m1, const Motion* m2, int feature, float current_time,
+                                        const std::vector<bool>& selected_segments, int selected_segment_index,
+                                        VoxelGrid& out1, VoxelGrid& out2, VoxelGrid& out_diff, float& out_max) const;
+    bool ComposeSelectedSegmentsAccumulated(const Motion* m1, const Motion* m2, int feature,
+                                            const std::vector<bool>& selected_segments, int selected_segment_index,
+                                            VoxelGrid& out1, VoxelGrid& out2, VoxelGrid& out_diff, float& out_max) const;
+
+private:
+    struct PrevPresenceCacheEntry {
+        const Motion* motion;
+        float time;
+        std::vector<std::vector<SparseVoxel>> seg_presence_sparse;
+        bool valid;
+
+        PrevPresenceCacheEntry() : motion(nullptr), time(0.0f), valid(false) {}
+    };
+
+    PrevPresenceCacheEntry prev_presence_cache_entries[2];
+
+    // フレームキャッシュのファイルの保存・マップ・マップの解除
+    bool SaveFrameCacheFiles(const std::string& base) const;
+    bool OpenFrameCacheFiles(const std::string& base);
+    void CloseFrameCacheFiles();
+
+    // 累積するフレームの範囲を取得（累積の対象時間範囲がなければ全フレーム）
+    void GetAccumulationFrameRange(const Motion* m, int& frame_begin, int& frame_end) const;
+
+    // ボクセル化の設定の変更時にフレームキャッシュ・部位ごとの局所グリッドの範囲・合成済みの累積結果を破棄
+    void DiscardFrameCaches();
+
+    // 区間累積の索引を構築（構築済みなら何もしない）・破棄
+    void EnsureFrameRangeIndex(int motion_no, int feature);
+    void ClearFrameRangeIndices();
+
+    void VoxelizeMotion(Motion* m, float time, VoxelGrid& occ, VoxelGrid& spd, VoxelGrid& jrk, VoxelGrid& ine, VoxelGrid& pax);
+    void VoxelizeMotionBySegmentGrids(Motion* m, float time,
+                                      std::vector<VoxelGrid>& seg_presence_grids,
+                                      std::vector<VoxelGrid>& seg_speed_grids,
+                                      std::vector<VoxelGrid>& seg_jerk_grids,
+                                      std::vector<VoxelGrid>& seg_inertia_grids,
+                                      std::vector<VoxelGrid>& seg_principal_axis_grids);
+    void BuildSegmentSparseVoxels(Motion* m, float time, std::vector<std::vector<SparseVoxel>>& seg_sparse_values);
+    void BuildSingleMotionFeatureFrameCache(Motion* m, MotionFrameSegmentVoxelGridCache& cache);
+    bool ComposeInstantFeatureFromFrameCache(Motion* m1, Motion* m2, int feature, float current_time);
+    bool ComposeInstantFeatureFromLazyCache(Motion* m1, Motion* m2, int feature, float current_time);
+};
@@ -0,0 +1,124 @@
+﻿#include "SpatialAnalysisJob.h"
+#include "Trace.h"
+#include <iostream>
+
+SpatialAnalysisJob::SpatialAnalysisJob(const Motion* m1, const Motion* m2, const SpatialAnalysisJobParams& p)
+    : motion1(*m1), motion2(*m2), params(p), running_job(nullptr), current_stage(SA_STAGE_FRAME_CACHE1), completed(false) {
+    // Motion のコピーコンストラクタは名前をコピーしないため個別に設定
+    motion1.name = m1->name;
+    motion2.name = m2->name;
+
+    if (params.grid_resolution != grid_resolution)
+        ResizeGrids(params.grid_resolution);
+    SetVoxelGridSpace(params.grid_space);
+    SetWorldBounds(params.world_bounds);
+
+    partial_frames[0] = 0;
+    partial_frames[1] = 0;
+}
+
+SpatialAnalysisJob::~SpatialAnalysisJob() {}
+
+// ワーカースレッドで実行する処理
+void SpatialAnalysisJob::Run(Job& job) {
+    TRACE_SCOPE_CAT("AnalysisJob::Run", "analysis");
+
+    running_job = &job;
+    for (int i = 0; i < 2; ++i) {
+        partial_grids[i].Resize(grid_resolution);
+        partial_frames[i] = 0;
+    }
+
+    if (params.accumulate_all) {
+        // 全特徴量の累積ボクセルを計算し、ファイルキャッシュに保存
+        AccumulateAllFrames(&motion1, &motion2);
+        if (job.IsCancelled() || !has_frame_cache)
+            return;
+        if (!params.cache_motion1_name.empty() && !params.cache_motion2_name.empty())
+            SaveVoxelCache(params.cache_motion1_name.c_str(), params.cache_motion2_name.c_str());
+    } else {
+        // フレームキャッシュを構築し、表示中の特徴量のみ累積ボクセルを合成
+        BuildAllFeatureFrameCaches(&motion1, &motion2);
+        if (job.IsCancelled() || !has_frame_cache)
+            return;
+        if (!params.cache_motion1_name.empty() && !params.cache_motion2_name.empty())
+            SaveFrameCache(params.cache_motion1_name.c_str(), params.cache_motion2_name.c_str());
+        if (params.preview_feature >= 0) {
+            OnAnalysisProgress(SA_STAGE_ACCUMULATE, 0, 1);
+            if (motion1.body)
+                InitializeSegmentMaxValues(motion1.body->num_segments);
+            ComposeAccumulatedFeatureFromFrameCache(&motion1, &motion2, params.preview_feature);
+        }
+    }
+
+    if (job.IsCancelled())
+        return;
+    job.SetProgress(1.0f);
+    completed.store(true);
+}
+
+// 進捗の通知を受け、進捗の更新・中断の確認・途中経過の公開を行う
+bool SpatialAnalysisJob::OnAnalysisProgress(int stage, int done, int total) {
+    if (!running_job)
+        return true;
+
+    current_stage.store(stage);
+    int num_stages = (params.accumulate_all || params.preview_feature >= 0) ? 3 : 2;
+    float stage_progress = (total > 0) ? (float)done / total : 1.0f;
+    running_job->SetProgress((stage + stage_progress) / num_stages);
+
+    if (running_job->IsCancelled())
+        return false;
+
+    // フレームキャッシュの構築中は、一定フレームごとに構築済みのフレームを累積して公開
+    if (params.preview_feature >= 0 && (stage == SA_STAGE_FRAME_CACHE1 || stage == SA_STAGE_FRAME_CACHE2)) {
+        int pending = done - partial_frames[stage];
+        if (pending >= params.publish_interval || (done == total && pending > 0)) {
+            const Motion* m = (stage == SA_STAGE_FRAME_CACHE1) ? &motion1 : &motion2;
+            AccumulateFrameCacheRange(m, stage, params.preview_feature, partial_frames[stage], done - 1, partial_grids[stage]);
+            partial_frames[stage] = done;
+            PublishPreview();
+        }
+    }
+    return true;
+}
+
+// 途中経過を作業用バッファに作成し、公開用バッファと入れ替え
+void SpatialAnalysisJob::PublishPreview() {
+    TRACE_SCOPE_CAT("AnalysisJob::PublishPreview", "analysis");
+
+    work_buffer.grid1 = partial_grids[0];
+    work_buffer.grid2 = partial_grids[1];
+    work_buffer.max_value = ComputeDiffGrid(work_buffer.grid1, work_buffer.grid2, work_buffer.diff);
+
+    std::lock_guard<std::mutex> lock(publish_mutex);
+    std::swap(work_buffer, publish_buffer);
+    publish_buffer.updated = true;
+}
+
+// 計算途中の累積ボクセルが公開されていれば表示側に設定
+bool SpatialAnalysisJob::TakePreview(SpatialAnalysisCore& target) {
+    if (params.preview_feature < 0)
+        return false;
+
+    std::lock_guard<std::mutex> lock(publish_mutex);
+    if (!publish_buffer.updated)
+        return false;
+    if (publish_buffer.grid1.resolution != target.grid_resolution)
+        return false;
+
+    target.SetAccumulatedPreview(params.preview_feature, publish_buffer.grid1, publish_buffer.grid2,
+                                 publish_buffer.diff, publish_buffer.max_value);
+    publish_buffer.updated = false;
+    return true;
+}
+
+// 現在の処理段階の名前
+const char* SpatialAnalysisJob::GetStageName() const {
+    switch (current_stage.load()) {
+    case SA_STAGE_FRAME_CACHE1: return "Building frame cache (M1)";
+    case SA_STAGE_FRAME_CACHE2: return "Building frame cache (M2)";
+    case SA_STAGE_ACCUMULATE: return "Accumulating voxels";
+    }
+    return "";
+}
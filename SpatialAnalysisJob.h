@@ -0,0 +1,81 @@
+﻿#pragma once
+#include <mutex>
+#include <atomic>
+#include <string>
+#include "SpatialAnalysisCore.h"
+#include "JobSystem.h"
+
+// 空間解析の非同期ジョブ（フレームキャッシュ・累積ボクセルをワーカースレッドで計算）
+// ジョブ登録時の動作のコピーから計算するため、計算中に表示側の動作が変更されても影響を受けない
+// 計算途中の累積ボクセルは一定フレームごとに公開され、描画スレッドが TakePreview() で受け取る
+
+// ジョブの設定
+struct SpatialAnalysisJobParams {
+    int grid_resolution;        // ボクセルグリッド解像度
+    float world_bounds[3][2];   // 解析対象領域
+    bool accumulate_all;        // 全特徴量の累積ボクセルを計算するか（false ならフレームキャッシュのみ）
+    std::string cache_motion1_name; // キャッシュの保存先のファイル名に使う動作名（空なら保存しない、accumulate_all が false ならフレームキャッシュのみ保存）
+    std::string cache_motion2_name;
+    int preview_feature;        // 途中経過を公開し、完了時に合成する特徴量（-1 なら公開・合成しない）
+    int publish_interval;       // 途中経過を公開するフレーム間隔
+    VoxelGridSpace grid_space;  // フレームキャッシュのボクセル化の座標系
+
+    SpatialAnalysisJobParams() : grid_resolution(64), accumulate_all(false), preview_feature(-1), publish_interval(100),
+                                 grid_space(VOXEL_GRID_WORLD) {
+        for (int i = 0; i < 3; ++i) {
+            world_bounds[i][0] = -1.0f;
+            world_bounds[i][1] = 1.0f;
+        }
+    }
+};
+
+class SpatialAnalysisJob : public SpatialAnalysisCore {
+public:
+    SpatialAnalysisJob(const Motion* m1, const Motion* m2, const SpatialAnalysisJobParams& p);
+    virtual ~SpatialAnalysisJob();
+
+    // ワーカースレッドで実行する処理
+    void Run(Job& job);
+
+    // 計算途中の累積ボクセルが公開されていれば表示側に設定（描画スレッドから呼び出す）
+    bool TakePreview(SpatialAnalysisCore& target);
+
+    // 計算が完了したかどうか（中断されずに最後まで実行された場合のみ true）
+    bool IsCompleted() const { return completed.load(); }
+
+    // 現在の処理段階の名前（進捗表示用）
+    const char* GetStageName() const;
+
+    const SpatialAnalysisJobParams& GetParams() const { return params; }
+
+protected:
+    virtual bool OnAnalysisProgress(int stage, int done, int total) override;
+
+private:
+    // 計算に使う動作のコピー
+    Motion motion1, motion2;
+    SpatialAnalysisJobParams params;
+
+    // 実行中のジョブ（進捗の設定・中断の確認用）
+    Job* running_job;
+    std::atomic<int> current_stage;
+    std::atomic<bool> completed;
+
+    // 計算途中の累積グリッド（ワーカースレッドのみが使用）
+    VoxelGrid partial_grids[2];
+    int partial_frames[2];
+
+    // 途中経過のダブルバッファ（work をワーカースレッドで作成し、publish と入れ替えて公開）
+    struct PreviewBuffer {
+        VoxelGrid grid1, grid2, diff;
+        float max_value;
+        bool updated;
+
+        PreviewBuffer() : max_value(1.0f), updated(false) {}
+    };
+    PreviewBuffer work_buffer;
+    PreviewBuffer publish_buffer;
+    std::mutex publish_mutex;
+
+    void PublishPreview();
+};
@@ -0,0 +1,468 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  処理時間の計測（スコープ単位の区間計測・カウンタ、Chrome のトレース形式での出力）
+**/
+
+
+// ライブラリ・クラス定義の読み込み
+#include "Trace.h"
+
+// 標準ライブラリの読み込み
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <cstdio>
+#include <algorithm>
+
+using namespace  std;
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  スレッドごとの記録用バッファ
+//
+
+
+// 各スレッドのリングバッファの容量（２のべき乗）
+static const int  trace_buffer_capacity = 1 << 15;
+
+// フレームごとの所要時間の履歴のフレーム数
+static const int  trace_history_frames = 120;
+
+
+//
+//  スレッドごとのリングバッファ
+//  書き込みは所有スレッドのみが行い、読み出し側は head を確認して上書きされた記録を除外する
+//
+struct  TraceThreadBuffer
+{
+	// スレッド番号・名前
+	int  thread_id;
+	string  thread_name;
+
+	// 記録の配列（リングバッファ）
+	vector< TraceEvent >  events;
+
+	// これまでに書き込んだ記録の数（次に書き込む位置は head & (容量-1)）
+	atomic< unsigned long long >  head;
+
+	// 区間の入れ子の深さ
+	int  depth;
+
+	// 使用中のスレッドがあるかどうか（スレッド終了後は他のスレッドが再利用する）
+	bool  in_use;
+
+	TraceThreadBuffer() : thread_id( 0 ), head( 0 ), depth( 0 ), in_use( false ) {}
+};
+
+
+// 計測の有効・無効のフラグ
+atomic< bool >  g_trace_enabled( false );
+
+// 全スレッドのバッファ（プログラム終了まで保持）
+static mutex  trace_registry_mutex;
+static vector< unique_ptr< TraceThreadBuffer > >  trace_buffers;
+
+// 計測の基準時刻
+static const chrono::steady_clock::time_point  trace_epoch = chrono::steady_clock::now();
+
+
+//
+//  スレッド終了時にバッファを解放済みにするためのクラス
+//
+struct  TraceThreadSlot
+{
+	TraceThreadBuffer *  buffer;
+
+	TraceThreadSlot() : buffer( NULL ) {}
+	~TraceThreadSlot()
+	{
+		if ( buffer )
+		{
+			lock_guard< mutex >  lock( trace_registry_mutex );
+			buffer->in_use = false;
+		}
+	}
+};
+
+static thread_local TraceThreadSlot  trace_thread_slot;
+
+
+//
+//  現在のスレッドのバッファを取得（初回は未使用のバッファを再利用するか新たに作成）
+//
+static TraceThreadBuffer *  GetThreadBuffer()
+{
+	if ( trace_thread_slot.buffer )
+		return  trace_thread_slot.buffer;
+
+	lock_guard< mutex >  lock( trace_registry_mutex );
+	TraceThreadBuffer *  buffer = NULL;
+	for ( size_t i = 0; i < trace_buffers.size(); i++ )
+	{
+		if ( !trace_buffers[ i ]->in_use )
+		{
+			buffer = trace_buffers[ i ].get();
+			break;
+		}
+	}
+	if ( !buffer )
+	{
+		trace_buffers.push_back( unique_ptr< TraceThreadBuffer >( new TraceThreadBuffer() ) );
+		buffer = trace_buffers.back().get();
+		buffer->thread_id = (int) trace_buffers.size();
+		buffer->events.resize( trace_buffer_capacity );
+	}
+	buffer->in_use = true;
+	buffer->depth = 0;
+	buffer->thread_name.clear();
+	trace_thread_slot.buffer = buffer;
+	return  buffer;
+}
+
+
+//
+//  バッファに記録を追加
+//
+static void  PushEvent( TraceThreadBuffer * buffer, const TraceEvent & e )
+{
+	unsigned long long  h = buffer->head.load( memory_order_relaxed );
+	buffer->events[ h & ( trace_buffer_capacity - 1 ) ] = e;
+	buffer->head.store( h + 1, memory_order_release );
+}
+
+
+//
+//  バッファから有効な記録をコピー（コピー中に上書きされた可能性のある古い記録は除く）
+//
+static void  CopyEvents( const TraceThreadBuffer * buffer, vector< TraceEvent > & out )
+{
+	out.clear();
+	unsigned long long  head = buffer->head.load( memory_order_acquire );
+	unsigned long long  begin = ( head > (unsigned long long) trace_buffer_capacity ) ? head - trace_buffer_capacity : 0;
+	out.reserve( (size_t)( head - begin ) );
+	for ( unsigned long long  i = begin; i < head; i++ )
+		out.push_back( buffer->events[ i & ( trace_buffer_capacity - 1 ) ] );
+
+	// コピー中に書き込まれた分だけ、先頭の記録は上書きされている可能性がある
+	unsigned long long  head_after = buffer->head.load( memory_order_acquire );
+	unsigned long long  safe_begin = ( head_after > (unsigned long long) trace_buffer_capacity ) ? head_after - trace_buffer_capacity : 0;
+	if ( safe_begin > begin )
+	{
+		size_t  num_discard = (size_t) min( safe_begin - begin, (unsigned long long) out.size() );
+		out.erase( out.begin(), out.begin() + num_discard );
+	}
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  計測の記録
+//
+
+
+//
+//  計測の有効・無効を設定
+//
+void  TraceSetEnabled( bool enabled )
+{
+	g_trace_enabled.store( enabled, memory_order_relaxed );
+}
+
+
+//
+//  計測開始からの時刻 [ns]
+//
+long long  TraceNow()
+{
+	return  chrono::duration_cast< chrono::nanoseconds >( chrono::steady_clock::now() - trace_epoch ).count();
+}
+
+
+//
+//  現在のスレッドの名前を設定
+//
+void  TraceSetThreadName( const char * name )
+{
+	TraceThreadBuffer *  buffer = GetThreadBuffer();
+	lock_guard< mutex >  lock( trace_registry_mutex );
+	buffer->thread_name = name ? name : "";
+}
+
+
+//
+//  区間の開始（区間の開始時の入れ子の深さを返す）
+//
+int  TraceEnterScope()
+{
+	TraceThreadBuffer *  buffer = GetThreadBuffer();
+	return  buffer->depth++;
+}
+
+
+//
+//  区間の記録（入れ子の深さを一つ戻す）
+//
+void  TraceRecordScope( const char * name, const char * category, long long start_ns, long long end_ns, int depth )
+{
+	TraceThreadBuffer *  buffer = GetThreadBuffer();
+	if ( buffer->depth > 0 )
+		buffer->depth--;
+
+	TraceEvent  e;
+	e.name = name;
+	e.category = category;
+	e.start_ns = start_ns;
+	e.duration_ns = end_ns - start_ns;
+	e.value = 0.0;
+	e.type = TRACE_EVENT_SCOPE;
+	e.depth = (unsigned char) min( depth, 255 );
+	PushEvent( buffer, e );
+}
+
+
+//
+//  カウンタの記録
+//
+void  TraceRecordCounter( const char * name, double value )
+{
+	TraceEvent  e;
+	e.name = name;
+	e.category = "counter";
+	e.start_ns = TraceNow();
+	e.duration_ns = 0;
+	e.value = value;
+	e.type = TRACE_EVENT_COUNTER;
+	e.depth = 0;
+	PushEvent( GetThreadBuffer(), e );
+}
+
+
+//
+//  全スレッドの記録を削除
+//  （記録中のスレッドとは同期しないため、計測を止めてから呼び出すこと）
+//
+void  TraceClear()
+{
+	lock_guard< mutex >  lock( trace_registry_mutex );
+	for ( size_t i = 0; i < trace_buffers.size(); i++ )
+		trace_buffers[ i ]->head.store( 0, memory_order_release );
+}
+
+
+//
+//  JSON 文字列の出力（エスケープが必要な文字を置き換え）
+//
+static void  WriteJSONString( FILE * fp, const char * text )
+{
+	fputc( '"', fp );
+	for ( const char * p = text ? text : ""; *p; p++ )
+	{
+		if ( ( *p == '"' ) || ( *p == '\\' ) )
+			fprintf( fp, "\\%c", *p );
+		else if ( (unsigned char) *p < 0x20 )
+			fputc( ' ', fp );
+		else
+			fputc( *p, fp );
+	}
+	fputc( '"', fp );
+}
+
+
+//
+//  全スレッドの記録を Chrome のトレース形式（JSON）で出力
+//
+bool  TraceExportChromeJSON( const char * file_name )
+{
+	FILE *  fp = fopen( file_name, "w" );
+	if ( !fp )
+		return  false;
+
+	// 出力中に追加されたスレッドは対象外とするため、バッファの一覧を先に取得
+	vector< TraceThreadBuffer * >  buffers;
+	vector< string >  thread_names;
+	{
+		lock_guard< mutex >  lock( trace_registry_mutex );
+		for ( size_t i = 0; i < trace_buffers.size(); i++ )
+		{
+			buffers.push_back( trace_buffers[ i ].get() );
+			thread_names.push_back( trace_buffers[ i ]->thread_name );
+		}
+	}
+
+	fprintf( fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+	bool  first = true;
+	vector< TraceEvent >  events;
+	for ( size_t b = 0; b < buffers.size(); b++ )
+	{
+		const TraceThreadBuffer *  buffer = buffers[ b ];
+
+		// スレッド名
+		if ( !thread_names[ b ].empty() )
+		{
+			fprintf( fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", buffer->thread_id );
+			WriteJSONString( fp, thread_names[ b ].c_str() );
+			fprintf( fp, "}}" );
+			first = false;
+		}
+
+		CopyEvents( buffer, events );
+		for ( size_t i = 0; i < events.size(); i++ )
+		{
+			const TraceEvent &  e = events[ i ];
+			fprintf( fp, "%s{\"name\":", first ? "" : ",\n" );
+			WriteJSONString( fp, e.name );
+			fprintf( fp, ",\"cat\":" );
+			WriteJSONString( fp, e.category );
+			if ( e.type == TRACE_EVENT_SCOPE )
+				fprintf( fp, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+					e.start_ns * 0.001, e.duration_ns * 0.001, buffer->thread_id );
+			else
+				fprintf( fp, ",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"value\":%g}}",
+					e.start_ns * 0.001, buffer->thread_id, e.value );
+			first = false;
+		}
+	}
+	fprintf( fp, "\n]}\n" );
+
+	bool  success = !ferror( fp );
+	fclose( fp );
+	return  success;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+//  フレームごとの所要時間の履歴
+//
+
+
+// 履歴を記録する区間の最大の深さ
+static int  trace_stage_max_depth = 2;
+
+// 各区間の履歴
+static vector< TraceStageHistory >  trace_stages;
+
+// 現在のフレームの開始時の記録位置（描画スレッドのバッファ）
+static TraceThreadBuffer *  trace_frame_buffer = NULL;
+static unsigned long long  trace_frame_begin = 0;
+static long long  trace_frame_begin_ns = 0;
+static bool  trace_frame_active = false;
+
+
+//
+//  表示順の比較（区間の開始が早い順、同時なら浅い順）
+//
+static bool  CompareStageOrder( const TraceStageHistory & a, const TraceStageHistory & b )
+{
+	if ( a.order_ms != b.order_ms )
+		return  a.order_ms < b.order_ms;
+	return  a.depth < b.depth;
+}
+
+
+//
+//  フレームの開始
+//
+void  TraceBeginFrame()
+{
+	trace_frame_active = TraceIsEnabled();
+	if ( !trace_frame_active )
+		return;
+	trace_frame_buffer = GetThreadBuffer();
+	trace_frame_begin = trace_frame_buffer->head.load( memory_order_relaxed );
+	trace_frame_begin_ns = TraceNow();
+}
+
+
+//
+//  フレームの終了（フレーム中に記録された区間の所要時間を、名前・深さごとに合計して履歴に追加）
+//
+void  TraceEndFrame()
+{
+	if ( !trace_frame_active || ( trace_frame_buffer != GetThreadBuffer() ) )
+		return;
+	trace_frame_active = false;
+
+	unsigned long long  head = trace_frame_buffer->head.load( memory_order_relaxed );
+	unsigned long long  begin = trace_frame_begin;
+	if ( begin > head )
+		begin = head;
+	else if ( head - begin > (unsigned long long) trace_buffer_capacity )
+		begin = head - trace_buffer_capacity;
+
+	// 今回のフレームの各区間の合計所要時間
+	vector< float >  frame_ms( trace_stages.size(), 0.0f );
+	bool  stage_added = false;
+	for ( unsigned long long  i = begin; i < head; i++ )
+	{
+		const TraceEvent &  e = trace_frame_buffer->events[ i & ( trace_buffer_capacity - 1 ) ];
+		if ( ( e.type != TRACE_EVENT_SCOPE ) || ( e.depth > trace_stage_max_depth ) )
+			continue;
+
+		// 名前は文字列リテラルを想定しているため、ポインタと深さで区間を識別
+		size_t  s = 0;
+		while ( ( s < trace_stages.size() ) && ( ( trace_stages[ s ].name != e.name ) || ( trace_stages[ s ].depth != e.depth ) ) )
+			s++;
+		if ( s == trace_stages.size() )
+		{
+			TraceStageHistory  stage;
+			stage.name = e.name;
+			stage.depth = e.depth;
+			stage.history_ms.assign( trace_history_frames, 0.0f );
+			stage.next = 0;
+			stage.last_ms = stage.average_ms = stage.max_ms = 0.0f;
+			stage.order_ms = ( e.start_ns - trace_frame_begin_ns ) * 1.0e-6f;
+			trace_stages.push_back( stage );
+			frame_ms.push_back( 0.0f );
+			stage_added = true;
+		}
+		frame_ms[ s ] += e.duration_ns * 1.0e-6f;
+	}
+
+	// 履歴に追加し、統計値を更新
+	for ( size_t s = 0; s < trace_stages.size(); s++ )
+	{
+		TraceStageHistory &  stage = trace_stages[ s ];
+		stage.history_ms[ stage.next ] = frame_ms[ s ];
+		stage.next = ( stage.next + 1 ) % trace_history_frames;
+		stage.last_ms = frame_ms[ s ];
+
+		float  sum = 0.0f, max_ms = 0.0f;
+		for ( int i = 0; i < trace_history_frames; i++ )
+		{
+			sum += stage.history_ms[ i ];
+			max_ms = max( max_ms, stage.history_ms[ i ] );
+		}
+		stage.average_ms = sum / trace_history_frames;
+		stage.max_ms = max_ms;
+	}
+
+	// 新たな区間が追加されたら、フレーム内での開始順に並べ替え（親の区間が子の区間より前になる）
+	if ( stage_added )
+		stable_sort( trace_stages.begin(), trace_stages.end(), CompareStageOrder );
+}
+
+
+//
+//  履歴を記録する区間の最大の深さを設定
+//
+void  TraceSetFrameStageMaxDepth( int max_depth )
+{
+	trace_stage_max_depth = max( max_depth, 0 );
+	trace_stages.clear();
+}
+
+
+//
+//  フレームごとの所要時間の履歴を取得
+//
+const vector< TraceStageHistory > &  TraceGetFrameStages()
+{
+	return  trace_stages;
+}
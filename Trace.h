@@ -0,0 +1,175 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  処理時間の計測（スコープ単位の区間計測・カウンタ、Chrome のトレース形式での出力）
+***
+***  TRACE_SCOPE( "名前" ) を置いたスコープの開始・終了時刻と、TRACE_COUNTER( "名前", 値 ) の値を、
+***  スレッドごとのリングバッファに記録する（古い記録から上書きされる）
+***  計測は実行時に TraceSetEnabled() で有効・無効を切り替えられ、無効時の負荷はフラグの確認のみとなる
+***  SH_TRACE_DISABLED を定義してコンパイルすると、マクロは空になり計測処理は完全に取り除かれる
+***  名前・カテゴリには文字列リテラルなど、プログラム終了まで有効な文字列を指定すること
+**/
+
+#ifndef  _TRACE_H_
+#define  _TRACE_H_
+
+
+// 標準ライブラリの読み込み
+#include <atomic>
+#include <vector>
+#include <string>
+
+
+//
+//  記録の種類
+//
+enum  TraceEventType
+{
+	TRACE_EVENT_SCOPE,   // 区間（開始時刻と所要時間）
+	TRACE_EVENT_COUNTER  // カウンタ（時刻と値）
+};
+
+
+//
+//  記録（１件分）
+//
+struct  TraceEvent
+{
+	// 名前・カテゴリ
+	const char *  name;
+	const char *  category;
+
+	// 開始時刻・所要時間（計測開始からのナノ秒）
+	long long  start_ns;
+	long long  duration_ns;
+
+	// カウンタの値
+	double  value;
+
+	// 記録の種類
+	unsigned char  type;
+
+	// 区間の入れ子の深さ（最も外側が０）
+	unsigned char  depth;
+};
+
+
+//
+//  フレームごとの区間の所要時間の履歴（オーバーレイ表示用）
+//
+struct  TraceStageHistory
+{
+	// 区間の名前・入れ子の深さ
+	const char *  name;
+	int  depth;
+
+	// 各フレームの合計所要時間 [ms]（リングバッファ、next が次に書き込む位置）
+	std::vector< float >  history_ms;
+	int  next;
+
+	// 直近のフレームの所要時間・履歴の平均・最大 [ms]
+	float  last_ms;
+	float  average_ms;
+	float  max_ms;
+
+	// 表示順（初めて記録されたフレームでの、フレーム開始から区間開始までの時間 [ms]）
+	float  order_ms;
+};
+
+
+// 計測の有効・無効のフラグ（直接参照せず TraceIsEnabled() を使用）
+extern std::atomic< bool >  g_trace_enabled;
+
+// 計測が有効かどうか
+inline bool  TraceIsEnabled() { return  g_trace_enabled.load( std::memory_order_relaxed ); }
+
+// 計測の有効・無効を設定
+void  TraceSetEnabled( bool enabled );
+
+// 計測開始からの時刻 [ns]
+long long  TraceNow();
+
+// 現在のスレッドの名前を設定（トレース出力で使用）
+void  TraceSetThreadName( const char * name );
+
+// 区間の開始（現在のスレッドの入れ子の深さを返す）・区間の記録（通常は TraceScope から呼び出す）
+int  TraceEnterScope();
+void  TraceRecordScope( const char * name, const char * category, long long start_ns, long long end_ns, int depth );
+
+// カウンタの記録（通常はマクロから呼び出す）
+void  TraceRecordCounter( const char * name, double value );
+
+// 全スレッドの記録を削除
+void  TraceClear();
+
+// 全スレッドの記録を Chrome のトレース形式（JSON）で出力（chrome://tracing や Perfetto で表示できる）
+bool  TraceExportChromeJSON( const char * file_name );
+
+
+// フレームの開始・終了（描画スレッドから呼び出し、フレーム内の区間の所要時間を履歴に追加する）
+void  TraceBeginFrame();
+void  TraceEndFrame();
+
+// フレームごとの所要時間の履歴を記録する区間の最大の深さを設定
+void  TraceSetFrameStageMaxDepth( int max_depth );
+
+// フレームごとの所要時間の履歴を取得（描画スレッドから呼び出す）
+const std::vector< TraceStageHistory > &  TraceGetFrameStages();
+
+
+//
+//  スコープの開始から終了までの区間を記録するクラス
+//
+class  TraceScope
+{
+  protected:
+	const char *  name;
+	const char *  category;
+	long long  start_ns;
+	int  depth;
+	bool  active;
+
+  public:
+	TraceScope( const char * n, const char * c ) : name( n ), category( c ), start_ns( 0 ), depth( 0 ), active( TraceIsEnabled() )
+	{
+		if ( active )
+		{
+			depth = TraceEnterScope();
+			start_ns = TraceNow();
+		}
+	}
+
+	~TraceScope()
+	{
+		if ( active )
+			TraceRecordScope( name, category, start_ns, TraceNow(), depth );
+	}
+};
+
+
+//
+//  計測用マクロ
+//
+#define  TRACE_CONCAT_INNER( a, b )  a##b
+#define  TRACE_CONCAT( a, b )  TRACE_CONCAT_INNER( a, b )
+
+#ifndef  SH_TRACE_DISABLED
+
+#define  TRACE_SCOPE( name )  TraceScope  TRACE_CONCAT( trace_scope_, __LINE__ )( name, "app" )
+#define  TRACE_SCOPE_CAT( name, category )  TraceScope  TRACE_CONCAT( trace_scope_, __LINE__ )( name, category )
+#define  TRACE_COUNTER( name, value )  do { if ( TraceIsEnabled() ) TraceRecordCounter( name, (double)( value ) ); } while ( 0 )
+
+#else
+
+#define  TRACE_SCOPE( name )  ((void)0)
+#define  TRACE_SCOPE_CAT( name, category )  ((void)0)
+#define  TRACE_COUNTER( name, value )  ((void)0)
+
+#endif // SH_TRACE_DISABLED
+
+
+#endif // _TRACE_H_
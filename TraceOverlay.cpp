@@ -0,0 +1,90 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  処理時間の計測結果の表示（ImGui のウィンドウに、区間ごとのフレーム時間の履歴を表示）
+**/
+
+
+// ライブラリ・クラス定義の読み込み
+#include "TraceOverlay.h"
+#include "Trace.h"
+#include "imgui.h"
+
+// 標準ライブラリの読み込み
+#include <cstdio>
+
+
+//
+//  計測結果のウィンドウを描画
+//
+void  DrawTraceOverlay( bool * p_open, const char * trace_file_name )
+{
+	if ( p_open && !*p_open )
+		return;
+
+	ImGui::SetNextWindowSize( ImVec2( 420, 480 ), ImGuiCond_FirstUseEver );
+	if ( !ImGui::Begin( "Performance", p_open ) )
+	{
+		ImGui::End();
+		return;
+	}
+
+	// 計測の有効・無効、記録の出力・削除
+	bool  enabled = TraceIsEnabled();
+	if ( ImGui::Checkbox( "Enable Tracing", &enabled ) )
+		TraceSetEnabled( enabled );
+	ImGui::SameLine();
+	if ( ImGui::Button( "Export Chrome Trace" ) )
+	{
+		if ( TraceExportChromeJSON( trace_file_name ) )
+			printf( "Trace exported to %s\n", trace_file_name );
+		else
+			printf( "Failed to export trace to %s\n", trace_file_name );
+	}
+	ImGui::SameLine();
+	if ( ImGui::Button( "Clear" ) )
+	{
+		bool  was_enabled = TraceIsEnabled();
+		TraceSetEnabled( false );
+		TraceClear();
+		TraceSetEnabled( was_enabled );
+	}
+
+#ifdef  SH_TRACE_DISABLED
+	ImGui::TextDisabled( "Tracing is disabled at compile time (SH_TRACE_DISABLED)." );
+#endif
+
+	// 区間ごとの所要時間の履歴（入れ子の深さに応じて字下げ）
+	const std::vector< TraceStageHistory > &  stages = TraceGetFrameStages();
+	if ( stages.empty() )
+		ImGui::TextDisabled( "No frame data. Enable tracing to collect per-stage timings." );
+	else
+		ImGui::TextDisabled( "Stage  (last / average / max over %d frames)", (int) stages[ 0 ].history_ms.size() );
+
+	for ( size_t i = 0; i < stages.size(); i++ )
+	{
+		const TraceStageHistory &  stage = stages[ i ];
+		ImGui::PushID( (int) i );
+		if ( stage.depth > 0 )
+			ImGui::Indent( 12.0f * stage.depth );
+
+		ImGui::Text( "%s", stage.name );
+		ImGui::SameLine( 200.0f );
+		ImGui::Text( "%6.2f / %6.2f / %6.2f ms", stage.last_ms, stage.average_ms, stage.max_ms );
+
+		char  overlay[ 32 ];
+		sprintf( overlay, "max %.2f ms", stage.max_ms );
+		ImGui::PlotHistogram( "##history", &stage.history_ms.front(), (int) stage.history_ms.size(), stage.next,
+			overlay, 0.0f, ( stage.max_ms > 0.0f ) ? stage.max_ms : 1.0f, ImVec2( -1.0f, 32.0f ) );
+
+		if ( stage.depth > 0 )
+			ImGui::Unindent( 12.0f * stage.depth );
+		ImGui::PopID();
+	}
+
+	ImGui::End();
+}
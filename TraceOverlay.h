@@ -0,0 +1,20 @@
+﻿/**
+***  キャラクタアニメーションのための人体モデルの表現・基本処理 ライブラリ・サンプルプログラム
+***  Copyright (c) 2015-, Masaki OSHITA (www.oshita-lab.org)
+***  Released under the MIT license http://opensource.org/licenses/mit-license.php
+**/
+
+/**
+***  処理時間の計測結果の表示（ImGui のウィンドウに、区間ごとのフレーム時間の履歴を表示）
+**/
+
+#ifndef  _TRACE_OVERLAY_H_
+#define  _TRACE_OVERLAY_H_
+
+
+// 計測結果のウィンドウを描画（ImGui::NewFrame() から ImGui::Render() までの間に呼び出す）
+// 計測の有効・無効の切替、Chrome のトレース形式での出力（trace_file_name）も行える
+void  DrawTraceOverlay( bool * p_open, const char * trace_file_name = "trace.json" );
+
+
+#endif // _TRACE_OVERLAY_H_
@@ -1,4 +1,5 @@
 #include "VoxelData.h"
+#include "ScratchArena.h"
 #include <algorithm>
 #include <fstream>
 
@@ -10,11 +11,58 @@ using namespace std;
 void VoxelGrid::Resize(int res) {
     resolution = res;
     data.assign(res * res * res, 0.0f);
+
+    brick_resolution = (res + (1 << kVoxelGridBrickBits) - 1) >> kVoxelGridBrickBits;
+    dirty_bricks.clear();
+    all_dirty = false;
+    if (track_dirty)
+        brick_dirty.assign((size_t)brick_resolution * brick_resolution * brick_resolution, 0);
 }
 
-// グリッドデータを全てゼロでクリア
+// グリッドデータを全てゼロでクリア（書き込んだブリックを記録している場合は、そのブリックのみ）
 void VoxelGrid::Clear() {
+    if (HasDirtyBricks()) {
+        int begin[3], end[3];
+        for (size_t i = 0; i < dirty_bricks.size(); ++i) {
+            int b = dirty_bricks[i];
+            GetBrickRange(b, begin, end);
+            for (int z = begin[2]; z < end[2]; ++z)
+                for (int y = begin[1]; y < end[1]; ++y) {
+                    float* row = &data[((size_t)z * resolution + y) * resolution];
+                    std::fill(row + begin[0], row + end[0], 0.0f);
+                }
+            brick_dirty[b] = 0;
+        }
+        dirty_bricks.clear();
+        return;
+    }
+
     std::fill(data.begin(), data.end(), 0.0f);
+    if (track_dirty) {
+        std::fill(brick_dirty.begin(), brick_dirty.end(), 0);
+        dirty_bricks.clear();
+        all_dirty = false;
+    }
+}
+
+// 書き込んだブリックの記録を有効化
+void VoxelGrid::EnableDirtyTracking() {
+    if (track_dirty)
+        return;
+    track_dirty = true;
+    all_dirty = true;
+    brick_resolution = (resolution + (1 << kVoxelGridBrickBits) - 1) >> kVoxelGridBrickBits;
+    brick_dirty.assign((size_t)brick_resolution * brick_resolution * brick_resolution, 0);
+    dirty_bricks.clear();
+}
+
+// ブリックのボクセル座標の範囲
+void VoxelGrid::GetBrickRange(int brick, int begin[3], int end[3]) const {
+    int bc[3] = { brick % brick_resolution, (brick / brick_resolution) % brick_resolution, brick / (brick_resolution * brick_resolution) };
+    for (int i = 0; i < 3; ++i) {
+        begin[i] = bc[i] << kVoxelGridBrickBits;
+        end[i] = (std::min)(begin[i] + (1 << kVoxelGridBrickBits), resolution);
+    }
 }
 
 // 指定座標のボクセル値への参照を取得（範囲外の場合はダミー値を返す）
@@ -82,6 +130,7 @@ bool VoxelGrid::LoadFromFile(const char* filename) {
     
     Resize(res);
     ifs.read(reinterpret_cast<char*>(data.data()), data_size * sizeof(float));
+    MarkAllDirty();
     
     // バージョン2以降は基準姿勢情報を読み込み
     if (version >= 2) {
@@ -146,4 +195,178 @@ bool LoadSegmentVoxelGridsFromFile(std::vector<VoxelGrid>& segment_grids, const
     }
     
     return ifs.good();
-}
\ No newline at end of file
+}
+
+// --- MotionFrameSegmentVoxelGridCache Implementation ---
+
+// 特徴量ごとに値が 0 でない疎ボクセルのビットを立てる（値によらず全ての疎ボクセルのビットを書き込む）
+void AppendQuantizedFeatureMasks(const QuantizedSparseVoxel* voxels, size_t first, size_t count, std::vector<unsigned int> masks[5]) {
+    size_t words = GetFeatureMaskWords(first + count);
+    for (int f = 0; f < 5; ++f) {
+        std::vector<unsigned int>& mask = masks[f];
+        mask.resize(words, 0u);
+        for (size_t k = 0; k < count; ++k) {
+            size_t bit = first + k;
+            unsigned int set = (voxels[k].values[f] != 0) ? 1u : 0u;
+            mask[bit / kFeatureMaskWordBits] |= set << (bit % kFeatureMaskWordBits);
+        }
+    }
+}
+
+// キャッシュを空にして、指定フレーム数分のフレーム・部位の領域を確保
+void MotionFrameSegmentVoxelGridCache::Reset(int num_frames, int num_seg, int res, float threshold) {
+    Clear();
+    resolution = res;
+    num_segments = num_seg;
+    sparse_threshold = threshold;
+    references.reserve(num_frames);
+    segments.reserve((size_t)num_frames * num_seg);
+}
+
+// 1フレーム分の疎ボクセルを、ブリックごとにまとめて量子化し末尾に追加
+void MotionFrameSegmentVoxelGridCache::AppendFrame(const FrameSegmentVoxelGrid& frame) {
+    FrameReference ref;
+    ref.root_pos.set(0, 0, 0);
+    ref.root_ori.setIdentity();
+    if (!frame.segment_grids.empty() && frame.segment_grids[0].has_reference) {
+        ref.root_pos = frame.segment_grids[0].reference_root_pos;
+        ref.root_ori = frame.segment_grids[0].reference_root_ori;
+    }
+    references.push_back(ref);
+    size_t first_voxel = voxels.size();
+
+    const int mask = kBrickSize - 1;
+    int bricks_per_axis = (resolution + mask) / kBrickSize;
+    int res2 = resolution * resolution;
+    // (ブリック番号, 疎ボクセルの番号)（現在のスレッドのアリーナから割り当て、終了時に巻き戻す）
+    ScratchArena& arena = GetThreadScratchArena();
+    ScratchArenaScope scope(arena);
+    ScratchVector<std::pair<int, int>> keys{ScratchAllocator<std::pair<int, int>>(arena)};
+    size_t max_voxels = 0;
+    for (size_t s = 0; s < frame.segment_grids.size(); ++s)
+        max_voxels = (std::max)(max_voxels, frame.segment_grids[s].voxels.size());
+    keys.reserve(max_voxels);
+
+    for (int s = 0; s < num_segments; ++s) {
+        CompactSegmentRecord record;
+        record.first_brick = (unsigned int)bricks.size();
+        record.num_bricks = 0;
+        for (int f = 0; f < 5; ++f)
+            record.scale[f] = 0.0f;
+
+        if (s >= (int)frame.segment_grids.size() || frame.segment_grids[s].voxels.empty()) {
+            segments.push_back(record);
+            continue;
+        }
+        const std::vector<SparseVoxel>& src = frame.segment_grids[s].voxels;
+
+        // 特徴量ごとの最大値から量子化スケールを決定
+        float inv_scale[5];
+        for (int f = 0; f < 5; ++f) {
+            float max_value = 0.0f;
+            for (size_t k = 0; k < src.size(); ++k)
+                if (src[k].values[f] > max_value)
+                    max_value = src[k].values[f];
+            record.scale[f] = max_value / 65535.0f;
+            inv_scale[f] = (max_value > 0.0f) ? 65535.0f / max_value : 0.0f;
+        }
+
+        // ブリックごとにまとめる（ブリック内の順序は元の順序を維持）
+        keys.resize(src.size());
+        for (size_t k = 0; k < src.size(); ++k) {
+            int index = src[k].index;
+            int z = index / res2;
+            int y = (index - z * res2) / resolution;
+            int x = index - z * res2 - y * resolution;
+            int key = ((z >> kBrickBits) * bricks_per_axis + (y >> kBrickBits)) * bricks_per_axis + (x >> kBrickBits);
+            keys[k] = std::make_pair(key, (int)k);
+        }
+        std::stable_sort(keys.begin(), keys.end(),
+                         [](const std::pair<int, int>& a, const std::pair<int, int>& b) { return a.first < b.first; });
+
+        int prev_key = -1;
+        for (size_t k = 0; k < keys.size(); ++k) {
+            const SparseVoxel& sv = src[keys[k].second];
+            int z = sv.index / res2;
+            int y = (sv.index - z * res2) / resolution;
+            int x = sv.index - z * res2 - y * resolution;
+            if (keys[k].first != prev_key) {
+                SparseVoxelBrick brick;
+                brick.first_voxel = (unsigned int)voxels.size();
+                brick.num_voxels = 0;
+                brick.origin[0] = (unsigned short)(x >> kBrickBits);
+                brick.origin[1] = (unsigned short)(y >> kBrickBits);
+                brick.origin[2] = (unsigned short)(z >> kBrickBits);
+                bricks.push_back(brick);
+                record.num_bricks++;
+                prev_key = keys[k].first;
+            }
+
+            QuantizedSparseVoxel qv;
+            qv.local = (unsigned short)((x & mask) | ((y & mask) << kBrickBits) | ((z & mask) << (kBrickBits * 2)));
+            for (int f = 0; f < 5; ++f) {
+                float q = sv.values[f] * inv_scale[f] + 0.5f;
+                qv.values[f] = (q <= 0.0f) ? 0 : (q >= 65535.0f) ? 65535 : (unsigned short)q;
+                // 合成時と同じ復元値で閾値と比較し、閾値以下の値を除く
+                if (qv.values[f] * record.scale[f] <= sparse_threshold)
+                    qv.values[f] = 0;
+            }
+            voxels.push_back(qv);
+            bricks.back().num_voxels++;
+        }
+        segments.push_back(record);
+    }
+    AppendQuantizedFeatureMasks(voxels.data() + first_voxel, first_voxel, voxels.size() - first_voxel, feature_masks);
+
+    // 最初のフレームのボクセル数から全フレーム分の領域を見積もって確保（構築中の再確保を抑える）
+    if (references.size() == 1 && references.capacity() > 1) {
+        size_t expected_frames = references.capacity();
+        voxels.reserve(voxels.size() * expected_frames * 5 / 4);
+        bricks.reserve(bricks.size() * expected_frames * 5 / 4);
+        for (int f = 0; f < 5; ++f)
+            feature_masks[f].reserve(GetFeatureMaskWords(voxels.capacity()));
+    }
+}
+
+// 構築後に余分に確保した領域を解放
+void MotionFrameSegmentVoxelGridCache::ShrinkToFit() {
+    references.shrink_to_fit();
+    segments.shrink_to_fit();
+    bricks.shrink_to_fit();
+    voxels.shrink_to_fit();
+    for (int f = 0; f < 5; ++f)
+        feature_masks[f].shrink_to_fit();
+}
+
+void MotionFrameSegmentVoxelGridCache::Swap(MotionFrameSegmentVoxelGridCache& other) {
+    std::swap(resolution, other.resolution);
+    std::swap(num_segments, other.num_segments);
+    references.swap(other.references);
+    segments.swap(other.segments);
+    bricks.swap(other.bricks);
+    voxels.swap(other.voxels);
+    for (int f = 0; f < 5; ++f)
+        feature_masks[f].swap(other.feature_masks[f]);
+    segment_bounds.swap(other.segment_bounds);
+    std::swap(sparse_threshold, other.sparse_threshold);
+}
+
+// 使用メモリの内訳
+FrameCacheMemoryInfo MotionFrameSegmentVoxelGridCache::GetMemoryInfo() const {
+    FrameCacheMemoryInfo info;
+    info.num_frames = GetNumFrames();
+    info.num_voxels = voxels.size();
+    info.num_bricks = bricks.size();
+    info.reference_bytes = references.capacity() * sizeof(FrameReference);
+    info.segment_bytes = segments.capacity() * sizeof(CompactSegmentRecord);
+    info.brick_bytes = bricks.capacity() * sizeof(SparseVoxelBrick);
+    info.voxel_bytes = voxels.capacity() * sizeof(QuantizedSparseVoxel);
+    for (int f = 0; f < 5; ++f)
+        info.mask_bytes += feature_masks[f].capacity() * sizeof(unsigned int);
+    info.total_bytes = sizeof(*this) + info.reference_bytes + info.segment_bytes + info.brick_bytes + info.voxel_bytes + info.mask_bytes +
+                       segment_bounds.capacity() * sizeof(SegmentGridBounds);
+    info.uncompressed_bytes = (size_t)info.num_frames * sizeof(FrameSegmentVoxelGrid) +
+                              segments.size() * sizeof(SegmentVoxelGrid) +
+                              info.num_voxels * sizeof(SparseVoxel);
+    return info;
+}
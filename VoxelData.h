@@ -1,7 +1,14 @@
 #pragma once
 #include <vector>
+#include <cstddef>
 #include <Point3.h>
 #include <Matrix3.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// 書き込んだ領域を記録するブリックの1辺のボクセル数のビット数（8^3 ボクセル）
+static const int kVoxelGridBrickBits = 3;
 
 struct VoxelGrid {
     int resolution;
@@ -11,8 +18,17 @@ struct VoxelGrid {
     Point3f reference_root_pos;
     Matrix3f reference_root_ori;
     bool has_reference;
+
+    // 書き込んだブリックの記録（EnableDirtyTracking() で有効にしたグリッドのみ）
+    // MarkDirty() で記録したブリックのみを Clear() で 0 に戻すため、1フレーム分の体が占める領域のみの書き込み・消去で済む
+    // 記録せずに書き込んだ場合は MarkAllDirty() を呼び、次回の Clear() で全体を消去する
+    bool track_dirty;
+    bool all_dirty;                      // 記録していない書き込みがある（全体を書き込み済みとみなす）
+    int brick_resolution;                // 1辺のブリック数
+    std::vector<unsigned char> brick_dirty;
+    std::vector<int> dirty_bricks;       // 書き込んだブリックの番号（書き込んだ順）
     
-    VoxelGrid() : resolution(0), has_reference(false) {
+    VoxelGrid() : resolution(0), has_reference(false), track_dirty(false), all_dirty(false), brick_resolution(0) {
         reference_root_pos.set(0, 0, 0);
         reference_root_ori.setIdentity();
     }
@@ -21,6 +37,38 @@ struct VoxelGrid {
     void Clear();
     float& At(int x, int y, int z);
     float Get(int x, int y, int z) const;
+
+    // 書き込んだブリックの記録を有効化（無効だった場合は全体を書き込み済みとみなす）
+    void EnableDirtyTracking();
+
+    // 書き込んだボクセルのブリックを記録（記録が無効なら何もしない）
+    void MarkDirty(int x, int y, int z) {
+        if (!track_dirty || all_dirty)
+            return;
+        int b = ((z >> kVoxelGridBrickBits) * brick_resolution + (y >> kVoxelGridBrickBits)) * brick_resolution + (x >> kVoxelGridBrickBits);
+        if (!brick_dirty[b]) {
+            brick_dirty[b] = 1;
+            dirty_bricks.push_back(b);
+        }
+    }
+
+    // ブリックを記録（新たに記録した場合は true）
+    bool MarkDirtyBrick(int brick) {
+        if (!track_dirty || all_dirty || brick_dirty[brick])
+            return false;
+        brick_dirty[brick] = 1;
+        dirty_bricks.push_back(brick);
+        return true;
+    }
+
+    void MarkAllDirty() { all_dirty = true; }
+
+    // 書き込んだ領域をブリック単位で参照できるか
+    bool HasDirtyBricks() const { return track_dirty && !all_dirty; }
+    const std::vector<int>& GetDirtyBricks() const { return dirty_bricks; }
+
+    // ブリックのボクセル座標の範囲（[begin, end)、端のブリックはグリッドの範囲までに切り詰める）
+    void GetBrickRange(int brick, int begin[3], int end[3]) const;
     
     // 基準姿勢の設定
     void SetReference(const Point3f& root_pos, const Matrix3f& root_ori) {
@@ -115,29 +163,182 @@ struct FrameSegmentVoxelGrid {
     }
 };
 
+// フレームキャッシュの量子化した疎ボクセル（12バイト）
+// 位置はブリック内の座標（x | y << 5 | z << 10）、特徴量は部位ごとのスケールで16ビットに量子化した値
+struct QuantizedSparseVoxel {
+    unsigned short local;
+    unsigned short values[5]; // 0:occupancy, 1:speed, 2:jerk, 3:inertia, 4:principal-axis angular speed
+};
+
+// ブリックの1辺のボクセル数のビット数（32^3 ボクセル）
+static const int kSparseVoxelBrickBits = 5;
+
+// 疎ボクセルの位置の基準となる 32^3 ボクセルの領域
+struct SparseVoxelBrick {
+    unsigned int first_voxel;
+    unsigned int num_voxels;
+    unsigned short origin[3]; // ブリック単位の座標
+};
+
+// 1フレーム・1部位分の疎ボクセルのブリックの範囲と、特徴量ごとの量子化スケール
+struct CompactSegmentRecord {
+    unsigned int first_brick;
+    unsigned int num_bricks;
+    float scale[5];
+};
+
+// 1フレーム分の基準姿勢（腰の位置・回転、全部位で共通）
+struct FrameReference {
+    Point3f root_pos;
+    Matrix3f root_ori;
+};
+
+// 部位ごとの局所グリッドの範囲（ルート位置を原点・ルートの回転を軸とする座標系の3軸分の最小値/最大値）
+// 局所グリッドのボクセル番号は、解像度は共通で各部位の範囲を分割したグリッドの番号となる
+struct SegmentGridBounds {
+    float bounds[3][2];
+};
+
+// 特徴量ごとのマスクの1語のビット数（疎ボクセルの番号 k のビットは語 k / 32 のビット k % 32）
+static const int kFeatureMaskWordBits = 32;
+
+// 疎ボクセル数 n 個分のマスクの語数
+inline size_t GetFeatureMaskWords(size_t n) {
+    return (n + kFeatureMaskWordBits - 1) / kFeatureMaskWordBits;
+}
+
+// 0 でない語の最下位の 1 のビットの位置
+inline int CountTrailingZeroBits(unsigned int bits) {
+#ifdef _MSC_VER
+    unsigned long pos;
+    _BitScanForward(&pos, bits);
+    return (int)pos;
+#else
+    return __builtin_ctz(bits);
+#endif
+}
+
+// 量子化した疎ボクセル voxels[0] ～ voxels[count - 1] の特徴量ごとに、値が 0 でないかをマスクの first 番目以降のビットに格納（マスクは必要な語数に拡張）
+// フレームキャッシュの構築時に1回だけ求め、合成時は特徴量のマスクのビットが立った疎ボクセルのみを読み出す
+void AppendQuantizedFeatureMasks(const QuantizedSparseVoxel* voxels, size_t first, size_t count, std::vector<unsigned int> masks[5]);
+
+// 1フレーム・1部位分の量子化した疎ボクセルのうち、指定特徴量が 0 でないボクセルについて func(線形インデックス, 値) を呼び出す
+// bricks・voxels は record のブリック番号・ブリックのボクセル番号の基準となる配列の先頭、feature_mask は voxels と同じ番号の指定特徴量のマスク
+// （メモリ上のキャッシュ・マップしたファイルで共通）
+// マスクの語ごとに立っているビットのみをたどるため、値が 0 の疎ボクセルは読み出さず、値による分岐もない
+template <class Func>
+inline void ForEachQuantizedSegmentVoxel(const CompactSegmentRecord& record, const SparseVoxelBrick* bricks, const QuantizedSparseVoxel* voxels,
+                                         const unsigned int* feature_mask, int resolution, int feature, Func func) {
+    const int brick_bits = kSparseVoxelBrickBits;
+    const int mask = (1 << brick_bits) - 1;
+    float scale = record.scale[feature];
+    if (scale <= 0.0f)
+        return;
+    int res2 = resolution * resolution;
+    for (unsigned int b = 0; b < record.num_bricks; ++b) {
+        const SparseVoxelBrick& brick = bricks[record.first_brick + b];
+        if (brick.num_voxels == 0)
+            continue;
+        int base = (brick.origin[0] + brick.origin[1] * resolution + brick.origin[2] * res2) << brick_bits;
+        size_t begin = brick.first_voxel;
+        size_t end = begin + brick.num_voxels;
+        size_t first_word = begin / kFeatureMaskWordBits;
+        size_t last_word = (end - 1) / kFeatureMaskWordBits;
+        for (size_t w = first_word; w <= last_word; ++w) {
+            // ブリックの範囲外のビットを除く
+            unsigned int bits = feature_mask[w];
+            if (w == first_word)
+                bits &= ~0u << (begin % kFeatureMaskWordBits);
+            if (w == last_word && end % kFeatureMaskWordBits != 0)
+                bits &= ~0u >> (kFeatureMaskWordBits - end % kFeatureMaskWordBits);
+            while (bits) {
+                const QuantizedSparseVoxel& v = voxels[w * kFeatureMaskWordBits + CountTrailingZeroBits(bits)];
+                bits &= bits - 1;
+                int local = v.local;
+                int index = base + (local & mask) + ((local >> brick_bits) & mask) * resolution + (local >> (brick_bits * 2)) * res2;
+                func(index, v.values[feature] * scale);
+            }
+        }
+    }
+}
+
+// フレームキャッシュの使用メモリの内訳
+struct FrameCacheMemoryInfo {
+    int num_frames;
+    size_t num_voxels;
+    size_t num_bricks;
+    size_t reference_bytes;
+    size_t segment_bytes;
+    size_t brick_bytes;
+    size_t voxel_bytes;
+    size_t mask_bytes;
+    size_t total_bytes;        // 確保済みの領域を含む合計
+    size_t uncompressed_bytes; // 部位ごとの SegmentVoxelGrid で保持した場合の見積もり
+    size_t mapped_bytes;       // ファイルをマップして参照している場合のファイルサイズ（total_bytes には含まない）
+
+    FrameCacheMemoryInfo() : num_frames(0), num_voxels(0), num_bricks(0), reference_bytes(0), segment_bytes(0),
+                             brick_bytes(0), voxel_bytes(0), mask_bytes(0), total_bytes(0), uncompressed_bytes(0), mapped_bytes(0) {}
+};
+
 // フレーム数 × 部位数 の疎ボクセルグリッドキャッシュ
+// 全フレームの疎ボクセルを動作ごとに1つの配列にまとめ、位置はブリック内の座標、特徴量は量子化した値で保持する
+// 量子化の誤差は部位・フレームごとの各特徴量の最大値の 1/131070 以下
+// 構築時に sparse_threshold 以下となる特徴量の値は 0 とし、特徴量ごとに値が 0 でない疎ボクセルのマスクを持つ
+// （合成時に閾値と比較せず、各特徴量の値を持つ疎ボクセルのみを読み出す）
 struct MotionFrameSegmentVoxelGridCache {
+    static const int kBrickBits = kSparseVoxelBrickBits;
+    static const int kBrickSize = 1 << kBrickBits;
+
     int resolution;
     int num_segments;
-    std::vector<FrameSegmentVoxelGrid> frames;
+    std::vector<FrameReference> references;     // フレームごと
+    std::vector<CompactSegmentRecord> segments; // フレーム × 部位
+    std::vector<SparseVoxelBrick> bricks;
+    std::vector<QuantizedSparseVoxel> voxels;
+    std::vector<unsigned int> feature_masks[5];    // 特徴量ごとの値が 0 でない疎ボクセルのマスク（voxels と同じ番号）
+    std::vector<SegmentGridBounds> segment_bounds; // 部位ごとの局所グリッドの範囲（空ならワールド座標系の共通グリッド）
+    float sparse_threshold;                        // 構築時に除いた値の上限
 
-    MotionFrameSegmentVoxelGridCache() : resolution(0), num_segments(0) {}
+    MotionFrameSegmentVoxelGridCache() : resolution(0), num_segments(0), sparse_threshold(0.0f) {}
 
-    void Resize(int num_frames, int num_seg, int res) {
-        resolution = res;
-        num_segments = num_seg;
-        frames.clear();
-        frames.resize(num_frames);
-        for (int i = 0; i < num_frames; ++i)
-            frames[i].Resize(num_seg, res);
-    }
+    // キャッシュを空にして、指定フレーム数分の領域を確保（threshold 以下の特徴量の値は追加時に除く）
+    void Reset(int num_frames, int num_seg, int res, float threshold = 0.0f);
+
+    // 1フレーム分の疎ボクセルを量子化して末尾に追加（フレーム順に追加する）
+    void AppendFrame(const FrameSegmentVoxelGrid& frame);
+
+    // 構築後に余分に確保した領域を解放
+    void ShrinkToFit();
 
     void Clear() {
-        frames.clear();
+        references.clear();
+        segments.clear();
+        bricks.clear();
+        voxels.clear();
+        for (int f = 0; f < 5; ++f)
+            feature_masks[f].clear();
+        segment_bounds.clear();
         resolution = 0;
         num_segments = 0;
+        sparse_threshold = 0.0f;
     }
 
-    bool SaveToFile(const char* filename) const;
-    bool LoadFromFile(const char* filename);
-};
\ No newline at end of file
+    void Swap(MotionFrameSegmentVoxelGridCache& other);
+
+    int GetNumFrames() const { return (int)references.size(); }
+    int GetNumSegments() const { return num_segments; }
+    int GetResolution() const { return resolution; }
+    bool Empty() const { return references.empty(); }
+    const FrameReference& GetReference(int frame) const { return references[frame]; }
+    const SegmentGridBounds* GetSegmentBounds(int segment) const { return segment_bounds.empty() ? nullptr : &segment_bounds[segment]; }
+
+    // 指定フレーム・部位の指定特徴量が 0 でないボクセルについて func(線形インデックス, 値) を呼び出す
+    template <class Func>
+    void ForEachVoxel(int frame, int segment, int feature, Func func) const {
+        ForEachQuantizedSegmentVoxel(segments[(size_t)frame * num_segments + segment], bricks.data(), voxels.data(),
+                                     feature_masks[feature].data(), resolution, feature, func);
+    }
+
+    // 使用メモリの内訳
+    FrameCacheMemoryInfo GetMemoryInfo() const;
+};
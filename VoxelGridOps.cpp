@@ -0,0 +1,446 @@
+#include "VoxelGridOps.h"
+#include <atomic>
+#include <cmath>
+
+// SIMD命令（SSE2・AVX2）の使用（x86 以外では SIMD 命令を使わない実装のみ）
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#include <immintrin.h>
+#define VOXEL_GRID_OPS_USE_SSE2
+#define VOXEL_GRID_OPS_USE_AVX2
+#ifdef _MSC_VER
+#include <intrin.h>
+#define VOXEL_GRID_OPS_TARGET_AVX2
+#else
+#define VOXEL_GRID_OPS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// 合計の部分和の数
+static const int kSumLanes = 8;
+
+// 8つの部分和を決まった順序で足し合わせる
+static inline double vgo_combine_lanes(const double lanes[kSumLanes]) {
+    return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+// 演算の実装の関数表
+struct VoxelGridOpsTable {
+    void (*abs_diff)(const float* a, const float* b, float* out, size_t n);
+    float (*max)(const float* data, size_t n);
+    float (*max_abs_diff)(const float* a, const float* b, size_t n);
+    float (*abs_diff_max)(const float* a, const float* b, float* out, size_t n);
+    void (*scale)(float* data, size_t n, float scale);
+    size_t (*compact_above)(const float* data, size_t n, float threshold, int* out_indices, float* out_values);
+    double (*sum)(const float* data, size_t n);
+};
+
+
+// --- SIMD 命令を使わない実装 ---
+
+static void vgo_scalar_abs_diff(const float* a, const float* b, float* out, size_t n) {
+    for (size_t i = 0; i < n; ++i)
+        out[i] = fabsf(a[i] - b[i]);
+}
+
+static float vgo_scalar_max(const float* data, size_t n) {
+    float m = 0.0f;
+    for (size_t i = 0; i < n; ++i)
+        m = (data[i] > m) ? data[i] : m;
+    return m;
+}
+
+static float vgo_scalar_max_abs_diff(const float* a, const float* b, size_t n) {
+    float m = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        float d = fabsf(a[i] - b[i]);
+        m = (d > m) ? d : m;
+    }
+    return m;
+}
+
+static float vgo_scalar_abs_diff_max(const float* a, const float* b, float* out, size_t n) {
+    float m = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        float d = fabsf(a[i] - b[i]);
+        out[i] = d;
+        m = (d > m) ? d : m;
+    }
+    return m;
+}
+
+static void vgo_scalar_scale(float* data, size_t n, float scale) {
+    for (size_t i = 0; i < n; ++i)
+        data[i] *= scale;
+}
+
+// threshold より大きい要素を1つ出力
+static inline void vgo_emit(size_t i, float v, int* out_indices, float* out_values, size_t& count) {
+    if (out_indices)
+        out_indices[count] = (int)i;
+    if (out_values)
+        out_values[count] = v;
+    ++count;
+}
+
+static size_t vgo_scalar_compact_above(const float* data, size_t n, float threshold, int* out_indices, float* out_values) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i)
+        if (data[i] > threshold)
+            vgo_emit(i, data[i], out_indices, out_values, count);
+    return count;
+}
+
+static double vgo_scalar_sum(const float* data, size_t n) {
+    double lanes[kSumLanes] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+    size_t n8 = n - n % kSumLanes;
+    for (size_t i = 0; i < n8; i += kSumLanes)
+        for (int k = 0; k < kSumLanes; ++k)
+            lanes[k] += data[i + k];
+    double s = vgo_combine_lanes(lanes);
+    for (size_t i = n8; i < n; ++i)
+        s += data[i];
+    return s;
+}
+
+static const VoxelGridOpsTable kScalarOps = {
+    vgo_scalar_abs_diff, vgo_scalar_max, vgo_scalar_max_abs_diff, vgo_scalar_abs_diff_max,
+    vgo_scalar_scale, vgo_scalar_compact_above, vgo_scalar_sum
+};
+
+
+// --- SSE2 による実装（4要素ずつ、端数は SIMD 命令を使わない実装で計算） ---
+// 最大値は _mm_max_ps(d, m) とし、d が NaN の場合は m を残す（SIMD 命令を使わない実装の比較と同じ）
+#ifdef VOXEL_GRID_OPS_USE_SSE2
+
+static inline __m128 vgo_sse2_abs_mask() {
+    return _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+}
+
+static inline float vgo_sse2_reduce_max(__m128 v) {
+    float lanes[4];
+    _mm_storeu_ps(lanes, v);
+    return vgo_scalar_max(lanes, 4);
+}
+
+static void vgo_sse2_abs_diff(const float* a, const float* b, float* out, size_t n) {
+    const __m128 abs_mask = vgo_sse2_abs_mask();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(out + i, _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)), abs_mask));
+    vgo_scalar_abs_diff(a + i, b + i, out + i, n - i);
+}
+
+static float vgo_sse2_max(const float* data, size_t n) {
+    __m128 m = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        m = _mm_max_ps(_mm_loadu_ps(data + i), m);
+    float r = vgo_sse2_reduce_max(m);
+    float t = vgo_scalar_max(data + i, n - i);
+    return (t > r) ? t : r;
+}
+
+static float vgo_sse2_max_abs_diff(const float* a, const float* b, size_t n) {
+    const __m128 abs_mask = vgo_sse2_abs_mask();
+    __m128 m = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        m = _mm_max_ps(_mm_and_ps(_mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)), abs_mask), m);
+    float r = vgo_sse2_reduce_max(m);
+    float t = vgo_scalar_max_abs_diff(a + i, b + i, n - i);
+    return (t > r) ? t : r;
+}
+
+static float vgo_sse2_abs_diff_max(const float* a, const float* b, float* out, size_t n) {
+    const __m128 abs_mask = vgo_sse2_abs_mask();
+    __m128 m = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 d = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)), abs_mask);
+        _mm_storeu_ps(out + i, d);
+        m = _mm_max_ps(d, m);
+    }
+    float r = vgo_sse2_reduce_max(m);
+    float t = vgo_scalar_abs_diff_max(a + i, b + i, out + i, n - i);
+    return (t > r) ? t : r;
+}
+
+static void vgo_sse2_scale(float* data, size_t n, float scale) {
+    const __m128 s = _mm_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), s));
+    vgo_scalar_scale(data + i, n - i, scale);
+}
+
+// 4要素ずつ比較し、threshold より大きい要素がない場合は読み飛ばす（疎なグリッドではほとんどの要素を比較のみで読み飛ばす）
+static size_t vgo_sse2_compact_above(const float* data, size_t n, float threshold, int* out_indices, float* out_values) {
+    const __m128 t = _mm_set1_ps(threshold);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        int mask = _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(data + i), t));
+        if (mask == 0)
+            continue;
+        for (int k = 0; k < 4; ++k)
+            if (mask & (1 << k))
+                vgo_emit(i + k, data[i + k], out_indices, out_values, count);
+    }
+    for (; i < n; ++i)
+        if (data[i] > threshold)
+            vgo_emit(i, data[i], out_indices, out_values, count);
+    return count;
+}
+
+// 部分和 0～7 を2要素ずつ4つのレジスタで保持
+static double vgo_sse2_sum(const float* data, size_t n) {
+    __m128d acc[4] = { _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd() };
+    size_t n8 = n - n % kSumLanes;
+    for (size_t i = 0; i < n8; i += kSumLanes) {
+        __m128 lo = _mm_loadu_ps(data + i);
+        __m128 hi = _mm_loadu_ps(data + i + 4);
+        acc[0] = _mm_add_pd(acc[0], _mm_cvtps_pd(lo));
+        acc[1] = _mm_add_pd(acc[1], _mm_cvtps_pd(_mm_movehl_ps(lo, lo)));
+        acc[2] = _mm_add_pd(acc[2], _mm_cvtps_pd(hi));
+        acc[3] = _mm_add_pd(acc[3], _mm_cvtps_pd(_mm_movehl_ps(hi, hi)));
+    }
+    double lanes[kSumLanes];
+    for (int k = 0; k < 4; ++k)
+        _mm_storeu_pd(lanes + k * 2, acc[k]);
+    double s = vgo_combine_lanes(lanes);
+    for (size_t i = n8; i < n; ++i)
+        s += data[i];
+    return s;
+}
+
+static const VoxelGridOpsTable kSSE2Ops = {
+    vgo_sse2_abs_diff, vgo_sse2_max, vgo_sse2_max_abs_diff, vgo_sse2_abs_diff_max,
+    vgo_sse2_scale, vgo_sse2_compact_above, vgo_sse2_sum
+};
+
+#endif // VOXEL_GRID_OPS_USE_SSE2
+
+
+// --- AVX2 による実装（8要素ずつ、端数は SSE2 による実装で計算） ---
+#ifdef VOXEL_GRID_OPS_USE_AVX2
+
+VOXEL_GRID_OPS_TARGET_AVX2 static inline __m256 vgo_avx2_abs_mask() {
+    return _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+}
+
+VOXEL_GRID_OPS_TARGET_AVX2 static inline float vgo_avx2_reduce_max(__m256 v) {
+    float lanes[8];
+    _mm256_storeu_ps(lanes, v);
+    return vgo_scalar_max(lanes, 8);
+}
+
+VOXEL_GRID_OPS_TARGET_AVX2 static void vgo_avx2_abs_diff(const float* a, const float* b, float* out, size_t n) {
+    const __m256 abs_mask = vgo_avx2_abs_mask();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(out + i, _mm256_and_ps(_mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)), abs_mask));
+    vgo_sse2_abs_diff(a + i, b + i, out + i, n - i);
+}
+
+VOXEL_GRID_OPS_TARGET_AVX2 static float vgo_avx2_max(const float* data, size_t n) {
+    __m256 m = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        m = _mm256_max_ps(_mm256_loadu_ps(data + i), m);
+    float r = vgo_avx2_reduce_max(m);
+    float t = vgo_sse2_max(data + i, n - i);
+    return (t > r) ? t : r;
+}
+
+VOXEL_GRID_OPS_TARGET_AVX2 static float vgo_avx2_max_abs_diff(const float* a, const float* b, size_t n) {
+    const __m256 abs_mask = vgo_avx2_abs_mask();
+    __m256 m = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        m = _mm256_max_ps(_mm256_and_ps(_mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)), abs_mask), m);
+    float r = vgo_avx2_reduce_max(m);
+    float t = vgo_sse2_max_abs_diff(a + i, b + i, n - i);
+    return (t > r) ? t : r;
+}
+
+VOXEL_GRID_OPS_TARGET_AVX2 static float vgo_avx2_abs_diff_max(const float* a, const float* b, float* out, size_t n) {
+    const __m256 abs_mask = vgo_avx2_abs_mask();
+    __m256 m = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 d = _mm256_and_ps(_mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)), abs_mask);
+        _mm256_storeu_ps(out + i, d);
+        m = _mm256_max_ps(d, m);
+    }
+    float r = vgo_avx2_reduce_max(m);
+    float t = vgo_sse2_abs_diff_max(a + i, b + i, out + i, n - i);
+    return (t > r) ? t : r;
+}
+
+VOXEL_GRID_OPS_TARGET_AVX2 static void vgo_avx2_scale(float* data, size_t n, float scale) {
+    const __m256 s = _mm256_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(data + i, _mm256_mul_ps(_mm256_loadu_ps(data + i), s));
+    vgo_sse2_scale(data + i, n - i, scale);
+}
+
+VOXEL_GRID_OPS_TARGET_AVX2 static size_t vgo_avx2_compact_above(const float* data, size_t n, float threshold, int* out_indices, float* out_values) {
+    const __m256 t = _mm256_set1_ps(threshold);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(data + i), t, _CMP_GT_OQ));
+        if (mask == 0)
+            continue;
+        for (int k = 0; k < 8; ++k)
+            if (mask & (1 << k))
+                vgo_emit(i + k, data[i + k], out_indices, out_values, count);
+    }
+    for (; i < n; ++i)
+        if (data[i] > threshold)
+            vgo_emit(i, data[i], out_indices, out_values, count);
+    return count;
+}
+
+// 部分和 0～3・4～7 を4要素ずつ2つのレジスタで保持
+VOXEL_GRID_OPS_TARGET_AVX2 static double vgo_avx2_sum(const float* data, size_t n) {
+    __m256d acc_lo = _mm256_setzero_pd();
+    __m256d acc_hi = _mm256_setzero_pd();
+    size_t n8 = n - n % kSumLanes;
+    for (size_t i = 0; i < n8; i += kSumLanes) {
+        acc_lo = _mm256_add_pd(acc_lo, _mm256_cvtps_pd(_mm_loadu_ps(data + i)));
+        acc_hi = _mm256_add_pd(acc_hi, _mm256_cvtps_pd(_mm_loadu_ps(data + i + 4)));
+    }
+    double lanes[kSumLanes];
+    _mm256_storeu_pd(lanes, acc_lo);
+    _mm256_storeu_pd(lanes + 4, acc_hi);
+    double s = vgo_combine_lanes(lanes);
+    for (size_t i = n8; i < n; ++i)
+        s += data[i];
+    return s;
+}
+
+static const VoxelGridOpsTable kAVX2Ops = {
+    vgo_avx2_abs_diff, vgo_avx2_max, vgo_avx2_max_abs_diff, vgo_avx2_abs_diff_max,
+    vgo_avx2_scale, vgo_avx2_compact_above, vgo_avx2_sum
+};
+
+// CPU・OS が AVX2 に対応しているか（OS が YMM レジスタを保存するかも確認）
+static bool vgo_cpu_supports_avx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#endif // VOXEL_GRID_OPS_USE_AVX2
+
+
+// --- 実装の選択 ---
+
+// 実装の関数表（使えない実装は nullptr）
+static const VoxelGridOpsTable* vgo_get_table(int backend) {
+    switch (backend) {
+    case VOXEL_GRID_OPS_SCALAR:
+        return &kScalarOps;
+#ifdef VOXEL_GRID_OPS_USE_SSE2
+    case VOXEL_GRID_OPS_SSE2:
+        return &kSSE2Ops;
+#endif
+#ifdef VOXEL_GRID_OPS_USE_AVX2
+    case VOXEL_GRID_OPS_AVX2: {
+        static const bool supported = vgo_cpu_supports_avx2();
+        return supported ? &kAVX2Ops : nullptr;
+    }
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+// 実行中のCPUで使える最も幅の広い実装
+static int vgo_detect_backend() {
+    for (int backend = VOXEL_GRID_OPS_COUNT - 1; backend > VOXEL_GRID_OPS_SCALAR; --backend)
+        if (vgo_get_table(backend))
+            return backend;
+    return VOXEL_GRID_OPS_SCALAR;
+}
+
+// 使用中の実装（初回の呼び出し時に選択）
+static std::atomic<int>& vgo_current_backend() {
+    static std::atomic<int> backend(vgo_detect_backend());
+    return backend;
+}
+
+static inline const VoxelGridOpsTable& vgo_ops() {
+    return *vgo_get_table(vgo_current_backend().load(std::memory_order_relaxed));
+}
+
+const char* GetVoxelGridOpsBackendName(int backend) {
+    switch (backend) {
+    case VOXEL_GRID_OPS_SCALAR: return "scalar";
+    case VOXEL_GRID_OPS_SSE2: return "sse2";
+    case VOXEL_GRID_OPS_AVX2: return "avx2";
+    default: return "unknown";
+    }
+}
+
+bool IsVoxelGridOpsBackendSupported(int backend) {
+    return vgo_get_table(backend) != nullptr;
+}
+
+VoxelGridOpsBackend GetVoxelGridOpsBackend() {
+    return (VoxelGridOpsBackend)vgo_current_backend().load(std::memory_order_relaxed);
+}
+
+bool SetVoxelGridOpsBackend(int backend) {
+    if (!IsVoxelGridOpsBackendSupported(backend))
+        return false;
+    vgo_current_backend().store(backend, std::memory_order_relaxed);
+    return true;
+}
+
+
+// --- 演算 ---
+
+void VoxelGridAbsDiff(const float* a, const float* b, float* out, size_t n) {
+    vgo_ops().abs_diff(a, b, out, n);
+}
+
+float VoxelGridMax(const float* data, size_t n) {
+    return vgo_ops().max(data, n);
+}
+
+float VoxelGridMaxAbsDiff(const float* a, const float* b, size_t n) {
+    return vgo_ops().max_abs_diff(a, b, n);
+}
+
+float VoxelGridAbsDiffMax(const float* a, const float* b, float* out, size_t n) {
+    return vgo_ops().abs_diff_max(a, b, out, n);
+}
+
+void VoxelGridScale(float* data, size_t n, float scale) {
+    vgo_ops().scale(data, n, scale);
+}
+
+size_t VoxelGridCompactAbove(const float* data, size_t n, float threshold, int* out_indices, float* out_values) {
+    return vgo_ops().compact_above(data, n, threshold, out_indices, out_values);
+}
+
+double VoxelGridSum(const float* data, size_t n) {
+    return vgo_ops().sum(data, n);
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+
+// ボクセルグリッドの値の配列（VoxelGrid::data など）に対する演算
+// 実行時のCPUに応じて SIMD 命令（AVX2・SSE2）による実装を選び、対応していないCPUでは SIMD 命令を使わない実装を使う
+// いずれの実装も要素ごとの演算・比較の結果は同じで、合計は決まった順序で加算するため、実装によらず同じ値を返す
+// 最大値は各要素と 0 の最大値（NaN は無視）、差分は差の絶対値とする
+
+// 演算の実装
+enum VoxelGridOpsBackend {
+    VOXEL_GRID_OPS_SCALAR = 0, // SIMD 命令を使わない実装
+    VOXEL_GRID_OPS_SSE2 = 1,   // 4要素ずつ
+    VOXEL_GRID_OPS_AVX2 = 2,   // 8要素ずつ
+    VOXEL_GRID_OPS_COUNT = 3
+};
+
+// 実装の名前を取得（scalar, sse2, avx2）
+const char* GetVoxelGridOpsBackendName(int backend);
+
+// 実装が実行中のCPUで使えるか
+bool IsVoxelGridOpsBackendSupported(int backend);
+
+// 使用中の実装（既定は実行中のCPUで使える最も幅の広い実装）
+VoxelGridOpsBackend GetVoxelGridOpsBackend();
+
+// 使用する実装を変更（検証・計測用、使えない実装なら変更せず false を返す）
+bool SetVoxelGridOpsBackend(int backend);
+
+// out[i] = |a[i] - b[i]|
+void VoxelGridAbsDiff(const float* a, const float* b, float* out, size_t n);
+
+// max(0, data[i])
+float VoxelGridMax(const float* data, size_t n);
+
+// max(0, |a[i] - b[i]|)
+float VoxelGridMaxAbsDiff(const float* a, const float* b, size_t n);
+
+// out[i] = |a[i] - b[i]| を計算し、その最大値を返す（差分の計算と最大値の計算を1回の読み出しで行う）
+float VoxelGridAbsDiffMax(const float* a, const float* b, float* out, size_t n);
+
+// data[i] *= scale
+void VoxelGridScale(float* data, size_t n, float scale);
+
+// threshold より大きい要素の番号・値を順に out_indices・out_values に格納し、その数を返す（いずれも nullptr なら数のみ数える）
+// 出力先には最大 n 個を格納できる領域を用意する
+size_t VoxelGridCompactAbove(const float* data, size_t n, float threshold, int* out_indices, float* out_values);
+
+// 全要素の合計（倍精度、8要素ごとに同じ位置の要素を加算した8つの部分和を最後に足し合わせる）
+double VoxelGridSum(const float* data, size_t n);
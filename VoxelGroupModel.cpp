@@ -0,0 +1,339 @@
+#include "VoxelGroupModel.h"
+#include "VoxelGridOps.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+// ファイルの識別子・形式の版
+static const char kGroupModelFileMagic[8] = { 'S', 'H', 'V', 'G', 'R', 'P', '\0', '\0' };
+static const int kGroupModelFileVersion = 1;
+
+// ファイルの先頭
+struct GroupModelFileHeader {
+    char magic[8];
+    int version;
+    int feature;
+    int resolution;
+    int num_takes;
+    float world_bounds[3][2];
+    unsigned long long num_entries; // 保存したボクセル数
+};
+
+// ファイルに保存するボクセルの統計
+struct GroupModelFileEntry {
+    int index;
+    unsigned int count;
+    float mean;
+    float m2;
+};
+
+// ボクセル番号の区間 [0, count) を分割して複数のスレッドで処理（最初の区間は呼び出し元のスレッドで処理）
+template <class FUNC>
+static void vgm_parallel_for(size_t count, size_t min_per_thread, FUNC func) {
+    if (count == 0)
+        return;
+
+    int num_threads = (int)std::thread::hardware_concurrency();
+    if (num_threads <= 0)
+        num_threads = 1;
+    num_threads = (int)(std::min)((size_t)num_threads, (std::max)((size_t)1, count / min_per_thread));
+
+    std::vector<std::thread> workers;
+    size_t per_thread = (count + num_threads - 1) / num_threads;
+    for (int t = 1; t < num_threads; ++t) {
+        size_t b = t * per_thread;
+        size_t e = (std::min)(b + per_thread, count);
+        if (b < e)
+            workers.push_back(std::thread(func, b, e));
+    }
+    func((size_t)0, (std::min)(per_thread, count));
+    for (size_t t = 0; t < workers.size(); ++t)
+        workers[t].join();
+}
+
+// 1スレッドあたりの最小ボクセル数
+static const size_t kGroupModelVoxelsPerThread = 1 << 16;
+
+VoxelGroupModel::VoxelGroupModel() : feature(0), resolution(0), num_takes(0) {
+    memset(world_bounds, 0, sizeof(world_bounds));
+}
+
+// 特徴量・解像度・グリッドの範囲を設定して空にする
+void VoxelGroupModel::Reset(int f, int res, const float bounds[3][2]) {
+    feature = f;
+    resolution = res;
+    num_takes = 0;
+    memcpy(world_bounds, bounds, sizeof(world_bounds));
+    VoxelMoments zero = { 0, 0.0f, 0.0f };
+    moments.assign((size_t)res * res * res, zero);
+}
+
+// 解像度・グリッドの範囲が同じか
+bool VoxelGroupModel::IsCompatible(int res, const float bounds[3][2]) const {
+    if (res != resolution)
+        return false;
+    for (int a = 0; a < 3; ++a) {
+        float extent = (std::max)(fabsf(world_bounds[a][1] - world_bounds[a][0]), 1e-6f);
+        for (int s = 0; s < 2; ++s) {
+            if (fabsf(bounds[a][s] - world_bounds[a][s]) > extent * 1e-4f)
+                return false;
+        }
+    }
+    return true;
+}
+
+// ボクセルの統計を n 回目の試行までに更新
+// count 個の値の平均 m・偏差平方和 M2 に値 0 を (n - count) 個加えると、平均は m * count / n、偏差平方和は M2 + m^2 * count * (n - count) / n
+void VoxelGroupModel::CatchUp(const VoxelMoments& v, int n, double& mean, double& m2) {
+    mean = v.mean;
+    m2 = v.m2;
+    if (v.count == 0 || (int)v.count >= n) {
+        if (v.count == 0) {
+            mean = 0.0;
+            m2 = 0.0;
+        }
+        return;
+    }
+    double k = (double)v.count;
+    double nn = (double)n;
+    m2 += mean * mean * k * (nn - k) / nn;
+    mean *= k / nn;
+}
+
+// 1試行分のグリッドを追加
+bool VoxelGroupModel::AddTake(const VoxelGrid& grid) {
+    if (grid.resolution != resolution || moments.empty())
+        return false;
+
+    // 値が 0 より大きいボクセルを詰める
+    size_t n = grid.data.size();
+    take_indices.resize(n);
+    take_values.resize(n);
+    size_t num_active = VoxelGridCompactAbove(grid.data.data(), n, 0.0f, take_indices.data(), take_values.data());
+
+    // 値のあるボクセルのみを Welford の方法で更新（それまでの値 0 の試行を先に反映）
+    int prev_takes = num_takes;
+    VoxelMoments* m = moments.data();
+    const int* indices = take_indices.data();
+    const float* values = take_values.data();
+    vgm_parallel_for(num_active, kGroupModelVoxelsPerThread / 4, [=](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            VoxelMoments& v = m[indices[i]];
+            double mean, m2;
+            CatchUp(v, prev_takes, mean, m2);
+            double x = values[i];
+            double delta = x - mean;
+            mean += delta / (double)(prev_takes + 1);
+            m2 += delta * (x - mean);
+            v.count = (unsigned int)(prev_takes + 1);
+            v.mean = (float)mean;
+            v.m2 = (float)m2;
+        }
+    });
+    ++num_takes;
+    return true;
+}
+
+// 別のモデルの試行を統合
+// 試行数 na・nb の2つの統計の平均の差を d とすると、平均は ma + d * nb / n、偏差平方和は M2a + M2b + d^2 * na * nb / n
+bool VoxelGroupModel::Merge(const VoxelGroupModel& other) {
+    if (other.feature != feature || !IsCompatible(other.resolution, other.world_bounds))
+        return false;
+    if (other.num_takes == 0)
+        return true;
+
+    int na = num_takes;
+    int nb = other.num_takes;
+    VoxelMoments* a = moments.data();
+    const VoxelMoments* b = other.moments.data();
+    vgm_parallel_for(moments.size(), kGroupModelVoxelsPerThread, [=](size_t begin, size_t end) {
+        double n = (double)(na + nb);
+        for (size_t i = begin; i < end; ++i) {
+            // どちらの試行も全て 0 のボクセルは更新しない
+            if (a[i].count == 0 && b[i].count == 0)
+                continue;
+            double mean_a, m2_a, mean_b, m2_b;
+            CatchUp(a[i], na, mean_a, m2_a);
+            CatchUp(b[i], nb, mean_b, m2_b);
+            double d = mean_b - mean_a;
+            a[i].count = (unsigned int)(na + nb);
+            a[i].mean = (float)(mean_a + d * nb / n);
+            a[i].m2 = (float)(m2_a + m2_b + d * d * na * nb / n);
+        }
+    });
+    num_takes += nb;
+    return true;
+}
+
+// ボクセルの全試行の平均
+float VoxelGroupModel::GetMean(size_t index) const {
+    if (index >= moments.size())
+        return 0.0f;
+    double mean, m2;
+    CatchUp(moments[index], num_takes, mean, m2);
+    return (float)mean;
+}
+
+// ボクセルの全試行の不偏分散
+float VoxelGroupModel::GetVariance(size_t index) const {
+    if (index >= moments.size() || num_takes < 2)
+        return 0.0f;
+    double mean, m2;
+    CatchUp(moments[index], num_takes, mean, m2);
+    return (float)(std::max)(0.0, m2 / (num_takes - 1));
+}
+
+// 全ボクセルの平均のグリッド
+void VoxelGroupModel::GetMeanGrid(VoxelGrid& out) const {
+    if (out.resolution != resolution)
+        out.Resize(resolution);
+    for (size_t i = 0; i < moments.size(); ++i)
+        out.data[i] = GetMean(i);
+    out.MarkAllDirty();
+}
+
+// 全ボクセルの標準偏差のグリッド
+void VoxelGroupModel::GetStdDevGrid(VoxelGrid& out) const {
+    if (out.resolution != resolution)
+        out.Resize(resolution);
+    for (size_t i = 0; i < moments.size(); ++i)
+        out.data[i] = sqrtf(GetVariance(i));
+    out.MarkAllDirty();
+}
+
+// 試行のグリッドの集団に対する z 値
+float VoxelGroupModel::ComputeZScoreGrid(const VoxelGrid& take, VoxelGrid& out, float relative_floor, bool absolute) const {
+    if (take.resolution != resolution || moments.empty())
+        return 0.0f;
+    if (out.resolution != resolution)
+        out.Resize(resolution);
+
+    // 試行数が 2 未満ならばらつきがないため z 値は求めない
+    if (num_takes < 2) {
+        std::fill(out.data.begin(), out.data.end(), 0.0f);
+        out.MarkAllDirty();
+        return 0.0f;
+    }
+
+    // 標準偏差の下限（全ボクセルの標準偏差の最大値に対する割合）
+    // 一度も値を持たなかったボクセルは平均・分散とも 0 のため調べない
+    int n = num_takes;
+    const VoxelMoments* m = moments.data();
+    size_t count = moments.size();
+    int num_chunks = (int)((count + kGroupModelVoxelsPerThread - 1) / kGroupModelVoxelsPerThread);
+    std::vector<float> chunk_max(num_chunks, 0.0f);
+    float* chunk_max_ptr = chunk_max.data();
+    vgm_parallel_for((size_t)num_chunks, 1, [=](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+            float max_var = 0.0f;
+            size_t e = (std::min)((c + 1) * kGroupModelVoxelsPerThread, count);
+            for (size_t i = c * kGroupModelVoxelsPerThread; i < e; ++i) {
+                if (m[i].count == 0)
+                    continue;
+                double mean, m2;
+                CatchUp(m[i], n, mean, m2);
+                max_var = (std::max)(max_var, (float)(m2 / (n - 1)));
+            }
+            chunk_max_ptr[c] = max_var;
+        }
+    });
+    float max_var = 0.0f;
+    for (int c = 0; c < num_chunks; ++c)
+        max_var = (std::max)(max_var, chunk_max[c]);
+    double min_stddev = (std::max)((double)sqrtf(max_var) * relative_floor, 1e-12);
+
+    // z 値（区間ごとの絶対値の最大値を最後に集約）
+    const float* x = take.data.data();
+    float* z = out.data.data();
+    vgm_parallel_for((size_t)num_chunks, 1, [=](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+            float max_z = 0.0f;
+            size_t e = (std::min)((c + 1) * kGroupModelVoxelsPerThread, count);
+            for (size_t i = c * kGroupModelVoxelsPerThread; i < e; ++i) {
+                double mean, m2;
+                CatchUp(m[i], n, mean, m2);
+                double stddev = (std::max)(sqrt((std::max)(0.0, m2 / (n - 1))), min_stddev);
+                float v = (float)(((double)(std::max)(x[i], 0.0f) - mean) / stddev);
+                if (absolute)
+                    v = fabsf(v);
+                z[i] = v;
+                max_z = (std::max)(max_z, fabsf(v));
+            }
+            chunk_max_ptr[c] = max_z;
+        }
+    });
+    float max_z = 0.0f;
+    for (int c = 0; c < num_chunks; ++c)
+        max_z = (std::max)(max_z, chunk_max[c]);
+    out.MarkAllDirty();
+    return max_z;
+}
+
+// ファイル保存
+bool VoxelGroupModel::SaveToFile(const char* filename) const {
+    std::vector<GroupModelFileEntry> entries;
+    for (size_t i = 0; i < moments.size(); ++i) {
+        if (moments[i].count == 0)
+            continue;
+        GroupModelFileEntry e = { (int)i, moments[i].count, moments[i].mean, moments[i].m2 };
+        entries.push_back(e);
+    }
+
+    GroupModelFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kGroupModelFileMagic, sizeof(header.magic));
+    header.version = kGroupModelFileVersion;
+    header.feature = feature;
+    header.resolution = resolution;
+    header.num_takes = num_takes;
+    memcpy(header.world_bounds, world_bounds, sizeof(world_bounds));
+    header.num_entries = entries.size();
+
+    FILE* fp = fopen(filename, "wb");
+    if (!fp)
+        return false;
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = ok && (entries.empty() || fwrite(entries.data(), sizeof(GroupModelFileEntry), entries.size(), fp) == entries.size());
+    ok = (fclose(fp) == 0) && ok;
+    return ok;
+}
+
+// ファイル読み込み（失敗した場合は変更しない）
+bool VoxelGroupModel::LoadFromFile(const char* filename) {
+    FILE* fp = fopen(filename, "rb");
+    if (!fp)
+        return false;
+
+    GroupModelFileHeader header;
+    bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+              memcmp(header.magic, kGroupModelFileMagic, sizeof(header.magic)) == 0 &&
+              header.version == kGroupModelFileVersion &&
+              header.resolution > 0 && header.num_takes >= 0 &&
+              header.num_entries <= (unsigned long long)header.resolution * header.resolution * header.resolution;
+    std::vector<GroupModelFileEntry> entries;
+    if (ok) {
+        entries.resize((size_t)header.num_entries);
+        ok = entries.empty() || fread(entries.data(), sizeof(GroupModelFileEntry), entries.size(), fp) == entries.size();
+    }
+    fclose(fp);
+    if (!ok)
+        return false;
+
+    size_t num_voxels = (size_t)header.resolution * header.resolution * header.resolution;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].index < 0 || (size_t)entries[i].index >= num_voxels || (int)entries[i].count > header.num_takes)
+            return false;
+    }
+
+    Reset(header.feature, header.resolution, header.world_bounds);
+    num_takes = header.num_takes;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        VoxelMoments& v = moments[entries[i].index];
+        v.count = entries[i].count;
+        v.mean = entries[i].mean;
+        v.m2 = entries[i].m2;
+    }
+    return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <vector>
+#include "VoxelData.h"
+
+// 複数の試行（同じ動作を複数回計測した動作など）の1つの特徴量のグリッドの、ボクセルごとの平均・分散の統計モデル
+// 試行ごとのグリッドを Welford の方法で逐次に加え、新しい試行のグリッドの集団に対する z 値を求める
+// 保持するのはボクセルごとの平均・偏差平方和と更新済みの試行数のみのため、使用メモリは試行数によらず解像度の3乗に比例する
+//
+// 試行のグリッドの大部分は 0 のため、追加時は値が 0 より大きいボクセルのみを更新し、
+// 値が 0 の試行はボクセルの更新済みの試行数との差として参照時・次の更新時にまとめて反映する
+// （特徴量の値は 0 以上とし、0 以下の値は 0 とみなす）
+// 追加・統合・z 値の計算はボクセルを区間に分けて複数のスレッドで並列に処理する
+class VoxelGroupModel {
+public:
+    VoxelGroupModel();
+
+    // 特徴量・解像度・グリッドの範囲を設定して空にする
+    void Reset(int feature, int resolution, const float world_bounds[3][2]);
+
+    // 解像度・グリッドの範囲が同じか（同じグリッドで計算した試行のみを比較できる）
+    bool IsCompatible(int resolution, const float world_bounds[3][2]) const;
+
+    int GetFeature() const { return feature; }
+    int GetResolution() const { return resolution; }
+    int GetNumTakes() const { return num_takes; }
+    float GetWorldBound(int axis, int side) const { return world_bounds[axis][side]; }
+    size_t GetMemoryBytes() const { return moments.capacity() * sizeof(VoxelMoments); }
+
+    // 1試行分のグリッドを追加（解像度が異なる場合は false）
+    bool AddTake(const VoxelGrid& grid);
+
+    // 別のモデル（同じ特徴量・グリッド）の試行を統合（並列に作成した部分的なモデルの統合用）
+    bool Merge(const VoxelGroupModel& other);
+
+    // ボクセルの全試行の平均・不偏分散（試行数が 2 未満なら分散は 0）
+    float GetMean(size_t index) const;
+    float GetVariance(size_t index) const;
+
+    // 全ボクセルの平均・標準偏差のグリッド
+    void GetMeanGrid(VoxelGrid& out) const;
+    void GetStdDevGrid(VoxelGrid& out) const;
+
+    // 試行のグリッドの集団に対する z 値 (x - 平均) / 標準偏差 を out に格納し、z 値の絶対値の最大値を返す
+    // 標準偏差は全ボクセルの標準偏差の最大値の relative_floor 倍を下限とする（ほとんどばらつかないボクセルで z 値が発散しないようにする）
+    // absolute が true なら z 値の絶対値を格納する（差分と同じく 0 以上の値として表示する場合）
+    float ComputeZScoreGrid(const VoxelGrid& take, VoxelGrid& out, float relative_floor, bool absolute) const;
+
+    // ファイル保存・読み込み（更新済みの試行数が 1 以上のボクセルのみを保存）
+    bool SaveToFile(const char* filename) const;
+    bool LoadFromFile(const char* filename);
+
+private:
+    // ボクセルごとの統計（count 回目の試行までの平均・偏差平方和、以降の試行の値は 0）
+    struct VoxelMoments {
+        unsigned int count;
+        float mean;
+        float m2;
+    };
+
+    // ボクセルの統計を n 回目の試行までに更新した平均・偏差平方和（count から n までの試行の値 0 を加える）
+    static void CatchUp(const VoxelMoments& v, int n, double& mean, double& m2);
+
+    int feature;
+    int resolution;
+    int num_takes;
+    float world_bounds[3][2];
+    std::vector<VoxelMoments> moments; // 解像度の3乗個
+
+    // 追加時に値が 0 より大きいボクセルを詰めた作業領域
+    std::vector<int> take_indices;
+    std::vector<float> take_values;
+};
@@ -0,0 +1,132 @@
+#include "VoxelPyramid.h"
+#include <algorithm>
+#include <cfloat>
+
+VoxelGridPyramid::VoxelGridPyramid() : reduce(VOXEL_PYRAMID_SUM), base_resolution(0), valid(false) {}
+
+// 集約方法を設定
+void VoxelGridPyramid::SetReduce(VoxelPyramidReduce r) {
+    if (reduce != r)
+        valid = false;
+    reduce = r;
+}
+
+// 段の解像度
+int VoxelGridPyramid::GetLevelResolution(int level) const {
+    if (level <= 0)
+        return base_resolution;
+    return (base_resolution + (1 << level) - 1) >> level;
+}
+
+// 段の値を表示用の値に換算する係数
+float VoxelGridPyramid::GetLevelScale(int level) const {
+    if (reduce != VOXEL_PYRAMID_SUM || level <= 0)
+        return 1.0f;
+    return 1.0f / (float)(1 << (3 * level));
+}
+
+// 段の格子の値
+float VoxelGridPyramid::GetLevelValue(const VoxelGrid& base, int level, int x, int y, int z) const {
+    if (level <= 0 || !valid)
+        return base.Get(x, y, z);
+    if (level > (int)levels.size())
+        level = (int)levels.size();
+    return levels[level - 1].Get(x, y, z);
+}
+
+// 全段を構築
+void VoxelGridPyramid::Build(const VoxelGrid& base) {
+    if (valid && base_resolution == base.resolution)
+        return;
+
+    base_resolution = base.resolution;
+    int num_levels = 0;
+    for (int r = base_resolution; r > 1; r = (r + 1) / 2)
+        ++num_levels;
+    levels.resize(num_levels);
+    for (int level = 1; level <= num_levels; ++level)
+        BuildLevel(base, level);
+    valid = true;
+}
+
+// 段を1つ下の段から集約
+void VoxelGridPyramid::BuildLevel(const VoxelGrid& base, int level) {
+    const VoxelGrid& src = (level == 1) ? base : levels[level - 2];
+    VoxelGrid& dst = levels[level - 1];
+    int sr = src.resolution;
+    int dr = (sr + 1) / 2;
+    if (dst.resolution != dr)
+        dst.Resize(dr);
+    std::fill(dst.data.begin(), dst.data.end(), (reduce == VOXEL_PYRAMID_SUM) ? 0.0f : -FLT_MAX);
+
+    // 下の段の行を順に読み、親の格子に集約（書き込み先の行は2行ごとに変わる）
+    for (int z = 0; z < sr; ++z) {
+        for (int y = 0; y < sr; ++y) {
+            const float* row = &src.data[((size_t)z * sr + y) * sr];
+            float* parent = &dst.data[((size_t)(z >> 1) * dr + (y >> 1)) * dr];
+            if (reduce == VOXEL_PYRAMID_SUM) {
+                for (int x = 0; x < sr; ++x)
+                    parent[x >> 1] += row[x];
+            } else {
+                for (int x = 0; x < sr; ++x)
+                    parent[x >> 1] = (std::max)(parent[x >> 1], row[x]);
+            }
+        }
+    }
+}
+
+// 値が threshold 以上の格子を最上段から絞り込んで列挙
+void VoxelGridPyramid::CollectCellsAbove(const VoxelGrid& base, int level, float threshold, std::vector<int>& out) const {
+    out.clear();
+    if (base.resolution <= 0)
+        return;
+
+    // 未構築なら段 0 を直接調べる
+    if (!valid || base_resolution != base.resolution || level > (int)levels.size()) {
+        if (level != 0)
+            return;
+        for (size_t i = 0; i < base.data.size(); ++i) {
+            if (base.data[i] >= threshold)
+                out.push_back((int)i);
+        }
+        return;
+    }
+    if (level < 0)
+        level = 0;
+
+    // 調べる格子（段・座標）
+    struct Cell {
+        int level, x, y, z;
+    };
+    std::vector<Cell> stack;
+    int top = (int)levels.size();
+    int top_res = GetLevelResolution(top);
+    for (int z = 0; z < top_res; ++z)
+        for (int y = 0; y < top_res; ++y)
+            for (int x = 0; x < top_res; ++x) {
+                Cell c = { top, x, y, z };
+                stack.push_back(c);
+            }
+
+    int target_res = GetLevelResolution(level);
+    while (!stack.empty()) {
+        Cell c = stack.back();
+        stack.pop_back();
+        if (GetLevelValue(base, c.level, c.x, c.y, c.z) < threshold)
+            continue;
+        if (c.level == level) {
+            out.push_back((c.z * target_res + c.y) * target_res + c.x);
+            continue;
+        }
+
+        // 子の格子（下の段の範囲外は除く）
+        int child_res = GetLevelResolution(c.level - 1);
+        for (int dz = 1; dz >= 0; --dz)
+            for (int dy = 1; dy >= 0; --dy)
+                for (int dx = 1; dx >= 0; --dx) {
+                    Cell child = { c.level - 1, c.x * 2 + dx, c.y * 2 + dy, c.z * 2 + dz };
+                    if (child.x < child_res && child.y < child_res && child.z < child_res)
+                        stack.push_back(child);
+                }
+    }
+}
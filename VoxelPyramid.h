@@ -0,0 +1,65 @@
+#pragma once
+#include <vector>
+#include "VoxelData.h"
+
+// 上位の段への集約方法
+enum VoxelPyramidReduce {
+    VOXEL_PYRAMID_SUM = 0, // 8個の子の合計（占有率）
+    VOXEL_PYRAMID_MAX = 1  // 8個の子の最大値（速度・ジャーク・慣性モーメント・慣性主軸角速度）
+};
+
+// 特徴量に対応する集約方法（占有率は合計、それ以外は最大値）
+inline VoxelPyramidReduce GetVoxelPyramidReduce(int feature) {
+    return (feature == 0) ? VOXEL_PYRAMID_SUM : VOXEL_PYRAMID_MAX;
+}
+
+// ボクセルグリッドの多重解像度ピラミッド（表示の詳細度の切り替え・粗い段からの差分の絞り込み用）
+// 段 0 は元のグリッド（保持しない）で、段 k は解像度 ceil(res / 2^k)、段 k の (x, y, z) は段 k-1 の (2x～2x+1, 2y～2y+1, 2z～2z+1) を集約する
+// 元のグリッドが更新されたら Invalidate() を呼び、必要になった時点で Build() で再構築する
+// （各段は1つ下の段から作るため、全段の構築は元のグリッドを1回読むのとほぼ同じ時間で済み、メモリは元のグリッドの 1/7 程度）
+class VoxelGridPyramid {
+public:
+    VoxelGridPyramid();
+
+    // 集約方法を設定（変わった場合は構築済みの段を破棄）
+    void SetReduce(VoxelPyramidReduce r);
+    VoxelPyramidReduce GetReduce() const { return reduce; }
+
+    // 元のグリッドの更新を通知（次回の Build() で全段を再構築）
+    void Invalidate() { valid = false; }
+    bool IsValid() const { return valid; }
+
+    // 元のグリッドから全段（解像度 1 まで）を構築（構築済みで元のグリッドの解像度が同じなら何もしない）
+    void Build(const VoxelGrid& base);
+
+    // 構築済みの最上段の番号（未構築なら 0）
+    int GetTopLevel() const { return valid ? (int)levels.size() : 0; }
+
+    // 段の解像度
+    int GetLevelResolution(int level) const;
+
+    // 段の値を表示用の値に換算する係数（合計なら子孫のボクセル数の逆数で平均に換算、最大値なら 1）
+    float GetLevelScale(int level) const;
+
+    // 段の格子の値（level 0 は元のグリッド、範囲外は 0）
+    float GetLevelValue(const VoxelGrid& base, int level, int x, int y, int z) const;
+
+    // 元のグリッドのボクセル座標を含む段の格子の値
+    float GetValueAtBaseVoxel(const VoxelGrid& base, int level, int x, int y, int z) const {
+        return GetLevelValue(base, level, x >> level, y >> level, z >> level);
+    }
+
+    // 段 level の格子のうち値が threshold 以上のものの格子番号を out に格納（順序は不定）
+    // 値は 0 以上とし、子の値は親の値以下となるため、最上段から値が threshold 以上の格子の子のみをたどる
+    // （粗い段で値の大きい領域を見つけてから細かい段に絞り込むため、値の小さい領域は調べない）
+    void CollectCellsAbove(const VoxelGrid& base, int level, float threshold, std::vector<int>& out) const;
+
+private:
+    // 段 level（1 以上）を1つ下の段から集約
+    void BuildLevel(const VoxelGrid& base, int level);
+
+    VoxelPyramidReduce reduce;
+    int base_resolution;
+    bool valid;
+    std::vector<VoxelGrid> levels; // levels[k - 1] が段 k
+};
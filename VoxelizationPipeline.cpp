@@ -0,0 +1,621 @@
+#include "VoxelizationPipeline.h"
+#include "FrameVoxelStore.h"
+#include "ScratchArena.h"
+#include "Trace.h"
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+
+// SIMD命令（SSE）の使用
+#if defined( _M_X64 ) || defined( __SSE2__ )
+#include <emmintrin.h>
+#define  VOXELIZATION_PIPELINE_USE_SSE
+#endif
+
+using namespace std;
+
+// --- 作業領域 ---
+
+// 姿勢の作業領域（4フレーム分の姿勢の関節回転の配列を再利用）
+struct VpPoseScratch {
+    Posture curr, prev, prev2, prev3;
+    const Skeleton* body;
+    int num_joints;
+
+    VpPoseScratch() : body(nullptr), num_joints(0) {}
+
+    // 骨格が変わった場合のみ姿勢を初期化
+    void Bind(const Skeleton* b) {
+        if (body == b && num_joints == b->num_joints)
+            return;
+        curr.Init(b);
+        prev.Init(b);
+        prev2.Init(b);
+        prev3.Init(b);
+        body = b;
+        num_joints = b->num_joints;
+    }
+};
+
+// 1フレーム分のボクセル化の作業領域（変換行列・ボーンの配列を再利用）
+struct VpFrameScratch {
+    FrameData frame_data;
+    std::vector<BoneData> bones;
+    std::vector<std::vector<SparseVoxel>> seg_sparse_values;
+};
+
+// --- 集約方法 ---
+
+// 既存の疎ボクセルに書き込みを集約（占有率は合計、速度・ジャーク・慣性モーメントは最大値）
+static inline void vp_merge_sparse_values(SparseVoxel& sv, float presence, float speed, float jerk, float inertia) {
+    sv.values[0] += presence;
+    if (speed > sv.values[1])
+        sv.values[1] = speed;
+    if (jerk > sv.values[2])
+        sv.values[2] = jerk;
+    if (inertia > sv.values[3])
+        sv.values[3] = inertia;
+}
+// Begin() で出力先の疎ボクセルの配列を設定し、Add() で書き込み、End() で出力先に集約結果を格納する
+// 書き込み順に最初の書き込みの位置へ集約するため、占有率の加算順序はいずれの方法でも同じになる
+
+// 解像度の3乗の対応表（未使用のボクセルは -1、End() で書き込んだボクセルのみ -1 に戻す）
+class DenseVoxelAccumulator {
+public:
+    void Begin(int resolution, std::vector<SparseVoxel>* out) {
+        int size = resolution * resolution * resolution;
+        if ((int)index_to_pos.size() != size)
+            index_to_pos.assign(size, -1);
+        sparse = out;
+    }
+
+    void Add(int index, float presence, float speed, float jerk, float inertia) {
+        int pos = index_to_pos[index];
+        if (pos < 0) {
+            index_to_pos[index] = (int)sparse->size();
+            sparse->push_back(SparseVoxel(index, presence, speed, jerk, inertia, 0.0f));
+        } else {
+            vp_merge_sparse_values((*sparse)[pos], presence, speed, jerk, inertia);
+        }
+    }
+
+    void End() {
+        for (size_t k = 0; k < sparse->size(); ++k)
+            index_to_pos[(*sparse)[k].index] = -1;
+    }
+
+private:
+    std::vector<int> index_to_pos;
+    std::vector<SparseVoxel>* sparse;
+};
+
+// ハッシュ表（部位ごとに空にして、確保済みのバケットを再利用）
+class HashVoxelAccumulator {
+public:
+    void Begin(int /*resolution*/, std::vector<SparseVoxel>* out) {
+        index_to_pos.clear();
+        sparse = out;
+    }
+
+    void Add(int index, float presence, float speed, float jerk, float inertia) {
+        std::pair<std::unordered_map<int, int>::iterator, bool> it = index_to_pos.insert(std::make_pair(index, (int)sparse->size()));
+        if (it.second)
+            sparse->push_back(SparseVoxel(index, presence, speed, jerk, inertia, 0.0f));
+        else
+            vp_merge_sparse_values((*sparse)[it.first->second], presence, speed, jerk, inertia);
+    }
+
+    void End() {}
+
+private:
+    std::unordered_map<int, int> index_to_pos;
+    std::vector<SparseVoxel>* sparse;
+};
+
+// 書き込みの記録を整列して集約（出力はボクセル番号順）
+class SortedRunVoxelAccumulator {
+public:
+    void Begin(int /*resolution*/, std::vector<SparseVoxel>* out) {
+        records.clear();
+        sparse = out;
+    }
+
+    void Add(int index, float presence, float speed, float jerk, float inertia) {
+        records.push_back(SparseVoxel(index, presence, speed, jerk, inertia, 0.0f));
+    }
+
+    void End() {
+        // 同じボクセルの記録は書き込み順を保って連続させる
+        std::stable_sort(records.begin(), records.end(),
+                         [](const SparseVoxel& a, const SparseVoxel& b) { return a.index < b.index; });
+        for (size_t k = 0; k < records.size(); ++k) {
+            const SparseVoxel& r = records[k];
+            if (sparse->empty() || sparse->back().index != r.index)
+                sparse->push_back(r);
+            else
+                vp_merge_sparse_values(sparse->back(), r.values[0], r.values[1], r.values[2], r.values[3]);
+        }
+    }
+
+private:
+    std::vector<SparseVoxel> records;
+    std::vector<SparseVoxel>* sparse;
+};
+
+// 集約方法ごとの作業領域（スレッドごとに1つ）
+struct VpAccumulatorScratch {
+    DenseVoxelAccumulator dense;
+    HashVoxelAccumulator hash;
+    SortedRunVoxelAccumulator sorted_run;
+};
+
+// スレッドごとの作業領域のプール（フレームキャッシュの構築・先読みの各スレッドが個別に使用）
+static ObjectPool<VpPoseScratch>& vp_get_pose_scratch_pool() {
+    static thread_local ObjectPool<VpPoseScratch> pool;
+    return pool;
+}
+
+static ObjectPool<VpFrameScratch>& vp_get_frame_scratch_pool() {
+    static thread_local ObjectPool<VpFrameScratch> pool;
+    return pool;
+}
+
+static ObjectPool<VpAccumulatorScratch>& vp_get_accumulator_scratch_pool() {
+    static thread_local ObjectPool<VpAccumulatorScratch> pool;
+    return pool;
+}
+
+// --- ラスタライズ ---
+
+// ボーンの軸平行境界ボックス（AABB）をボクセル座標で計算（bounds はボクセル化するグリッドの範囲）
+static void vp_compute_bone_aabb(const Point3f& p1, const Point3f& p2, float radius, const VoxelizationSettings& settings,
+                                 const float bounds[3][2], const float world_range[3], int idx_min[3], int idx_max[3]) {
+    const float a[3] = {p1.x, p1.y, p1.z};
+    const float b[3] = {p2.x, p2.y, p2.z};
+    int res = settings.resolution;
+    for (int i = 0; i < 3; ++i) {
+        float b_min = (std::min)(a[i], b[i]) - radius;
+        float b_max = (std::max)(a[i], b[i]) + radius;
+        idx_min[i] = (std::max)(0, (int)(((b_min - bounds[i][0]) / world_range[i]) * res));
+        idx_max[i] = (std::min)(res - 1, (int)(((b_max - bounds[i][0]) / world_range[i]) * res));
+    }
+}
+
+// ボーンの影響をガウス分布で重み付けして集約先に書き込み
+template <class Accumulator>
+static void vp_rasterize_bone(const BoneData& bone, const VoxelizationSettings& settings, const float bounds[3][2], const float world_range[3],
+                              Accumulator& acc) {
+    if (!bone.valid)
+        return;
+
+    float bone_radius = settings.bone_radius;
+    int res = settings.resolution;
+    int idx_min[3], idx_max[3];
+    vp_compute_bone_aabb(bone.p1, bone.p2, bone_radius, settings, bounds, world_range, idx_min, idx_max);
+
+    Point3f bone_vec = bone.p2 - bone.p1;
+    float bone_len_sq = bone_vec.x*bone_vec.x + bone_vec.y*bone_vec.y + bone_vec.z*bone_vec.z;
+    if (bone_len_sq < 1e-6f)
+        return;
+
+    float sigma_sq = 2.0f * (bone_radius/2.0f) * (bone_radius/2.0f);
+    float radius_sq = bone_radius * bone_radius;
+
+    for (int z = idx_min[2]; z <= idx_max[2]; ++z) {
+        for (int y = idx_min[1]; y <= idx_max[1]; ++y) {
+            for (int x = idx_min[0]; x <= idx_max[0]; ++x) {
+                float wc[3];
+                wc[0] = bounds[0][0] + (x + 0.5f) * (world_range[0] / res);
+                wc[1] = bounds[1][0] + (y + 0.5f) * (world_range[1] / res);
+                wc[2] = bounds[2][0] + (z + 0.5f) * (world_range[2] / res);
+
+                Point3f voxel_center(wc[0], wc[1], wc[2]);
+                Point3f v_to_p1 = voxel_center - bone.p1;
+                float t = (v_to_p1.x*bone_vec.x + v_to_p1.y*bone_vec.y + v_to_p1.z*bone_vec.z) / bone_len_sq;
+                float k_clamped = (std::max)(0.0f, (std::min)(1.0f, t));
+                Point3f closest = bone.p1 + bone_vec * k_clamped;
+
+                float dist_sq = pow(voxel_center.x - closest.x, 2.0) + pow(voxel_center.y - closest.y, 2.0) + pow(voxel_center.z - closest.z, 2.0);
+                if (dist_sq >= radius_sq)
+                    continue;
+
+                int idx = x + y * res + z * res * res;
+                float s_interp = (1.0f - k_clamped) * bone.speed1 + k_clamped * bone.speed2;
+                float j_interp = (1.0f - k_clamped) * bone.jerk1 + k_clamped * bone.jerk2;
+                float i_interp = (1.0f - k_clamped) * bone.inertia1 + k_clamped * bone.inertia2;
+                acc.Add(idx, exp(-dist_sq / sigma_sq), s_interp, j_interp, i_interp);
+            }
+        }
+    }
+}
+
+// ワールド座標をルート相対の座標に変換（root_ori^T * (p - root_pos)）
+static Point3f vp_world_to_root_local(const Point3f& p, const Point3f& root_pos, const Matrix3f& root_ori) {
+    float dx = p.x - root_pos.x;
+    float dy = p.y - root_pos.y;
+    float dz = p.z - root_pos.z;
+    return Point3f(root_ori.m00 * dx + root_ori.m10 * dy + root_ori.m20 * dz,
+                   root_ori.m01 * dx + root_ori.m11 * dy + root_ori.m21 * dz,
+                   root_ori.m02 * dx + root_ori.m12 * dy + root_ori.m22 * dz);
+}
+
+// 部位ごとにボーンを書き込んで集約（部位ごとのボーンは1本のため、集約先の作業領域は部位間で共有する）
+// 部位ごとの局所グリッドでは、ボーンの両端点をルート相対の座標に変換して部位の範囲のグリッドに書き込む（剛体変換のため重みは変わらない）
+template <class Accumulator>
+static void vp_rasterize_bones(const std::vector<BoneData>& bones, int num_segments, const VoxelizationSettings& settings,
+                               const Point3f& root_pos, const Matrix3f& root_ori,
+                               Accumulator& acc, std::vector<std::vector<SparseVoxel>>& seg_sparse_values) {
+    bool segment_local = (int)settings.segment_bounds.size() >= num_segments;
+    float world_range[3];
+    for (int i = 0; i < 3; ++i)
+        world_range[i] = settings.world_bounds[i][1] - settings.world_bounds[i][0];
+
+    for (const BoneData& bone : bones) {
+        if (!bone.valid)
+            continue;
+        if (bone.segment_index < 0 || bone.segment_index >= num_segments)
+            continue;
+        acc.Begin(settings.resolution, &seg_sparse_values[bone.segment_index]);
+        if (segment_local) {
+            const SegmentGridBounds& local = settings.segment_bounds[bone.segment_index];
+            float local_range[3];
+            for (int i = 0; i < 3; ++i)
+                local_range[i] = local.bounds[i][1] - local.bounds[i][0];
+            BoneData local_bone = bone;
+            local_bone.p1 = vp_world_to_root_local(bone.p1, root_pos, root_ori);
+            local_bone.p2 = vp_world_to_root_local(bone.p2, root_pos, root_ori);
+            vp_rasterize_bone(local_bone, settings, local.bounds, local_range, acc);
+        } else {
+            vp_rasterize_bone(bone, settings, settings.world_bounds, world_range, acc);
+        }
+        acc.End();
+    }
+}
+
+// --- ボクセル化の各段階 ---
+
+const char* GetVoxelAccumulatorName(int type) {
+    static const char* names[VOXEL_ACCUMULATOR_COUNT] = {"dense", "hash", "sorted_run"};
+    if (type < 0 || type >= VOXEL_ACCUMULATOR_COUNT)
+        return "unknown";
+    return names[type];
+}
+
+const char* GetPrincipalAxisModeName(int mode) {
+    static const char* names[PRINCIPAL_AXIS_COUNT] = {"bone", "voxel_pca"};
+    if (mode < 0 || mode >= PRINCIPAL_AXIS_COUNT)
+        return "unknown";
+    return names[mode];
+}
+
+// 1. 指定時刻と前3フレーム分の姿勢データを計算（速度・ジャーク計算用）
+void ComputeVoxelizationFrameData(Motion* m, float time, FrameData& frame_data) {
+    if (!m) 
+        return;
+    
+    // 姿勢はスレッドごとのプールから取得し、関節回転の配列を再利用
+    PooledObject<VpPoseScratch> poses(vp_get_pose_scratch_pool());
+    poses->Bind(m->body);
+    Posture& curr_pose = poses->curr;
+    Posture& prev_pose = poses->prev;
+    Posture& prev2_pose = poses->prev2;
+    Posture& prev3_pose = poses->prev3;
+    
+    frame_data.dt = m->interval;
+    float prev_time = time - frame_data.dt;
+    float prev2_time = time - 2.0f * frame_data.dt;
+    float prev3_time = time - 3.0f * frame_data.dt;
+    if (prev_time < 0) prev_time = 0;
+    if (prev2_time < 0) prev2_time = 0;
+    if (prev3_time < 0) prev3_time = 0;
+
+    m->GetPosture(time, curr_pose);
+    m->GetPosture(prev_time, prev_pose);
+    m->GetPosture(prev2_time, prev2_pose);
+    m->GetPosture(prev3_time, prev3_pose);
+
+    curr_pose.ForwardKinematics(frame_data.curr_frames, frame_data.curr_joint_pos);
+    prev_pose.ForwardKinematics(frame_data.prev_frames, frame_data.prev_joint_pos);
+    prev2_pose.ForwardKinematics(frame_data.prev2_frames, frame_data.prev2_joint_pos);
+    prev3_pose.ForwardKinematics(frame_data.prev3_frames, frame_data.prev3_joint_pos);
+
+    frame_data.curr_root_pos.set(curr_pose.root_pos);
+    frame_data.curr_root_ori = curr_pose.root_ori;
+    frame_data.prev_root_pos.set(prev_pose.root_pos);
+}
+
+// 2. フレームデータから全ボーンの位置・速度・ジャークを抽出
+void ExtractVoxelizationBones(Motion* m, const FrameData& frame_data, std::vector<BoneData>& bones) {
+    bones.clear();
+    bones.reserve(m->body->num_segments);
+    
+    for (int s = 0; s < m->body->num_segments; ++s) {
+        const Segment* seg = m->body->segments[s];
+        BoneData bone;
+        bone.segment_index = s;
+        bone.valid = false;
+        
+        // 指をスキップ
+        if (IsFingerSegment(seg)) {
+            bones.push_back(bone);
+            continue;
+        }
+
+        if (seg->num_joints == 1) {
+            bone.p1 = Point3f(frame_data.curr_frames[s].m03, frame_data.curr_frames[s].m13, frame_data.curr_frames[s].m23);
+            bone.p1_prev = Point3f(frame_data.prev_frames[s].m03, frame_data.prev_frames[s].m13, frame_data.prev_frames[s].m23);
+            bone.p1_prev2 = Point3f(frame_data.prev2_frames[s].m03, frame_data.prev2_frames[s].m13, frame_data.prev2_frames[s].m23);
+            bone.p1_prev3 = Point3f(frame_data.prev3_frames[s].m03, frame_data.prev3_frames[s].m13, frame_data.prev3_frames[s].m23);
+            
+            if (seg->has_site) {
+                // site_positionをワールド座標に変換
+                Matrix3f R_curr(frame_data.curr_frames[s].m00, frame_data.curr_frames[s].m01, frame_data.curr_frames[s].m02, 
+                                frame_data.curr_frames[s].m10, frame_data.curr_frames[s].m11, frame_data.curr_frames[s].m12, 
+                                frame_data.curr_frames[s].m20, frame_data.curr_frames[s].m21, frame_data.curr_frames[s].m22);
+                Point3f offset = seg->site_position;
+                R_curr.transform(&offset);
+                bone.p2 = bone.p1 + offset;
+
+                Matrix3f R_prev(frame_data.prev_frames[s].m00, frame_data.prev_frames[s].m01, frame_data.prev_frames[s].m02, 
+                                frame_data.prev_frames[s].m10, frame_data.prev_frames[s].m11, frame_data.prev_frames[s].m12, 
+                                frame_data.prev_frames[s].m20, frame_data.prev_frames[s].m21, frame_data.prev_frames[s].m22);
+                Point3f offset_prev = seg->site_position;
+                R_prev.transform(&offset_prev);
+                bone.p2_prev = bone.p1_prev + offset_prev;
+
+                Matrix3f R_prev2(frame_data.prev2_frames[s].m00, frame_data.prev2_frames[s].m01, frame_data.prev2_frames[s].m02, 
+                                 frame_data.prev2_frames[s].m10, frame_data.prev2_frames[s].m11, frame_data.prev2_frames[s].m12, 
+                                 frame_data.prev2_frames[s].m20, frame_data.prev2_frames[s].m21, frame_data.prev2_frames[s].m22);
+                Point3f offset_prev2 = seg->site_position;
+                R_prev2.transform(&offset_prev2);
+                bone.p2_prev2 = bone.p1_prev2 + offset_prev2;
+
+                Matrix3f R_prev3(frame_data.prev3_frames[s].m00, frame_data.prev3_frames[s].m01, frame_data.prev3_frames[s].m02, 
+                                 frame_data.prev3_frames[s].m10, frame_data.prev3_frames[s].m11, frame_data.prev3_frames[s].m12,
+                                 frame_data.prev3_frames[s].m20, frame_data.prev3_frames[s].m21, frame_data.prev3_frames[s].m22);
+                Point3f offset_prev3 = seg->site_position;
+                R_prev3.transform(&offset_prev3);
+                bone.p2_prev3 = bone.p1_prev3 + offset_prev3;
+
+                bone.valid = true;
+            }
+        } else if (seg->num_joints >= 2) {
+            Joint* root_joint = seg->joints[0];
+            Joint* end_joint = seg->joints[1];
+            
+            bone.p1 = frame_data.curr_joint_pos[root_joint->index];
+            bone.p2 = frame_data.curr_joint_pos[end_joint->index];
+            bone.p1_prev = frame_data.prev_joint_pos[root_joint->index];
+            bone.p2_prev = frame_data.prev_joint_pos[end_joint->index];
+            bone.p1_prev2 = frame_data.prev2_joint_pos[root_joint->index];
+            bone.p2_prev2 = frame_data.prev2_joint_pos[end_joint->index];
+            bone.p1_prev3 = frame_data.prev3_joint_pos[root_joint->index];
+            bone.p2_prev3 = frame_data.prev3_joint_pos[end_joint->index];
+
+            bone.valid = true;
+        }
+        
+        // 速度とジャークと慣性モーメントを計算
+        if (bone.valid) {
+            Vector3f spd1_curr = bone.p1 - bone.p1_prev;
+            Vector3f spd2_curr = bone.p2 - bone.p2_prev;
+            bone.speed1 = spd1_curr.length() / frame_data.dt;
+            bone.speed2 = spd2_curr.length() / frame_data.dt;
+
+            Vector3f spd1_prev = bone.p1_prev - bone.p1_prev2;
+            Vector3f spd2_prev = bone.p2_prev - bone.p2_prev2;
+            Vector3f spd1_prev2 = bone.p1_prev2 - bone.p1_prev3;
+            Vector3f spd2_prev2 = bone.p2_prev2 - bone.p2_prev3;
+
+            Vector3f accel1_curr = spd1_curr - spd1_prev;
+            Vector3f accel2_curr = spd2_curr - spd2_prev;
+            Vector3f accel1_prev = spd1_prev - spd1_prev2;
+            Vector3f accel2_prev = spd2_prev - spd2_prev2;
+
+            Vector3f jerk1_curr = accel1_curr - accel1_prev;
+            Vector3f jerk2_curr = accel2_curr - accel2_prev;
+            bone.jerk1 = jerk1_curr.length() / frame_data.dt;
+            bone.jerk2 = jerk2_curr.length() / frame_data.dt;
+
+            // 慣性モーメント: ルートからの距離の2乗
+            Vector3f d1 = bone.p1 - frame_data.curr_root_pos;
+            Vector3f d2 = bone.p2 - frame_data.curr_root_pos;
+            bone.inertia1 = d1.x*d1.x + d1.y*d1.y + d1.z*d1.z;
+            bone.inertia2 = d2.x*d2.x + d2.y*d2.y + d2.z*d2.z;
+
+            // 軸の角速度: 前フレームの軸方向との角度（軸の向きは区別しない）
+            Vector3f axis_curr = bone.p2 - bone.p1;
+            Vector3f axis_prev = bone.p2_prev - bone.p1_prev;
+            float len_curr = axis_curr.length();
+            float len_prev = axis_prev.length();
+            if (len_curr > 1e-3f && len_prev > 1e-3f && frame_data.dt > 1e-8f) {
+                float dot = fabsf(axis_curr.dot(axis_prev)) / (len_curr * len_prev);
+                dot = (std::min)(1.0f, dot);
+                bone.axis_speed = acosf(dot) / frame_data.dt;
+            }
+        }
+        
+        bones.push_back(bone);
+    }
+}
+
+// 部位ごとの局所グリッドの範囲を計算
+void ComputeSegmentGridBounds(Motion* m1, Motion* m2, float margin, float min_extent, std::vector<SegmentGridBounds>& segment_bounds) {
+    int num_segments = 0;
+    if (m1 && m1->body)
+        num_segments = m1->body->num_segments;
+    if (m2 && m2->body)
+        num_segments = (std::max)(num_segments, m2->body->num_segments);
+
+    segment_bounds.assign(num_segments, SegmentGridBounds());
+    std::vector<char> has_bone(num_segments, 0);
+    for (int s = 0; s < num_segments; ++s) {
+        for (int i = 0; i < 3; ++i) {
+            segment_bounds[s].bounds[i][0] = 1e6f;
+            segment_bounds[s].bounds[i][1] = -1e6f;
+        }
+    }
+
+    // 各フレームのボーンの両端点をルート相対の座標に変換して範囲を更新
+    PooledObject<VpFrameScratch> scratch(vp_get_frame_scratch_pool());
+    Motion* motions[2] = { m1, m2 };
+    for (int k = 0; k < 2; ++k) {
+        Motion* m = motions[k];
+        if (!m || !m->body)
+            continue;
+        for (int f = 0; f < m->num_frames; ++f) {
+            ComputeVoxelizationFrameData(m, f * m->interval, scratch->frame_data);
+            ExtractVoxelizationBones(m, scratch->frame_data, scratch->bones);
+            for (const BoneData& bone : scratch->bones) {
+                if (!bone.valid || bone.segment_index < 0 || bone.segment_index >= num_segments)
+                    continue;
+                SegmentGridBounds& b = segment_bounds[bone.segment_index];
+                const Point3f ends[2] = {
+                    vp_world_to_root_local(bone.p1, scratch->frame_data.curr_root_pos, scratch->frame_data.curr_root_ori),
+                    vp_world_to_root_local(bone.p2, scratch->frame_data.curr_root_pos, scratch->frame_data.curr_root_ori)
+                };
+                for (int e = 0; e < 2; ++e) {
+                    const float p[3] = { ends[e].x, ends[e].y, ends[e].z };
+                    for (int i = 0; i < 3; ++i) {
+                        b.bounds[i][0] = (std::min)(b.bounds[i][0], p[i]);
+                        b.bounds[i][1] = (std::max)(b.bounds[i][1], p[i]);
+                    }
+                }
+                has_bone[bone.segment_index] = 1;
+            }
+        }
+    }
+
+    // 余白を加え、最も長い辺に揃えた立方体に広げる（有効なボーンがない部位はルート位置を中心とする立方体）
+    for (int s = 0; s < num_segments; ++s) {
+        SegmentGridBounds& b = segment_bounds[s];
+        float center[3], half = (std::max)(margin, 0.5f * min_extent);
+        for (int i = 0; i < 3; ++i) {
+            center[i] = has_bone[s] ? 0.5f * (b.bounds[i][0] + b.bounds[i][1]) : 0.0f;
+            if (has_bone[s])
+                half = (std::max)(half, 0.5f * (b.bounds[i][1] - b.bounds[i][0]) + margin);
+        }
+        for (int i = 0; i < 3; ++i) {
+            b.bounds[i][0] = center[i] - half;
+            b.bounds[i][1] = center[i] + half;
+        }
+    }
+}
+
+// ボーンを部位ごとの疎ボクセルに変換し、閾値以下のボクセルを除く
+void VoxelizationPipeline::RasterizeBones(const std::vector<BoneData>& bones, int num_segments, const Point3f& root_pos, const Matrix3f& root_ori,
+                                          std::vector<std::vector<SparseVoxel>>& seg_sparse_values) const {
+    // 出力先の確保済みの領域を再利用するため、部位数のみ合わせて各部位を空にする
+    seg_sparse_values.resize(num_segments);
+    for (int s = 0; s < num_segments; ++s)
+        seg_sparse_values[s].clear();
+
+    PooledObject<VpAccumulatorScratch> acc(vp_get_accumulator_scratch_pool());
+    switch (settings.accumulator) {
+    case VOXEL_ACCUMULATOR_HASH:
+        vp_rasterize_bones(bones, num_segments, settings, root_pos, root_ori, acc->hash, seg_sparse_values);
+        break;
+    case VOXEL_ACCUMULATOR_SORTED_RUN:
+        vp_rasterize_bones(bones, num_segments, settings, root_pos, root_ori, acc->sorted_run, seg_sparse_values);
+        break;
+    default:
+        vp_rasterize_bones(bones, num_segments, settings, root_pos, root_ori, acc->dense, seg_sparse_values);
+        break;
+    }
+
+    // 部位ごとの慣性主軸角速度（部位ごとのボーンは1本のため、部位の全ボクセルで同じ値）
+    ScratchArenaScope scope(GetThreadScratchArena());
+    float* axis_speeds = GetThreadScratchArena().AllocateArray<float>(num_segments);
+    for (int s = 0; s < num_segments; ++s)
+        axis_speeds[s] = 0.0f;
+    if (settings.principal_axis == PRINCIPAL_AXIS_BONE) {
+        for (const BoneData& bone : bones) {
+            if (bone.valid && bone.segment_index >= 0 && bone.segment_index < num_segments)
+                axis_speeds[bone.segment_index] = (std::max)(axis_speeds[bone.segment_index], bone.axis_speed);
+        }
+    }
+
+    // 4特徴量のいずれかが閾値より大きい疎ボクセルのみを前に詰める
+    // 4特徴量をまとめて閾値と比較したマスクから残すかを求め、分岐せずに常に書き込み、残す場合のみ書き込み位置を進める
+    float threshold = settings.sparse_threshold;
+#ifdef VOXELIZATION_PIPELINE_USE_SSE
+    const __m128 threshold4 = _mm_set1_ps(threshold);
+#endif
+    for (int s = 0; s < num_segments; ++s) {
+        std::vector<SparseVoxel>& sparse = seg_sparse_values[s];
+        size_t write_pos = 0;
+        for (size_t k = 0; k < sparse.size(); ++k) {
+            SparseVoxel sv = sparse[k];
+            sv.values[4] = axis_speeds[s];
+#ifdef VOXELIZATION_PIPELINE_USE_SSE
+            size_t keep = (_mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(sv.values), threshold4)) != 0) ? 1 : 0;
+#else
+            size_t keep = (size_t)((sv.values[0] > threshold) | (sv.values[1] > threshold) | (sv.values[2] > threshold) | (sv.values[3] > threshold));
+#endif
+            sparse[write_pos] = sv;
+            write_pos += keep;
+        }
+        sparse.resize(write_pos);
+    }
+}
+
+// 1フレーム分の部位ごとの疎ボクセルを計算
+void VoxelizationPipeline::BuildFrame(Motion* m, float time, std::vector<std::vector<SparseVoxel>>& seg_sparse_values) const {
+    if (!m || !m->body)
+        return;
+
+    PooledObject<VpFrameScratch> scratch(vp_get_frame_scratch_pool());
+    ComputeVoxelizationFrameData(m, time, scratch->frame_data);
+    ExtractVoxelizationBones(m, scratch->frame_data, scratch->bones);
+    RasterizeBones(scratch->bones, m->body->num_segments, scratch->frame_data.curr_root_pos, scratch->frame_data.curr_root_ori, seg_sparse_values);
+}
+
+// 1フレーム分の疎ボクセルを計算し、基準姿勢とともに格納
+void VoxelizationPipeline::BuildFrameEntry(Motion* m, int frame, FrameSegmentVoxelGrid& out) const {
+    int num_segments = m->body->num_segments;
+    if (out.num_segments != num_segments || (int)out.segment_grids.size() != num_segments)
+        out.Resize(num_segments, settings.resolution);
+    else
+        out.Clear();
+
+    // 計算結果は出力先と入れ替え、出力先が保持していた配列を次のフレームで再利用
+    PooledObject<VpFrameScratch> scratch(vp_get_frame_scratch_pool());
+    std::vector<std::vector<SparseVoxel>>& seg_sparse_values = scratch->seg_sparse_values;
+    BuildFrame(m, frame * m->interval, seg_sparse_values);
+    for (int s = 0; s < num_segments; ++s) {
+        out.segment_grids[s].SetReference(m->frames[frame].root_pos, m->frames[frame].root_ori);
+        out.segment_grids[s].voxels.swap(seg_sparse_values[s]);
+    }
+}
+
+// 全フレームを計算して保存先に追加
+bool VoxelizationPipeline::BuildMotion(Motion* m, FrameVoxelStore& store, const FrameFilter& filter, const ProgressFunction& progress) const {
+    TRACE_SCOPE_CAT("VoxelizationPipeline::BuildMotion", "analysis");
+
+    if (!m || !m->body || m->num_frames <= 0)
+        return false;
+    if (!store.Begin(m->num_frames, m->body->num_segments, settings.resolution, settings.segment_bounds, settings.sparse_threshold))
+        return false;
+
+    // 前フレームを参照する処理のため、直前の2フレーム分のみ展開した状態で保持
+    // 保存時の作業領域はフレームごとにアリーナを巻き戻して再利用
+    FrameSegmentVoxelGrid frame_sparse[2];
+    ScratchArena& arena = GetThreadScratchArena();
+    for (int f = 0; f < m->num_frames; ++f) {
+        ScratchArenaScope frame_scope(arena);
+        FrameSegmentVoxelGrid& curr = frame_sparse[f & 1];
+        BuildFrameEntry(m, f, curr);
+        if (filter)
+            filter(m, f, (f > 0) ? &frame_sparse[(f - 1) & 1] : nullptr, curr);
+        if (!store.AppendFrame(curr)) {
+            store.Abort();
+            return false;
+        }
+
+        if (progress && !progress(f + 1, m->num_frames)) {
+            store.Abort();
+            return false;
+        }
+    }
+    return store.End();
+}
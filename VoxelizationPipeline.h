@@ -0,0 +1,133 @@
+#pragma once
+#include <vector>
+#include <functional>
+#include "SimpleHuman.h"
+#include "VoxelData.h"
+
+class FrameVoxelStore;
+
+// ボクセル化の処理の流れ（空間解析のフレームキャッシュ・瞬間ボクセルの構築で共通）
+//   1. 姿勢の取得    : 指定時刻と前3フレーム分の姿勢の順運動学計算（ComputeVoxelizationFrameData）
+//   2. ボーンの抽出  : 部位ごとのボーンの両端点・速度・ジャーク・慣性モーメント・軸の角速度（ExtractVoxelizationBones）
+//   3. ラスタライズ  : ボーンの周囲のボクセルにガウス分布で重み付けした値を書き込む
+//   4. 集約          : ボクセルごとに占有率は合計、速度・ジャーク・慣性モーメントは最大値をとり、閾値以下を除く
+//   5. 保存          : 1フレーム分の疎ボクセルを保存先（FrameVoxelStore）に追加
+// 集約の方法（VoxelAccumulatorType）と保存先は入れ替えられ、いずれの組み合わせでも同じ値を計算する
+
+// ボーン情報を格納する構造体（ボクセル化処理の共通化用）
+struct BoneData {
+    Point3f p1, p2;           // 現在フレームの両端点
+    Point3f p1_prev, p2_prev; // 前フレームの両端点
+    Point3f p1_prev2, p2_prev2; // 2フレーム前の両端点（加速度計算用）
+	Point3f p1_prev3, p2_prev3; // 3フレーム前の両端点（ジャーク計算用）
+	float speed1, speed2;     // 両端の速度
+	float jerk1, jerk2;       // 両端のジャーク
+	float inertia1, inertia2; // 両端の慣性モーメント（ルートからの距離の2乗）
+	float axis_speed;         // ボーンの軸方向の角速度（前フレームの軸方向との角度 / フレーム間隔）
+	int segment_index;        // セグメントインデックス
+	bool valid;               // 有効なボーンかどうか
+
+	BoneData() : speed1(0), speed2(0), jerk1(0), jerk2(0), inertia1(0), inertia2(0), axis_speed(0), segment_index(-1), valid(false) {}
+};
+
+// フレームデータを格納する構造体（FK計算結果の共通化用）
+struct FrameData {
+    std::vector<Matrix4f> curr_frames;     // 現在フレームの変換行列
+    std::vector<Matrix4f> prev_frames;     // 前フレームの変換行列
+    std::vector<Matrix4f> prev2_frames;    // 2フレーム前の変換行列（加速度計算用）
+	std::vector<Matrix4f> prev3_frames;    // 3フレーム前の変換行列（ジャーク計算用）
+    Point3f curr_root_pos;  // 現在フレームのルート位置
+    Matrix3f curr_root_ori; // 現在フレームのルートの回転
+    std::vector<Point3f> curr_joint_pos;   // 現在フレームの関節位置
+    std::vector<Point3f> prev_joint_pos;   // 前フレームの関節位置
+    std::vector<Point3f> prev2_joint_pos;  // 2フレーム前の関節位置（加速度計算用）
+	std::vector<Point3f> prev3_joint_pos;  // 3フレーム前の関節位置（ジャーク計算用）
+    float dt;                              // フレーム間隔
+    Point3f prev_root_pos;                 // 前フレームのルート位置
+
+	FrameData() : dt(0) {}
+};
+
+// ラスタライズした値の集約方法
+enum VoxelAccumulatorType {
+    VOXEL_ACCUMULATOR_DENSE = 0,      // 解像度の3乗の対応表（ボクセル番号→疎ボクセルの位置）を引く
+    VOXEL_ACCUMULATOR_HASH = 1,       // ハッシュ表（ボクセル番号→疎ボクセルの位置）を引く
+    VOXEL_ACCUMULATOR_SORTED_RUN = 2, // 書き込みを全て記録し、ボクセル番号順に整列して連続する記録をまとめる
+    VOXEL_ACCUMULATOR_COUNT = 3
+};
+
+// 集約方法の名前を取得（dense, hash, sorted_run）
+const char* GetVoxelAccumulatorName(int type);
+
+// 慣性主軸角速度の計算方法
+// 部位の占有率の分布の主軸はボーンの軸方向とほぼ一致するため、通常はボーンの両端点から直接求める
+enum PrincipalAxisMode {
+    PRINCIPAL_AXIS_BONE = 0,      // ボーンの軸方向の角速度をボーンの抽出時に計算（前フレームのボクセル化が不要）
+    PRINCIPAL_AXIS_VOXEL_PCA = 1, // 部位の占有率で重み付けしたボクセルの主成分分析（検証用、前フレームの疎ボクセルが必要）
+    PRINCIPAL_AXIS_COUNT = 2
+};
+
+// 慣性主軸角速度の計算方法の名前を取得（bone, voxel_pca）
+const char* GetPrincipalAxisModeName(int mode);
+
+// ボクセル化の設定
+struct VoxelizationSettings {
+    int resolution;                   // ボクセルグリッド解像度
+    float world_bounds[3][2];         // ボクセル化対象領域
+    float bone_radius;                // ボーンの影響半径
+    float sparse_threshold;           // 疎ボクセルとして保持する値の下限
+    VoxelAccumulatorType accumulator; // 集約方法
+    PrincipalAxisMode principal_axis; // 慣性主軸角速度の計算方法（PRINCIPAL_AXIS_BONE 以外は集約後の値を 0 とし、呼び出し側で設定する）
+    std::vector<SegmentGridBounds> segment_bounds; // 部位ごとの局所グリッドの範囲（空なら全部位を world_bounds のグリッドにボクセル化）
+
+    VoxelizationSettings() : resolution(64), bone_radius(0.08f), sparse_threshold(1e-4f), accumulator(VOXEL_ACCUMULATOR_DENSE),
+                             principal_axis(PRINCIPAL_AXIS_BONE) {
+        for (int i = 0; i < 3; ++i) {
+            world_bounds[i][0] = -1.0f;
+            world_bounds[i][1] = 1.0f;
+        }
+    }
+};
+
+// 1. 姿勢の取得（指定時刻と前3フレーム分の姿勢の順運動学計算）
+void ComputeVoxelizationFrameData(Motion* m, float time, FrameData& frame_data);
+
+// 2. ボーンの抽出（部位ごとに1本、指の部位は無効なボーンとする）
+void ExtractVoxelizationBones(Motion* m, const FrameData& frame_data, std::vector<BoneData>& bones);
+
+// 部位ごとの局所グリッドの範囲を計算
+// 2つの動作の全フレームのボーンの両端点のルート相対の座標の範囲に margin を加え、ボクセルが立方体になるよう最も長い辺（min_extent 以上）に揃える
+// 部位の動く範囲のみを覆うため、ワールド座標系の共通グリッドと同じ解像度でも部位ごとに細かいボクセルでボクセル化できる
+// （疎ボクセルの数はボクセルの1辺の3乗に反比例するため、min_extent で細かくなり過ぎないようにする）
+void ComputeSegmentGridBounds(Motion* m1, Motion* m2, float margin, float min_extent, std::vector<SegmentGridBounds>& segment_bounds);
+
+class VoxelizationPipeline {
+public:
+    // 集約後・保存前に1フレーム分の疎ボクセルに適用する処理（prev は前フレームの適用後の疎ボクセル、先頭フレームは nullptr）
+    typedef std::function<void(Motion* m, int frame, const FrameSegmentVoxelGrid* prev, FrameSegmentVoxelGrid& curr)> FrameFilter;
+
+    // 進捗の通知（1フレームごとに呼ばれ、false を返すと処理を中断する）
+    typedef std::function<bool(int done, int total)> ProgressFunction;
+
+    explicit VoxelizationPipeline(const VoxelizationSettings& s) : settings(s) {}
+
+    const VoxelizationSettings& GetSettings() const { return settings; }
+
+    // 1～4. 1フレーム分の部位ごとの疎ボクセル（占有率・速度・ジャーク・慣性モーメント）を計算
+    void BuildFrame(Motion* m, float time, std::vector<std::vector<SparseVoxel>>& seg_sparse_values) const;
+
+    // 3～4. ボーンを部位ごとの疎ボクセルに変換（PRINCIPAL_AXIS_BONE なら各部位のボーンの軸の角速度を慣性主軸角速度とする）
+    // 部位ごとの局所グリッドでは、ボーンの両端点を root_pos・root_ori を基準とするルート相対の座標に変換してから書き込む
+    void RasterizeBones(const std::vector<BoneData>& bones, int num_segments, const Point3f& root_pos, const Matrix3f& root_ori,
+                        std::vector<std::vector<SparseVoxel>>& seg_sparse_values) const;
+
+    // 1～4. 1フレーム分の疎ボクセルを計算し、基準姿勢とともに out に格納（out の確保済みの領域を再利用）
+    void BuildFrameEntry(Motion* m, int frame, FrameSegmentVoxelGrid& out) const;
+
+    // 1～5. 全フレームを計算して保存先に追加（中断された場合は保存先を破棄して false を返す）
+    bool BuildMotion(Motion* m, FrameVoxelStore& store, const FrameFilter& filter = FrameFilter(),
+                     const ProgressFunction& progress = ProgressFunction()) const;
+
+private:
+    VoxelizationSettings settings;
+};